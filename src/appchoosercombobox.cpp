@@ -21,6 +21,7 @@
 #include "appchooserdialog.h"
 #include "utilities.h"
 #include "core/iconinfo.h"
+#include "core/appinfocache.h"
 
 namespace Fm {
 
@@ -47,19 +48,17 @@ void AppChooserComboBox::setMimeType(std::shared_ptr<const Fm::MimeType> mimeTyp
     mimeType_ = std::move(mimeType);
     if(mimeType_) {
         const char* typeName = mimeType_->name();
-        defaultApp_ = Fm::GAppInfoPtr{g_app_info_get_default_for_type(typeName, FALSE), false};
-        GList* appInfos_glist = g_app_info_get_all_for_type(typeName);
+        defaultApp_ = Fm::AppInfoCache::defaultAppForType(typeName);
+        appInfos_ = Fm::AppInfoCache::appsForType(typeName);
         int i = 0;
-        for(GList* l = appInfos_glist; l; l = l->next, ++i) {
-            Fm::GAppInfoPtr app{G_APP_INFO(l->data), false};
+        for(auto& app: appInfos_) {
             GIcon* gicon = g_app_info_get_icon(app.get());
             addItem(gicon ? Fm::IconInfo::fromGIcon(gicon)->qicon(): QIcon(), g_app_info_get_name(app.get()));
-            if(g_app_info_equal(app.get(), defaultApp_.get())) {
+            if(defaultApp_ && g_app_info_equal(app.get(), defaultApp_.get())) {
                 defaultAppIndex_ = i;
             }
-            appInfos_.push_back(std::move(app));
+            ++i;
         }
-        g_list_free(appInfos_glist);
     }
     // add "Other applications" item
     insertSeparator(count());
@@ -23,6 +23,7 @@
 #include <QPushButton>
 #include <gio/gdesktopappinfo.h>
 #include <glib/gstdio.h>
+#include "core/appinfocache.h"
 
 namespace Fm {
 
@@ -160,10 +161,8 @@ GAppInfo* AppChooserDialog::customCommandToApp() {
         if(mimeType_) {
             MenuCache* menu_cache;
             /* see if the command is already in the list of known apps for this mime-type */
-            GList* apps = g_app_info_get_all_for_type(mimeType_->name());
-            GList* l;
-            for(l = apps; l; l = l->next) {
-                GAppInfo* app2 = G_APP_INFO(l->data);
+            for(auto& appInfo: AppInfoCache::appsForType(mimeType_->name())) {
+                GAppInfo* app2 = appInfo.get();
                 const char* cmd = g_app_info_get_commandline(app2);
                 char* bin2 = get_binary(cmd, nullptr);
                 if(g_strcmp0(bin1, bin2) == 0) {
@@ -174,8 +173,6 @@ GAppInfo* AppChooserDialog::customCommandToApp() {
                 }
                 g_free(bin2);
             }
-            g_list_foreach(apps, (GFunc)g_object_unref, nullptr);
-            g_list_free(apps);
             if(app) {
                 goto _out;
             }
@@ -248,6 +245,8 @@ void AppChooserDialog::accept() {
             if(ui->setDefault->isChecked()) {
                 g_app_info_set_as_default_for_type(selectedApp_.get(), mimeType_->name(), nullptr);
             }
+            // the order of the apps is changed
+            AppInfoCache::invalidate();
         }
     }
 }
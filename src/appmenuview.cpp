@@ -19,6 +19,8 @@
 
 #include "appmenuview.h"
 #include <QStandardItemModel>
+#include <QApplication>
+#include <QPointer>
 #include "appmenuview_p.h"
 #include "core/filepath.h"
 
@@ -26,17 +28,10 @@
 
 namespace Fm {
 
-AppMenuView::AppMenuView(QWidget* parent):
-    QTreeView(parent),
-    model_(new QStandardItemModel()),
+AppMenuModel::AppMenuModel(QObject* parent):
+    QStandardItemModel(parent),
     menu_cache(nullptr),
     menu_cache_reload_notify(nullptr) {
-
-    setHeaderHidden(true);
-    setSelectionMode(SingleSelection);
-
-    // initialize model
-    // TODO: share one model among all app menu view widgets
     // ensure that we're using lxmenu-data (FIXME: should we do this?)
     QByteArray oldenv = qgetenv("XDG_MENU_PREFIX");
     qputenv("XDG_MENU_PREFIX", "lxde-");
@@ -48,17 +43,13 @@ AppMenuView::AppMenuView(QWidget* parent):
         MenuCacheDir* dir = menu_cache_dup_root_dir(menu_cache);
         menu_cache_reload_notify = menu_cache_add_reload_notify(menu_cache, _onMenuCacheReload, this);
         if(dir) { /* content of menu is already loaded */
-            addMenuItems(nullptr, dir);
+            updateItems(invisibleRootItem(), dir);
             menu_cache_item_unref(MENU_CACHE_ITEM(dir));
         }
     }
-    setModel(model_);
-    connect(selectionModel(), &QItemSelectionModel::selectionChanged, this, &AppMenuView::selectionChanged);
-    selectionModel()->select(model_->index(0, 0), QItemSelectionModel::SelectCurrent);
 }
 
-AppMenuView::~AppMenuView() {
-    delete model_;
+AppMenuModel::~AppMenuModel() {
     if(menu_cache) {
         if(menu_cache_reload_notify) {
             menu_cache_remove_reload_notify(menu_cache, menu_cache_reload_notify);
@@ -67,46 +58,85 @@ AppMenuView::~AppMenuView() {
     }
 }
 
-void AppMenuView::addMenuItems(QStandardItem* parentItem, MenuCacheDir* dir) {
+// static
+AppMenuModel* AppMenuModel::globalInstance() {
+    // it's kept until the app quits, so opening the views later doesn't build it again
+    static QPointer<AppMenuModel> instance;
+    if(!instance) {
+        instance = new AppMenuModel(qApp);
+    }
+    return instance;
+}
+
+void AppMenuModel::updateItems(QStandardItem* parentItem, MenuCacheDir* dir) {
     GSList* l;
     GSList* list;
+    int row = 0;
     /* Iterate over all menu items in this directory. */
     for(l = list = menu_cache_dir_list_children(dir); l != nullptr; l = l->next) {
         /* Get the menu item. */
         MenuCacheItem* menuItem = MENU_CACHE_ITEM(l->data);
-        switch(menu_cache_item_get_type(menuItem)) {
-        case MENU_CACHE_TYPE_NONE:
-        case MENU_CACHE_TYPE_SEP:
-            break;
-        case MENU_CACHE_TYPE_APP:
-        case MENU_CACHE_TYPE_DIR: {
-            AppMenuViewItem* newItem = new AppMenuViewItem(menuItem);
-            if(parentItem) {
-                parentItem->insertRow(parentItem->rowCount(), newItem);
-            }
-            else {
-                model_->insertRow(model_->rowCount(), newItem);
+        auto type = menu_cache_item_get_type(menuItem);
+        if(type != MENU_CACHE_TYPE_APP && type != MENU_CACHE_TYPE_DIR) {
+            continue;
+        }
+        // find the item of the same entry, and remove the items before it which are removed or moved
+        const char* id = menu_cache_item_get_id(menuItem);
+        int oldRow = row;
+        for(; oldRow < parentItem->rowCount(); ++oldRow) {
+            auto oldItem = static_cast<AppMenuViewItem*>(parentItem->child(oldRow));
+            if(oldItem->type() == type && g_strcmp0(menu_cache_item_get_id(oldItem->item()), id) == 0) {
+                break;
             }
-
-            if(menu_cache_item_get_type(menuItem) == MENU_CACHE_TYPE_DIR) {
-                addMenuItems(newItem, MENU_CACHE_DIR(menuItem));
+        }
+        AppMenuViewItem* item;
+        if(oldRow < parentItem->rowCount()) {
+            if(oldRow > row) {
+                parentItem->removeRows(row, oldRow - row);
             }
-            break;
+            item = static_cast<AppMenuViewItem*>(parentItem->child(row));
+            item->setItem(menuItem);
         }
+        else {
+            item = new AppMenuViewItem(menuItem);
+            parentItem->insertRow(row, item);
         }
+        if(type == MENU_CACHE_TYPE_DIR) {
+            updateItems(item, MENU_CACHE_DIR(menuItem));
+        }
+        ++row;
     }
     g_slist_free_full(list, (GDestroyNotify)menu_cache_item_unref);
+    if(row < parentItem->rowCount()) {
+        parentItem->removeRows(row, parentItem->rowCount() - row);
+    }
 }
 
-void AppMenuView::onMenuCacheReload(MenuCache* mc) {
+void AppMenuModel::onMenuCacheReload(MenuCache* mc) {
     MenuCacheDir* dir = menu_cache_dup_root_dir(mc);
-    model_->clear();
-    /* FIXME: preserve original selection */
+    // the unchanged items are kept, so the selections of the views are preserved
     if(dir) {
-        addMenuItems(nullptr, dir);
+        updateItems(invisibleRootItem(), dir);
         menu_cache_item_unref(MENU_CACHE_ITEM(dir));
-        selectionModel()->select(model_->index(0, 0), QItemSelectionModel::SelectCurrent);
     }
+    else {
+        clear();
+    }
+}
+
+AppMenuView::AppMenuView(QWidget* parent):
+    QTreeView(parent),
+    model_(AppMenuModel::globalInstance()) {
+
+    setHeaderHidden(true);
+    setSelectionMode(SingleSelection);
+
+    setModel(model_);
+    connect(selectionModel(), &QItemSelectionModel::selectionChanged, this, &AppMenuView::selectionChanged);
+    selectionModel()->select(model_->index(0, 0), QItemSelectionModel::SelectCurrent);
+}
+
+AppMenuView::~AppMenuView() {
 }
 
 bool AppMenuView::isAppSelected() const {
@@ -152,7 +182,7 @@ FilePath AppMenuView::selectedAppDesktopPath() const {
     AppMenuViewItem* item = selectedItem();
     FilePath path;
     if(item && item->isApp()) {
-        char* mpath = menu_cache_dir_make_path(MENU_CACHE_DIR(item));
+        char* mpath = menu_cache_dir_make_path(MENU_CACHE_DIR(item->item()));
         path = FilePath::fromUri("menu://applications/").relativePath(mpath + 13 /* skip "/Applications" */);
         g_free(mpath);
     }
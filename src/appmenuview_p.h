@@ -21,6 +21,7 @@
 #define FM_APPMENUVIEW_P_H
 
 #include <QStandardItem>
+#include <QStandardItemModel>
 #include <menu-cache/menu-cache.h>
 #include "core/iconinfo.h"
 
@@ -29,23 +30,34 @@ namespace Fm {
 class AppMenuViewItem : public QStandardItem {
 public:
     explicit AppMenuViewItem(MenuCacheItem* item):
-        item_(menu_cache_item_ref(item)) {
-        std::shared_ptr<const Fm::IconInfo> icon;
-        if(menu_cache_item_get_icon(item)) {
-            icon = Fm::IconInfo::fromName(menu_cache_item_get_icon(item));
-        }
-        setText(menu_cache_item_get_name(item));
+        item_(nullptr) {
         setEditable(false);
         setDragEnabled(false);
-        if(icon) {
-            setIcon(icon->qicon());
-        }
+        setItem(item);
     }
 
     ~AppMenuViewItem() {
         menu_cache_item_unref(item_);
     }
 
+    // replace the menu item after the menu is reloaded, which only updates what's changed
+    void setItem(MenuCacheItem* item) {
+        auto oldItem = item_;
+        item_ = menu_cache_item_ref(item);
+        QString name = QString::fromUtf8(menu_cache_item_get_name(item));
+        if(name != text()) {
+            setText(name);
+        }
+        const char* iconName = menu_cache_item_get_icon(item);
+        if(!oldItem || g_strcmp0(iconName, menu_cache_item_get_icon(oldItem)) != 0) {
+            auto icon = iconName ? Fm::IconInfo::fromName(iconName) : nullptr;
+            setIcon(icon ? icon->qicon() : QIcon());
+        }
+        if(oldItem) {
+            menu_cache_item_unref(oldItem);
+        }
+    }
+
     MenuCacheItem* item() {
         return item_;
     }
@@ -66,6 +78,32 @@ private:
     MenuCacheItem* item_;
 };
 
+// The tree of the applications menu shared by all the AppMenuViews, which is built once and
+// updated in place when the menu is reloaded.
+class AppMenuModel : public QStandardItemModel {
+    Q_OBJECT
+public:
+    static AppMenuModel* globalInstance();
+
+    ~AppMenuModel() override;
+
+private:
+    explicit AppMenuModel(QObject* parent);
+
+    // make the children of the parent item match the menu dir, keeping the unchanged items
+    void updateItems(QStandardItem* parentItem, MenuCacheDir* dir);
+
+    void onMenuCacheReload(MenuCache* mc);
+
+    static void _onMenuCacheReload(MenuCache* mc, gpointer user_data) {
+        static_cast<AppMenuModel*>(user_data)->onMenuCacheReload(mc);
+    }
+
+private:
+    MenuCache* menu_cache;
+    MenuCacheNotifyId menu_cache_reload_notify;
+};
+
 }
 
 #endif // FM_APPMENUVIEW_P_H
@@ -0,0 +1,146 @@
+#include "asciicollator_p.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Fm {
+
+// the chars of the strings whose order is checked, in pairs, against the collator
+static const char checkedChars[] = "abcdefghijklmnopqrstuvwxyz0189 -._";
+
+static inline bool isDigit(ushort c) {
+    return c >= '0' && c <= '9';
+}
+
+AsciiCollator::AsciiCollator(): isValid_{false} {
+    memset(ranks_, 0, sizeof(ranks_));
+}
+
+void AsciiCollator::setCollator(const QCollator& collator) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    isValid_ = false;
+    collator_ = collator;
+    if(!collator.numericMode()) {
+        return;
+    }
+    // the cases only differ beyond the primary level
+    QCollator primary{collator};
+    primary.setCaseSensitivity(Qt::CaseInsensitive);
+
+    // rank the printable chars, and give the same rank to the ones which are equal
+    std::vector<QString> chars;
+    for(ushort c = 0x20; c <= 0x7e; ++c) {
+        chars.emplace_back(QChar{c});
+    }
+    std::stable_sort(chars.begin(), chars.end(), [&primary](const QString& a, const QString& b) {
+        return primary.compare(a, b) < 0;
+    });
+    unsigned char rank = 1;
+    for(size_t i = 0; i < chars.size(); ++i) {
+        if(primary.compare(chars[i], QString{}) == 0) {
+            return; // the ignorable chars are not handled
+        }
+        if(i > 0 && primary.compare(chars[i - 1], chars[i]) != 0) {
+            ++rank;
+        }
+        ranks_[chars[i][0].unicode()] = rank;
+    }
+    // the digit runs are compared by their values, so no other char can be ordered between the digits
+    for(ushort c = 0x20; c <= 0x7e; ++c) {
+        if(!isDigit(c) && ranks_[c] >= ranks_['0'] && ranks_[c] <= ranks_['9']) {
+            return;
+        }
+    }
+
+    // Sort the pairs of some chars in the learned order, and check that the collator agrees.
+    // This finds the contractions of the locale, like "ch" which comes after "h" in Czech.
+    std::vector<QString> pairs;
+    for(const char* a = checkedChars; *a; ++a) {
+        for(const char* b = checkedChars; *b; ++b) {
+            pairs.emplace_back(QString{QLatin1Char{*a}} + QLatin1Char{*b});
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [this](const QString& a, const QString& b) {
+        return comparePrimary(a, b) < 0;
+    });
+    for(size_t i = 1; i < pairs.size(); ++i) {
+        // the equal ones are compared by the collator anyway
+        if(comparePrimary(pairs[i - 1], pairs[i]) < 0 && primary.compare(pairs[i - 1], pairs[i]) >= 0) {
+            return;
+        }
+    }
+    // the values of the digit runs
+    static const char* const numbers[][2] = {
+        {"a2", "a10"},
+        {"a01b", "a1c"},
+        {"x9y", "x10a"},
+        {"1.5", "1.10"},
+        {"file99", "file100"}
+    };
+    for(const auto& pair: numbers) {
+        QString a = QLatin1String(pair[0]);
+        QString b = QLatin1String(pair[1]);
+        if(comparePrimary(a, b) < 0 && primary.compare(a, b) >= 0) {
+            return;
+        }
+    }
+    isValid_ = true;
+}
+
+int AsciiCollator::compare(const QString& a, const QString& b) const {
+    int comp = comparePrimary(a, b);
+    if(comp != 0) {
+        return comp;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    return collator_.compare(a, b);
+}
+
+int AsciiCollator::comparePrimary(const QString& a, const QString& b) const {
+    const ushort* pa = a.utf16();
+    const ushort* pb = b.utf16();
+    const ushort* endA = pa + a.size();
+    const ushort* endB = pb + b.size();
+    while(pa != endA && pb != endB) {
+        if(isDigit(*pa) && isDigit(*pb)) {
+            // the larger number has more digits without the leading zeros
+            while(pa != endA && *pa == '0') {
+                ++pa;
+            }
+            while(pb != endB && *pb == '0') {
+                ++pb;
+            }
+            const ushort* runA = pa;
+            const ushort* runB = pb;
+            while(pa != endA && isDigit(*pa)) {
+                ++pa;
+            }
+            while(pb != endB && isDigit(*pb)) {
+                ++pb;
+            }
+            if(pa - runA != pb - runB) {
+                return pa - runA < pb - runB ? -1 : 1;
+            }
+            for(; runA != pa; ++runA, ++runB) {
+                if(*runA != *runB) {
+                    return *runA < *runB ? -1 : 1;
+                }
+            }
+            continue;
+        }
+        // a number is ordered like its first digit
+        int rankA = ranks_[isDigit(*pa) ? '0' : *pa];
+        int rankB = ranks_[isDigit(*pb) ? '0' : *pb];
+        if(rankA != rankB) {
+            return rankA < rankB ? -1 : 1;
+        }
+        ++pa;
+        ++pb;
+    }
+    if(pa != endA) {
+        return 1;
+    }
+    return pb != endB ? -1 : 0;
+}
+
+} // namespace Fm
@@ -0,0 +1,53 @@
+#ifndef FM_ASCIICOLLATOR_P_H
+#define FM_ASCIICOLLATOR_P_H
+
+#include <QCollator>
+#include <QString>
+#include <mutex>
+
+namespace Fm {
+
+// Compares the names made of printable ASCII chars in the same order as a numeric-mode QCollator,
+// without calling ICU or creating the sort keys. The order of the chars is learned from the collator,
+// digit runs are compared by their values inline, and only the names which differ beyond the primary
+// level, e.g. only by their cases, are compared by the collator.
+// It can't follow the locales which collate some ASCII sequences specially, like "ch" in Czech or
+// "aa" in Danish, and it's not valid for them. It can be used by many threads at once.
+class AsciiCollator {
+public:
+    AsciiCollator();
+
+    // Learn the order of the collator, and check it on some strings. isValid() is false if the order
+    // can't be followed, or the collator isn't in the numeric mode.
+    void setCollator(const QCollator& collator);
+
+    bool isValid() const {
+        return isValid_;
+    }
+
+    // whether the string can be compared by compare()
+    static bool isAscii(const QString& str) {
+        for(const QChar* c = str.constData(), *end = c + str.size(); c != end; ++c) {
+            if(c->unicode() < 0x20 || c->unicode() > 0x7e) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the same as QCollator::compare() for the strings for which isAscii() is true
+    int compare(const QString& a, const QString& b) const;
+
+private:
+    // the comparison of the primary level, 0 if they differ only beyond it
+    int comparePrimary(const QString& a, const QString& b) const;
+
+    unsigned char ranks_[128]; // the primary order of the printable chars
+    bool isValid_;
+    QCollator collator_; // for the names which are equal at the primary level
+    mutable std::mutex mutex_; // QCollator is reentrant, but not thread-safe
+};
+
+} // namespace Fm
+
+#endif // FM_ASCIICOLLATOR_P_H
@@ -19,12 +19,17 @@
 
 
 #include "browsehistory.h"
+#include "cachedfoldermodel.h"
+#include <algorithm>
+#include <cstdlib>
 
 namespace Fm {
 
 BrowseHistory::BrowseHistory():
     currentIndex_(0),
-    maxCount_(10) {
+    maxCount_(10),
+    maxRetainedModels_(3),
+    maxRetainedMemory_(64 * 1024 * 1024) {
 }
 
 BrowseHistory::~BrowseHistory() {
@@ -51,11 +56,13 @@ void BrowseHistory::add(Fm::FilePath path, int scrollPos) {
     // add a path and current scroll position to browse history
     items_.push_back(BrowseHistoryItem(path, scrollPos));
     currentIndex_ = items_.size() - 1;
+    trimRetainedModels();
 }
 
 void BrowseHistory::setCurrentIndex(int index) {
     if(index >= 0 && static_cast<size_t>(index) < items_.size()) {
         currentIndex_ = index;
+        trimRetainedModels();
         // FIXME: should we emit a signal for the change?
     }
 }
@@ -67,6 +74,7 @@ bool BrowseHistory::canBackward() const {
 int BrowseHistory::backward() {
     if(canBackward()) {
         --currentIndex_;
+        trimRetainedModels();
     }
     return currentIndex_;
 }
@@ -78,6 +86,7 @@ bool BrowseHistory::canForward() const {
 int BrowseHistory::forward() {
     if(canForward()) {
         ++currentIndex_;
+        trimRetainedModels();
     }
     return currentIndex_;
 }
@@ -89,5 +98,48 @@ void BrowseHistory::setMaxCount(int maxCount) {
     }
 }
 
+void BrowseHistory::retainModel(std::shared_ptr<CachedFolderModel> model, Fm::FilePathList selectedFiles, int scrollPos) {
+    if(items_.empty()) {
+        return;
+    }
+    BrowseHistoryItem& item = items_[currentIndex_];
+    item.setModel(std::move(model));
+    item.setSelectedFiles(std::move(selectedFiles));
+    item.setScrollPos(scrollPos);
+}
+
+void BrowseHistory::setMaxRetainedModels(int count) {
+    maxRetainedModels_ = count;
+    trimRetainedModels();
+}
+
+void BrowseHistory::setMaxRetainedMemory(size_t bytes) {
+    maxRetainedMemory_ = bytes;
+    trimRetainedModels();
+}
+
+void BrowseHistory::trimRetainedModels() {
+    // the current item is shown, so its model is used anyway
+    std::vector<int> retained;
+    size_t bytes = 0;
+    for(int i = 0; i < static_cast<int>(items_.size()); ++i) {
+        if(i != currentIndex_ && items_[i].model()) {
+            retained.push_back(i);
+            bytes += items_[i].model()->memoryUsage();
+        }
+    }
+    // the farthest ones first
+    std::sort(retained.begin(), retained.end(), [this](int a, int b) {
+        return std::abs(a - currentIndex_) > std::abs(b - currentIndex_);
+    });
+    for(auto it = retained.begin();
+        it != retained.end() && (retained.end() - it > maxRetainedModels_ || bytes > maxRetainedMemory_); ++it) {
+        BrowseHistoryItem& item = items_[*it];
+        bytes -= std::min(bytes, item.model()->memoryUsage());
+        item.releaseModel();
+        item.setSelectedFiles(Fm::FilePathList{});
+    }
+}
+
 
 } // namespace Fm
@@ -23,11 +23,14 @@
 
 #include "libfmqtglobals.h"
 #include <vector>
+#include <memory>
 
 #include "core/filepath.h"
 
 namespace Fm {
 
+class CachedFolderModel;
+
 // class used to story browsing history of folder views
 // We use this class to replace FmNavHistory provided by libfm since
 // the original Libfm API is hard to use and confusing.
@@ -49,11 +52,7 @@ public:
     ~BrowseHistoryItem() {
     }
 
-    BrowseHistoryItem& operator=(const BrowseHistoryItem& other) {
-        path_ = other.path_;
-        scrollPos_ = other.scrollPos_;
-        return *this;
-    }
+    BrowseHistoryItem& operator=(const BrowseHistoryItem& other) = default;
 
     Fm::FilePath path() const {
         return path_;
@@ -67,10 +66,33 @@ public:
         scrollPos_ = pos;
     }
 
+    // The model of the folder kept by the item with the sorted keys and the thumbnails of its items,
+    // so going back to the folder shows it at once. See BrowseHistory::retainModel().
+    CachedFolderModel* model() const {
+        return model_.get();
+    }
+
+    void setModel(std::shared_ptr<CachedFolderModel> model) {
+        model_ = std::move(model);
+    }
+
+    void releaseModel() {
+        model_.reset();
+    }
+
+    const Fm::FilePathList& selectedFiles() const {
+        return selectedFiles_;
+    }
+
+    void setSelectedFiles(Fm::FilePathList files) {
+        selectedFiles_ = std::move(files);
+    }
+
 private:
     Fm::FilePath path_;
     int scrollPos_;
-    // TODO: we may need to store current selection as well.
+    std::shared_ptr<CachedFolderModel> model_;
+    Fm::FilePathList selectedFiles_;
 };
 
 class LIBFM_QT_API BrowseHistory {
@@ -120,10 +142,33 @@ public:
 
     void setMaxCount(int maxCount);
 
+    // Keep the model, the selected files and the scroll position of the current item before leaving
+    // it. The models of the items other than the current one are bounded by their count and by
+    // their total FolderModel::memoryUsage(), and the ones farthest from the current item are
+    // released first.
+    void retainModel(std::shared_ptr<CachedFolderModel> model, Fm::FilePathList selectedFiles, int scrollPos);
+
+    void setMaxRetainedModels(int count);
+
+    int maxRetainedModels() const {
+        return maxRetainedModels_;
+    }
+
+    void setMaxRetainedMemory(size_t bytes);
+
+    size_t maxRetainedMemory() const {
+        return maxRetainedMemory_;
+    }
+
+private:
+    void trimRetainedModels();
+
 private:
     std::vector<BrowseHistoryItem> items_;
     int currentIndex_;
     int maxCount_;
+    int maxRetainedModels_;
+    size_t maxRetainedMemory_;
 };
 
 }
@@ -18,50 +18,175 @@
  */
 
 #include "cachedfoldermodel.h"
+#include "core/memorypressure.h"
+#include <QTimer>
+#include <QCoreApplication>
 
 namespace Fm {
 
+std::unordered_map<const Fm::Folder*, std::weak_ptr<CachedFolderModel>> CachedFolderModel::models_;
+std::list<std::shared_ptr<CachedFolderModel>> CachedFolderModel::lru_;
+size_t CachedFolderModel::maxIdleModels_ = 8;
+size_t CachedFolderModel::maxIdleMemory_ = 64 * 1024 * 1024;
+
 CachedFolderModel::CachedFolderModel(const std::shared_ptr<Fm::Folder>& folder):
+    CachedFolderModel(folder, false) {
+}
+
+CachedFolderModel::CachedFolderModel(const std::shared_ptr<Fm::Folder>& folder, bool shared):
     FolderModel(),
-    refCount(1) {
+    refCount(shared ? 0 : 1),
+    shared_{shared} {
     FolderModel::setFolder(folder);
+    // the memory of the folders kept by the idle models is only freed with the models
+    connect(Fm::MemoryPressure::globalInstance().get(), &Fm::MemoryPressure::trimRequested, this,
+            [](Fm::MemoryPressure::Level level) {
+        if(level == Fm::MemoryPressure::Critical) {
+            // not in the handler, since this model might be deleted
+            QTimer::singleShot(0, &CachedFolderModel::clearIdleModels);
+        }
+    });
 }
 
 CachedFolderModel::~CachedFolderModel() {
     // qDebug("delete CachedFolderModel");
 }
 
-CachedFolderModel* CachedFolderModel::modelFromFolder(const std::shared_ptr<Fm::Folder>& folder) {
-    QVariant cache = folder->property(cacheKey);
-    CachedFolderModel* model = cache.value<CachedFolderModel*>();
+// static
+void CachedFolderModel::deleteModel(CachedFolderModel* model) {
+    auto it = models_.find(model->folder().get());
+    if(it != models_.end() && it->second.expired()) {
+        models_.erase(it);
+    }
+    delete model;
+}
+
+// static
+std::shared_ptr<CachedFolderModel> CachedFolderModel::sharedModelFromFolder(const std::shared_ptr<Fm::Folder>& folder) {
+    std::shared_ptr<CachedFolderModel> model;
+    auto it = models_.find(folder.get());
+    if(it != models_.end()) {
+        model = it->second.lock();
+    }
     if(model) {
-        model->ref();
+        // move it to the front of the LRU list
+        for(auto lruIt = lru_.begin(); lruIt != lru_.end(); ++lruIt) {
+            if(*lruIt == model) {
+                lru_.splice(lru_.begin(), lru_, lruIt);
+                break;
+            }
+        }
     }
     else {
-        model = new CachedFolderModel(folder);
-        cache = QVariant::fromValue(model);
-        folder->setProperty(cacheKey, cache);
+        static bool quitConnected = false;
+        if(!quitConnected && qApp) {
+            // the models should not be deleted with the static objects after the app is gone
+            quitConnected = true;
+            QObject::connect(qApp, &QCoreApplication::aboutToQuit, &CachedFolderModel::clearIdleModels);
+        }
+        model = std::shared_ptr<CachedFolderModel>{new CachedFolderModel(folder, true), &CachedFolderModel::deleteModel};
+        models_[folder.get()] = model;
+        if(maxIdleModels_ > 0) {
+            lru_.push_front(model);
+        }
     }
+    trimIdleModels();
     return model;
 }
 
-CachedFolderModel* CachedFolderModel::modelFromPath(const Fm::FilePath& path) {
+// static
+std::shared_ptr<CachedFolderModel> CachedFolderModel::sharedModelFromPath(const Fm::FilePath& path) {
     auto folder = Fm::Folder::fromPath(path);
     if(folder) {
-        CachedFolderModel* model = modelFromFolder(folder);
-        return model;
+        return sharedModelFromFolder(folder);
     }
     return nullptr;
 }
 
+// static
+void CachedFolderModel::trimIdleModels() {
+    // only the models nobody else uses are counted, from the least recently used ones
+    size_t nIdle = 0;
+    size_t bytes = 0;
+    for(const auto& model: lru_) {
+        if(model.use_count() == 1) {
+            ++nIdle;
+            bytes += model->memoryUsage();
+        }
+    }
+    for(auto it = lru_.end(); it != lru_.begin() && (nIdle > maxIdleModels_ || (maxIdleMemory_ > 0 && bytes > maxIdleMemory_));) {
+        --it;
+        if(it->use_count() == 1) {
+            --nIdle;
+            bytes -= std::min(bytes, (*it)->memoryUsage());
+            it = lru_.erase(it);
+        }
+    }
+}
+
+// static
+void CachedFolderModel::setMaxIdleModels(size_t count) {
+    maxIdleModels_ = count;
+    trimIdleModels();
+}
+
+// static
+void CachedFolderModel::setMaxIdleMemory(size_t bytes) {
+    maxIdleMemory_ = bytes;
+    trimIdleModels();
+}
+
+// static
+void CachedFolderModel::clearIdleModels() {
+    for(auto it = lru_.begin(); it != lru_.end();) {
+        if(it->use_count() == 1) {
+            it = lru_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void CachedFolderModel::ref() {
+    if(refCount++ == 0 && shared_) {
+        legacyRef_ = shared_from_this();
+    }
+}
+
 void CachedFolderModel::unref() {
     // qDebug("unref cache");
-    --refCount;
-    if(refCount <= 0) {
-        folder()->setProperty(cacheKey, QVariant());
-        delete(this);
+    if(!shared_) {
+        if(--refCount <= 0) {
+            delete this;
+        }
+        return;
+    }
+    if(--refCount <= 0) {
+        refCount = 0;
+        // the model is deleted here unless it's still shared or kept by the cache
+        auto self = std::move(legacyRef_);
+        self.reset();
+        trimIdleModels();
     }
 }
 
+// static
+CachedFolderModel* CachedFolderModel::modelFromFolder(const std::shared_ptr<Fm::Folder>& folder) {
+    auto model = sharedModelFromFolder(folder);
+    model->ref();
+    return model.get();
+}
+
+// static
+CachedFolderModel* CachedFolderModel::modelFromPath(const Fm::FilePath& path) {
+    auto folder = Fm::Folder::fromPath(path);
+    if(folder) {
+        CachedFolderModel* model = modelFromFolder(folder);
+        return model;
+    }
+    return nullptr;
+}
+
 
 } // namespace Fm
@@ -24,29 +24,75 @@
 #include "libfmqtglobals.h"
 #include "foldermodel.h"
 
+#include <list>
+#include <memory>
+#include <unordered_map>
+
 #include "core/folder.h"
 
 namespace Fm {
 
-// FIXME: deprecate CachedFolderModel later (ugly API design with manual ref()/unref())
-class LIBFM_QT_API CachedFolderModel : public FolderModel {
+// The models of the folders shared by all the views, so the proxy models of several windows showing
+// the same folder share one source model with its items and thumbnails. The models are owned by
+// shared_ptr's. The recently used ones are also kept by an LRU cache when nobody uses them, which is
+// bounded by their number and by their total memoryUsage(), so revisiting a folder shows it at once.
+// The idle models are released on the critical memory pressure, see MemoryPressure.
+class LIBFM_QT_API CachedFolderModel : public FolderModel, public std::enable_shared_from_this<CachedFolderModel> {
     Q_OBJECT
 public:
+    // The legacy constructor, which is kept for compatibility. The model is created with a reference,
+    // and it's deleted when it's unref()'ed to 0. It's not shared by the views and it's never kept by
+    // the cache of the idle models, so sharedModelFromFolder() should be used instead.
+    FM_QT_DEPRECATED
     explicit CachedFolderModel(const std::shared_ptr<Fm::Folder>& folder);
-    void ref() {
-        ++refCount;
+
+    static std::shared_ptr<CachedFolderModel> sharedModelFromFolder(const std::shared_ptr<Fm::Folder>& folder);
+
+    static std::shared_ptr<CachedFolderModel> sharedModelFromPath(const Fm::FilePath& path);
+
+    // the most idle models kept by the cache (0 disables it), and their most memory (0 means no limit)
+    static void setMaxIdleModels(size_t count);
+
+    static size_t maxIdleModels() {
+        return maxIdleModels_;
+    }
+
+    static void setMaxIdleMemory(size_t bytes);
+
+    static size_t maxIdleMemory() {
+        return maxIdleMemory_;
     }
+
+    // release all the idle models kept by the cache
+    static void clearIdleModels();
+
+    // The legacy API with manual reference counting, which is kept for compatibility. The model
+    // is kept alive while it's ref()'ed, in addition to the shared_ptr's and the cache.
+    void ref();
     void unref();
 
     static CachedFolderModel* modelFromFolder(const std::shared_ptr<Fm::Folder>& folder);
     static CachedFolderModel* modelFromPath(const Fm::FilePath& path);
 
 private:
+    // a model owned by shared_ptr's if shared is true, otherwise by the legacy reference counting
+    explicit CachedFolderModel(const std::shared_ptr<Fm::Folder>& folder, bool shared);
+
     virtual ~CachedFolderModel();
 
+    static void deleteModel(CachedFolderModel* model);
+
+    static void trimIdleModels();
+
 private:
     int refCount;
-    constexpr static const char* cacheKey = "CachedFolderModel";
+    bool shared_; // false if it's created by the legacy constructor
+    std::shared_ptr<CachedFolderModel> legacyRef_; // set while refCount > 0 if the model is shared
+
+    static std::unordered_map<const Fm::Folder*, std::weak_ptr<CachedFolderModel>> models_;
+    static std::list<std::shared_ptr<CachedFolderModel>> lru_; // the most recently used ones first
+    static size_t maxIdleModels_;
+    static size_t maxIdleMemory_;
 };
 
 
@@ -0,0 +1,56 @@
+#include "appinfocache.h"
+
+namespace Fm {
+
+std::mutex AppInfoCache::mutex_;
+std::unordered_map<std::string, AppInfoCache::Entry> AppInfoCache::cache_;
+GAppInfoMonitor* AppInfoCache::monitor_ = nullptr;
+
+// static
+AppInfoCache::Entry& AppInfoCache::entry(const char* mimeType) {
+    if(!monitor_) {
+        // the monitor only reports the changes after the apps are queried, so it's created first
+        monitor_ = g_app_info_monitor_get();
+        g_signal_connect(monitor_, "changed", G_CALLBACK(onAppInfoChanged), nullptr);
+    }
+    return cache_[mimeType];
+}
+
+// static
+GAppInfoPtr AppInfoCache::defaultAppForType(const char* mimeType) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& e = entry(mimeType);
+    if(!e.hasDefaultApp) {
+        e.defaultApp = GAppInfoPtr{g_app_info_get_default_for_type(mimeType, FALSE), false};
+        e.hasDefaultApp = true;
+    }
+    return e.defaultApp;
+}
+
+// static
+std::vector<GAppInfoPtr> AppInfoCache::appsForType(const char* mimeType) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& e = entry(mimeType);
+    if(!e.hasApps) {
+        GList* apps = g_app_info_get_all_for_type(mimeType);
+        for(GList* l = apps; l; l = l->next) {
+            e.apps.emplace_back(G_APP_INFO(l->data), false);
+        }
+        g_list_free(apps);
+        e.hasApps = true;
+    }
+    return e.apps;
+}
+
+// static
+void AppInfoCache::invalidate() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    cache_.clear();
+}
+
+// static
+void AppInfoCache::onAppInfoChanged(GAppInfoMonitor* /*monitor*/, gpointer /*user_data*/) {
+    invalidate();
+}
+
+} // namespace Fm
@@ -0,0 +1,52 @@
+#ifndef FM2_APPINFOCACHE_H
+#define FM2_APPINFOCACHE_H
+
+#include "../libfmqtglobals.h"
+#include "gioptrs.h"
+#include <gio/gio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace Fm {
+
+// Caches the apps of the mime types, since g_app_info_get_default_for_type() and
+// g_app_info_get_all_for_type() read mimeapps.list and the desktop files each time.
+// The cache is cleared when GAppInfoMonitor reports that the installed apps are changed.
+class LIBFM_QT_API AppInfoCache {
+public:
+    // the default app of the mime type, or nullptr
+    static GAppInfoPtr defaultAppForType(const char* mimeType);
+
+    // all the apps which can open the files of the mime type, the recommended ones first
+    static std::vector<GAppInfoPtr> appsForType(const char* mimeType);
+
+    // should be called after the default app or the last used app of a type is set
+    static void invalidate();
+
+private:
+    struct Entry {
+        Entry(): hasDefaultApp{false}, hasApps{false} {
+        }
+
+        bool hasDefaultApp;
+        GAppInfoPtr defaultApp;
+        bool hasApps;
+        std::vector<GAppInfoPtr> apps;
+    };
+
+    // called with the mutex locked
+    static Entry& entry(const char* mimeType);
+
+    static void onAppInfoChanged(GAppInfoMonitor* monitor, gpointer user_data);
+
+private:
+    static std::mutex mutex_;
+    static std::unordered_map<std::string, Entry> cache_;
+    static GAppInfoMonitor* monitor_;
+};
+
+} // namespace Fm
+
+#endif // FM2_APPINFOCACHE_H
@@ -1,5 +1,6 @@
 #include "basicfilelauncher.h"
 #include "fileinfojob.h"
+#include "appinfocache.h"
 #include "mountoperation.h"
 
 #include <gio/gdesktopappinfo.h>
@@ -7,6 +8,11 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 
 #include <QObject>
 #include <QEventLoop>
@@ -16,6 +22,11 @@
 
 namespace Fm {
 
+// the number of threads which launch the apps opening one file each
+static const unsigned int maxLaunchThreads = 8;
+// the failed files listed in the error message
+static const size_t maxReportedFailures = 10;
+
 BasicFileLauncher::BasicFileLauncher():
     quickExec_{false} {
 }
@@ -84,7 +95,8 @@ bool BasicFileLauncher::launchFiles(const FileInfoList& fileInfos, GAppLaunchCon
         auto& mimeType = typeFiles.first;
         auto& files = typeFiles.second;
         GErrorPtr err;
-        GAppInfoPtr app{g_app_info_get_default_for_type(mimeType.c_str(), false), false};
+        // the apps are cached, so the app database isn't read again for each type
+        auto app = AppInfoCache::defaultAppForType(mimeType.c_str());
         if(!app) {
             app = chooseApp(files, mimeType.c_str(), err);
         }
@@ -153,7 +165,32 @@ int BasicFileLauncher::ask(const char* /* msg */, char* const* /* btn_labels */,
     return default_btn;
 }
 
+// whether the app opens only one file per process, for which it's launched for each file
+static bool launchesEachFile(GAppInfo* app) {
+    const char* cmd = g_app_info_get_commandline(app);
+    bool single = false;
+    for(auto p = cmd; p && *p; ++p) {
+        if(*p == '%') {
+            switch(*++p) {
+            case 'F':
+            case 'U':
+                return false;
+            case 'f':
+            case 'u':
+                single = true;
+                break;
+            case '\0':
+                return single;
+            }
+        }
+    }
+    return single;
+}
+
 bool BasicFileLauncher::launchWithApp(GAppInfo* app, const FilePathList& paths, GAppLaunchContext* ctx) {
+    if(paths.size() > 1 && launchesEachFile(app)) {
+        return launchEachFileWithApp(app, paths, ctx);
+    }
     GList* uris = nullptr;
     for(auto& path : paths) {
         auto uri = path.uri();
@@ -171,6 +208,63 @@ bool BasicFileLauncher::launchWithApp(GAppInfo* app, const FilePathList& paths,
 }
 
 
+bool BasicFileLauncher::launchEachFileWithApp(GAppInfo* app, const FilePathList& paths, GAppLaunchContext* ctx) {
+    // GIO would spawn the processes one by one, so they are spawned by a few threads instead.
+    // The launch context of the caller does more than a plain one, e.g. startup notification and
+    // the environment, and it might not be thread-safe, so it's only used in this thread. The files
+    // are launched in parallel only if there's no context.
+    struct Failure {
+        FilePath path;
+        QString message;
+    };
+    std::vector<Failure> failures;
+    std::mutex failuresMutex;
+    std::atomic<size_t> next{0};
+    auto launchNext = [&]() {
+        for(size_t i; (i = next++) < paths.size();) {
+            auto uri = paths[i].uri();
+            GList uris{uri.get(), nullptr, nullptr};
+            GErrorPtr err;
+            if(!g_app_info_launch_uris(app, &uris, ctx, &err)) {
+                std::lock_guard<std::mutex> lock{failuresMutex};
+                failures.push_back(Failure{paths[i], err ? QString::fromUtf8(err->message) : QString()});
+            }
+        }
+    };
+    size_t n_threads = ctx ? 1 : std::min(paths.size(), size_t(std::max(2u, std::min(g_get_num_processors(), maxLaunchThreads))));
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back(launchNext);
+    }
+    launchNext();
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(failures.empty()) {
+        return true;
+    }
+    // report all the errors at once
+    if(failures.size() == 1) {
+        GErrorPtr err{G_IO_ERROR, G_IO_ERROR_FAILED, failures[0].message};
+        showError(ctx, err, failures[0].path);
+        return false;
+    }
+    QString msg = QObject::tr("Failed to open %n file(s) with %1:", "", int(failures.size())).arg(QString::fromUtf8(g_app_info_get_name(app)));
+    for(size_t i = 0; i < failures.size() && i < maxReportedFailures; ++i) {
+        msg += QLatin1Char('\n') + QString::fromUtf8(failures[i].path.displayName().get());
+        if(!failures[i].message.isEmpty()) {
+            msg += QStringLiteral(": ") + failures[i].message;
+        }
+    }
+    if(failures.size() > maxReportedFailures) {
+        msg += QLatin1Char('\n') + QObject::tr("and %n more", "", int(failures.size() - maxReportedFailures));
+    }
+    GErrorPtr err{G_IO_ERROR, G_IO_ERROR_FAILED, msg};
+    showError(ctx, err);
+    return false;
+}
+
 bool BasicFileLauncher::launchDesktopEntry(const FileInfoPtr &fileInfo, const FilePathList &paths, GAppLaunchContext* ctx) {
     /* treat desktop entries as executables */
     auto target = fileInfo->target();
@@ -334,7 +428,7 @@ bool BasicFileLauncher::launchWithDefaultApp(const FileInfoPtr &fileInfo, GAppLa
     FileInfoList files;
     files.emplace_back(fileInfo);
     GErrorPtr err;
-    GAppInfoPtr app{g_app_info_get_default_for_type(fileInfo->mimeType()->name(), false), false};
+    auto app = AppInfoCache::defaultAppForType(fileInfo->mimeType()->name());
     if(app) {
         return launchWithApp(app.get(), files.paths(), ctx);
     }
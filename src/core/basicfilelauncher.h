@@ -63,6 +63,10 @@ private:
 
     FilePath handleShortcut(const FileInfoPtr &fileInfo, GAppLaunchContext* ctx = nullptr);
 
+    // Launch the app for each file and show one error for all the failed files. The files are launched
+    // in parallel only if ctx is nullptr, since the launch context is used in the calling thread only.
+    bool launchEachFileWithApp(GAppInfo* app, const FilePathList& paths, GAppLaunchContext* ctx);
+
 private:
     bool quickExec_; // Don't ask options on launch executable file
 };
@@ -1,13 +1,71 @@
 #include "bookmarks.h"
 #include "cstrptr.h"
+#include "job.h"
+#include "desktopentrycache_p.h"
 #include <algorithm>
+#include <unordered_map>
 #include <QTimer>
 #include <QStandardPaths>
 
 namespace Fm {
 
+// the delay before reloading the changed file, so the events of one write are handled together
+static const int reloadDelay = 200;
+
 std::weak_ptr<Bookmarks> Bookmarks::globalInstance_;
 
+// reads or writes the bookmarks file in a worker thread
+class BookmarksFileJob: public Job {
+public:
+    explicit BookmarksFileJob(FilePath file, std::string content, bool write):
+        file_{std::move(file)},
+        content_{std::move(content)},
+        write_{write},
+        success_{false} {
+    }
+
+    const std::string& content() const {
+        return content_;
+    }
+
+    bool success() const {
+        return success_;
+    }
+
+protected:
+    void exec() override {
+        GError* err = nullptr;
+        if(write_) {
+            success_ = g_file_replace_contents(file_.gfile().get(), content_.c_str(), content_.length(), nullptr,
+                                               FALSE, G_FILE_CREATE_NONE, nullptr, cancellable().get(), &err);
+        }
+        else {
+            char* data = nullptr;
+            gsize len = 0;
+            success_ = g_file_load_contents(file_.gfile().get(), cancellable().get(), &data, &len, nullptr, &err);
+            if(success_) {
+                content_.assign(data, len);
+                g_free(data);
+            }
+            else if(err && err->domain == G_IO_ERROR && err->code == G_IO_ERROR_NOT_FOUND) {
+                success_ = true; // no bookmarks
+            }
+        }
+        if(err) {
+            if(write_) {
+                g_critical("%s", err->message);
+            }
+            g_error_free(err);
+        }
+    }
+
+private:
+    FilePath file_;
+    std::string content_;
+    bool write_;
+    bool success_;
+};
+
 static inline CStrPtr get_legacy_bookmarks_file(void) {
     return CStrPtr{g_build_filename(g_get_home_dir(), ".gtk-bookmarks", nullptr)};
 }
@@ -27,15 +85,9 @@ BookmarkItem::BookmarkItem(const FilePath& path, const QString name):
     // to get folder icons directly, as is done at `FileInfo::setFromGFileInfo` and more.
     auto local_path = path.localPath();
     auto dot_dir = CStrPtr{g_build_filename(local_path.get(), ".directory", nullptr)};
-    if(g_file_test(dot_dir.get(), G_FILE_TEST_IS_REGULAR)) {
-        GKeyFile* kf = g_key_file_new();
-        if(g_key_file_load_from_file(kf, dot_dir.get(), G_KEY_FILE_NONE, nullptr)) {
-            CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
-            if(icon_name) {
-                icon_ = IconInfo::fromName(icon_name.get());
-            }
-        }
-        g_key_file_free(kf);
+    auto fields = DesktopEntryCache::lookup(dot_dir.get());
+    if(fields && !fields->icon.empty()) {
+        icon_ = IconInfo::fromName(fields->icon.c_str());
     }
     if(!icon_ || !icon_->isValid()) {
         // first check some standard folders that are shared by Qt and GLib
@@ -72,7 +124,12 @@ BookmarkItem::BookmarkItem(const FilePath& path, const QString name):
 
 Bookmarks::Bookmarks(QObject* parent):
     QObject(parent),
-    idle_handler{false} {
+    idle_handler{false},
+    contentHash_{0},
+    reloadQueued_{false},
+    loading_{false},
+    saving_{false},
+    savePending_{false} {
 
     /* trying the gtk-3.0 first and use it if it exists */
     auto fpath = get_new_bookmarks_file();
@@ -93,6 +150,12 @@ Bookmarks::~Bookmarks() {
     if(mon) {
         g_signal_handlers_disconnect_by_data(mon.get(), this);
     }
+    // don't lose the changes which are not written yet
+    if(idle_handler || savePending_) {
+        auto buf = content();
+        g_file_replace_contents(file.gfile().get(), buf.c_str(), buf.length(), nullptr,
+                                FALSE, G_FILE_CREATE_NONE, nullptr, nullptr, nullptr);
+    }
 }
 
 const std::shared_ptr<const BookmarkItem>& Bookmarks::insert(const FilePath& path, const QString& name, int pos) {
@@ -145,9 +208,8 @@ std::shared_ptr<Bookmarks> Bookmarks::globalInstance() {
     return bookmarks;
 }
 
-void Bookmarks::save() {
+std::string Bookmarks::content() const {
     std::string buf;
-    // G_LOCK(bookmarks);
     for(auto& item: items_) {
         auto uri = item->path().uri();
         buf += uri.get();
@@ -155,54 +217,123 @@ void Bookmarks::save() {
         buf += item->name().toUtf8().constData();
         buf += '\n';
     }
+    return buf;
+}
+
+void Bookmarks::save() {
     idle_handler = false;
-    // G_UNLOCK(bookmarks);
-    GError* err = nullptr;
-    if(!g_file_replace_contents(file.gfile().get(), buf.c_str(), buf.length(), nullptr,
-                                FALSE, G_FILE_CREATE_NONE, nullptr, nullptr, &err)) {
-        g_critical("%s", err->message);
-        g_error_free(err);
-    }
+    writeFile();
     /* we changed bookmarks list, let inform who interested in that */
     Q_EMIT changed();
 }
 
+void Bookmarks::writeFile() {
+    if(saving_) {
+        savePending_ = true;
+        return;
+    }
+    auto buf = content();
+    // the file monitor will report our own write, which shouldn't reload the bookmarks
+    contentHash_ = std::hash<std::string>{}(buf);
+    saving_ = true;
+    auto job = new BookmarksFileJob{file, std::move(buf), true};
+    job->setAutoDelete(true);
+    connect(job, &Job::finished, this, [this]() {
+        saving_ = false;
+        if(savePending_) {
+            savePending_ = false;
+            writeFile();
+        }
+    }, Qt::QueuedConnection);
+    job->runAsync();
+}
+
 void Bookmarks::load() {
-    auto fpath = file.localPath();
-    FILE* f;
-    char buf[1024];
-    /* load the file */
-    f = fopen(fpath.get(), "r");
-    if(f) {
-        while(fgets(buf, 1024, f)) {
-            // format of each line in the bookmark file:
-            // <URI> <name>\n
-            char* sep;
-            sep = strchr(buf, '\n');
-            if(sep) {
-                *sep = '\0';
-            }
+    char* data = nullptr;
+    gsize len = 0;
+    if(g_file_load_contents(file.gfile().get(), nullptr, &data, &len, nullptr, nullptr)) {
+        setContent(std::string{data, len});
+        g_free(data);
+    }
+}
 
-            QString name;
-            sep = strchr(buf, ' ');  // find the separator between URI and name
-            if(sep) {
-                *sep = '\0';
-                name = sep + 1;
-            }
-            auto uri = buf;
-            if(uri[0] != '\0') {
-                items_.push_back(std::make_shared<BookmarkItem>(FilePath::fromUri(uri), name));
-            }
+bool Bookmarks::setContent(const std::string& content) {
+    auto hash = std::hash<std::string>{}(content);
+    if(hash == contentHash_) {
+        return false;
+    }
+    contentHash_ = hash;
+
+    // the unchanged bookmarks keep their items, so the users only need to update the changed ones
+    std::unordered_multimap<std::string, std::shared_ptr<const BookmarkItem>> oldItems;
+    for(auto& item : items_) {
+        std::string line = item->path().uri().get();
+        line += ' ';
+        line += item->name().toUtf8().constData();
+        oldItems.emplace(std::move(line), item);
+    }
+    std::vector<std::shared_ptr<const BookmarkItem>> items;
+    for(std::string::size_type pos = 0; pos < content.length();) {
+        // format of each line in the bookmark file:
+        // <URI> <name>\n
+        auto end = content.find('\n', pos);
+        if(end == std::string::npos) {
+            end = content.length();
+        }
+        std::string line = content.substr(pos, end - pos);
+        pos = end + 1;
+        auto sep = line.find(' '); // find the separator between URI and name
+        std::string uri = line.substr(0, sep);
+        if(uri.empty()) {
+            continue;
+        }
+        QString name;
+        if(sep != std::string::npos) {
+            name = QString::fromUtf8(line.c_str() + sep + 1);
+        }
+        else {
+            line += ' ';
+        }
+        auto old = oldItems.find(line);
+        if(old != oldItems.end()) {
+            items.emplace_back(std::move(old->second));
+            oldItems.erase(old);
+        }
+        else {
+            items.emplace_back(std::make_shared<BookmarkItem>(FilePath::fromUri(uri.c_str()), name));
         }
-        fclose(f);
     }
+    bool changed = (items != items_);
+    items_ = std::move(items);
+    return changed;
 }
 
 void Bookmarks::onFileChanged(GFileMonitor* /*mon*/, GFile* /*gf*/, GFile* /*other*/, GFileMonitorEvent /*evt*/) {
-    // reload the bookmarks
-    items_.clear();
-    load();
-    Q_EMIT changed();
+    // reload the bookmarks later, since a write emits several events
+    if(!reloadQueued_) {
+        reloadQueued_ = true;
+        QTimer::singleShot(reloadDelay, this, &Bookmarks::reload);
+    }
+}
+
+void Bookmarks::reload() {
+    reloadQueued_ = false;
+    if(loading_) {
+        // the file might be changed after it's read
+        onFileChanged(nullptr, nullptr, nullptr, G_FILE_MONITOR_EVENT_CHANGED);
+        return;
+    }
+    loading_ = true;
+    auto job = new BookmarksFileJob{file, std::string{}, false};
+    job->setAutoDelete(true);
+    connect(job, &Job::finished, this, [this, job]() {
+        loading_ = false;
+        // the local changes which are not written yet win
+        if(job->success() && !idle_handler && !saving_ && setContent(job->content())) {
+            Q_EMIT changed();
+        }
+    }, Qt::QueuedConnection);
+    job->runAsync();
 }
 
 
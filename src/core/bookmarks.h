@@ -2,6 +2,8 @@
 #define FM2_BOOKMARKS_H
 
 #include <QObject>
+#include <string>
+#include <vector>
 #include "gobjectptr.h"
 #include "filepath.h"
 #include "iconinfo.h"
@@ -65,8 +67,21 @@ Q_SIGNALS:
 private Q_SLOTS:
     void save();
 
+    void reload();
+
 private:
+    // read the file synchronously, only used when the bookmarks are created
     void load();
+
+    // replace the items with the content of the file, keeping the items of the unchanged lines.
+    // Returns false if the content is the same as the last one read or written.
+    bool setContent(const std::string& content);
+
+    std::string content() const;
+
+    // write the file in a worker thread, the writes are serialized
+    void writeFile();
+
     void queueSave();
 
     static void _onFileChanged(GFileMonitor* mon, GFile* gf, GFile* other, GFileMonitorEvent evt, Bookmarks* _this) {
@@ -80,6 +95,11 @@ private:
     std::vector<std::shared_ptr<const BookmarkItem>> items_;
     static std::weak_ptr<Bookmarks> globalInstance_;
     bool idle_handler;
+    std::size_t contentHash_; // hash of the last content read or written, to skip our own changes
+    bool reloadQueued_;
+    bool loading_;
+    bool saving_;
+    bool savePending_; // changed while the file is being written
 };
 
 } // namespace Fm
@@ -0,0 +1,173 @@
+#include "bulkrenamejob.h"
+#include "cstrptr.h"
+#include <unordered_map>
+
+namespace Fm {
+
+// the tries to find an unused temporary name for a file renamed in a cycle
+static const int maxTemporaryNameTries = 100;
+
+BulkRenameJob::BulkRenameJob(std::vector<Rename> renames):
+    renames_{std::move(renames)} {
+}
+
+void BulkRenameJob::setFolderFiles(const FilePath& dirPath, const FileInfoList& files) {
+    folderPath_ = dirPath;
+    folderNames_.clear();
+    folderNames_.reserve(files.size());
+    for(auto& file: files) {
+        folderNames_.insert(file->name());
+    }
+}
+
+bool BulkRenameJob::renameFile(const FilePath& from, const FilePath& to, GErrorPtr& error) {
+    // the same as changeFileName(), the existing files are never overwritten
+    return g_file_move(from.gfile().get(), to.gfile().get(),
+                       GFileCopyFlags(G_FILE_COPY_ALL_METADATA |
+                                      G_FILE_COPY_NO_FALLBACK_FOR_MOVE |
+                                      G_FILE_COPY_NOFOLLOW_SYMLINKS),
+                       cancellable().get(), nullptr, nullptr, &error);
+}
+
+bool BulkRenameJob::moveToTemporaryName(size_t index) {
+    auto& path = renames_[index].path;
+    auto parent = path.parent();
+    auto baseName = path.baseName();
+    GErrorPtr error;
+    for(int i = 0; i < maxTemporaryNameTries; ++i) {
+        error = GErrorPtr{};
+        auto name = std::string{".~"} + baseName.get() + '.' + std::to_string(i);
+        auto tempPath = parent.child(name.c_str());
+        if(renameFile(path, tempPath, error)) {
+            currentPaths_[index] = std::move(tempPath);
+            return true;
+        }
+        if(error.domain() != G_IO_ERROR || error.code() != G_IO_ERROR_EXISTS) {
+            break;
+        }
+    }
+    results_[index].status = Status::FAILED;
+    results_[index].error = std::move(error);
+    return false;
+}
+
+void BulkRenameJob::exec() {
+    const size_t count = renames_.size();
+    results_.clear();
+    results_.reserve(count);
+    currentPaths_.clear();
+    currentPaths_.reserve(count);
+    // the files are found by their old paths, so a new name can be the old one of another file
+    std::unordered_map<std::string, size_t> sources;
+    sources.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        results_.emplace_back(Result{Status::PENDING, FilePath{}, GErrorPtr{}});
+        currentPaths_.push_back(renames_[i].path);
+        sources.emplace(renames_[i].path.toString().get(), i);
+    }
+
+    // check all the new names before renaming any file
+    std::vector<FilePath> targets(count);
+    std::vector<ptrdiff_t> blockers(count, -1); // the file which has the new name of a file now
+    std::unordered_map<std::string, size_t> targetIndexes;
+    targetIndexes.reserve(count);
+    for(size_t i = 0; i < count && !isCancelled(); ++i) {
+        auto& rename = renames_[i];
+        auto& result = results_[i];
+        auto& newName = rename.newName;
+        if(newName.empty() || newName == "." || newName == ".." || newName.find('/') != std::string::npos) {
+            result.status = Status::INVALID_NAME;
+            continue;
+        }
+        if(newName == rename.path.baseName().get()) {
+            result.status = Status::UNCHANGED;
+            continue;
+        }
+        auto parent = rename.path.parent();
+        targets[i] = parent.child(newName.c_str());
+        std::string key = targets[i].toString().get();
+        auto inserted = targetIndexes.emplace(key, i);
+        if(!inserted.second) {
+            // none of the files getting the same name is renamed
+            result.status = Status::DUPLICATE;
+            results_[inserted.first->second].status = Status::DUPLICATE;
+            continue;
+        }
+        auto source = sources.find(key);
+        if(source != sources.end()) {
+            blockers[i] = source->second;
+            continue;
+        }
+        bool exists = (parent == folderPath_) ? folderNames_.count(newName) != 0
+                      : g_file_query_exists(targets[i].gfile().get(), cancellable().get());
+        if(exists) {
+            result.status = Status::EXISTS;
+        }
+    }
+
+    // Rename the files in order, except that the file having the new name of another file is
+    // renamed before it. The files waiting for each other are followed as a chain, which is renamed
+    // from its end. If the chain is a cycle, the file closing it is moved to a temporary name first.
+    enum {NOT_VISITED, IN_CHAIN, VISITED};
+    std::vector<char> visits(count, NOT_VISITED);
+    std::vector<size_t> chain;
+    for(size_t i = 0; i < count && !isCancelled(); ++i) {
+        if(visits[i] != NOT_VISITED || results_[i].status != Status::PENDING) {
+            continue;
+        }
+        chain.clear();
+        ptrdiff_t next = i;
+        while(next >= 0 && visits[next] == NOT_VISITED && results_[next].status == Status::PENDING) {
+            visits[next] = IN_CHAIN;
+            chain.push_back(next);
+            next = blockers[next];
+        }
+        if(next >= 0 && visits[next] == IN_CHAIN) {
+            moveToTemporaryName(next);
+        }
+        for(auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            size_t index = *it;
+            visits[index] = VISITED;
+            auto& result = results_[index];
+            if(result.status != Status::PENDING) {
+                continue;
+            }
+            if(!waitIfPaused()) {
+                break;
+            }
+            // the file having the new name can't be moved away
+            ptrdiff_t blocker = blockers[index];
+            if(blocker >= 0 && results_[blocker].status != Status::RENAMED
+                    && currentPaths_[blocker] == renames_[blocker].path) {
+                result.status = Status::EXISTS;
+                continue;
+            }
+            GErrorPtr error;
+            if(renameFile(currentPaths_[index], targets[index], error)) {
+                result.status = Status::RENAMED;
+                result.newPath = targets[index];
+                currentPaths_[index] = targets[index];
+                continue;
+            }
+            if(currentPaths_[index] != renames_[index].path) {
+                // try to restore the old name of a file with a temporary name
+                GErrorPtr restoreError;
+                if(renameFile(currentPaths_[index], renames_[index].path, restoreError)) {
+                    currentPaths_[index] = renames_[index].path;
+                }
+                else {
+                    result.newPath = currentPaths_[index];
+                }
+            }
+            if(error.domain() == G_IO_ERROR && error.code() == G_IO_ERROR_EXISTS) {
+                result.status = Status::EXISTS;
+            }
+            else {
+                result.status = Status::FAILED;
+                result.error = std::move(error);
+            }
+        }
+    }
+}
+
+} // namespace Fm
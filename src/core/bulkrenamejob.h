@@ -0,0 +1,78 @@
+#ifndef FM2_BULKRENAMEJOB_H
+#define FM2_BULKRENAMEJOB_H
+
+#include "../libfmqtglobals.h"
+#include "job.h"
+#include "filepath.h"
+#include "fileinfo.h"
+#include <vector>
+#include <string>
+#include <unordered_set>
+
+namespace Fm {
+
+// Rename many files at once, like numbering or date-prefixing a folder of photos.
+// The conflicts of all new names are checked in one pass before any file is renamed: with the
+// files of the folder given by setFolderFiles(), or with the filesystem for the other folders.
+// A new name may be the old name of another file in the list, in which case that file is
+// renamed first, and the files renamed in a cycle ("a" -> "b" -> "a") go through temporary names.
+// The results of all the files are available together when the job is finished.
+class LIBFM_QT_API BulkRenameJob : public Job {
+    Q_OBJECT
+public:
+    struct Rename {
+        FilePath path;
+        std::string newName;
+    };
+
+    enum class Status {
+        PENDING, // not handled yet, or the job was cancelled before it
+        RENAMED,
+        UNCHANGED, // the new name is the same as the old one
+        INVALID_NAME, // the new name is empty or contains a '/'
+        DUPLICATE, // the new name is given to another file in the list too
+        EXISTS, // another file with the new name exists
+        FAILED // the renaming failed, see Result::error
+    };
+
+    struct Result {
+        Status status;
+        FilePath newPath; // only valid if the file is renamed
+        GErrorPtr error; // only set if the renaming failed
+    };
+
+    explicit BulkRenameJob(std::vector<Rename> renames);
+
+    // The files currently in a folder, so the new names in it are checked without querying the
+    // filesystem. It should be called in the thread of the folder before the job is started,
+    // usually with Folder::files().
+    void setFolderFiles(const FilePath& dirPath, const FileInfoList& files);
+
+    const std::vector<Rename>& renames() const {
+        return renames_;
+    }
+
+    // the result of each of the renames, valid after the job is finished
+    const std::vector<Result>& results() const {
+        return results_;
+    }
+
+protected:
+    void exec() override;
+
+private:
+    bool renameFile(const FilePath& from, const FilePath& to, GErrorPtr& error);
+
+    bool moveToTemporaryName(size_t index);
+
+private:
+    std::vector<Rename> renames_;
+    std::vector<Result> results_;
+    std::vector<FilePath> currentPaths_; // differ from the old paths while the files have temporary names
+    FilePath folderPath_;
+    std::unordered_set<std::string> folderNames_;
+};
+
+} // namespace Fm
+
+#endif // FM2_BULKRENAMEJOB_H
@@ -1,6 +1,11 @@
 #include "deletejob.h"
 #include "totalsizejob.h"
 #include "fileinfo_p.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 namespace Fm {
 
@@ -77,11 +82,33 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
     }
 
     addFinishedAmount(g_file_info_get_size(inf.get()), 1);
+    throttle();
 
     return !hasError;
 }
 
 bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
+    if(path.isNative()) {
+        // O_NOFOLLOW: the path might be replaced by a symlink after its info is queried
+        int fd = open(path.localPath().get(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if(fd >= 0) {
+            return deleteNativeDirContent(path, fd);
+        }
+        // let gio report the error
+    }
+
+    // use the content listed by the TotalSizeJob if it's available, so the dir is not enumerated twice
+    std::vector<TotalSizeJob::Entry> entries;
+    if(scannedTree_ && scannedTree_->takeDirContent(path, entries)) {
+        for(const auto& entry: entries) {
+            if(isCancelled()) {
+                break;
+            }
+            deleteFile(path.child(entry.name.c_str()), entry.fileInfo());
+        }
+        return true;
+    }
+
     GErrorPtr err;
     GFileEnumeratorPtr enu {
         g_file_enumerate_children(path.gfile().get(), defaultGFileInfoQueryAttribs,
@@ -121,12 +148,105 @@ bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
     return !hasError;
 }
 
+bool DeleteJob::deleteNativeDirContent(const FilePath& path, int dirFd) {
+    bool hasError = false;
+    std::vector<TotalSizeJob::Entry> entries;
+    if(!scannedTree_ || !scannedTree_->takeDirContent(path, entries)) {
+        // list the whole dir before deleting anything, so the removals don't disturb readdir()
+        int listFd = dup(dirFd);
+        DIR* dir = listFd >= 0 ? fdopendir(listFd) : nullptr;
+        for(;;) {
+            struct dirent* ent = nullptr;
+            if(dir) {
+                errno = 0;
+                ent = readdir(dir);
+            }
+            if(!ent) {
+                if(errno != 0) { // the failure of readdir(), dup(), or fdopendir()
+                    int errsv = errno;
+                    auto dispName = path.displayName();
+                    GErrorPtr err{G_IO_ERROR, g_io_error_from_errno(errsv),
+                                  tr("Error reading directory '%1': %2").arg(QString::fromUtf8(dispName.get()), QString::fromUtf8(g_strerror(errsv)))};
+                    emitError(err, ErrorSeverity::MODERATE);
+                    hasError = true;
+                }
+                break;
+            }
+            const char* name = ent->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            GFileType type = G_FILE_TYPE_UNKNOWN;
+            if(ent->d_type == DT_UNKNOWN) {
+                // some filesystems don't provide the type in the dir entries
+                struct stat st;
+                if(fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+                    type = G_FILE_TYPE_DIRECTORY;
+                }
+            }
+            else if(ent->d_type == DT_DIR) {
+                type = G_FILE_TYPE_DIRECTORY;
+            }
+            entries.emplace_back(TotalSizeJob::Entry{name, type, 0, 0});
+        }
+        if(dir) {
+            closedir(dir);
+        }
+        else if(listFd >= 0) {
+            close(listFd);
+        }
+    }
+
+    for(const auto& entry: entries) {
+        if(isCancelled()) {
+            break;
+        }
+        const char* name = entry.name.c_str();
+        int flags = 0;
+        if(entry.type == G_FILE_TYPE_DIRECTORY) {
+            auto subPath = path.child(name);
+            setCurrentFile(subPath);
+            int subFd = openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if(subFd < 0) {
+                // out of fds in a very deep tree or a permission problem, let gio do the work
+                if(!deleteFile(subPath, entry.fileInfo())) {
+                    hasError = true;
+                }
+                continue;
+            }
+            deleteNativeDirContent(subPath, subFd);
+            flags = AT_REMOVEDIR;
+        }
+        while(!isCancelled()) {
+            if(unlinkat(dirFd, name, flags) == 0) {
+                break;
+            }
+            int errsv = errno;
+            if(errsv == ENOENT) { // already deleted by someone else
+                break;
+            }
+            auto dispName = path.child(name).displayName();
+            GErrorPtr err{G_IO_ERROR, g_io_error_from_errno(errsv),
+                          tr("Error removing file '%1': %2").arg(QString::fromUtf8(dispName.get()), QString::fromUtf8(g_strerror(errsv)))};
+            if(emitError(err, ErrorSeverity::MODERATE) != ErrorAction::RETRY) {
+                hasError = true;
+                break;
+            }
+        }
+        // the size of dirs is not counted by TotalSizeJob
+        addFinishedAmount(flags == AT_REMOVEDIR ? 0 : entry.size, 1);
+        throttle();
+    }
+    close(dirFd);
+    return !hasError;
+}
+
 
-DeleteJob::DeleteJob(const FilePathList &paths): paths_{paths} {
+DeleteJob::DeleteJob(const FilePathList &paths): paths_{paths}, scannedTree_{nullptr} {
     setCalcProgressUsingSize(false);
 }
 
-DeleteJob::DeleteJob(FilePathList &&paths): paths_{paths} {
+DeleteJob::DeleteJob(FilePathList &&paths): paths_{paths}, scannedTree_{nullptr} {
     setCalcProgressUsingSize(false);
 }
 
@@ -134,8 +254,10 @@ DeleteJob::~DeleteJob() {
 }
 
 void DeleteJob::exec() {
+    throttle(); // lower the priority of the scan too in the background mode
     /* prepare the job, count total work needed with FmDeepCountJob */
-    TotalSizeJob totalSizeJob{paths_, TotalSizeJob::Flags::PREPARE_DELETE};
+    TotalSizeJob totalSizeJob{paths_, TotalSizeJob::Flags(TotalSizeJob::PREPARE_DELETE | TotalSizeJob::KEEP_TREE)};
+    totalSizeJob.pauseWith(*this);
     connect(&totalSizeJob, &TotalSizeJob::error, this, &DeleteJob::error);
     connect(this, &DeleteJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
     totalSizeJob.run();
@@ -143,6 +265,7 @@ void DeleteJob::exec() {
     if(isCancelled()) {
         return;
     }
+    scannedTree_ = &totalSizeJob;
 
     setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount());
     Q_EMIT preparedToRun();
@@ -153,6 +276,7 @@ void DeleteJob::exec() {
         }
         deleteFile(path, GFileInfoPtr{nullptr});
     }
+    scannedTree_ = nullptr;
 }
 
 } // namespace Fm
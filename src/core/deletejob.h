@@ -8,6 +8,8 @@
 
 namespace Fm {
 
+class TotalSizeJob;
+
 class LIBFM_QT_API DeleteJob : public Fm::FileOperationJob {
     Q_OBJECT
 public:
@@ -23,9 +25,12 @@ protected:
 private:
     bool deleteFile(const FilePath& path, GFileInfoPtr inf);
     bool deleteDirContent(const FilePath& path, GFileInfoPtr inf);
+    // delete the content of a native dir with unlinkat() relative to dirFd, which is closed on return
+    bool deleteNativeDirContent(const FilePath& path, int dirFd);
 
 private:
     FilePathList paths_;
+    TotalSizeJob* scannedTree_; // provides the content of the scanned dirs
 };
 
 } // namespace Fm
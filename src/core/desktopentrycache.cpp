@@ -0,0 +1,92 @@
+#include "desktopentrycache_p.h"
+#include "cstrptr.h"
+#include "jobtrace_p.h"
+#include <glib.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+// the most files kept, which covers the launchers of a desktop and /usr/share/applications
+static const size_t maxEntries = 4096;
+
+DesktopEntryCache::EntryList DesktopEntryCache::entries_;
+std::unordered_map<std::string, DesktopEntryCache::EntryList::iterator> DesktopEntryCache::index_;
+std::mutex DesktopEntryCache::mutex_;
+
+// static
+std::shared_ptr<const DesktopEntryFields> DesktopEntryCache::lookup(const char* localPath) {
+    struct stat st;
+    if(!localPath || stat(localPath, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    std::int64_t mtime = st.st_mtim.tv_sec;
+    std::int64_t mtimeNsec = st.st_mtim.tv_nsec;
+    std::uint64_t size = st.st_size;
+    std::string key{localPath};
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = index_.find(key);
+        if(it != index_.end()) {
+            const Entry& entry = it->second->second;
+            if(entry.mtime == mtime && entry.mtimeNsec == mtimeNsec && entry.size == size) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return entry.fields;
+            }
+        }
+    }
+
+    // parsed without the lock, so other files can be looked up meanwhile
+    auto fields = parse(localPath);
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = index_.find(key);
+    if(it != index_.end()) {
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    entries_.emplace_front(key, Entry{mtime, mtimeNsec, size, fields});
+    index_.emplace(std::move(key), entries_.begin());
+    while(entries_.size() > maxEntries) {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+    return fields;
+}
+
+// static
+void DesktopEntryCache::clear() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    index_.clear();
+    entries_.clear();
+}
+
+// static
+std::shared_ptr<const DesktopEntryFields> DesktopEntryCache::parse(const char* localPath) {
+    BlockingScope scope{"DesktopEntryCache::parse"};
+    std::shared_ptr<DesktopEntryFields> fields;
+    GKeyFile* kf = g_key_file_new();
+    if(g_key_file_load_from_file(kf, localPath, G_KEY_FILE_NONE, nullptr)) {
+        fields = std::make_shared<DesktopEntryFields>();
+        CStrPtr type{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_TYPE, nullptr)};
+        if(type) {
+            fields->type = type.get();
+        }
+        CStrPtr url{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_URL, nullptr)};
+        if(url) {
+            fields->url = url.get();
+        }
+        CStrPtr icon{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_ICON, nullptr)};
+        if(icon) {
+            fields->icon = icon.get();
+        }
+        CStrPtr name{g_key_file_get_locale_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_NAME, nullptr, nullptr)};
+        if(name) {
+            fields->name = QString::fromUtf8(name.get());
+        }
+        fields->hidden = g_key_file_get_boolean(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_HIDDEN, nullptr);
+    }
+    g_key_file_free(kf);
+    return fields;
+}
+
+} // namespace Fm
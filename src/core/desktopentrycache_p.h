@@ -0,0 +1,53 @@
+#ifndef FM2_DESKTOPENTRYCACHE_P_H
+#define FM2_DESKTOPENTRYCACHE_P_H
+
+#include <QString>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Fm {
+
+// The fields of the "Desktop Entry" group of a .desktop or .directory file, which are used to show it.
+struct DesktopEntryFields {
+    std::string type;
+    std::string url;  // of a Link entry
+    std::string icon;
+    QString name;     // localized
+    bool hidden;
+};
+
+// Parsing a desktop entry file is much more costly than checking whether it's changed, so the parsed
+// fields are shared by all FileInfo objects, the custom folder icons and the bookmarks. A file is
+// parsed again only when its mtime in nanoseconds or its size changes, so a file rewritten within
+// the same second is not missed. It can be used in any thread.
+class DesktopEntryCache {
+public:
+    // the fields of the file at the local path, or nullptr if it can't be parsed. The mtime and the size
+    // are read with stat(), and nullptr is returned if the file doesn't exist or isn't a regular file.
+    static std::shared_ptr<const DesktopEntryFields> lookup(const char* localPath);
+
+    static void clear();
+
+private:
+    struct Entry {
+        std::int64_t mtime;
+        std::int64_t mtimeNsec;
+        std::uint64_t size;
+        std::shared_ptr<const DesktopEntryFields> fields;
+    };
+
+    static std::shared_ptr<const DesktopEntryFields> parse(const char* localPath);
+
+    typedef std::list<std::pair<std::string, Entry>> EntryList;
+    static EntryList entries_; // the most recently used first
+    static std::unordered_map<std::string, EntryList::iterator> index_;
+    static std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_DESKTOPENTRYCACHE_P_H
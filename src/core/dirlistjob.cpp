@@ -1,27 +1,74 @@
 #include "dirlistjob.h"
 #include <gio/gio.h>
 #include "fileinfo_p.h"
+#include "jobtrace_p.h"
+#include "foldersnapshot_p.h"
+#include "filesystemcapabilities_p.h"
 #include "gioptrs.h"
+#include "vfs/fm-search-enumerator.h"
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <QDebug>
 
 namespace Fm {
 
-DirListJob::DirListJob(const FilePath& path, Flags _flags, const std::shared_ptr<const HashSet>& cutFilesHashSet):
-    dir_path{path}, flags{_flags}, cutFilesHashSet_{cutFilesHashSet} {
+namespace {
+
+// state of a pending g_file_enumerator_next_files_async() request
+struct NextFilesRequest {
+    GList* infos = nullptr;
+    GErrorPtr err;
+    bool finished = false;
+};
+
+void onNextFilesReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    auto request = static_cast<NextFilesRequest*>(user_data);
+    request->infos = g_file_enumerator_next_files_finish(G_FILE_ENUMERATOR(source), res, &request->err);
+    request->finished = true;
+}
+
+} // namespace
+
+DirListJob::DirListJob(const FilePath& path, Flags _flags, const std::shared_ptr<const CutFileSet>& cutFilesHashSet):
+    dir_path{path},
+    flags{_flags},
+    cutFilesHashSet_{cutFilesHashSet},
+    nativeListing_{true},
+    emit_files_found{false},
+    batchSize_{256},
+    batchInterval_{100},
+    enumBatchSize_{256},
+    recordSnapshot_{false},
+    fileInfoPool_{std::make_shared<FileInfoPool>()} {
+    setPriority(Priority::INTERACTIVE);
+}
+
+void DirListJob::setIncremental(bool set) {
+    emit_files_found = set;
 }
 
 void DirListJob::exec() {
     GErrorPtr err;
     GFileInfoPtr dir_inf;
-    GFilePtr dir_gfile = dir_path.gfile();
-    // FIXME: these are hacks for search:/// URI implemented by libfm which contains some bugs
+    const GFilePtr& dir_gfile = dir_path.gfile();
     bool isFileSearch = dir_path.hasUriScheme("search");
     if(isFileSearch) {
-        // NOTE: The GFile instance changes its URI during file enumeration (bad design).
-        // So we create a copy here to avoid channging the gfile stored in dir_path.
-        // FIXME: later we should refactor file search and remove this dirty hack.
-        dir_gfile = GFilePtr{g_file_dup(dir_gfile.get())};
+        // the search results always come with their full info
+        flags = static_cast<Flags>(flags | DETAILED);
     }
+    TraceSpan querySpan{"DirListJob::queryDirInfo"};
 _retry:
     err.reset();
     dir_inf = GFileInfoPtr{
@@ -49,130 +96,300 @@ _retry:
         return;
     }
     else {
+        // Query the filesystem once for all its files, which get their read-only flags from
+        // the cache instead of the filesystem::readonly attribute.
+        if(auto fsId = g_file_info_get_attribute_string(dir_inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM)) {
+            FileSystemCapabilities::query(g_intern_string(fsId), dir_path, cancellable().get());
+        }
         std::lock_guard<std::mutex> lock{mutex_};
         dir_fi = std::make_shared<FileInfo>(dir_inf, dir_path.parent());
     }
+    querySpan.end();
 
-    FileInfoList foundFiles;
-    /* check if FS is R/O and set attr. into inf */
-    // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
-    err.reset();
-    GFileEnumeratorPtr enu = GFileEnumeratorPtr{
-            g_file_enumerate_children(dir_gfile.get(), defaultGFileInfoQueryAttribs,
-                                      G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
-            false
-    };
-    if(enu) {
-        // qDebug() << "START LISTING:" << dir_path.toString().get();
-        while(!isCancelled()) {
-            err.reset();
-            GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
-            if(inf) {
-#if 0
-                FmPath* dir, *sub;
-                GFile* child;
-                if(G_UNLIKELY(job->flags & FM_DIR_LIST_JOB_DIR_ONLY)) {
-                    /* FIXME: handle symlinks */
-                    if(g_file_info_get_file_type(inf) != G_FILE_TYPE_DIRECTORY) {
-                        g_object_unref(inf);
-                        continue;
-                    }
-                }
-#endif
-                // virtual folders may return children not within them
-                // For example: the search:/// URI implemented by libfm might return files from different folders during enumeration.
-                // So here we call g_file_enumerator_get_container() to get the real parent path rather than simply using dir_path.
-                // This is not the behaviour of gio, but the extensions by libfm might do this.
-                // FIXME: after we port these vfs implementation from libfm, we can redesign this.
-                FilePath realParentPath = FilePath{g_file_enumerator_get_container(enu.get()), true};
-                if(isFileSearch) { // this is a file sarch job (search:/// URI)
-                    // FIXME: redesign file search and remove this dirty hack
-                    // the libfm implementation of search:/// URI returns a customized GFile implementation that does not behave normally.
-                    // let's get its actual URI and re-create a normal gio GFile instance from it.
-                    realParentPath = FilePath::fromUri(realParentPath.uri().get());
-                }
-#if 0
-                if(g_file_info_get_file_type(inf) == G_FILE_TYPE_DIRECTORY)
-                    /* for dir: check if its FS is R/O and set attr. into inf */
-                {
-                    _fm_file_info_job_update_fs_readonly(child, inf, nullptr, nullptr);
-                }
-                fi = fm_file_info_new_from_g_file_data(child, inf, sub);
-#endif
-                auto fileInfo = std::make_shared<FileInfo>(inf, realParentPath);
-                if(emit_files_found) {
-                    // Q_EMIT filesFound();
-                }
-
-                if(cutFilesHashSet_
-                        && cutFilesHashSet_->count(fileInfo->path().hash()) > 0) {
-                    fileInfo->bindCutFiles(cutFilesHashSet_);
-                }
+    batchTimer_.start();
+    // For local folders, the detailed info of the files are not needed in FAST mode,
+    // so we can read the directory ourselves and avoid the overhead of gio.
+    // the mime types and icons are looked up while the file infos are created in this span
+    TraceSpan listSpan{"DirListJob::list"};
+    bool listed = false;
+    if(nativeListing_ && !(flags & DETAILED) && !isFileSearch && dir_path.isNative()) {
+        listed = listNativeFiles();
+    }
 
-                foundFiles.push_back(std::move(fileInfo));
+    if(!listed) {
+        err.reset();
+        // in FAST mode, the details of the files will be queried later when they're needed
+        GFileEnumeratorPtr enu = GFileEnumeratorPtr{
+                g_file_enumerate_children(dir_gfile.get(),
+                                          (flags & DETAILED) ? defaultGFileInfoQueryAttribs : fastGFileInfoQueryAttribs,
+                                          G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
+                false
+        };
+        if(enu) {
+            // qDebug() << "START LISTING:" << dir_path.toString().get();
+            // Remote backends (sftp, smb) pay one round trip per g_file_enumerator_next_file() call,
+            // so we fetch the file infos in batches for them.
+            if(fm_is_search_enumerator(enu.get())) {
+                listSearchResults(enu.get());
+            }
+            else if(enumBatchSize_ > 0 && !dir_path.isNative()) {
+                listFilesBatched(enu.get());
             }
             else {
-                if(err) {
-                    ErrorAction act = emitError(err, ErrorSeverity::MILD);
-                    /* ErrorAction::RETRY is not supported. */
-                    if(act == ErrorAction::ABORT) {
-                        cancel();
-                    }
-                }
-                /* otherwise it's EOL */
-                break;
+                listFiles(enu.get());
             }
+            err.reset();
+            g_file_enumerator_close(enu.get(), cancellable().get(), &err);
+        }
+        else {
+            emitError(err, ErrorSeverity::CRITICAL);
         }
-        err.reset();
-        g_file_enumerator_close(enu.get(), cancellable().get(), &err);
     }
-    else {
-        emitError(err, ErrorSeverity::CRITICAL);
+
+    listSpan.end();
+
+    // only the listings through gio are saved, since the native listing has no GFileInfo
+    if(recordSnapshot_ && !listed && !isCancelled()) {
+        FolderSnapshot::save(dir_path, snapshotInfos_, flags & DETAILED);
     }
+    snapshotInfos_.clear();
 
     // qDebug() << "END LISTING:" << dir_path.toString().get();
-    if(!foundFiles.empty()) {
+    if(emit_files_found && !foundFiles_.empty() && !isCancelled()) {
+        // flush the last batch
+        TraceSpan emitSpan{"DirListJob::filesFound"};
+        emitSpan.addCount(foundFiles_.size());
+        Q_EMIT filesFound(foundFiles_);
+        foundFiles_.clear();
+    }
+    if(!foundFiles_.empty()) {
         std::lock_guard<std::mutex> lock{mutex_};
-        files_.swap(foundFiles);
+        files_.swap(foundFiles_);
+    }
+}
+
+FilePath DirListJob::containerPath(GFileEnumerator* enu) const {
+    // virtual folders may return children not within them, so the real parent path
+    // is taken from g_file_enumerator_get_container() rather than dir_path.
+    // This is not the behaviour of gio, but the extensions by libfm might do this.
+    return FilePath{g_file_enumerator_get_container(enu), true};
+}
+
+void DirListJob::addFoundFile(std::shared_ptr<FileInfo> fileInfo) {
+    if((flags & DIR_ONLY) && !fileInfo->isDir()) {
+        return;
+    }
+    fileInfo->isPartial_ = !(flags & DETAILED);
+    if(cutFilesHashSet_
+            && cutFilesHashSet_->contains(fileInfo->dirPath(), fileInfo->name())) {
+        fileInfo->bindCutFiles(cutFilesHashSet_);
+    }
+
+    foundFiles_.push_back(std::move(fileInfo));
+
+    // emit the files found so far if the batch is full or we held them for too long
+    if(emit_files_found
+            && (foundFiles_.size() >= batchSize_ || batchTimer_.elapsed() >= batchInterval_)) {
+        TraceSpan emitSpan{"DirListJob::filesFound"};
+        emitSpan.addCount(foundFiles_.size());
+        Q_EMIT filesFound(foundFiles_);
+        foundFiles_.clear();
+        batchTimer_.restart();
     }
 }
 
+void DirListJob::listFiles(GFileEnumerator* enu) {
+    // all files share the same parent path object instead of creating one for each of them.
+    auto parentPath = containerPath(enu);
+    // the files of a folder mostly share a few icons
+    FileInfoIconMemo iconMemo;
+    while(!isCancelled()) {
+        GErrorPtr err;
+        GFileInfoPtr inf{g_file_enumerator_next_file(enu, cancellable().get(), &err), false};
+        if(inf) {
 #if 0
-//FIXME: incremental..
+            if(g_file_info_get_file_type(inf) == G_FILE_TYPE_DIRECTORY)
+                /* for dir: check if its FS is R/O and set attr. into inf */
+            {
+                _fm_file_info_job_update_fs_readonly(child, inf, nullptr, nullptr);
+            }
+            fi = fm_file_info_new_from_g_file_data(child, inf, sub);
+#endif
+            if(recordSnapshot_) {
+                snapshotInfos_.push_back(inf);
+            }
+            auto fileInfo = std::allocate_shared<FileInfo>(FileInfoPoolAllocator<FileInfo>{fileInfoPool_});
+            fileInfo->setFromGFileInfo(inf, parentPath, &iconMemo);
+            addFoundFile(std::move(fileInfo));
+        }
+        else {
+            if(err) {
+                // an incomplete listing is not saved
+                recordSnapshot_ = false;
+                ErrorAction act = emitError(err, ErrorSeverity::MILD);
+                /* ErrorAction::RETRY is not supported. */
+                if(act == ErrorAction::ABORT) {
+                    cancel();
+                }
+            }
+            /* otherwise it's EOL */
+            break;
+        }
+    }
+}
+
+void DirListJob::listFilesBatched(GFileEnumerator* enu) {
+    // The async requests are dispatched to the thread-default main context,
+    // so we need our own main context in the job thread.
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
 
-static gboolean emit_found_files(gpointer user_data) {
-    /* this callback is called from the main thread */
-    FmDirListJob* job = FM_DIR_LIST_JOB(user_data);
-    /* g_print("emit_found_files: %d\n", g_slist_length(job->files_to_add)); */
+    auto parentPath = containerPath(enu);
+    FileInfoIconMemo iconMemo;
+    std::unique_ptr<NextFilesRequest> request{new NextFilesRequest{}};
+    g_file_enumerator_next_files_async(enu, enumBatchSize_, G_PRIORITY_DEFAULT, cancellable().get(),
+                                       &onNextFilesReady, request.get());
+    while(request) {
+        while(!request->finished) {
+            g_main_context_iteration(context, TRUE);
+        }
+        GList* infos = request->infos;
+        GErrorPtr err = std::move(request->err);
+        if(infos != nullptr && !isCancelled()) {
+            // Request the next batch before handling this one so the backend can work on it meanwhile.
+            // NOTE: GFileEnumerator does not allow more than one pending operation.
+            request.reset(new NextFilesRequest{});
+            g_file_enumerator_next_files_async(enu, enumBatchSize_, G_PRIORITY_DEFAULT, cancellable().get(),
+                                               &onNextFilesReady, request.get());
+        }
+        else {
+            request.reset();
+        }
 
-    if(g_source_is_destroyed(g_main_current_source())) {
-        return FALSE;
+        for(GList* l = infos; l; l = l->next) {
+            GFileInfoPtr inf{G_FILE_INFO(l->data), false};
+            if(!isCancelled()) {
+                if(recordSnapshot_) {
+                    snapshotInfos_.push_back(inf);
+                }
+                auto fileInfo = std::allocate_shared<FileInfo>(FileInfoPoolAllocator<FileInfo>{fileInfoPool_});
+                fileInfo->setFromGFileInfo(inf, parentPath, &iconMemo);
+                addFoundFile(std::move(fileInfo));
+            }
+        }
+        g_list_free(infos);
+
+        if(err && !isCancelled()) {
+            recordSnapshot_ = false;
+            ErrorAction act = emitError(err, ErrorSeverity::MILD);
+            /* ErrorAction::RETRY is not supported. */
+            if(act == ErrorAction::ABORT) {
+                cancel();
+            }
+        }
     }
-    g_signal_emit(job, signals[FILES_FOUND], 0, job->files_to_add);
-    g_slist_free_full(job->files_to_add, (GDestroyNotify)fm_file_info_unref);
-    job->files_to_add = nullptr;
-    job->delay_add_files_handler = 0;
-    return FALSE;
+
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
 }
 
-static gpointer queue_add_file(FmJob* fmjob, gpointer user_data) {
-    FmDirListJob* job = FM_DIR_LIST_JOB(fmjob);
-    FmFileInfo* file = FM_FILE_INFO(user_data);
-    /* this callback is called from the main thread */
-    /* g_print("queue_add_file: %s\n", fm_file_info_get_disp_name(file)); */
-    job->files_to_add = g_slist_prepend(job->files_to_add, fm_file_info_ref(file));
-    if(job->delay_add_files_handler == 0)
-        job->delay_add_files_handler = g_timeout_add_seconds_full(G_PRIORITY_LOW,
-                                       1, emit_found_files, g_object_ref(job), g_object_unref);
-    return nullptr;
+void DirListJob::listSearchResults(GFileEnumerator* enu) {
+    // The results come from many folders, but those of a folder share the same GFile,
+    // so the parent paths are looked up by the GFile first and then by the path.
+    // Files found in the same folder share one parent path object.
+    std::unordered_map<FilePath, FilePath> parentPaths;
+    GFile* lastParent = nullptr;
+    FilePath parentPath;
+    FileInfoIconMemo iconMemo;
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+    while(!isCancelled()) {
+        GErrorPtr err;
+        GFile* parent = nullptr;
+        gboolean timedOut;
+        // don't hold the found files while the search is still looking for more
+        GFileInfoPtr inf{fm_search_enumerator_next_result(enu, &parent, gint64(batchInterval_) * 1000, &timedOut,
+                                                          cancellable().get(), &err), false};
+        if(progressTimer.elapsed() >= batchInterval_ || timedOut) {
+            guint scanned, matched;
+            fm_search_enumerator_get_progress(enu, &scanned, &matched);
+            Q_EMIT searchProgress(scanned, matched);
+            progressTimer.restart();
+        }
+        if(timedOut) {
+            if(emit_files_found && !foundFiles_.empty()) {
+                Q_EMIT filesFound(foundFiles_);
+                foundFiles_.clear();
+                batchTimer_.restart();
+            }
+            continue;
+        }
+        if(inf) {
+            FilePath realParent{parent, false};
+            if(parent != lastParent) {
+                lastParent = parent;
+                auto it = parentPaths.find(realParent);
+                if(it == parentPaths.end()) {
+                    it = parentPaths.emplace(realParent, realParent).first;
+                }
+                parentPath = it->second;
+            }
+            auto fileInfo = std::allocate_shared<FileInfo>(FileInfoPoolAllocator<FileInfo>{fileInfoPool_});
+            fileInfo->setFromGFileInfo(inf, parentPath, &iconMemo);
+            addFoundFile(std::move(fileInfo));
+        }
+        else {
+            if(err) {
+                ErrorAction act = emitError(err, ErrorSeverity::MILD);
+                /* ErrorAction::RETRY is not supported. */
+                if(act == ErrorAction::ABORT) {
+                    cancel();
+                }
+            }
+            break;
+        }
+    }
 }
 
-void fm_dir_list_job_add_found_file(FmDirListJob* job, FmFileInfo* file) {
-    fm_file_info_list_push_tail(job->files, file);
-    if(G_UNLIKELY(job->emit_files_found)) {
-        fm_job_call_main_thread(FM_JOB(job), queue_add_file, file);
+bool DirListJob::listNativeFiles() {
+    auto localPath = dir_path.localPath();
+    DIR* dir = opendir(localPath.get());
+    if(!dir) {
+        // let gio handle and report the error
+        return false;
     }
+    int dirFd = dirfd(dir);
+
+    // files listed in the .hidden file are hidden, too
+    auto hiddenNames = readHiddenNames(localPath.get());
+
+    // files can be deleted only if the folder is writable
+    bool dirWritable = (access(localPath.get(), W_OK) == 0);
+
+    // NOTE: glibc implements readdir() with large getdents64() reads, so one syscall returns many entries.
+    struct dirent* entry;
+    while(!isCancelled() && (entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        // skip the files without stat() if the type is known, symlinks might point to dirs
+        if((flags & DIR_ONLY) && entry->d_type != DT_DIR && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        NativeFileStat stat;
+        stat.name = name;
+        if(!nativeFileStat(dirFd, dirWritable, hiddenNames, stat)) {
+            continue;  // the file is already removed
+        }
+
+        auto fileInfo = std::allocate_shared<FileInfo>(FileInfoPoolAllocator<FileInfo>{fileInfoPool_});
+        fileInfo->setFromNativeStat(stat, dir_path);
+        addFoundFile(std::move(fileInfo));
+    }
+
+    closedir(dir);
+    return true;
 }
-#endif
 
 } // namespace Fm
@@ -3,13 +3,18 @@
 
 #include "../libfmqtglobals.h"
 #include <mutex>
+#include <vector>
+#include <QElapsedTimer>
 #include "job.h"
 #include "filepath.h"
 #include "gobjectptr.h"
+#include "gioptrs.h"
 #include "fileinfo.h"
 
 namespace Fm {
 
+class FileInfoPool;
+
 class LIBFM_QT_API DirListJob : public Job {
     Q_OBJECT
 public:
@@ -19,18 +24,67 @@ public:
         DETAILED = 1 << 1
     };
 
-    explicit DirListJob(const FilePath& path, Flags flags, const std::shared_ptr<const HashSet>& cutFilesHashSet = nullptr);
+    explicit DirListJob(const FilePath& path, Flags flags, const std::shared_ptr<const CutFileSet>& cutFilesHashSet = nullptr);
 
     FileInfoList& files() {
         return files_;
     }
 
+    // In incremental mode, found files are emitted in batches with filesFound()
+    // while the directory is still being enumerated. files() then only holds the
+    // files which are not emitted yet.
     void setIncremental(bool set);
 
     bool incremental() const {
         return emit_files_found;
     }
 
+    // max number of files in a batch emitted by filesFound()
+    void setBatchSize(size_t size) {
+        batchSize_ = size;
+    }
+
+    size_t batchSize() const {
+        return batchSize_;
+    }
+
+    // max time (in milliseconds) to hold found files before emitting them
+    void setBatchInterval(int msec) {
+        batchInterval_ = msec;
+    }
+
+    int batchInterval() const {
+        return batchInterval_;
+    }
+
+    // read local folders directly instead of using gio in FAST mode
+    void setNativeListing(bool set) {
+        nativeListing_ = set;
+    }
+
+    bool nativeListing() const {
+        return nativeListing_;
+    }
+
+    // number of file infos requested from remote backends at once (0 to disable batched enumeration)
+    void setEnumerationBatchSize(int size) {
+        enumBatchSize_ = size;
+    }
+
+    int enumerationBatchSize() const {
+        return enumBatchSize_;
+    }
+
+    // Save the listing with FolderSnapshot when it's finished, so the folder can be shown from it
+    // before it's listed again. The listing is not saved if it fails or it's cancelled.
+    void setSnapshotRecording(bool set) {
+        recordSnapshot_ = set;
+    }
+
+    bool snapshotRecording() const {
+        return recordSnapshot_;
+    }
+
     FilePath dirPath() const {
         std::lock_guard<std::mutex> lock{mutex_};
         return dir_path;
@@ -42,22 +96,49 @@ public:
     }
 
 Q_SIGNALS:
+    // emitted in the worker thread, and the files may be moved away by the receiver.
+    // This signal should be connected with Qt::DirectConnection, and the files are handed to
+    // the main thread without blocking the job.
     void filesFound(FileInfoList& foundFiles);
 
+    // emitted regularly while the results of a search:// URI are listed
+    void searchProgress(unsigned int scannedFiles, unsigned int matchedFiles);
+
 protected:
 
     void exec() override;
 
+private:
+    FilePath containerPath(GFileEnumerator* enu) const;
+
+    void addFoundFile(std::shared_ptr<FileInfo> fileInfo);
+
+    void listFiles(GFileEnumerator* enu);
+
+    void listFilesBatched(GFileEnumerator* enu);
+
+    // the results of search:// URIs, which come from many folders
+    void listSearchResults(GFileEnumerator* enu);
+
+    bool listNativeFiles();
+
 private:
     mutable std::mutex mutex_;
     FilePath dir_path;
     Flags flags;
     std::shared_ptr<const FileInfo> dir_fi;
     FileInfoList files_;
-    const std::shared_ptr<const HashSet> cutFilesHashSet_;
+    const std::shared_ptr<const CutFileSet> cutFilesHashSet_;
+    bool nativeListing_;
     bool emit_files_found;
-    // guint delay_add_files_handler;
-    // GSList* files_to_add;
+    size_t batchSize_;
+    int batchInterval_;
+    int enumBatchSize_;
+    bool recordSnapshot_;
+    std::vector<GFileInfoPtr> snapshotInfos_;
+    FileInfoList foundFiles_;
+    QElapsedTimer batchTimer_;
+    std::shared_ptr<FileInfoPool> fileInfoPool_; // memory of the listed FileInfo objects
 };
 
 } // namespace Fm
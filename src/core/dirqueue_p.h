@@ -0,0 +1,57 @@
+#ifndef DIRQUEUE_P_H
+#define DIRQUEUE_P_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <gio/gio.h>
+#include "filepath.h"
+
+namespace Fm {
+
+// The dirs waiting to be processed by the threads of a job walking a tree in parallel.
+// The last pushed dir is taken first, so each thread mostly walks down its own subtree
+// and the queue stays short.
+class DirQueue {
+public:
+    explicit DirQueue(int threadCount): busy_{threadCount} {
+    }
+
+    void push(FilePath dir) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        dirs_.emplace_back(std::move(dir));
+        cond_.notify_one();
+    }
+
+    // Called by a thread after it finishes processing the previous dir.
+    // Returns false when all dirs are processed or the job is cancelled.
+    bool pop(FilePath& dir, GCancellable* cancellable) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        --busy_;
+        for(;;) {
+            if(g_cancellable_is_cancelled(cancellable) || (dirs_.empty() && busy_ == 0)) {
+                // no one can push more dirs
+                cond_.notify_all();
+                return false;
+            }
+            if(!dirs_.empty()) {
+                break;
+            }
+            cond_.wait(lock);
+        }
+        dir = std::move(dirs_.back());
+        dirs_.pop_back();
+        ++busy_;
+        return true;
+    }
+
+private:
+    int busy_; // number of threads which are processing a dir
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<FilePath> dirs_;
+};
+
+} // namespace Fm
+
+#endif // DIRQUEUE_P_H
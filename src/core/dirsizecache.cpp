@@ -0,0 +1,221 @@
+#include "dirsizecache.h"
+#include "totalsizejob.h"
+#include "jobtrace_p.h"
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QCoreApplication>
+
+namespace Fm {
+
+// (version, [(URI, mtime, size)])
+static const char cacheType[] = "(ua(stt))";
+static const guint32 cacheVersion = 1;
+// each dir is scanned by a job with a few threads, and a few dirs are scanned at the same time
+static const int maxJobs = 2;
+static const int jobThreadCount = 2;
+// the queued dirs are scanned after a while, so the dirs only scrolled past are not all scanned,
+// and the dirs changed repeatedly are not scanned again on each change
+static const int startDelay = 500;
+static const int saveDelay = 10000;
+static const size_t maxEntries = 50000;
+
+std::mutex DirSizeCache::mutex_;
+std::weak_ptr<DirSizeCache> DirSizeCache::globalInstance_;
+
+static QString cacheFilePath() {
+    CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "dirsizes", nullptr)};
+    return QString::fromLocal8Bit(path.get());
+}
+
+DirSizeCache::DirSizeCache(): QObject(), dirty_{false} {
+    startTimer_.setSingleShot(true);
+    startTimer_.setInterval(startDelay);
+    connect(&startTimer_, &QTimer::timeout, this, &DirSizeCache::startJobs);
+    saveTimer_.setSingleShot(true);
+    saveTimer_.setInterval(saveDelay);
+    connect(&saveTimer_, &QTimer::timeout, this, &DirSizeCache::save);
+    // the global instance might live until the static objects are destroyed
+    if(qApp) {
+        connect(qApp, &QCoreApplication::aboutToQuit, this, &DirSizeCache::save);
+    }
+    load();
+}
+
+DirSizeCache::~DirSizeCache() {
+    for(auto& item : jobs_) {
+        item.first->cancel();
+    }
+    save();
+}
+
+// static
+std::shared_ptr<DirSizeCache> DirSizeCache::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto cache = globalInstance_.lock();
+    if(!cache) {
+        cache = std::make_shared<DirSizeCache>();
+        globalInstance_ = cache;
+    }
+    return cache;
+}
+
+bool DirSizeCache::size(const FilePath& dir, std::uint64_t mtime, std::uint64_t* totalSize) const {
+    auto it = entries_.find(dir);
+    if(it == entries_.end() || it->second.mtime != mtime) {
+        return false;
+    }
+    *totalSize = it->second.size;
+    return true;
+}
+
+void DirSizeCache::requestSize(const FilePath& dir, std::uint64_t mtime) {
+    // the sizes of the remote dirs are too slow to get, and other dirs are virtual
+    if(!dir.isNative() || queuedDirs_.count(dir) > 0) {
+        return;
+    }
+    std::uint64_t totalSize;
+    if(size(dir, mtime, &totalSize)) {
+        return;
+    }
+    for(auto& item : jobs_) {
+        if(item.second.dir == dir && staleJobs_.count(item.first) == 0) {
+            return; // being scanned
+        }
+    }
+    queuedDirs_.insert(dir);
+    queue_.push_back(Request{dir, mtime});
+    if(!startTimer_.isActive() && jobs_.size() < size_t(maxJobs)) {
+        startTimer_.start();
+    }
+}
+
+void DirSizeCache::invalidate(const FilePath& dir) {
+    // the results of the running jobs are dropped, and the dirs are requested again by the views
+    for(auto& item : jobs_) {
+        FilePath jobDir = item.second.dir;
+        if((jobDir == dir || jobDir.isPrefixOf(dir)) && staleJobs_.insert(item.first).second) {
+            Q_EMIT invalidated(jobDir);
+        }
+    }
+    for(FilePath path = dir; path; path = path.hasParent() ? path.parent() : FilePath{}) {
+        if(entries_.erase(path) > 0) {
+            dirty_ = true;
+            Q_EMIT invalidated(path);
+        }
+    }
+    if(dirty_ && !saveTimer_.isActive()) {
+        saveTimer_.start();
+    }
+}
+
+// static
+void DirSizeCache::invalidateGlobal(const FilePath& dir) {
+    std::shared_ptr<DirSizeCache> cache;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        cache = globalInstance_.lock();
+    }
+    if(cache) {
+        cache->invalidate(dir);
+    }
+}
+
+void DirSizeCache::startJobs() {
+    while(jobs_.size() < size_t(maxJobs) && !queue_.empty()) {
+        Request request = std::move(queue_.front());
+        queue_.pop_front();
+        queuedDirs_.erase(request.dir);
+        // the mounted filesystems inside the dir are not counted, like "du -x"
+        auto job = new TotalSizeJob{FilePathList{request.dir}, TotalSizeJob::SAME_FS};
+        job->setThreadCount(jobThreadCount);
+        job->setAutoDelete(true);
+        connect(job, &TotalSizeJob::finished, this, &DirSizeCache::onJobFinished, Qt::QueuedConnection);
+        jobs_.emplace(job, std::move(request));
+        job->runAsync(QThread::LowPriority);
+    }
+}
+
+void DirSizeCache::onJobFinished() {
+    auto job = static_cast<TotalSizeJob*>(sender());
+    auto it = jobs_.find(job);
+    if(it == jobs_.end()) {
+        return;
+    }
+    Request request = std::move(it->second);
+    jobs_.erase(it);
+    bool stale = staleJobs_.erase(job) > 0;
+    if(!stale && !job->isCancelled()) {
+        if(entries_.size() >= maxEntries) {
+            entries_.clear();
+        }
+        entries_[request.dir] = Entry{request.mtime, job->totalSize()};
+        dirty_ = true;
+        if(!saveTimer_.isActive()) {
+            saveTimer_.start();
+        }
+        Q_EMIT sizeChanged(request.dir, job->totalSize());
+    }
+    if(!queue_.empty() && !startTimer_.isActive()) {
+        startJobs();
+    }
+}
+
+void DirSizeCache::load() {
+    BlockingScope blocking{"DirSizeCache::load"};
+    QFile file{cacheFilePath()};
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return;
+    }
+    auto data = file.map(0, file.size());
+    if(!data) {
+        return;
+    }
+    // the data is checked by GVariant while it's read, and the values are copied out of the mapped file
+    GVariant* cache = g_variant_ref_sink(g_variant_new_from_data(G_VARIANT_TYPE(cacheType), data, file.size(),
+                                                                 FALSE, nullptr, nullptr));
+    guint32 version;
+    GVariantIter* iter;
+    g_variant_get(cache, "(ua(stt))", &version, &iter);
+    if(version == cacheVersion) {
+        entries_.reserve(g_variant_iter_n_children(iter));
+        const char* uri;
+        guint64 mtime;
+        guint64 size;
+        while(g_variant_iter_next(iter, "(&stt)", &uri, &mtime, &size)) {
+            entries_[FilePath::fromUri(uri)] = Entry{mtime, size};
+        }
+    }
+    g_variant_iter_free(iter);
+    g_variant_unref(cache);
+}
+
+void DirSizeCache::save() {
+    if(!dirty_) {
+        return;
+    }
+    TraceSpan span{"DirSizeCache::save"};
+    span.addCount(entries_.size());
+    dirty_ = false;
+    saveTimer_.stop();
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(stt)"));
+    for(auto& item : entries_) {
+        auto uri = item.first.uri();
+        g_variant_builder_add(&builder, "(stt)", uri.get(), guint64(item.second.mtime), guint64(item.second.size));
+    }
+    GVariant* cache = g_variant_ref_sink(g_variant_new(cacheType, cacheVersion, &builder));
+
+    // another process might be reading the old file, so a new file is written and renamed
+    QString path = cacheFilePath();
+    QDir().mkpath(QFileInfo{path}.absolutePath());
+    QSaveFile file{path};
+    if(file.open(QIODevice::WriteOnly)) {
+        file.write(static_cast<const char*>(g_variant_get_data(cache)), g_variant_get_size(cache));
+        file.commit();
+    }
+    g_variant_unref(cache);
+}
+
+} // namespace Fm
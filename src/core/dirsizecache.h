@@ -0,0 +1,88 @@
+#ifndef FM2_DIRSIZECACHE_H
+#define FM2_DIRSIZECACHE_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QTimer>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "filepath.h"
+
+namespace Fm {
+
+class TotalSizeJob;
+
+// The total sizes of the native dirs including all their subdirs, which are shown by the views
+// in place of the sizes of the dirs. The dirs are scanned by low priority jobs in the background,
+// a few at a time, and the sizes are saved in the cache dir of the user with the mtimes of the
+// dirs, so they're not scanned again when they're shown later or by another process.
+// The changes inside a dir don't always change its mtime, so the folders invalidate the sizes of
+// their dirs and all the parents when their monitors report changes.
+class LIBFM_QT_API DirSizeCache : public QObject {
+    Q_OBJECT
+public:
+    explicit DirSizeCache();
+
+    ~DirSizeCache();
+
+    static std::shared_ptr<DirSizeCache> globalInstance();
+
+    // The cached size of the dir, false if it's not known or the dir is changed since it's scanned,
+    // i.e. mtime is not the same as the one of the scan.
+    bool size(const FilePath& dir, std::uint64_t mtime, std::uint64_t* totalSize) const;
+
+    // Scan the dir in the background if its size is not known. sizeChanged() is emitted when it's got.
+    void requestSize(const FilePath& dir, std::uint64_t mtime);
+
+    // Forget the sizes of the dir and all its parents since its content is changed.
+    void invalidate(const FilePath& dir);
+
+    // the same as invalidate() with the global instance only if it exists, so nothing is loaded
+    static void invalidateGlobal(const FilePath& dir);
+
+Q_SIGNALS:
+    void sizeChanged(const Fm::FilePath& dir, quint64 totalSize);
+
+    // the size of the dir is forgotten, and it should be requested again if it's shown
+    void invalidated(const Fm::FilePath& dir);
+
+private:
+    struct Entry {
+        std::uint64_t mtime;
+        std::uint64_t size;
+    };
+
+    struct Request {
+        FilePath dir;
+        std::uint64_t mtime;
+    };
+
+    void startJobs();
+
+    void onJobFinished();
+
+    void load();
+
+    void save();
+
+private:
+    std::unordered_map<FilePath, Entry, FilePathHash> entries_;
+    std::deque<Request> queue_; // the dirs waiting to be scanned
+    std::unordered_set<FilePath, FilePathHash> queuedDirs_;
+    std::unordered_map<TotalSizeJob*, Request> jobs_;
+    std::unordered_set<TotalSizeJob*> staleJobs_; // the dirs are changed while they're scanned
+    QTimer startTimer_;
+    QTimer saveTimer_;
+    bool dirty_;
+
+    static std::mutex mutex_;
+    static std::weak_ptr<DirSizeCache> globalInstance_;
+};
+
+} // namespace Fm
+
+#endif // FM2_DIRSIZECACHE_H
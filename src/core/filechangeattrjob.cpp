@@ -1,7 +1,16 @@
 #include "filechangeattrjob.h"
 #include "totalsizejob.h"
+#include "dirqueue_p.h"
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <string>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
 
 namespace Fm {
 
@@ -12,9 +21,14 @@ static const char query[] =  G_FILE_ATTRIBUTE_STANDARD_TYPE","
                              G_FILE_ATTRIBUTE_UNIX_MODE","
                              G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME;
 
+// the finished amount is updated after changing this number of files in a native dir
+static const std::uint64_t progressBatchSize = 256;
+
 FileChangeAttrJob::FileChangeAttrJob(FilePathList paths):
     paths_{std::move(paths)},
     recursive_{false},
+    threadCount_{1},
+    dirQueue_{nullptr},
     // chmod
     fileModeEnabled_{false},
     newMode_{0},
@@ -42,6 +56,8 @@ void FileChangeAttrJob::exec() {
     // count total amount of the work
     if(recursive_) {
         TotalSizeJob totalSizeJob{paths_};
+        totalSizeJob.pauseWith(*this);
+        totalSizeJob.setThreadCount(threadCount_);
         connect(&totalSizeJob, &TotalSizeJob::error, this, &FileChangeAttrJob::error);
         connect(this, &FileChangeAttrJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
         totalSizeJob.run();
@@ -57,6 +73,10 @@ void FileChangeAttrJob::exec() {
     Q_EMIT preparedToRun();
 
     // do the actual change attrs job
+    DirQueue dirQueue{threadCount_};
+    if(threadCount_ > 1 && recursive_ && canChangeNatively()) {
+        dirQueue_ = &dirQueue;
+    }
     for(auto& path : paths_) {
         if(isCancelled()) {
             break;
@@ -75,6 +95,26 @@ void FileChangeAttrJob::exec() {
             handleError(err, path, info);
         }
     }
+    if(dirQueue_) {
+        // the native dirs found in the paths are processed in parallel
+        std::vector<std::thread> threads;
+        for(int i = 0; i < threadCount_; ++i) {
+            threads.emplace_back([this]() {
+                FilePath dir;
+                while(dirQueue_->pop(dir, cancellable().get())) {
+                    changeNativeDirContent(dir);
+                }
+            });
+        }
+        for(auto& thread: threads) {
+            thread.join();
+        }
+        dirQueue_ = nullptr;
+    }
+}
+
+void FileChangeAttrJob::setThreadCount(int count) {
+    threadCount_ = std::max(count, 1);
 }
 
 bool FileChangeAttrJob::processFile(const FilePath& path, const GFileInfoPtr& info) {
@@ -109,7 +149,15 @@ bool FileChangeAttrJob::processFile(const FilePath& path, const GFileInfoPtr& in
 
     // recursively apply to subfolders
     auto type = g_file_info_get_file_type(info.get());
-    if(!isCancelled() && recursive_ && type == G_FILE_TYPE_DIRECTORY) {
+    if(!isCancelled() && recursive_ && type == G_FILE_TYPE_DIRECTORY && path.isNative() && canChangeNatively()) {
+        if(dirQueue_) {
+            dirQueue_->push(path);
+        }
+        else {
+            changeNativeDirContent(path);
+        }
+    }
+    else if(!isCancelled() && recursive_ && type == G_FILE_TYPE_DIRECTORY) {
         bool retry;
         do {
             retry = false;
@@ -153,6 +201,7 @@ bool FileChangeAttrJob::processFile(const FilePath& path, const GFileInfoPtr& in
 }
 
 bool FileChangeAttrJob::handleError(GErrorPtr &err, const FilePath &path, const GFileInfoPtr &info, ErrorSeverity severity) {
+    std::lock_guard<std::mutex> lock{errorMutex_};
     auto act = emitError(err, severity);
     if (act == ErrorAction::RETRY) {
         err.reset();
@@ -205,24 +254,9 @@ bool FileChangeAttrJob::changeFileMode(const FilePath& path, const GFileInfoPtr&
     bool ret = false;
     /* change mode */
     if(newModeMask) {
-        guint32 mode = g_file_info_get_attribute_uint32(info.get(), G_FILE_ATTRIBUTE_UNIX_MODE);
-        mode &= ~newModeMask;
-        mode |= (newMode & newModeMask);
-
         auto type = g_file_info_get_file_type(info.get());
-        /* FIXME: this behavior should be optional. */
-        /* treat dirs with 'r' as 'rx' */
-        if(type == G_FILE_TYPE_DIRECTORY) {
-            if((newModeMask & S_IRUSR) && (mode & S_IRUSR)) {
-                mode |= S_IXUSR;
-            }
-            if((newModeMask & S_IRGRP) && (mode & S_IRGRP)) {
-                mode |= S_IXGRP;
-            }
-            if((newModeMask & S_IROTH) && (mode & S_IROTH)) {
-                mode |= S_IXOTH;
-            }
-        }
+        guint32 mode = calcFileMode(g_file_info_get_attribute_uint32(info.get(), G_FILE_ATTRIBUTE_UNIX_MODE),
+                                    type == G_FILE_TYPE_DIRECTORY);
 
         /* new mode */
         bool retry;
@@ -244,6 +278,26 @@ bool FileChangeAttrJob::changeFileMode(const FilePath& path, const GFileInfoPtr&
 
 }
 
+mode_t FileChangeAttrJob::calcFileMode(mode_t mode, bool isDir) const {
+    mode &= ~newModeMask_;
+    mode |= (newMode_ & newModeMask_);
+
+    /* FIXME: this behavior should be optional. */
+    /* treat dirs with 'r' as 'rx' */
+    if(isDir) {
+        if((newModeMask_ & S_IRUSR) && (mode & S_IRUSR)) {
+            mode |= S_IXUSR;
+        }
+        if((newModeMask_ & S_IRGRP) && (mode & S_IRGRP)) {
+            mode |= S_IXGRP;
+        }
+        if((newModeMask_ & S_IROTH) && (mode & S_IROTH)) {
+            mode |= S_IXOTH;
+        }
+    }
+    return mode;
+}
+
 bool FileChangeAttrJob::changeFileDisplayName(const FilePath& path, const GFileInfoPtr& info, const char* displayName) {
     bool ret = false;
     bool retry;
@@ -321,4 +375,121 @@ bool FileChangeAttrJob::changeFileTargetUri(const FilePath& path, const GFileInf
     return ret;
 }
 
+bool FileChangeAttrJob::canChangeNatively() const {
+    return !displayNameEnabled_ && !iconEnabled_ && !hiddenEnabled_ && !targetUriEnabled_;
+}
+
+void FileChangeAttrJob::changeNativeDirContent(const FilePath& path) {
+    setCurrentFile(path);
+    auto localPath = path.localPath();
+    DIR* dir = nullptr;
+    for(;;) {
+        int fd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        dir = fd >= 0 ? fdopendir(fd) : nullptr;
+        if(dir) {
+            break;
+        }
+        int errsv = errno;
+        if(fd >= 0) {
+            close(fd);
+        }
+        auto err = nativeError(errsv, tr("Error opening directory '%1': %2"), path);
+        if(!handleError(err, path, GFileInfoPtr{}, ErrorSeverity::MILD) || isCancelled()) {
+            return;
+        }
+    }
+
+    // the subdirs are processed after closing the dir, so a deep tree doesn't use up the fds
+    std::vector<std::string> subdirs;
+    std::uint64_t unreported = 0;
+    int dirFd = dirfd(dir);
+    while(!isCancelled()) {
+        struct dirent* ent = readdir(dir);
+        if(!ent) {
+            break;
+        }
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        struct stat st;
+        if(fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue; // removed while we're listing the dir
+        }
+        changeNativeFile(dirFd, path, name, st);
+        if(S_ISDIR(st.st_mode)) {
+            subdirs.emplace_back(name);
+        }
+        if(++unreported == progressBatchSize) {
+            addFinishedAmount(unreported, unreported);
+            unreported = 0;
+        }
+    }
+    closedir(dir);
+    addFinishedAmount(unreported, unreported);
+
+    for(auto& subdir: subdirs) {
+        if(isCancelled()) {
+            break;
+        }
+        auto subdirPath = path.child(subdir.c_str());
+        if(dirQueue_) {
+            dirQueue_->push(std::move(subdirPath));
+        }
+        else {
+            changeNativeDirContent(subdirPath);
+        }
+    }
+}
+
+bool FileChangeAttrJob::changeNativeFile(int dirFd, const FilePath& dirPath, const char* name, const struct stat& st) {
+    bool ret = true;
+    // change the owner and the group with one call
+    uid_t uid = (ownerEnabled_ && uid_ != st.st_uid) ? uid_ : uid_t(-1);
+    gid_t gid = (groupEnabled_ && gid_ != st.st_gid) ? gid_ : gid_t(-1);
+    bool chowned = false;
+    if(uid != uid_t(-1) || gid != gid_t(-1)) {
+        for(;;) {
+            if(fchownat(dirFd, name, uid, gid, AT_SYMLINK_NOFOLLOW) == 0) {
+                chowned = true;
+                break;
+            }
+            int errsv = errno;
+            auto path = dirPath.child(name);
+            auto err = nativeError(errsv, tr("Error changing the owner of '%1': %2"), path);
+            if(!handleError(err, path, GFileInfoPtr{}, ErrorSeverity::MILD) || isCancelled()) {
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    // the permissions of symlinks cannot be changed
+    if(fileModeEnabled_ && newModeMask_ && !S_ISLNK(st.st_mode)) {
+        mode_t mode = calcFileMode(st.st_mode & 07777, S_ISDIR(st.st_mode));
+        // chown() might have cleared the setuid and setgid bits
+        if(chowned || mode != (st.st_mode & 07777)) {
+            for(;;) {
+                if(fchmodat(dirFd, name, mode, 0) == 0) {
+                    break;
+                }
+                int errsv = errno;
+                auto path = dirPath.child(name);
+                auto err = nativeError(errsv, tr("Error changing the permissions of '%1': %2"), path);
+                if(!handleError(err, path, GFileInfoPtr{}, ErrorSeverity::MILD) || isCancelled()) {
+                    ret = false;
+                    break;
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+GErrorPtr FileChangeAttrJob::nativeError(int errsv, const QString& format, const FilePath& path) const {
+    auto dispName = path.displayName();
+    return GErrorPtr{G_IO_ERROR, g_io_error_from_errno(errsv),
+                     format.arg(QString::fromUtf8(dispName.get()), QString::fromUtf8(g_strerror(errsv)))};
+}
+
 } // namespace Fm
@@ -6,11 +6,15 @@
 #include "gioptrs.h"
 
 #include <string>
+#include <mutex>
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 namespace Fm {
 
+class DirQueue;
+
 class LIBFM_QT_API FileChangeAttrJob : public Fm::FileOperationJob {
     Q_OBJECT
 public:
@@ -49,6 +53,14 @@ public:
         recursive_ = recursive;
     }
 
+    // Walk the native dirs with this number of threads when only the owner, group, or mode
+    // is changed recursively. The default is 1.
+    void setThreadCount(int count);
+
+    int threadCount() const {
+        return threadCount_;
+    }
+
     void setHiddenEnabled(bool enabled) {
         hiddenEnabled_ = enabled;
     }
@@ -107,9 +119,22 @@ private:
     bool changeFileHidden(const FilePath& path, const GFileInfoPtr& info, bool hidden);
     bool changeFileTargetUri(const FilePath& path, const GFileInfoPtr& info, const char* targetUri_);
 
+    mode_t calcFileMode(mode_t mode, bool isDir) const;
+
+    // only the changes which can be applied with fchownat() and fchmodat() are requested
+    bool canChangeNatively() const;
+
+    // change the owner, group, and mode of the content of a native dir without gio
+    void changeNativeDirContent(const FilePath& path);
+    bool changeNativeFile(int dirFd, const FilePath& dirPath, const char* name, const struct stat& st);
+    GErrorPtr nativeError(int errsv, const QString& format, const FilePath& path) const;
+
 private:
     FilePathList paths_;
     bool recursive_;
+    int threadCount_;
+    DirQueue* dirQueue_; // only set while the dirs are processed by multiple threads
+    std::mutex errorMutex_; // serializes the error prompts of the threads
 
     // chmod
     bool fileModeEnabled_;
@@ -1,6 +1,20 @@
 #include "fileinfo.h"
 #include "fileinfo_p.h"
+#include "stats.h"
+#include "desktopentrycache_p.h"
+#include "filesystemcapabilities_p.h"
 #include <gio/gio.h>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 
 namespace Fm {
 
@@ -11,19 +25,366 @@ const char defaultGFileInfoQueryAttribs[] = "standard::*,"
                                             "id::filesystem,"
                                             "metadata::emblems";
 
+// only the basic info needed to show a file in a folder view
+const char fastGFileInfoQueryAttribs[] = "standard::name,"
+                                         "standard::display-name,"
+                                         "standard::type,"
+                                         "standard::size,"
+                                         "standard::is-hidden,"
+                                         "standard::is-backup,"
+                                         "standard::is-symlink,"
+                                         "standard::symlink-target,"
+                                         "standard::fast-content-type,"
+                                         "unix::mode,"
+                                         "time::modified";
+
+namespace {
+
+// Filesystem ids are interned so they can be compared by pointers (see FileInfo::filesystemId()).
+// All files in a folder normally share the same id, so the last result of each thread is remembered
+// to avoid taking the global lock of g_intern_string() for every file.
+const char* internFilesystemId(const char* id) {
+    static thread_local const char* lastId = nullptr;
+    if(!id) {
+        return nullptr;
+    }
+    if(!lastId || strcmp(lastId, id) != 0) {
+        lastId = g_intern_string(id);
+    }
+    return lastId;
+}
+
+const char* nativeFilesystemId(dev_t dev) {
+    static thread_local dev_t lastDev = 0;
+    static thread_local const char* lastId = nullptr;
+    if(!lastId || lastDev != dev) {
+        // this is the same format used by gio for local files
+        char id[32];
+        g_snprintf(id, sizeof(id), "l%" G_GUINT64_FORMAT, (guint64)dev);
+        lastId = g_intern_string(id);
+        lastDev = dev;
+    }
+    return lastId;
+}
+
+// The read-only flag of the filesystem of a dir, which is cached for each filesystem.
+// Only the native filesystems are queried here since it's cheap, and the remote ones are
+// queried by DirListJob before their files are listed.
+bool isReadOnlyFileSystem(const char* filesystemId, const FilePath& parentDirPath, const char* name) {
+    auto capabilities = FileSystemCapabilities::cached(filesystemId);
+    if(!capabilities.isKnown && filesystemId && parentDirPath.isNative()) {
+        capabilities = FileSystemCapabilities::query(filesystemId, parentDirPath.child(name));
+    }
+    return capabilities.readOnly;
+}
+
+// The length of the leading ASCII chars of a string, which are checked a word at a time.
+size_t asciiPrefixLength(const std::string& str) {
+    const char* data = str.data();
+    size_t len = str.size();
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if(word & UINT64_C(0x8080808080808080)) {
+            break;
+        }
+    }
+    while(i < len && static_cast<unsigned char>(data[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+// Whether the name is shown as it is, which is true if it's valid UTF-8 and the file names are in
+// UTF-8. Most names are ASCII, and only the rest of the name after the ASCII chars is validated.
+bool isDisplayableName(const std::string& name, bool* isAscii) {
+    static const bool utf8FileNames = g_get_filename_charsets(nullptr);
+    size_t asciiLen = asciiPrefixLength(name);
+    *isAscii = (asciiLen == name.size());
+    if(*isAscii) {
+        return true;
+    }
+    return utf8FileNames && g_utf8_validate(name.data() + asciiLen, name.size() - asciiLen, nullptr);
+}
+
+bool hasSuffix(const std::string& str, const char* suffix, size_t len) {
+    return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+// g_file_info_get_is_backup() does not cover ".bak" and ".old".
+bool hasBackupSuffix(const QString& dispName, const std::string& name) {
+    if(dispName.isNull()) { // the same as the name
+        return hasSuffix(name, ".bak", 4) || hasSuffix(name, ".old", 4);
+    }
+    return dispName.endsWith(QLatin1String(".bak")) || dispName.endsWith(QLatin1String(".old"));
+}
+
+} // namespace
+
+// stat() a file relative to the directory fd, using statx() if it's available
+bool nativeStat(int dirFd, const char* name, bool followSymlink, struct stat* st) {
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    struct statx stx;
+    // don't force network filesystems to sync the attributes with the server
+    int flags = AT_STATX_DONT_SYNC | (followSymlink ? 0 : AT_SYMLINK_NOFOLLOW);
+    if(statx(dirFd, name, flags, STATX_BASIC_STATS, &stx) == 0) {
+        memset(st, 0, sizeof(struct stat));
+        st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        st->st_ino = stx.stx_ino;
+        st->st_mode = stx.stx_mode;
+        st->st_nlink = stx.stx_nlink;
+        st->st_uid = stx.stx_uid;
+        st->st_gid = stx.stx_gid;
+        st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+        st->st_size = stx.stx_size;
+        st->st_blksize = stx.stx_blksize;
+        st->st_blocks = stx.stx_blocks;
+        st->st_atime = stx.stx_atime.tv_sec;
+        st->st_mtime = stx.stx_mtime.tv_sec;
+        st->st_ctime = stx.stx_ctime.tv_sec;
+        return true;
+    }
+    if(errno != ENOSYS) {
+        return false;
+    }
+#endif
+    return fstatat(dirFd, name, st, followSymlink ? 0 : AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+std::unordered_set<std::string> readHiddenNames(const char* dirPath) {
+    std::unordered_set<std::string> hiddenNames;
+    char* hiddenData = nullptr;
+    auto hiddenFile = CStrPtr{g_build_filename(dirPath, ".hidden", nullptr)};
+    if(g_file_get_contents(hiddenFile.get(), &hiddenData, nullptr, nullptr)) {
+        char** names = g_strsplit(hiddenData, "\n", -1);
+        for(char** name = names; *name; ++name) {
+            if(**name) {
+                hiddenNames.emplace(*name);
+            }
+        }
+        g_strfreev(names);
+        g_free(hiddenData);
+    }
+    return hiddenNames;
+}
+
+bool nativeFileStat(int dirFd, bool dirWritable, const std::unordered_set<std::string>& hiddenNames, NativeFileStat& stat) {
+    const char* name = stat.name;
+    if(!nativeStat(dirFd, name, false, &stat.st)) {
+        return false;
+    }
+    stat.isSymlink = S_ISLNK(stat.st.st_mode);
+    stat.isBroken = false;
+    if(stat.isSymlink) {
+        char target[PATH_MAX];
+        ssize_t len = readlinkat(dirFd, name, target, sizeof(target) - 1);
+        if(len >= 0) {
+            stat.symlinkTarget.assign(target, len);
+        }
+        // use the info of the target like gio does
+        struct stat targetSt;
+        if(nativeStat(dirFd, name, true, &targetSt)) {
+            stat.st = targetSt;
+        }
+        else {
+            stat.isBroken = true;
+        }
+    }
+    stat.isHidden = !hiddenNames.empty() && hiddenNames.count(name) > 0;
+    stat.canRead = (faccessat(dirFd, name, R_OK, 0) == 0);
+    stat.canWrite = (faccessat(dirFd, name, W_OK, 0) == 0);
+    stat.canDelete = dirWritable;
+    return true;
+}
+
+// the names of the emblems joined with '\n', which can't be in an icon name
+static std::string emblemSetKey(char** names) {
+    std::string key;
+    for(char** name = names; *name; ++name) {
+        if(name != names) {
+            key += '\n';
+        }
+        key += *name;
+    }
+    return key;
+}
+
+std::shared_ptr<const EmblemList> internEmblems(char** names) {
+    // the sets nobody uses are removed when the table has grown, there are only a few of them
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const EmblemList>> emblemSets;
+    static size_t nextPurge = 32;
+    if(!names || !*names) {
+        return nullptr;
+    }
+    auto key = emblemSetKey(names);
+    std::lock_guard<std::mutex> lock{mutex};
+    auto& entry = emblemSets[key];
+    auto emblems = entry.lock();
+    if(!emblems) {
+        auto newEmblems = std::make_shared<EmblemList>();
+        auto last = newEmblems->before_begin();
+        for(char** name = names; *name; ++name) {
+            last = newEmblems->emplace_after(last, IconInfo::fromName(*name));
+        }
+        emblems = newEmblems;
+        entry = emblems;
+        if(emblemSets.size() >= nextPurge) {
+            for(auto it = emblemSets.begin(); it != emblemSets.end();) {
+                it = it->second.expired() ? emblemSets.erase(it) : std::next(it);
+            }
+            nextPurge = std::max(size_t(32), emblemSets.size() * 2);
+        }
+    }
+    return emblems;
+}
+
+std::shared_ptr<const IconInfo> FileInfoIconMemo::icon(GIcon* gicon, const MimeType* mimeType) {
+    auto it = icons_.find(mimeType);
+    if(it != icons_.end() && g_icon_equal(it->second.gicon.get(), gicon)) {
+        return it->second.icon;
+    }
+    auto icon = IconInfo::fromGIcon(gicon);
+    // a file with its own icon doesn't replace the icon of its mime type
+    if(it == icons_.end() && icon) {
+        icons_.emplace(mimeType, Icon{icon->gicon(), icon});
+    }
+    return icon;
+}
+
+std::shared_ptr<const EmblemList> FileInfoIconMemo::emblems(char** names) {
+    auto& emblems = emblems_[emblemSetKey(names)];
+    if(!emblems) {
+        emblems = internEmblems(names);
+    }
+    return emblems;
+}
+
 FileInfo::FileInfo() {
     // FIXME: initialize numeric data members
+    isPartial_ = false;
+    isNameAscii_ = true;
+    Stats::add(Stats::LIVE_FILE_INFOS);
+}
+
+void FileInfo::setDisplayName(QString name) {
+    if(!name.isNull()) {
+        isNameAscii_ = false; // not the name
+    }
+    dispNameSet_.set(!name.isNull());
+    dispName_ = std::move(name);
+}
+
+void FileInfo::makeDisplayName() const {
+    // the same FileInfo can be shown in several threads, e.g. by the models and the file search
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock{mutex};
+    if(!dispNameSet_.isSet()) {
+        dispName_ = isNameAscii_ ? QString::fromLatin1(name_.c_str(), name_.size())
+                                 : QString::fromUtf8(name_.c_str(), name_.size());
+        dispNameSet_.set(true);
+    }
 }
 
 FileInfo::FileInfo(const GFileInfoPtr& inf, const FilePath& parentDirPath) {
     setFromGFileInfo(inf, parentDirPath);
+    Stats::add(Stats::LIVE_FILE_INFOS);
 }
 
 FileInfo::~FileInfo() {
+    Stats::add(Stats::LIVE_FILE_INFOS, -1);
+}
+
+const std::string& FileInfo::target() const {
+    static const std::string empty;
+    return extra_ ? extra_->target : empty;
+}
+
+const std::forward_list<std::shared_ptr<const IconInfo>>& FileInfo::emblems() const {
+    static const std::forward_list<std::shared_ptr<const IconInfo>> empty;
+    return extra_ && extra_->emblems ? *extra_->emblems : empty;
+}
+
+// the heap memory of a string, which is not used by the short strings stored in the object itself
+static size_t heapUsage(const std::string& str) {
+    return str.capacity() >= sizeof(std::string) ? str.capacity() + 1 : 0;
+}
+
+size_t FileInfo::memoryUsage() const {
+    size_t bytes = sizeof(FileInfo) + heapUsage(name_);
+    if(!dispName_.isNull()) {
+        bytes += sizeof(QArrayData) + (dispName_.capacity() + 1) * sizeof(QChar);
+    }
+    if(extra_) {
+        // the control block of make_shared(), and the emblem sets are shared
+        bytes += sizeof(ExtraInfo) + 2 * sizeof(void*) + heapUsage(extra_->target);
+    }
+    return bytes;
+}
+
+FilePath FileInfo::path() const {
+    if(GFile* gf = path_.ref()) {
+        return FilePath{gf, false};
+    }
+    return path_.set(dirPath_ ? dirPath_.child(name_.c_str()) : FilePath::fromPathStr(name_.c_str()));
+}
+
+FileInfo::PathCache& FileInfo::PathCache::operator=(const PathCache& other) {
+    if(this != &other) {
+        GFile* gf = other.ref();
+        reset();
+        gfile_.store(gf, std::memory_order_release);
+    }
+    return *this;
+}
+
+GFile* FileInfo::PathCache::ref() const {
+    GFile* gf = gfile_.load(std::memory_order_acquire);
+    // the cached GFile is only released by reset() and the destructor, which are never
+    // called while other threads are using this object, so adding a reference here is safe.
+    return gf ? G_FILE(g_object_ref(gf)) : nullptr;
+}
+
+FilePath FileInfo::PathCache::set(const FilePath& path) const {
+    if(!path) {
+        return path;
+    }
+    GFile* expected = nullptr;
+    GFile* gf = G_FILE(g_object_ref(path.gfile().get()));
+    if(!gfile_.compare_exchange_strong(expected, gf, std::memory_order_acq_rel)) {
+        // another thread cached the path first
+        g_object_unref(gf);
+        return FilePath{expected, true};
+    }
+    return path;
+}
+
+void FileInfo::PathCache::reset() {
+    if(GFile* gf = gfile_.exchange(nullptr, std::memory_order_acq_rel)) {
+        g_object_unref(gf);
+    }
+}
+
+FileInfo::ExtraInfo& FileInfo::extraInfo() {
+    // the extra info might be shared with copies of this object, so don't modify it in place
+    if(!extra_) {
+        extra_ = std::make_shared<ExtraInfo>();
+    }
+    else if(extra_.use_count() > 1) {
+        extra_ = std::make_shared<ExtraInfo>(*extra_);
+    }
+    return const_cast<ExtraInfo&>(*extra_);
 }
 
 void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath& parentDirPath) {
+    setFromGFileInfo(inf, parentDirPath, nullptr);
+}
+
+void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath& parentDirPath, FileInfoIconMemo* iconMemo) {
     dirPath_ = parentDirPath;
+    extra_.reset();
+    path_.reset();
     const char* tmp, *uri;
     GIcon* gicon;
     GFileType type;
@@ -31,11 +392,27 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
     if (const char * name = g_file_info_get_name(inf.get()))
         name_ = name;
 
-    dispName_ = g_file_info_get_display_name(inf.get());
+    // the display name isn't stored if it's the same as the name, which is true for the most files
+    const char* dispName = g_file_info_get_display_name(inf.get());
+    if(dispName && strcmp(dispName, name_.c_str()) != 0) {
+        setDisplayName(QString::fromUtf8(dispName));
+    }
+    else {
+        isNameAscii_ = (asciiPrefixLength(name_) == name_.size());
+        setDisplayName(QString());
+    }
 
     size_ = g_file_info_get_size(inf.get());
+    blksize_ = g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_BLOCK_SIZE);
+    blocks_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_UNIX_BLOCKS);
+
+    isPartial_ = false;
 
     tmp = g_file_info_get_content_type(inf.get());
+    if(!tmp) {
+        // only the type guessed from the file name is available in DirListJob::FAST mode
+        tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
     if(!tmp) {
         tmp = "application/octet-stream";
     }
@@ -120,6 +497,10 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
     }
 
     isShortcut_ = false;
+    isReadOnly_ = false; /* default is R/W */
+
+    tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+    filesystemId_ = internFilesystemId(tmp);
 
     /* special handling for symlinks */
     if(g_file_info_get_is_symlink(inf.get())) {
@@ -137,13 +518,13 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
         if(uri) {
             if(g_str_has_prefix(uri, "file:///")) {
                 auto filename = CStrPtr{g_filename_from_uri(uri, nullptr, nullptr)};
-                target_ = filename.get();
+                extraInfo().target = filename.get();
             }
             else {
-                target_ = uri;
+                extraInfo().target = uri;
             }
             if(!mimeType_) {
-                mimeType_ = MimeType::guessFromFileName(target_.c_str());
+                mimeType_ = MimeType::guessFromFileName(target().c_str());
             }
         }
 
@@ -162,10 +543,13 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
         if(!mimeType_) {
             mimeType_ = MimeType::inodeDirectory();
         }
-        isReadOnly_ = false; /* default is R/W */
         if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_READONLY)) {
             isReadOnly_ = g_file_info_get_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
         }
+        else {
+            /* the filesystem is queried once and shared by all its dirs, default is R/W */
+            isReadOnly_ = isReadOnlyFileSystem(filesystemId_, parentDirPath, name_.c_str());
+        }
         /* directories should be writable to be deleted by user */
         if(isReadOnly_ || !isWritable_) {
             isDeletable_ = false;
@@ -177,13 +561,13 @@ _file_is_symlink:
         if(uri) {
             if(g_str_has_prefix(uri, "file:///")) {
                 auto filename = CStrPtr{g_filename_from_uri(uri, nullptr, nullptr)};
-                target_ = filename.get();
+                extraInfo().target = filename.get();
             }
             else {
-                target_ = uri;
+                extraInfo().target = uri;
             }
             if(!mimeType_) {
-                mimeType_ = MimeType::guessFromFileName(target_.c_str());
+                mimeType_ = MimeType::guessFromFileName(target().c_str());
             }
         }
     /* Falls through. */
@@ -197,29 +581,18 @@ _file_is_symlink:
     }
 
     /* if there is a custom folder icon, use it */
-    if(isNative() && type == G_FILE_TYPE_DIRECTORY) {
-        auto local_path = path().localPath();
-        auto dot_dir = CStrPtr{g_build_filename(local_path.get(), ".directory", nullptr)};
-        if(g_file_test(dot_dir.get(), G_FILE_TEST_IS_REGULAR)) {
-            GKeyFile* kf = g_key_file_new();
-            if(g_key_file_load_from_file(kf, dot_dir.get(), G_KEY_FILE_NONE, nullptr)) {
-                CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
-                if(icon_name) {
-                    auto dot_icon = IconInfo::fromName(icon_name.get());
-                    if(dot_icon && dot_icon->isValid()) {
-                        icon_ = dot_icon;
-                    }
-                }
-            }
-            g_key_file_free(kf);
-        }
-     }
+    // Probing the .directory file costs a stat() for every dir, so it's left to the detailed info,
+    // which has the icon of the file, and not done for the FAST listings (see Folder::loadDetails()).
+    if(isNative() && type == G_FILE_TYPE_DIRECTORY
+            && g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ICON)) {
+        loadCustomFolderIcon();
+    }
 
     if(!icon_) {
         /* try file-specific icon first */
         gicon = g_file_info_get_icon(inf.get());
         if(gicon) {
-            icon_ = IconInfo::fromGIcon(gicon);
+            icon_ = iconMemo ? iconMemo->icon(gicon, mimeType_.get()) : IconInfo::fromGIcon(gicon);
         }
     }
 
@@ -235,25 +608,16 @@ _file_is_symlink:
 
     /* if the file has emblems, add them to the icon */
     auto emblem_names = g_file_info_get_attribute_stringv(inf.get(), "metadata::emblems");
-    if(emblem_names) {
-        auto n_emblems = g_strv_length(emblem_names);
-        for(int i = n_emblems - 1; i >= 0; --i) {
-            emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
-        }
+    if(emblem_names && *emblem_names) {
+        extraInfo().emblems = iconMemo ? iconMemo->emblems(emblem_names) : internEmblems(emblem_names);
     }
 
-    tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
-    filesystemId_ = g_intern_string(tmp);
-
     mtime_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED);
     atime_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_ACCESS);
     ctime_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_CHANGED);
     isHidden_ = g_file_info_get_is_hidden(inf.get());
-    // g_file_info_get_is_backup() does not cover ".bak" and ".old".
     // NOTE: Here, dispName_ is not modified for desktop entries yet.
-    isBackup_ = g_file_info_get_is_backup(inf.get())
-                || dispName_.endsWith(QLatin1String(".bak"))
-                || dispName_.endsWith(QLatin1String(".old"));
+    isBackup_ = g_file_info_get_is_backup(inf.get()) || hasBackupSuffix(dispName_, name_);
     isNameChangeable_ = true; /* GVFS tends to ignore this attribute */
     isIconChangeable_ = isHiddenChangeable_ = false;
     if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME)) {
@@ -262,36 +626,7 @@ _file_is_symlink:
 
     // special handling for desktop entry files (show the name and icon defined in the desktop entry instead)
     if(isNative() && G_UNLIKELY(isDesktopEntry())) {
-        auto local_path = path().localPath();
-        GKeyFile* kf = g_key_file_new();
-        if(g_key_file_load_from_file(kf, local_path.get(), G_KEY_FILE_NONE, nullptr)) {
-            /* check if type is correct and supported */
-            CStrPtr type{g_key_file_get_string(kf, "Desktop Entry", "Type", nullptr)};
-            if(type) {
-                // Type == "Link"
-                if(strcmp(type.get(), G_KEY_FILE_DESKTOP_TYPE_LINK) == 0) {
-                    CStrPtr uri{g_key_file_get_string(kf, G_KEY_FILE_DESKTOP_GROUP, G_KEY_FILE_DESKTOP_KEY_URL, nullptr)};
-                    if(uri) {
-                        isShortcut_ = true;
-                        target_ = uri.get();
-                    }
-                }
-            }
-            CStrPtr icon_name{g_key_file_get_string(kf, "Desktop Entry", "Icon", nullptr)};
-            if(icon_name) {
-                icon_ = IconInfo::fromName(icon_name.get());
-            }
-            /* Use title of the desktop entry for display */
-            CStrPtr displayName{g_key_file_get_locale_string(kf, "Desktop Entry", "Name", nullptr, nullptr)};
-            if(displayName) {
-                dispName_ = displayName.get();
-            }
-            /* handle 'Hidden' key to set hidden attribute */
-            if(!isHidden_) {
-                isHidden_ = g_key_file_get_boolean(kf, "Desktop Entry", "Hidden", nullptr);
-            }
-        }
-        g_key_file_free(kf);
+        loadDesktopEntry();
     }
 
     if(!icon_ && mimeType_)
@@ -316,7 +651,136 @@ _file_is_symlink:
 #endif
 }
 
-void FileInfo::bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet) {
+void FileInfo::setFromNativeStat(const NativeFileStat& stat, const FilePath& parentDirPath) {
+    dirPath_ = parentDirPath;
+    extra_.reset();
+    path_.reset();
+    name_ = stat.name;
+    bool isAscii;
+    if(isDisplayableName(name_, &isAscii)) {
+        isNameAscii_ = isAscii;
+        setDisplayName(QString());
+    }
+    else {
+        CStrPtr dispName{g_filename_display_name(stat.name)};
+        setDisplayName(QString::fromUtf8(dispName.get()));
+    }
+
+    const struct stat& st = stat.st;
+    mode_ = st.st_mode;
+    uid_ = st.st_uid;
+    gid_ = st.st_gid;
+    size_ = st.st_size;
+    blksize_ = st.st_blksize;
+    blocks_ = st.st_blocks;
+    mtime_ = st.st_mtime;
+    atime_ = st.st_atime;
+    ctime_ = st.st_ctime;
+    filesystemId_ = nativeFilesystemId(st.st_dev);
+
+    isAccessible_ = stat.canRead;
+    isWritable_ = stat.canWrite;
+    isDeletable_ = stat.canDelete;
+    isReadOnly_ = S_ISDIR(st.st_mode) ? isReadOnlyFileSystem(filesystemId_, parentDirPath, name_.c_str()) : false;
+    if(isReadOnly_) {
+        isDeletable_ = false;
+    }
+    isPartial_ = false;
+    isShortcut_ = false;
+    isHidden_ = stat.isHidden || name_[0] == '.';
+    isBackup_ = (!name_.empty() && name_.back() == '~') || hasBackupSuffix(dispName_, name_);
+    isNameChangeable_ = true;
+    isIconChangeable_ = isHiddenChangeable_ = false;
+
+    if(stat.isSymlink) {
+        extraInfo().target = stat.symlinkTarget;
+    }
+
+    // NOTE: the file type is taken from the target of a symlink, like what gio does.
+    if(stat.isBroken) {
+        mimeType_ = MimeType::fromName("inode/symlink");
+    }
+    else if(S_ISDIR(st.st_mode)) {
+        mimeType_ = MimeType::inodeDirectory();
+        /* directories should be writable to be deleted by user */
+        if(!isWritable_) {
+            isDeletable_ = false;
+        }
+    }
+    else if(S_ISCHR(st.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/chardevice");
+    }
+    else if(S_ISBLK(st.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/blockdevice");
+    }
+    else if(S_ISFIFO(st.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/fifo");
+    }
+#ifdef S_ISSOCK
+    else if(S_ISSOCK(st.st_mode)) {
+        mimeType_ = MimeType::fromName("inode/socket");
+    }
+#endif
+    else {
+        // only the file name is used here and the content is not sniffed
+        mimeType_ = MimeType::guessFromFileName(name_.c_str());
+    }
+
+    if(stat.isSymlink) {
+        mode_ &= ~S_IFMT; /* reset type */
+        mode_ |= S_IFLNK; /* set type to symlink */
+    }
+
+    // The custom folder icons are not loaded here. The infos got by stat() are partial, and the
+    // .directory files are only probed for the dirs which are shown, when their details are loaded.
+
+    if(G_UNLIKELY(isDesktopEntry())) {
+        loadDesktopEntry();
+    }
+
+    if(!icon_ && mimeType_) {
+        icon_ = mimeType_->icon();
+    }
+}
+
+void FileInfo::loadCustomFolderIcon() {
+    auto local_path = path().localPath();
+    auto dot_dir = CStrPtr{g_build_filename(local_path.get(), ".directory", nullptr)};
+    auto fields = DesktopEntryCache::lookup(dot_dir.get());
+    if(fields && !fields->icon.empty()) {
+        auto dot_icon = IconInfo::fromName(fields->icon.c_str());
+        if(dot_icon && dot_icon->isValid()) {
+            icon_ = dot_icon;
+        }
+    }
+}
+
+void FileInfo::loadDesktopEntry() {
+    auto local_path = path().localPath();
+    // the file is only parsed again if it's changed since it was parsed last time.
+    // It's checked with stat(), since mtime_ doesn't have the nanoseconds.
+    auto fields = DesktopEntryCache::lookup(local_path.get());
+    if(fields) {
+        /* check if type is correct and supported */
+        if(fields->type == G_KEY_FILE_DESKTOP_TYPE_LINK && !fields->url.empty()) {
+            isShortcut_ = true;
+            extraInfo().target = fields->url;
+        }
+        if(!fields->icon.empty()) {
+            icon_ = IconInfo::fromName(fields->icon.c_str());
+        }
+        /* Use title of the desktop entry for display */
+        if(!fields->name.isEmpty()) {
+            setDisplayName(fields->name);
+        }
+        /* handle 'Hidden' key to set hidden attribute */
+        if(!isHidden_) {
+            isHidden_ = fields->hidden;
+        }
+    }
+}
+
+void FileInfo::bindCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet) {
     cutFilesHashSet_ = cutFilesHashSet;
 }
 
@@ -337,15 +801,15 @@ bool FileInfo::isExecutableType() const {
         /* treat desktop entries as executables if
          they are native and have read permission */
         if(isNative() && (mode_ & (S_IRUSR|S_IRGRP|S_IROTH))) {
-            if(isShortcut() && !target_.empty()) {
+            if(isShortcut() && !target().empty()) {
                 /* handle shortcuts from desktop to menu entries:
                    first check for entries in /usr/share/applications and such
                    which may be considered as a safe desktop entry path
                    then check if that is a shortcut to a native file
                    otherwise it is a link to a file under menu:// */
-                if (!g_str_has_prefix(target_.c_str(), "/usr/share/")) {
-                    auto target = FilePath::fromPathStr(target_.c_str());
-                    bool is_native = target.isNative();
+                if (!g_str_has_prefix(target().c_str(), "/usr/share/")) {
+                    auto targetPath = FilePath::fromPathStr(target().c_str());
+                    bool is_native = targetPath.isNative();
                     if (is_native) {
                         return true;
                     }
@@ -378,6 +842,7 @@ bool FileInfo::isExecutableType() const {
 }
 
 
+// NOTE: MimeType objects are unique per type name, so comparing the pointers is enough.
 bool FileInfoList::isSameType() const {
     if(!empty()) {
         auto& item = front();
@@ -391,6 +856,7 @@ bool FileInfoList::isSameType() const {
     return true;
 }
 
+// NOTE: filesystem ids are interned strings, so comparing the pointers is enough.
 bool FileInfoList::isSameFilesystem() const {
     if(!empty()) {
         auto& item = front();
@@ -31,9 +31,12 @@
 
 #include <vector>
 #include <set>
+#include <unordered_set>
+#include <unordered_map>
 #include <utility>
 #include <string>
 #include <forward_list>
+#include <atomic>
 
 #include "gioptrs.h"
 #include "filepath.h"
@@ -44,10 +47,56 @@
 namespace Fm {
 
 class FileInfoList;
-typedef std::set<unsigned int> HashSet;
+struct NativeFileStat;
+class FileInfoIconMemo;
+
+// The cut files, by their names and parent folders.
+// A file is looked up by its name and parent folder, so no path needs to be built for it and
+// different files can't be mistaken for each other, unlike with the hashes of their paths.
+// The files cut in a search folder have different parents, which are their real folders.
+class LIBFM_QT_API CutFileSet {
+public:
+    void insert(const FilePath& dirPath, const std::string& name) {
+        if(!contains(dirPath, name)) {
+            names_.emplace(name, dirPath);
+            dirPaths_.insert(dirPath);
+        }
+    }
+
+    bool contains(const FilePath& dirPath, const std::string& name) const {
+        // the names are compared first, since comparing the folders is slower
+        auto range = names_.equal_range(name);
+        for(auto it = range.first; it != range.second; ++it) {
+            if(it->second == dirPath) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // whether any of the files is in the folder
+    bool containsDir(const FilePath& dirPath) const {
+        return dirPaths_.count(dirPath) != 0;
+    }
+
+    bool empty() const {
+        return names_.empty();
+    }
+
+    size_t size() const {
+        return names_.size();
+    }
+
+private:
+    std::unordered_multimap<std::string, FilePath> names_;
+    std::unordered_set<FilePath, FilePathHash> dirPaths_;
+};
 
 class LIBFM_QT_API FileInfo {
 public:
+    friend class DirListJob;
+    friend class FolderSnapshot;
+    friend class FileInfoJob;
 
     explicit FileInfo();
 
@@ -77,6 +126,7 @@ public:
         return uid_;
     }
 
+    // the returned string is interned, so ids of files can be compared by their pointers
     const char* filesystemId() const {
         return filesystemId_;
     }
@@ -102,9 +152,7 @@ public:
         return mtime_;
     }
 
-    const std::string& target() const {
-        return target_;
-    }
+    const std::string& target() const;
 
     bool isWritableDirectory() const {
         return (!isReadOnly_ && isDir());
@@ -173,12 +221,18 @@ public:
         return !cutFilesHashSet_.expired();
     }
 
+    // only the basic info is loaded (see DirListJob::FAST) and the details,
+    // like the sniffed mime type and emblems, should be queried later
+    bool isPartial() const {
+        return isPartial_;
+    }
+
     mode_t mode() const {
         return mode_;
     }
 
     uint64_t realSize() const {
-        return blksize_ *blocks_;
+        return uint64_t(blksize_) * blocks_;
     }
 
     uint64_t size() const {
@@ -189,17 +243,26 @@ public:
         return name_;
     }
 
+    // The display name is only stored by the listing if it differs from the name, e.g. for the desktop
+    // entries or the names which aren't valid UTF-8. Otherwise it's converted from the name when it's used first.
     const QString& displayName() const {
+        if(!dispNameSet_.isSet()) {
+            makeDisplayName();
+        }
         return dispName_;
     }
 
+    // true if the display name is the name and it's ASCII, so the names can be compared as bytes
+    bool isNameAscii() const {
+        return isNameAscii_;
+    }
+
     QString description() const {
         return QString::fromUtf8(mimeType_ ? mimeType_->desc() : "");
     }
 
-    FilePath path() const {
-        return dirPath_ ? dirPath_.child(name_.c_str()) : FilePath::fromPathStr(name_.c_str());
-    }
+    // the path is created on the first call and cached, so calling it repeatedly is cheap
+    FilePath path() const;
 
     const FilePath& dirPath() const {
         return dirPath_;
@@ -207,35 +270,122 @@ public:
 
     void setFromGFileInfo(const GFileInfoPtr& inf, const FilePath& parentDirPath);
 
-    void bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet);
+    void bindCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet);
 
-    const std::forward_list<std::shared_ptr<const IconInfo>>& emblems() const {
-        return emblems_;
-    }
+    const std::forward_list<std::shared_ptr<const IconInfo>>& emblems() const;
+
+    // the approximate number of bytes used by this object and the data it owns.
+    // The mime type, the icons and the dir path are shared with other files and not counted.
+    size_t memoryUsage() const;
+
+private:
+    // set the info of a local file from the result of stat() without the help of gio
+    void setFromNativeStat(const NativeFileStat& stat, const FilePath& parentDirPath);
+
+    // the icons and emblems are resolved with the memo of the listing if it's not nullptr
+    void setFromGFileInfo(const GFileInfoPtr& inf, const FilePath& parentDirPath, FileInfoIconMemo* iconMemo);
+
+    void loadCustomFolderIcon();
+
+    void loadDesktopEntry();
+
+    // set dispName_, or make it from the name later if name is null
+    void setDisplayName(QString name);
+
+    void makeDisplayName() const;
+
+    // the data which only a few files have is kept out of line to save memory
+    struct ExtraInfo {
+        std::string target; /* target of shortcut or mountable. */
+        // interned and shared by all files with the same emblems
+        std::shared_ptr<const std::forward_list<std::shared_ptr<const IconInfo>>> emblems;
+    };
+
+    ExtraInfo& extraInfo();
+
+    // Lazily created full path of the file.
+    // path() is const and can be called from different threads, so the GFile is set atomically.
+    class PathCache {
+    public:
+        PathCache(): gfile_{nullptr} {
+        }
+
+        PathCache(const PathCache& other): gfile_{other.ref()} {
+        }
+
+        ~PathCache() {
+            reset();
+        }
+
+        PathCache& operator=(const PathCache& other);
+
+        // returns a new reference to the cached GFile, or nullptr
+        GFile* ref() const;
+
+        // cache the path if no other thread did it first and return the cached one
+        FilePath set(const FilePath& path) const;
+
+        void reset();
+
+    private:
+        mutable std::atomic<GFile*> gfile_;
+    };
+
+    // Whether dispName_ is set, which is copied with the FileInfo.
+    // displayName() is const and can be called from different threads, so it's set atomically.
+    class DisplayNameFlag {
+    public:
+        DisplayNameFlag(): set_{false} {
+        }
+
+        DisplayNameFlag(const DisplayNameFlag& other): set_{other.isSet()} {
+        }
+
+        DisplayNameFlag& operator=(const DisplayNameFlag& other) {
+            set_.store(other.isSet(), std::memory_order_release);
+            return *this;
+        }
+
+        bool isSet() const {
+            return set_.load(std::memory_order_acquire);
+        }
+
+        void set(bool value) {
+            set_.store(value, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<bool> set_;
+    };
 
 private:
+    // NOTE: the members are ordered by their sizes to avoid paddings.
     std::string name_;
-    QString dispName_;
+    mutable QString dispName_;
 
-    FilePath dirPath_;
+    FilePath dirPath_; // shared by all files listed from the same folder
 
-    mode_t mode_;
     const char* filesystemId_;
-    uid_t uid_;
-    gid_t gid_;
     uint64_t size_;
     quint64 mtime_;
     quint64 atime_;
     quint64 ctime_;
-
-    uint64_t blksize_;
     uint64_t blocks_;
 
+    mode_t mode_;
+    uid_t uid_;
+    gid_t gid_;
+    uint32_t blksize_;
+
     std::shared_ptr<const MimeType> mimeType_;
     std::shared_ptr<const IconInfo> icon_;
-    std::forward_list<std::shared_ptr<const IconInfo>> emblems_;
 
-    std::string target_; /* target of shortcut or mountable. */
+    // nullptr if the file has neither a target nor emblems.
+    // FileInfo objects are immutable once created, so copies can share it.
+    std::shared_ptr<const ExtraInfo> extra_;
+
+    PathCache path_;
+    mutable DisplayNameFlag dispNameSet_;
 
     bool isShortcut_ : 1; /* TRUE if file is shortcut type */
     bool isAccessible_ : 1; /* TRUE if can be read by user */
@@ -247,8 +397,10 @@ private:
     bool isIconChangeable_ : 1; /* TRUE if icon can be changed */
     bool isHiddenChangeable_ : 1; /* TRUE if hidden can be changed */
     bool isReadOnly_ : 1; /* TRUE if host FS is R/O */
+    bool isPartial_ : 1; /* TRUE if only basic info is loaded */
+    bool isNameAscii_ : 1; /* TRUE if the display name is name_ and it's ASCII, so it's made from it as Latin-1 */
 
-    std::weak_ptr<const HashSet> cutFilesHashSet_;
+    std::weak_ptr<const CutFileSet> cutFilesHashSet_;
     // std::vector<std::tuple<int, void*, void(void*)>> extraData_;
 };
 
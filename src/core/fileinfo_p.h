@@ -1,10 +1,180 @@
 #ifndef FILEINFO_P_H
 #define FILEINFO_P_H
 
+#include <sys/stat.h>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
+#include <forward_list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include "iconinfo.h"
+#include "mimetype.h"
+
 namespace Fm {
 
     extern const char defaultGFileInfoQueryAttribs[];
 
+    extern const char fastGFileInfoQueryAttribs[];
+
+    // result of stat() and access() calls for a local file
+    struct NativeFileStat {
+        const char* name;
+        struct stat st; // info of the target if this is a symlink
+        std::string symlinkTarget;
+        bool isSymlink;
+        bool isBroken; // the target of the symlink does not exist
+        bool isHidden; // listed in the .hidden file
+        bool canRead;
+        bool canWrite;
+        bool canDelete;
+    };
+
+    // stat() a file relative to the directory fd, using statx() if it's available
+    bool nativeStat(int dirFd, const char* name, bool followSymlink, struct stat* st);
+
+    // the names listed in the .hidden file of a local dir
+    std::unordered_set<std::string> readHiddenNames(const char* dirPath);
+
+    // stat() and access() a file in the dir of dirFd for FileInfo::setFromNativeStat().
+    // The name of the stat should be set, and false is returned if the file does not exist.
+    bool nativeFileStat(int dirFd, bool dirWritable, const std::unordered_set<std::string>& hiddenNames, NativeFileStat& stat);
+
+    typedef std::forward_list<std::shared_ptr<const IconInfo>> EmblemList;
+
+    // The emblem set of the names in metadata::emblems. The sets are interned, so all files with the
+    // same emblems share one immutable list, and nullptr is returned if there are no names.
+    std::shared_ptr<const EmblemList> internEmblems(char** names);
+
+    // The icons and the emblem sets resolved for the files of one listing, so those shared by many
+    // files are looked up once instead of taking the locks of the global caches for each file.
+    // The icons are remembered by the mime types, which decide the icons of most files.
+    // NOTE: a memo is used by one thread at a time.
+    class FileInfoIconMemo {
+    public:
+        std::shared_ptr<const IconInfo> icon(GIcon* gicon, const MimeType* mimeType);
+
+        std::shared_ptr<const EmblemList> emblems(char** names);
+
+    private:
+        struct Icon {
+            GIconPtr gicon;
+            std::shared_ptr<const IconInfo> icon;
+        };
+        std::unordered_map<const MimeType*, Icon> icons_;
+        std::unordered_map<std::string, std::shared_ptr<const EmblemList>> emblems_;
+    };
+
+    // Memory pool for the FileInfo objects created by one DirListJob.
+    // The objects are carved out of large chunks instead of being allocated one by one,
+    // and all chunks are released at once when the last object allocated from the pool is freed.
+    // NOTE: only the allocations of the first requested size are pooled.
+    class FileInfoPool {
+    public:
+        explicit FileInfoPool(size_t objectsPerChunk = 256):
+            objectsPerChunk_{objectsPerChunk},
+            slotSize_{0},
+            next_{nullptr},
+            end_{nullptr},
+            freeList_{nullptr} {
+        }
+
+        ~FileInfoPool() {
+            for(auto chunk: chunks_) {
+                ::operator delete(chunk);
+            }
+        }
+
+        void* allocate(size_t size) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if(slotSize_ == 0) {
+                // round up the size so that every slot is properly aligned
+                slotSize_ = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+            }
+            if(size > slotSize_) {
+                return ::operator new(size);
+            }
+            if(freeList_) {
+                auto slot = freeList_;
+                freeList_ = slot->next;
+                return slot;
+            }
+            if(next_ == end_) {
+                chunks_.reserve(chunks_.size() + 1);
+                next_ = static_cast<char*>(::operator new(slotSize_ * objectsPerChunk_));
+                end_ = next_ + slotSize_ * objectsPerChunk_;
+                chunks_.push_back(next_);
+            }
+            auto slot = next_;
+            next_ += slotSize_;
+            return slot;
+        }
+
+        void deallocate(void* p, size_t size) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if(size > slotSize_) {
+                ::operator delete(p);
+                return;
+            }
+            auto slot = static_cast<FreeSlot*>(p);
+            slot->next = freeList_;
+            freeList_ = slot;
+        }
+
+    private:
+        struct FreeSlot {
+            FreeSlot* next;
+        };
+
+        std::mutex mutex_;
+        size_t objectsPerChunk_;
+        size_t slotSize_;
+        std::vector<char*> chunks_;
+        char* next_;
+        char* end_;
+        FreeSlot* freeList_;
+    };
+
+    // allocator for std::allocate_shared() using a FileInfoPool.
+    // Every object keeps a copy of the allocator in its control block, so the pool lives as long as the objects.
+    template <typename T>
+    class FileInfoPoolAllocator {
+    public:
+        typedef T value_type;
+
+        explicit FileInfoPoolAllocator(std::shared_ptr<FileInfoPool> pool): pool_{std::move(pool)} {
+        }
+
+        template <typename U>
+        FileInfoPoolAllocator(const FileInfoPoolAllocator<U>& other): pool_{other.pool_} {
+        }
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n) {
+            pool_->deallocate(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const FileInfoPoolAllocator<U>& other) const {
+            return pool_ == other.pool_;
+        }
+
+        template <typename U>
+        bool operator!=(const FileInfoPoolAllocator<U>& other) const {
+            return pool_ != other.pool_;
+        }
+
+    private:
+        template <typename U> friend class FileInfoPoolAllocator;
+
+        std::shared_ptr<FileInfoPool> pool_;
+    };
+
 } // namespace Fm
 
 #endif // FILEINFO_P_H
@@ -1,19 +1,46 @@
 #include "fileinfojob.h"
 #include "fileinfo_p.h"
+#include "jobtrace_p.h"
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace Fm {
 
-FileInfoJob::FileInfoJob(FilePathList paths, FilePathList deletionPaths, FilePath commonDirPath, const std::shared_ptr<const HashSet>& cutFilesHashSet):
+// the native stat() calls are split among at most this number of threads,
+// and each of them gets this number of files at least
+static const size_t maxStatThreads = 4;
+static const size_t minFilesPerStatThread = 32;
+
+FileInfoJob::FileInfoJob(FilePathList paths, FilePathList deletionPaths, FilePath commonDirPath, const std::shared_ptr<const CutFileSet>& cutFilesHashSet):
     Job(),
     paths_{std::move(paths)},
     deletionPaths_{std::move(deletionPaths)},
     commonDirPath_{std::move(commonDirPath)},
-    cutFilesHashSet_{cutFilesHashSet} {
+    cutFilesHashSet_{cutFilesHashSet},
+    listCommonDir_{false},
+    nativeStat_{false} {
 }
 
 void FileInfoJob::exec() {
-    for(const auto& path: paths_) {
-        if(!isCancelled()) {
+    std::vector<bool> found;
+    if(nativeStat_ && commonDirPath_.isValid() && commonDirPath_.isNative()) {
+        TraceSpan statSpan{"FileInfoJob::nativeStat"};
+        found = statNativeFiles();
+        statSpan.addCount(std::count(found.cbegin(), found.cend(), true));
+    }
+    else if(listCommonDir_ && commonDirPath_.isValid()) {
+        TraceSpan listSpan{"FileInfoJob::listCommonDir"};
+        found = listCommonDir();
+        listSpan.addCount(std::count(found.cbegin(), found.cend(), true));
+    }
+    TraceSpan querySpan{"FileInfoJob::queryInfo"};
+    for(size_t i = 0; i < paths_.size(); ++i) {
+        const auto& path = paths_[i];
+        if(!isCancelled() && (found.empty() || !found[i])) {
             GErrorPtr err;
             GFileInfoPtr inf{
                 g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs,
@@ -23,22 +50,120 @@ void FileInfoJob::exec() {
             if(!inf) {
                 continue;
             }
+            querySpan.addCount();
+            addInfo(path, inf);
+        }
+    }
+}
 
-            // Reuse the same dirPath object when the path remains the same (optimize for files in the same dir)
-            auto dirPath = commonDirPath_.isValid() ? commonDirPath_ : path.parent();
-            FileInfo fileInfo(inf, dirPath);
+std::vector<bool> FileInfoJob::listCommonDir() {
+    std::vector<bool> found(paths_.size(), false);
+    std::unordered_map<std::string, size_t> children;
+    for(size_t i = 0; i < paths_.size(); ++i) {
+        if(commonDirPath_.isParentOf(paths_[i])) {
+            children.emplace(paths_[i].baseName().get(), i);
+        }
+    }
+    GFileEnumeratorPtr enu{
+        g_file_enumerate_children(commonDirPath_.gfile().get(), defaultGFileInfoQueryAttribs,
+                                  G_FILE_QUERY_INFO_NONE, cancellable().get(), nullptr),
+        false
+    };
+    if(!enu) {
+        return found; // query the files one by one
+    }
+    while(!isCancelled() && !children.empty()) {
+        GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), nullptr), false};
+        if(!inf) {
+            break;
+        }
+        auto it = children.find(g_file_info_get_name(inf.get()));
+        if(it != children.end()) {
+            addInfo(paths_[it->second], inf);
+            found[it->second] = true;
+            children.erase(it);
+        }
+    }
+    g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    return found;
+}
 
-            if(cutFilesHashSet_
-                    && cutFilesHashSet_->count(fileInfo.path().hash())) {
-                fileInfo.bindCutFiles(cutFilesHashSet_);
-            }
+std::vector<bool> FileInfoJob::statNativeFiles() {
+    std::vector<bool> done(paths_.size(), false);
+    auto dirPath = commonDirPath_.localPath();
+    int dirFd = open(dirPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        return done; // let gio handle and report the error
+    }
+    auto hiddenNames = readHiddenNames(dirPath.get());
+    // files can be deleted only if the folder is writable
+    bool dirWritable = (access(dirPath.get(), W_OK) == 0);
 
-            auto fileInfoPtr = std::make_shared<const FileInfo>(fileInfo);
+    std::vector<size_t> indices;
+    std::vector<std::string> names;
+    for(size_t i = 0; i < paths_.size(); ++i) {
+        if(commonDirPath_.isParentOf(paths_[i])) {
+            indices.push_back(i);
+            names.emplace_back(paths_[i].baseName().get());
+        }
+    }
+    std::vector<NativeFileStat> stats(indices.size());
+    std::vector<char> exists(indices.size(), false); // not vector<bool>, which can't be written by many threads
+    auto statFiles = [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end && !isCancelled(); ++i) {
+            stats[i].name = names[i].c_str();
+            exists[i] = nativeFileStat(dirFd, dirWritable, hiddenNames, stats[i]);
+        }
+    };
+    size_t nThreads = std::min(maxStatThreads, indices.size() / minFilesPerStatThread);
+    if(nThreads > 1) {
+        size_t chunkSize = (indices.size() + nThreads - 1) / nThreads;
+        std::vector<std::thread> threads;
+        for(size_t begin = chunkSize; begin < indices.size(); begin += chunkSize) {
+            threads.emplace_back(statFiles, begin, std::min(begin + chunkSize, indices.size()));
+        }
+        statFiles(0, chunkSize);
+        for(auto& thread: threads) {
+            thread.join();
+        }
+    }
+    else {
+        statFiles(0, indices.size());
+    }
+    close(dirFd);
 
-            results_.push_back(fileInfoPtr);
-            Q_EMIT gotInfo(path, fileInfoPtr);
+    // the infos are added in the order of the paths
+    for(size_t i = 0; i < indices.size() && !isCancelled(); ++i) {
+        done[indices[i]] = true;
+        if(exists[i]) {
+            FileInfo fileInfo;
+            fileInfo.setFromNativeStat(stats[i], commonDirPath_);
+            fileInfo.isPartial_ = true;
+            addInfo(paths_[indices[i]], fileInfo, commonDirPath_);
         }
     }
+    return done;
+}
+
+void FileInfoJob::addInfo(const FilePath& path, const GFileInfoPtr& inf) {
+    // Reuse the same dirPath object when the path remains the same (optimize for files in the same dir)
+    auto dirPath = commonDirPath_.isValid() ? commonDirPath_ : path.parent();
+    FileInfo fileInfo(inf, dirPath);
+    addInfo(path, fileInfo, dirPath);
+}
+
+void FileInfoJob::addInfo(const FilePath& path, FileInfo& fileInfo, const FilePath& dirPath) {
+    // the files of a search folder are cut in their real folders
+    if(cutFilesHashSet_
+            && (cutFilesHashSet_->contains(dirPath, fileInfo.name())
+                || (dirPath.hasUriScheme("search") && cutFilesHashSet_->contains(path.parent(), fileInfo.name())))) {
+        fileInfo.bindCutFiles(cutFilesHashSet_);
+    }
+
+    auto fileInfoPtr = std::make_shared<const FileInfo>(fileInfo);
+
+    results_.push_back(fileInfoPtr);
+    Q_EMIT gotInfo(path, fileInfoPtr);
 }
 
 } // namespace Fm
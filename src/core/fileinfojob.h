@@ -13,7 +13,7 @@ class LIBFM_QT_API FileInfoJob : public Job {
     Q_OBJECT
 public:
 
-    explicit FileInfoJob(FilePathList paths, FilePathList deletionPaths = FilePathList(), FilePath commonDirPath = FilePath(), const std::shared_ptr<const HashSet>& cutFilesHashSet = nullptr);
+    explicit FileInfoJob(FilePathList paths, FilePathList deletionPaths = FilePathList(), FilePath commonDirPath = FilePath(), const std::shared_ptr<const CutFileSet>& cutFilesHashSet = nullptr);
 
     const FilePathList& paths() const {
         return paths_;
@@ -27,18 +27,45 @@ public:
         return results_;
     }
 
+    // Get the info of the paths in commonDirPath by listing the dir once instead of querying
+    // them one by one. This is faster only if the paths are a large part of the dir.
+    void setListCommonDir(bool listCommonDir) {
+        listCommonDir_ = listCommonDir;
+    }
+
+    // Get the basic info of the local files in commonDirPath with statx() instead of gio, like the
+    // FAST listing of DirListJob. The contents are not sniffed, so the infos are partial (see
+    // FileInfo::isPartial()). Many files are stat'ed by a few threads in parallel, so the latency of
+    // a network filesystem is not paid for each of them in turn.
+    void setNativeStat(bool nativeStat) {
+        nativeStat_ = nativeStat;
+    }
+
 Q_SIGNALS:
     void gotInfo(const FilePath& path, std::shared_ptr<const FileInfo>& info);
 
 protected:
     void exec() override;
 
+private:
+    void addInfo(const FilePath& path, const GFileInfoPtr& inf);
+
+    void addInfo(const FilePath& path, FileInfo& fileInfo, const FilePath& dirPath);
+
+    // returns which of the paths are found in commonDirPath
+    std::vector<bool> listCommonDir();
+
+    // returns which of the paths are stat'ed, including the ones which don't exist
+    std::vector<bool> statNativeFiles();
+
 private:
     FilePathList paths_;
     FilePathList deletionPaths_;
     FileInfoList results_;
     FilePath commonDirPath_;
-    const std::shared_ptr<const HashSet> cutFilesHashSet_;
+    const std::shared_ptr<const CutFileSet> cutFilesHashSet_;
+    bool listCommonDir_;
+    bool nativeStat_;
 };
 
 } // namespace Fm
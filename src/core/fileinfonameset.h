@@ -0,0 +1,216 @@
+#ifndef FM2_FILEINFONAMESET_H
+#define FM2_FILEINFONAMESET_H
+
+#include "../libfmqtglobals.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include "fileinfo.h"
+
+namespace Fm {
+
+// The files of a folder keyed by their names, used by Folder.
+// It's a flat hash table with open addressing, whose keys are the names stored in the FileInfo
+// objects themselves, so the names are not copied and the entries are not allocated one by one.
+// Only the hashes are kept in the slots, to skip comparing the names which don't match.
+class FileInfoNameSet {
+private:
+    struct Slot {
+        std::shared_ptr<const FileInfo> file; // nullptr if the slot is empty
+        std::size_t hash;
+    };
+
+public:
+    class const_iterator {
+    public:
+        const_iterator(const Slot* slot, const Slot* end): slot_{slot}, end_{end} {
+            skipEmpty();
+        }
+
+        const std::shared_ptr<const FileInfo>& operator*() const {
+            return slot_->file;
+        }
+
+        const std::shared_ptr<const FileInfo>* operator->() const {
+            return &slot_->file;
+        }
+
+        const_iterator& operator++() {
+            ++slot_;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return slot_ == other.slot_;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return slot_ != other.slot_;
+        }
+
+    private:
+        friend class FileInfoNameSet;
+
+        void skipEmpty() {
+            while(slot_ != end_ && !slot_->file) {
+                ++slot_;
+            }
+        }
+
+        const Slot* slot_;
+        const Slot* end_;
+    };
+
+    FileInfoNameSet(): size_{0} {
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const_iterator begin() const {
+        return const_iterator{slots_.data(), slots_.data() + slots_.size()};
+    }
+
+    const_iterator end() const {
+        return const_iterator{slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+    }
+
+    void clear() {
+        slots_.clear();
+        slots_.shrink_to_fit();
+        size_ = 0;
+    }
+
+    void swap(FileInfoNameSet& other) {
+        slots_.swap(other.slots_);
+        std::swap(size_, other.size_);
+    }
+
+    // make room for count files without growing the table again
+    void reserve(std::size_t count) {
+        std::size_t capacity = capacityFor(count);
+        if(capacity > slots_.size()) {
+            rehash(capacity);
+        }
+    }
+
+    const_iterator find(const char* name) const {
+        return find(name, strlen(name));
+    }
+
+    const_iterator find(const std::string& name) const {
+        return find(name.c_str(), name.length());
+    }
+
+    // Add the file, or replace the file of the same name. The replaced file is returned.
+    std::shared_ptr<const FileInfo> insert(std::shared_ptr<const FileInfo> file) {
+        const std::string& name = file->name();
+        std::size_t hash = hashName(name.c_str(), name.length());
+        if(slots_.empty() || (size_ + 1) * 4 > slots_.size() * 3) {
+            rehash(capacityFor(size_ + 1));
+        }
+        std::size_t mask = slots_.size() - 1;
+        for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots_[i];
+            if(!slot.file) {
+                slot.file = std::move(file);
+                slot.hash = hash;
+                ++size_;
+                return nullptr;
+            }
+            if(slot.hash == hash && slot.file->name() == name) {
+                std::swap(slot.file, file);
+                return file;
+            }
+        }
+    }
+
+    void erase(const_iterator it) {
+        std::size_t mask = slots_.size() - 1;
+        std::size_t hole = it.slot_ - slots_.data();
+        slots_[hole].file.reset();
+        --size_;
+        // move the following files of the probe sequence back, so no tombstone is needed
+        for(std::size_t i = (hole + 1) & mask; slots_[i].file; i = (i + 1) & mask) {
+            std::size_t home = slots_[i].hash & mask;
+            // the file can fill the hole if the hole is between its home and its current slot
+            if(((i - home) & mask) >= ((i - hole) & mask)) {
+                slots_[hole] = std::move(slots_[i]);
+                slots_[i].file.reset();
+                hole = i;
+            }
+        }
+    }
+
+    // the bytes used by the table for each file
+    static std::size_t memoryPerFile() {
+        // the table is kept at most 3/4 full
+        return sizeof(Slot) * 4 / 3;
+    }
+
+private:
+    // FNV-1a
+    static std::size_t hashName(const char* name, std::size_t len) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for(std::size_t i = 0; i < len; ++i) {
+            hash ^= static_cast<unsigned char>(name[i]);
+            hash *= 1099511628211ULL;
+        }
+        return static_cast<std::size_t>(hash);
+    }
+
+    // the smallest power of 2 which keeps count files at most 3/4 full
+    static std::size_t capacityFor(std::size_t count) {
+        std::size_t capacity = 8;
+        while(capacity * 3 < count * 4) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    const_iterator find(const char* name, std::size_t len) const {
+        if(size_ > 0) {
+            std::size_t hash = hashName(name, len);
+            std::size_t mask = slots_.size() - 1;
+            for(std::size_t i = hash & mask; slots_[i].file; i = (i + 1) & mask) {
+                const Slot& slot = slots_[i];
+                if(slot.hash == hash && slot.file->name().length() == len
+                        && memcmp(slot.file->name().c_str(), name, len) == 0) {
+                    return const_iterator{&slot, slots_.data() + slots_.size()};
+                }
+            }
+        }
+        return end();
+    }
+
+    void rehash(std::size_t capacity) {
+        std::vector<Slot> oldSlots(capacity);
+        oldSlots.swap(slots_);
+        std::size_t mask = capacity - 1;
+        for(auto& old: oldSlots) {
+            if(old.file) {
+                std::size_t i = old.hash & mask;
+                while(slots_[i].file) {
+                    i = (i + 1) & mask;
+                }
+                slots_[i] = std::move(old);
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::size_t size_;
+};
+
+} // namespace Fm
+
+#endif // FM2_FILEINFONAMESET_H
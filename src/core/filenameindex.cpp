@@ -0,0 +1,346 @@
+#include "filenameindex.h"
+#include "vfs/fm-name-index.h"
+#include <QSaveFile>
+#include <QDir>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+static const char indexMagic[8] = {'F', 'M', 'N', 'I', 'D', 'X', '1', '\0'};
+// the indexed dirs are checked for changes at most once in this long
+static const qint64 indexCheckInterval = 5000; // msecs
+
+std::mutex FileNameIndex::cacheMutex_;
+std::unordered_map<std::string, std::weak_ptr<FileNameIndex>> FileNameIndex::cache_;
+
+FileNameIndex::FileNameIndex(std::string rootPath):
+    rootPath_{std::move(rootPath)},
+    rootPrefix_{rootPath_},
+    rootDev_{0},
+    data_{nullptr} {
+    // the root dir "/" ends with a '/' already
+    if(rootPrefix_.empty() || rootPrefix_.back() != '/') {
+        rootPrefix_ += '/';
+    }
+}
+
+FileNameIndex::~FileNameIndex() {
+    file_.close(); // also unmaps it
+}
+
+// static
+std::shared_ptr<FileNameIndex> FileNameIndex::forPath(const FilePath& path, bool create) {
+    if(!path.isNative()) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    for(auto dirPath = path; dirPath.isValid(); dirPath = dirPath.parent()) {
+        std::string dir = dirPath.localPath().get();
+        auto it = cache_.find(dir);
+        std::shared_ptr<FileNameIndex> index;
+        if(it != cache_.end()) {
+            index = it->second.lock();
+        }
+        if(!index && access(indexFilePath(dir).c_str(), F_OK) == 0) {
+            index = std::make_shared<FileNameIndex>(dir);
+            cache_[dir] = index;
+        }
+        if(index) {
+            return index;
+        }
+        if(!dirPath.hasParent()) {
+            break;
+        }
+    }
+    if(!create) {
+        return nullptr;
+    }
+    std::string dir = path.localPath().get();
+    auto index = std::make_shared<FileNameIndex>(dir);
+    cache_[dir] = index;
+    return index;
+}
+
+// static
+void FileNameIndex::remove(const FilePath& rootPath) {
+    if(!rootPath.isNative()) {
+        return;
+    }
+    std::string dir = rootPath.localPath().get();
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    cache_.erase(dir);
+    unlink(indexFilePath(dir).c_str());
+}
+
+std::string FileNameIndex::indexFilePath() const {
+    return indexFilePath(rootPath_);
+}
+
+// static
+std::string FileNameIndex::indexFilePath(const std::string& rootPath) {
+    CStrPtr hash{g_compute_checksum_for_string(G_CHECKSUM_MD5, rootPath.c_str(), rootPath.length())};
+    CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "name-index", hash.get(), nullptr)};
+    return std::string{path.get()} + ".idx";
+}
+
+std::uint32_t FileNameIndex::Builder::addString(const char* str, size_t len) {
+    std::uint32_t offset = strings.length();
+    strings.append(str, len);
+    strings += '\0';
+    return offset;
+}
+
+bool FileNameIndex::load() {
+    file_.close();
+    data_ = nullptr;
+    file_.setFileName(QString::fromLocal8Bit(indexFilePath().c_str()));
+    if(!file_.open(QIODevice::ReadOnly) || file_.size() < qint64(sizeof(Header))) {
+        return false;
+    }
+    auto data = file_.map(0, file_.size());
+    if(!data) {
+        return false;
+    }
+    // check if the file is valid before using it
+    auto h = reinterpret_cast<const Header*>(data);
+    quint64 size = sizeof(Header) + quint64(h->dirCount) * sizeof(Dir) + quint64(h->entryCount) * sizeof(Entry) + h->stringsSize;
+    if(memcmp(h->magic, indexMagic, sizeof(indexMagic)) != 0 || size != quint64(file_.size())
+            || h->stringsSize == 0 || h->rootOffset >= h->stringsSize) {
+        file_.close();
+        return false;
+    }
+    data_ = data;
+    if(strings()[h->stringsSize - 1] != '\0' || rootPath_ != strings() + h->rootOffset) {
+        file_.close();
+        data_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool FileNameIndex::save(const Builder& builder) {
+    // the old file might still be mapped by other processes, so a new file is written and renamed
+    QString path = QString::fromLocal8Bit(indexFilePath().c_str());
+    QDir().mkpath(QFileInfo{path}.absolutePath());
+    QSaveFile file{path};
+    if(!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    Header h;
+    memcpy(h.magic, indexMagic, sizeof(indexMagic));
+    h.dirCount = builder.dirs.size();
+    h.entryCount = builder.entries.size();
+    h.stringsSize = builder.strings.length();
+    h.rootOffset = 0; // the root path is always added first
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    file.write(reinterpret_cast<const char*>(builder.dirs.data()), builder.dirs.size() * sizeof(Dir));
+    file.write(reinterpret_cast<const char*>(builder.entries.data()), builder.entries.size() * sizeof(Entry));
+    file.write(builder.strings.data(), builder.strings.length());
+    if(!file.commit()) {
+        return false;
+    }
+    return load();
+}
+
+bool FileNameIndex::isChanged() const {
+    auto h = header();
+    auto d = dirs();
+    for(std::uint32_t i = 0; i < h->dirCount; ++i) {
+        const char* relPath = strings() + d[i].pathOffset;
+        std::string path = *relPath ? rootPrefix_ + relPath : rootPath_;
+        struct stat st;
+        if(lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)
+                || st.st_mtim.tv_sec != d[i].mtime || st.st_mtim.tv_nsec != d[i].mtimeNsec) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileNameIndex::updateDir(Builder& builder, const std::unordered_map<std::string, std::uint32_t>& oldDirs,
+                              const std::string& relPath, GCancellable* cancellable) {
+    if(g_cancellable_is_cancelled(cancellable)) {
+        return false;
+    }
+    std::string path = relPath.empty() ? rootPath_ : rootPrefix_ + relPath;
+    int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if(dirFd < 0 || fstat(dirFd, &st) != 0) {
+        if(dirFd >= 0) {
+            close(dirFd);
+        }
+        return true; // skip the dirs we can't read
+    }
+    if(relPath.empty()) {
+        rootDev_ = st.st_dev;
+    }
+    else if(st.st_dev != rootDev_) {
+        // don't cross into other filesystems, such as /proc and the removable media under "/"
+        close(dirFd);
+        return true;
+    }
+
+    Dir dir;
+    dir.pathOffset = builder.addString(relPath.c_str(), relPath.length());
+    dir.firstEntry = builder.entries.size();
+    dir.reserved = 0;
+    dir.mtime = st.st_mtim.tv_sec;
+    dir.mtimeNsec = st.st_mtim.tv_nsec;
+    std::vector<std::string> subDirs;
+
+    auto old = oldDirs.find(relPath);
+    if(old != oldDirs.end() && dirs()[old->second].mtime == dir.mtime && dirs()[old->second].mtimeNsec == dir.mtimeNsec) {
+        // the names in the dir are not changed, but the subdirs might be
+        close(dirFd);
+        auto& oldDir = dirs()[old->second];
+        for(auto e = entries() + oldDir.firstEntry; e < entries() + oldDir.firstEntry + oldDir.entryCount; ++e) {
+            const char* name = strings() + e->nameOffset;
+            builder.entries.push_back(Entry{builder.addString(name, strlen(name)), e->isDir});
+            if(e->isDir) {
+                subDirs.emplace_back(name);
+            }
+        }
+    }
+    else {
+        DIR* dirp = fdopendir(dirFd);
+        if(!dirp) {
+            close(dirFd);
+            return true;
+        }
+        while(auto ent = readdir(dirp)) {
+            const char* name = ent->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            // the symlinks to dirs are not followed, like the search does
+            bool isDir = (ent->d_type == DT_DIR);
+            struct stat entSt;
+            if(ent->d_type == DT_UNKNOWN && fstatat(dirfd(dirp), name, &entSt, AT_SYMLINK_NOFOLLOW) == 0) {
+                isDir = S_ISDIR(entSt.st_mode);
+            }
+            builder.entries.push_back(Entry{builder.addString(name, strlen(name)), isDir});
+            if(isDir) {
+                subDirs.emplace_back(name);
+            }
+        }
+        closedir(dirp);
+    }
+    dir.entryCount = builder.entries.size() - dir.firstEntry;
+    builder.dirs.push_back(dir);
+
+    for(const auto& subDir: subDirs) {
+        if(!updateDir(builder, oldDirs, relPath.empty() ? subDir : relPath + '/' + subDir, cancellable)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileNameIndex::update(GCancellable* cancellable) {
+    if(data_ && checkTimer_.isValid() && !checkTimer_.hasExpired(indexCheckInterval)) {
+        return true; // checked recently
+    }
+    checkTimer_.start();
+    if(data_ && !isChanged()) {
+        return true;
+    }
+    std::unordered_map<std::string, std::uint32_t> oldDirs;
+    if(data_) {
+        for(std::uint32_t i = 0; i < header()->dirCount; ++i) {
+            oldDirs.emplace(strings() + dirs()[i].pathOffset, i);
+        }
+    }
+    Builder builder;
+    builder.addString(rootPath_.c_str(), rootPath_.length());
+    if(!updateDir(builder, oldDirs, std::string{}, cancellable) || builder.dirs.empty()) {
+        return false;
+    }
+    if(!save(builder)) {
+        qWarning("failed to save the file name index of %s", rootPath_.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FileNameIndex::query(const FilePath& dirPath, bool recursive, bool showHidden,
+                          const std::function<bool (const char* name)>& filter,
+                          FilePathList& results, GCancellable* cancellable) {
+    if(!dirPath.isNative()) {
+        return false;
+    }
+    std::string path = dirPath.localPath().get();
+    std::string relDir;
+    if(path != rootPath_) {
+        if(path.compare(0, rootPrefix_.length(), rootPrefix_) != 0) {
+            return false;
+        }
+        relDir = path.substr(rootPrefix_.length());
+    }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!data_) {
+        load();
+    }
+    if(!update(cancellable)) {
+        return false;
+    }
+    auto d = dirs();
+    for(std::uint32_t i = 0; i < header()->dirCount; ++i) {
+        const char* relPath = strings() + d[i].pathOffset;
+        const char* subPath; // the path of the dir relative to the queried dir
+        if(relDir.empty()) {
+            subPath = relPath;
+        }
+        else if(strncmp(relPath, relDir.c_str(), relDir.length()) == 0
+                && (relPath[relDir.length()] == '\0' || relPath[relDir.length()] == '/')) {
+            subPath = relPath + relDir.length() + (relPath[relDir.length()] == '/');
+        }
+        else {
+            continue;
+        }
+        if(*subPath && !recursive) {
+            continue;
+        }
+        // skip the dirs in the hidden dirs below the queried dir
+        if(!showHidden && (subPath[0] == '.' || strstr(subPath, "/."))) {
+            continue;
+        }
+        std::string prefix = *relPath ? rootPrefix_ + relPath + '/' : rootPrefix_;
+        for(auto e = entries() + d[i].firstEntry; e < entries() + d[i].firstEntry + d[i].entryCount; ++e) {
+            const char* name = strings() + e->nameOffset;
+            if((showHidden || name[0] != '.') && filter(name)) {
+                results.push_back(FilePath::fromLocalPath((prefix + name).c_str()));
+            }
+        }
+        if(g_cancellable_is_cancelled(cancellable)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace Fm
+
+gboolean fm_name_index_query(GFile* dir, gboolean recursive, gboolean show_hidden,
+                             FmNameIndexFilter filter, gpointer user_data,
+                             GSList** files, GCancellable* cancellable) {
+    Fm::FilePath dirPath{dir, true};
+    auto index = Fm::FileNameIndex::forPath(dirPath, true);
+    if(!index) {
+        return FALSE;
+    }
+    Fm::FilePathList results;
+    if(!index->query(dirPath, recursive, show_hidden, [filter, user_data](const char* name) {
+                         return filter(name, user_data) != FALSE;
+                     }, results, cancellable)) {
+        return FALSE;
+    }
+    for(auto& path: results) {
+        *files = g_slist_prepend(*files, g_object_ref(path.gfile().get()));
+    }
+    return TRUE;
+}
@@ -0,0 +1,134 @@
+#ifndef FM2_FILENAMEINDEX_H
+#define FM2_FILENAMEINDEX_H
+
+#include "../libfmqtglobals.h"
+#include <QFile>
+#include <QElapsedTimer>
+#include <sys/types.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include "gioptrs.h"
+#include "filepath.h"
+
+namespace Fm {
+
+// A persistent index of the names of all files under a local folder, which lets the searches by
+// name skip walking the folder again. The index is saved in the cache dir of the user and mapped
+// into memory when it's used.
+// Before a query, the mtimes of the indexed dirs are checked and only the changed dirs are listed
+// again, so the index is kept up to date without monitoring the whole tree. Checking every dir
+// takes a while in a big tree, so it's done at most once in a few seconds, and the queries made
+// meanwhile use the index as is. The filesystems mounted below the root are not indexed.
+class LIBFM_QT_API FileNameIndex {
+public:
+    explicit FileNameIndex(std::string rootPath);
+
+    ~FileNameIndex();
+
+    // the index covering the local path, which is the saved index of the path or one of its parents.
+    // If there's none and create is true, the index of the path is created (but not built yet).
+    static std::shared_ptr<FileNameIndex> forPath(const FilePath& path, bool create);
+
+    // delete the saved index of the dir
+    static void remove(const FilePath& rootPath);
+
+    FilePath root() const {
+        return FilePath::fromLocalPath(rootPath_.c_str());
+    }
+
+    // Find the files in the dir (and its subdirs if recursive) whose names pass the filter.
+    // The hidden files and the files in the hidden dirs are skipped unless showHidden is true.
+    // The index is built or updated first if needed.
+    // Returns false if the dir is not covered by the index or the query is cancelled.
+    bool query(const FilePath& dirPath, bool recursive, bool showHidden,
+               const std::function<bool (const char* name)>& filter,
+               FilePathList& results, GCancellable* cancellable);
+
+private:
+    // the file format, which has no pointers so it can be mapped directly
+    struct Header {
+        char magic[8];
+        std::uint32_t dirCount;
+        std::uint32_t entryCount;
+        std::uint32_t stringsSize;
+        std::uint32_t rootOffset; // path of the root dir in the strings
+    };
+
+    struct Dir {
+        std::uint32_t pathOffset; // relative to the root, empty for the root itself
+        std::uint32_t firstEntry; // the entries of a dir are stored together
+        std::uint32_t entryCount;
+        std::uint32_t reserved;
+        std::int64_t mtime;
+        std::int64_t mtimeNsec;
+    };
+
+    struct Entry {
+        std::uint32_t nameOffset;
+        std::uint32_t isDir;
+    };
+
+    // the content of the index while it's built
+    struct Builder {
+        std::vector<Dir> dirs;
+        std::vector<Entry> entries;
+        std::string strings;
+
+        std::uint32_t addString(const char* str, size_t len);
+    };
+
+    std::string indexFilePath() const;
+
+    static std::string indexFilePath(const std::string& rootPath);
+
+    bool load();
+
+    bool save(const Builder& builder);
+
+    // whether any indexed dir is changed, added or removed
+    bool isChanged() const;
+
+    // list the dir again if it's changed since it's indexed, otherwise copy the old entries
+    bool updateDir(Builder& builder, const std::unordered_map<std::string, std::uint32_t>& oldDirs,
+                   const std::string& relPath, GCancellable* cancellable);
+
+    // build the index, or update it if it's changed
+    bool update(GCancellable* cancellable);
+
+    const Header* header() const {
+        return reinterpret_cast<const Header*>(data_);
+    }
+
+    const Dir* dirs() const {
+        return reinterpret_cast<const Dir*>(data_ + sizeof(Header));
+    }
+
+    const Entry* entries() const {
+        return reinterpret_cast<const Entry*>(data_ + sizeof(Header) + header()->dirCount * sizeof(Dir));
+    }
+
+    const char* strings() const {
+        return reinterpret_cast<const char*>(entries() + header()->entryCount);
+    }
+
+private:
+    std::string rootPath_;
+    std::string rootPrefix_; // rootPath_ ending with a '/', which is prepended to the relative paths
+    dev_t rootDev_; // the filesystem of the root, set while updating the index
+    QElapsedTimer checkTimer_; // since the dirs are checked last time
+    QFile file_;
+    const uchar* data_; // the mapped index file
+    std::mutex mutex_;
+
+    static std::mutex cacheMutex_;
+    static std::unordered_map<std::string, std::weak_ptr<FileNameIndex>> cache_;
+};
+
+} // namespace Fm
+
+#endif // FM2_FILENAMEINDEX_H
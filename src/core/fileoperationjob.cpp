@@ -1,7 +1,66 @@
 #include "fileoperationjob.h"
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 namespace Fm {
 
+// the progress is sampled at most this often (in ms)
+static const qint64 progressSampleInterval = 250;
+
+// the throughput is calculated from the samples of this period
+static const qint64 throughputWindow = 10000;
+
+// the background jobs are as nice as possible
+static const int backgroundNiceness = 19;
+
+// the transfer can catch up for the time it didn't use the bandwidth, but only for this long
+static const qint64 maxThrottleCredit = 1000;
+
+#ifdef __linux__
+// from linux/ioprio.h, which is not always installed
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// the priority of the thread which is set by the jobs, and its original values
+struct ThreadPriority {
+    const FileOperationJob* job = nullptr;
+    unsigned int changes = 0;
+    bool background = false;
+    int ioPriority = 0;
+    int niceness = 0;
+};
+
+static thread_local ThreadPriority threadPriority;
+
+static void setThreadBackground(bool background) {
+    pid_t tid = syscall(SYS_gettid);
+    if(background) {
+        threadPriority.ioPriority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+        errno = 0;
+        threadPriority.niceness = getpriority(PRIO_PROCESS, tid);
+        if(errno != 0) {
+            threadPriority.niceness = 0;
+        }
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+        setpriority(PRIO_PROCESS, tid, backgroundNiceness);
+    }
+    else {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, std::max(threadPriority.ioPriority, 0));
+        // NOTE: unprivileged users may not be allowed to lower the niceness again.
+        setpriority(PRIO_PROCESS, tid, threadPriority.niceness);
+    }
+    threadPriority.background = background;
+}
+#endif
+
 FileOperationJob::FileOperationJob():
     hasTotalAmount_{false},
     calcProgressUsingSize_{true},
@@ -10,7 +69,73 @@ FileOperationJob::FileOperationJob():
     finishedSize_{0},
     finishedCount_{0},
     currentFileSize_{0},
-    currentFileFinished_{0} {
+    currentFileFinished_{0},
+    background_{false},
+    priorityChanges_{0},
+    bandwidthLimit_{0},
+    fileExistsAction_{-1},
+    throttledSize_{0} {
+    // it might run for long and wait for the user to handle the errors
+    setPriority(Priority::OWN_THREAD);
+}
+
+void FileOperationJob::setBackground(bool value) {
+    background_.store(value, std::memory_order_relaxed);
+    priorityChanges_.fetch_add(1, std::memory_order_release);
+}
+
+void FileOperationJob::setBandwidthLimit(std::uint64_t bytesPerSec) {
+    std::lock_guard<std::mutex> lock{throttleMutex_};
+    bandwidthLimit_.store(bytesPerSec, std::memory_order_relaxed);
+    throttleTimer_.invalidate();
+}
+
+void FileOperationJob::throttle(std::uint64_t transferredSize) {
+    if(isPaused()) {
+        onPaused();
+        waitIfPaused();
+        onResumed();
+    }
+#ifdef __linux__
+    // the priority is only changed by the threads themselves
+    auto changes = priorityChanges_.load(std::memory_order_acquire);
+    if(threadPriority.job != this || threadPriority.changes != changes) {
+        bool background = isBackground();
+        if(background != threadPriority.background) {
+            setThreadBackground(background);
+        }
+        threadPriority.job = this;
+        threadPriority.changes = changes;
+    }
+#endif
+    auto limit = bandwidthLimit();
+    if(limit == 0 || transferredSize == 0) {
+        return;
+    }
+    qint64 delay;
+    {
+        std::lock_guard<std::mutex> lock{throttleMutex_};
+        if(!throttleTimer_.isValid()) {
+            throttleTimer_.start();
+            throttledSize_ = 0;
+        }
+        throttledSize_ += transferredSize;
+        qint64 due = throttledSize_ * 1000 / limit; // when the data should be finished at the limited rate
+        qint64 elapsed = throttleTimer_.elapsed();
+        if(elapsed > due + maxThrottleCredit) {
+            throttleTimer_.start();
+            throttledSize_ = transferredSize;
+            due = throttledSize_ * 1000 / limit;
+            elapsed = 0;
+        }
+        delay = due - elapsed;
+    }
+    // sleep in short steps so cancelling the job is not delayed
+    while(delay > 0 && !isCancelled()) {
+        auto step = std::min(delay, qint64(100));
+        std::this_thread::sleep_for(std::chrono::milliseconds(step));
+        delay -= step;
+    }
 }
 
 bool FileOperationJob::totalAmount(uint64_t& fileSize, uint64_t& fileCount) const {
@@ -26,8 +151,8 @@ bool FileOperationJob::currentFileProgress(FilePath& path, uint64_t& totalSize,
     std::lock_guard<std::mutex> lock{mutex_};
     if(currentFile_.isValid()) {
         path = currentFile_;
-        totalSize = currentFileSize_;
-        finishedSize = currentFileFinished_;
+        totalSize = currentFileSize_.load(std::memory_order_relaxed);
+        finishedSize = currentFileFinished_.load(std::memory_order_relaxed);
     }
     return currentFile_.isValid();
 }
@@ -36,10 +161,11 @@ double FileOperationJob::progress() const {
     std::lock_guard<std::mutex> lock{mutex_};
     double finishedRatio;
     if(calcProgressUsingSize_) {
-        finishedRatio = totalSize_ > 0 ? double(finishedSize_ + currentFileFinished_) / totalSize_ : 0.0;
+        finishedRatio = totalSize_ > 0 ? double(finishedSize_.load(std::memory_order_relaxed)
+                                                + currentFileFinished_.load(std::memory_order_relaxed)) / totalSize_ : 0.0;
     }
     else {
-        finishedRatio = totalCount_ > 0 ? double(finishedCount_) / totalCount_ : 0.0;
+        finishedRatio = totalCount_ > 0 ? double(finishedCount_.load(std::memory_order_relaxed)) / totalCount_ : 0.0;
     }
 
     if(finishedRatio > 1.0) {
@@ -48,8 +174,127 @@ double FileOperationJob::progress() const {
     return finishedRatio;
 }
 
+void FileOperationJob::sampleProgress() const {
+    // NOTE: statsMutex_ should be locked
+    if(!statsTimer_.isValid()) {
+        return;
+    }
+    auto now = statsTimer_.elapsed();
+    if(samples_.empty() || now - samples_.back().time >= progressSampleInterval) {
+        samples_.push_back(ProgressSample{now,
+                                          finishedSize_.load(std::memory_order_relaxed) + currentFileFinished_.load(std::memory_order_relaxed),
+                                          finishedCount_.load(std::memory_order_relaxed)});
+    }
+    // keep one sample older than the window, so the window is fully covered
+    while(samples_.size() > 2 && now - samples_[1].time >= throughputWindow) {
+        samples_.pop_front();
+    }
+}
+
+// The progress can go back, e.g. when a file is retried or skipped, so the amounts are subtracted
+// as signed numbers instead of wrapping around, and the amount done in an interval is at least 0.
+static double progressDelta(std::uint64_t from, std::uint64_t to) {
+    return std::max(double(qint64(to) - qint64(from)), 0.0);
+}
+
+bool FileOperationJob::throughput(double& bytesPerSec, double& filesPerSec) const {
+    std::lock_guard<std::mutex> lock{statsMutex_};
+    sampleProgress();
+    if(samples_.size() < 2) {
+        return false;
+    }
+    auto& first = samples_.front();
+    auto& last = samples_.back();
+    double secs = (last.time - first.time) / 1000.0;
+    if(secs <= 0) {
+        return false;
+    }
+    bytesPerSec = progressDelta(first.size, last.size) / secs;
+    filesPerSec = progressDelta(first.count, last.count) / secs;
+    return true;
+}
+
+bool FileOperationJob::averageThroughput(double& bytesPerSec, double& filesPerSec) const {
+    std::lock_guard<std::mutex> lock{statsMutex_};
+    if(!statsTimer_.isValid() || statsTimer_.elapsed() <= 0) {
+        return false;
+    }
+    double secs = statsTimer_.elapsed() / 1000.0;
+    bytesPerSec = (finishedSize_.load(std::memory_order_relaxed) + currentFileFinished_.load(std::memory_order_relaxed)) / secs;
+    filesPerSec = finishedCount_.load(std::memory_order_relaxed) / secs;
+    return true;
+}
+
+qint64 FileOperationJob::remainingTime() const {
+    std::uint64_t totalSize, totalCount;
+    if(!totalAmount(totalSize, totalCount)) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock{statsMutex_};
+    sampleProgress();
+    if(samples_.size() < 3) { // not enough to tell the costs apart
+        return -1;
+    }
+    // Fit time = bytes * secsPerByte + files * secsPerFile to the intervals between the samples
+    // with least squares. Any of the costs can't be negative, so the other one is fitted alone then.
+    double bb = 0, bf = 0, ff = 0, tb = 0, tf = 0;
+    for(size_t i = 1; i < samples_.size(); ++i) {
+        double t = (samples_[i].time - samples_[i - 1].time) / 1000.0;
+        double b = progressDelta(samples_[i - 1].size, samples_[i].size);
+        double f = progressDelta(samples_[i - 1].count, samples_[i].count);
+        bb += b * b;
+        bf += b * f;
+        ff += f * f;
+        tb += t * b;
+        tf += t * f;
+    }
+    double secsPerByte = 0, secsPerFile = 0;
+    double det = bb * ff - bf * bf;
+    if(det > 0) {
+        secsPerByte = (tb * ff - tf * bf) / det;
+        secsPerFile = (tf * bb - tb * bf) / det;
+    }
+    if(det <= 0 || secsPerByte < 0 || secsPerFile < 0) {
+        // keep the one which explains more of the time
+        double byteFit = bb > 0 ? tb * tb / bb : 0;
+        double fileFit = ff > 0 ? tf * tf / ff : 0;
+        secsPerByte = (bb > 0 && byteFit >= fileFit) ? tb / bb : 0;
+        secsPerFile = (secsPerByte == 0 && ff > 0) ? tf / ff : 0;
+    }
+    if(secsPerByte == 0 && secsPerFile == 0) { // no progress in the window
+        return -1;
+    }
+    auto& last = samples_.back();
+    double remainingSize = totalSize > last.size ? totalSize - last.size : 0;
+    double remainingCount = totalCount > last.count ? totalCount - last.count : 0;
+    return qint64(remainingSize * secsPerByte + remainingCount * secsPerFile);
+}
+
+void FileOperationJob::setFileExistsAction(FileExistsAction action) {
+    if(action == OVERWRITE || action == SKIP) {
+        fileExistsAction_.store(action, std::memory_order_relaxed);
+    }
+}
+
+void FileOperationJob::resetFileExistsAction() {
+    fileExistsAction_.store(-1, std::memory_order_relaxed);
+}
+
+bool FileOperationJob::fileExistsAction(FileExistsAction& action) const {
+    int value = fileExistsAction_.load(std::memory_order_relaxed);
+    if(value == -1) {
+        return false;
+    }
+    action = FileExistsAction(value);
+    return true;
+}
+
 FileOperationJob::FileExistsAction FileOperationJob::askRename(const FileInfo &src, const FileInfo &dest, FilePath &newDest) {
     FileExistsAction action = SKIP;
+    // the answer for all the files doesn't need a blocking round trip to the thread of the UI
+    if(fileExistsAction(action)) {
+        return action;
+    }
     Q_EMIT fileExists(src, dest, action, newDest);
     return action;
 }
@@ -57,29 +302,33 @@ FileOperationJob::FileExistsAction FileOperationJob::askRename(const FileInfo &s
 bool FileOperationJob::finishedAmount(uint64_t& finishedSize, uint64_t& finishedCount) const {
     std::lock_guard<std::mutex> lock{mutex_};
     if(hasTotalAmount_) {
-        finishedSize = finishedSize_;
-        finishedCount = finishedCount_;
+        finishedSize = finishedSize_.load(std::memory_order_relaxed);
+        finishedCount = finishedCount_.load(std::memory_order_relaxed);
     }
     return hasTotalAmount_;
 }
 
 void FileOperationJob::setTotalAmount(uint64_t fileSize, uint64_t fileCount) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    hasTotalAmount_ = true;
-    totalSize_ = fileSize;
-    totalCount_ = fileCount;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        hasTotalAmount_ = true;
+        totalSize_ = fileSize;
+        totalCount_ = fileCount;
+    }
+    std::lock_guard<std::mutex> lock{statsMutex_};
+    if(!statsTimer_.isValid()) {
+        statsTimer_.start();
+    }
 }
 
 void FileOperationJob::setFinishedAmount(uint64_t finishedSize, uint64_t finishedCount) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    finishedSize_ = finishedSize;
-    finishedCount_ = finishedCount;
+    finishedSize_.store(finishedSize, std::memory_order_relaxed);
+    finishedCount_.store(finishedCount, std::memory_order_relaxed);
 }
 
 void FileOperationJob::addFinishedAmount(uint64_t finishedSize, uint64_t finishedCount) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    finishedSize_ += finishedSize;
-    finishedCount_ += finishedCount;
+    finishedSize_.fetch_add(finishedSize, std::memory_order_relaxed);
+    finishedCount_.fetch_add(finishedCount, std::memory_order_relaxed);
 }
 
 FilePath FileOperationJob::currentFile() const {
@@ -94,9 +343,8 @@ void FileOperationJob::setCurrentFile(const FilePath& path) {
 }
 
 void FileOperationJob::setCurrentFileProgress(uint64_t totalSize, uint64_t finishedSize) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    currentFileSize_ = totalSize;
-    currentFileFinished_ = finishedSize;
+    currentFileSize_.store(totalSize, std::memory_order_relaxed);
+    currentFileFinished_.store(finishedSize, std::memory_order_relaxed);
 }
 
 } // namespace Fm
@@ -3,9 +3,12 @@
 
 #include "../libfmqtglobals.h"
 #include "job.h"
+#include <QElapsedTimer>
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <cstdint>
+#include <deque>
 #include "fileinfo.h"
 #include "filepath.h"
 
@@ -44,6 +47,43 @@ public:
     // get currently finished amount (0.0 to 1.0)
     virtual double progress() const;
 
+    // get the rates of the last few seconds. Returns false if the job is not running for long enough.
+    bool throughput(double& bytesPerSec, double& filesPerSec) const;
+
+    // get the rates since the job started to transfer the files
+    bool averageThroughput(double& bytesPerSec, double& filesPerSec) const;
+
+    // Estimate the remaining seconds, or -1 if it's unknown yet. The time spent on each file is modeled
+    // from the recent progress as a cost per byte plus a cost per file, so the estimate stays stable
+    // when the job goes through a mix of small and big files.
+    qint64 remainingTime() const;
+
+    // Run the job in the background so it doesn't slow down the interactive use of the disks:
+    // its threads use the idle I/O class and a lower CPU priority. It can be changed while the job is running.
+    void setBackground(bool value);
+
+    bool isBackground() const {
+        return background_.load(std::memory_order_relaxed);
+    }
+
+    // limit the rate the data is transferred at, in bytes per second (0 means no limit)
+    void setBandwidthLimit(std::uint64_t bytesPerSec);
+
+    std::uint64_t bandwidthLimit() const {
+        return bandwidthLimit_.load(std::memory_order_relaxed);
+    }
+
+    // Resolve all the conflicts with the existing destination files in the same way, such as when the
+    // user chooses "apply to all", so the job doesn't emit fileExists() for the later ones.
+    // Only OVERWRITE and SKIP can be used for all the files. It can be set before or while the job runs.
+    void setFileExistsAction(FileExistsAction action);
+
+    // forget the action set by setFileExistsAction(), so the next conflicts are asked again
+    void resetFileExistsAction();
+
+    // get the action used for all the conflicts, or returns false if they're asked one by one
+    bool fileExistsAction(FileExistsAction& action) const;
+
 Q_SIGNALS:
 
     void preparedToRun();
@@ -69,6 +109,18 @@ protected:
 
     void setCurrentFileProgress(uint64_t totalSize, uint64_t finishedSize);
 
+    // To be called by every thread of the job between files or chunks of data. It waits while the
+    // job is paused, applies the current priority of the job to the calling thread, and waits to
+    // keep the bandwidth limit.
+    void throttle(std::uint64_t transferredSize = 0);
+
+    // called by each thread which stops at throttle() since the job is paused, before and after it waits
+    virtual void onPaused() {
+    }
+
+    virtual void onResumed() {
+    }
+
     void setCalcProgressUsingSize(bool value) {
         calcProgressUsingSize_ = value;
     }
@@ -82,13 +134,36 @@ private:
     bool calcProgressUsingSize_;
     std::uint64_t totalSize_;
     std::uint64_t totalCount_;
-    std::uint64_t finishedSize_;
-    std::uint64_t finishedCount_;
+    // the progress is updated very often while copying files, so it's not protected by the mutex
+    std::atomic<std::uint64_t> finishedSize_;
+    std::atomic<std::uint64_t> finishedCount_;
 
     FilePath currentFile_;
-    std::uint64_t currentFileSize_;
-    std::uint64_t currentFileFinished_;
-    mutable std::mutex mutex_;
+    std::atomic<std::uint64_t> currentFileSize_;
+    std::atomic<std::uint64_t> currentFileFinished_;
+    mutable std::mutex mutex_; // protects the total amount and the current file
+
+    struct ProgressSample {
+        qint64 time;
+        std::uint64_t size;
+        std::uint64_t count;
+    };
+
+    // take a sample of the progress if the last one is old enough and drop the ones out of the window
+    void sampleProgress() const;
+
+    // the statistics are collected when they're queried, so the job doesn't need to know their users
+    mutable std::deque<ProgressSample> samples_;
+    mutable QElapsedTimer statsTimer_; // started when the total amount is first known
+    mutable std::mutex statsMutex_;
+
+    std::atomic<bool> background_;
+    std::atomic<unsigned int> priorityChanges_; // lets every thread know that it should apply the new priority
+    std::atomic<std::uint64_t> bandwidthLimit_;
+    std::atomic<int> fileExistsAction_; // -1 if the conflicts are asked one by one
+    std::uint64_t throttledSize_; // bytes transferred since throttleTimer_ is started
+    QElapsedTimer throttleTimer_;
+    std::mutex throttleMutex_;
 };
 
 } // namespace Fm
@@ -6,6 +6,7 @@
 #include "cstrptr.h"
 #include <gio/gio.h>
 #include <vector>
+#include <unordered_set>
 #include <QMetaType>
 
 namespace Fm {
@@ -170,6 +171,8 @@ struct FilePathHash {
 
 typedef std::vector<FilePath> FilePathList;
 
+typedef std::unordered_set<FilePath, FilePathHash> FilePathSet;
+
 } // namespace Fm
 
 Q_DECLARE_METATYPE(Fm::FilePath)
@@ -0,0 +1,162 @@
+#include "filesystemcapabilities_p.h"
+#include "gioptrs.h"
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#include <sys/statvfs.h>
+
+namespace Fm {
+
+static std::mutex capabilitiesMutex;
+// keyed by the interned filesystem ids
+static std::unordered_map<const char*, FileSystemCapabilities> capabilitiesCache;
+// increased by clear() so the result remembered by each thread is dropped
+static std::atomic<unsigned int> cacheGeneration{0};
+
+namespace {
+
+// All files of a folder are normally on the same filesystem, so the last result of each thread
+// is remembered to avoid taking the lock for every file.
+struct LastCapabilities {
+    const char* filesystemId = nullptr;
+    unsigned int generation = 0;
+    FileSystemCapabilities capabilities;
+};
+
+thread_local LastCapabilities lastCapabilities;
+
+bool cachedCapabilities(const char* filesystemId, FileSystemCapabilities& capabilities) {
+    auto& last = lastCapabilities;
+    unsigned int generation = cacheGeneration.load(std::memory_order_acquire);
+    if(last.filesystemId == filesystemId && last.generation == generation) {
+        capabilities = last.capabilities;
+        return true;
+    }
+    std::lock_guard<std::mutex> lock{capabilitiesMutex};
+    auto it = capabilitiesCache.find(filesystemId);
+    if(it == capabilitiesCache.end()) {
+        return false;
+    }
+    capabilities = it->second;
+    last.filesystemId = filesystemId;
+    last.generation = generation;
+    last.capabilities = capabilities;
+    return true;
+}
+
+} // namespace
+
+// static
+FileSystemCapabilities FileSystemCapabilities::cached(const char* filesystemId) {
+    FileSystemCapabilities capabilities;
+    if(filesystemId) {
+        cachedCapabilities(filesystemId, capabilities);
+    }
+    return capabilities;
+}
+
+// static
+FileSystemCapabilities FileSystemCapabilities::query(const char* filesystemId, const FilePath& path, GCancellable* cancellable) {
+    FileSystemCapabilities capabilities;
+    if(!filesystemId || !path.isValid()) {
+        return capabilities;
+    }
+    if(cachedCapabilities(filesystemId, capabilities)) {
+        return capabilities;
+    }
+    // the filesystem is queried without the lock, and the first result is kept if another thread did it too
+    if(path.isNative()) {
+        capabilities = queryNative(path.localPath().get());
+    }
+    else {
+        capabilities = queryGio(path, cancellable);
+    }
+    if(capabilities.isKnown) {
+        std::lock_guard<std::mutex> lock{capabilitiesMutex};
+        capabilities = capabilitiesCache.emplace(filesystemId, capabilities).first->second;
+    }
+    return capabilities;
+}
+
+// static
+void FileSystemCapabilities::clear() {
+    std::lock_guard<std::mutex> lock{capabilitiesMutex};
+    capabilitiesCache.clear();
+    cacheGeneration.fetch_add(1, std::memory_order_release);
+}
+
+// static
+FileSystemCapabilities FileSystemCapabilities::queryNative(const char* localPath) {
+    FileSystemCapabilities capabilities;
+    struct statvfs vfs;
+    if(statvfs(localPath, &vfs) != 0) {
+        return capabilities;
+    }
+    capabilities.isKnown = true;
+    capabilities.readOnly = (vfs.f_flag & ST_RDONLY) != 0;
+    // gio puts the trash of other mounts in their .Trash-$uid dirs, which can't be made if it's read-only
+    capabilities.canTrash = !capabilities.readOnly;
+#ifdef __linux__
+    struct statfs st;
+    if(statfs(localPath, &st) == 0) {
+        switch(static_cast<std::uint32_t>(st.f_type)) {
+        case 0x4d44: // MSDOS (vfat)
+        case 0x2011BAB0: // exFAT
+            capabilities.caseSensitive = false;
+            capabilities.supportsSymlinks = false;
+            break;
+        case 0x5346544e: // NTFS (ntfs)
+        case 0x7366746e: // NTFS (ntfs3)
+            capabilities.caseSensitive = false;
+            break;
+        case 0x9660: // ISO 9660
+        case 0x15013346: // UDF
+            capabilities.readOnly = true;
+            capabilities.canTrash = false;
+            break;
+        default:
+            break;
+        }
+    }
+#endif
+    return capabilities;
+}
+
+// static
+FileSystemCapabilities FileSystemCapabilities::queryGio(const FilePath& path, GCancellable* cancellable) {
+    FileSystemCapabilities capabilities;
+    GFileInfoPtr inf{g_file_query_filesystem_info(path.gfile().get(),
+                                                  G_FILE_ATTRIBUTE_FILESYSTEM_READONLY ","
+                                                  G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE ","
+                                                  G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW,
+                                                  cancellable, nullptr), false};
+    if(!inf) {
+        return capabilities;
+    }
+    capabilities.isKnown = true;
+    capabilities.readOnly = g_file_info_get_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
+    bool remote = g_file_info_get_attribute_boolean(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+    if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW)) {
+        switch(g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW)) {
+        case G_FILESYSTEM_PREVIEW_TYPE_NEVER:
+            capabilities.canThumbnail = false;
+            break;
+        case G_FILESYSTEM_PREVIEW_TYPE_IF_LOCAL:
+            capabilities.canThumbnail = !remote;
+            break;
+        default:
+            break;
+        }
+    }
+    // the gvfs backends don't support trash:// except for the trash itself, and
+    // can't make symlinks to local paths (see FileTransferJob::linkFile())
+    capabilities.canTrash = false;
+    capabilities.supportsSymlinks = false;
+    return capabilities;
+}
+
+} // namespace Fm
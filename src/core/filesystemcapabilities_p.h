@@ -0,0 +1,49 @@
+#ifndef FM2_FILESYSTEMCAPABILITIES_P_H
+#define FM2_FILESYSTEMCAPABILITIES_P_H
+
+#include <gio/gio.h>
+#include "filepath.h"
+
+namespace Fm {
+
+// What a filesystem can do, which is the same for all the files on it.
+// The capabilities are queried once per filesystem id (see FileInfo::filesystemId()) and shared by
+// all the threads, so the files don't need the expensive filesystem::* attributes of gio.
+class FileSystemCapabilities {
+public:
+    FileSystemCapabilities():
+        isKnown{false},
+        readOnly{false},
+        canThumbnail{true},
+        canTrash{true},
+        caseSensitive{true},
+        supportsSymlinks{true} {
+    }
+
+    // The cached capabilities of the filesystem. isKnown is false if it's not queried yet,
+    // and the other fields have the defaults assumed by gio.
+    static FileSystemCapabilities cached(const char* filesystemId);
+
+    // The capabilities of the filesystem with the id, which contains the path.
+    // The filesystem is queried if it's not known yet, which might block for a remote one.
+    static FileSystemCapabilities query(const char* filesystemId, const FilePath& path, GCancellable* cancellable = nullptr);
+
+    // forget the capabilities of the filesystems, e.g. when they're remounted
+    static void clear();
+
+    bool isKnown;
+    bool readOnly;
+    bool canThumbnail; // the previews of the files are wanted (filesystem::use-preview)
+    bool canTrash;
+    bool caseSensitive;
+    bool supportsSymlinks;
+
+private:
+    static FileSystemCapabilities queryNative(const char* localPath);
+
+    static FileSystemCapabilities queryGio(const FilePath& path, GCancellable* cancellable);
+};
+
+} // namespace Fm
+
+#endif // FM2_FILESYSTEMCAPABILITIES_P_H
@@ -0,0 +1,157 @@
+#include "filesysteminfocache.h"
+#include "filesysteminfojob.h"
+#include <QTimer>
+
+namespace Fm {
+
+// the minimal interval between the queries of the same filesystem, in ms
+static const qint64 minRefreshInterval = 1000;
+// the paths whose filesystems are known
+static const size_t maxCachedPaths = 4096;
+
+std::mutex FileSystemInfoCache::mutex_;
+std::weak_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance_;
+
+FileSystemInfoCache::FileSystemInfoCache(): QObject() {
+}
+
+FileSystemInfoCache::~FileSystemInfoCache() {
+    for(auto& item : entries_) {
+        if(item.second.job) {
+            item.second.job->cancel();
+        }
+    }
+    for(auto& item : pathJobs_) {
+        item.second->cancel();
+    }
+}
+
+// static
+std::shared_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto cache = globalInstance_.lock();
+    if(!cache) {
+        cache = std::make_shared<FileSystemInfoCache>();
+        globalInstance_ = cache;
+    }
+    return cache;
+}
+
+bool FileSystemInfoCache::info(const FilePath& path, uint64_t* totalSize, uint64_t* freeSize) const {
+    auto idIt = pathIds_.find(path);
+    if(idIt == pathIds_.end()) {
+        return false;
+    }
+    auto it = entries_.find(idIt->second);
+    if(it == entries_.end() || !it->second.isAvailable) {
+        return false;
+    }
+    *totalSize = it->second.totalSize;
+    *freeSize = it->second.freeSize;
+    return true;
+}
+
+std::string FileSystemInfoCache::filesystemId(const FilePath& path) const {
+    auto idIt = pathIds_.find(path);
+    return idIt != pathIds_.end() ? idIt->second : std::string{};
+}
+
+void FileSystemInfoCache::refresh(const FilePath& path) {
+    auto idIt = pathIds_.find(path);
+    if(idIt == pathIds_.end()) {
+        // find out the filesystem of the path first
+        if(pathJobs_.find(path) == pathJobs_.end()) {
+            startJob(path, nullptr);
+        }
+        return;
+    }
+    auto& entry = entries_[idIt->second];
+    entry.path = path;
+    scheduleRefresh(idIt->second, entry);
+}
+
+void FileSystemInfoCache::scheduleRefresh(const std::string& id, Entry& entry) {
+    if(entry.refreshPending) { // queried later already
+        return;
+    }
+    if(entry.job) {
+        // query again after the running job is finished
+        entry.refreshPending = true;
+        return;
+    }
+    qint64 elapsed = entry.lastQueryTime.isValid() ? entry.lastQueryTime.elapsed() : minRefreshInterval;
+    if(elapsed < minRefreshInterval) {
+        entry.refreshPending = true;
+        QTimer::singleShot(minRefreshInterval - elapsed, this, [this, id]() {
+            auto it = entries_.find(id);
+            if(it != entries_.end() && it->second.refreshPending && !it->second.job) {
+                it->second.refreshPending = false;
+                startJob(it->second.path, &it->second);
+            }
+        });
+        return;
+    }
+    startJob(entry.path, &entry);
+}
+
+void FileSystemInfoCache::startJob(const FilePath& path, Entry* entry) {
+    auto job = new FileSystemInfoJob{path};
+    job->setAutoDelete(true);
+    connect(job, &FileSystemInfoJob::finished, this, &FileSystemInfoCache::onJobFinished, Qt::QueuedConnection);
+    if(entry) {
+        entry->job = job;
+        entry->lastQueryTime.start();
+    }
+    else {
+        pathJobs_[path] = job;
+    }
+    job->runAsync();
+}
+
+void FileSystemInfoCache::onJobFinished() {
+    auto job = static_cast<FileSystemInfoJob*>(sender());
+    // the entry which started the job
+    std::string jobId;
+    Entry* jobEntry = nullptr;
+    for(auto& item : entries_) {
+        if(item.second.job == job) {
+            jobId = item.first;
+            jobEntry = &item.second;
+            jobEntry->job = nullptr;
+            break;
+        }
+    }
+    auto pathJob = pathJobs_.find(job->path());
+    if(pathJob != pathJobs_.end() && pathJob->second == job) {
+        pathJobs_.erase(pathJob);
+    }
+    if(job->isCancelled()) {
+        return;
+    }
+
+    // the filesystem of the path might be changed by mounting, so it's updated each time
+    std::string id = job->filesystemId();
+    if(id.empty()) { // only share the info of the same path then
+        id = job->path().uri().get();
+    }
+    if(pathIds_.size() >= maxCachedPaths) {
+        pathIds_.clear();
+    }
+    pathIds_[job->path()] = id;
+    auto& entry = entries_[id];
+    if(!entry.path) {
+        entry.path = job->path();
+        entry.lastQueryTime.start();
+    }
+    entry.isAvailable = job->isAvailable();
+    entry.totalSize = job->size();
+    entry.freeSize = job->freeSize();
+
+    if(jobEntry && jobEntry->refreshPending) {
+        jobEntry->refreshPending = false;
+        scheduleRefresh(jobId, *jobEntry);
+    }
+    Q_EMIT changed(id);
+}
+
+} // namespace Fm
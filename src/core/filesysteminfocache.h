@@ -0,0 +1,75 @@
+#ifndef FM2_FILESYSTEMINFOCACHE_H
+#define FM2_FILESYSTEMINFOCACHE_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QElapsedTimer>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "filepath.h"
+
+namespace Fm {
+
+class FileSystemInfoJob;
+
+// The sizes and free spaces of the filesystems, which are shared by all the folders and views.
+// The info of each filesystem is queried by one job at a time, and it's refreshed at most once
+// in a while however many folders on the filesystem are changed.
+class LIBFM_QT_API FileSystemInfoCache : public QObject {
+    Q_OBJECT
+public:
+    explicit FileSystemInfoCache();
+
+    ~FileSystemInfoCache();
+
+    static std::shared_ptr<FileSystemInfoCache> globalInstance();
+
+    // the cached info of the filesystem containing the path, false if it's not known yet
+    bool info(const FilePath& path, uint64_t* totalSize, uint64_t* freeSize) const;
+
+    // the id of the filesystem containing the path, empty if it's not known yet
+    std::string filesystemId(const FilePath& path) const;
+
+    // Query the info of the filesystem containing the path again. changed() is emitted
+    // when the info is got.
+    void refresh(const FilePath& path);
+
+Q_SIGNALS:
+    void changed(const std::string& filesystemId);
+
+private:
+    struct Entry {
+        Entry(): isAvailable{false}, totalSize{0}, freeSize{0}, job{nullptr}, refreshPending{false} {
+        }
+
+        FilePath path; // the last refreshed path on the filesystem, which is queried
+        bool isAvailable;
+        uint64_t totalSize;
+        uint64_t freeSize;
+        FileSystemInfoJob* job;
+        bool refreshPending; // refreshed while the job is running or too soon
+        QElapsedTimer lastQueryTime;
+    };
+
+    // entry is nullptr if the filesystem of the path is not known yet
+    void startJob(const FilePath& path, Entry* entry);
+
+    void scheduleRefresh(const std::string& id, Entry& entry);
+
+    void onJobFinished();
+
+private:
+    std::unordered_map<FilePath, std::string, FilePathHash> pathIds_;
+    std::unordered_map<std::string, Entry> entries_;
+    // the jobs for the paths whose filesystems are not known yet
+    std::unordered_map<FilePath, FileSystemInfoJob*, FilePathHash> pathJobs_;
+
+    static std::mutex mutex_;
+    static std::weak_ptr<FileSystemInfoCache> globalInstance_;
+};
+
+} // namespace Fm
+
+#endif // FM2_FILESYSTEMINFOCACHE_H
@@ -4,6 +4,17 @@
 namespace Fm {
 
 void FileSystemInfoJob::exec() {
+    GObjectPtr<GFileInfo> idInfo{
+            g_file_query_info(path_.gfile().get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                              G_FILE_QUERY_INFO_NONE, cancellable().get(), nullptr),
+            false
+    };
+    if(idInfo) {
+        auto id = g_file_info_get_attribute_string(idInfo.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+        if(id) {
+            filesystemId_ = id;
+        }
+    }
     GObjectPtr<GFileInfo> inf = GObjectPtr<GFileInfo>{
             g_file_query_filesystem_info(
                 path_.gfile().get(),
@@ -4,6 +4,7 @@
 #include "../libfmqtglobals.h"
 #include "job.h"
 #include "filepath.h"
+#include <string>
 
 namespace Fm {
 
@@ -29,6 +30,15 @@ public:
         return freeSize_;
     }
 
+    const FilePath& path() const {
+        return path_;
+    }
+
+    // the id of the filesystem containing the path, empty if it's unknown
+    const std::string& filesystemId() const {
+        return filesystemId_;
+    }
+
 protected:
 
     void exec() override;
@@ -38,6 +48,7 @@ private:
     bool isAvailable_;
     uint64_t size_;
     uint64_t freeSize_;
+    std::string filesystemId_;
 };
 
 } // namespace Fm
@@ -1,13 +1,411 @@
 #include "filetransferjob.h"
 #include "totalsizejob.h"
+#include "transferscheduler.h"
+#include "jobtrace_p.h"
 #include "fileinfo_p.h"
+#include "filesystemcapabilities_p.h"
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <QFile>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gio/gfiledescriptorbased.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
 
 namespace Fm {
 
+// the progress of the current file copied by gio is updated after this number of bytes
+static const goffset progressReportInterval = 1024 * 1024;
+
+// size of the buffers used to verify the copies if setStreamBufferSize() is not called
+static const size_t defaultVerifyBufferSize = 1024 * 1024;
+
+static bool isZeroFilled(const char* data, size_t len) {
+    return len > 0 && data[0] == 0 && memcmp(data, data + 1, len - 1) == 0;
+}
+
+// Create a new hidden file ".name.XXXXXX" in the dir of destPath, like mkstemp() does for the native
+// copies, so an existing file can be replaced with the copy once it's complete.
+static GFileOutputStreamPtr createHiddenTempFile(const FilePath& destPath, FilePath& tmpPath, GCancellable* cancellable, GErrorPtr& err) {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    auto dirPath = destPath.parent();
+    auto baseName = destPath.baseName();
+    if(!dirPath || !baseName) {
+        return GFileOutputStreamPtr{};
+    }
+    for(int attempt = 0; attempt < 100; ++attempt) {
+        std::string name = std::string{"."} + baseName.get() + '.';
+        for(int i = 0; i < 6; ++i) {
+            name += chars[g_random_int_range(0, sizeof(chars) - 1)];
+        }
+        tmpPath = dirPath.child(name.c_str());
+        err.reset();
+        GFileOutputStreamPtr out{g_file_create(tmpPath.gfile().get(), G_FILE_CREATE_PRIVATE, cancellable, &err), false};
+        if(out || !err || err->domain != G_IO_ERROR || err->code != G_IO_ERROR_EXISTS) {
+            return out;
+        }
+    }
+    return GFileOutputStreamPtr{};
+}
+
+// Incremental XXH64 hash of a stream. It's only used to compare the data of a file with its copy,
+// and is fast enough to keep up with the disks on the reader thread of the streaming copy.
+class StreamHash {
+public:
+    StreamHash(): v1_{prime1 + prime2}, v2_{prime2}, v3_{0}, v4_{0 - prime1}, total_{0}, pendingLen_{0} {
+    }
+
+    void update(const char* data, size_t len) {
+        total_ += len;
+        if(pendingLen_ + len < 32) {
+            memcpy(pending_ + pendingLen_, data, len);
+            pendingLen_ += len;
+            return;
+        }
+        if(pendingLen_ > 0) {
+            size_t fill = 32 - pendingLen_;
+            memcpy(pending_ + pendingLen_, data, fill);
+            consume(pending_);
+            data += fill;
+            len -= fill;
+            pendingLen_ = 0;
+        }
+        for(; len >= 32; data += 32, len -= 32) {
+            consume(data);
+        }
+        memcpy(pending_, data, len);
+        pendingLen_ = len;
+    }
+
+    std::uint64_t digest() const {
+        std::uint64_t h;
+        if(total_ >= 32) {
+            h = rotl(v1_, 1) + rotl(v2_, 7) + rotl(v3_, 12) + rotl(v4_, 18);
+            h = mergeRound(h, v1_);
+            h = mergeRound(h, v2_);
+            h = mergeRound(h, v3_);
+            h = mergeRound(h, v4_);
+        }
+        else {
+            h = prime5;
+        }
+        h += total_;
+        const char* p = pending_;
+        size_t len = pendingLen_;
+        for(; len >= 8; p += 8, len -= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if(len >= 4) {
+            h ^= std::uint64_t(read32(p)) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+            len -= 4;
+        }
+        for(; len > 0; ++p, --len) {
+            h ^= std::uint64_t(static_cast<unsigned char>(*p)) * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr std::uint64_t prime1 = 11400714785074694791ULL;
+    static constexpr std::uint64_t prime2 = 14029467366897019727ULL;
+    static constexpr std::uint64_t prime3 = 1609587929392839161ULL;
+    static constexpr std::uint64_t prime4 = 9650029242287828579ULL;
+    static constexpr std::uint64_t prime5 = 2870177450012600261ULL;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static std::uint64_t read64(const char* p) {
+        std::uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint32_t read32(const char* p) {
+        std::uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+        acc += input * prime2;
+        return rotl(acc, 31) * prime1;
+    }
+
+    static std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val) {
+        acc ^= round(0, val);
+        return acc * prime1 + prime4;
+    }
+
+    void consume(const char* p) {
+        v1_ = round(v1_, read64(p));
+        v2_ = round(v2_, read64(p + 8));
+        v3_ = round(v3_, read64(p + 16));
+        v4_ = round(v4_, read64(p + 24));
+    }
+
+    std::uint64_t v1_, v2_, v3_, v4_;
+    std::uint64_t total_;
+    char pending_[32];
+    size_t pendingLen_;
+};
+
+// the files of a directory which are copied by the workers, so we can wait for all of them before leaving it
+struct FileTransferGroup {
+    FileTransferGroup(): pending{0}, failed{false} {
+    }
+
+    int pending;
+    bool failed;
+};
+
+// A fixed number of threads copying the regular files of a FileTransferJob in parallel.
+class FileTransferWorkers {
+public:
+    explicit FileTransferWorkers(int count): stopped_{false} {
+        for(int i = 0; i < count; ++i) {
+            threads_.emplace_back(&FileTransferWorkers::run, this);
+        }
+    }
+
+    ~FileTransferWorkers() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopped_ = true;
+        }
+        taskAdded_.notify_all();
+        for(auto& thread: threads_) {
+            thread.join();
+        }
+    }
+
+    // func() returns false if the file is not copied
+    void submit(FileTransferGroup& group, std::function<bool ()> func) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        // don't enumerate the whole tree ahead of the workers
+        taskDone_.wait(lock, [this]() {
+            return tasks_.size() < threads_.size() * 4;
+        });
+        ++group.pending;
+        tasks_.emplace_back(&group, std::move(func));
+        taskAdded_.notify_one();
+    }
+
+    // returns false if any file of the group is not copied
+    bool wait(FileTransferGroup& group) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        taskDone_.wait(lock, [&group]() {
+            return group.pending == 0;
+        });
+        return !group.failed;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        for(;;) {
+            taskAdded_.wait(lock, [this]() {
+                return stopped_ || !tasks_.empty();
+            });
+            if(tasks_.empty()) { // stopped
+                break;
+            }
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            bool success = task.second();
+            lock.lock();
+            if(!success) {
+                task.first->failed = true;
+            }
+            --task.first->pending;
+            taskDone_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable taskAdded_;
+    std::condition_variable taskDone_;
+    std::deque<std::pair<FileTransferGroup*, std::function<bool ()>>> tasks_;
+    std::vector<std::thread> threads_;
+    bool stopped_;
+};
+
+// The log of a FileTransferJob, which has one line for each copied file and each answer to the
+// prompts. The fields are separated by tabs and the paths are stored as URIs, so they contain no
+// tabs or line breaks:
+//   C <src> <dest> <size> <mtime>
+//   A <src> <FileExistsAction> <new dest or empty>
+class FileTransferJournal {
+public:
+    explicit FileTransferJournal(const QString& path): path_{QFile::encodeName(path).toStdString()} {
+        // load the entries of the previous runs
+        file_ = fopen(path_.c_str(), "re");
+        if(file_) {
+            QByteArray line;
+            char buf[4096];
+            while(fgets(buf, sizeof(buf), file_)) {
+                line += buf;
+                if(!line.endsWith('\n')) {
+                    continue; // a long line, or the last one which is cut by a crash
+                }
+                line.chop(1);
+                auto fields = line.split('\t');
+                if(fields.size() == 5 && fields[0] == "C") {
+                    copied_[fields[1].toStdString()] = Copied{fields[2].toStdString(), fields[3].toULongLong(), fields[4].toULongLong()};
+                }
+                else if(fields.size() == 4 && fields[0] == "A") {
+                    answers_[fields[1].toStdString()] = Answer{fields[2].toInt(), fields[3].toStdString()};
+                }
+                line.clear();
+            }
+            fclose(file_);
+        }
+        file_ = fopen(path_.c_str(), "ae");
+        if(!file_) {
+            qWarning("cannot open the journal %s", path_.c_str());
+        }
+    }
+
+    ~FileTransferJournal() {
+        if(file_) {
+            fclose(file_);
+        }
+    }
+
+    // true if the file is copied to destPath by a previous run and neither the file nor the copy is changed since then
+    bool isCopied(const FilePath& srcPath, const FilePath& destPath, GCancellable* cancellable) {
+        Copied copied;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = copied_.find(srcPath.uri().get());
+            if(it == copied_.end()) {
+                return false;
+            }
+            copied = it->second;
+        }
+        if(copied.destUri != destPath.uri().get()) {
+            return false; // copied somewhere else, e.g. renamed by an answer which is not given this time
+        }
+        std::uint64_t size, mtime;
+        return querySizeAndMtime(srcPath, cancellable, size, mtime) && size == copied.size && mtime == copied.mtime
+               && querySizeAndMtime(destPath, cancellable, size, mtime)
+               && size == copied.size && mtime == copied.mtime;
+    }
+
+    void addCopied(const FilePath& srcPath, const FilePath& destPath, GCancellable* cancellable) {
+        // all the metadata is copied, so the mtime of the copy is the same as the source
+        std::uint64_t size, mtime;
+        if(file_ && querySizeAndMtime(destPath, cancellable, size, mtime)) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            fprintf(file_, "C\t%s\t%s\t%llu\t%llu\n", srcPath.uri().get(), destPath.uri().get(),
+                    (unsigned long long)size, (unsigned long long)mtime);
+            fflush(file_);
+        }
+    }
+
+    bool findAnswer(const FilePath& srcPath, int& action, FilePath& newDest) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = answers_.find(srcPath.uri().get());
+        if(it == answers_.end()) {
+            return false;
+        }
+        action = it->second.action;
+        newDest = it->second.newDestUri.empty() ? FilePath{} : FilePath::fromUri(it->second.newDestUri.c_str());
+        return true;
+    }
+
+    void addAnswer(const FilePath& srcPath, int action, const FilePath& newDest) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(file_) {
+            fprintf(file_, "A\t%s\t%d\t%s\n", srcPath.uri().get(), action, newDest.isValid() ? newDest.uri().get() : "");
+            fflush(file_);
+        }
+    }
+
+    void remove() {
+        if(file_) {
+            fclose(file_);
+            file_ = nullptr;
+        }
+        unlink(path_.c_str());
+    }
+
+private:
+    static bool querySizeAndMtime(const FilePath& path, GCancellable* cancellable, std::uint64_t& size, std::uint64_t& mtime) {
+        GFileInfoPtr info{
+            g_file_query_info(path.gfile().get(), G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable, nullptr),
+            false
+        };
+        if(!info) {
+            return false;
+        }
+        size = g_file_info_get_size(info.get());
+        mtime = g_file_info_get_attribute_uint64(info.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        return true;
+    }
+
+    struct Copied {
+        std::string destUri;
+        std::uint64_t size;
+        std::uint64_t mtime;
+    };
+
+    struct Answer {
+        int action;
+        std::string newDestUri;
+    };
+
+    std::string path_;
+    FILE* file_;
+    std::mutex mutex_; // the files are copied and logged by several workers
+    std::unordered_map<std::string, Copied> copied_;
+    std::unordered_map<std::string, Answer> answers_;
+};
+
 FileTransferJob::FileTransferJob(FilePathList srcPaths, Mode mode):
     FileOperationJob{},
     srcPaths_{std::move(srcPaths)},
-    mode_{mode} {
+    mode_{mode},
+    workerCount_{1},
+    streamBufferSize_{0},
+    verifyCopies_{false},
+    lastReportedProgress_{0},
+    overlapSizeScan_{false},
+    scanJob_{nullptr},
+    scanFinished_{false},
+    filesSinceTotalsUpdate_{0},
+    workers_{nullptr},
+    currentGroup_{nullptr},
+    journal_{nullptr},
+    scheduled_{false},
+    devicesReleased_{false} {
 }
 
 FileTransferJob::FileTransferJob(FilePathList srcPaths, FilePathList destPaths, Mode mode):
@@ -69,11 +467,58 @@ void FileTransferJob::setDestDirPath(const FilePath& destDirPath) {
     }
 }
 
+void FileTransferJob::setWorkerCount(int count) {
+    workerCount_ = std::max(count, 1);
+}
+
+GFileInfoPtr FileTransferJob::fullFileInfo(const FilePath& path, const GFileInfoPtr& info) {
+    // the infos from TotalSizeJob::Entry only have the basic attributes
+    if(g_file_info_has_attribute(info.get(), G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+        return info;
+    }
+    GFileInfoPtr fullInfo{
+        g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs,
+                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable().get(), nullptr),
+        false
+    };
+    return fullInfo ? fullInfo : info;
+}
+
+FileOperationJob::FileExistsAction FileTransferJob::askRenameSerialized(const FileInfo& src, const FileInfo& dest, FilePath& newDest) {
+    FileExistsAction policy;
+    if(fileExistsAction(policy)) {
+        // the workers don't wait for each other when the same answer is used for all the files
+        return policy;
+    }
+    std::lock_guard<std::mutex> lock{promptMutex_};
+    int action;
+    if(journal_ && journal_->findAnswer(src.path(), action, newDest)) {
+        // answered in the previous run
+        return FileExistsAction(action);
+    }
+    auto ret = askRename(src, dest, newDest);
+    if(journal_ && ret != CANCEL) {
+        journal_->addAnswer(src.path(), ret, newDest);
+    }
+    return ret;
+}
+
+Job::ErrorAction FileTransferJob::emitErrorSerialized(const GErrorPtr& err, ErrorSeverity severity) {
+    std::lock_guard<std::mutex> lock{promptMutex_};
+    return emitError(err, severity);
+}
+
 void FileTransferJob::gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, FileTransferJob* _this) {
-    _this->setCurrentFileProgress(total_num_bytes, current_num_bytes);
+    // gio calls this for every chunk it copies, while the UI only polls the progress a few times per second
+    if(current_num_bytes == total_num_bytes || current_num_bytes - _this->lastReportedProgress_ >= progressReportInterval) {
+        _this->throttle(current_num_bytes - _this->lastReportedProgress_);
+        _this->setCurrentFileProgress(total_num_bytes, current_num_bytes);
+        _this->lastReportedProgress_ = current_num_bytes;
+    }
 }
 
 bool FileTransferJob::moveFileSameFs(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath) {
+    TraceSpan span{"FileTransferJob::moveFileSameFs"};
     int flags = G_FILE_COPY_ALL_METADATA | G_FILE_COPY_NOFOLLOW_SYMLINKS;
     GErrorPtr err;
     bool retry;
@@ -93,6 +538,12 @@ bool FileTransferJob::moveFileSameFs(const FilePath& srcPath, const GFileInfoPtr
 }
 
 bool FileTransferJob::copyRegularFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath) {
+    if(journal_ && journal_->isCopied(srcPath, destPath, cancellable().get())) {
+        return true; // copied by the previous run
+    }
+    TraceSpan span{"FileTransferJob::copyRegularFile"};
+    span.addCount(g_file_info_get_size(srcInfo.get())); // in bytes
+    throttle();
     int flags = G_FILE_COPY_ALL_METADATA | G_FILE_COPY_NOFOLLOW_SYMLINKS;
     GErrorPtr err;
     bool retry;
@@ -101,21 +552,421 @@ bool FileTransferJob::copyRegularFile(const FilePath& srcPath, const GFileInfoPt
         err.reset();
 
         // reset progress of the current file (only for copy)
-        auto size = g_file_info_get_size(srcInfo.get());
-        setCurrentFileProgress(size, 0);
+        // the workers copy several files at the same time, so they don't report it
+        if(!workers_) {
+            auto size = g_file_info_get_size(srcInfo.get());
+            setCurrentFileProgress(size, 0);
+            lastReportedProgress_ = 0;
+        }
 
         // do the file operation
-        if(!g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(),
-                       (GFileProgressCallback)&gfileCopyProgressCallback, this, &err)) {
+        bool copied = false;
+        bool isRegular = (g_file_info_get_file_type(srcInfo.get()) == G_FILE_TYPE_REGULAR);
+        bool streaming = isRegular && (streamBufferSize_ > 0 || verifyCopies_);
+        if(streaming) {
+            copied = copyStreaming(srcPath, srcInfo, destPath, flags, err);
+        }
+        else if(isRegular && srcPath.isNative() && destPath.isNative()) {
+            // let the kernel copy the data if possible (falls back to gio if err is not set)
+            copied = copyNativeFile(srcPath, destPath, flags, err);
+        }
+        if(!copied && !err && !streaming) {
+            copied = g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(),
+                                 workers_ ? nullptr : (GFileProgressCallback)&gfileCopyProgressCallback, this, &err);
+            if(copied && workers_) { // no progress is reported by the workers
+                throttle(g_file_info_get_size(srcInfo.get()));
+            }
+        }
+        if(!copied) {
             retry = handleError(err, srcPath, srcInfo, destPath, flags);
         }
         else {
+            if(journal_) {
+                journal_->addCopied(srcPath, destPath, cancellable().get());
+            }
             return true;
         }
     } while(retry && !isCancelled());
     return false;
 }
 
+bool FileTransferJob::copyNativeFile(const FilePath& srcPath, const FilePath& destPath, int flags, GErrorPtr& err) {
+#ifdef __linux__
+    auto src = srcPath.localPath();
+    auto dest = destPath.localPath();
+    int srcFd = open(src.get(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if(srcFd < 0) {
+        return false; // let gio handle and report it
+    }
+    struct stat srcStat;
+    if(fstat(srcFd, &srcStat) != 0 || !S_ISREG(srcStat.st_mode)) {
+        close(srcFd);
+        return false;
+    }
+
+    // An existing file is only replaced when the copy is complete, so it's kept if the copy fails or
+    // is cancelled. The data is written to a temporary file in the same dir, which is renamed to it.
+    std::string tmpPath;
+    int destFd;
+    if(flags & G_FILE_COPY_OVERWRITE) {
+        CStrPtr dirName{g_path_get_dirname(dest.get())};
+        CStrPtr baseName{g_path_get_basename(dest.get())};
+        CStrPtr tmpName{g_strconcat(".", baseName.get(), ".XXXXXX", nullptr)};
+        CStrPtr tmpTemplate{g_build_filename(dirName.get(), tmpName.get(), nullptr)};
+        destFd = mkostemp(tmpTemplate.get(), O_CLOEXEC);
+        if(destFd >= 0) {
+            tmpPath = tmpTemplate.get();
+            fchmod(destFd, (srcStat.st_mode & 0777) | S_IWUSR);
+        }
+    }
+    else {
+        destFd = open(dest.get(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, (srcStat.st_mode & 0777) | S_IWUSR);
+    }
+    const char* writtenPath = tmpPath.empty() ? dest.get() : tmpPath.c_str();
+    if(destFd < 0) {
+        int errsv = errno;
+        close(srcFd);
+        if(errsv == EEXIST) {
+            // handleError() asks the user what to do with the existing file
+            err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_EXISTS, g_strerror(errsv)};
+            return false;
+        }
+        return false; // let gio handle and report it
+    }
+
+    bool done = false;
+    bool fallback = false;
+    int errsv = 0;
+#ifdef FICLONE
+    // share the extents with the source file on CoW filesystems, such as btrfs and XFS
+    done = (ioctl(destFd, FICLONE, srcFd) == 0);
+#endif
+    if(!done) {
+        const off_t total = srcStat.st_size;
+        // Only the data segments of sparse files are copied and the holes are kept, so a mostly
+        // empty VM image doesn't become fully allocated. SEEK_DATA and SEEK_HOLE list the segments.
+        bool sparse = off_t(srcStat.st_blocks) * 512 < total;
+        off_t pos = 0;
+        off_t segmentEnd = sparse ? 0 : total; // end of the data segment being copied
+        bool copiedAny = false;
+        bool useCopyFileRange = true;
+        while(pos < total && !isCancelled()) {
+            if(pos == segmentEnd) {
+                // find the next data segment
+                off_t dataPos = lseek(srcFd, pos, SEEK_DATA);
+                if(dataPos < 0) {
+                    if(errno == ENXIO) { // only a hole is left
+                        pos = total;
+                        break;
+                    }
+                    segmentEnd = total; // SEEK_DATA is not supported, copy the rest as is
+                    continue;
+                }
+                off_t holePos = lseek(srcFd, dataPos, SEEK_HOLE);
+                pos = std::min(dataPos, total);
+                segmentEnd = holePos > dataPos ? std::min(holePos, total) : total;
+                continue;
+            }
+            size_t chunk = std::min(off_t(8 * 1024 * 1024), segmentEnd - pos);
+            ssize_t len;
+#ifdef __NR_copy_file_range
+            if(useCopyFileRange) {
+                loff_t inOff = pos, outOff = pos;
+                len = syscall(__NR_copy_file_range, srcFd, &inOff, destFd, &outOff, chunk, 0);
+                if(len < 0 && !copiedAny && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    useCopyFileRange = false;
+                    continue;
+                }
+            }
+            else
+#endif
+            {
+                off_t inOff = pos;
+                len = (lseek(destFd, pos, SEEK_SET) == pos) ? sendfile(destFd, srcFd, &inOff, chunk) : -1;
+                if(len < 0 && !copiedAny && (errno == ENOSYS || errno == EINVAL)) {
+                    fallback = true;
+                    break;
+                }
+            }
+            if(len < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                errsv = errno;
+                break;
+            }
+            if(len == 0) { // the file is truncated while we're copying it
+                break;
+            }
+            pos += len;
+            copiedAny = true;
+            throttle(len);
+            if(!workers_) {
+                setCurrentFileProgress(total, pos);
+            }
+        }
+        // the file ends with a hole which is not written
+        if(!fallback && errsv == 0 && sparse && pos == total && ftruncate(destFd, total) != 0) {
+            errsv = errno;
+        }
+        done = !fallback && errsv == 0 && !isCancelled();
+    }
+    close(srcFd);
+    if(close(destFd) != 0 && done) {
+        errsv = errno;
+        done = false;
+    }
+    if(done && !tmpPath.empty() && rename(tmpPath.c_str(), dest.get()) != 0) {
+        errsv = errno;
+        done = false;
+    }
+
+    if(!done) {
+        // remove the partial content, and gio will create the file again if we fall back to it
+        unlink(writtenPath);
+        if(isCancelled()) {
+            err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_CANCELLED, g_strerror(ECANCELED)};
+        }
+        else if(errsv != 0) {
+            err = GErrorPtr{G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv)};
+        }
+        return false;
+    }
+
+    // copy the permissions, timestamps, and other metadata like g_file_copy() does.
+    g_file_copy_attributes(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(), nullptr);
+    return true;
+#else
+    Q_UNUSED(srcPath);
+    Q_UNUSED(destPath);
+    Q_UNUSED(flags);
+    Q_UNUSED(err);
+    return false;
+#endif
+}
+
+bool FileTransferJob::copyStreaming(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destPath, int flags, GErrorPtr& err) {
+    GFileInputStreamPtr in{g_file_read(srcPath.gfile().get(), cancellable().get(), &err), false};
+    if(!in) {
+        return false;
+    }
+    // An existing file is only replaced when the copy is complete and verified, so it's kept if the copy
+    // fails or is cancelled. The data is written to a hidden file in the same dir, which is moved to it.
+    // If the backend can't create that file, the stream of g_file_replace() is used, which only replaces
+    // the file when it's closed successfully, and it's aborted otherwise.
+    FilePath writtenPath = destPath;
+    bool replacing = false;
+    GFileOutputStreamPtr out;
+    if(flags & G_FILE_COPY_OVERWRITE) {
+        FilePath tmpPath;
+        out = createHiddenTempFile(destPath, tmpPath, cancellable().get(), err);
+        if(out) {
+            writtenPath = tmpPath;
+        }
+        else if(!isCancelled()) {
+            err.reset();
+            out = GFileOutputStreamPtr{g_file_replace(destPath.gfile().get(), nullptr, false, G_FILE_CREATE_REPLACE_DESTINATION,
+                                                      cancellable().get(), &err), false};
+            replacing = true;
+        }
+    }
+    else {
+        out = GFileOutputStreamPtr{g_file_create(destPath.gfile().get(), G_FILE_CREATE_NONE, cancellable().get(), &err), false};
+    }
+    if(!out) {
+        return false; // an existing file is handled by handleError()
+    }
+    // the zero-filled buffers of sparse files are skipped instead of written, so the holes are kept
+    bool keepHoles = false;
+    if(G_IS_FILE_DESCRIPTOR_BASED(in.get())) {
+        int fd = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(in.get()));
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        struct stat st;
+        keepHoles = fstat(fd, &st) == 0 && off_t(st.st_blocks) * 512 < st.st_size
+                    && G_IS_SEEKABLE(out.get()) && g_seekable_can_truncate(G_SEEKABLE(out.get()));
+    }
+
+    // The reader thread fills one buffer while this thread writes the other one.
+    // A buffer with len == 0 marks the end of the file, and len < 0 an error.
+    struct Buffer {
+        std::unique_ptr<char[]> data;
+        gssize len;
+    };
+    size_t bufferSize = streamBufferSize_ > 0 ? streamBufferSize_ : defaultVerifyBufferSize;
+    Buffer buffers[2];
+    for(auto& buffer: buffers) {
+        buffer.data = std::unique_ptr<char[]>{new char[bufferSize]};
+        buffer.len = 0;
+    }
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Buffer*> freeBuffers{&buffers[0], &buffers[1]};
+    std::deque<Buffer*> filledBuffers;
+    bool stopped = false; // the writer gave up
+    GErrorPtr readError;
+    StreamHash srcHash; // updated by the reader, so hashing is overlapped with writing
+
+    std::thread reader{[&]() {
+        for(;;) {
+            throttle(); // only the writer counts the bandwidth
+            Buffer* buffer;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                cond.wait(lock, [&]() {
+                    return stopped || !freeBuffers.empty();
+                });
+                if(stopped) {
+                    break;
+                }
+                buffer = freeBuffers.front();
+                freeBuffers.pop_front();
+            }
+            gsize len = 0;
+            bool ok = g_input_stream_read_all(G_INPUT_STREAM(in.get()), buffer->data.get(), bufferSize,
+                                              &len, cancellable().get(), &readError);
+            buffer->len = ok ? gssize(len) : -1;
+            if(ok && verifyCopies_) {
+                srcHash.update(buffer->data.get(), len);
+            }
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                filledBuffers.push_back(buffer);
+            }
+            cond.notify_all();
+            if(buffer->len <= 0) {
+                break;
+            }
+        }
+    }};
+
+    auto totalSize = g_file_info_get_size(srcInfo.get());
+    uint64_t written = 0;
+    bool endsWithHole = false;
+    bool success = false;
+    for(;;) {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            cond.wait(lock, [&]() {
+                return !filledBuffers.empty();
+            });
+            buffer = filledBuffers.front();
+            filledBuffers.pop_front();
+        }
+        if(buffer->len < 0) { // read error
+            break;
+        }
+        if(buffer->len == 0) { // end of file
+            success = true;
+            break;
+        }
+        endsWithHole = keepHoles && isZeroFilled(buffer->data.get(), buffer->len);
+        if(endsWithHole) {
+            if(!g_seekable_seek(G_SEEKABLE(out.get()), buffer->len, G_SEEK_CUR, cancellable().get(), &err)) {
+                break;
+            }
+        }
+        else if(!g_output_stream_write_all(G_OUTPUT_STREAM(out.get()), buffer->data.get(), buffer->len,
+                                           nullptr, cancellable().get(), &err)) {
+            break;
+        }
+        written += buffer->len;
+        throttle(buffer->len);
+        if(!workers_) {
+            setCurrentFileProgress(totalSize, written);
+        }
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            freeBuffers.push_back(buffer);
+        }
+        cond.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopped = true;
+    }
+    cond.notify_all();
+    reader.join();
+
+    if(!success && !err) {
+        err = std::move(readError);
+    }
+    if(success && endsWithHole) {
+        // the size is not extended by seeking past the end
+        success = g_seekable_truncate(G_SEEKABLE(out.get()), written, cancellable().get(), &err);
+    }
+    g_input_stream_close(G_INPUT_STREAM(in.get()), nullptr, nullptr);
+    if(success && verifyCopies_ && G_IS_FILE_DESCRIPTOR_BASED(out.get())) {
+        // write the data to the disk, so it's read back from there instead of the page cache
+        fdatasync(g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(out.get())));
+    }
+    if(replacing && !success) {
+        // closing the stream with a cancelled cancellable drops the new content and keeps the old file
+        GCancellablePtr abort{g_cancellable_new(), false};
+        g_cancellable_cancel(abort.get());
+        g_output_stream_close(G_OUTPUT_STREAM(out.get()), abort.get(), nullptr);
+        return false;
+    }
+    if(!g_output_stream_close(G_OUTPUT_STREAM(out.get()), cancellable().get(), success ? &err : nullptr)) {
+        success = false;
+    }
+    if(success && verifyCopies_) {
+        // the replaced file is verified after it's closed, since it can't be read before that
+        success = verifyCopy(writtenPath, srcHash.digest(), bufferSize, err);
+    }
+    if(success && writtenPath != destPath) {
+        success = g_file_move(writtenPath.gfile().get(), destPath.gfile().get(),
+                              GFileCopyFlags(G_FILE_COPY_OVERWRITE | G_FILE_COPY_NOFOLLOW_SYMLINKS),
+                              cancellable().get(), nullptr, nullptr, &err);
+    }
+    if(!success) {
+        // Remove the partial content, which is never the existing file of an overwrite. A replaced file
+        // which fails to be verified is kept, since the old content is gone once the stream is closed.
+        if(!replacing) {
+            g_file_delete(writtenPath.gfile().get(), nullptr, nullptr);
+        }
+        return false;
+    }
+    // copy the permissions, timestamps, and other metadata like g_file_copy() does.
+    g_file_copy_attributes(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(), nullptr);
+    return true;
+}
+
+bool FileTransferJob::verifyCopy(const FilePath& destPath, std::uint64_t srcHash, size_t bufferSize, GErrorPtr& err) {
+    TraceSpan span{"FileTransferJob::verifyCopy"};
+    GFileInputStreamPtr in{g_file_read(destPath.gfile().get(), cancellable().get(), &err), false};
+    if(!in) {
+        return false;
+    }
+    if(G_IS_FILE_DESCRIPTOR_BASED(in.get())) {
+        int fd = g_file_descriptor_based_get_fd(G_FILE_DESCRIPTOR_BASED(in.get()));
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // drop the cached pages written by us
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    std::unique_ptr<char[]> buffer{new char[bufferSize]};
+    StreamHash destHash;
+    bool success = true;
+    for(;;) {
+        gsize len = 0;
+        if(!g_input_stream_read_all(G_INPUT_STREAM(in.get()), buffer.get(), bufferSize, &len, cancellable().get(), &err)) {
+            success = false;
+            break;
+        }
+        if(len == 0) {
+            break;
+        }
+        destHash.update(buffer.get(), len);
+    }
+    g_input_stream_close(G_INPUT_STREAM(in.get()), nullptr, nullptr);
+    if(success && destHash.digest() != srcHash) {
+        auto dispName = destPath.displayName();
+        err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_FAILED,
+                        tr("The copy '%1' is different from the source file").arg(QString::fromUtf8(dispName.get()))};
+        success = false;
+    }
+    return success;
+}
+
 bool FileTransferJob::copySpecialFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath &destPath) {
     bool ret = false;
     // only handle FIFO for local files
@@ -140,12 +991,14 @@ bool FileTransferJob::copySpecialFile(const FilePath& srcPath, const GFileInfoPt
         g_set_error(&err, G_IO_ERROR, G_IO_ERROR_FAILED,
                     ("Cannot copy file '%s': not supported"),
                     g_file_info_get_display_name(srcInfo.get()));
-        emitError(err, ErrorSeverity::MODERATE);
+        emitErrorSerialized(err, ErrorSeverity::MODERATE);
     }
     return ret;
 }
 
 bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr srcInfo, FilePath& destPath, bool skip) {
+    // The dir is enumerated again instead of using the content found by the TotalSizeJob, which is
+    // only used for the totals, since the files might be added, removed or changed after the scan.
     bool ret = false;
     // copy dir content
     GErrorPtr err;
@@ -159,6 +1012,10 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr srcIn
         int n_children = 0;
         int n_copied = 0;
         ret = true;
+        // the regular files in this dir are handed to the workers, if any
+        FileTransferGroup group;
+        FileTransferGroup* parentGroup = currentGroup_;
+        currentGroup_ = &group;
         while(!isCancelled()) {
             err.reset();
             GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
@@ -178,7 +1035,7 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr srcIn
                 if(err) {
                     // fail to read directory content
                     // NOTE: since we cannot read the source dir, we cannot calculate the progress correctly, either.
-                    emitError(err, ErrorSeverity::MODERATE);
+                    emitErrorSerialized(err, ErrorSeverity::MODERATE);
                     err.reset();
                     /* ErrorAction::RETRY is not supported here */
                     ret = false;
@@ -202,11 +1059,16 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr srcIn
                 }
             }
         }
+        currentGroup_ = parentGroup;
+        // wait for the files of this dir, so the dir is not deleted before its content when moving it
+        if(workers_ && !workers_->wait(group)) {
+            ret = false;
+        }
         g_file_enumerator_close(enu.get(), nullptr, &err);
     }
     else {
         if(err) {
-            emitError(err, ErrorSeverity::MODERATE);
+            emitErrorSerialized(err, ErrorSeverity::MODERATE);
         }
     }
     return ret;
@@ -238,7 +1100,7 @@ bool FileTransferJob::makeDir(const FilePath& srcPath, GFileInfoPtr srcInfo, Fil
                 }
 
                 FilePath newDestPath;
-                FileExistsAction opt = askRename(FileInfo{srcInfo, srcPath.parent()}, FileInfo{destInfo, destPath.parent()}, newDestPath);
+                FileExistsAction opt = askRenameSerialized(FileInfo{fullFileInfo(srcPath, srcInfo), srcPath.parent()}, FileInfo{destInfo, destPath.parent()}, newDestPath);
                 switch(opt) {
                 case FileOperationJob::RENAME:
                     destPath = std::move(newDestPath);
@@ -257,7 +1119,7 @@ bool FileTransferJob::makeDir(const FilePath& srcPath, GFileInfoPtr srcInfo, Fil
                 }
             }
             else {
-                ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
+                ErrorAction act = emitErrorSerialized(err, ErrorSeverity::MODERATE);
                 if(act != ErrorAction::RETRY) {
                     break;
                 }
@@ -279,7 +1141,7 @@ bool FileTransferJob::makeDir(const FilePath& srcPath, GFileInfoPtr srcInfo, Fil
                                                          mode, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                                          cancellable().get(), &err);
                 if(!chmod_done) {
-                    ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
+                    ErrorAction act = emitErrorSerialized(err, ErrorSeverity::MODERATE);
                     if(act != ErrorAction::RETRY) {
                         break;
                     }
@@ -311,7 +1173,7 @@ bool FileTransferJob::handleError(GErrorPtr &err, const FilePath &srcPath, const
         // ask the user to rename or overwrite the existing file
         if(!isCancelled() && destInfo) {
             FilePath newDestPath;
-            FileExistsAction opt = askRename(FileInfo{srcInfo, srcPath.parent()},
+            FileExistsAction opt = askRenameSerialized(FileInfo{fullFileInfo(srcPath, srcInfo), srcPath.parent()},
                                              FileInfo{destInfo, destPath.parent()},
                                              newDestPath);
             switch(opt) {
@@ -345,7 +1207,7 @@ bool FileTransferJob::handleError(GErrorPtr &err, const FilePath &srcPath, const
 
     // show error message
     if(!isCancelled() && err) {
-        ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
+        ErrorAction act = emitErrorSerialized(err, ErrorSeverity::MODERATE);
         err.reset();
         if(act == ErrorAction::RETRY) {
             // the user wants retry the operation again
@@ -397,17 +1259,10 @@ bool FileTransferJob::processPath(const FilePath& srcPath, const FilePath& destD
 
 bool FileTransferJob::moveFile(const FilePath &srcPath, const GFileInfoPtr &srcInfo, const FilePath &destDirPath, const char *destFileName) {
     setCurrentFile(srcPath);
+    updateScannedTotals();
 
-    GErrorPtr err;
-    GFileInfoPtr destDirInfo = GFileInfoPtr {
-        g_file_query_info(destDirPath.gfile().get(),
-        "id::filesystem",
-        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-        cancellable().get(), &err),
-        false
-    };
-
-    if(!destDirInfo || isCancelled()) {
+    auto dest_fs = filesystemId(destDirPath);
+    if(!dest_fs || isCancelled()) {
         // FIXME: report errors
         return false;
     }
@@ -416,7 +1271,6 @@ bool FileTransferJob::moveFile(const FilePath &srcPath, const GFileInfoPtr &srcI
     // Exception: if src FS is trash:///, we always do move
     // Otherwise, do copy & delete src files.
     auto src_fs = g_file_info_get_attribute_string(srcInfo.get(), "id::filesystem");
-    auto dest_fs = g_file_info_get_attribute_string(destDirInfo.get(), "id::filesystem");
     bool ret;
     if(src_fs && dest_fs && (strcmp(src_fs, dest_fs) == 0 || g_str_has_prefix(src_fs, "trash"))) {
         // src and dest are on the same filesystem
@@ -437,8 +1291,59 @@ bool FileTransferJob::moveFile(const FilePath &srcPath, const GFileInfoPtr &srcI
     return ret;
 }
 
+const char* FileTransferJob::filesystemId(const FilePath& dirPath) {
+    auto it = fsIds_.find(dirPath);
+    if(it != fsIds_.end()) {
+        return it->second;
+    }
+    GFileInfoPtr dirInfo{
+        g_file_query_info(dirPath.gfile().get(),
+        "id::filesystem",
+        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+        cancellable().get(), nullptr),
+        false
+    };
+    if(!dirInfo) {
+        return nullptr;
+    }
+    auto id = g_intern_string(g_file_info_get_attribute_string(dirInfo.get(), "id::filesystem"));
+    if(id) {
+        fsIds_.emplace(dirPath, id);
+    }
+    return id;
+}
+
+std::vector<std::string> FileTransferJob::usedDevices() {
+    std::vector<std::string> devices;
+    if(mode_ == Mode::LINK || srcPaths_.size() != destPaths_.size()) {
+        return devices;
+    }
+    bool renameOnly = (mode_ == Mode::MOVE);
+    auto addDevice = [&devices](const char* id) {
+        if(id && std::find(devices.cbegin(), devices.cend(), id) == devices.cend()) {
+            devices.emplace_back(id);
+        }
+    };
+    for(size_t i = 0; i < srcPaths_.size(); ++i) {
+        auto srcId = filesystemId(srcPaths_[i].parent());
+        auto destId = filesystemId(destPaths_[i].parent());
+        // the ids are interned
+        if(srcId != destId || !srcId) {
+            renameOnly = false;
+        }
+        addDevice(srcId);
+        addDevice(destId);
+    }
+    // renaming the files on the same filesystem is quick and doesn't need to wait
+    if(renameOnly) {
+        devices.clear();
+    }
+    return devices;
+}
+
 bool FileTransferJob::copyFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destDirPath, const char* destFileName, bool skip) {
     setCurrentFile(srcPath);
+    updateScannedTotals();
 
     auto size = g_file_info_get_size(srcInfo.get());
     bool success = false;
@@ -446,6 +1351,24 @@ bool FileTransferJob::copyFile(const FilePath& srcPath, const GFileInfoPtr& srcI
 
     auto destPath = destDirPath.child(destFileName);
     auto file_type = g_file_info_get_file_type(srcInfo.get());
+    if(!skip && workers_ && file_type != G_FILE_TYPE_DIRECTORY && file_type != G_FILE_TYPE_SPECIAL) {
+        // copy the regular file in a worker thread, and the result is checked when the whole dir is done
+        workers_->submit(*currentGroup_, [this, srcPath, srcInfo, destPath, size]() mutable {
+            if(!copyRegularFile(srcPath, srcInfo, destPath)) {
+                return false;
+            }
+            addFinishedAmount(size, 1);
+            if(mode_ == Mode::MOVE) {
+                // delete the source file for cross-filesystem move
+                if(!g_file_delete(srcPath.gfile().get(), cancellable().get(), nullptr)) {
+                    return false;
+                }
+                addFinishedAmount(1, 1);
+            }
+            return true;
+        });
+        return true;
+    }
     if(!skip) {
         switch(file_type) {
         case G_FILE_TYPE_DIRECTORY:
@@ -496,11 +1419,18 @@ bool FileTransferJob::linkFile(const FilePath &srcPath, const GFileInfoPtr &srcI
     if(!destDirPath.isNative()) {
         auto msg = tr("Cannot create a link on non-native filesystem");
         GErrorPtr err{g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED, msg.toUtf8().constData())};
-        emitError(err, ErrorSeverity::CRITICAL);
+        emitErrorSerialized(err, ErrorSeverity::CRITICAL);
         return false;
     }
 
     if(srcPath.isNative()) {
+        // e.g. vfat and exFAT, on which gio would only report a generic error
+        if(!FileSystemCapabilities::query(filesystemId(destDirPath), destDirPath, cancellable().get()).supportsSymlinks) {
+            auto msg = tr("Cannot create a link on a filesystem which does not support symbolic links");
+            GErrorPtr err{g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, msg.toUtf8().constData())};
+            emitErrorSerialized(err, ErrorSeverity::CRITICAL);
+            return false;
+        }
         // create symlinks for native files
         auto destPath = destDirPath.child(destFileName);
         ret = createSymlink(srcPath, srcInfo, destPath);
@@ -606,25 +1536,110 @@ bool FileTransferJob::createShortcut(const FilePath &srcPath, const GFileInfoPtr
 
 
 void FileTransferJob::exec() {
+    if(scheduled_) {
+        devices_ = usedDevices();
+        if(!devices_.empty()) {
+            scheduler_ = TransferScheduler::globalInstance();
+            TraceSpan waitSpan{"FileTransferJob::waitForDevices"};
+            if(!scheduler_->acquire(this, devices_)) {
+                scheduler_.reset();
+                return; // cancelled while waiting
+            }
+        }
+    }
+    transfer();
+    if(scheduler_) {
+        scheduler_->release(this);
+        scheduler_.reset();
+    }
+}
+
+void FileTransferJob::onPaused() {
+    // let the transfers waiting for the same devices run while this one is paused
+    std::lock_guard<std::mutex> lock{schedulerMutex_};
+    if(scheduler_ && !devicesReleased_) {
+        scheduler_->release(this);
+        devicesReleased_ = true;
+    }
+}
+
+void FileTransferJob::onResumed() {
+    // the other threads of the job wait here until the devices are acquired again
+    std::lock_guard<std::mutex> lock{schedulerMutex_};
+    if(devicesReleased_) {
+        // returns false if the job is cancelled while waiting, which the transfer will notice
+        scheduler_->acquire(this, devices_);
+        devicesReleased_ = false;
+    }
+}
+
+void FileTransferJob::transfer() {
+    throttle(); // lower the priority of the scan too in the background mode
     // calculate the total size of files to copy
     auto totalSizeFlags = (mode_ == Mode::COPY ? TotalSizeJob::DEFAULT : TotalSizeJob::PREPARE_MOVE);
     TotalSizeJob totalSizeJob{srcPaths_, totalSizeFlags};
-    connect(&totalSizeJob, &TotalSizeJob::error, this, &FileTransferJob::error);
-    connect(this, &FileTransferJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
-    totalSizeJob.run();
-    if(isCancelled()) {
-        return;
+    totalSizeJob.pauseWith(*this);
+    if(mode_ == Mode::MOVE && !destPaths_.empty()) {
+        // the files moved into a dir on the same filesystem are renamed and don't need to be scanned
+        auto destDirPath = destPaths_[0].parent();
+        bool sameDestDir = std::all_of(destPaths_.cbegin() + 1, destPaths_.cend(), [&destDirPath](const FilePath& destPath) {
+            return destDirPath.isParentOf(destPath);
+        });
+        if(sameDestDir) {
+            totalSizeJob.setDestFilesystemId(filesystemId(destDirPath));
+        }
+    }
+    std::thread scanThread;
+    if(overlapSizeScan_) {
+        // scan the files while copying them, and the totals are updated by updateScannedTotals().
+        // the errors of the scan are not shown since the transfer will report the same errors.
+        connect(this, &FileTransferJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel, Qt::DirectConnection);
+        scanJob_ = &totalSizeJob;
+        scanFinished_ = false;
+        filesSinceTotalsUpdate_ = 0;
+        scanThread = std::thread{[this, &totalSizeJob]() {
+            totalSizeJob.run();
+            scanFinished_ = true;
+        }};
+        setTotalAmount(0, 0);
+    }
+    else {
+        connect(&totalSizeJob, &TotalSizeJob::error, this, &FileTransferJob::error);
+        connect(this, &FileTransferJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
+        totalSizeJob.run();
+        if(isCancelled()) {
+            return;
+        }
+        setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount());
     }
 
     // ready to start
-    setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount());
     Q_EMIT preparedToRun();
 
     if(srcPaths_.size() != destPaths_.size()) {
         qWarning("error: srcPaths.size() != destPaths.size() when copying files");
+        if(scanThread.joinable()) {
+            totalSizeJob.cancel();
+            scanThread.join();
+            scanJob_ = nullptr;
+        }
         return;
     }
 
+    std::unique_ptr<FileTransferJournal> journal;
+    if(!journalPath_.isEmpty()) {
+        journal = std::unique_ptr<FileTransferJournal>{new FileTransferJournal{journalPath_}};
+        journal_ = journal.get();
+    }
+
+    std::unique_ptr<FileTransferWorkers> workers;
+    FileTransferGroup group;
+    if(workerCount_ > 1 && mode_ != Mode::LINK) {
+        workers = std::unique_ptr<FileTransferWorkers>{new FileTransferWorkers{workerCount_}};
+        workers_ = workers.get();
+        currentGroup_ = &group;
+    }
+
     // copy the files
     for(size_t i = 0; i < srcPaths_.size(); ++i) {
         if(isCancelled()) {
@@ -635,6 +1650,37 @@ void FileTransferJob::exec() {
         auto destDirPath = destPath.parent();
         processPath(srcPath, destDirPath, destPath.baseName().get());
     }
+
+    if(workers) {
+        workers->wait(group);
+        workers_ = nullptr;
+        currentGroup_ = nullptr;
+    }
+
+    if(scanThread.joinable()) {
+        // the totals are not needed anymore if the transfer is done before the scan
+        totalSizeJob.cancel();
+        scanThread.join();
+        scanJob_ = nullptr;
+    }
+
+    if(journal) {
+        if(!isCancelled()) {
+            journal->remove(); // nothing to resume
+        }
+        journal_ = nullptr;
+    }
+}
+
+void FileTransferJob::updateScannedTotals() {
+    // the scan is usually ahead of the transfer, so don't update the totals for each file
+    if(scanJob_ && (scanFinished_ || ++filesSinceTotalsUpdate_ >= 64)) {
+        setTotalAmount(scanJob_->totalSize(), scanJob_->fileCount());
+        filesSinceTotalsUpdate_ = 0;
+        if(scanFinished_) {
+            scanJob_ = nullptr; // the totals are final
+        }
+    }
 }
 
 
@@ -4,9 +4,20 @@
 #include "../libfmqtglobals.h"
 #include "fileoperationjob.h"
 #include "gioptrs.h"
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <string>
 
 namespace Fm {
 
+class TotalSizeJob;
+class FileTransferWorkers;
+struct FileTransferGroup;
+class FileTransferJournal;
+class TransferScheduler;
+
 class LIBFM_QT_API FileTransferJob : public Fm::FileOperationJob {
     Q_OBJECT
 public:
@@ -25,9 +36,77 @@ public:
     void setDestPaths(FilePathList destPaths);
     void setDestDirPath(const FilePath &destDirPath);
 
+    // Copy up to this number of regular files in parallel (1 by default, which copies them one by one).
+    // This helps when copying lots of small files or copying over high-latency network shares.
+    // The progress of the current file is not reported in the parallel mode.
+    void setWorkerCount(int count);
+
+    int workerCount() const {
+        return workerCount_;
+    }
+
+    // Copy regular files with our own streaming loop, using two buffers of this size so that
+    // reading and writing happen in parallel on separate threads. Large buffers help with slow
+    // media like USB and SMB. 0 (the default) uses the kernel copy for native files and g_file_copy().
+    void setStreamBufferSize(size_t bytes) {
+        streamBufferSize_ = bytes;
+    }
+
+    size_t streamBufferSize() const {
+        return streamBufferSize_;
+    }
+
+    // Hash the data of the regular files while copying them, and compare it with the hash of the
+    // copy read back after it's written. The files are copied with the streaming loop, which hashes
+    // each buffer on the reader thread while the other buffer is being written.
+    void setVerifyCopies(bool value) {
+        verifyCopies_ = value;
+    }
+
+    bool verifyCopies() const {
+        return verifyCopies_;
+    }
+
+    // Start the transfer right away and calculate the total size of the files in another thread at
+    // the same time, instead of waiting for the calculation before copying anything.
+    // The totals reported by totalAmount() grow while the files are being scanned.
+    void setOverlapSizeScan(bool value) {
+        overlapSizeScan_ = value;
+    }
+
+    bool overlapSizeScan() const {
+        return overlapSizeScan_;
+    }
+
+    // Log the copied files and the answers to the prompts to a local file, so the transfer can be
+    // resumed by running a job with the same journal after it's cancelled or crashed. The files
+    // copied by the previous run are skipped if the source and the copy still have the same
+    // sizes and mtimes. The journal is removed when the job finishes without being cancelled.
+    void setJournalPath(const QString& path) {
+        journalPath_ = path;
+    }
+
+    const QString& journalPath() const {
+        return journalPath_;
+    }
+
+    // Wait for the other scheduled transfers using the same devices before starting, see TransferScheduler.
+    // Moves which only rename the files never wait.
+    void setScheduled(bool value) {
+        scheduled_ = value;
+    }
+
+    bool scheduled() const {
+        return scheduled_;
+    }
+
 protected:
     void exec() override;
 
+    void onPaused() override;
+
+    void onResumed() override;
+
 private:
     bool processPath(const FilePath& srcPath, const FilePath& destPath, const char *destFileName);
     bool moveFile(const FilePath &srcPath, const GFileInfoPtr &srcInfo, const FilePath &destDirPath, const char *destFileName);
@@ -36,6 +115,12 @@ private:
 
     bool moveFileSameFs(const FilePath &srcPath, const GFileInfoPtr& srcInfo, FilePath &destPath);
     bool copyRegularFile(const FilePath &srcPath, const GFileInfoPtr& srcInfo, FilePath &destPath);
+    // Copy a native regular file with FICLONE, copy_file_range() or sendfile().
+    // Returns false without setting err if these are not supported, so the caller can use gio instead.
+    bool copyNativeFile(const FilePath &srcPath, const FilePath &destPath, int flags, GErrorPtr& err);
+    bool copyStreaming(const FilePath &srcPath, const GFileInfoPtr& srcInfo, const FilePath &destPath, int flags, GErrorPtr& err);
+    // read the copy from the disk and compare its hash with the one of the source
+    bool verifyCopy(const FilePath &destPath, std::uint64_t srcHash, size_t bufferSize, GErrorPtr& err);
     bool copySpecialFile(const FilePath &srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
     bool copyDirContent(const FilePath &srcPath, GFileInfoPtr srcInfo, FilePath &destPath, bool skip = false);
     bool makeDir(const FilePath &srcPath, GFileInfoPtr srcInfo, FilePath &destPath);
@@ -44,12 +129,50 @@ private:
 
     bool handleError(GErrorPtr& err, const FilePath &srcPath, const GFileInfoPtr &srcInfo, FilePath &destPath, int& flags);
 
+    // get the info with all the attributes needed to show it to the user
+    GFileInfoPtr fullFileInfo(const FilePath& path, const GFileInfoPtr& info);
+
+    // the prompts can come from several worker threads, so only one of them is shown at a time
+    FileExistsAction askRenameSerialized(const FileInfo& src, const FileInfo& dest, FilePath& newDest);
+    ErrorAction emitErrorSerialized(const GErrorPtr& err, ErrorSeverity severity);
+
+    void updateScannedTotals();
+
+    // the interned id of the filesystem of a dir, which is only queried once for all the files in it
+    const char* filesystemId(const FilePath& dirPath);
+
+    // the ids of the filesystems read and written by the transfer, see TransferScheduler
+    std::vector<std::string> usedDevices();
+
+    void transfer();
+
     static void gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, FileTransferJob* _this);
 
 private:
     FilePathList srcPaths_;
     FilePathList destPaths_;
     Mode mode_;
+
+    int workerCount_;
+    size_t streamBufferSize_;
+    bool verifyCopies_;
+    goffset lastReportedProgress_; // for gfileCopyProgressCallback()
+
+    bool overlapSizeScan_;
+    TotalSizeJob* scanJob_; // the running TotalSizeJob if overlapSizeScan_ is set
+    std::atomic<bool> scanFinished_;
+    int filesSinceTotalsUpdate_;
+    FileTransferWorkers* workers_; // only set while copying files in parallel
+    FileTransferGroup* currentGroup_; // the files of the directory being copied by the workers
+    std::mutex promptMutex_;
+    std::unordered_map<FilePath, const char*, FilePathHash> fsIds_;
+    QString journalPath_;
+    FileTransferJournal* journal_; // only set while running with a journal
+    bool scheduled_;
+    std::shared_ptr<TransferScheduler> scheduler_; // set while the devices are acquired
+    std::vector<std::string> devices_;
+    bool devicesReleased_; // the devices are given to other jobs while this job is paused
+    std::mutex schedulerMutex_;
 };
 
 
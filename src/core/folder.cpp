@@ -23,83 +23,157 @@
 
 #include "folder.h"
 #include <string.h>
+#include <cstdio>
 #include <cassert>
+#include <algorithm>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#include <gio/gunixmounts.h>
 #include <QTimer>
 #include <QDebug>
 
 #include "dirlistjob.h"
-#include "filesysteminfojob.h"
+#include "filesysteminfocache.h"
+#include "dirsizecache.h"
 #include "fileinfojob.h"
+#include "gioasync.h"
+#include "foldersnapshot_p.h"
+#include "resultqueue_p.h"
+#include "job_p.h"
+#include "stats.h"
+#include "core/legacy/fm-config.h"
 
 namespace Fm {
 
+// the smallest local folders whose listings are shared, see Folder::setSharedListingsEnabled()
+static const size_t sharedListingMinFiles = 1000;
+// the range of the intervals of polling the folders without file monitors, in milliseconds
+static const int minPollInterval = 2000;
+static const int maxPollInterval = 60000;
+
 std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> Folder::cache_;
+std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> Folder::dirsOnlyCache_;
 QString Folder::cutFilesDirPath_;
 QString Folder::lastCutFilesDirPath_;
-std::shared_ptr<const HashSet> Folder::cutFilesHashSet_;
-std::mutex Folder::mutex_;
+std::shared_ptr<const CutFileSet> Folder::cutFilesHashSet_;
+std::mutex Folder::cacheMutex_;
+std::list<std::shared_ptr<Folder>> Folder::lru_;
+size_t Folder::maxCachedFolders_ = 0;
+size_t Folder::maxCachedFiles_ = 0;
+size_t Folder::maxCachedMemory_ = 0;
+int Folder::maxUpdateDelay_ = 1000;
+size_t Folder::reloadThreshold_ = 10000;
+size_t Folder::largeThreshold_ = 50000;
+std::unordered_set<FilePath, FilePathHash> Folder::largeDirs_;
+bool Folder::snapshotsEnabled_ = false;
+bool Folder::sharedListingsEnabled_ = false;
+size_t Folder::nativeMonitors_ = 0;
+
+// half of the inotify watches of the user, if the limit is known
+static size_t defaultMaxMonitors() {
+    size_t maxWatches = 0;
+    if(FILE* file = fopen("/proc/sys/fs/inotify/max_user_watches", "r")) {
+        unsigned long value;
+        if(fscanf(file, "%lu", &value) == 1) {
+            maxWatches = value;
+        }
+        fclose(file);
+    }
+    return maxWatches / 2;
+}
+
+size_t Folder::maxMonitors_ = defaultMaxMonitors();
 
 Folder::Folder():
     dirlist_job{nullptr},
-    fsInfoJob_{nullptr},
-    volumeManager_{VolumeManager::globalInstance()},
+    fsInfoCache_{FileSystemInfoCache::globalInstance()},
+    dirDevice_{0},
     /* for file monitor */
     has_idle_reload_handler{0},
+    idleReloadIsRefresh_{false},
     has_idle_update_handler{false},
     pending_change_notify{false},
     filesystem_info_pending{false},
-    wants_incremental{false},
+    wants_incremental{true},
+    dirsOnly_{false},
+    prefetching_{false},
+    diffListing_{false},
+    stale_{false},
+    isLarge_{false},
+    monitorReleased_{false},
     stop_emission{false}, /* don't set it 1 bit to not lock other bits */
-    /* filesystem info - set in query thread, read in main */
-    fs_total_size{0},
-    fs_free_size{0},
-    has_fs_info{false},
+    updateDelay_{0},
+    bulkUpdates_{0},
+    bulkChanged_{false},
+    countedPendingChanges_{0},
+    memoryUsage_{0},
+    pollInterval_{minPollInterval},
+    polledMtime_{0},
+    polledCtime_{0},
     defer_content_test{false} {
 
-    connect(volumeManager_.get(), &VolumeManager::mountAdded, this, &Folder::onMountAdded);
-    connect(volumeManager_.get(), &VolumeManager::mountRemoved, this, &Folder::onMountRemoved);
+    connect(fsInfoCache_.get(), &FileSystemInfoCache::changed, this, &Folder::onFileSystemInfoChanged);
+    pollTimer_.setSingleShot(true);
+    connect(&pollTimer_, &QTimer::timeout, this, &Folder::pollDirChanges);
 }
 
 Folder::Folder(const FilePath& path): Folder() {
     dirPath_ = path;
+    // it's created by fromPath() and the others with cacheMutex_ locked
+    isLarge_ = largeDirs_.count(path) > 0;
 }
 
 Folder::~Folder() {
-    if(dirMonitor_) {
-        g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
-        dirMonitor_.reset();
-    }
+    releaseMonitor();
 
     if(dirlist_job) {
         dirlist_job->cancel();
     }
+    if(pollCancellable_) {
+        g_cancellable_cancel(pollCancellable_.get());
+    }
 
     // cancel any file info job in progress.
     for(auto job: fileinfoJobs_) {
         job->cancel();
     }
-
-    if(fsInfoJob_) {
-        fsInfoJob_->cancel();
-    }
+    Stats::add(Stats::PENDING_MONITOR_EVENTS, -std::int64_t(countedPendingChanges_));
+    Stats::add(Stats::FOLDER_MEMORY_BYTES, -std::int64_t(memoryUsage_.load()));
 
     // We store a weak_ptr instead of shared_ptr in the hash table, so the hash table
     // does not own a reference to the folder. When the last reference to Folder is
     // freed, we need to remove its hash table entry.
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto it = cache_.find(dirPath_);
-    if(it != cache_.end()) {
-        cache_.erase(it);
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    auto& cache = dirsOnly_ ? dirsOnlyCache_ : cache_;
+    auto it = cache.find(dirPath_);
+    // a new folder object of the same path might be created already
+    if(it != cache.end() && it->second.expired()) {
+        cache.erase(it);
     }
 }
 
 // static
 std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
-    std::lock_guard<std::mutex> lock{mutex_};
+    // NOTE: the evicted folders should be freed after the lock is released since ~Folder() locks it again.
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{cacheMutex_};
     auto it = cache_.find(path);
     if(it != cache_.end()) {
         auto folder = it->second.lock();
         if(folder) {
+            if(folder->prefetching_) {
+                // the user is waiting for it now
+                folder->prefetching_ = false;
+                if(folder->dirlist_job) {
+                    JobExecutor::instance()->promote(folder->dirlist_job, Job::Priority::INTERACTIVE);
+                }
+            }
+            if(folder->monitorReleased_) {
+                folder->restoreMonitor();
+            }
+            retainInCache(folder, evicted);
             return folder;
         }
         else { // FIXME: is this possible?
@@ -107,11 +181,156 @@ std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
         }
     }
     auto folder = std::make_shared<Folder>(path);
+    releaseIdleMonitors();
     folder->reload();
     cache_.emplace(path, folder);
+    retainInCache(folder, evicted);
     return folder;
 }
 
+// static
+std::shared_ptr<Folder> Folder::prefetch(const FilePath& path) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    auto it = cache_.find(path);
+    if(it != cache_.end()) {
+        if(auto folder = it->second.lock()) {
+            return folder;
+        }
+        cache_.erase(it);
+    }
+    auto folder = std::make_shared<Folder>(path);
+    folder->prefetching_ = true;
+    folder->reload();
+    cache_.emplace(path, folder);
+    return folder;
+}
+
+// static
+std::shared_ptr<Folder> Folder::dirsFromPath(const FilePath& path) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    // a full folder has all the dirs already
+    auto it = cache_.find(path);
+    if(it != cache_.end()) {
+        if(auto folder = it->second.lock()) {
+            if(folder->monitorReleased_) {
+                folder->restoreMonitor();
+            }
+            return folder;
+        }
+    }
+    it = dirsOnlyCache_.find(path);
+    if(it != dirsOnlyCache_.end()) {
+        if(auto folder = it->second.lock()) {
+            return folder;
+        }
+        dirsOnlyCache_.erase(it);
+    }
+    auto folder = std::make_shared<Folder>(path);
+    folder->dirsOnly_ = true;
+    releaseIdleMonitors();
+    folder->reload();
+    dirsOnlyCache_.emplace(path, folder);
+    return folder;
+}
+
+// static
+void Folder::retainInCache(const std::shared_ptr<Folder>& folder, std::vector<std::shared_ptr<Folder>>& evicted) {
+    if(maxCachedFolders_ == 0) {
+        return;
+    }
+    // move the folder to the front of the LRU list
+    lru_.remove(folder);
+    lru_.push_front(folder);
+    trimCache(evicted);
+}
+
+// static
+void Folder::trimCache(std::vector<std::shared_ptr<Folder>>& evicted) {
+    size_t nFiles = 0;
+    size_t bytes = 0;
+    if(maxCachedFiles_ > 0 || maxCachedMemory_ > 0) {
+        for(const auto& folder: lru_) {
+            nFiles += folder->files_.size();
+            bytes += folder->memoryUsage_;
+        }
+    }
+    while(!lru_.empty()
+          && (lru_.size() > maxCachedFolders_ || (maxCachedFiles_ > 0 && nFiles > maxCachedFiles_)
+              || (maxCachedMemory_ > 0 && bytes > maxCachedMemory_))) {
+        nFiles -= std::min(nFiles, lru_.back()->files_.size());
+        bytes -= std::min(bytes, lru_.back()->memoryUsage_.load());
+        evicted.push_back(std::move(lru_.back()));
+        lru_.pop_back();
+    }
+}
+
+// static
+void Folder::setMaxCachedFolders(size_t count) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    maxCachedFolders_ = count;
+    trimCache(evicted);
+}
+
+// static
+size_t Folder::maxCachedFolders() {
+    return maxCachedFolders_;
+}
+
+// static
+void Folder::setMaxCachedFiles(size_t count) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    maxCachedFiles_ = count;
+    trimCache(evicted);
+}
+
+// static
+size_t Folder::maxCachedFiles() {
+    return maxCachedFiles_;
+}
+
+// static
+void Folder::setMaxCachedMemory(size_t bytes) {
+    std::vector<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    maxCachedMemory_ = bytes;
+    trimCache(evicted);
+}
+
+// static
+size_t Folder::maxCachedMemory() {
+    return maxCachedMemory_;
+}
+
+// static
+std::shared_ptr<Folder> Folder::findByPath(const FilePath& path) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    auto it = cache_.find(path);
+    return it != cache_.end() ? it->second.lock() : nullptr;
+}
+
+// static
+void Folder::clearCache() {
+    std::list<std::shared_ptr<Folder>> evicted;
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    evicted.swap(lru_);
+}
+
+// static
+void Folder::cacheCounts(size_t& cachedFolders, size_t& retainedFolders) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    cachedFolders = 0;
+    for(auto cache: {&cache_, &dirsOnlyCache_}) {
+        for(const auto& item: *cache) {
+            if(!item.second.expired()) {
+                ++cachedFolders;
+            }
+        }
+    }
+    retainedFolders = lru_.size();
+}
+
 bool Folder::makeDirectory(const char* /*name*/, GError** /*error*/) {
     // TODO:
     // FIXME: what the API is used for in the original libfm C API?
@@ -133,7 +352,7 @@ bool Folder::isLoaded() const {
 std::shared_ptr<const FileInfo> Folder::fileByName(const char* name) const {
     auto it = files_.find(name);
     if(it != files_.end()) {
-        return it->second;
+        return *it;
     }
     return nullptr;
 }
@@ -143,12 +362,20 @@ bool Folder::isEmpty() const {
 }
 
 FileInfoList Folder::files() const {
-    FileInfoList ret;
-    ret.reserve(files_.size());
-    for(const auto& item : files_) {
-        ret.push_back(item.second);
+    return *filesSnapshot();
+}
+
+std::shared_ptr<const FileInfoList> Folder::filesSnapshot() const {
+    // the snapshot is only rebuilt after the files are changed
+    if(!filesSnapshot_) {
+        auto snapshot = std::make_shared<FileInfoList>();
+        snapshot->reserve(files_.size());
+        for(const auto& file : files_) {
+            snapshot->push_back(file);
+        }
+        filesSnapshot_ = std::move(snapshot);
     }
-    return ret;
+    return filesSnapshot_;
 }
 
 
@@ -180,26 +407,52 @@ void Folder::init(FmFolder* folder) {
 }
 #endif
 
+void Folder::beginBulkUpdate() {
+    ++bulkUpdates_;
+}
+
+void Folder::endBulkUpdate() {
+    if(bulkUpdates_ > 0 && --bulkUpdates_ == 0 && bulkChanged_) {
+        bulkChanged_ = false;
+        // one listing replaces all the incremental updates dropped during the operations
+        queueReload(true);
+    }
+}
+
 void Folder::onIdleReload() {
     /* check if folder still exists */
-    reload();
+    if(idleReloadIsRefresh_) {
+        refresh();
+    }
+    else {
+        reload();
+    }
     // G_LOCK(query);
     has_idle_reload_handler = false;
     // G_UNLOCK(query);
 }
 
-void Folder::queueReload() {
+void Folder::queueReload(bool refreshOnly) {
     // G_LOCK(query);
     if(!has_idle_reload_handler) {
         has_idle_reload_handler = true;
+        idleReloadIsRefresh_ = refreshOnly;
         QTimer::singleShot(0, this, &Folder::onIdleReload);
     }
+    else if(!refreshOnly) { // a full reload wins over a refresh
+        idleReloadIsRefresh_ = false;
+    }
     // G_UNLOCK(query);
 }
 
 void Folder::onFileInfoFinished() {
     FileInfoJob* job = static_cast<FileInfoJob*>(sender());
-    fileinfoJobs_.erase(std::find(fileinfoJobs_.cbegin(), fileinfoJobs_.cend(), job));
+    auto it = std::find(fileinfoJobs_.cbegin(), fileinfoJobs_.cend(), job);
+    // the queued signal of a job might arrive after the job is cancelled and forgotten
+    if(it == fileinfoJobs_.cend()) {
+        return;
+    }
+    fileinfoJobs_.erase(it);
 
     if(job->isCancelled())
         return;
@@ -210,6 +463,7 @@ void Folder::onFileInfoFinished() {
 
     const auto& paths = job->paths();
     const auto& deletionPaths = job->deletionPaths();
+    const FilePathSet deletionPathSet{deletionPaths.cbegin(), deletionPaths.cend()};
     const auto& infos = job->files();
     auto path_it = paths.cbegin();
     auto info_it = infos.cbegin();
@@ -217,21 +471,34 @@ void Folder::onFileInfoFinished() {
         const auto& path = *path_it;
         const auto& info = *info_it;
 
+        pendingDetails_.erase(info->name());
         if(path == dirPath_) { // got the info for the folder itself.
             dirInfo_ = info;
         }
         // add/update the file only if it isn't going to be deleted
-        else if(std::find(deletionPaths.cbegin(), deletionPaths.cend(), path) == deletionPaths.cend()) {
+        else if(deletionPathSet.count(path) == 0) {
             auto it = files_.find(info->name());
-            if(it != files_.end()) { // the file already exists, update
-                files_to_update.push_back(std::make_pair(it->second, info));
+            if(dirsOnly_ && !info->isDir()) {
+                // it's not a dir (anymore)
+                if(it != files_.end()) {
+                    files_to_delete.push_back(*it);
+                    addMemoryUsage(-std::int64_t(fileMemoryUsage(**it)));
+                    files_.erase(it);
+                }
+                continue; // not shown in the dirs-only mode
+            }
+            else if(it != files_.end()) { // the file already exists, update
+                files_to_update.push_back(std::make_pair(*it, info));
             }
             else { // newly added
                 files_to_add.push_back(info);
             }
-            files_[info->name()] = info;
+            insertFile(info);
         }
     }
+    if(!files_to_add.empty() || !files_to_update.empty()) {
+        filesSnapshot_.reset();
+    }
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
     }
@@ -243,16 +510,33 @@ void Folder::onFileInfoFinished() {
         auto name = path.baseName();
         auto it = files_.find(name.get());
         if(it != files_.end()) {
-            files_to_delete.push_back(it->second);
+            files_to_delete.push_back(*it);
+            addMemoryUsage(-std::int64_t(fileMemoryUsage(**it)));
             files_.erase(it);
         }
     }
+    if(!files_to_delete.empty()) {
+        filesSnapshot_.reset();
+    }
     if(!files_to_delete.empty()) {
         Q_EMIT filesRemoved(files_to_delete);
     }
+    updateLarge();
     Q_EMIT contentChanged();
 }
 
+void Folder::loadDetails(const std::shared_ptr<const FileInfo>& file) {
+    if(!file->isPartial() || file->dirPath() != dirPath_) {
+        return;
+    }
+    // the details of the file are already requested
+    if(!pendingDetails_.insert(file->name()).second) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    eventFileChanged(file->path());
+}
+
 void Folder::processPendingChanges() {
     has_idle_update_handler = false;
     // FmFileInfoJob* job = nullptr;
@@ -264,6 +548,17 @@ void Folder::processPendingChanges() {
         return;
     }
 
+    lastUpdateTime_.start();
+
+    // Too many changes are pending (an event storm caused by something like rsync or git checkout).
+    // Relisting the whole folder once is cheaper than querying the files one by one.
+    if(paths_to_add.size() + paths_to_update.size() + paths_to_del.size() > reloadThreshold_) {
+        paths_to_update.clear();
+        paths_to_add.clear();
+        paths_to_del.clear();
+        queueReload(true);
+    }
+
     FileInfoJob* info_job = nullptr;
     if(!paths_to_update.empty() || !paths_to_add.empty() || !paths_to_del.empty()) {
         FilePathList paths, deletionPaths;
@@ -272,15 +567,25 @@ void Folder::processPendingChanges() {
         deletionPaths.insert(deletionPaths.end(), paths_to_del.cbegin(), paths_to_del.cend());
         info_job = new FileInfoJob{paths, deletionPaths, dirPath_,
                                    hasCutFiles() ? cutFilesHashSet_ : nullptr};
+        // the details are loaded later like the listing, so the local files are only stat'ed,
+        // unless the details of the shown files are requested, which would be partial again
+        if(defer_content_test && dirPath_.isNative() && pendingDetails_.empty()) {
+            info_job->setNativeStat(true);
+        }
+        // listing the folder once is cheaper when a large part of it is changed
+        else if(paths.size() >= 16 && paths.size() * 4 >= files_.size()) {
+            info_job->setListCommonDir(true);
+        }
         paths_to_update.clear();
         paths_to_add.clear();
         paths_to_del.clear();
     }
+    countPendingChanges();
 
     if(info_job) {
         fileinfoJobs_.push_back(info_job);
         info_job->setAutoDelete(true);
-        connect(info_job, &FileInfoJob::finished, this, &Folder::onFileInfoFinished, Qt::BlockingQueuedConnection);
+        connect(info_job, &FileInfoJob::finished, this, &Folder::onFileInfoFinished, Qt::QueuedConnection);
         info_job->runAsync();
 #if 0
         pending_jobs = g_slist_prepend(pending_jobs, job);
@@ -309,9 +614,150 @@ void Folder::processPendingChanges() {
 void Folder::queueUpdate() {
     // qDebug() << "queue_update:" << !has_idle_handler << paths_to_add.size() << paths_to_update.size() << paths_to_del.size();
     if(!has_idle_update_handler) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        // If the last batch of changes was processed very recently, the changes keep
+        // coming. So we wait longer each time to coalesce more of them into one batch.
+        // Otherwise, the changes are processed as soon as possible.
+        if(lastUpdateTime_.isValid() && lastUpdateTime_.elapsed() < std::max(updateDelay_, 100)) {
+            updateDelay_ = std::min(std::max(updateDelay_ * 2, 50), maxUpdateDelay_);
+        }
+        else {
+            updateDelay_ = 0;
+        }
+        QTimer::singleShot(updateDelay_, this, &Folder::processPendingChanges);
         has_idle_update_handler = true;
     }
+    countPendingChanges();
+}
+
+void Folder::countPendingChanges() {
+    size_t count = paths_to_add.size() + paths_to_update.size() + paths_to_del.size();
+    if(count != countedPendingChanges_) {
+        Stats::add(Stats::PENDING_MONITOR_EVENTS, std::int64_t(count) - std::int64_t(countedPendingChanges_));
+        countedPendingChanges_ = count;
+    }
+}
+
+void Folder::insertFile(const std::shared_ptr<const FileInfo>& file) {
+    std::int64_t delta = fileMemoryUsage(*file);
+    if(auto replaced = files_.insert(file)) {
+        delta -= fileMemoryUsage(*replaced);
+    }
+    addMemoryUsage(delta);
+}
+
+// static
+size_t Folder::fileMemoryUsage(const FileInfo& file) {
+    // the slot of the hash table and the control block of the FileInfo
+    return FileInfoNameSet::memoryPerFile() + 2 * sizeof(void*) + file.memoryUsage();
+}
+
+void Folder::addMemoryUsage(std::int64_t delta) {
+    if(delta != 0) {
+        memoryUsage_ += size_t(delta);
+        Stats::add(Stats::FOLDER_MEMORY_BYTES, delta);
+    }
+}
+
+// static
+void Folder::setMaxUpdateDelay(int msec) {
+    maxUpdateDelay_ = msec;
+}
+
+// static
+int Folder::maxUpdateDelay() {
+    return maxUpdateDelay_;
+}
+
+// static
+void Folder::setReloadThreshold(size_t count) {
+    reloadThreshold_ = count;
+}
+
+// static
+size_t Folder::reloadThreshold() {
+    return reloadThreshold_;
+}
+
+// static
+void Folder::setLargeThreshold(size_t count) {
+    largeThreshold_ = count;
+}
+
+// static
+size_t Folder::largeThreshold() {
+    return largeThreshold_;
+}
+
+void Folder::updateLarge() {
+    // the threshold of a large folder is lower, so it doesn't switch back and forth on each change
+    bool large = largeThreshold_ > 0
+                 && (isLarge_ ? files_.size() * 2 >= largeThreshold_ : files_.size() >= largeThreshold_);
+    if(large == isLarge_) {
+        return;
+    }
+    isLarge_ = large;
+    {
+        std::lock_guard<std::mutex> lock{cacheMutex_};
+        if(large) {
+            largeDirs_.insert(dirPath_);
+        }
+        else {
+            largeDirs_.erase(dirPath_);
+        }
+    }
+    if(large) {
+        // the running listing is kept, but the following changes only get the basic info
+        defer_content_test = true;
+    }
+    Q_EMIT largeChanged(large);
+}
+
+// static
+void Folder::setSnapshotsEnabled(bool enabled) {
+    snapshotsEnabled_ = enabled;
+}
+
+// static
+bool Folder::snapshotsEnabled() {
+    return snapshotsEnabled_;
+}
+
+// static
+void Folder::setMaxMonitors(size_t count) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    maxMonitors_ = count;
+    releaseIdleMonitors();
+}
+
+// static
+size_t Folder::maxMonitors() {
+    return maxMonitors_;
+}
+
+// static
+void Folder::releaseIdleMonitors() {
+    if(maxMonitors_ == 0) {
+        return;
+    }
+    // the least recently used folders are released first
+    for(auto it = lru_.rbegin(); it != lru_.rend() && nativeMonitors_ >= maxMonitors_; ++it) {
+        auto& folder = *it;
+        // only referenced by the cache, so it's not shown anywhere
+        if(folder.use_count() == 1 && folder->dirMonitor_ && folder->dirPath_.isNative()) {
+            folder->releaseMonitor();
+            folder->monitorReleased_ = true;
+        }
+    }
+}
+
+// static
+void Folder::setSharedListingsEnabled(bool enabled) {
+    sharedListingsEnabled_ = enabled;
+}
+
+// static
+bool Folder::sharedListingsEnabled() {
+    return sharedListingsEnabled_;
 }
 
 
@@ -320,18 +766,16 @@ bool Folder::eventFileAdded(const FilePath &path) {
     bool added = true;
     // G_LOCK(lists);
     /* make sure that the file is not already queued for addition. */
-    if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
+    if(paths_to_add.count(path) == 0) {
         if(files_.find(path.baseName().get()) != files_.end()) { // the file already exists, update instead
-            if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
-                paths_to_update.push_back(path);
-            }
+            paths_to_update.insert(path);
         }
         else { // newly added file
-            paths_to_add.push_back(path);
+            paths_to_add.insert(path);
         }
         /* bug #3591771: 'ln -fns . test' leave no file visible in folder.
            If it is queued for deletion then cancel that operation */
-        paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
+        paths_to_del.erase(path);
     }
     else
         /* file already queued for adding, don't duplicate */
@@ -349,13 +793,13 @@ bool Folder::eventFileChanged(const FilePath &path) {
     bool added;
     // G_LOCK(lists);
     /* make sure that the file is not already queued for changes, addition or deletion */
-    if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()
-       && std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()
-       && std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
+    if(paths_to_update.count(path) == 0
+       && paths_to_add.count(path) == 0
+       && paths_to_del.count(path) == 0) {
         /* Since this function is called only when a file already exists, even if that file
            isn't included in "files_" yet, it will be soon due to a previous call to queueUpdate().
            So, here, we should queue it for changes regardless of what "files_" may contain. */
-        paths_to_update.push_back(path);
+        paths_to_update.insert(path);
         added = true;
         queueUpdate();
     }
@@ -373,16 +817,11 @@ void Folder::eventFileDeleted(const FilePath& path) {
        if it is, remove it from that queue instead of queueing it for deletion.
        Moreover, as was the case with eventFileChanged(), here too queueing
        should be done regardless of what "files_" may contain. */
-    if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
-            paths_to_del.push_back(path);
-        }
-    }
-    else {
-        paths_to_add.erase(std::remove(paths_to_add.begin(), paths_to_add.end(), path), paths_to_add.cend());
+    if(paths_to_add.erase(path) == 0) {
+        paths_to_del.insert(path);
     }
     /* the update queue should be canceled for a file that is going to be deleted */
-    paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path), paths_to_update.cend());
+    paths_to_update.erase(path);
     queueUpdate();
     // G_UNLOCK(lists);
 }
@@ -409,8 +848,8 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
     case G_FILE_MONITOR_EVENT_CHANGED: {
         std::lock_guard<std::mutex> lock{mutex_};
         pending_change_notify = true;
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), dirPath_) != paths_to_update.cend()) {
-            paths_to_update.push_back(dirPath_);
+        if(paths_to_update.count(dirPath_) == 0) {
+            paths_to_update.insert(dirPath_);
             queueUpdate();
         }
         /* g_debug("folder is changed"); */
@@ -436,10 +875,16 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
         "G_FILE_MONITOR_EVENT_PRE_UNMOUNT",
         "G_FILE_MONITOR_EVENT_UNMOUNTED"
     }; */
+    // the total sizes of the dir and its parents are changed, even if the mtimes of the parents are not
+    DirSizeCache::invalidateGlobal(dirPath_);
     if(dirPath_ == gf) {
         onDirChanged(evt);
         return;
     }
+    else if(bulkUpdates_ > 0) {
+        // querying the files while they're still being written is wasted; they're listed again at the end
+        bulkChanged_ = true;
+    }
     else {
         std::lock_guard<std::mutex> lock{mutex_};
         auto path = FilePath{gf, true};
@@ -474,12 +919,13 @@ bool Folder::hadCutFilesUnset() {
 }
 
 bool Folder::hasCutFiles() {
+    // the cut files are looked up by their real folders, which a search folder has many of
     return cutFilesHashSet_
             && !cutFilesHashSet_->empty()
-            && cutFilesDirPath_ == dirPath_.toString().get();
+            && (cutFilesHashSet_->containsDir(dirPath_) || dirPath_.hasUriScheme("search"));
 }
 
-void Folder::setCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet) {
+void Folder::setCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet) {
     if(cutFilesHashSet_ && !cutFilesHashSet_->empty()) {
         lastCutFilesDirPath_ = cutFilesDirPath_;
     }
@@ -487,26 +933,15 @@ void Folder::setCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet)
     cutFilesHashSet_ = cutFilesHashSet;
 }
 
-void Folder::onDirListFinished() {
-    DirListJob* job = static_cast<DirListJob*>(sender());
-    if(job->isCancelled()) { // this is a cancelled job, ignore!
-        if(job == dirlist_job) {
-            dirlist_job = nullptr;
-        }
-        Q_EMIT finishLoading();
-        return;
-    }
-    dirInfo_ = job->dirInfo();
-
+void Folder::addDirListFiles(const FileInfoList& infos) {
     FileInfoList files_to_add;
     std::vector<FileInfoPair> files_to_update;
-    const auto& infos = job->files();
 
     // with "search://", there is no update for infos and all of them should be added
     if(strcmp(dirPath_.uriScheme().get(), "search") == 0) {
         files_to_add = infos;
         for(auto& file: files_to_add) {
-            files_[file->name()] = file;
+            insertFile(file);
         }
     }
     else {
@@ -515,14 +950,15 @@ void Folder::onDirListFinished() {
             const auto& info = *info_it;
             auto it = files_.find(info->name());
             if(it != files_.end()) {
-                files_to_update.push_back(std::make_pair(it->second, info));
+                files_to_update.push_back(std::make_pair(*it, info));
             }
             else {
                 files_to_add.push_back(info);
             }
-            files_[info->name()] = info;
+            insertFile(info);
         }
     }
+    filesSnapshot_.reset();
 
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
@@ -530,116 +966,214 @@ void Folder::onDirListFinished() {
     if(!files_to_update.empty()) {
         Q_EMIT filesChanged(files_to_update);
     }
+    updateLarge();
+}
 
-#if 0
-    if(dirlist_job->isCancelled() && !wants_incremental) {
-        GList* l;
-        for(l = fm_file_info_list_peek_head_link(job->files); l; l = l->next) {
-            FmFileInfo* inf = (FmFileInfo*)l->data;
-            files = g_slist_prepend(files, inf);
-            fm_file_info_list_push_tail(files, inf);
-        }
-        if(G_LIKELY(files)) {
-            GSList* l;
-
-            G_LOCK(lists);
-            if(defer_content_test && fm_path_is_native(dir_path))
-                /* we got only basic info on content, schedule update it now */
-                for(l = files; l; l = l->next)
-                    files_to_update = g_slist_prepend(files_to_update,
-                                              fm_path_ref(fm_file_info_get_path(l->data)));
-            G_UNLOCK(lists);
-            g_signal_emit(folder, signals[FILES_ADDED], 0, files);
-            g_slist_free(files);
-        }
-
-        if(job->dir_fi) {
-            dir_fi = fm_file_info_ref(job->dir_fi);
-        }
-
-        /* Some new files are created while FmDirListJob is loading the folder. */
-        G_LOCK(lists);
-        if(G_UNLIKELY(files_to_add)) {
-            /* This should be a very rare case. Could this happen? */
-            GSList* l;
-            for(l = files_to_add; l;) {
-                FmPath* path = l->data;
-                GSList* next = l->next;
-                if(_Folder::get_file_by_path(folder, path)) {
-                    /* we already have the file. remove it from files_to_add,
-                     * and put it in files_to_update instead.
-                     * No strdup for name is needed here. We steal
-                     * the string from files_to_add.*/
-                    files_to_update = g_slist_prepend(files_to_update, path);
-                    files_to_add = g_slist_delete_link(files_to_add, l);
-                }
-                l = next;
+void Folder::applyDirListDiff(const FileInfoList& infos) {
+    FileInfoList files_to_add;
+    FileInfoList files_to_delete;
+    std::vector<FileInfoPair> files_to_update;
+
+    FileInfoNameSet newFiles;
+    newFiles.reserve(infos.size());
+    size_t newMemoryUsage = 0;
+    for(const auto& info: infos) {
+        auto it = files_.find(info->name());
+        if(it != files_.end()) {
+            const auto& oldInfo = *it;
+            if(oldInfo->mtime() == info->mtime() && oldInfo->size() == info->size()
+                    && oldInfo->mode() == info->mode()
+                    && (!oldInfo->isPartial() || info->isPartial())) {
+                // the file is not changed, keep the old object so the views keep their thumbnails and selections
+                newFiles.insert(oldInfo);
+                newMemoryUsage += fileMemoryUsage(*oldInfo);
+            }
+            else {
+                files_to_update.push_back(std::make_pair(oldInfo, info));
+                newFiles.insert(info);
+                newMemoryUsage += fileMemoryUsage(*info);
             }
+            files_.erase(it);
+        }
+        else { // newly added
+            files_to_add.push_back(info);
+            newFiles.insert(info);
+            newMemoryUsage += fileMemoryUsage(*info);
         }
-        G_UNLOCK(lists);
     }
-    else if(!dir_fi && job->dir_fi)
-        /* we may need dir_fi for incremental folders too */
-    {
-        dir_fi = fm_file_info_ref(job->dir_fi);
+    // the remaining files are not there anymore
+    files_to_delete.reserve(files_.size());
+    for(const auto& file : files_) {
+        files_to_delete.push_back(file);
+    }
+    files_.swap(newFiles);
+    addMemoryUsage(std::int64_t(newMemoryUsage) - std::int64_t(memoryUsage_.load()));
+    filesSnapshot_.reset();
+
+    if(!files_to_delete.empty()) {
+        Q_EMIT filesRemoved(files_to_delete);
+    }
+    if(!files_to_add.empty()) {
+        Q_EMIT filesAdded(files_to_add);
+    }
+    if(!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+    updateLarge();
+    if(!files_to_delete.empty() || !files_to_add.empty() || !files_to_update.empty()) {
+        Q_EMIT contentChanged();
+    }
+}
+
+void Folder::onDirListFilesFound(DirListJob* job, std::vector<FileInfoList>& batches) {
+    // NOTE: the job is not deleted yet since its finished() is handled after the batches
+    if(job != dirlist_job || job->isCancelled()) { // this is an outdated job, ignore!
+        return;
+    }
+    // we may want the info of the folder while it's still being loaded
+    if(!dirInfo_) {
+        dirInfo_ = job->dirInfo();
+    }
+    // the batches queued while the main thread is busy are added at once
+    auto& files = batches.front();
+    for(size_t i = 1; i < batches.size(); ++i) {
+        files.insert(files.end(), std::make_move_iterator(batches[i].begin()), std::make_move_iterator(batches[i].end()));
+    }
+    addDirListFiles(files);
+}
+
+void Folder::onDirListFinished() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job->isCancelled()) { // this is a cancelled job, ignore!
+        if(job == dirlist_job) {
+            dirlist_job = nullptr;
+        }
+        Q_EMIT finishLoading();
+        return;
+    }
+    dirInfo_ = job->dirInfo();
+    bool fromSnapshot = stale_;
+
+    if(diffListing_) {
+        diffListing_ = false;
+        // if the folder can't be reached, the saved files are kept and they're still stale
+        if(!stale_ || dirInfo_) {
+            applyDirListDiff(job->files());
+            stale_ = false;
+        }
+    }
+    else {
+        // in incremental mode, this only contains the files which are not emitted yet
+        addDirListFiles(job->files());
+    }
+    // the listings of the other processes are compared with the saved one when it's loaded again
+    if(!fromSnapshot && dirInfo_ && dirPath_.isNative() && usesSnapshot() && files_.size() >= sharedListingMinFiles) {
+        saveSharedListing();
     }
-    g_object_unref(dirlist_job);
-#endif
 
     dirlist_job = nullptr;
     Q_EMIT finishLoading();
 }
 
-#if 0
-
+bool Folder::usesSnapshot() const {
+    if(dirsOnly_ || dirPath_.hasUriScheme("search")) {
+        return false;
+    }
+    // the local folders are listed fast enough unless they're big, which is only known after the listing
+    return dirPath_.isNative() ? sharedListingsEnabled_ : snapshotsEnabled_;
+}
 
-void on_dirlist_job_files_found(FmDirListJob* job, GSList* files, gpointer user_data) {
-    FmFolder* folder = FM_FOLDER(user_data);
-    GSList* l;
-    for(l = files; l; l = l->next) {
-        FmFileInfo* file = FM_FILE_INFO(l->data);
-        fm_file_info_list_push_tail(files, file);
+bool Folder::loadSnapshot() {
+    auto files = FolderSnapshot::load(dirPath_, hasCutFiles() ? cutFilesHashSet_ : nullptr);
+    if(files.empty()) {
+        return false;
     }
-    if(G_UNLIKELY(!dir_fi && job->dir_fi))
-        /* we may want info while folder is still loading */
-    {
-        dir_fi = fm_file_info_ref(job->dir_fi);
+    for(const auto& file: files) {
+        insertFile(file);
     }
-    g_signal_emit(folder, signals[FILES_ADDED], 0, files);
+    filesSnapshot_.reset();
+    stale_ = true;
+    Q_EMIT filesAdded(files);
+    Q_EMIT contentChanged();
+    return true;
 }
 
-ErrorAction on_dirlist_job_error(FmDirListJob* job, GError* err, FmJobErrorSeverity severity, FmFolder* folder) {
-    guint ret;
-    /* it's possible that some signal handlers tries to free the folder
-     * when errors occurs, so let's g_object_ref here. */
-    g_object_ref(folder);
-    g_signal_emit(folder, signals[ERROR], 0, err, (guint)severity, &ret);
-    g_object_unref(folder);
-    return ret;
+void Folder::saveSharedListing() {
+    if(dirListFlags() & DirListJob::DETAILED) {
+        return; // the listing is through gio, and it's saved by the job already
+    }
+    // The native listing has no GFileInfo to save, so the folder is listed through gio again
+    // in the background. Nothing waits for the job, and it deletes itself.
+    // It's not needed if no file is added, removed or renamed since the last saved listing, since
+    // the other changes are found by comparing the saved listing with the new one when it's used.
+    if(FolderSnapshot::isNewerThanDir(dirPath_)) {
+        return;
+    }
+    auto job = new DirListJob(dirPath_, dirListFlags());
+    job->setNativeListing(false);
+    job->setSnapshotRecording(true);
+    job->setPriority(Job::Priority::BACKGROUND);
+    job->setAutoDelete(true);
+    job->runAsync();
 }
 
-void free_dirlist_job(FmFolder* folder) {
-    if(wants_incremental) {
-        g_signal_handlers_disconnect_by_func(dirlist_job, on_dirlist_job_files_found, folder);
+DirListJob::Flags Folder::dirListFlags() const {
+    int flags = defer_content_test ? DirListJob::FAST : DirListJob::DETAILED;
+    if(dirsOnly_) {
+        flags |= DirListJob::DIR_ONLY;
     }
-    g_signal_handlers_disconnect_by_func(dirlist_job, on_dirlist_job_finished, folder);
-    g_signal_handlers_disconnect_by_func(dirlist_job, on_dirlist_job_error, folder);
-    fm_job_cancel(FM_JOB(dirlist_job));
-    g_object_unref(dirlist_job);
-    dirlist_job = nullptr;
+    return static_cast<DirListJob::Flags>(flags);
 }
 
-#endif
+void Folder::refresh() {
+    if(files_.empty()) { // nothing to compare with
+        reload();
+        return;
+    }
+
+    // cancel in-progress jobs if there are any
+    if(dirlist_job) {
+        dirlist_job->cancel();
+        dirlist_job = nullptr;
+    }
+
+    // the pending changes will be included in the new listing
+    paths_to_add.clear();
+    paths_to_update.clear();
+    paths_to_del.clear();
+    countPendingChanges();
+    for(auto job: fileinfoJobs_) {
+        job->cancel();
+        disconnect(job, &FileInfoJob::finished, this, &Folder::onFileInfoFinished);
+    }
+    fileinfoJobs_.clear();
+    pendingDetails_.clear();
+
+    // list the folder again without touching the current files, and compare the results when the
+    // listing is finished. The job is not incremental since we need the complete list to find removed files.
+    diffListing_ = true;
+    defer_content_test = fm_config->defer_content_test || isLarge_;
+    dirlist_job = new DirListJob(dirPath_, dirListFlags(), hasCutFiles() ? cutFilesHashSet_ : nullptr);
+    dirlist_job->setAutoDelete(true);
+    dirlist_job->setSnapshotRecording(usesSnapshot());
+    connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
+    connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::QueuedConnection);
+    connect(dirlist_job, &DirListJob::searchProgress, this, &Folder::searchProgress, Qt::QueuedConnection);
+    dirlist_job->runAsync();
 
+    queryFilesystemInfo();
+}
 
 void Folder::reload() {
     // cancel in-progress jobs if there are any
-    GError* err = nullptr;
-    // cancel directory monitoring
-    if(dirMonitor_) {
-        g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
-        dirMonitor_.reset();
+    if(dirlist_job) {
+        dirlist_job->cancel();
+        dirlist_job = nullptr;
     }
+    diffListing_ = false;
+
+    // cancel directory monitoring
+    releaseMonitor();
 
     /* clear all update-lists now, see SF bug #919 - if update comes before
        listing job is finished, a duplicate may be created in the folder */
@@ -648,6 +1182,7 @@ void Folder::reload() {
         paths_to_add.clear();
         paths_to_update.clear();
         paths_to_del.clear();
+        countPendingChanges();
 
         // cancel any file info job in progress.
         for(auto job: fileinfoJobs_) {
@@ -662,6 +1197,8 @@ void Folder::reload() {
         // FIXME: this is not very efficient :(
         auto tmp = files();
         files_.clear();
+        addMemoryUsage(-std::int64_t(memoryUsage_.load()));
+        filesSnapshot_.reset();
         Q_EMIT filesRemoved(tmp);
     }
 
@@ -675,39 +1212,43 @@ void Folder::reload() {
     dirInfo_.reset(); // clear dir info
 
     /* also re-create a new file monitor */
-    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
-    // FIXME: should we make this cancellable?
-    dirMonitor_ = GFileMonitorPtr{
-            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
-            false
-    };
-
-    if(dirMonitor_) {
-        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
-    }
-    else {
-        qDebug("file monitor cannot be created: %s", err->message);
-        g_error_free(err);
-    }
+    createMonitor();
+    updateMountWatch();
+    startPolling();
 
     Q_EMIT contentChanged();
 
     /* run a new dir listing job */
-    // FIXME:
-    // defer_content_test = fm_config->defer_content_test;
-    dirlist_job = new DirListJob(dirPath_, defer_content_test ? DirListJob::FAST : DirListJob::DETAILED,
-                                 hasCutFiles() ? cutFilesHashSet_ : nullptr);
+    // with defer_content_test, only the basic info of the files is loaded here and
+    // the details are queried later with loadDetails() for the files being shown.
+    defer_content_test = fm_config->defer_content_test || isLarge_;
+    pendingDetails_.clear();
+    stale_ = false;
+    // the saved files are shown at once, and the new listing is compared with them like refresh()
+    diffListing_ = usesSnapshot() && loadSnapshot();
+    dirlist_job = new DirListJob(dirPath_, dirListFlags(), hasCutFiles() ? cutFilesHashSet_ : nullptr);
     dirlist_job->setAutoDelete(true);
+    dirlist_job->setSnapshotRecording(usesSnapshot());
     connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
-    connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::BlockingQueuedConnection);
-
-#if 0
-    if(wants_incremental) {
-        g_signal_connect(dirlist_job, "files-found", G_CALLBACK(on_dirlist_job_files_found), folder);
+    connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::QueuedConnection);
+    connect(dirlist_job, &DirListJob::searchProgress, this, &Folder::searchProgress, Qt::QueuedConnection);
+    // the diff needs the complete listing
+    if(wants_incremental && !diffListing_) {
+        // show the files found so far while the folder is still being loaded
+        dirlist_job->setIncremental(true);
+        // the worker queues the batches without waiting for the main thread to add them
+        auto job = dirlist_job;
+        auto results = ResultQueue<FileInfoList>::create(this, [this, job](std::vector<FileInfoList>& batches) {
+            onDirListFilesFound(job, batches);
+        });
+        connect(dirlist_job, &DirListJob::filesFound, [results](FileInfoList& files) {
+            results->push(std::move(files));
+        });
     }
-    fm_dir_list_job_set_incremental(dirlist_job, wants_incremental);
-#endif
 
+    if(prefetching_) {
+        dirlist_job->setPriority(Job::Priority::BACKGROUND);
+    }
     dirlist_job->runAsync();
 
     /* also reload filesystem info.
@@ -749,41 +1290,20 @@ bool Folder::is_incremental(FmFolder* folder) {
 #endif
 
 bool Folder::getFilesystemInfo(uint64_t* total_size, uint64_t* free_size) const {
-    if(has_fs_info) {
-        *total_size = fs_total_size;
-        *free_size = fs_free_size;
-        return true;
-    }
-    return false;
+    return fsInfoCache_->info(dirPath_, total_size, free_size);
 }
 
-
-void Folder::onFileSystemInfoFinished() {
-    FileSystemInfoJob* job = static_cast<FileSystemInfoJob*>(sender());
-    if(job->isCancelled() || job != fsInfoJob_) { // this is a cancelled job, ignore!
-        fsInfoJob_ = nullptr;
-        has_fs_info = false;
-        return;
+void Folder::onFileSystemInfoChanged(const std::string& filesystemId) {
+    // the info is shared by all folders on the filesystem
+    if(filesystemId == fsInfoCache_->filesystemId(dirPath_)) {
+        filesystem_info_pending = true;
+        queueUpdate();
     }
-    has_fs_info = job->isAvailable();
-    fs_total_size = job->size();
-    fs_free_size = job->freeSize();
-    filesystem_info_pending = true;
-    fsInfoJob_ = nullptr;
-    queueUpdate();
 }
 
-
 void Folder::queryFilesystemInfo() {
-    // G_LOCK(query);
-    if(fsInfoJob_)
-        return;
-    fsInfoJob_ = new FileSystemInfoJob{dirPath_};
-    fsInfoJob_->setAutoDelete(true);
-    connect(fsInfoJob_, &FileSystemInfoJob::finished, this, &Folder::onFileSystemInfoFinished, Qt::BlockingQueuedConnection);
-
-    fsInfoJob_->runAsync();
-    // G_UNLOCK(query);
+    // the queries of the folders on the same filesystem are merged and rate-limited by the cache
+    fsInfoCache_->refresh(dirPath_);
 }
 
 
@@ -880,18 +1400,192 @@ void Folder::content_changed(FmFolder* folder) {
  * 4. Some limitations come from Linux/inotify. If FAM/gamin is used,
  *    the condition may be different. More testing is needed.
  */
-void Folder::onMountAdded(const Mount& mnt) {
+#ifdef __linux__
+// the network filesystems on which inotify only reports the changes made by this host
+static bool isNetworkFilesystem(const char* path) {
+    struct statfs st;
+    if(statfs(path, &st) != 0) {
+        return false;
+    }
+    switch(static_cast<std::uint32_t>(st.f_type)) {
+    case 0x6969: // NFS
+    case 0x517B: // SMB
+    case 0xFF534D42: // CIFS
+    case 0xFE534D42: // SMB2
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
+void Folder::createMonitor() {
+    bool isNative = dirPath_.isNative();
+    if(isNative && maxMonitors_ > 0 && nativeMonitors_ >= maxMonitors_) {
+        // the inotify watches would run out and the monitor would silently not work, so it's polled instead
+        qDebug("too many file monitors, polling %s", dirPath_.toString().get());
+        return;
+    }
+    // FIXME: should we make this cancellable?
+    GError* err = nullptr;
+    dirMonitor_ = GFileMonitorPtr{
+            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err),
+            false
+    };
+
+    if(dirMonitor_) {
+        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+        if(isNative) {
+            ++nativeMonitors_;
+            Stats::add(Stats::DIR_MONITORS, 1);
+        }
+    }
+    else {
+        qDebug("file monitor cannot be created: %s", err->message);
+        g_error_free(err);
+    }
+}
+
+void Folder::releaseMonitor() {
+    if(dirMonitor_) {
+        g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
+        dirMonitor_.reset();
+        if(dirPath_.isNative()) {
+            --nativeMonitors_;
+            Stats::add(Stats::DIR_MONITORS, -1);
+        }
+    }
+}
+
+void Folder::restoreMonitor() {
+    monitorReleased_ = false;
+    releaseIdleMonitors();
+    createMonitor();
+    // the changes while it's not monitored are found by comparing with a new listing
+    queueReload(true);
+}
+
+bool Folder::needsPolling() const {
+    if(dirPath_.hasUriScheme("search")) {
+        return false;
+    }
+    if(!dirMonitor_) {
+        return true;
+    }
+#ifdef __linux__
+    if(dirPath_.isNative()) {
+        return isNetworkFilesystem(dirPath_.localPath().get());
+    }
+#endif
+    return false;
+}
+
+void Folder::startPolling() {
+    if(pollCancellable_) {
+        g_cancellable_cancel(pollCancellable_.get());
+        pollCancellable_.reset();
+    }
+    polledMtime_ = polledCtime_ = 0;
+    if(!needsPolling()) {
+        pollTimer_.stop();
+        return;
+    }
+    // the first query is done with the listing, so the changes after it are noticed
+    pollDirChanges();
+}
+
+void Folder::pollDirChanges() {
+    if(pollCancellable_) {
+        return; // the last query is not finished yet
+    }
+    pollCancellable_ = GCancellablePtr{g_cancellable_new(), false};
+    GioAsync::queryInfo(dirPath_,
+                        G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                        G_FILE_ATTRIBUTE_TIME_CHANGED "," G_FILE_ATTRIBUTE_TIME_CHANGED_USEC,
+                        G_FILE_QUERY_INFO_NONE, pollCancellable_, this, [this](GFileInfoPtr& inf, GErrorPtr& err) {
+        // cancelled by startPolling(), which starts a new query
+        if(!inf && err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED) {
+            return;
+        }
+        onPollInfo(inf);
+    }, G_PRIORITY_LOW);
+}
+
+void Folder::onPollInfo(const GFileInfoPtr& inf) {
+    pollCancellable_.reset();
+    bool changed = false;
+    if(inf) { // if the folder can't be reached, it's queried again later
+        guint64 mtime = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                        + g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        guint64 ctime = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_CHANGED) * G_USEC_PER_SEC
+                        + g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TIME_CHANGED_USEC);
+        changed = (polledMtime_ != 0 || polledCtime_ != 0) && (mtime != polledMtime_ || ctime != polledCtime_);
+        polledMtime_ = mtime;
+        polledCtime_ = ctime;
+    }
+    if(changed) {
+        pollInterval_ = std::max(minPollInterval, pollInterval_ / 2);
+        // the running listing will have the changes
+        if(!dirlist_job) {
+            refresh();
+        }
+    }
+    else {
+        pollInterval_ = std::min(maxPollInterval, pollInterval_ * 3 / 2);
+    }
+    pollTimer_.start(pollInterval_);
+}
+
+void Folder::updateMountWatch() {
+    if(dirMonitor_ && dirPath_.isNative()) {
+        if(volumeManager_) {
+            volumeManager_->disconnect(this);
+            volumeManager_.reset();
+        }
+        // the unix mount monitor only reads the mount table, unlike the volume monitor
+        static GUnixMountMonitor* mountMonitor = nullptr;
+        if(!mountMonitor) {
+            mountMonitor = g_unix_mount_monitor_get();
+            g_signal_connect(mountMonitor, "mounts-changed", G_CALLBACK(onUnixMountsChanged), nullptr);
+        }
+        struct stat st;
+        dirDevice_ = stat(dirPath_.localPath().get(), &st) == 0 ? st.st_dev : 0;
+    }
+    else {
+        dirDevice_ = 0;
+        if(!volumeManager_) {
+            volumeManager_ = VolumeManager::globalInstance();
+            connect(volumeManager_.get(), &VolumeManager::mountRemoved, this, &Folder::onMountRemoved);
+        }
+    }
+}
+
+// static
+void Folder::onUnixMountsChanged() {
     /* If a filesystem is mounted over an existing folder,
      * we need to refresh the content of the folder to reflect
      * the changes. Besides, we need to create a new GFileMonitor
      * for the newly-mounted filesystem as the inode already changed.
      * GFileMonitor cannot detect this kind of changes caused by mounting.
-     * So let's do it ourselves. */
-    auto mountRoot = mnt.root();
-    if(mountRoot.isPrefixOf(dirPath_)) {
-        queueReload();
+     * So let's do it ourselves: the device of the folder is changed then. */
+    std::vector<std::shared_ptr<Folder>> folders;
+    {
+        std::lock_guard<std::mutex> lock{cacheMutex_};
+        for(auto cache : {&cache_, &dirsOnlyCache_}) {
+            for(auto& item : *cache) {
+                auto folder = item.second.lock();
+                if(folder && folder->dirDevice_ != 0) {
+                    folders.emplace_back(std::move(folder));
+                }
+            }
+        }
+    }
+    for(auto& folder : folders) {
+        struct stat st;
+        if(stat(folder->dirPath_.localPath().get(), &st) == 0 && std::uint64_t(st.st_dev) != folder->dirDevice_) {
+            folder->queueReload();
+        }
     }
-    /* g_debug("FmFolder::mount_added"); */
 }
 
 void Folder::onMountRemoved(const Mount& mnt) {
@@ -24,23 +24,29 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include <list>
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 #include <mutex>
 #include <functional>
 
 #include <QObject>
 #include <QtGlobal>
+#include <QElapsedTimer>
+#include <QTimer>
 #include "../libfmqtglobals.h"
 
 #include "gioptrs.h"
 #include "fileinfo.h"
+#include "fileinfonameset.h"
 #include "job.h"
+#include "dirlistjob.h"
 #include "volumemanager.h"
 
 namespace Fm {
 
-class DirListJob;
-class FileSystemInfoJob;
+class FileSystemInfoCache;
 class FileInfoJob;
 
 
@@ -56,6 +62,55 @@ public:
 
     static std::shared_ptr<Folder> fromPath(const FilePath& path);
 
+    // the folder of the path if it's already loaded, or nullptr. Unlike fromPath(), no folder is created.
+    static std::shared_ptr<Folder> findByPath(const FilePath& path);
+
+    // A folder which only lists the sub dirs of the path, for the views which ignore other files.
+    // Other files are skipped without stat() when possible. If a full folder of the path is loaded
+    // already, it's returned instead, so the callers should still filter the files themselves.
+    static std::shared_ptr<Folder> dirsFromPath(const FilePath& path);
+
+    // Start listing the folder with the background priority, before the user is likely to open it.
+    // Unlike fromPath(), the folder is not retained by the cache, so its listing is cancelled once
+    // the returned pointer is released, unless it's opened with fromPath() meanwhile, which moves
+    // the listing to the normal priority. A folder already in the cache is returned as it is.
+    static std::shared_ptr<Folder> prefetch(const FilePath& path);
+
+    bool isDirsOnly() const {
+        return dirsOnly_;
+    }
+
+    // Keep strong references to the recently used folders, so their contents and file monitors
+    // are kept after the last user releases them and revisiting them is instant.
+    // The cache is bounded by the number of folders (0 disables it) and optionally by the
+    // total number of files in them and by their total memoryUsage() (0 means no limit).
+    static void setMaxCachedFolders(size_t count);
+
+    static size_t maxCachedFolders();
+
+    static void setMaxCachedFiles(size_t count);
+
+    static size_t maxCachedFiles();
+
+    static void setMaxCachedMemory(size_t bytes);
+
+    static size_t maxCachedMemory();
+
+    // The most file monitors of local folders, which use the inotify watches limited by
+    // /proc/sys/fs/inotify/max_user_watches. By default it's half of the limit, leaving the rest
+    // to the other apps, and 0 means no limit. When a folder is opened while all of them are used,
+    // the monitors of the cached folders nobody uses are released first, and those folders are
+    // refreshed when they're opened again. If there are none, the new folder is polled instead.
+    static void setMaxMonitors(size_t count);
+
+    static size_t maxMonitors();
+
+    // release all folders retained by the cache
+    static void clearCache();
+
+    // the number of the folders in the cache which are alive, and the number of them retained by the cache
+    static void cacheCounts(size_t& cachedFolders, size_t& retainedFolders);
+
     bool makeDirectory(const char* name, GError** error);
 
     void queryFilesystemInfo();
@@ -64,6 +119,30 @@ public:
 
     void reload();
 
+    // List the folder again in the background and only emit the differences with the current
+    // content. Unchanged FileInfo objects are kept, so the views keep their thumbnails and selections.
+    void refresh();
+
+    // Opt-in stale-while-revalidate opening of remote folders: the listing of a remote folder is saved
+    // in the cache dir when it's loaded, and when the folder is loaded again, the saved files are shown
+    // at once while the folder is listed again in the background, like refresh().
+    static void setSnapshotsEnabled(bool enabled);
+
+    static bool snapshotsEnabled();
+
+    // Opt-in sharing of the listings of big local folders between the processes using libfm-qt,
+    // such as a file manager and the file dialogs of other apps. The listing of a big local folder
+    // is saved like the snapshots of remote folders, and other processes show it at once
+    // when they load the folder, while they list it again in the background.
+    static void setSharedListingsEnabled(bool enabled);
+
+    static bool sharedListingsEnabled();
+
+    // true while the files are from the saved listing and the new listing is not finished yet
+    bool isStale() const {
+        return stale_;
+    }
+
     bool isIncremental() const;
 
     bool isValid() const;
@@ -72,10 +151,21 @@ public:
 
     std::shared_ptr<const FileInfo> fileByName(const char* name) const;
 
+    // The approximate number of bytes used by the files of the folder, which is updated as they
+    // change. A FileInfo object shared with other folders or views is counted by each folder.
+    // The total of all folders is Stats::FOLDER_MEMORY_BYTES.
+    size_t memoryUsage() const {
+        return memoryUsage_;
+    }
+
     bool isEmpty() const;
 
     FileInfoList files() const;
 
+    // An immutable snapshot of the current files shared by all callers. It's only rebuilt
+    // after the content of the folder changes, so calling it repeatedly does not copy anything.
+    std::shared_ptr<const FileInfoList> filesSnapshot() const;
+
     const FilePath& path() const;
 
     const std::shared_ptr<const FileInfo> &info() const;
@@ -84,12 +174,50 @@ public:
 
     bool hasCutFiles();
 
-    void setCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet);
+    void setCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet);
+
+    // query the details of a file which has only its basic info loaded (see FileInfo::isPartial()).
+    // filesChanged() is emitted when the details are available.
+    void loadDetails(const std::shared_ptr<const FileInfo>& file);
+
+    // The changes reported by the file monitor are processed in batches. While the changes
+    // keep coming, the delay before processing the next batch grows up to this value.
+    static void setMaxUpdateDelay(int msec);
+
+    static int maxUpdateDelay();
+
+    // If more than this number of changes are pending, the folder is reloaded instead.
+    static void setReloadThreshold(size_t count);
+
+    static size_t reloadThreshold();
+
+    // A folder with at least this number of files is large, and it's listed with FAST so the types of
+    // the files are only found from their names, and the details are loaded for the shown files only.
+    // The views also switch to cheaper strategies while it's large, see largeChanged().
+    // The folder stays large until it has less than half of it. 0 means no folder is large.
+    static void setLargeThreshold(size_t count);
+
+    static size_t largeThreshold();
+
+    bool isLarge() const {
+        return isLarge_;
+    }
+
+    // While a bulk file operation writes into the folder, the changes of its files reported by the file
+    // monitor are dropped, and the folder is refreshed once after the last operation ends.
+    // The calls can be nested and should be paired.
+    void beginBulkUpdate();
+
+    void endBulkUpdate();
+
+    bool isInBulkUpdate() const {
+        return bulkUpdates_ > 0;
+    }
 
     void forEachFile(std::function<void (const std::shared_ptr<const FileInfo>&)> func) const {
         std::lock_guard<std::mutex> lock{mutex_};
-        for(auto it = files_.begin(); it != files_.end(); ++it) {
-            func(it->second);
+        for(const auto& file: files_) {
+            func(file);
         }
     }
 
@@ -98,6 +226,9 @@ Q_SIGNALS:
 
     void finishLoading();
 
+    // The lists of the changed files are shared by all the receivers, which are called directly.
+    // They should be taken by reference, since a receiver taking one by value copies the whole list,
+    // with a reference count update per file.
     void filesAdded(FileInfoList& addedFiles);
 
     void filesChanged(std::vector<FileInfoPair>& changePairs);
@@ -114,6 +245,12 @@ Q_SIGNALS:
 
     void fileSystemChanged();
 
+    // the folder becomes large or small, see setLargeThreshold()
+    void largeChanged(bool large);
+
+    // the numbers of the files checked and found so far while a search:// folder is loaded
+    void searchProgress(unsigned int scannedFiles, unsigned int matchedFiles);
+
     // FIXME: this API design is bad. We leave this here to be compatible with the old libfm C API.
     // It might be better to remember the error state while loading the folder, and let the user of the
     // API handle the error on finish.
@@ -128,25 +265,80 @@ private:
     void onDirChanged(GFileMonitorEvent event_type);
 
     void queueUpdate();
-    void queueReload();
+
+    // report the change of the number of pending changes to Stats
+    void countPendingChanges();
+
+    // check the number of files against largeThreshold() after the files are changed
+    void updateLarge();
+
+    // add or replace a file in files_, and update the memory usage
+    void insertFile(const std::shared_ptr<const FileInfo>& file);
+    // the approximate bytes of an entry of files_
+    static size_t fileMemoryUsage(const FileInfo& file);
+    void addMemoryUsage(std::int64_t delta);
+    void queueReload(bool refreshOnly = false);
+
+    // The folders without a working file monitor, such as the remote ones and the local ones on
+    // NFS or SMB whose changes by other hosts are not reported, are polled instead. The mtime and
+    // ctime of the dir are queried regularly, and the folder is refreshed only when they're changed.
+    // The interval is shortened after a change and lengthened while nothing is changed.
+    bool needsPolling() const;
+    void createMonitor();
+    void releaseMonitor();
+    // called when a folder whose monitor is released is opened again
+    void restoreMonitor();
+    // release the monitors of the folders only retained by the cache while too many monitors are used.
+    // cacheMutex_ should be locked.
+    static void releaseIdleMonitors();
+    void startPolling();
+    void pollDirChanges();
+    void onPollInfo(const GFileInfoPtr& inf);
+
+    static void retainInCache(const std::shared_ptr<Folder>& folder, std::vector<std::shared_ptr<Folder>>& evicted);
+    static void trimCache(std::vector<std::shared_ptr<Folder>>& evicted);
 
     bool eventFileAdded(const FilePath &path);
     bool eventFileChanged(const FilePath &path);
     void eventFileDeleted(const FilePath &path);
 
+    void addDirListFiles(const FileInfoList& infos);
+
+    // the batches of the files found by an incremental DirListJob, handed over by a ResultQueue
+    void onDirListFilesFound(DirListJob* job, std::vector<FileInfoList>& batches);
+
+    void applyDirListDiff(const FileInfoList& infos);
+
+    DirListJob::Flags dirListFlags() const;
+
+    // whether the listings of this folder are saved with FolderSnapshot
+    bool usesSnapshot() const;
+
+    // show the files of the saved listing, and returns false if there's none
+    bool loadSnapshot();
+
+    // save the listing of a big local folder for the other processes, see setSharedListingsEnabled()
+    void saveSharedListing();
+
 private Q_SLOTS:
 
     void processPendingChanges();
 
     void onDirListFinished();
 
-    void onFileSystemInfoFinished();
+    void onFileSystemInfoChanged(const std::string& filesystemId);
 
     void onFileInfoFinished();
 
     void onIdleReload();
 
-    void onMountAdded(const Mount& mnt);
+    // Watch the mounts which the dir monitor can't notice. The dir monitor can't notice a
+    // filesystem mounted over a local folder, which is checked when the mounts are changed.
+    // A folder without a dir monitor can't notice its unmount, so it watches the removed mounts
+    // of the VolumeManager, which is only created for such folders.
+    void updateMountWatch();
+
+    static void onUnixMountsChanged();
 
     void onMountRemoved(const Mount& mnt);
 
@@ -157,38 +349,69 @@ private:
     std::shared_ptr<const FileInfo> dirInfo_;
     DirListJob* dirlist_job;
     std::vector<FileInfoJob*> fileinfoJobs_;
-    FileSystemInfoJob* fsInfoJob_;
+    std::shared_ptr<FileSystemInfoCache> fsInfoCache_;
 
-    std::shared_ptr<VolumeManager> volumeManager_;
+    std::shared_ptr<VolumeManager> volumeManager_; // only used by the folders without dir monitors
+    std::uint64_t dirDevice_; // the device of a local dir, 0 if it's unknown
 
     /* for file monitor */
     bool has_idle_reload_handler;
+    bool idleReloadIsRefresh_;
     bool has_idle_update_handler;
-    std::vector<FilePath> paths_to_add;
-    std::vector<FilePath> paths_to_update;
-    std::vector<FilePath> paths_to_del;
+    // hash sets so that duplicated events in an event storm can be coalesced cheaply
+    FilePathSet paths_to_add;
+    FilePathSet paths_to_update;
+    FilePathSet paths_to_del;
+    std::unordered_set<std::string> pendingDetails_; // names of partial files whose details are requested
     // GSList* pending_jobs;
     bool pending_change_notify;
     bool filesystem_info_pending;
 
     bool wants_incremental;
+    bool dirsOnly_; // created by dirsFromPath()
+    bool prefetching_; // created by prefetch(), and not opened by fromPath() yet
+    bool diffListing_; // the running DirListJob is started by refresh()
+    bool stale_; // the files are from the saved listing, see isStale()
+    bool isLarge_;
+    bool monitorReleased_; // released by releaseIdleMonitors()
     bool stop_emission; /* don't set it 1 bit to not lock other bits */
+    int updateDelay_; // current delay before processing the pending changes
+    int bulkUpdates_; // number of running bulk operations, see beginBulkUpdate()
+    bool bulkChanged_; // some changes are dropped during the bulk operations
+    size_t countedPendingChanges_; // the pending changes added to Stats::PENDING_MONITOR_EVENTS
+    std::atomic<size_t> memoryUsage_; // also read by trimCache() in other threads
+    QElapsedTimer lastUpdateTime_;
+    QTimer pollTimer_;
+    int pollInterval_; // in milliseconds
+    GCancellablePtr pollCancellable_;
+    guint64 polledMtime_; // in microseconds, 0 before the first query
+    guint64 polledCtime_;
+
+    FileInfoNameSet files_;
+    mutable std::shared_ptr<const FileInfoList> filesSnapshot_;
+    mutable std::mutex mutex_; // protects the pending changes and files of this folder
 
-    std::unordered_map<const std::string, std::shared_ptr<const FileInfo>, std::hash<std::string>> files_;
-
-    /* filesystem info - set in query thread, read in main */
-    uint64_t fs_total_size;
-    uint64_t fs_free_size;
-    GCancellablePtr fs_size_cancellable;
-
-    bool has_fs_info : 1;
     bool defer_content_test : 1;
 
     static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> cache_;
+    static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> dirsOnlyCache_;
+    static std::list<std::shared_ptr<Folder>> lru_; // strong references to recently used folders
+    static size_t maxCachedFolders_;
+    static size_t maxCachedFiles_;
+    static size_t maxCachedMemory_;
     static QString cutFilesDirPath_;
     static QString lastCutFilesDirPath_;
-    static std::shared_ptr<const HashSet> cutFilesHashSet_;
-    static std::mutex mutex_;
+    static std::shared_ptr<const CutFileSet> cutFilesHashSet_;
+    static std::mutex cacheMutex_; // protects cache_ and lru_
+    static int maxUpdateDelay_;
+    static size_t reloadThreshold_;
+    static size_t largeThreshold_;
+    // the large folders found so far, which are listed with FAST from the start when they're loaded again
+    static std::unordered_set<FilePath, FilePathHash> largeDirs_; // protected by cacheMutex_
+    static bool snapshotsEnabled_;
+    static bool sharedListingsEnabled_;
+    static size_t maxMonitors_;
+    static size_t nativeMonitors_; // the file monitors of the local folders
 };
 
 }
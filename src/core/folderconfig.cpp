@@ -10,22 +10,311 @@
  * opened first, then required operations performed, then closed. Each
  * opened descriptor holds a lock on the cache so it is not adviced to
  * keep it somewhere.
+ *
+ * The settings of the folders without a .directory file are kept in a
+ * database, which is a log of records appended to a file. Each record holds
+ * all the settings of one folder, and the last record of a folder is the
+ * current one. The records are indexed by the folder paths in memory, and the
+ * changed ones are appended to the file when the cache is saved. The file is
+ * compacted when most of its records are outdated.
  */
 
 #include "folderconfig.h"
+#include "jobtrace_p.h"
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 
 namespace Fm {
 
 CStrPtr FolderConfig::globalConfigFile_;
 
-// FIXME: sharing the same keyfile object everywhere is problematic
-// FIXME: this is MT-unsafe
-static GKeyFile* fc_cache = nullptr;
-static bool fc_cache_changed = FALSE;
+static const char fcDbMagic[8] = {'F', 'M', 'D', 'I', 'R', 'D', 'B', '1'};
+// the group of the keyfile created for a folder in the database
+static const char fcDbGroup[] = "Folder";
+// the file is compacted if the outdated records take more than this and half of the file
+static const gsize fcDbMinGarbage = 64 * 1024;
+// saveCacheLater() waits for this long without new calls before writing the file, but not more than fcMaxSaveDelay
+static const std::chrono::milliseconds fcSaveDelay{2000};
+static const std::chrono::milliseconds fcMaxSaveDelay{10000};
+
+// the entries are accessed in the main thread, and written to the file in a worker thread
+struct FolderConfigDb {
+    FolderConfigDb():
+        fileSize{0},
+        liveSize{0},
+        needsCompaction{false} {
+    }
+
+    // what's written to the file by a save
+    struct Write {
+        bool compact; // the whole file is replaced
+        std::string data;
+        gsize expectedSize; // the size of the file to append to
+    };
+
+    std::mutex mutex; // locked while the entries or the pending records are used
+    std::string filePath;
+    std::unordered_map<std::string, std::string> entries; // folder path => the keys of the group
+    std::string pending; // the records which are not written yet
+    gsize fileSize; // the valid part of the file
+    gsize liveSize; // the size of the records of the current entries
+    bool needsCompaction;
+
+    static gsize recordSize(const std::string& key, const std::string& data) {
+        return 2 * sizeof(guint32) + key.length() + data.length();
+    }
+
+    static void appendRecord(std::string& out, const std::string& key, const std::string& data) {
+        guint32 len = key.length();
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out += key;
+        len = data.length();
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out += data;
+    }
+
+    // empty data removes the folder
+    void set(const std::string& key, std::string data) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto it = entries.find(key);
+        if(it != entries.end()) {
+            if(it->second == data) {
+                return;
+            }
+            liveSize -= recordSize(key, it->second);
+        }
+        appendRecord(pending, key, data);
+        if(data.empty()) {
+            if(it != entries.end()) {
+                entries.erase(it);
+            }
+        }
+        else {
+            liveSize += recordSize(key, data);
+            if(it != entries.end()) {
+                it->second = std::move(data);
+            }
+            else {
+                entries.emplace(key, std::move(data));
+            }
+        }
+    }
+
+    bool load() {
+        char* contents;
+        gsize len;
+        if(!g_file_get_contents(filePath.c_str(), &contents, &len, nullptr)) {
+            return false;
+        }
+        if(len < sizeof(fcDbMagic) || memcmp(contents, fcDbMagic, sizeof(fcDbMagic)) != 0) {
+            g_free(contents);
+            return false;
+        }
+        gsize pos = sizeof(fcDbMagic);
+        entries.clear();
+        liveSize = 0;
+        for(;;) {
+            // a record which is not completely written is ignored
+            guint32 keyLen, dataLen;
+            if(len - pos < sizeof(keyLen)) {
+                break;
+            }
+            memcpy(&keyLen, contents + pos, sizeof(keyLen));
+            if(len - pos - sizeof(keyLen) < gsize(keyLen) + sizeof(dataLen)) {
+                break;
+            }
+            std::string key{contents + pos + sizeof(keyLen), keyLen};
+            memcpy(&dataLen, contents + pos + sizeof(keyLen) + keyLen, sizeof(dataLen));
+            gsize dataPos = pos + sizeof(keyLen) + keyLen + sizeof(dataLen);
+            if(len - dataPos < dataLen) {
+                break;
+            }
+            auto it = entries.find(key);
+            if(it != entries.end()) {
+                liveSize -= recordSize(key, it->second);
+                entries.erase(it);
+            }
+            if(dataLen > 0) {
+                std::string data{contents + dataPos, dataLen};
+                liveSize += recordSize(key, data);
+                entries.emplace(std::move(key), std::move(data));
+            }
+            pos = dataPos + dataLen;
+        }
+        fileSize = pos;
+        // the broken tail is removed by rewriting the file
+        needsCompaction = (pos != len);
+        g_free(contents);
+        return true;
+    }
+
+    // called with the mutex locked
+    bool takeWrite(Write& w) {
+        if(pending.empty() && !needsCompaction) {
+            return false;
+        }
+        w.compact = needsCompaction || fileSize + pending.length() - sizeof(fcDbMagic) > 2 * liveSize + fcDbMinGarbage;
+        if(w.compact) {
+            w.data.assign(fcDbMagic, sizeof(fcDbMagic));
+            w.data.reserve(sizeof(fcDbMagic) + liveSize);
+            for(const auto& entry: entries) {
+                appendRecord(w.data, entry.first, entry.second);
+            }
+        }
+        else { // only the changed folders are appended
+            w.data.swap(pending);
+        }
+        pending.clear();
+        needsCompaction = false;
+        w.expectedSize = fileSize;
+        return true;
+    }
+
+    // the file is written without locking the mutex
+    bool writeFile(const Write& w) const {
+        if(w.compact) {
+            // replaced atomically, so the file is never left half written
+            GErrorPtr err;
+            CStrPtr dir{g_path_get_dirname(filePath.c_str())};
+            g_mkdir_with_parents(dir.get(), 0700);
+            if(!g_file_set_contents(filePath.c_str(), w.data.c_str(), w.data.length(), &err)) {
+                g_warning("cannot save %s: %s", filePath.c_str(), err->message);
+                return false;
+            }
+            g_chmod(filePath.c_str(), 0600);
+            return true;
+        }
+        int fd = ::open(filePath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if(fd < 0) {
+            return false;
+        }
+        // if the file is changed by others, or the last write failed, it's rewritten
+        struct stat st;
+        if(fstat(fd, &st) != 0 || gsize(st.st_size) != w.expectedSize) {
+            ::close(fd);
+            return false;
+        }
+        const char* p = w.data.c_str();
+        gsize left = w.data.length();
+        while(left > 0) {
+            auto n = write(fd, p, left);
+            if(n < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                g_warning("cannot save %s: %s", filePath.c_str(), g_strerror(errno));
+                ::close(fd);
+                return false;
+            }
+            p += n;
+            left -= n;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    bool save() {
+        // if appending fails, the whole file is written again
+        for(int attempt = 0; attempt < 2; ++attempt) {
+            Write w;
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                if(!takeWrite(w)) {
+                    return true;
+                }
+            }
+            bool ok = writeFile(w);
+            std::lock_guard<std::mutex> lock{mutex};
+            if(ok) {
+                fileSize = w.compact ? w.data.length() : w.expectedSize + w.data.length();
+                return true;
+            }
+            needsCompaction = true;
+        }
+        return false;
+    }
+
+    // import the settings saved in the keyfile by the older versions
+    void migrate(GKeyFile* kf) {
+        gsize n_groups;
+        CStrArrayPtr groups{g_key_file_get_groups(kf, &n_groups)};
+        for(gsize i = 0; i < n_groups; ++i) {
+            GKeyFile* folder_kf = g_key_file_new();
+            CStrArrayPtr keys{g_key_file_get_keys(kf, groups[i], nullptr, nullptr)};
+            for(auto key = keys.get(); key && *key; ++key) {
+                CStrPtr value{g_key_file_get_value(kf, groups[i], *key, nullptr)};
+                if(value) {
+                    g_key_file_set_value(folder_kf, fcDbGroup, *key, value.get());
+                }
+            }
+            set(groups[i], keyFileData(folder_kf));
+            g_key_file_free(folder_kf);
+        }
+        needsCompaction = true;
+    }
+
+    // the keys of the group in the keyfile of a folder, which are saved in its record
+    static std::string keyFileData(GKeyFile* kf) {
+        std::string data;
+        if(g_key_file_has_group(kf, fcDbGroup)) {
+            gsize len;
+            CStrPtr out{g_key_file_to_data(kf, &len, nullptr)};
+            if(out) {
+                const char* keys = strchr(out.get(), '\n'); // skip the group line
+                if(keys) {
+                    data = keys + 1;
+                }
+            }
+        }
+        return data;
+    }
+};
+
+static FolderConfigDb* fc_db = nullptr;
+
+// the worker thread which saves the database
+static std::thread fc_writer;
+static std::mutex fc_writer_mutex;
+static std::condition_variable fc_writer_cond;
+static bool fc_save_requested = false;
+static bool fc_writer_quit = false;
+static std::chrono::steady_clock::time_point fc_first_request; // the first saveCacheLater() since the last write
+static std::chrono::steady_clock::time_point fc_last_request;
+
+static void fc_writer_thread() {
+    std::unique_lock<std::mutex> lock{fc_writer_mutex};
+    for(;;) {
+        fc_writer_cond.wait(lock, []() {
+            return fc_save_requested || fc_writer_quit;
+        });
+        if(!fc_save_requested) { // quit
+            break;
+        }
+        // wait until saveCacheLater() is not called for a while
+        while(!fc_writer_quit) {
+            auto deadline = std::min(fc_last_request + fcSaveDelay, fc_first_request + fcMaxSaveDelay);
+            if(fc_writer_cond.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
+            }
+        }
+        fc_save_requested = false;
+        lock.unlock();
+        fc_db->save();
+        lock.lock();
+    }
+}
 
 FolderConfig::FolderConfig():
     keyFile_{nullptr},
@@ -68,13 +357,22 @@ bool FolderConfig::open(const Fm::FilePath& path) {
         }
     }
 
+    if(!fc_db) { // FolderConfig::init() is not called
+        return false;
+    }
+
     // No per-folder config file.
-    // use the global key file instead and use the folder path as group key
+    // use the database instead, and make a small keyfile with the settings of the folder
     configFilePath_.reset();
-    group_ = path.toString();
-
-    // FIXME: we should use ref counting here. glib 2.36+ supports g_key_file_ref()
-    keyFile_ = fc_cache;
+    cacheKey_ = path.toString().get();
+    group_ = CStrPtr{g_strdup(fcDbGroup)};
+    keyFile_ = g_key_file_new();
+    std::lock_guard<std::mutex> lock{fc_db->mutex};
+    auto it = fc_db->entries.find(cacheKey_);
+    if(it != fc_db->entries.end()) {
+        std::string data = std::string{"["} + fcDbGroup + "]\n" + it->second;
+        g_key_file_load_from_data(keyFile_, data.c_str(), data.length(), G_KEY_FILE_NONE, nullptr);
+    }
     return true;
 }
 
@@ -100,10 +398,12 @@ bool FolderConfig::close(GErrorPtr& err) {
         g_key_file_free(keyFile_);
     }
     else {
-        group_.reset();
         if(changed_) {
-            fc_cache_changed = TRUE;
+            fc_db->set(cacheKey_, FolderConfigDb::keyFileData(keyFile_));
         }
+        group_.reset();
+        cacheKey_.clear();
+        g_key_file_free(keyFile_);
     }
     keyFile_ = nullptr;
     return ret;
@@ -233,42 +533,80 @@ void FolderConfig::purge() {
 
 // static
 void FolderConfig::saveCache(void) {
-    char* out;
-    gsize len;
-
-    /* if per-directory cache was changed since last invocation then save it */
-    if(fc_cache_changed && (out = g_key_file_to_data(fc_cache, &len, nullptr))) {
-        /* FIXME: create dir */
-        /* create temp file with settings */
-        GFilePtr gfile{g_file_new_for_path(globalConfigFile_.get()), false};
-        GErrorPtr err;
-        /* do safe replace now, the file is important enough to be lost */
-        if(g_file_replace_contents(gfile.get(), out, len, nullptr, true, G_FILE_CREATE_PRIVATE, nullptr, nullptr, &err)) {
-            fc_cache_changed = FALSE;
+    BlockingScope scope{"FolderConfig::saveCache"};
+    if(!fc_db) {
+        return;
+    }
+    // the requested save is done by the worker immediately when it quits
+    if(fc_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock{fc_writer_mutex};
+            fc_writer_quit = true;
         }
-        else {
-            g_warning("cannot save %s: %s", globalConfigFile_.get(), err->message);
+        fc_writer_cond.notify_one();
+        fc_writer.join();
+    }
+    /* if per-directory cache was changed since last invocation then save it */
+    fc_db->save();
+}
+
+// static
+void FolderConfig::saveCacheLater(void) {
+    if(!fc_db) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{fc_writer_mutex};
+    auto now = std::chrono::steady_clock::now();
+    if(!fc_save_requested) {
+        fc_save_requested = true;
+        fc_first_request = now;
+    }
+    fc_last_request = now;
+    if(!fc_writer.joinable()) {
+        static bool exitHandlerAdded = false;
+        if(!exitHandlerAdded) {
+            // the worker is joined before the static std::thread is destroyed, even without finalize()
+            exitHandlerAdded = true;
+            std::atexit([]() {
+                saveCache();
+            });
         }
-        g_free(out);
+        fc_writer_quit = false;
+        fc_writer = std::thread{fc_writer_thread};
     }
+    fc_writer_cond.notify_one();
 }
 
 // static
 void FolderConfig::finalize(void) {
     saveCache();
-    g_key_file_free(fc_cache);
-    fc_cache = nullptr;
+    delete fc_db;
+    fc_db = nullptr;
 }
 
 // static
 void FolderConfig::init(const char* globalConfigFile) {
     globalConfigFile_ = CStrPtr{g_strdup(globalConfigFile)};
-    fc_cache = g_key_file_new();
-    if(!g_key_file_load_from_file(fc_cache, globalConfigFile_.get(), G_KEY_FILE_NONE, nullptr)) {
-        // fail to load the config file.
-        // fallback to the legacy libfm config file for backward compatibility
-        CStrPtr legacyConfigFlie{g_build_filename(g_get_user_config_dir(), "libfm/dir-settings.conf", nullptr)};
-        g_key_file_load_from_file(fc_cache, legacyConfigFlie.get(), G_KEY_FILE_NONE, nullptr);
+    // the database is saved beside the config file, e.g. dir-settings.db for dir-settings.conf
+    fc_db = new FolderConfigDb();
+    fc_db->filePath = globalConfigFile;
+    if(g_str_has_suffix(globalConfigFile, ".conf")) {
+        fc_db->filePath.erase(fc_db->filePath.length() - 5);
+    }
+    fc_db->filePath += ".db";
+    if(!fc_db->load()) {
+        // there's no database yet, so import the config file of the older versions once.
+        // The config file is kept for them.
+        GKeyFile* kf = g_key_file_new();
+        if(!g_key_file_load_from_file(kf, globalConfigFile_.get(), G_KEY_FILE_NONE, nullptr)) {
+            // fail to load the config file.
+            // fallback to the legacy libfm config file for backward compatibility
+            CStrPtr legacyConfigFlie{g_build_filename(g_get_user_config_dir(), "libfm/dir-settings.conf", nullptr)};
+            g_key_file_load_from_file(kf, legacyConfigFlie.get(), G_KEY_FILE_NONE, nullptr);
+        }
+        fc_db->migrate(kf);
+        g_key_file_free(kf);
+        fc_db->save();
     }
 }
 
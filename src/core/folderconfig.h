@@ -7,6 +7,7 @@
 #include "gioptrs.h"
 
 #include <cstdint>
+#include <string>
 
 namespace Fm {
 
@@ -59,8 +60,14 @@ public:
 
     static void finalize();
 
+    // save the changed settings now and wait for it, which is also done by finalize()
     static void saveCache(void);
 
+    // Save the changed settings later in a worker thread. The calls made within a short time are
+    // combined into one write, so this can be called after each change. A pending save is done by
+    // saveCache(), finalize() or at exit.
+    static void saveCacheLater(void);
+
 // the object cannot be copied.
 private:
     FolderConfig(const FolderConfig& other) = delete;
@@ -68,8 +75,9 @@ private:
 
 private:
     GKeyFile *keyFile_;
-    CStrPtr group_; /* allocated if not in cache */
+    CStrPtr group_;
     CStrPtr configFilePath_; /* NULL if in cache */
+    std::string cacheKey_; /* the folder path if in cache */
     bool changed_;
 
     static CStrPtr globalConfigFile_;
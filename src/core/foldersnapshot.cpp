@@ -0,0 +1,209 @@
+#include "foldersnapshot_p.h"
+#include "fileinfo_p.h"
+#include "jobtrace_p.h"
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+// (version, URI, time of the listing, detailed, [{attribute: value}])
+static const char snapshotType[] = "(usxbaa{sv})";
+static const guint32 snapshotVersion = 1;
+// the GIcon objects are saved with g_icon_serialize() and marked by this tag
+static const char iconTag[] = "icon";
+
+static GVariant* attributeToVariant(GFileInfo* inf, const char* attribute) {
+    switch(g_file_info_get_attribute_type(inf, attribute)) {
+    case G_FILE_ATTRIBUTE_TYPE_STRING: {
+        const char* str = g_file_info_get_attribute_string(inf, attribute);
+        return str && g_utf8_validate(str, -1, nullptr) ? g_variant_new_string(str) : nullptr;
+    }
+    case G_FILE_ATTRIBUTE_TYPE_BYTE_STRING:
+        return g_variant_new_bytestring(g_file_info_get_attribute_byte_string(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_BOOLEAN:
+        return g_variant_new_boolean(g_file_info_get_attribute_boolean(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_UINT32:
+        return g_variant_new_uint32(g_file_info_get_attribute_uint32(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_INT32:
+        return g_variant_new_int32(g_file_info_get_attribute_int32(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_UINT64:
+        return g_variant_new_uint64(g_file_info_get_attribute_uint64(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_INT64:
+        return g_variant_new_int64(g_file_info_get_attribute_int64(inf, attribute));
+    case G_FILE_ATTRIBUTE_TYPE_STRINGV: {
+        char** strv = g_file_info_get_attribute_stringv(inf, attribute);
+        return strv ? g_variant_new_strv(strv, -1) : nullptr;
+    }
+    case G_FILE_ATTRIBUTE_TYPE_OBJECT: {
+        GObject* obj = g_file_info_get_attribute_object(inf, attribute);
+        if(obj && G_IS_ICON(obj)) {
+            if(GVariant* icon = g_icon_serialize(G_ICON(obj))) {
+                GVariant* value = g_variant_new("(sv)", iconTag, icon);
+                g_variant_unref(icon);
+                return value;
+            }
+        }
+        return nullptr;
+    }
+    default: // other objects and the invalid attributes are not saved
+        return nullptr;
+    }
+}
+
+static void setAttributeFromVariant(GFileInfo* inf, const char* attribute, GVariant* value) {
+    if(g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        g_file_info_set_attribute_string(inf, attribute, g_variant_get_string(value, nullptr));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_BYTESTRING)) {
+        g_file_info_set_attribute_byte_string(inf, attribute, g_variant_get_bytestring(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        g_file_info_set_attribute_boolean(inf, attribute, g_variant_get_boolean(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+        g_file_info_set_attribute_uint32(inf, attribute, g_variant_get_uint32(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_INT32)) {
+        g_file_info_set_attribute_int32(inf, attribute, g_variant_get_int32(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64)) {
+        g_file_info_set_attribute_uint64(inf, attribute, g_variant_get_uint64(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_INT64)) {
+        g_file_info_set_attribute_int64(inf, attribute, g_variant_get_int64(value));
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY)) {
+        const char** strv = g_variant_get_strv(value, nullptr);
+        g_file_info_set_attribute_stringv(inf, attribute, const_cast<char**>(strv));
+        g_free(strv);
+    }
+    else if(g_variant_is_of_type(value, G_VARIANT_TYPE("(sv)"))) {
+        const char* tag;
+        GVariant* serialized;
+        g_variant_get(value, "(&sv)", &tag, &serialized);
+        if(strcmp(tag, iconTag) == 0) {
+            GIconPtr icon{g_icon_deserialize(serialized), false};
+            if(icon) {
+                g_file_info_set_attribute_object(inf, attribute, G_OBJECT(icon.get()));
+            }
+        }
+        g_variant_unref(serialized);
+    }
+}
+
+// static
+std::string FolderSnapshot::snapshotFilePath(const FilePath& dirPath) {
+    auto uri = dirPath.uri();
+    CStrPtr hash{g_compute_checksum_for_string(G_CHECKSUM_MD5, uri.get(), -1)};
+    CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "snapshots", hash.get(), nullptr)};
+    return path.get();
+}
+
+// static
+bool FolderSnapshot::save(const FilePath& dirPath, const std::vector<GFileInfoPtr>& infos, bool detailed) {
+    TraceSpan span{"FolderSnapshot::save"};
+    span.addCount(infos.size());
+    GVariantBuilder files;
+    g_variant_builder_init(&files, G_VARIANT_TYPE("aa{sv}"));
+    for(const auto& inf: infos) {
+        g_variant_builder_open(&files, G_VARIANT_TYPE_VARDICT);
+        char** attributes = g_file_info_list_attributes(inf.get(), nullptr);
+        for(char** attribute = attributes; attribute && *attribute; ++attribute) {
+            if(GVariant* value = attributeToVariant(inf.get(), *attribute)) {
+                g_variant_builder_add(&files, "{sv}", *attribute, value);
+            }
+        }
+        g_strfreev(attributes);
+        g_variant_builder_close(&files);
+    }
+    auto uri = dirPath.uri();
+    GVariant* snapshot = g_variant_ref_sink(g_variant_new(snapshotType, snapshotVersion, uri.get(),
+                                                          g_get_real_time() / G_USEC_PER_SEC, detailed, &files));
+
+    // the old file might still be mapped by another process, so a new file is written and renamed
+    QString path = QString::fromLocal8Bit(snapshotFilePath(dirPath).c_str());
+    QDir().mkpath(QFileInfo{path}.absolutePath());
+    QSaveFile file{path};
+    bool saved = false;
+    if(file.open(QIODevice::WriteOnly)) {
+        file.write(static_cast<const char*>(g_variant_get_data(snapshot)), g_variant_get_size(snapshot));
+        saved = file.commit();
+    }
+    g_variant_unref(snapshot);
+    return saved;
+}
+
+// static
+FileInfoList FolderSnapshot::load(const FilePath& dirPath, const std::shared_ptr<const CutFileSet>& cutFilesHashSet) {
+    BlockingScope blocking{"FolderSnapshot::load"};
+    FileInfoList files;
+    QFile file{QString::fromLocal8Bit(snapshotFilePath(dirPath).c_str())};
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return files;
+    }
+    auto data = file.map(0, file.size());
+    if(!data) {
+        return files;
+    }
+    // The data is not trusted, and GVariant checks it while reading. The values are copied
+    // out of the mapped file, which is unmapped when it's closed.
+    GVariant* snapshot = g_variant_ref_sink(g_variant_new_from_data(G_VARIANT_TYPE(snapshotType), data, file.size(),
+                                                                    FALSE, nullptr, nullptr));
+    guint32 version;
+    const char* uri;
+    gint64 time;
+    gboolean detailed;
+    GVariantIter* fileIter;
+    g_variant_get(snapshot, "(u&sxbaa{sv})", &version, &uri, &time, &detailed, &fileIter);
+    // the hash of another URI might be the same
+    if(version == snapshotVersion && strcmp(uri, dirPath.uri().get()) == 0) {
+        GVariantIter* attributeIter;
+        FileInfoIconMemo iconMemo;
+        while(g_variant_iter_next(fileIter, "a{sv}", &attributeIter)) {
+            GFileInfoPtr inf{g_file_info_new(), false};
+            const char* attribute;
+            GVariant* value;
+            while(g_variant_iter_next(attributeIter, "{&sv}", &attribute, &value)) {
+                setAttributeFromVariant(inf.get(), attribute, value);
+                g_variant_unref(value);
+            }
+            g_variant_iter_free(attributeIter);
+            if(!g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_NAME)) {
+                continue;
+            }
+            auto fileInfo = std::make_shared<FileInfo>();
+            fileInfo->setFromGFileInfo(inf, dirPath, &iconMemo);
+            fileInfo->isPartial_ = !detailed;
+            if(cutFilesHashSet && cutFilesHashSet->contains(dirPath, fileInfo->name())) {
+                fileInfo->bindCutFiles(cutFilesHashSet);
+            }
+            files.push_back(std::move(fileInfo));
+        }
+    }
+    g_variant_iter_free(fileIter);
+    g_variant_unref(snapshot);
+    return files;
+}
+
+// static
+void FolderSnapshot::remove(const FilePath& dirPath) {
+    unlink(snapshotFilePath(dirPath).c_str());
+}
+
+// static
+bool FolderSnapshot::isNewerThanDir(const FilePath& dirPath) {
+    auto localPath = dirPath.localPath();
+    struct stat dirStat, snapshotStat;
+    if(!localPath || stat(localPath.get(), &dirStat) != 0 || stat(snapshotFilePath(dirPath).c_str(), &snapshotStat) != 0) {
+        return false;
+    }
+    return snapshotStat.st_mtim.tv_sec > dirStat.st_mtim.tv_sec
+           || (snapshotStat.st_mtim.tv_sec == dirStat.st_mtim.tv_sec && snapshotStat.st_mtim.tv_nsec > dirStat.st_mtim.tv_nsec);
+}
+
+} // namespace Fm
@@ -0,0 +1,39 @@
+#ifndef FM2_FOLDERSNAPSHOT_P_H
+#define FM2_FOLDERSNAPSHOT_P_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "gioptrs.h"
+#include "filepath.h"
+#include "fileinfo.h"
+
+namespace Fm {
+
+// The saved listing of a remote folder, which is shown at once when the folder is opened again,
+// before the folder is listed again in the background.
+// The GFileInfo objects of the listing are stored as a serialized GVariant in the cache dir of the
+// user, with a file per URI, and the file is mapped into memory while it's read.
+class FolderSnapshot {
+public:
+    // Save the listing of the folder. detailed is false if the infos are from a FAST listing.
+    // It's called in the thread of the DirListJob.
+    static bool save(const FilePath& dirPath, const std::vector<GFileInfoPtr>& infos, bool detailed);
+
+    // the saved files of the folder, or an empty list if there's no valid snapshot
+    static FileInfoList load(const FilePath& dirPath, const std::shared_ptr<const CutFileSet>& cutFilesHashSet);
+
+    // delete the saved listing of the folder
+    static void remove(const FilePath& dirPath);
+
+    // true if the saved listing of a local folder is written after the folder is changed last time,
+    // so no file has been added, removed or renamed since then
+    static bool isNewerThanDir(const FilePath& dirPath);
+
+private:
+    static std::string snapshotFilePath(const FilePath& dirPath);
+};
+
+} // namespace Fm
+
+#endif // FM2_FOLDERSNAPSHOT_P_H
@@ -0,0 +1,149 @@
+#include "gioasync.h"
+#include <QPointer>
+#include <memory>
+
+namespace Fm {
+
+namespace GioAsync {
+
+namespace {
+
+// The state of an operation, which is freed when it's finished. The callbacks are dropped
+// if the context object is deleted.
+struct Operation {
+    Operation(const FilePath& path, const GCancellablePtr& cancellable, QObject* context):
+        path{path},
+        cancellable{cancellable},
+        context{context},
+        hasContext{context != nullptr} {
+    }
+
+    bool isContextAlive() const {
+        return !hasContext || context;
+    }
+
+    FilePath path;
+    GCancellablePtr cancellable;
+    QPointer<QObject> context;
+    bool hasContext;
+};
+
+struct InfoOperation: Operation {
+    InfoOperation(const FilePath& path, const GCancellablePtr& cancellable, QObject* context, InfoCallback callback):
+        Operation{path, cancellable, context},
+        callback{std::move(callback)} {
+    }
+
+    InfoCallback callback;
+};
+
+struct EnumerateOperation: Operation {
+    EnumerateOperation(const FilePath& path, const GCancellablePtr& cancellable, QObject* context, int batchSize,
+                       int priority, ChildrenCallback onFiles, DoneCallback onDone):
+        Operation{path, cancellable, context},
+        batchSize{batchSize},
+        priority{priority},
+        onFiles{std::move(onFiles)},
+        onDone{std::move(onDone)} {
+    }
+
+    void finish(GErrorPtr& err) {
+        // closing it in the dispose of the enumerator would block
+        if(enumerator) {
+            g_file_enumerator_close_async(enumerator.get(), priority, nullptr, nullptr, nullptr);
+        }
+        if(isContextAlive()) {
+            onDone(err);
+        }
+    }
+
+    int batchSize;
+    int priority;
+    GFileEnumeratorPtr enumerator;
+    ChildrenCallback onFiles;
+    DoneCallback onDone;
+};
+
+void onInfoReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    std::unique_ptr<InfoOperation> op{static_cast<InfoOperation*>(user_data)};
+    GErrorPtr err;
+    GFileInfoPtr info{g_file_query_info_finish(G_FILE(source), res, &err), false};
+    if(op->isContextAlive()) {
+        op->callback(info, err);
+    }
+}
+
+void onFilesystemInfoReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    std::unique_ptr<InfoOperation> op{static_cast<InfoOperation*>(user_data)};
+    GErrorPtr err;
+    GFileInfoPtr info{g_file_query_filesystem_info_finish(G_FILE(source), res, &err), false};
+    if(op->isContextAlive()) {
+        op->callback(info, err);
+    }
+}
+
+void onNextFilesReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    std::unique_ptr<EnumerateOperation> op{static_cast<EnumerateOperation*>(user_data)};
+    GErrorPtr err;
+    GList* list = g_file_enumerator_next_files_finish(G_FILE_ENUMERATOR(source), res, &err);
+    std::vector<GFileInfoPtr> infos;
+    for(GList* l = list; l; l = l->next) {
+        infos.emplace_back(G_FILE_INFO(l->data), false);
+    }
+    g_list_free(list);
+    if(err || infos.empty() || !op->isContextAlive()) { // the end of the enumeration
+        op->finish(err);
+        return;
+    }
+    if(!op->onFiles(infos)) {
+        op->finish(err);
+        return;
+    }
+    auto enumerator = op->enumerator.get();
+    auto cancellable = op->cancellable.get();
+    int batchSize = op->batchSize;
+    int priority = op->priority;
+    g_file_enumerator_next_files_async(enumerator, batchSize, priority, cancellable, &onNextFilesReady, op.release());
+}
+
+void onEnumeratorReady(GObject* source, GAsyncResult* res, gpointer user_data) {
+    std::unique_ptr<EnumerateOperation> op{static_cast<EnumerateOperation*>(user_data)};
+    GErrorPtr err;
+    op->enumerator = GFileEnumeratorPtr{g_file_enumerate_children_finish(G_FILE(source), res, &err), false};
+    if(!op->enumerator || !op->isContextAlive()) {
+        op->finish(err);
+        return;
+    }
+    auto enumerator = op->enumerator.get();
+    auto cancellable = op->cancellable.get();
+    int batchSize = op->batchSize;
+    int priority = op->priority;
+    g_file_enumerator_next_files_async(enumerator, batchSize, priority, cancellable, &onNextFilesReady, op.release());
+}
+
+} // namespace
+
+void queryInfo(const FilePath& path, const char* attributes, GFileQueryInfoFlags flags,
+               const GCancellablePtr& cancellable, QObject* context, InfoCallback callback, int priority) {
+    auto op = new InfoOperation{path, cancellable, context, std::move(callback)};
+    g_file_query_info_async(op->path.gfile().get(), attributes, flags, priority, cancellable.get(), &onInfoReady, op);
+}
+
+void queryFilesystemInfo(const FilePath& path, const char* attributes,
+                         const GCancellablePtr& cancellable, QObject* context, InfoCallback callback, int priority) {
+    auto op = new InfoOperation{path, cancellable, context, std::move(callback)};
+    g_file_query_filesystem_info_async(op->path.gfile().get(), attributes, priority, cancellable.get(),
+                                       &onFilesystemInfoReady, op);
+}
+
+void enumerateChildren(const FilePath& path, const char* attributes, GFileQueryInfoFlags flags,
+                       const GCancellablePtr& cancellable, QObject* context, int batchSize,
+                       ChildrenCallback onFiles, DoneCallback onDone, int priority) {
+    auto op = new EnumerateOperation{path, cancellable, context, batchSize, priority, std::move(onFiles), std::move(onDone)};
+    g_file_enumerate_children_async(op->path.gfile().get(), attributes, flags, priority, cancellable.get(),
+                                    &onEnumeratorReady, op);
+}
+
+} // namespace GioAsync
+
+} // namespace Fm
@@ -0,0 +1,48 @@
+#ifndef FM2_GIOASYNC_H
+#define FM2_GIOASYNC_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <functional>
+#include <vector>
+#include "gioptrs.h"
+#include "filepath.h"
+
+namespace Fm {
+
+// Asynchronous file operations which run the *_async()/*_finish() calls of GIO on the main context
+// of the calling thread, instead of a thread per operation like Job::runAsync().
+// The calling thread should run a GLib main loop, which the GUI thread of Qt does.
+// The callbacks are called in that thread, and they are not called at all if the context object is
+// deleted meanwhile, so they can capture it. A cancelled operation reports G_IO_ERROR_CANCELLED.
+namespace GioAsync {
+
+typedef std::function<void (GFileInfoPtr& info, GErrorPtr& err)> InfoCallback;
+
+// g_file_query_info_async()
+LIBFM_QT_API void queryInfo(const FilePath& path, const char* attributes, GFileQueryInfoFlags flags,
+                            const GCancellablePtr& cancellable, QObject* context, InfoCallback callback,
+                            int priority = G_PRIORITY_DEFAULT);
+
+// g_file_query_filesystem_info_async()
+LIBFM_QT_API void queryFilesystemInfo(const FilePath& path, const char* attributes,
+                                      const GCancellablePtr& cancellable, QObject* context, InfoCallback callback,
+                                      int priority = G_PRIORITY_DEFAULT);
+
+// called with each batch of the enumerated files, and returns false to stop the enumeration
+typedef std::function<bool (std::vector<GFileInfoPtr>& infos)> ChildrenCallback;
+// called once when the enumeration is finished, with the error if it failed
+typedef std::function<void (GErrorPtr& err)> DoneCallback;
+
+// g_file_enumerate_children_async() followed by g_file_enumerator_next_files_async() until the end.
+// The next batch is requested after the callback of the last one returns.
+LIBFM_QT_API void enumerateChildren(const FilePath& path, const char* attributes, GFileQueryInfoFlags flags,
+                                    const GCancellablePtr& cancellable, QObject* context, int batchSize,
+                                    ChildrenCallback onFiles, DoneCallback onDone,
+                                    int priority = G_PRIORITY_DEFAULT);
+
+} // namespace GioAsync
+
+} // namespace Fm
+
+#endif // FM2_GIOASYNC_H
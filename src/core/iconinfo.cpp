@@ -1,12 +1,33 @@
 #include "iconinfo.h"
 #include "iconinfo_p.h"
 #include <string.h>
+#include <algorithm>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QCoreApplication>
 
 namespace Fm {
 
 std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, IconInfo::GIconHash, IconInfo::GIconEqual> IconInfo::cache_;
 std::mutex IconInfo::mutex_;
+IconInfo::CacheStats IconInfo::cacheStats_ = {0, 0, 0, 0};
+std::size_t IconInfo::nextEviction_ = 0;
 QList<QIcon> IconInfo::fallbackQicons_;
+int IconInfo::deferredRendering_ = 0;
+std::atomic<unsigned int> IconInfo::themeSerial_{0};
+
+// the time spent on rendering the deferred icons before the events are processed again
+static const int renderTimeSlice = 10; // msecs
+// the number of rendered pixmaps kept for an icon
+static const size_t maxRenderedPixmaps = 8;
+// the unused icons are not removed from the cache before it has this many icons
+static const size_t minEvictionCacheSize = 512;
+
+static bool isGuiThread() {
+    auto app = QCoreApplication::instance();
+    return app && QThread::currentThread() == app->thread();
+}
 
 static const char* fallbackIconNames[] = {
     "unknown",
@@ -48,8 +69,15 @@ std::shared_ptr<const IconInfo> IconInfo::fromGIcon(GIconPtr gicon) {
         std::lock_guard<std::mutex> lock{mutex_};
         auto it = cache_.find(gicon.get());
         if(it != cache_.end()) {
+            ++cacheStats_.hits;
             return it->second;
         }
+        ++cacheStats_.misses;
+        // the cache is allowed to grow to twice its size after the last eviction
+        if(cache_.size() >= std::max(nextEviction_, minEvictionCacheSize) && isGuiThread()) {
+            evictUnused();
+            nextEviction_ = cache_.size() * 2;
+        }
         // not found in the cache, create a new entry for it.
         auto icon = std::make_shared<IconInfo>(std::move(gicon));
         cache_.insert(std::make_pair(icon->gicon_.get(), icon));
@@ -58,12 +86,53 @@ std::shared_ptr<const IconInfo> IconInfo::fromGIcon(GIconPtr gicon) {
     return std::shared_ptr<const IconInfo>{};
 }
 
+// static
+IconInfo::CacheStats IconInfo::cacheStats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    CacheStats stats = cacheStats_;
+    stats.size = cache_.size();
+    return stats;
+}
+
+// static
+void IconInfo::purgeCache() {
+    if(!isGuiThread()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    evictUnused();
+    nextEviction_ = cache_.size() * 2;
+}
+
+// static
+void IconInfo::evictUnused() {
+    for(auto it = cache_.begin(); it != cache_.end();) {
+        const auto& info = it->second;
+        // The QIcons have weak references to the icon, so they're checked too. They're only
+        // created and copied in the GUI thread.
+        if(info.use_count() == 1
+                && (info->qicon_.isNull() || info->qicon_.isDetached())
+                && (info->qiconTransparent_.isNull() || info->qiconTransparent_.isDetached())) {
+            it = cache_.erase(it);
+            ++cacheStats_.evicted;
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
 void IconInfo::updateQIcons() {
+    if(isGuiThread()) {
+        purgeCache();
+    }
     std::lock_guard<std::mutex> lock{mutex_};
     for(auto& elem: cache_) {
         auto& info = elem.second;
         info->internalQicons_.clear();
+        info->pixmaps_.clear();
     }
+    ++themeSerial_;
 }
 
 QIcon IconInfo::qicon(const bool& transparent) const {
@@ -145,6 +214,77 @@ QIcon IconInfo::internalQicon() const {
     return ret_icon;
 }
 
+QPixmap IconInfo::renderedPixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) const {
+    if(deferredRendering_ == 0) {
+        return internalQicon().pixmap(size, mode, state);
+    }
+    // the same pixmap is rendered only once
+    for(const auto& rendered: pixmaps_) {
+        if(rendered.size == size && rendered.mode == mode && rendered.state == state) {
+            return rendered.pixmap;
+        }
+    }
+    if(pixmaps_.size() >= maxRenderedPixmaps) {
+        auto it = std::find_if(pixmaps_.begin(), pixmaps_.end(), [](const RenderedPixmap& rendered) {
+            return !rendered.pending;
+        });
+        if(it != pixmaps_.end()) {
+            pixmaps_.erase(it);
+        }
+    }
+    pixmaps_.push_back(RenderedPixmap{size, mode, state, QPixmap{}, true});
+    IconPixmapLoader::instance()->queue(shared_from_this());
+    return QPixmap{};
+}
+
+void IconInfo::renderPendingPixmaps() const {
+    for(auto& rendered: pixmaps_) {
+        if(rendered.pending) {
+            rendered.pixmap = internalQicon().pixmap(rendered.size, rendered.mode, rendered.state);
+            rendered.pending = false;
+        }
+    }
+}
+
+IconPixmapLoader::IconPixmapLoader():
+    timer_{new QTimer(this)} {
+    timer_->setSingleShot(true);
+    connect(timer_, &QTimer::timeout, this, &IconPixmapLoader::renderQueued);
+}
+
+// static
+IconPixmapLoader* IconPixmapLoader::instance() {
+    static IconPixmapLoader* loader = new IconPixmapLoader();
+    return loader;
+}
+
+void IconPixmapLoader::queue(std::shared_ptr<const IconInfo> info) {
+    if(std::find(queue_.cbegin(), queue_.cend(), info) == queue_.cend()) {
+        queue_.push_back(std::move(info));
+    }
+    if(!timer_->isActive()) {
+        timer_->start(0);
+    }
+}
+
+void IconPixmapLoader::renderQueued() {
+    QElapsedTimer elapsed;
+    elapsed.start();
+    bool rendered = false;
+    while(!queue_.empty() && elapsed.elapsed() < renderTimeSlice) {
+        auto info = std::move(queue_.front());
+        queue_.pop_front();
+        info->renderPendingPixmaps();
+        rendered = true;
+    }
+    if(!queue_.empty()) {
+        timer_->start(0);
+    }
+    if(rendered) {
+        Q_EMIT pixmapsReady();
+    }
+}
+
 // compatibility function for leagcy libfm
 // FIXME: deprecate this later.
 extern "C" GIcon* _fm_icon_from_name(const char* name) {
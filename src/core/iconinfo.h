@@ -30,9 +30,15 @@
 #include "gioptrs.h"
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <unordered_map>
 #include <forward_list>
+#include <vector>
+#include <deque>
 #include <QIcon>
+#include <QObject>
+
+class QTimer;
 
 
 namespace Fm {
@@ -40,6 +46,20 @@ namespace Fm {
 class LIBFM_QT_API IconInfo: public std::enable_shared_from_this<IconInfo> {
 public:
     friend class IconEngine;
+    friend class IconPixmapLoader;
+
+    // While an object of this class exists, the icons of qicon() which are not rendered in the
+    // requested sizes yet are not drawn, but rendered later without blocking the painting.
+    // IconPixmapLoader::pixmapsReady() is emitted when they're ready, so the views can be repainted.
+    class LIBFM_QT_API DeferredRendering {
+    public:
+        DeferredRendering() {
+            ++deferredRendering_;
+        }
+        ~DeferredRendering() {
+            --deferredRendering_;
+        }
+    };
 
     explicit IconInfo() {}
 
@@ -59,6 +79,24 @@ public:
 
     static void updateQIcons();
 
+    // changed by updateQIcons(), so the pixmaps rendered for the old icon theme can be dropped
+    static unsigned int themeSerial() {
+        return themeSerial_;
+    }
+
+    struct CacheStats {
+        std::size_t size;     // the number of cached icons
+        std::size_t hits;     // the lookups which found a cached icon
+        std::size_t misses;   // the lookups which created a new icon
+        std::size_t evicted;  // the icons removed from the cache since they're unused
+    };
+
+    static CacheStats cacheStats();
+
+    // Remove the icons which are only referred to by the cache. This is also done when the cache
+    // grows, but only in the GUI thread, since the QIcons created for the icons are checked too.
+    static void purgeCache();
+
     GIconPtr gicon() const {
         return gicon_;
     }
@@ -82,6 +120,23 @@ private:
     // actual QIcon loaded by QIcon::fromTheme
     QIcon internalQicon() const;
 
+    // the pixmap rendered from internalQicon(), which is null if it's deferred
+    QPixmap renderedPixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) const;
+
+    // render the deferred pixmaps
+    void renderPendingPixmaps() const;
+
+    struct RenderedPixmap {
+        QSize size;
+        QIcon::Mode mode;
+        QIcon::State state;
+        QPixmap pixmap;
+        bool pending;
+    };
+
+    // remove the unused icons, with the mutex locked
+    static void evictUnused();
+
     struct GIconHash {
         std::size_t operator()(GIcon* gicon) const {
             return g_icon_hash(gicon);
@@ -99,10 +154,41 @@ private:
     mutable QIcon qicon_;
     mutable QIcon qiconTransparent_;
     mutable QList<QIcon> internalQicons_;
+    mutable std::vector<RenderedPixmap> pixmaps_; // only used for the deferred rendering
 
     static std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, GIconHash, GIconEqual> cache_;
     static std::mutex mutex_;
+    static CacheStats cacheStats_;
+    static std::size_t nextEviction_; // the cache size which triggers the next eviction
     static QList<QIcon> fallbackQicons_;
+    static int deferredRendering_;
+    static std::atomic<unsigned int> themeSerial_;
+};
+
+// Renders the deferred icons in the GUI thread in short time slices, since the theme lookups
+// and the pixmaps of Qt can't be used in other threads.
+class LIBFM_QT_API IconPixmapLoader: public QObject {
+    Q_OBJECT
+public:
+    static IconPixmapLoader* instance();
+
+Q_SIGNALS:
+    // some deferred icons are rendered
+    void pixmapsReady();
+
+private:
+    friend class IconInfo;
+
+    explicit IconPixmapLoader();
+
+    // each icon is queued only once, no matter how many of its pixmaps are requested
+    void queue(std::shared_ptr<const IconInfo> info);
+
+    void renderQueued();
+
+private:
+    std::deque<std::shared_ptr<const IconInfo>> queue_;
+    QTimer* timer_;
 };
 
 } // namespace Fm
@@ -86,7 +86,17 @@ void IconEngine::paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, Q
             painter->save();
             painter->setOpacity(0.45);
         }
-        info->internalQicon().paint(painter, rect, Qt::AlignCenter, mode, state);
+        if(IconInfo::deferredRendering_ > 0) {
+            // draw nothing until the pixmap is rendered
+            QPixmap pixmap = info->renderedPixmap(rect.size(), mode, state);
+            if(!pixmap.isNull()) {
+                QSize size = pixmap.size() / pixmap.devicePixelRatio();
+                painter->drawPixmap(QRect{rect.topLeft() + QPoint{(rect.width() - size.width()) / 2, (rect.height() - size.height()) / 2}, size}, pixmap);
+            }
+        }
+        else {
+            info->internalQicon().paint(painter, rect, Qt::AlignCenter, mode, state);
+        }
         if(transparent_) {
             painter->restore();
         }
@@ -95,7 +105,7 @@ void IconEngine::paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, Q
 
 QPixmap IconEngine::pixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) {
     auto info = info_.lock();
-    return info ? info->internalQicon().pixmap(size, mode, state) : QPixmap{};
+    return info ? info->renderedPixmap(size, mode, state) : QPixmap{};
 }
 
 void IconEngine::virtual_hook(int id, void* data) {
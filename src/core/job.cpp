@@ -1,10 +1,135 @@
 #include "job.h"
 #include "job_p.h"
+#include "jobtrace_p.h"
+#include "stats.h"
+#include <thread>
+#include <algorithm>
 
 namespace Fm {
 
+thread_local JobExecutor::Worker* JobExecutor::currentWorker_ = nullptr;
+
+JobExecutor::JobExecutor():
+    idleWorkers_{0},
+    queuedJobs_{0} {
+    // most jobs wait for I/O, so there're more workers than cores
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    maxWorkers_ = std::min(size_t{32}, std::max(size_t{4}, cores * 2));
+}
+
+// static
+JobExecutor* JobExecutor::instance() {
+    // never deleted, since the workers are running till the process exits
+    static JobExecutor* executor = new JobExecutor();
+    return executor;
+}
+
+void JobExecutor::submit(Job* job, Job::Priority priority) {
+    auto worker = currentWorker_;
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(worker) {
+        std::lock_guard<std::mutex> workerLock{worker->mutex};
+        worker->jobs.push_back(job);
+    }
+    else {
+        queues_[int(priority)].push_back(job);
+    }
+    ++queuedJobs_;
+    Stats::set(Stats::QUEUED_JOBS, queuedJobs_);
+    if(idleWorkers_ < queuedJobs_ && workers_.size() < maxWorkers_) {
+        startWorker();
+    }
+    else {
+        cond_.notify_one();
+    }
+}
+
+bool JobExecutor::promote(const Job* job, Job::Priority priority) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for(int i = int(priority) + 1; i < int(Job::Priority::OWN_THREAD); ++i) {
+        auto& queue = queues_[i];
+        auto it = std::find(queue.begin(), queue.end(), job);
+        if(it != queue.end()) {
+            Job* queued = *it;
+            queue.erase(it);
+            queues_[int(priority)].push_back(queued);
+            return true;
+        }
+    }
+    return false;
+}
+
+// should be called with mutex_ locked
+void JobExecutor::startWorker() {
+    workers_.emplace_back(new Worker());
+    auto worker = workers_.back().get();
+    std::thread thread{[this, worker]() {
+        workerMain(worker);
+    }};
+    thread.detach();
+}
+
+void JobExecutor::workerMain(Worker* worker) {
+    currentWorker_ = worker;
+    for(;;) {
+        Job* job = takeJob(worker);
+        if(job) {
+            job->run();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock{mutex_};
+        ++idleWorkers_;
+        cond_.wait(lock, [this]() {
+            return queuedJobs_ > 0;
+        });
+        --idleWorkers_;
+    }
+}
+
+Job* JobExecutor::takeJob(Worker* worker) {
+    Job* job = nullptr;
+    {
+        // the latest job of its own, which is likely related to the job just finished
+        std::lock_guard<std::mutex> lock{worker->mutex};
+        if(!worker->jobs.empty()) {
+            job = worker->jobs.back();
+            worker->jobs.pop_back();
+        }
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!job) {
+        for(auto& queue : queues_) {
+            if(!queue.empty()) {
+                job = queue.front();
+                queue.pop_front();
+                break;
+            }
+        }
+    }
+    if(!job) {
+        // steal the oldest job of another worker
+        for(auto& other : workers_) {
+            if(other.get() == worker) {
+                continue;
+            }
+            std::lock_guard<std::mutex> otherLock{other->mutex};
+            if(!other->jobs.empty()) {
+                job = other->jobs.front();
+                other->jobs.pop_front();
+                break;
+            }
+        }
+    }
+    if(job) {
+        --queuedJobs_;
+        Stats::set(Stats::QUEUED_JOBS, queuedJobs_);
+    }
+    return job;
+}
+
 Job::Job():
-    paused_{false},
+    pauseState_{std::make_shared<PauseState>()},
+    priority_{Priority::INFO},
     cancellable_{g_cancellable_new(), false},
     cancellableHandler_{g_signal_connect(cancellable_.get(), "cancelled", G_CALLBACK(_onCancellableCancelled), this)} {
 }
@@ -16,20 +141,77 @@ Job::~Job() {
 }
 
 void Job::runAsync(QThread::Priority priority) {
-    auto thread = new JobThread(this);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
     if(autoDelete()) {
         connect(this, &Job::finished, this, &Job::deleteLater);
     }
-    thread->start(priority);
+    if(priority_ == Priority::OWN_THREAD) {
+        auto thread = new JobThread(this);
+        connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+        thread->start(priority);
+        return;
+    }
+    auto jobPriority = priority_;
+    if(priority <= QThread::LowPriority && jobPriority < Priority::BACKGROUND) {
+        jobPriority = Priority::BACKGROUND;
+    }
+    JobExecutor::instance()->submit(this, jobPriority);
 }
 
 void Job::cancel() {
     g_cancellable_cancel(cancellable_.get());
 }
 
+bool Job::pause() {
+    if(isCancelled()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock{pauseState_->mutex};
+    pauseState_->paused.store(true, std::memory_order_release);
+    return true;
+}
+
+void Job::resume() {
+    {
+        std::lock_guard<std::mutex> lock{pauseState_->mutex};
+        pauseState_->paused.store(false, std::memory_order_release);
+    }
+    pauseState_->resumed.notify_all();
+}
+
+bool Job::isPaused() const {
+    return pauseState_->paused.load(std::memory_order_acquire);
+}
+
+void Job::pauseWith(const Job& job) {
+    pauseState_ = job.pauseState_;
+}
+
+bool Job::waitIfPaused() {
+    auto& state = *pauseState_;
+    if(state.paused.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock{state.mutex};
+        state.resumed.wait(lock, [this, &state]() {
+            return !state.paused.load(std::memory_order_relaxed) || isCancelled();
+        });
+    }
+    return !isCancelled();
+}
+
+void Job::onCancellableCancelled(GCancellable* /*cancellable*/) {
+    // wake up the threads waiting at the pause points, the lock makes sure they don't miss it
+    {
+        std::lock_guard<std::mutex> lock{pauseState_->mutex};
+    }
+    pauseState_->resumed.notify_all();
+    Q_EMIT cancelled();
+}
+
 void Job::run() {
+    TraceSpan span{metaObject()->className()};
+    Stats::add(Stats::RUNNING_JOBS);
     exec();
+    Stats::add(Stats::RUNNING_JOBS, -1);
+    span.end();
     Q_EMIT finished();
 }
 
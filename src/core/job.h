@@ -36,7 +36,8 @@ namespace Fm {
 /*
  * Fm::Job can be used in several different modes.
  * 1. run with QThreadPool::start()
- * 2. call runAsync(), which will create a new QThread and move the object to the thread.
+ * 2. call runAsync(), which runs the job in the shared job executor, or in a new QThread
+ *    if its priority is OWN_THREAD.
  * 3. create a new QThread, and connect the started() signal to the slot Job::run()
  * 4. Directly call Job::run(), which executes synchrounously as a normal blocking call
 */
@@ -60,6 +61,15 @@ public:
         CRITICAL
     };
 
+    // The classes of the jobs run by runAsync(). The queued jobs of a higher class run first.
+    enum class Priority {
+        INTERACTIVE, // the listing of the folders being shown
+        INFO, // the queries of file info
+        THUMBNAIL,
+        BACKGROUND, // size scans and other things which are not waited for
+        OWN_THREAD // long jobs which might wait for the user, like file operations
+    };
+
     explicit Job();
 
     virtual ~Job();
@@ -68,12 +78,31 @@ public:
         return g_cancellable_is_cancelled(cancellable_.get());
     }
 
+    // Run the job in the shared job executor, which has a bounded number of threads.
+    // A low thread priority moves the job to the BACKGROUND class.
     void runAsync(QThread::Priority priority = QThread::InheritPriority);
 
+    Priority priority() const {
+        return priority_;
+    }
+
+    void setPriority(Priority priority) {
+        priority_ = priority;
+    }
+
+    // Pause the job at its next pause point. The jobs check them between files or chunks of data,
+    // and their threads wait there without using the CPU until the job is resumed or cancelled.
+    // Returns false if the job is already cancelled.
     bool pause();
 
     void resume();
 
+    bool isPaused() const;
+
+    // Pause and resume this job together with another job, such as the job running this one as a
+    // part of its work. It should be called before this job is started.
+    void pauseWith(const Job& job);
+
     const GCancellablePtr& cancellable() const {
         return cancellable_;
     }
@@ -81,6 +110,8 @@ public:
 Q_SIGNALS:
     void cancelled();
 
+    // emitted in the worker thread. With Qt::QueuedConnection, an auto-deleted job is still alive
+    // when the slots connected before runAsync() are called, since it's deleted with deleteLater().
     void finished();
 
     // this signal should be connected with Qt::BlockingQueuedConnection
@@ -93,6 +124,10 @@ public Q_SLOTS:
     void run() override;
 
 protected:
+    // A pause point, called by the threads of the job where it can stop safely.
+    // It blocks while the job is paused, and returns false if the job is cancelled.
+    bool waitIfPaused();
+
     ErrorAction emitError(const GErrorPtr& err, ErrorSeverity severity = ErrorSeverity::MODERATE);
 
     // all derived job subclasses should do their work in this method.
@@ -103,12 +138,13 @@ private:
         _this->onCancellableCancelled(cancellable);
     }
 
-    void onCancellableCancelled(GCancellable* /*cancellable*/) {
-        Q_EMIT cancelled();
-    }
+    void onCancellableCancelled(GCancellable* cancellable);
 
 private:
-    bool paused_;
+    struct PauseState;
+
+    std::shared_ptr<PauseState> pauseState_; // shared with the jobs set by pauseWith()
+    Priority priority_;
     GCancellablePtr cancellable_;
     gulong cancellableHandler_;
 };
@@ -2,10 +2,25 @@
 #define JOB_P_H
 
 #include <QThread>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include "job.h"
 
 namespace Fm {
 
+struct Job::PauseState {
+    PauseState(): paused{false} {
+    }
+
+    std::atomic<bool> paused; // checked by the pause points without locking
+    std::mutex mutex;
+    std::condition_variable resumed; // also notified when a job sharing the state is cancelled
+};
+
 class JobThread: public QThread {
     Q_OBJECT
 public:
@@ -21,6 +36,47 @@ protected:
     Job* job_;
 };
 
+// A bounded pool of worker threads shared by all the jobs run with Job::runAsync().
+// The jobs submitted by other threads are queued by their priority classes. The jobs submitted
+// by a job running in a worker are queued in the worker's own deque, which the idle workers
+// steal from. The workers are started on demand, so a light app only has a few of them.
+class JobExecutor {
+public:
+    static JobExecutor* instance();
+
+    void submit(Job* job, Job::Priority priority);
+
+    // Move a job waiting in a lower class to the given one. The job is only compared, so it might
+    // be freed already. Returns false if the job is not waiting in the queues of the classes.
+    bool promote(const Job* job, Job::Priority priority);
+
+private:
+    JobExecutor();
+
+    struct Worker {
+        std::mutex mutex; // protects jobs
+        std::deque<Job*> jobs;
+    };
+
+    void startWorker();
+
+    void workerMain(Worker* worker);
+
+    // the next job for the worker, nullptr if there's none
+    Job* takeJob(Worker* worker);
+
+private:
+    std::mutex mutex_; // protects all the members except the jobs of the workers
+    std::condition_variable cond_;
+    std::deque<Job*> queues_[int(Job::Priority::OWN_THREAD)];
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t maxWorkers_;
+    size_t idleWorkers_;
+    size_t queuedJobs_; // in all the queues
+
+    static thread_local Worker* currentWorker_;
+};
+
 } // namespace Fm
 
 #endif // JOB_P_H
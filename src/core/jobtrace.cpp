@@ -0,0 +1,258 @@
+#include "jobtrace_p.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <QCoreApplication>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+
+namespace Fm {
+
+// the spans kept in memory are limited, so tracing a long session can't use up the memory
+static const size_t maxTraceEvents = 1000000;
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    qint64 start;
+    qint64 duration;
+    std::uint64_t count;
+    int thread;
+};
+
+// collects the spans of all threads
+class TraceRecorder {
+public:
+    TraceRecorder():
+        startTime_{std::chrono::steady_clock::now()},
+        dropped_{false} {
+        const char* path = getenv("LIBFM_QT_TRACE");
+        if(path) {
+            path_ = path;
+        }
+    }
+
+    qint64 now() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime_).count();
+    }
+
+    void add(const TraceEvent& event) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(events_.size() < maxTraceEvents) {
+            events_.push_back(event);
+        }
+        else if(!dropped_) {
+            dropped_ = true;
+            qWarning("too many spans are traced, the later ones are dropped");
+        }
+    }
+
+    void write() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(path_.empty()) {
+            return;
+        }
+        FILE* file = fopen(path_.c_str(), "w");
+        if(!file) {
+            qWarning("failed to write the trace file %s", path_.c_str());
+            return;
+        }
+        int pid = getpid();
+        fputs("{\"traceEvents\":[\n", file);
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"libfm-qt\"}}", pid);
+        for(const auto& event: events_) {
+            // the names are string literals in the code, so they don't need to be escaped
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d",
+                    event.name, event.category, static_cast<long long>(event.start),
+                    static_cast<long long>(event.duration), pid, event.thread);
+            if(event.count > 0) {
+                fprintf(file, ",\"args\":{\"count\":%llu}", static_cast<unsigned long long>(event.count));
+            }
+            fputc('}', file);
+        }
+        fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+        fclose(file);
+    }
+
+private:
+    std::string path_;
+    std::chrono::steady_clock::time_point startTime_;
+    std::vector<TraceEvent> events_;
+    bool dropped_;
+    std::mutex mutex_;
+};
+
+} // namespace
+
+static void writeTrace() {
+    JobTrace::flush();
+}
+
+// The recorder is never freed since the detached threads of the jobs might still add spans while
+// the program exits, and the trace is written by an atexit() handler instead.
+static TraceRecorder& traceRecorder() {
+    static TraceRecorder* recorder = [] {
+        auto recorder = new TraceRecorder();
+        atexit(writeTrace);
+        return recorder;
+    }();
+    return *recorder;
+}
+
+// small numbers are easier to read in the trace viewers than the real thread ids
+static int traceThreadId() {
+    static std::atomic<int> lastThreadId{0};
+    thread_local int threadId = ++lastThreadId;
+    return threadId;
+}
+
+const bool JobTrace::enabled_ = qEnvironmentVariableIsSet("LIBFM_QT_TRACE");
+
+// static
+qint64 JobTrace::now() {
+    return traceRecorder().now();
+}
+
+// static
+void JobTrace::addSpan(const char* name, const char* category, qint64 start, qint64 end, std::uint64_t count) {
+    traceRecorder().add(TraceEvent{name, category, start, end - start, count, traceThreadId()});
+}
+
+// static
+void JobTrace::flush() {
+    if(enabled_) {
+        traceRecorder().write();
+    }
+}
+
+const bool StartupSpan::reportEnabled_ = qEnvironmentVariableIsSet("LIBFM_QT_STARTUP_REPORT");
+
+static qint64 startupClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StartupSpan::StartupSpan(const char* name):
+    span_{name, "startup"},
+    name_{name},
+    start_{reportEnabled_ ? startupClock() : -1} {
+}
+
+StartupSpan::~StartupSpan() {
+    if(start_ >= 0) {
+        qInfo("libfm-qt startup: %s took %.3f ms", name_, (startupClock() - start_) / 1000000.0);
+    }
+}
+
+static int stallThreshold() {
+    bool ok;
+    int msecs = qEnvironmentVariableIntValue("LIBFM_QT_STALL_WATCHDOG", &ok);
+    return ok && msecs > 0 ? msecs : 0;
+}
+
+const int StallWatchdog::thresholdMsecs_ = stallThreshold();
+
+// the state shared with the watchdog thread
+static std::atomic<qint64> lastHeartbeat{0}; // milliseconds of the steady clock
+static std::atomic<const char*> currentScope{nullptr};
+static std::atomic<QThread*> guiThread{nullptr};
+// The thread is only started and stopped by the GUI thread. It's not a static std::thread,
+// which would terminate the process at exit if LibFmQt is never destroyed.
+static std::thread* watchdogThread = nullptr;
+static QPointer<QTimer> heartbeatTimer;
+static std::mutex watchdogMutex; // protects watchdogStopping
+static std::condition_variable watchdogCond;
+static bool watchdogStopping = false;
+
+static qint64 steadyMsecs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void watchdogMain(int threshold) {
+    qint64 stallStart = -1; // the last heartbeat before the reported stall
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{watchdogMutex};
+            if(watchdogCond.wait_for(lock, std::chrono::milliseconds(threshold / 4 + 1), []() {
+                return watchdogStopping;
+            })) {
+                return;
+            }
+        }
+        qint64 beat = lastHeartbeat.load(std::memory_order_relaxed);
+        qint64 now = steadyMsecs();
+        if(stallStart < 0 && now - beat > threshold) {
+            stallStart = beat;
+            const char* scope = currentScope.load(std::memory_order_relaxed);
+            qWarning("libfm-qt: the GUI thread is blocked for %lld ms in %s", static_cast<long long>(now - beat),
+                     scope ? scope : "code without a BlockingScope");
+        }
+        else if(stallStart >= 0 && beat != stallStart) {
+            qWarning("libfm-qt: the GUI thread is blocked for %lld ms in total", static_cast<long long>(beat - stallStart));
+            if(JobTrace::isEnabled()) {
+                qint64 end = JobTrace::now();
+                JobTrace::addSpan("GUI thread stall", "stall", end - (beat - stallStart) * 1000, end);
+            }
+            stallStart = -1;
+        }
+    }
+}
+
+// static
+void StallWatchdog::start() {
+    if(!isEnabled() || !QCoreApplication::instance() || watchdogThread) {
+        return;
+    }
+    guiThread = QThread::currentThread();
+    lastHeartbeat = steadyMsecs();
+    // the timer only fires while the event loop of the GUI thread is running
+    heartbeatTimer = new QTimer(QCoreApplication::instance());
+    heartbeatTimer->setInterval(std::max(1, thresholdMsecs_ / 4));
+    QObject::connect(heartbeatTimer.data(), &QTimer::timeout, heartbeatTimer.data(), []() {
+        lastHeartbeat.store(steadyMsecs(), std::memory_order_relaxed);
+    });
+    heartbeatTimer->start();
+    watchdogStopping = false;
+    watchdogThread = new std::thread{watchdogMain, thresholdMsecs_};
+}
+
+// static
+void StallWatchdog::stop() {
+    if(!watchdogThread) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{watchdogMutex};
+        watchdogStopping = true;
+    }
+    watchdogCond.notify_one();
+    watchdogThread->join();
+    delete watchdogThread;
+    watchdogThread = nullptr;
+    // it's already deleted with the application if that's gone first
+    delete heartbeatTimer.data();
+    guiThread = nullptr;
+}
+
+// static
+const char* StallWatchdog::enter(const char* name, bool& entered) {
+    entered = QThread::currentThread() == guiThread;
+    return entered ? currentScope.exchange(name, std::memory_order_relaxed) : nullptr;
+}
+
+// static
+void StallWatchdog::leave(const char* outerName) {
+    currentScope.store(outerName, std::memory_order_relaxed);
+}
+
+} // namespace Fm
@@ -0,0 +1,146 @@
+#ifndef JOBTRACE_P_H
+#define JOBTRACE_P_H
+
+#include <QtGlobal>
+#include <cstdint>
+
+namespace Fm {
+
+// Optional tracing of the jobs, which shows where the time of a job goes.
+// If the environment variable LIBFM_QT_TRACE is set to a file path, the spans recorded by the
+// jobs are written to the file in the Chrome trace event format when the program exits. It can be
+// loaded in chrome://tracing or https://ui.perfetto.dev. Otherwise a span only checks a flag.
+class JobTrace {
+public:
+    static bool isEnabled() {
+        return enabled_;
+    }
+
+    // microseconds since the tracing is started
+    static qint64 now();
+
+    // the name and category should be string literals, which are kept until the trace is written
+    static void addSpan(const char* name, const char* category, qint64 start, qint64 end, std::uint64_t count = 0);
+
+    // write the spans recorded so far to the trace file
+    static void flush();
+
+private:
+    static const bool enabled_;
+};
+
+// Records the time from its construction to its destruction, or to end(), as a span.
+// The count is shown in the arguments of the span, such as the number of the files handled in it.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* category = "job"):
+        name_{name},
+        category_{category},
+        start_{JobTrace::isEnabled() ? JobTrace::now() : -1},
+        count_{0} {
+    }
+
+    ~TraceSpan() {
+        end();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void addCount(std::uint64_t count = 1) {
+        count_ += count;
+    }
+
+    void end() {
+        if(start_ >= 0) {
+            JobTrace::addSpan(name_, category_, start_, JobTrace::now(), count_);
+            start_ = -1;
+        }
+    }
+
+private:
+    const char* name_;
+    const char* category_;
+    qint64 start_; // -1 if the tracing is off or the span is ended
+    std::uint64_t count_;
+};
+
+// Times the initialization of a part of the library. It's recorded as a span of the "startup"
+// category, and if the environment variable LIBFM_QT_STARTUP_REPORT is set, the time is also
+// printed when it's finished, so the startup cost can be checked without a trace viewer.
+class StartupSpan {
+public:
+    explicit StartupSpan(const char* name);
+
+    ~StartupSpan();
+
+    StartupSpan(const StartupSpan&) = delete;
+    StartupSpan& operator=(const StartupSpan&) = delete;
+
+    static bool isReportEnabled() {
+        return reportEnabled_;
+    }
+
+private:
+    TraceSpan span_;
+    const char* name_;
+    qint64 start_; // in nanoseconds, -1 if the report is off
+
+    static const bool reportEnabled_;
+};
+
+// An optional watchdog of the GUI thread. If the environment variable LIBFM_QT_STALL_WATCHDOG is set
+// to a number of milliseconds, a thread checks that the event loop of the GUI thread keeps running,
+// and when it's blocked for longer than that, the innermost BlockingScope of the GUI thread is
+// reported with qWarning(). The stall is also recorded as a span of the "stall" category.
+class StallWatchdog {
+public:
+    static bool isEnabled() {
+        return thresholdMsecs_ > 0;
+    }
+
+    // called by LibFmQt in the GUI thread
+    static void start();
+
+    // stops and joins the thread, called by LibFmQt in the GUI thread
+    static void stop();
+
+    // Called by BlockingScope. Returns the name of the outer scope, or nullptr if the scope
+    // isn't in the GUI thread, and it shouldn't be left then.
+    static const char* enter(const char* name, bool& entered);
+
+    static void leave(const char* outerName);
+
+private:
+    static const int thresholdMsecs_; // 0 if the watchdog is off
+};
+
+// Marks a call which might block the thread for long, such as a synchronous I/O call. It's recorded
+// as a span of the "blocking" category, and the stall watchdog reports it if the GUI thread is stalled in it.
+// The name should be a string literal.
+class BlockingScope {
+public:
+    explicit BlockingScope(const char* name):
+        span_{name, "blocking"},
+        entered_{false},
+        outerName_{StallWatchdog::isEnabled() ? StallWatchdog::enter(name, entered_) : nullptr} {
+    }
+
+    ~BlockingScope() {
+        if(entered_) {
+            StallWatchdog::leave(outerName_);
+        }
+    }
+
+    BlockingScope(const BlockingScope&) = delete;
+    BlockingScope& operator=(const BlockingScope&) = delete;
+
+private:
+    TraceSpan span_;
+    bool entered_;
+    const char* outerName_;
+};
+
+} // namespace Fm
+
+#endif // JOBTRACE_P_H
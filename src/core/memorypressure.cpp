@@ -0,0 +1,115 @@
+#include "memorypressure.h"
+#include "folder.h"
+#include "iconinfo.h"
+#include "thumbnailjob.h"
+#include "stats.h"
+#include "jobtrace_p.h"
+#include <QSocketNotifier>
+#include <QPixmapCache>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace Fm {
+
+// The PSI triggers: some tasks are stalled on memory for 150 ms in 2 s, or all of them for 100 ms.
+// The window of an unprivileged trigger should be a multiple of 2 s.
+static const char moderateTrigger[] = "some 150000 2000000";
+static const char criticalTrigger[] = "full 100000 2000000";
+// the pressure lasts a while, and trimming the caches again right after they're filled is useless
+static const qint64 minTrimInterval = 10000;
+
+std::mutex MemoryPressure::mutex_;
+std::weak_ptr<MemoryPressure> MemoryPressure::globalInstance_;
+
+MemoryPressure::MemoryPressure(): QObject(), moderateNotifier_{nullptr}, criticalNotifier_{nullptr} {
+    moderateNotifier_ = addTrigger(moderateTrigger);
+    criticalNotifier_ = addTrigger(criticalTrigger);
+    if(moderateNotifier_) {
+        connect(moderateNotifier_, &QSocketNotifier::activated, this, [this]() {
+            onPressure(Moderate);
+        });
+    }
+    if(criticalNotifier_) {
+        connect(criticalNotifier_, &QSocketNotifier::activated, this, [this]() {
+            onPressure(Critical);
+        });
+    }
+}
+
+MemoryPressure::~MemoryPressure() {
+    for(auto notifier: {moderateNotifier_, criticalNotifier_}) {
+        if(notifier) {
+            int fd = notifier->socket();
+            delete notifier;
+            close(fd);
+        }
+    }
+}
+
+// static
+std::shared_ptr<MemoryPressure> MemoryPressure::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto pressure = globalInstance_.lock();
+    if(!pressure) {
+        pressure = std::make_shared<MemoryPressure>();
+        globalInstance_ = pressure;
+    }
+    return pressure;
+}
+
+// static
+void MemoryPressure::trimGlobal(Level level) {
+    globalInstance()->trim(level);
+}
+
+QSocketNotifier* MemoryPressure::addTrigger(const char* trigger) {
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0) {
+        return nullptr;
+    }
+    // the trigger is removed when the fd is closed
+    if(write(fd, trigger, strlen(trigger) + 1) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    // the kernel reports the events with POLLPRI
+    return new QSocketNotifier{fd, QSocketNotifier::Exception, this};
+}
+
+void MemoryPressure::onPressure(Level level) {
+    QElapsedTimer& last = lastTrim_[level];
+    if(last.isValid() && last.elapsed() < minTrimInterval) {
+        return;
+    }
+    last.start();
+    if(level == Critical) { // it's done for the moderate pressure too
+        lastTrim_[Moderate].start();
+    }
+    trim(level);
+}
+
+void MemoryPressure::trim(Level level) {
+    TraceSpan span{level == Critical ? "MemoryPressure::trim(Critical)" : "MemoryPressure::trim(Moderate)"};
+    Stats::add(Stats::MEMORY_TRIMS);
+    // the pixmaps are rendered again from the icons and the images quickly
+    QPixmapCache::clear();
+    // the thumbnails are read from the disk again
+    ThumbnailJob::clearMemoryCache();
+    IconInfo::purgeCache();
+    // the models free the state of their items, and Critical makes them free all of it
+    Q_EMIT trimRequested(level);
+    if(level == Critical) {
+        // the folders nobody uses are listed again when they're opened
+        Folder::clearCache();
+    }
+#ifdef __GLIBC__
+    // give the freed memory back to the system, or it's still counted for the process
+    malloc_trim(0);
+#endif
+}
+
+} // namespace Fm
@@ -0,0 +1,70 @@
+#ifndef FM2_MEMORYPRESSURE_H
+#define FM2_MEMORYPRESSURE_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QElapsedTimer>
+#include <memory>
+#include <mutex>
+
+class QSocketNotifier;
+
+namespace Fm {
+
+// Trims the caches of libfm-qt when the system is short of memory, so the long sessions on the
+// machines with little memory are not killed by the OOM killer. The memory pressure is watched with
+// the PSI triggers of Linux (/proc/pressure/memory) if they're available, and the applications can
+// also trim the caches with trim(), e.g. when the host reports the pressure in another way.
+// The caches which are the cheapest to fill again are trimmed first:
+//   Moderate: the pixmaps in QPixmapCache, the decoded thumbnails of ThumbnailJob, the unused icons,
+//             and the display strings and thumbnails of the items not shown recently by the models
+//   Critical: also the folders retained by Folder::setMaxCachedFolders(), and the display strings
+//             and thumbnails of all the items, which are created again when they're shown
+class LIBFM_QT_API MemoryPressure : public QObject {
+    Q_OBJECT
+public:
+    enum Level {
+        Moderate,
+        Critical
+    };
+
+    explicit MemoryPressure();
+
+    ~MemoryPressure();
+
+    // The instance used by the models. It watches the memory pressure while it exists, and the
+    // applications which want it without any model can keep a reference to it.
+    static std::shared_ptr<MemoryPressure> globalInstance();
+
+    // Trim the caches for the level, and ask the models to do so with trimRequested().
+    void trim(Level level);
+
+    // the same as trim() with the global instance, which is created if needed
+    static void trimGlobal(Level level);
+
+    // true if the PSI triggers are set up, false if the kernel doesn't support them
+    bool isMonitoring() const {
+        return moderateNotifier_ || criticalNotifier_;
+    }
+
+Q_SIGNALS:
+    // emitted by trim() after the caches of the library are trimmed
+    void trimRequested(Fm::MemoryPressure::Level level);
+
+private:
+    QSocketNotifier* addTrigger(const char* trigger);
+
+    void onPressure(Level level);
+
+private:
+    QSocketNotifier* moderateNotifier_;
+    QSocketNotifier* criticalNotifier_;
+    QElapsedTimer lastTrim_[2]; // the time of the last automatic trim of each level
+
+    static std::mutex mutex_;
+    static std::weak_ptr<MemoryPressure> globalInstance_;
+};
+
+} // namespace Fm
+
+#endif // FM2_MEMORYPRESSURE_H
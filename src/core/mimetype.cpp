@@ -1,5 +1,9 @@
 #include "mimetype.h"
+#include "mimetypediskcache_p.h"
 #include <cstring>
+#include <unordered_set>
+#include <fnmatch.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <gio/gio.h>
@@ -8,7 +12,8 @@ using namespace std;
 
 namespace Fm {
 
-std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> MimeType::cache_;
+std::shared_ptr<const MimeType::Cache> MimeType::cache_ = std::make_shared<const MimeType::Cache>();
+std::atomic<unsigned int> MimeType::cacheSerial_{0};
 std::mutex MimeType::mutex_;
 
 std::shared_ptr<const MimeType> MimeType::inodeDirectory_;  // inode/directory
@@ -16,16 +21,201 @@ std::shared_ptr<const MimeType> MimeType::inodeShortcut_;  // inode/x-shortcut
 std::shared_ptr<const MimeType> MimeType::inodeMountPoint_;  // inode/mount-point
 std::shared_ptr<const MimeType> MimeType::desktopEntry_; // application/x-desktop
 
+// how often the glob files of shared-mime-info are checked for changes, like GIO does
+static const gint64 mimeGlobsCheckInterval = 5 * G_USEC_PER_SEC;
+
+// The globs of shared-mime-info, which tell if the type guessed from a file name only depends
+// on its extension. Then the type is remembered for the extension, and g_content_type_guess(),
+// which takes the global lock of GIO, isn't called again for the other files with it.
+struct MimeGlobs {
+    // the extensions of the "*.ext" globs, as "cs:<ext>" if they're case-sensitive,
+    // otherwise as "ci:<lowercase ext>"
+    std::unordered_set<std::string> exts;
+    // the lowercase extensions which have case-sensitive globs
+    std::unordered_set<std::string> caseSensitiveExts;
+    // the globs like "*.tar.gz" by their last extension, as lowercase suffixes
+    std::unordered_map<std::string, std::vector<std::string>> compoundSuffixes;
+    // the globs without wildcards, like "makefile", in lowercase
+    std::unordered_set<std::string> literals;
+    // the other globs, like "readme*"
+    std::vector<std::string> complexGlobs;
+    // the parsed glob files and their mtimes
+    std::vector<std::pair<std::string, gint64>> files;
+    bool usable = true;
+};
+
+// the types remembered for the extensions, which are dropped when the globs are changed
+struct MimeTypeMemo {
+    std::shared_ptr<const MimeGlobs> globs;
+    // by the lowercase extensions, or by the extensions if they have case-sensitive globs
+    std::unordered_map<std::string, std::shared_ptr<const MimeType>> types;
+};
+
+// an immutable snapshot which is replaced when a type is added, like MimeType::cache_
+static std::shared_ptr<const MimeTypeMemo> mimeTypeMemo;
+static std::atomic<gint64> mimeGlobsLastCheck{0};
+static std::mutex mimeTypeMemoMutex;
+
+static std::string asciiLower(std::string str) {
+    for(auto& ch: str) {
+        ch = g_ascii_tolower(ch);
+    }
+    return str;
+}
+
+static gint64 fileMtime(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? gint64(st.st_mtim.tv_sec) * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000 : -1;
+}
+
+static std::vector<std::string> mimeGlobFiles() {
+    std::vector<std::string> files;
+    CStrPtr userFile{g_build_filename(g_get_user_data_dir(), "mime", "globs2", nullptr)};
+    files.emplace_back(userFile.get());
+    for(auto dir = g_get_system_data_dirs(); *dir; ++dir) {
+        CStrPtr file{g_build_filename(*dir, "mime", "globs2", nullptr)};
+        files.emplace_back(file.get());
+    }
+    return files;
+}
+
+static std::shared_ptr<MimeGlobs> loadMimeGlobs() {
+    auto globs = std::make_shared<MimeGlobs>();
+    for(auto& file: mimeGlobFiles()) {
+        globs->files.emplace_back(file, fileMtime(file));
+        char* data = nullptr;
+        if(!g_file_get_contents(file.c_str(), &data, nullptr, nullptr)) {
+            continue;
+        }
+        CStrPtr content{data};
+        for(char* line = data; line && *line;) {
+            char* next = strchr(line, '\n');
+            if(next) {
+                *next++ = '\0';
+            }
+            // weight:type:glob[:flags]
+            char** fields = line[0] != '#' ? g_strsplit(line, ":", 4) : nullptr;
+            if(fields && fields[0] && fields[1] && fields[2]) {
+                const char* glob = fields[2];
+                bool caseSensitive = fields[3] && strstr(fields[3], "cs");
+                if(strcmp(glob, "__NOGLOBS__") == 0) {
+                    // the globs of a type are removed by another file, which is not handled
+                    globs->usable = false;
+                }
+                else if(!strpbrk(glob, "*?[")) {
+                    globs->literals.insert(asciiLower(glob));
+                }
+                else if(glob[0] == '*' && glob[1] == '.' && !strpbrk(glob + 2, "*?[")) {
+                    const char* ext = strrchr(glob, '.') + 1;
+                    if(ext != glob + 2) {
+                        globs->compoundSuffixes[asciiLower(ext)].push_back(asciiLower(glob + 1));
+                    }
+                    else {
+                        if(caseSensitive) {
+                            globs->exts.insert(std::string{"cs:"} + ext);
+                            globs->caseSensitiveExts.insert(asciiLower(ext));
+                        }
+                        else {
+                            globs->exts.insert("ci:" + asciiLower(ext));
+                        }
+                    }
+                }
+                else {
+                    globs->complexGlobs.emplace_back(glob);
+                }
+            }
+            g_strfreev(fields);
+            line = next;
+        }
+    }
+    return globs;
+}
+
+static std::shared_ptr<const MimeTypeMemo> currentMimeTypeMemo() {
+    gint64 now = g_get_monotonic_time();
+    auto memo = std::atomic_load(&mimeTypeMemo);
+    if(memo && now - mimeGlobsLastCheck.load(std::memory_order_relaxed) < mimeGlobsCheckInterval) {
+        return memo;
+    }
+    std::lock_guard<std::mutex> lock{mimeTypeMemoMutex};
+    memo = mimeTypeMemo;
+    if(memo && now - mimeGlobsLastCheck.load(std::memory_order_relaxed) < mimeGlobsCheckInterval) {
+        return memo; // checked by another thread meanwhile
+    }
+    bool changed = !memo;
+    if(memo) {
+        auto files = mimeGlobFiles();
+        changed = (files.size() != memo->globs->files.size());
+        for(size_t i = 0; !changed && i < files.size(); ++i) {
+            changed = (files[i] != memo->globs->files[i].first || fileMtime(files[i]) != memo->globs->files[i].second);
+        }
+    }
+    if(changed) {
+        if(memo) {
+            // the saved types are dropped with the old globs
+            MimeTypeDiskCache::invalidate();
+        }
+        auto newMemo = std::make_shared<MimeTypeMemo>();
+        newMemo->globs = loadMimeGlobs();
+        memo = newMemo;
+        std::atomic_store(&mimeTypeMemo, memo);
+    }
+    mimeGlobsLastCheck.store(now, std::memory_order_relaxed);
+    return memo;
+}
+
+// Get the memo key of a file name whose type only depends on its extension. The globs of the
+// extension which match the name are the same for all the names with the key. Returns false if
+// other globs might match the name.
+static bool mimeTypeMemoKey(const MimeGlobs& globs, const char* baseName, std::string& key) {
+    const char* dot = strrchr(baseName, '.');
+    if(!globs.usable || !dot || dot == baseName || dot[1] == '\0') {
+        return false;
+    }
+    std::string lowerName = asciiLower(baseName);
+    if(globs.literals.count(lowerName)) {
+        return false;
+    }
+    std::string ext{dot + 1};
+    std::string lowerExt = asciiLower(ext);
+    auto compound = globs.compoundSuffixes.find(lowerExt);
+    if(compound != globs.compoundSuffixes.cend()) {
+        for(const auto& suffix: compound->second) {
+            if(lowerName.size() >= suffix.size() && lowerName.compare(lowerName.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                return false;
+            }
+        }
+    }
+    for(const auto& glob: globs.complexGlobs) {
+        // ignoring the case might only match more names, which is safe here
+        if(fnmatch(glob.c_str(), baseName, FNM_CASEFOLD) == 0) {
+            return false;
+        }
+    }
+    if(globs.caseSensitiveExts.count(lowerExt)) {
+        key = "cs:" + ext;
+        return globs.exts.count(key) || globs.exts.count("ci:" + lowerExt);
+    }
+    key = "ci:" + lowerExt;
+    return globs.exts.count(key) != 0;
+}
+
 
 MimeType::MimeType(const char* typeName):
     name_{g_strdup(typeName)},
-    desc_{nullptr} {
+    desc_{nullptr},
+    thumbnailers_{std::make_shared<const ThumbnailerList>()} {
 
-    GObjectPtr<GIcon> gicon{g_content_type_get_icon(typeName), false};
-    if(strcmp(typeName, "inode/directory") == 0)
-        g_themed_icon_prepend_name(G_THEMED_ICON(gicon.get()), "folder");
-    else if(g_content_type_can_be_executable(typeName))
-        g_themed_icon_append_name(G_THEMED_ICON(gicon.get()), "application-x-executable");
+    // the icon saved in the disk cache saves loading the icons of the types from shared-mime-info
+    GObjectPtr<GIcon> gicon = MimeTypeDiskCache::icon(typeName);
+    if(!gicon) {
+        gicon = GObjectPtr<GIcon>{g_content_type_get_icon(typeName), false};
+        if(strcmp(typeName, "inode/directory") == 0)
+            g_themed_icon_prepend_name(G_THEMED_ICON(gicon.get()), "folder");
+        else if(g_content_type_can_be_executable(typeName))
+            g_themed_icon_append_name(G_THEMED_ICON(gicon.get()), "application-x-executable");
+        MimeTypeDiskCache::addIcon(typeName, gicon.get());
+    }
 
     icon_ = IconInfo::fromGIcon(gicon);
 }
@@ -33,18 +223,40 @@ MimeType::MimeType(const char* typeName):
 MimeType::~MimeType () {
 }
 
+// static
+const std::shared_ptr<const MimeType::Cache>& MimeType::cacheSnapshot() {
+    // each thread keeps the last snapshot it has seen, so a lookup only reads the serial
+    // atomically unless the cache is changed
+    thread_local std::shared_ptr<const Cache> snapshot;
+    thread_local unsigned int snapshotSerial = 0;
+    unsigned int serial = cacheSerial_.load(std::memory_order_acquire);
+    if(!snapshot || snapshotSerial != serial) {
+        snapshot = std::atomic_load(&cache_);
+        snapshotSerial = serial;
+    }
+    return snapshot;
+}
+
 //static
 std::shared_ptr<const MimeType> MimeType::fromName(const char* typeName) {
-    std::shared_ptr<const MimeType> ret;
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = cache_.find(typeName);
-    if(it == cache_.end()) {
-        ret = std::make_shared<MimeType>(typeName);
-        cache_.insert(std::make_pair(ret->name_.get(), ret));
+    {
+        const auto& cache = cacheSnapshot();
+        auto it = cache->find(typeName);
+        if(it != cache->end()) {
+            return it->second;
+        }
     }
-    else {
-        ret = it->second;
+    std::lock_guard<std::mutex> lock(mutex_);
+    // another thread might have added it meanwhile
+    auto it = cache_->find(typeName);
+    if(it != cache_->end()) {
+        return it->second;
     }
+    auto ret = std::make_shared<MimeType>(typeName);
+    auto cache = std::make_shared<Cache>(*cache_);
+    cache->insert(std::make_pair(ret->name_.get(), ret));
+    std::atomic_store(&cache_, std::shared_ptr<const Cache>{std::move(cache)});
+    cacheSerial_.fetch_add(1, std::memory_order_release);
     return ret;
 }
 
@@ -57,8 +269,44 @@ std::shared_ptr<const MimeType> MimeType::guessFromFileName(const char* fileName
         fileName = strchr(uri_scheme + 3, '/');
     if(fileName == nullptr)
         fileName = "unknown";
-    auto type = CStrPtr{g_content_type_guess(fileName, nullptr, 0, &uncertain)};
-    return fromName(type.get());
+
+    const char* baseName = strrchr(fileName, '/');
+    baseName = baseName ? baseName + 1 : fileName;
+    auto memo = currentMimeTypeMemo();
+    std::string key;
+    bool memoizable = mimeTypeMemoKey(*memo->globs, baseName, key);
+    if(memoizable) {
+        auto it = memo->types.find(key);
+        if(it != memo->types.cend()) {
+            return it->second;
+        }
+    }
+
+    std::shared_ptr<const MimeType> mimeType;
+    std::string savedType;
+    if(memoizable && MimeTypeDiskCache::typeForExtension(key, savedType)) {
+        // guessed before the restart
+        mimeType = fromName(savedType.c_str());
+        uncertain = FALSE;
+    }
+    else {
+        auto type = CStrPtr{g_content_type_guess(fileName, nullptr, 0, &uncertain)};
+        mimeType = fromName(type.get());
+        if(memoizable && !uncertain) {
+            MimeTypeDiskCache::addExtension(key, type.get());
+        }
+    }
+    // only remember the type if a single type is matched by the globs
+    if(memoizable && !uncertain) {
+        std::lock_guard<std::mutex> lock{mimeTypeMemoMutex};
+        if(mimeTypeMemo->globs == memo->globs && !mimeTypeMemo->types.count(key)) {
+            auto newMemo = std::make_shared<MimeTypeMemo>(*mimeTypeMemo);
+            newMemo->types.emplace(std::move(key), mimeType);
+            std::atomic_store(&mimeTypeMemo, std::shared_ptr<const MimeTypeMemo>{std::move(newMemo)});
+        }
+    }
+    return mimeType;
+
 }
 
 } // namespace Fm
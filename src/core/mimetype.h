@@ -31,6 +31,8 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
 #include <cstring>
 #include <forward_list>
 #include <functional>
@@ -53,13 +55,14 @@ public:
     ~MimeType();
 
     std::shared_ptr<const Thumbnailer> firstThumbnailer() const {
-        std::lock_guard<std::mutex> lock{mutex_};
-        return thumbnailers_.empty() ? nullptr : thumbnailers_.front();
+        auto thumbnailers = std::atomic_load(&thumbnailers_);
+        return thumbnailers->empty() ? nullptr : thumbnailers->front();
     }
 
     void forEachThumbnailer(std::function<bool(const std::shared_ptr<const Thumbnailer>&)> func) const {
-        std::lock_guard<std::mutex> lock{mutex_};
-        for(auto& thumbnailer: thumbnailers_) {
+        // NOTE: the list is never changed but replaced, so it can be used without a lock.
+        auto thumbnailers = std::atomic_load(&thumbnailers_);
+        for(auto& thumbnailer: *thumbnailers) {
             if(func(thumbnailer)) {
                 break;
             }
@@ -142,22 +145,37 @@ public:
     }
 
 private:
+    typedef std::forward_list<std::shared_ptr<const Thumbnailer>> ThumbnailerList;
+
+    // the thumbnailer list is copied and replaced, since it's read by many threads but rarely changed
     void removeThumbnailer(std::shared_ptr<const Thumbnailer>& thumbnailer) {
         std::lock_guard<std::mutex> lock{mutex_};
-        thumbnailers_.remove(thumbnailer);
+        auto thumbnailers = std::make_shared<ThumbnailerList>(*thumbnailers_);
+        thumbnailers->remove(thumbnailer);
+        std::atomic_store(&thumbnailers_, std::shared_ptr<const ThumbnailerList>{std::move(thumbnailers)});
     }
 
     void addThumbnailer(std::shared_ptr<const Thumbnailer> thumbnailer) {
         std::lock_guard<std::mutex> lock{mutex_};
-        thumbnailers_.push_front(std::move(thumbnailer));
+        auto thumbnailers = std::make_shared<ThumbnailerList>(*thumbnailers_);
+        thumbnailers->push_front(std::move(thumbnailer));
+        std::atomic_store(&thumbnailers_, std::shared_ptr<const ThumbnailerList>{std::move(thumbnailers)});
     }
 
+    typedef std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> Cache;
+
+    // the current snapshot of the cache, which is never changed once it's published
+    static const std::shared_ptr<const Cache>& cacheSnapshot();
+
 private:
     std::shared_ptr<const IconInfo> icon_;
     CStrPtr name_;
     mutable CStrPtr desc_;
-    std::forward_list<std::shared_ptr<const Thumbnailer>> thumbnailers_;
-    static std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> cache_;
+    std::shared_ptr<const ThumbnailerList> thumbnailers_;
+    // The lookups use an immutable snapshot of the cache without locking. A new type is added
+    // to a copy of the cache with the mutex locked, and the copy replaces the snapshot.
+    static std::shared_ptr<const Cache> cache_;
+    static std::atomic<unsigned int> cacheSerial_; // changed when the snapshot is replaced
     static std::mutex mutex_;
 
     static std::shared_ptr<const MimeType> inodeDirectory_;  // inode/directory
@@ -0,0 +1,224 @@
+#include "mimetypediskcache_p.h"
+#include "jobtrace_p.h"
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <gio/gio.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+// (version, [(checked file, mtime)], [(extension key, type)], [(type, icon names)])
+static const char cacheType[] = "(ua(sx)a(ss)a(sas))";
+static const guint32 cacheVersion = 1;
+
+std::shared_ptr<const MimeTypeDiskCache::Entries> MimeTypeDiskCache::loaded_;
+MimeTypeDiskCache::Entries MimeTypeDiskCache::added_;
+bool MimeTypeDiskCache::dirty_ = false;
+std::mutex MimeTypeDiskCache::mutex_;
+
+static QString cacheFilePath() {
+    CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "mimetypes", nullptr)};
+    return QString::fromLocal8Bit(path.get());
+}
+
+// static
+std::vector<std::pair<std::string, gint64>> MimeTypeDiskCache::checkedFiles() {
+    // update-mime-database writes mime.cache with all the other files of a mime dir
+    std::vector<std::pair<std::string, gint64>> files;
+    auto addFile = [&files](const char* dataDir) {
+        CStrPtr file{g_build_filename(dataDir, "mime", "mime.cache", nullptr)};
+        struct stat st;
+        gint64 mtime = stat(file.get(), &st) == 0 ? gint64(st.st_mtim.tv_sec) * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000 : -1;
+        files.emplace_back(file.get(), mtime);
+    };
+    addFile(g_get_user_data_dir());
+    for(auto dir = g_get_system_data_dirs(); *dir; ++dir) {
+        addFile(*dir);
+    }
+    return files;
+}
+
+// static
+std::shared_ptr<const MimeTypeDiskCache::Entries> MimeTypeDiskCache::loaded() {
+    auto entries = std::atomic_load(&loaded_);
+    if(entries) {
+        return entries;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    entries = loaded_;
+    if(!entries) {
+        entries = load();
+        std::atomic_store(&loaded_, entries);
+        if(auto app = QCoreApplication::instance()) {
+            QObject::connect(app, &QCoreApplication::aboutToQuit, app, &MimeTypeDiskCache::save);
+        }
+    }
+    return entries;
+}
+
+// static
+std::shared_ptr<const MimeTypeDiskCache::Entries> MimeTypeDiskCache::load() {
+    BlockingScope blocking{"MimeTypeDiskCache::load"};
+    auto entries = std::make_shared<Entries>();
+    entries->files = checkedFiles();
+    QFile file{cacheFilePath()};
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return entries;
+    }
+    auto data = file.map(0, file.size());
+    if(!data) {
+        return entries;
+    }
+    // the data is checked by GVariant while it's read, and the values are copied out of the mapped file
+    GVariant* cache = g_variant_ref_sink(g_variant_new_from_data(G_VARIANT_TYPE(cacheType), data, file.size(),
+                                                                 FALSE, nullptr, nullptr));
+    guint32 version;
+    GVariantIter* fileIter;
+    GVariantIter* extensionIter;
+    GVariantIter* iconIter;
+    g_variant_get(cache, cacheType, &version, &fileIter, &extensionIter, &iconIter);
+    bool valid = (version == cacheVersion && g_variant_iter_n_children(fileIter) == entries->files.size());
+    const char* name;
+    gint64 mtime;
+    for(size_t i = 0; valid && g_variant_iter_next(fileIter, "(&sx)", &name, &mtime); ++i) {
+        valid = (entries->files[i].first == name && entries->files[i].second == mtime);
+    }
+    if(valid) {
+        const char* typeName;
+        entries->extensionTypes.reserve(g_variant_iter_n_children(extensionIter));
+        while(g_variant_iter_next(extensionIter, "(&s&s)", &name, &typeName)) {
+            entries->extensionTypes.emplace(name, typeName);
+        }
+        GVariantIter* iconNameIter;
+        entries->typeIcons.reserve(g_variant_iter_n_children(iconIter));
+        while(g_variant_iter_next(iconIter, "(&sas)", &typeName, &iconNameIter)) {
+            auto& iconNames = entries->typeIcons[typeName];
+            const char* iconName;
+            while(g_variant_iter_next(iconNameIter, "&s", &iconName)) {
+                iconNames.emplace_back(iconName);
+            }
+            g_variant_iter_free(iconNameIter);
+        }
+    }
+    g_variant_iter_free(fileIter);
+    g_variant_iter_free(extensionIter);
+    g_variant_iter_free(iconIter);
+    g_variant_unref(cache);
+    return entries;
+}
+
+// static
+bool MimeTypeDiskCache::typeForExtension(const std::string& key, std::string& typeName) {
+    auto entries = loaded();
+    auto it = entries->extensionTypes.find(key);
+    if(it == entries->extensionTypes.cend()) {
+        return false;
+    }
+    typeName = it->second;
+    return true;
+}
+
+// static
+void MimeTypeDiskCache::addExtension(const std::string& key, const char* typeName) {
+    auto entries = loaded();
+    std::lock_guard<std::mutex> lock{mutex_};
+    // the entries might be invalidated meanwhile
+    if(entries == loaded_ && !entries->extensionTypes.count(key)) {
+        added_.extensionTypes[key] = typeName;
+        dirty_ = true;
+    }
+}
+
+// static
+GIconPtr MimeTypeDiskCache::icon(const char* typeName) {
+    auto entries = loaded();
+    auto it = entries->typeIcons.find(typeName);
+    if(it == entries->typeIcons.cend() || it->second.empty()) {
+        return GIconPtr{};
+    }
+    std::vector<char*> names;
+    names.reserve(it->second.size());
+    for(const auto& iconName: it->second) {
+        names.push_back(const_cast<char*>(iconName.c_str()));
+    }
+    return GIconPtr{g_themed_icon_new_from_names(names.data(), names.size()), false};
+}
+
+// static
+void MimeTypeDiskCache::addIcon(const char* typeName, GIcon* icon) {
+    if(!G_IS_THEMED_ICON(icon)) {
+        return;
+    }
+    auto entries = loaded();
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(entries == loaded_ && !entries->typeIcons.count(typeName)) {
+        auto& iconNames = added_.typeIcons[typeName];
+        iconNames.clear();
+        for(auto name = g_themed_icon_get_names(G_THEMED_ICON(icon)); *name; ++name) {
+            iconNames.emplace_back(*name);
+        }
+        dirty_ = true;
+    }
+}
+
+// static
+void MimeTypeDiskCache::invalidate() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!loaded_) {
+        return; // checked when it's loaded
+    }
+    auto entries = std::make_shared<Entries>();
+    entries->files = checkedFiles();
+    std::atomic_store(&loaded_, std::shared_ptr<const Entries>{std::move(entries)});
+    added_ = Entries{};
+    // the old file is replaced
+    dirty_ = true;
+}
+
+// static
+void MimeTypeDiskCache::save() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!dirty_ || !loaded_) {
+        return;
+    }
+    TraceSpan span{"MimeTypeDiskCache::save"};
+    dirty_ = false;
+    GVariantBuilder files;
+    g_variant_builder_init(&files, G_VARIANT_TYPE("a(sx)"));
+    for(const auto& file: loaded_->files) {
+        g_variant_builder_add(&files, "(sx)", file.first.c_str(), file.second);
+    }
+    GVariantBuilder extensions;
+    g_variant_builder_init(&extensions, G_VARIANT_TYPE("a(ss)"));
+    GVariantBuilder icons;
+    g_variant_builder_init(&icons, G_VARIANT_TYPE("a(sas)"));
+    for(const Entries* entries: {loaded_.get(), &added_}) {
+        for(const auto& item: entries->extensionTypes) {
+            g_variant_builder_add(&extensions, "(ss)", item.first.c_str(), item.second.c_str());
+        }
+        for(const auto& item: entries->typeIcons) {
+            GVariantBuilder iconNames;
+            g_variant_builder_init(&iconNames, G_VARIANT_TYPE("as"));
+            for(const auto& iconName: item.second) {
+                g_variant_builder_add(&iconNames, "s", iconName.c_str());
+            }
+            g_variant_builder_add(&icons, "(sas)", item.first.c_str(), &iconNames);
+        }
+    }
+    GVariant* cache = g_variant_ref_sink(g_variant_new(cacheType, cacheVersion, &files, &extensions, &icons));
+
+    // another process might be reading the old file, so a new file is written and renamed
+    QString path = cacheFilePath();
+    QDir().mkpath(QFileInfo{path}.absolutePath());
+    QSaveFile file{path};
+    if(file.open(QIODevice::WriteOnly)) {
+        file.write(static_cast<const char*>(g_variant_get_data(cache)), g_variant_get_size(cache));
+        file.commit();
+    }
+    g_variant_unref(cache);
+}
+
+} // namespace Fm
@@ -0,0 +1,60 @@
+#ifndef FM2_MIMETYPEDISKCACHE_P_H
+#define FM2_MIMETYPEDISKCACHE_P_H
+
+#include "gioptrs.h"
+#include <glib.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Fm {
+
+// The types guessed from the file extensions and the icons of the types, which are saved under
+// $XDG_CACHE_HOME, so the first listings after a restart don't ask GIO about each extension.
+// The file is mapped and read when the cache is used first, and it's dropped if the mime.cache of
+// shared-mime-info is changed in any data dir. The new entries are saved when the application quits.
+// It can be used in any thread.
+class MimeTypeDiskCache {
+public:
+    // the type saved for the key of the extension (see mimeTypeMemoKey() in mimetype.cpp)
+    static bool typeForExtension(const std::string& key, std::string& typeName);
+
+    static void addExtension(const std::string& key, const char* typeName);
+
+    // the saved icon of the type, or nullptr
+    static GIconPtr icon(const char* typeName);
+
+    // only the themed icons are saved
+    static void addIcon(const char* typeName, GIcon* icon);
+
+    // drop all entries, e.g. when the globs of shared-mime-info are changed
+    static void invalidate();
+
+    static void save();
+
+private:
+    struct Entries {
+        std::vector<std::pair<std::string, gint64>> files; // the checked files and their mtimes
+        std::unordered_map<std::string, std::string> extensionTypes;
+        std::unordered_map<std::string, std::vector<std::string>> typeIcons;
+    };
+
+    // the loaded entries, which are never changed once they're published
+    static std::shared_ptr<const Entries> loaded();
+
+    static std::shared_ptr<const Entries> load();
+
+    static std::vector<std::pair<std::string, gint64>> checkedFiles();
+
+    static std::shared_ptr<const Entries> loaded_;
+    static Entries added_; // not saved yet
+    static bool dirty_;
+    static std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_MIMETYPEDISKCACHE_P_H
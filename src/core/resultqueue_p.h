@@ -0,0 +1,127 @@
+#ifndef RESULTQUEUE_P_H
+#define RESULTQUEUE_P_H
+
+#include <QObject>
+#include <QPointer>
+#include <QEvent>
+#include <QCoreApplication>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "jobtrace_p.h"
+
+namespace Fm {
+
+// Posts the drain requests of a ResultQueue to the thread of its receiver.
+// It has no Q_OBJECT since it only handles a custom event, so it can be used in a template.
+class ResultQueueNotifier: public QObject {
+public:
+    explicit ResultQueueNotifier(std::function<void ()> drain): drain_{std::move(drain)} {
+    }
+
+    static QEvent::Type eventType() {
+        static const int type = QEvent::registerEventType();
+        return static_cast<QEvent::Type>(type);
+    }
+
+protected:
+    bool event(QEvent* event) override {
+        if(event->type() == eventType()) {
+            drain_();
+            return true;
+        }
+        return QObject::event(event);
+    }
+
+private:
+    std::function<void ()> drain_;
+};
+
+// The results produced by a job in a worker thread, which are handed to an object in another
+// thread in batches. The worker only locks a mutex to add a result instead of waiting until
+// the receiver handles it, and the thread of the receiver is woken up once for all the results
+// added meanwhile. The results are handled before the signals which the job emits later with
+// queued connections, such as finished().
+// The worker should keep a shared_ptr of the queue, since the queue might outlive the receiver.
+template <typename T>
+class ResultQueue {
+public:
+    using Handler = std::function<void (std::vector<T>& results)>;
+
+    // the handler is called in the thread of the receiver, unless the receiver is deleted
+    static std::shared_ptr<ResultQueue> create(QObject* receiver, Handler handler) {
+        std::shared_ptr<ResultQueue> queue{new ResultQueue{receiver, std::move(handler)}};
+        std::weak_ptr<ResultQueue> weakQueue = queue;
+        queue->notifier_ = new ResultQueueNotifier{[weakQueue]() {
+            if(auto queue = weakQueue.lock()) {
+                queue->drain();
+            }
+        }};
+        queue->notifier_->moveToThread(receiver->thread());
+        return queue;
+    }
+
+    ~ResultQueue() {
+        // the queue might be freed by the worker, and the notifier belongs to the receiver's thread
+        notifier_->deleteLater();
+    }
+
+    // called by the worker threads
+    void push(T result) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        results_.push_back(std::move(result));
+        if(!drainPosted_) {
+            drainPosted_ = true;
+            if(JobTrace::isEnabled()) {
+                postTime_ = JobTrace::now();
+            }
+            QCoreApplication::postEvent(notifier_, new QEvent{ResultQueueNotifier::eventType()});
+        }
+    }
+
+    // Handle the queued results now. Called in the thread of the receiver.
+    void drain() {
+        std::vector<T> results;
+        qint64 postTime;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            results.swap(results_);
+            drainPosted_ = false;
+            postTime = postTime_;
+        }
+        if(results.empty()) {
+            return;
+        }
+        if(JobTrace::isEnabled()) {
+            // the time the first result waits for the receiver's thread
+            JobTrace::addSpan("ResultQueue::handoff", "queue", postTime, JobTrace::now(), results.size());
+        }
+        if(receiver_) {
+            TraceSpan span{"ResultQueue::handleResults", "queue"};
+            span.addCount(results.size());
+            handler_(results);
+        }
+    }
+
+private:
+    ResultQueue(QObject* receiver, Handler handler):
+        receiver_{receiver},
+        handler_{std::move(handler)},
+        notifier_{nullptr},
+        drainPosted_{false},
+        postTime_{0} {
+    }
+
+    QPointer<QObject> receiver_;
+    Handler handler_;
+    ResultQueueNotifier* notifier_;
+    std::mutex mutex_;
+    std::vector<T> results_;
+    bool drainPosted_;
+    qint64 postTime_; // when the pending drain is posted, only set while tracing
+};
+
+} // namespace Fm
+
+#endif // RESULTQUEUE_P_H
@@ -0,0 +1,53 @@
+#include "stats.h"
+#include "folder.h"
+#include "iconinfo.h"
+#include "mimetype.h"
+#include "thumbnailjob.h"
+
+namespace Fm {
+
+std::atomic<std::int64_t> Stats::counters_[NUM_COUNTERS];
+
+// static
+Stats::Snapshot Stats::snapshot() {
+    Snapshot snapshot;
+    for(int i = 0; i < NUM_COUNTERS; ++i) {
+        snapshot.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+    Folder::cacheCounts(snapshot.cachedFolders, snapshot.retainedFolders);
+    auto iconStats = IconInfo::cacheStats();
+    snapshot.cachedIcons = iconStats.size;
+    snapshot.iconCacheHits = iconStats.hits;
+    snapshot.iconCacheMisses = iconStats.misses;
+    snapshot.cachedMimeTypes = MimeType::cacheSnapshot()->size();
+    snapshot.activeThumbnailThreads = ThumbnailJob::threadPool()->activeThreadCount();
+    return snapshot;
+}
+
+// static
+const char* Stats::counterName(Counter counter) {
+    static const char* const names[NUM_COUNTERS] = {
+        "live_file_infos",
+        "pending_monitor_events",
+        "thumbnail_requests",
+        "thumbnail_model_hits",
+        "thumbnail_memory_hits",
+        "thumbnail_disk_hits",
+        "thumbnails_generated",
+        "thumbnail_failures",
+        "thumbnail_memory_cache_bytes",
+        "queued_jobs",
+        "running_jobs",
+        "folder_memory_bytes",
+        "folder_model_memory_bytes",
+        "dir_monitors",
+        "thumbnails_skipped",
+        "thumbnail_shared_hits",
+        "thumbnail_previews",
+        "thumbnails_scaled",
+        "memory_trims"
+    };
+    return counter >= 0 && counter < NUM_COUNTERS ? names[counter] : nullptr;
+}
+
+} // namespace Fm
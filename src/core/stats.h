@@ -0,0 +1,74 @@
+#ifndef FM2_STATS_H
+#define FM2_STATS_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace Fm {
+
+// Counters of the objects, caches and queues of the library, which an app can show in a debug panel
+// or export to a monitoring system. The library updates the counters with relaxed atomic operations,
+// and snapshot() reads them with the sizes of the caches. It can be called in any thread.
+class LIBFM_QT_API Stats {
+public:
+    enum Counter {
+        LIVE_FILE_INFOS,              // FileInfo objects which are not freed
+        PENDING_MONITOR_EVENTS,       // file changes reported by the monitors and not handled by the folders yet
+        THUMBNAIL_REQUESTS,           // thumbnails asked from FolderModel
+        THUMBNAIL_MODEL_HITS,         // thumbnails already loaded by FolderModel when they're asked
+        THUMBNAIL_MEMORY_HITS,        // thumbnails found by ThumbnailJob in the memory cache
+        THUMBNAIL_DISK_HITS,          // thumbnails read by ThumbnailJob from the disk cache
+        THUMBNAILS_GENERATED,         // thumbnails generated by ThumbnailJob
+        THUMBNAIL_FAILURES,           // files ThumbnailJob can't make a thumbnail for
+        THUMBNAIL_MEMORY_CACHE_BYTES, // the size of the images in the memory cache of ThumbnailJob
+        QUEUED_JOBS,                  // jobs waiting for a worker of the shared job executor
+        RUNNING_JOBS,                 // jobs being run in any thread
+        FOLDER_MEMORY_BYTES,          // the sum of Folder::memoryUsage() of all folders
+        FOLDER_MODEL_MEMORY_BYTES,    // the sum of FolderModel::memoryUsage() of all models
+        DIR_MONITORS,                 // the file monitors of local folders, see Folder::setMaxMonitors()
+        THUMBNAILS_SKIPPED,           // thumbnails not generated due to the policies of their filesystems
+        THUMBNAIL_SHARED_HITS,        // thumbnails loaded by a ThumbnailJob for another one loading them too
+        THUMBNAIL_PREVIEWS,           // quick previews shown before the thumbnails, see ThumbnailJob::setProgressive()
+        THUMBNAILS_SCALED,            // thumbnails scaled from the larger ones in memory instead of being loaded
+        MEMORY_TRIMS,                 // trims of the caches, see MemoryPressure
+        NUM_COUNTERS
+    };
+
+    struct Snapshot {
+        std::int64_t counters[NUM_COUNTERS];
+        std::size_t cachedFolders;   // the folders in the cache which are still alive
+        std::size_t retainedFolders; // the folders the cache keeps alive after they're used
+        std::size_t cachedIcons;
+        std::size_t iconCacheHits;
+        std::size_t iconCacheMisses;
+        std::size_t cachedMimeTypes;
+        int activeThumbnailThreads;
+
+        std::int64_t value(Counter counter) const {
+            return counters[counter];
+        }
+    };
+
+    static Snapshot snapshot();
+
+    // the name of the counter in lower case, such as "live_file_infos"
+    static const char* counterName(Counter counter);
+
+    // used by the library to update the counters
+    static void add(Counter counter, std::int64_t delta = 1) {
+        counters_[counter].fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    static void set(Counter counter, std::int64_t value) {
+        counters_[counter].store(value, std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<std::int64_t> counters_[NUM_COUNTERS];
+};
+
+} // namespace Fm
+
+#endif // FM2_STATS_H
@@ -0,0 +1,66 @@
+#include "subdirprobejob.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+SubDirProbeJob::SubDirProbeJob(FilePathList dirs, bool showHidden):
+    dirs_{std::move(dirs)},
+    showHidden_{showHidden} {
+}
+
+void SubDirProbeJob::exec() {
+    results_.reserve(dirs_.size());
+    for(const auto& dir: dirs_) {
+        if(isCancelled()) {
+            break;
+        }
+        results_.push_back(hasSubDirs(dir));
+    }
+}
+
+bool SubDirProbeJob::hasSubDirs(const FilePath& dir) const {
+    if(!dir.isNative()) {
+        return true;
+    }
+    int dirFd = open(dir.localPath().get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        return false; // the dir can't be listed anyway
+    }
+    // On most local filesystems, the link count of a dir is 2 plus the number of its sub dirs,
+    // which include the hidden ones. Filesystems which don't count them report 1.
+    struct stat st;
+    if(showHidden_ && fstat(dirFd, &st) == 0 && st.st_nlink > 2) {
+        close(dirFd);
+        return true;
+    }
+    DIR* dirp = fdopendir(dirFd);
+    if(!dirp) {
+        close(dirFd);
+        return false;
+    }
+    bool found = false;
+    while(!found && !isCancelled()) {
+        auto ent = readdir(dirp);
+        if(!ent) {
+            break;
+        }
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (!showHidden_ || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if(ent->d_type == DT_DIR) {
+            found = true;
+        }
+        else if(ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN) {
+            // the symlinks to dirs are shown as dirs too
+            found = (fstatat(dirfd(dirp), name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        }
+    }
+    closedir(dirp);
+    return found;
+}
+
+} // namespace Fm
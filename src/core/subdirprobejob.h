@@ -0,0 +1,44 @@
+#ifndef FM2_SUBDIRPROBEJOB_H
+#define FM2_SUBDIRPROBEJOB_H
+
+#include "../libfmqtglobals.h"
+#include "job.h"
+#include "filepath.h"
+#include <vector>
+
+namespace Fm {
+
+// Check whether the dirs have any sub dirs without listing them fully, which is used
+// to decide if the items of a dir tree need expanders before they are loaded.
+// The listing of a dir stops at its first sub dir. Only the native dirs are probed,
+// the other ones are reported as having sub dirs since listing them might be slow.
+class LIBFM_QT_API SubDirProbeJob : public Job {
+    Q_OBJECT
+public:
+
+    explicit SubDirProbeJob(FilePathList dirs, bool showHidden);
+
+    const FilePathList& dirs() const {
+        return dirs_;
+    }
+
+    // whether each of the dirs has sub dirs, valid after the job is finished
+    const std::vector<bool>& results() const {
+        return results_;
+    }
+
+protected:
+    void exec() override;
+
+private:
+    bool hasSubDirs(const FilePath& dir) const;
+
+private:
+    FilePathList dirs_;
+    std::vector<bool> results_;
+    bool showHidden_;
+};
+
+} // namespace Fm
+
+#endif // FM2_SUBDIRPROBEJOB_H
@@ -26,7 +26,16 @@ FilePath TemplateItem::filePath() const {
     return fileInfo_->path();
 }
 
-Templates::Templates() : QObject() {
+Templates::Templates() : QObject(),
+    items_{std::make_shared<ItemList>()},
+    loaded_{false} {
+}
+
+void Templates::load() {
+    if(loaded_) {
+        return;
+    }
+    loaded_ = true;
     auto* data_dirs = g_get_system_data_dirs();
     // system-wide template dirs
     for(auto data_dir = data_dirs; *data_dir; ++data_dir) {
@@ -62,19 +71,45 @@ void Templates::addTemplateDir(const char* dirPathName) {
         connect(folder.get(), &Folder::filesChanged, this, &Templates::onFilesChanged);
         connect(folder.get(), &Folder::filesRemoved, this, &Templates::onFilesRemoved);
         connect(folder.get(), &Folder::removed, this, &Templates::onTemplateDirRemoved);
+        // the folder might be loaded already by a view, then no files will be added later
+        if(folder->isLoaded()) {
+            auto files = folder->files();
+            onFilesAdded(files);
+        }
         templateFolders_.emplace_back(std::move(folder));
     }
 }
 
+void Templates::removeItems(const std::function<bool (const std::shared_ptr<const TemplateItem>&)>& pred) {
+    auto& items = mutableItems();
+    auto it = std::stable_partition(items.begin(), items.end(), [&](const std::shared_ptr<const TemplateItem>& item) {
+        return !pred(item);
+    });
+    ItemList removed{it, items.end()};
+    items.erase(it, items.end());
+    for(auto& item : removed) {
+        // emit a signal for the removal
+        Q_EMIT itemRemoved(item);
+    }
+}
+
+Templates::ItemList& Templates::mutableItems() {
+    if(!items_.unique()) {
+        items_ = std::make_shared<ItemList>(*items_);
+    }
+    return *items_;
+}
+
 void Templates::onFilesAdded(FileInfoList& addedFiles) {
     for(auto& file : addedFiles) {
         // FIXME: we do not support subdirs right now (only XFCE supports this)
         if(file->isHidden() || file->isDir()) {
             continue;
         }
-        items_.emplace_back(std::make_shared<TemplateItem>(file));
+        auto item = std::make_shared<const TemplateItem>(file);
+        mutableItems().emplace_back(item);
         // emit a signal for the addition
-        Q_EMIT itemAdded(items_.back());
+        Q_EMIT itemAdded(item);
     }
 }
 
@@ -82,29 +117,25 @@ void Templates::onFilesChanged(std::vector<FileInfoPair>& changePairs) {
     for(auto& change: changePairs) {
         auto& old_file = change.first;
         auto& new_file = change.second;
-        auto it = std::find_if(items_.begin(), items_.end(), [&](const std::shared_ptr<TemplateItem>& item) {
+        auto& items = mutableItems();
+        auto it = std::find_if(items.begin(), items.end(), [&](const std::shared_ptr<const TemplateItem>& item) {
             return item->fileInfo() == old_file;
         });
-        if(it != items_.end()) {
+        if(it != items.end()) {
             // emit a signal for the change
             auto old = *it;
-            *it = std::make_shared<TemplateItem>(new_file);
-            Q_EMIT itemChanged(old, *it);
+            auto item = std::make_shared<const TemplateItem>(new_file);
+            *it = item;
+            Q_EMIT itemChanged(old, item);
         }
     }
 }
 
 void Templates::onFilesRemoved(FileInfoList& removedFiles) {
     for(auto& file : removedFiles) {
-        auto filePath = file->path();
-        auto it = std::remove_if(items_.begin(), items_.end(), [&](const std::shared_ptr<TemplateItem>& item) {
+        removeItems([&](const std::shared_ptr<const TemplateItem>& item) {
             return item->fileInfo() == file;
         });
-        for(auto removed_it = it; it != items_.end(); ++it) {
-            // emit a signal for the removal
-            Q_EMIT itemRemoved(*removed_it);
-        }
-        items_.erase(it, items_.end());
     }
 }
 
@@ -116,15 +147,10 @@ void Templates::onTemplateDirRemoved() {
     }
     auto dirPath = folder->path();
 
-    // remote all files under this dir
-    auto it = std::remove_if(items_.begin(), items_.end(), [&](const std::shared_ptr<TemplateItem>& item) {
-        return dirPath.isPrefixOf(item->filePath());
+    // remove all files under this dir
+    removeItems([&](const std::shared_ptr<const TemplateItem>& item) {
+        return dirPath.isPrefixOf(item->fileInfo()->path());
     });
-    for(auto removed_it = it; it != items_.end(); ++it) {
-        // emit a signal for the removal
-        Q_EMIT itemRemoved(*removed_it);
-    }
-    items_.erase(it, items_.end());
 }
 
 } // namespace Fm
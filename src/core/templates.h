@@ -6,6 +6,7 @@
 #include <QObject>
 #include <memory>
 #include <vector>
+#include <functional>
 #include "folder.h"
 #include "fileinfo.h"
 #include "mimetype.h"
@@ -47,27 +48,45 @@ private:
 class LIBFM_QT_API Templates : public QObject {
     Q_OBJECT
 public:
+    typedef std::vector<std::shared_ptr<const TemplateItem>> ItemList;
+
     explicit Templates();
 
-    // FIXME: the first call to this method will get no templates since dir loading is in progress.
+    // The template dirs are loaded by load(), or by the first call of forEachItem(), items() or hasTemplates().
+    // FIXME: the first call of them will get no templates since dir loading is in progress.
     static std::shared_ptr<Templates> globalInstance();
 
+    // Start loading and monitoring the template dirs if they're not loaded yet.
+    // The items are added later by itemAdded() signals while the dirs are loaded.
+    void load();
+
+    bool isLoaded() const {
+        return loaded_;
+    }
+
     void forEachItem(std::function<void (const std::shared_ptr<const TemplateItem>&)> func) const {
-        for(const auto& item : items_) {
+        ensureLoaded();
+        auto items = items_; // the items might be changed by func
+        for(const auto& item : *items) {
             func(item);
         }
     }
 
     std::vector<std::shared_ptr<const TemplateItem>> items() const {
-        std::vector<std::shared_ptr<const TemplateItem>> tmp_items;
-        for(auto& item: items_) {
-            tmp_items.emplace_back(item);
-        }
-        return tmp_items;
+        ensureLoaded();
+        return *items_;
+    }
+
+    // A snapshot of the current items, which is not changed when the items change later.
+    // Unlike items(), it doesn't load the template dirs, so the Create New menu can show the
+    // items loaded so far and only load the dirs when it's shown.
+    std::shared_ptr<const ItemList> itemsSnapshot() const {
+        return items_;
     }
 
     bool hasTemplates() const {
-        return !items_.empty();
+        ensureLoaded();
+        return !items_->empty();
     }
 
 Q_SIGNALS:
@@ -78,8 +97,19 @@ Q_SIGNALS:
     void itemRemoved(const std::shared_ptr<const TemplateItem>& item);
 
 private:
+    void ensureLoaded() const {
+        if(!loaded_) {
+            const_cast<Templates*>(this)->load();
+        }
+    }
+
     void addTemplateDir(const char* dirPathName);
 
+    // the items to change, which are copied first if a snapshot of them is still used
+    ItemList& mutableItems();
+
+    void removeItems(const std::function<bool (const std::shared_ptr<const TemplateItem>&)>& pred);
+
 private Q_SLOTS:
     void onFilesAdded(FileInfoList& addedFiles);
 
@@ -90,8 +120,9 @@ private Q_SLOTS:
     void onTemplateDirRemoved();
 
 private:
-    std::vector<std::shared_ptr<TemplateItem>> items_;
+    std::shared_ptr<ItemList> items_;
     std::vector<std::shared_ptr<Folder>> templateFolders_;
+    bool loaded_;
     static std::weak_ptr<Templates> globalInstance_;
 };
 
@@ -1,14 +1,27 @@
 #include "thumbnailer.h"
 #include "mimetype.h"
+#include "jobtrace_p.h"
 #include <string>
+#include <algorithm>
 #include <QDebug>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
+#include <chrono>
 
 namespace Fm {
 
 std::mutex Thumbnailer::mutex_;
 std::vector<std::shared_ptr<Thumbnailer>> Thumbnailer::allThumbnailers_;
+bool Thumbnailer::loaded_ = false;
+std::vector<time_t> Thumbnailer::dirMTimes_;
+std::mutex Thumbnailer::processMutex_;
+std::condition_variable Thumbnailer::processFinished_;
+int Thumbnailer::runningProcesses_ = 0;
+int Thumbnailer::maxRunningProcesses_ = 2;
+int Thumbnailer::timeout_ = 30000;
 
 Thumbnailer::Thumbnailer(const char* id, GKeyFile* kf):
     id_{g_strdup(id)},
@@ -70,11 +83,94 @@ CStrPtr Thumbnailer::commandForUri(const char* uri, const char* output_file, gui
 }
 
 bool Thumbnailer::run(const char* uri, const char* output_file, int size) const {
+    return run(uri, output_file, size, nullptr);
+}
+
+bool Thumbnailer::run(const char* uri, const char* output_file, int size, GCancellable* cancellable) const {
     auto cmd = commandForUri(uri, output_file, size);
+    if(!cmd) {
+        return false;
+    }
     qDebug() << cmd.get();
-    int status;
-    bool ret = g_spawn_command_line_sync(cmd.get(), nullptr, nullptr, &status, nullptr);
-    return ret && status == 0;
+    char** argv = nullptr;
+    if(!g_shell_parse_argv(cmd.get(), nullptr, &argv, nullptr)) {
+        return false;
+    }
+
+    // wait until the number of running thumbnailers is below the limit
+    {
+        std::unique_lock<std::mutex> lock{processMutex_};
+        while(runningProcesses_ >= maxRunningProcesses_) {
+            if(cancellable && g_cancellable_is_cancelled(cancellable)) {
+                g_strfreev(argv);
+                return false;
+            }
+            processFinished_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        ++runningProcesses_;
+    }
+
+    GPid pid;
+    int status = -1;
+    bool ret = g_spawn_async(nullptr, argv, nullptr, GSpawnFlags(G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD),
+                             nullptr, nullptr, &pid, nullptr);
+    g_strfreev(argv);
+    if(ret) {
+        gint64 deadline = g_get_monotonic_time() + gint64(timeout_) * 1000;
+        gulong pollInterval = 1000; // in microseconds, doubled up to 50 ms while the thumbnailer is running
+        for(;;) {
+            pid_t result = waitpid(pid, &status, WNOHANG);
+            if(result == pid) {
+                break;
+            }
+            if(result == -1 && errno != EINTR) {
+                ret = false;
+                break;
+            }
+            if((cancellable && g_cancellable_is_cancelled(cancellable))
+                    || (timeout_ > 0 && g_get_monotonic_time() > deadline)) {
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                ret = false;
+                break;
+            }
+            g_usleep(pollInterval);
+            pollInterval = std::min(pollInterval * 2, gulong(50000));
+        }
+        g_spawn_close_pid(pid);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{processMutex_};
+        --runningProcesses_;
+    }
+    processFinished_.notify_one();
+    return ret && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// static
+void Thumbnailer::setMaxRunningProcesses(int count) {
+    {
+        std::lock_guard<std::mutex> lock{processMutex_};
+        maxRunningProcesses_ = std::max(count, 1);
+    }
+    processFinished_.notify_all();
+}
+
+// static
+int Thumbnailer::maxRunningProcesses() {
+    std::lock_guard<std::mutex> lock{processMutex_};
+    return maxRunningProcesses_;
+}
+
+// static
+void Thumbnailer::setTimeout(int msec) {
+    timeout_ = msec;
+}
+
+// static
+int Thumbnailer::timeout() {
+    return timeout_;
 }
 
 static void find_thumbnailers_in_data_dir(std::unordered_map<std::string, const char*>& hash, const char* data_dir) {
@@ -92,7 +188,54 @@ static void find_thumbnailers_in_data_dir(std::unordered_map<std::string, const
     }
 }
 
+// the modification times of the thumbnailers folders of the user and system data dirs, or 0 for the missing ones
+static std::vector<time_t> thumbnailerDirMTimes() {
+    std::vector<time_t> mtimes;
+    auto addMTime = [&mtimes](const char* data_dir) {
+        CStrPtr dir_path{g_build_filename(data_dir, "thumbnailers", nullptr)};
+        struct stat st;
+        mtimes.push_back(stat(dir_path.get(), &st) == 0 ? st.st_mtime : 0);
+    };
+    addMTime(g_get_user_data_dir());
+    for(auto data_dir = g_get_system_data_dirs(); *data_dir; ++data_dir) {
+        addMTime(*data_dir);
+    }
+    return mtimes;
+}
+
+// static
 void Thumbnailer::loadAll() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    loadAllLocked();
+    dirMTimes_ = thumbnailerDirMTimes();
+    loaded_ = true;
+}
+
+// static
+void Thumbnailer::ensureLoaded() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    // only a few folders are checked, so it's cheap enough to be done for every thumbnail job
+    auto mtimes = thumbnailerDirMTimes();
+    if(loaded_ && mtimes == dirMTimes_) {
+        return;
+    }
+    loadAllLocked();
+    dirMTimes_ = std::move(mtimes);
+    loaded_ = true;
+}
+
+// static
+void Thumbnailer::loadAllLocked() {
+    StartupSpan span{"Thumbnailer::loadAll"};
+    // forget the thumbnailers loaded before
+    for(auto& thumbnailer: allThumbnailers_) {
+        std::shared_ptr<const Thumbnailer> constThumbnailer = thumbnailer;
+        for(auto& mime_type: thumbnailer->mimeTypes_) {
+            std::const_pointer_cast<MimeType>(mime_type)->removeThumbnailer(constThumbnailer);
+        }
+    }
+    allThumbnailers_.clear();
+
     const gchar* const* data_dirs = g_get_system_data_dirs();
     const gchar* const* data_dir;
 
@@ -111,7 +254,6 @@ void Thumbnailer::loadAll() {
 
     /* load all found thumbnailers */
     if(!hash.empty()) {
-        std::lock_guard<std::mutex> lock{mutex_};
         GKeyFile* kf = g_key_file_new();
         for(auto& item: hash) {
             auto& base_name = item.first;
@@ -126,6 +268,7 @@ void Thumbnailer::loadAll() {
                             auto mime_type = MimeType::fromName(*name);
                             if(mime_type) {
                                 std::const_pointer_cast<MimeType>(mime_type)->addThumbnailer(thumbnailer);
+                                thumbnailer->mimeTypes_.push_back(std::move(mime_type));
                             }
                         }
                         g_strfreev(mime_types);
@@ -7,6 +7,8 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <gio/gio.h>
 
 namespace Fm {
 
@@ -20,16 +22,45 @@ public:
 
     bool run(const char* uri, const char* output_file, int size) const;
 
+    // Run the thumbnailer and wait for it. The process is killed if it takes longer than timeout()
+    // or the cancellable is cancelled. At most maxRunningProcesses() thumbnailers run at the same
+    // time regardless of the number of threads calling this.
+    bool run(const char* uri, const char* output_file, int size, GCancellable* cancellable) const;
+
+    // Load the thumbnailers again. Normally ensureLoaded() should be used instead.
     static void loadAll();
 
+    // Load the thumbnailers on the first call, and load them again if the folders containing
+    // them were changed since then. Called before looking up the thumbnailers of a mime type.
+    static void ensureLoaded();
+
+    static void setMaxRunningProcesses(int count);
+
+    static int maxRunningProcesses();
+
+    // timeout in milliseconds (0 means no timeout)
+    static void setTimeout(int msec);
+
+    static int timeout();
+
 private:
     CStrPtr id_;
     CStrPtr try_exec_; /* FIXME: is this useful? */
     CStrPtr exec_;
-    //std::vector<std::shared_ptr<const MimeType>> mimeTypes_;
+    std::vector<std::shared_ptr<const MimeType>> mimeTypes_;
 
-    static std::mutex mutex_;
+    static void loadAllLocked();
+
+    static std::mutex mutex_; // protects allThumbnailers_, loaded_ and dirMTimes_
     static std::vector<std::shared_ptr<Thumbnailer>> allThumbnailers_;
+    static bool loaded_;
+    static std::vector<time_t> dirMTimes_; // of the thumbnailers folders of all data dirs
+
+    static std::mutex processMutex_; // protects runningProcesses_ and maxRunningProcesses_
+    static std::condition_variable processFinished_;
+    static int runningProcesses_;
+    static int maxRunningProcesses_;
+    static int timeout_;
 };
 
 } // namespace Fm
@@ -2,15 +2,537 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <libexif/exif-loader.h>
 #include <QImageReader>
+#include <QBuffer>
 #include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QThread>
+#include <QElapsedTimer>
 #include "thumbnailer.h"
+#include "jobtrace_p.h"
+#include "filesystemcapabilities_p.h"
+#include "stats.h"
 
 #include "core/legacy/fm-config.h"
 
 namespace Fm {
 
+namespace {
+
+// the largest image file which is read into memory to generate its thumbnail
+const size_t maxBufferedImageSize = 256 * 1024 * 1024;
+
+// the EXIF data is read in chunks of this size, but not beyond maxExifHeaderSize
+const size_t exifHeaderReadSize = 64 * 1024;
+const size_t maxExifHeaderSize = 256 * 1024;
+
+// LRU cache of decoded thumbnails keyed by the URI, mtime and size of the file (the base key) and the
+// thumbnail size. The sizes cached for each file are indexed too, so a smaller thumbnail can be scaled
+// from a larger one when the view is zoomed out.
+class MemoryCache {
+public:
+    MemoryCache(): maxBytes_{32 * 1024 * 1024}, bytes_{0} {
+    }
+
+    bool lookup(const std::string& base, int size, QImage& image) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = index_.find(key(base, size));
+        if(it == index_.end()) {
+            return false;
+        }
+        // move the entry to the front of the LRU list
+        entries_.splice(entries_.begin(), entries_, it->second);
+        image = it->second->image;
+        return true;
+    }
+
+    // the smallest cached thumbnail of the file which is larger than size
+    bool lookupLarger(const std::string& base, int size, QImage& image) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto sizesIt = sizes_.find(base);
+        if(sizesIt == sizes_.end()) {
+            return false;
+        }
+        int larger = 0;
+        for(int cachedSize : sizesIt->second) {
+            if(cachedSize > size && (larger == 0 || cachedSize < larger)) {
+                larger = cachedSize;
+            }
+        }
+        if(larger == 0) {
+            return false;
+        }
+        auto it = index_.find(key(base, larger));
+        entries_.splice(entries_.begin(), entries_, it->second);
+        image = it->second->image;
+        return true;
+    }
+
+    void insert(const std::string& base, int thumbnailSize, const QImage& image) {
+        size_t size = image.byteCount();
+        std::string entryKey = key(base, thumbnailSize);
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(size > maxBytes_) {
+            return;
+        }
+        auto it = index_.find(entryKey);
+        if(it != index_.end()) {
+            bytes_ -= it->second->image.byteCount();
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+        else {
+            sizes_[base].push_back(thumbnailSize);
+        }
+        entries_.emplace_front(Entry{base, thumbnailSize, image});
+        index_.emplace(std::move(entryKey), entries_.begin());
+        bytes_ += size;
+        trim();
+        Stats::set(Stats::THUMBNAIL_MEMORY_CACHE_BYTES, bytes_);
+    }
+
+    void setMaxBytes(size_t bytes) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        maxBytes_ = bytes;
+        trim();
+        Stats::set(Stats::THUMBNAIL_MEMORY_CACHE_BYTES, bytes_);
+    }
+
+    size_t maxBytes() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return maxBytes_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        index_.clear();
+        sizes_.clear();
+        entries_.clear();
+        bytes_ = 0;
+        Stats::set(Stats::THUMBNAIL_MEMORY_CACHE_BYTES, 0);
+    }
+
+private:
+    struct Entry {
+        std::string base;
+        int size;
+        QImage image;
+    };
+
+    static std::string key(const std::string& base, int size) {
+        std::string key{base};
+        key += '\n';
+        key += std::to_string(size);
+        return key;
+    }
+
+    void trim() {
+        while(bytes_ > maxBytes_ && !entries_.empty()) {
+            auto& last = entries_.back();
+            bytes_ -= last.image.byteCount();
+            index_.erase(key(last.base, last.size));
+            auto sizesIt = sizes_.find(last.base);
+            auto& sizes = sizesIt->second;
+            sizes.erase(std::find(sizes.begin(), sizes.end(), last.size));
+            if(sizes.empty()) {
+                sizes_.erase(sizesIt);
+            }
+            entries_.pop_back();
+        }
+    }
+
+    std::mutex mutex_;
+    size_t maxBytes_;
+    size_t bytes_;
+    std::list<Entry> entries_; // the most recently used ones first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::unordered_map<std::string, std::vector<int>> sizes_; // the cached sizes of each file
+};
+
+MemoryCache& memoryCache() {
+    static MemoryCache cache;
+    return cache;
+}
+
+// Names of the files in the thumbnail directories. Each directory is listed once when it's first
+// used and the index is updated when we write thumbnails, so the missing ones cost no syscalls.
+// Thumbnails created by other programs later are not known, and they are just generated again.
+class ThumbnailIndex {
+public:
+    bool contains(const std::string& dir, const char* name) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto& names = namesInDir(dir);
+        return names.find(name) != names.end();
+    }
+
+    void insert(const std::string& dir, const char* name) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        namesInDir(dir).emplace(name);
+    }
+
+private:
+    std::unordered_set<std::string>& namesInDir(const std::string& dir) {
+        auto it = dirs_.find(dir);
+        if(it == dirs_.end()) {
+            it = dirs_.emplace(dir, std::unordered_set<std::string>{}).first;
+            if(GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr)) {
+                while(const char* name = g_dir_read_name(gdir)) {
+                    it->second.emplace(name);
+                }
+                g_dir_close(gdir);
+            }
+        }
+        return it->second;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::unordered_set<std::string>> dirs_;
+};
+
+ThumbnailIndex& thumbnailIndex() {
+    static ThumbnailIndex index;
+    return index;
+}
+
+// Saves the generated thumbnails in a background thread, so they can be shown without waiting for
+// the PNG compression and the disk. Repeated writes of the same file are coalesced.
+class ThumbnailWriter {
+public:
+    ThumbnailWriter(): threadStarted_{false} {
+    }
+
+    void save(const QString& filename, const QImage& image) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        // don't let the queue grow without limit if the disk cannot keep up
+        queueNotFull_.wait(lock, [this]() {
+            return pending_.size() < maxPendingWrites;
+        });
+        pending_[filename] = image;
+        if(!threadStarted_) {
+            // the writer is never destroyed, so the thread can outlive the callers
+            std::thread{&ThumbnailWriter::run, this}.detach();
+            threadStarted_ = true;
+        }
+        queueNotEmpty_.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        for(;;) {
+            queueNotEmpty_.wait(lock, [this]() {
+                return !pending_.empty();
+            });
+            auto it = pending_.begin();
+            QString filename = it->first;
+            QImage image = std::move(it->second);
+            pending_.erase(it);
+            queueNotFull_.notify_all();
+
+            lock.unlock();
+            write(filename, image);
+            lock.lock();
+        }
+    }
+
+    static void write(const QString& filename, const QImage& image) {
+        int sep = filename.lastIndexOf('/');
+        QString dir = filename.left(sep);
+        QDir().mkpath(dir);
+        // write to a temporary file and rename it, so other programs never see a partial thumbnail
+        QSaveFile file{filename};
+        if(file.open(QIODevice::WriteOnly) && image.save(&file, "PNG", pngQuality) && file.commit()) {
+            thumbnailIndex().insert(dir.toLocal8Bit().constData(), filename.mid(sep + 1).toLocal8Bit().constData());
+        }
+    }
+
+    static const size_t maxPendingWrites = 256;
+    static const int pngQuality = 80; // prefer speed to the size of the files
+
+    std::mutex mutex_;
+    std::condition_variable queueNotEmpty_;
+    std::condition_variable queueNotFull_;
+    std::map<QString, QImage> pending_;
+    bool threadStarted_;
+};
+
+ThumbnailWriter& thumbnailWriter() {
+    static ThumbnailWriter* writer = new ThumbnailWriter();
+    return *writer;
+}
+
+// The policies of the filesystems, and the speeds of the ones in Auto mode measured while the
+// thumbnails of their files are generated. A slow filesystem is throttled for a while, e.g. sshfs
+// over a slow link, which is longer each time it's still slow when it's probed again.
+class FilesystemPolicies {
+public:
+    typedef ThumbnailJob::FilesystemPolicy Policy;
+
+    FilesystemPolicies() {
+        clock_.start();
+    }
+
+    void setPolicy(const std::string& id, Policy policy) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        Entry& entry = entries_[id];
+        entry.policy = policy;
+        entry.resetSamples();
+        entry.throttledUntil = 0;
+        entry.throttleTime = minThrottleTime;
+    }
+
+    Policy policy(const std::string& id) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = entries_.find(id);
+        return it != entries_.end() ? it->second.policy : Policy::Auto;
+    }
+
+    // the policy used for the files now
+    Policy effectivePolicy(const std::string& id) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = entries_.find(id);
+        if(it == entries_.end()) {
+            return Policy::Always;
+        }
+        const Entry& entry = it->second;
+        if(entry.policy != Policy::Auto) {
+            return entry.policy;
+        }
+        return clock_.elapsed() < entry.throttledUntil ? Policy::CachedOnly : Policy::Always;
+    }
+
+    bool isThrottled(const std::string& id) {
+        return policy(id) == Policy::Auto && effectivePolicy(id) == Policy::CachedOnly;
+    }
+
+    void addOpenTime(const std::string& id, qint64 nsecs) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        Entry& entry = entries_[id];
+        if(entry.policy != Policy::Auto) {
+            return;
+        }
+        double msecs = nsecs / 1e6;
+        entry.openTime = entry.openSamples > 0 ? entry.openTime + (msecs - entry.openTime) * sampleWeight : msecs;
+        ++entry.openSamples;
+        update(entry);
+    }
+
+    void addReadTime(const std::string& id, std::uint64_t bytes, qint64 nsecs) {
+        // the time of reading a small file is mostly the latency
+        if(bytes < minMeasuredReadSize || nsecs <= 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock{mutex_};
+        Entry& entry = entries_[id];
+        if(entry.policy != Policy::Auto) {
+            return;
+        }
+        double throughput = bytes * 1e9 / nsecs;
+        entry.throughput = entry.readSamples > 0 ? entry.throughput + (throughput - entry.throughput) * sampleWeight : throughput;
+        ++entry.readSamples;
+        update(entry);
+    }
+
+private:
+    struct Entry {
+        Entry():
+            policy{Policy::Auto},
+            throttledUntil{0},
+            throttleTime{minThrottleTime} {
+            resetSamples();
+        }
+
+        void resetSamples() {
+            openTime = 0;
+            throughput = 0;
+            openSamples = 0;
+            readSamples = 0;
+        }
+
+        Policy policy;
+        double openTime;   // the moving average of the opening latency in ms
+        double throughput; // the moving average of the read throughput in bytes per second
+        int openSamples;
+        int readSamples;
+        qint64 throttledUntil; // the time of clock_ until which it's throttled
+        qint64 throttleTime;   // how long it's throttled the next time it's slow
+    };
+
+    void update(Entry& entry) {
+        bool slow = (entry.openSamples >= minSamples && entry.openTime > maxOpenTime)
+                    || (entry.readSamples >= minSamples && entry.throughput < minThroughput);
+        bool fast = entry.openSamples >= minSamples && entry.readSamples >= minSamples && !slow;
+        if(slow) {
+            entry.throttledUntil = clock_.elapsed() + entry.throttleTime;
+            entry.throttleTime = std::min(entry.throttleTime * 2, maxThrottleTime);
+            entry.resetSamples();
+        }
+        else if(fast) {
+            entry.throttleTime = minThrottleTime;
+        }
+    }
+
+    static constexpr double sampleWeight = 0.25;
+    static const int minSamples = 3;
+    static constexpr double maxOpenTime = 200;      // ms
+    static constexpr double minThroughput = 2 << 20; // bytes per second
+    static const std::uint64_t minMeasuredReadSize = 64 * 1024;
+    static const qint64 minThrottleTime = 30 * 1000;
+    static const qint64 maxThrottleTime = 10 * 60 * 1000;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    QElapsedTimer clock_;
+};
+
+constexpr double FilesystemPolicies::sampleWeight;
+constexpr double FilesystemPolicies::maxOpenTime;
+constexpr double FilesystemPolicies::minThroughput;
+const qint64 FilesystemPolicies::minThrottleTime;
+const qint64 FilesystemPolicies::maxThrottleTime;
+
+// the base key of the thumbnails of the file in the memory cache
+std::string memoryCacheKey(const char* uri, const FileInfo& file) {
+    std::string key{uri};
+    key += '\n';
+    key += std::to_string(file.mtime());
+    key += '\n';
+    key += std::to_string(file.size());
+    return key;
+}
+
+// The subdirs of the thumbnail dir in the freedesktop spec, and the sizes of the thumbnails in them.
+// A thumbnail is loaded from the smallest one which is not smaller than it.
+struct ThumbnailTier {
+    const char* subdir;
+    int size;
+};
+
+const ThumbnailTier thumbnailTiers[] = {
+    {"normal", 128},
+    {"large", 256},
+    {"x-large", 512},
+    {"xx-large", 1024}
+};
+
+const int numThumbnailTiers = sizeof(thumbnailTiers) / sizeof(thumbnailTiers[0]);
+
+int thumbnailTierIndex(int size) {
+    for(int i = 0; i < numThumbnailTiers - 1; ++i) {
+        if(size <= thumbnailTiers[i].size) {
+            return i;
+        }
+    }
+    return numThumbnailTiers - 1;
+}
+
+const ThumbnailTier& thumbnailTier(int size) {
+    return thumbnailTiers[thumbnailTierIndex(size)];
+}
+
+FilesystemPolicies& filesystemPolicies() {
+    static FilesystemPolicies* policies = new FilesystemPolicies();
+    return *policies;
+}
+
+// The thumbnails being loaded by the jobs, so the jobs of the other views showing the same files
+// wait for the results instead of loading them again.
+class InFlightThumbnails {
+public:
+    struct Flight {
+        Flight(): done{false}, valid{false} {
+        }
+
+        bool done;
+        bool valid; // false if the job loading it is cancelled
+        QImage image;
+    };
+
+    // Finishes the flight of the job which loads the thumbnail when it's destroyed.
+    struct Owner {
+        Owner(const std::string& key, const Job* job): key{key}, job{job} {
+        }
+
+        ~Owner();
+
+        const std::string& key;
+        const Job* job;
+        QImage image; // a null image also tells the waiters that there's no thumbnail
+    };
+
+    // The flight of the key if another job is loading it. Otherwise nullptr is returned,
+    // and the caller should load it with an Owner.
+    std::shared_ptr<Flight> join(const std::string& key) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = flights_.find(key);
+        if(it != flights_.end()) {
+            return it->second;
+        }
+        flights_.emplace(key, std::make_shared<Flight>());
+        return nullptr;
+    }
+
+    // wait for the result of the flight, false if the job is cancelled, or the owner is cancelled
+    bool wait(const std::shared_ptr<Flight>& flight, const Job* job, QImage& image) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        while(!flight->done) {
+            if(job->isCancelled()) {
+                return false;
+            }
+            // the cancellation of the job is not notified, so it's checked once in a while
+            finished_.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        if(!flight->valid) {
+            return false;
+        }
+        image = flight->image;
+        return true;
+    }
+
+    void finish(const std::string& key, const QImage& image, bool valid) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = flights_.find(key);
+            if(it == flights_.end()) {
+                return;
+            }
+            auto& flight = *it->second;
+            flight.done = true;
+            flight.valid = valid;
+            flight.image = image;
+            flights_.erase(it);
+        }
+        finished_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable finished_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+};
+
+InFlightThumbnails& inFlightThumbnails() {
+    static InFlightThumbnails* flights = new InFlightThumbnails();
+    return *flights;
+}
+
+InFlightThumbnails::Owner::~Owner() {
+    inFlightThumbnails().finish(key, image, !job->isCancelled());
+}
+
+} // namespace
+
 QThreadPool* ThumbnailJob::threadPool_ = nullptr;
 
 bool ThumbnailJob::localFilesOnly_ = true;
@@ -19,7 +541,10 @@ int ThumbnailJob::maxThumbnailFileSize_ = 0;
 ThumbnailJob::ThumbnailJob(FileInfoList files, int size):
     files_{std::move(files)},
     size_{size},
-    md5Calc_{g_checksum_new(G_CHECKSUM_MD5)} {
+    md5Calc_{g_checksum_new(G_CHECKSUM_MD5)},
+    readTime_{0},
+    progressive_{false} {
+    setPriority(Priority::THUMBNAIL);
 }
 
 ThumbnailJob::~ThumbnailJob() {
@@ -28,21 +553,44 @@ ThumbnailJob::~ThumbnailJob() {
 }
 
 void ThumbnailJob::exec() {
+    // the thumbnailers are only loaded when the first thumbnail is requested
+    Thumbnailer::ensureLoaded();
+    if(progressive_) {
+        // the previews of all the files are shown before the real thumbnails of any of them
+        for(auto& file: files_) {
+            if(isCancelled()) {
+                return;
+            }
+            QImage preview = loadPreview(file);
+            if(!preview.isNull()) {
+                Stats::add(Stats::THUMBNAIL_PREVIEWS);
+                Q_EMIT thumbnailLoaded(file, size_, preview);
+            }
+        }
+    }
     for(auto& file: files_) {
         if(isCancelled()) {
             break;
         }
+        TraceSpan span{"ThumbnailJob::loadForFile"};
         auto image = loadForFile(file);
+        span.end();
         Q_EMIT thumbnailLoaded(file, size_, image);
         results_.emplace_back(std::move(image));
     }
 }
 
-QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
-    // FIXME: should we set a limit here? Otherwise if len is too large, we can run out of memory.
+QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len, int targetSize) {
+    // the whole file is buffered, so don't try it for huge files or we can run out of memory
+    if(len > maxBufferedImageSize) {
+        return QImage();
+    }
+    readTime_ = 0;
     std::unique_ptr<unsigned char[]> buffer{new unsigned char[len]}; // allocate enough buffer
     unsigned char* pbuffer = buffer.get();
     size_t totalReadSize = 0;
+    QElapsedTimer readTimer;
+    readTimer.start();
     while(!isCancelled() && totalReadSize < len) {
         size_t bytesToRead = totalReadSize + 4096 > len ? len - totalReadSize : 4096;
         gssize readSize = g_input_stream_read(stream, pbuffer, bytesToRead, cancellable_.get(), nullptr);
@@ -55,38 +603,94 @@ QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
         totalReadSize += readSize;
         pbuffer += readSize;
     }
-    QImage image;
-    image.loadFromData(buffer.get(), totalReadSize);
-    return image;
-}
-
-QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
-    if(!file->canThumbnail()) {
+    if(isCancelled()) {
         return QImage();
     }
+    readTime_ = readTimer.nsecsElapsed();
 
-    // thumbnails are stored in $XDG_CACHE_HOME/thumbnails/large|normal|failed
-    QString thumbnailDir{g_get_user_cache_dir()};
-    thumbnailDir += "/thumbnails/";
-
-    // don't make thumbnails for files inside the thumbnail directory
-    if(FilePath::fromLocalPath(thumbnailDir.toLocal8Bit().constData()).isParentOf(file->dirPath())) {
-        return QImage();
+    // Let the image plugin decode at the thumbnail size instead of decoding the full image and
+    // scaling it down later. The jpeg plugin does it in the DCT domain, which is much faster.
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(buffer.get()), totalReadSize);
+    QBuffer device{&data};
+    device.open(QIODevice::ReadOnly);
+    QImageReader reader{&device};
+    QSize imageSize = reader.size();
+    if(imageSize.isValid() && (imageSize.width() > targetSize || imageSize.height() > targetSize)) {
+        reader.setScaledSize(imageSize.scaled(targetSize, targetSize, Qt::KeepAspectRatio));
     }
+    return reader.read();
+}
 
-    const char* subdir = size_ > 128 ? "large" : "normal";
-    thumbnailDir += subdir;
+// the file name of the thumbnail => {md5 of uri}.png
+void ThumbnailJob::computeThumbnailName(const char* uri, char* name) {
+    g_checksum_update(md5Calc_, reinterpret_cast<const unsigned char*>(uri), -1);
+    memcpy(name, g_checksum_get_string(md5Calc_), 32);
+    mempcpy(name + 32, ".png", 5);
+    g_checksum_reset(md5Calc_); // reset the checksum calculator for next use
+}
 
-    // generate base name of the thumbnail  => {md5 of uri}.png
+// A quick thumbnail shown until loadForFile() gets the real one. Decoding the larger thumbnails
+// of a screen of images takes a while, so a smaller one is shown first if it's there, or the
+// preview embedded in a JPEG file whose thumbnail is not generated yet. It's scaled to the
+// requested size quickly. A null image is returned if there's no such preview, or if the real one is
+// quick to get anyway.
+QImage ThumbnailJob::loadPreview(const std::shared_ptr<const FileInfo>& file) {
+    int tier = thumbnailTierIndex(size_);
+    if(tier == 0 || !file->canThumbnail()
+            || !FileSystemCapabilities::cached(file->filesystemId()).canThumbnail) {
+        return QImage();
+    }
+    FilesystemPolicy policy = effectivePolicy(file);
+    if(policy == FilesystemPolicy::Never) {
+        return QImage();
+    }
     auto origPath = file->path();
     auto uri = origPath.uri();
+    std::string cacheKey = memoryCacheKey(uri.get(), *file);
+    QImage preview;
+    if(memoryCache().lookup(cacheKey, size_, preview) || memoryCache().lookupLarger(cacheKey, size_, preview)) {
+        return QImage();
+    }
 
     char thumbnailName[32 + 5];
-    // calculate md5 hash for the uri of the original file
-    g_checksum_update(md5Calc_, reinterpret_cast<const unsigned char*>(uri.get()), -1);
-    memcpy(thumbnailName, g_checksum_get_string(md5Calc_), 32);
-    mempcpy(thumbnailName + 32, ".png", 5);
-    g_checksum_reset(md5Calc_); // reset the checksum calculator for next use
+    computeThumbnailName(uri.get(), thumbnailName);
+    QString thumbnailDir{g_get_user_cache_dir()};
+    thumbnailDir += "/thumbnails/";
+    // the largest smaller one which is there
+    bool found = false;
+    for(int i = tier - 1; i >= 0 && !found; --i) {
+        QString smallerDir = thumbnailDir + thumbnailTiers[i].subdir;
+        if(thumbnailIndex().contains(smallerDir.toLocal8Bit().constData(), thumbnailName)) {
+            found = true;
+            preview = QImage{smallerDir + '/' + thumbnailName};
+            if(!preview.isNull() && isThumbnailOutdated(file, preview)) {
+                preview = QImage();
+            }
+        }
+    }
+    if(!found && policy == FilesystemPolicy::Always && strcmp(file->mimeType()->name(), "image/jpeg") == 0
+            && !thumbnailIndex().contains((thumbnailDir + thumbnailTiers[tier].subdir).toLocal8Bit().constData(), thumbnailName)) {
+        GFileInputStreamPtr ins{g_file_read(origPath.gfile().get(), cancellable_.get(), nullptr), false};
+        int rotate_degrees = 0;
+        if(ins && readJpegExif(G_INPUT_STREAM(ins.get()), preview, rotate_degrees) && rotate_degrees != 0) {
+            // see generateThumbnail()
+            preview = preview.transformed(QMatrix().rotate(360 - rotate_degrees));
+        }
+        if(ins) {
+            g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
+        }
+    }
+    if(!preview.isNull() && preview.width() != size_ && preview.height() != size_) {
+        preview = preview.scaled(size_, size_, Qt::KeepAspectRatio, Qt::FastTransformation);
+    }
+    return preview;
+}
+
+// the thumbnail of the file in the subdir of the thumbnail dir, which is generated if it's not there
+QImage ThumbnailJob::loadThumbnailFile(const std::shared_ptr<const FileInfo>& file, FilesystemPolicy policy,
+                                       const FilePath& origPath, const char* uri, const QString& thumbnailDir) {
+    char thumbnailName[32 + 5];
+    computeThumbnailName(uri, thumbnailName);
 
     QString thumbnailFilename = thumbnailDir;
     thumbnailFilename += '/';
@@ -94,19 +698,143 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
     // qDebug() << "thumbnail:" << file->getName().c_str() << thumbnailFilename;
 
     // try to load the thumbnail file if it exists
-    QImage thumbnail{thumbnailFilename};
-    if(thumbnail.isNull() || isThumbnailOutdated(file, thumbnail)) {
+    QImage thumbnail;
+    std::string thumbnailDirPath{thumbnailDir.toLocal8Bit().constData()};
+    if(thumbnailIndex().contains(thumbnailDirPath, thumbnailName)) {
+        thumbnail = QImage{thumbnailFilename};
+    }
+    if(!thumbnail.isNull() && !isThumbnailOutdated(file, thumbnail)) {
+        Stats::add(Stats::THUMBNAIL_DISK_HITS);
+    }
+    else {
         // the existing thumbnail cannot be loaded, generate a new one
+        if(policy == FilesystemPolicy::CachedOnly) {
+            // no failure marker, since it might be generated later
+            Stats::add(Stats::THUMBNAILS_SKIPPED);
+            return QImage();
+        }
+
+        // don't retry the files which we failed to make thumbnails for, until they are modified
+        QString failedDir{g_get_user_cache_dir()};
+        failedDir += "/thumbnails/fail/libfm-qt";
+        std::string failedDirPath{failedDir.toLocal8Bit().constData()};
+        QString failedFilename = failedDir + '/' + thumbnailName;
+        if(thumbnailIndex().contains(failedDirPath, thumbnailName)
+                && !isThumbnailOutdated(file, QImage{failedFilename})) {
+            Stats::add(Stats::THUMBNAIL_FAILURES);
+            return QImage();
+        }
 
         // create the thumbnail dir as needd (FIXME: Qt file I/O is slow)
         QDir().mkpath(thumbnailDir);
 
-        thumbnail = generateThumbnail(file, origPath, uri.get(), thumbnailFilename);
+        TraceSpan generateSpan{"ThumbnailJob::generateThumbnail"};
+        thumbnail = generateThumbnail(file, origPath, uri, thumbnailFilename);
+        generateSpan.end();
+        if(!thumbnail.isNull()) {
+            Stats::add(Stats::THUMBNAILS_GENERATED);
+            // the files written by the external thumbnailers are not known to the index yet
+            // (the ones we save are added by the writer, and the EXIF thumbnails are not saved)
+            if(QFile::exists(thumbnailFilename)) {
+                thumbnailIndex().insert(thumbnailDirPath, thumbnailName);
+            }
+        }
+        else if(!isCancelled() && hasThumbnailGenerator(file->mimeType())) {
+            Stats::add(Stats::THUMBNAIL_FAILURES);
+            // write a failure marker as described in the thumbnail spec
+            QImage failed{1, 1, QImage::Format_ARGB32};
+            failed.fill(Qt::transparent);
+            failed.setText("Thumb::MTime", QString::number(file->mtime()));
+            failed.setText("Thumb::URI", uri);
+            thumbnailWriter().save(failedFilename, failed);
+        }
     }
+    return thumbnail;
+}
+
+QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
+    if(!file->canThumbnail()) {
+        return QImage();
+    }
+    // the filesystems whose previews are not wanted, e.g. slow remote ones (filesystem::use-preview)
+    if(!FileSystemCapabilities::cached(file->filesystemId()).canThumbnail) {
+        return QImage();
+    }
+    FilesystemPolicy policy = effectivePolicy(file);
+    if(policy == FilesystemPolicy::Never) {
+        return QImage();
+    }
+
+    // thumbnails are stored in $XDG_CACHE_HOME/thumbnails/normal|large|x-large|xx-large|fail
+    QString thumbnailDir{g_get_user_cache_dir()};
+    thumbnailDir += "/thumbnails/";
+
+    // don't make thumbnails for files inside the thumbnail directory
+    if(FilePath::fromLocalPath(thumbnailDir.toLocal8Bit().constData()).isParentOf(file->dirPath())) {
+        return QImage();
+    }
+
+    const char* subdir = thumbnailTier(size_).subdir;
+    thumbnailDir += subdir;
+
+    // generate base name of the thumbnail  => {md5 of uri}.png
+    auto origPath = file->path();
+    auto uri = origPath.uri();
+
+    // check the decoded thumbnails in memory before touching the disk
+    std::string cacheKey = memoryCacheKey(uri.get(), *file);
+    QImage cached;
+    if(memoryCache().lookup(cacheKey, size_, cached)) {
+        Stats::add(Stats::THUMBNAIL_MEMORY_HITS);
+        return cached;
+    }
+    // a larger one is there if the view is zoomed out, which is scaled without decoding anything
+    if(memoryCache().lookupLarger(cacheKey, size_, cached)) {
+        Stats::add(Stats::THUMBNAIL_MEMORY_HITS);
+        // the thumbnail of a small image can be smaller than the size even in a larger tier, and it's not enlarged
+        if(cached.width() > size_ || cached.height() > size_) {
+            Stats::add(Stats::THUMBNAILS_SCALED);
+            cached = cached.scaled(size_, size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        memoryCache().insert(cacheKey, size_, cached);
+        return cached;
+    }
+
+    // Another job might be loading the thumbnail for another view, maybe at another size in the same
+    // subdir. This job waits for its result, so the file is decoded and the PNG is written only once.
+    std::string flightKey{uri.get()};
+    flightKey += '\n';
+    flightKey += std::to_string(file->mtime());
+    flightKey += '\n';
+    flightKey += std::to_string(file->size());
+    flightKey += '\n';
+    flightKey += subdir;
+    QImage thumbnail;
+    for(;;) {
+        auto flight = inFlightThumbnails().join(flightKey);
+        if(!flight) { // this job loads it
+            InFlightThumbnails::Owner owner{flightKey, this};
+            thumbnail = loadThumbnailFile(file, policy, origPath, uri.get(), thumbnailDir);
+            owner.image = thumbnail;
+            break;
+        }
+        if(inFlightThumbnails().wait(flight, this, thumbnail)) {
+            Stats::add(Stats::THUMBNAIL_SHARED_HITS);
+            break;
+        }
+        if(isCancelled()) {
+            return QImage();
+        }
+        // the other job is cancelled, so this one loads it
+    }
+
     // resize to the size we need
     if(thumbnail.width() > size_ || thumbnail.height() > size_) {
         thumbnail = thumbnail.scaled(size_, size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
+    if(!thumbnail.isNull() && !isCancelled()) {
+        memoryCache().insert(cacheKey, size_, thumbnail);
+    }
     return thumbnail;
 }
 
@@ -120,6 +848,18 @@ bool ThumbnailJob::isSupportedImageType(const std::shared_ptr<const MimeType>& m
     return false;
 }
 
+bool ThumbnailJob::hasThumbnailGenerator(const std::shared_ptr<const MimeType>& mimeType) const {
+    if(isSupportedImageType(mimeType)) {
+        return true;
+    }
+    bool found = false;
+    mimeType->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& /*thumbnailer*/) {
+        found = true;
+        return true;
+    });
+    return found;
+}
+
 bool ThumbnailJob::isThumbnailOutdated(const std::shared_ptr<const FileInfo>& file, const QImage &thumbnail) const {
     QString thumb_mtime = thumbnail.text("Thumb::MTime");
     return (thumb_mtime.isEmpty() || thumb_mtime.toULongLong() != file->mtime());
@@ -127,14 +867,18 @@ bool ThumbnailJob::isThumbnailOutdated(const std::shared_ptr<const FileInfo>& fi
 
 bool ThumbnailJob::readJpegExif(GInputStream *stream, QImage& thumbnail, int& rotate_degrees) {
     /* try to extract thumbnails embedded in jpeg files */
+    // The EXIF data is in the APP1 segment at the beginning of the file, which cannot be larger than 64 KiB.
+    // So only the header region is read even if the loader wants more data for some broken files.
     ExifLoader* exif_loader = exif_loader_new();
-    while(!isCancelled()) {
-        unsigned char buf[4096];
-        gssize read_size = g_input_stream_read(stream, buf, 4096, cancellable_.get(), nullptr);
+    std::unique_ptr<unsigned char[]> buf{new unsigned char[exifHeaderReadSize]};
+    size_t total_read_size = 0;
+    while(!isCancelled() && total_read_size < maxExifHeaderSize) {
+        gssize read_size = g_input_stream_read(stream, buf.get(), exifHeaderReadSize, cancellable_.get(), nullptr);
         if(read_size <= 0) { // EOF or error
             break;
         }
-        if(exif_loader_write(exif_loader, buf, read_size) == 0) {
+        total_read_size += read_size;
+        if(exif_loader_write(exif_loader, buf.get(), read_size) == 0) {
             break;    // no more EXIF data
         }
     }
@@ -176,29 +920,44 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
     QImage result;
     auto mime_type = file->mimeType();
     if(isSupportedImageType(mime_type)) {
+        // the speed of the filesystem is measured for its Auto policy
+        const char* filesystemId = file->filesystemId();
+        QElapsedTimer openTimer;
+        openTimer.start();
         GFileInputStreamPtr ins{g_file_read(origPath.gfile().get(), cancellable_.get(), nullptr), false};
+        if(filesystemId) {
+            filesystemPolicies().addOpenTime(filesystemId, openTimer.nsecsElapsed());
+        }
         if(!ins)
             return QImage();
         bool fromExif = false;
         int rotate_degrees = 0;
+        int target_size = thumbnailTier(size_).size;
         if(strcmp(mime_type->name(), "image/jpeg") == 0) { // if this is a jpeg file
             // try to get the thumbnail embedded in EXIF data
             if(readJpegExif(G_INPUT_STREAM(ins.get()), result, rotate_degrees)) {
-                fromExif = true;
+                // The embedded previews are usually 160x120, which is enough for the normal thumbnails.
+                // Don't upscale a small one for the large thumbnails but decode the whole image instead.
+                if(std::max(result.width(), result.height()) >= target_size) {
+                    fromExif = true;
+                }
+                else {
+                    result = QImage();
+                }
             }
         }
         if(!fromExif) {  // not able to generate a thumbnail from the EXIF data
             // load the original file and do the scaling ourselves
             g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable_.get(), nullptr);
-            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size());
+            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size(), target_size);
+            if(filesystemId && readTime_ > 0) {
+                filesystemPolicies().addReadTime(filesystemId, file->size(), readTime_);
+            }
         }
         g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
 
         if(!result.isNull()) { // the image is successfully loaded
-            // scale the image as needed
-            int target_size = size_ > 128 ? 256 : 128;
-
-            // only scale the original image if it's too large
+            // only scale the image if it's still too large (the EXIF thumbnail is not scaled yet)
             if(result.width() > target_size || result.height() > target_size) {
                 result = result.scaled(target_size, target_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
             }
@@ -220,16 +979,16 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             if(!fromExif) {
                 result.setText("Thumb::MTime", QString::number(file->mtime()));
                 result.setText("Thumb::URI", uri);
-                result.save(thumbnailFilename, "PNG");
+                thumbnailWriter().save(thumbnailFilename, result);
             }
             // qDebug() << "save thumbnail:" << thumbnailFilename;
         }
     }
     else { // the image format is not supported, try to find an external thumbnailer
         // try all available external thumbnailers for it until sucess
-        int target_size = size_ > 128 ? 256 : 128;
+        int target_size = thumbnailTier(size_).size;
         file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
-            if(thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size)) {
+            if(thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size, cancellable_.get())) {
                 result = QImage(thumbnailFilename);
             }
             return !result.isNull(); // return true on success, and forEachThumbnailer() will stop.
@@ -249,7 +1008,7 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             }
             if(Q_UNLIKELY(changed)) {
                 // save the modified PNG file containing metadata to a file.
-                result.save(thumbnailFilename, "PNG");
+                thumbnailWriter().save(thumbnailFilename, result);
             }
         }
     }
@@ -264,6 +1023,58 @@ QThreadPool* ThumbnailJob::threadPool() {
     return threadPool_;
 }
 
+// static
+void ThumbnailJob::setMaxThreadCount(int count) {
+    threadPool()->setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+// static
+void ThumbnailJob::setMemoryCacheSize(size_t bytes) {
+    memoryCache().setMaxBytes(bytes);
+}
+
+// static
+size_t ThumbnailJob::memoryCacheSize() {
+    return memoryCache().maxBytes();
+}
+
+// static
+void ThumbnailJob::clearMemoryCache() {
+    memoryCache().clear();
+}
+
+ThumbnailJob::FilesystemPolicy ThumbnailJob::effectivePolicy(const std::shared_ptr<const FileInfo>& file) const {
+    const char* id = file->filesystemId();
+    return id ? filesystemPolicies().effectivePolicy(id) : FilesystemPolicy::Always;
+}
+
+// static
+void ThumbnailJob::setFilesystemPolicy(const char* filesystemId, FilesystemPolicy policy) {
+    filesystemPolicies().setPolicy(filesystemId, policy);
+}
+
+// static
+bool ThumbnailJob::setFilesystemPolicy(const FilePath& path, FilesystemPolicy policy) {
+    GFileInfoPtr inf{g_file_query_info(path.gfile().get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+                                       G_FILE_QUERY_INFO_NONE, nullptr, nullptr), false};
+    const char* id = inf ? g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM) : nullptr;
+    if(!id) {
+        return false;
+    }
+    setFilesystemPolicy(id, policy);
+    return true;
+}
+
+// static
+ThumbnailJob::FilesystemPolicy ThumbnailJob::filesystemPolicy(const char* filesystemId) {
+    return filesystemPolicies().policy(filesystemId);
+}
+
+// static
+bool ThumbnailJob::isFilesystemThrottled(const char* filesystemId) {
+    return filesystemPolicies().isThrottled(filesystemId);
+}
+
 void ThumbnailJob::setLocalFilesOnly(bool value) {
     localFilesOnly_ = value;
     if(fm_config) {
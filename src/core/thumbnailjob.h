@@ -23,18 +23,67 @@ public:
 
     static QThreadPool* threadPool();
 
+    // Number of threads used to load thumbnails in parallel (1 by default, 0 to use one per CPU core).
+    // FolderModel splits its requests into small jobs, so they're spread over all threads.
+    static void setMaxThreadCount(int count);
+
+    static int maxThreadCount() {
+        return threadPool()->maxThreadCount();
+    }
+
     static void setLocalFilesOnly(bool value);
 
     static bool localFilesOnly() {
         return localFilesOnly_;
     }
 
+    // How the thumbnails of the files on a filesystem are loaded.
+    enum class FilesystemPolicy {
+        Auto,       // the default, Always unless the filesystem is measured to be slow, then CachedOnly for a while
+        Always,     // generate the missing thumbnails
+        CachedOnly, // only load the existing thumbnails, so the files themselves are never read
+        Never       // no thumbnail at all
+    };
+
+    // Set the policy of the filesystem with the id (see FileInfo::filesystemId()).
+    static void setFilesystemPolicy(const char* filesystemId, FilesystemPolicy policy);
+
+    // The same for the filesystem containing the path, such as a mount point. It queries the id
+    // of its filesystem, and returns false if it's not found.
+    static bool setFilesystemPolicy(const FilePath& path, FilesystemPolicy policy);
+
+    static FilesystemPolicy filesystemPolicy(const char* filesystemId);
+
+    // True while the thumbnails of an Auto filesystem are not generated since it's measured to be slow.
+    // The opening latency and the read throughput of the files are measured while their thumbnails are
+    // generated, and the filesystem is probed again after a while, which is longer each time it's slow.
+    static bool isFilesystemThrottled(const char* filesystemId);
+
     static int maxThumbnailFileSize() {
         return maxThumbnailFileSize_;
     }
 
     static void setMaxThumbnailFileSize(int size);
 
+    // Decoded thumbnails are kept in a process-wide LRU cache shared by all jobs, so reopening
+    // a folder does not read them from the disk again. The cache is bounded by the total size
+    // of the images in bytes (0 disables it).
+    static void setMemoryCacheSize(size_t bytes);
+
+    static size_t memoryCacheSize();
+
+    static void clearMemoryCache();
+
+    // Emit a quick preview of each file before its real thumbnail, both with thumbnailLoaded(),
+    // when the real one takes a while to load. It only happens to the thumbnails larger than the normal ones.
+    void setProgressive(bool progressive) {
+        progressive_ = progressive;
+    }
+
+    bool isProgressive() const {
+        return progressive_;
+    }
+
     const std::vector<QImage>& results() const {
         return results_;
     }
@@ -50,14 +99,28 @@ private:
 
     bool isSupportedImageType(const std::shared_ptr<const MimeType>& mimeType) const;
 
+    // the file type is supported by QImageReader or an external thumbnailer
+    bool hasThumbnailGenerator(const std::shared_ptr<const MimeType>& mimeType) const;
+
     bool isThumbnailOutdated(const std::shared_ptr<const FileInfo>& file, const QImage& thumbnail) const;
 
     QImage generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename);
 
-    QImage readImageFromStream(GInputStream* stream, size_t len);
+    // decode the image directly at a size which fits in targetSize x targetSize
+    QImage readImageFromStream(GInputStream* stream, size_t len, int targetSize);
 
     QImage loadForFile(const std::shared_ptr<const FileInfo>& file);
 
+    QImage loadPreview(const std::shared_ptr<const FileInfo>& file);
+
+    void computeThumbnailName(const char* uri, char* name);
+
+    QImage loadThumbnailFile(const std::shared_ptr<const FileInfo>& file, FilesystemPolicy policy,
+                             const FilePath& origPath, const char* uri, const QString& thumbnailDir);
+
+    // the policy of the filesystem of the file, where Auto becomes Always or CachedOnly
+    FilesystemPolicy effectivePolicy(const std::shared_ptr<const FileInfo>& file) const;
+
     bool readJpegExif(GInputStream* stream, QImage& thumbnail, int& rotate_degrees);
 
 private:
@@ -66,6 +129,8 @@ private:
     std::vector<QImage> results_;
     GCancellablePtr cancellable_;
     GChecksum* md5Calc_;
+    qint64 readTime_; // the nanoseconds of the last full read of readImageFromStream(), 0 if it failed
+    bool progressive_;
 
     static QThreadPool* threadPool_;
 
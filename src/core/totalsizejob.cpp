@@ -1,4 +1,12 @@
 #include "totalsizejob.h"
+#include "cstrptr.h"
+#include "dirqueue_p.h"
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 namespace Fm {
 
@@ -8,8 +16,20 @@ static const char query_str[] =
     G_FILE_ATTRIBUTE_STANDARD_IS_VIRTUAL","
     G_FILE_ATTRIBUTE_STANDARD_SIZE","
     G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE","
+    G_FILE_ATTRIBUTE_UNIX_MODE","
     G_FILE_ATTRIBUTE_ID_FILESYSTEM;
 
+// don't keep more entries than this with KEEP_TREE, and the remaining dirs are not remembered
+static const size_t maxTreeSize = 1024 * 1024;
+
+// minimal interval between the progressChanged() signals in milliseconds
+static const qint64 progressInterval = 200;
+
+// the same as the G_FILE_ATTRIBUTE_ID_FILESYSTEM of the local files given by gio
+static std::string nativeFilesystemId(dev_t dev) {
+    return 'l' + std::to_string(std::uint64_t(dev));
+}
+
 
 TotalSizeJob::TotalSizeJob(FilePathList paths, Flags flags):
     paths_{std::move(paths)},
@@ -17,7 +37,37 @@ TotalSizeJob::TotalSizeJob(FilePathList paths, Flags flags):
     totalSize_{0},
     totalOndiskSize_{0},
     fileCount_{0},
-    dest_fs_id{nullptr} {
+    dest_fs_id{nullptr},
+    treeSize_{0},
+    threadCount_{1},
+    walker_{nullptr},
+    lastProgressTime_{0} {
+    setPriority(Priority::BACKGROUND);
+}
+
+GFileInfoPtr TotalSizeJob::Entry::fileInfo() const {
+    GFileInfoPtr inf{g_file_info_new(), false};
+    g_file_info_set_name(inf.get(), name.c_str());
+    CStrPtr dispName{g_filename_display_name(name.c_str())};
+    g_file_info_set_display_name(inf.get(), dispName.get());
+    g_file_info_set_file_type(inf.get(), type);
+    g_file_info_set_size(inf.get(), size);
+    if(mode) {
+        g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_MODE, mode);
+    }
+    return inf;
+}
+
+bool TotalSizeJob::takeDirContent(const FilePath& path, std::vector<Entry>& entries) {
+    std::lock_guard<std::mutex> lock{treeMutex_};
+    auto it = tree_.find(path);
+    if(it == tree_.end()) {
+        return false;
+    }
+    entries = std::move(it->second);
+    treeSize_ -= entries.size();
+    tree_.erase(it);
+    return true;
 }
 
 
@@ -26,6 +76,10 @@ void TotalSizeJob::exec(FilePath path, GFileInfoPtr inf) {
     const char* fs_id;
     bool descend;
 
+    if(!waitIfPaused()) {
+        return;
+    }
+
 _retry_query_info:
     if(!inf) {
         GErrorPtr err;
@@ -36,7 +90,7 @@ _retry_query_info:
             false
         };
         if(!inf) {
-            ErrorAction act = emitError( err, ErrorSeverity::MILD);
+            ErrorAction act = emitErrorSerialized(err, ErrorSeverity::MILD);
             err = nullptr;
             if(act == ErrorAction::RETRY) {
                 goto _retry_query_info;
@@ -57,6 +111,7 @@ _retry_query_info:
         totalSize_ += g_file_info_get_size(inf.get());
     }
     totalOndiskSize_ += g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
+    reportProgress();
 
     /* prepare for moving across different devices */
     if(flags_ & PREPARE_MOVE) {
@@ -90,51 +145,247 @@ _retry_query_info:
 
         inf = nullptr;
         if(descend) {
+            if(walker_) {
+                walker_->push(path); // let any of the threads list it
+            }
+            else {
+                listDir(path);
+            }
+        }
+    }
+}
+
+void TotalSizeJob::listDir(const FilePath& path) {
+    // the fast path does the same as the gio one, and gets the ids of the filesystems from st_dev
+    if(path.isNative() && !(flags_ & SAME_FS)) {
+        listNativeDir(path);
+        return;
+    }
+
 _retry_enum_children:
-            GErrorPtr err;
-            auto enu = GFileEnumeratorPtr {
-                g_file_enumerate_children(path.gfile().get(), query_str,
-                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                cancellable().get(), &err),
-                false
-            };
-            if(enu) {
-                while(!isCancelled()) {
-                    inf = GFileInfoPtr{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
-                    if(inf) {
-                        FilePath child = path.child(g_file_info_get_name(inf.get()));
-                        exec(std::move(child), std::move(inf));
-                    }
-                    else {
-                        if(err) { /* error! */
-                            /* ErrorAction::RETRY is not supported */
-                            emitError( err, ErrorSeverity::MILD);
-                            err = nullptr;
-                        }
-                        else {
-                            /* EOF is reached, do nothing. */
-                            break;
-                        }
-                    }
-                }
-                g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    GErrorPtr err;
+    auto enu = GFileEnumeratorPtr {
+        g_file_enumerate_children(path.gfile().get(), query_str,
+        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+        cancellable().get(), &err),
+        false
+    };
+    if(enu) {
+        // list the whole dir before descending into its children, so the enumerator is closed
+        // early and the content can be taken by takeDirContent() as soon as possible
+        std::vector<GFileInfoPtr> children;
+        bool complete = false;
+        while(waitIfPaused()) {
+            GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
+            if(inf) {
+                children.emplace_back(std::move(inf));
             }
             else {
-                ErrorAction act = emitError( err, ErrorSeverity::MILD);
-                err = nullptr;
-                if(act == ErrorAction::RETRY) {
-                    goto _retry_enum_children;
+                if(err) { /* error! */
+                    /* ErrorAction::RETRY is not supported */
+                    emitErrorSerialized(err, ErrorSeverity::MILD);
+                    err = nullptr;
+                }
+                else {
+                    /* EOF is reached, do nothing. */
+                    complete = true;
+                    break;
                 }
             }
         }
+        g_file_enumerator_close(enu.get(), nullptr, nullptr);
+
+        if(complete && (flags_ & KEEP_TREE)) {
+            std::vector<Entry> entries;
+            entries.reserve(children.size());
+            for(auto& child: children) {
+                entries.emplace_back(Entry{g_file_info_get_name(child.get()),
+                                           g_file_info_get_file_type(child.get()),
+                                           g_file_info_get_attribute_uint32(child.get(), G_FILE_ATTRIBUTE_UNIX_MODE),
+                                           std::uint64_t(g_file_info_get_size(child.get()))});
+            }
+            keepDirContent(path, std::move(entries));
+        }
+
+        for(auto& child: children) {
+            if(isCancelled()) {
+                break;
+            }
+            FilePath childPath = path.child(g_file_info_get_name(child.get()));
+            exec(std::move(childPath), std::move(child));
+        }
+    }
+    else {
+        ErrorAction act = emitErrorSerialized(err, ErrorSeverity::MILD);
+        err = nullptr;
+        if(act == ErrorAction::RETRY) {
+            goto _retry_enum_children;
+        }
+    }
+}
+
+void TotalSizeJob::listNativeDir(const FilePath& path) {
+    auto localPath = path.localPath();
+    DIR* dir;
+    for(;;) {
+        int fd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dir = fd >= 0 ? fdopendir(fd) : nullptr;
+        if(dir) {
+            break;
+        }
+        int errsv = errno;
+        if(fd >= 0) {
+            close(fd);
+        }
+        CStrPtr dispName{g_filename_display_name(localPath.get())};
+        GErrorPtr err{G_IO_ERROR, g_io_error_from_errno(errsv),
+                      tr("Error opening directory '%1': %2").arg(QString::fromUtf8(dispName.get()), QString::fromUtf8(g_strerror(errsv)))};
+        if(emitErrorSerialized(err, ErrorSeverity::MILD) != ErrorAction::RETRY) {
+            return;
+        }
+    }
+
+    // stat the children relative to the dir and descend into the subdirs after closing it
+    std::vector<Entry> entries;
+    std::vector<std::string> subdirs;
+    int dfd = dirfd(dir);
+    // the children are usually on the same device, so the id is only compared when the device changes
+    bool hasLastDev = false;
+    dev_t lastDev = 0;
+    bool lastDevIsDest = false;
+    // the scan stops at each file while the job is paused
+    while(waitIfPaused()) {
+        struct dirent* ent = readdir(dir);
+        if(!ent) {
+            break;
+        }
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        struct stat st;
+        if(fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue; // removed while we're listing the dir
+        }
+        GFileType type = S_ISDIR(st.st_mode) ? G_FILE_TYPE_DIRECTORY
+                         : S_ISREG(st.st_mode) ? G_FILE_TYPE_REGULAR
+                         : S_ISLNK(st.st_mode) ? G_FILE_TYPE_SYMBOLIC_LINK
+                         : G_FILE_TYPE_SPECIAL;
+        ++fileCount_;
+        if(type != G_FILE_TYPE_DIRECTORY) {
+            totalSize_ += st.st_size;
+        }
+        totalOndiskSize_ += std::uint64_t(st.st_blocks) * 512;
+        bool descend = (type == G_FILE_TYPE_DIRECTORY);
+        if(flags_ & PREPARE_MOVE) {
+            if(dest_fs_id && (!hasLastDev || st.st_dev != lastDev)) {
+                hasLastDev = true;
+                lastDev = st.st_dev;
+                lastDevIsDest = (nativeFilesystemId(st.st_dev) == dest_fs_id);
+            }
+            if(dest_fs_id && lastDevIsDest) {
+                // same filesystem
+                descend = false;
+            }
+            else {
+                /* files on different device requires an additional 'delete' for the source file. */
+                ++totalSize_;
+                ++totalOndiskSize_;
+                ++fileCount_;
+            }
+        }
+        reportProgress();
+        if(descend) {
+            subdirs.emplace_back(name);
+        }
+        if(flags_ & KEEP_TREE) {
+            entries.emplace_back(Entry{name, type, std::uint32_t(st.st_mode), std::uint64_t(st.st_size)});
+        }
+    }
+    closedir(dir);
+
+    if(isCancelled()) {
+        return;
+    }
+    if(flags_ & KEEP_TREE) {
+        keepDirContent(path, std::move(entries));
+    }
+    for(auto& subdir: subdirs) {
+        if(isCancelled()) {
+            break;
+        }
+        auto subdirPath = path.child(subdir.c_str());
+        if(walker_) {
+            walker_->push(std::move(subdirPath));
+        }
+        else {
+            listNativeDir(subdirPath);
+        }
+    }
+}
+
+void TotalSizeJob::keepDirContent(const FilePath& path, std::vector<Entry> entries) {
+    std::lock_guard<std::mutex> lock{treeMutex_};
+    if(treeSize_ + entries.size() <= maxTreeSize) {
+        treeSize_ += entries.size();
+        tree_.emplace(path, std::move(entries));
+    }
+}
+
+void TotalSizeJob::reportProgress(bool force) {
+    // only one of the threads emits the signal for each interval
+    qint64 now = progressTimer_.elapsed();
+    qint64 last = lastProgressTime_.load(std::memory_order_relaxed);
+    if(force || (now - last >= progressInterval
+                 && lastProgressTime_.compare_exchange_strong(last, now, std::memory_order_relaxed))) {
+        Q_EMIT progressChanged(totalSize_, totalOndiskSize_, fileCount_);
     }
 }
 
+Job::ErrorAction TotalSizeJob::emitErrorSerialized(const GErrorPtr& err, ErrorSeverity severity) {
+    std::lock_guard<std::mutex> lock{errorMutex_};
+    return emitError(err, severity);
+}
+
+void TotalSizeJob::setThreadCount(int count) {
+    threadCount_ = std::max(count, 1);
+}
 
 void TotalSizeJob::exec() {
-    for(auto& path : paths_) {
-        exec(path, GFileInfoPtr{});
+    progressTimer_.start();
+    DirQueue walker{threadCount_};
+    if(threadCount_ > 1) {
+        walker_ = &walker;
+    }
+    if(!walker_) {
+        for(auto& path : paths_) {
+            exec(path, GFileInfoPtr{});
+        }
+    }
+    else {
+        // The paths are shared by the threads too, since many files might be selected, and then
+        // the dirs found in them are listed in parallel. A thread counts as busy for the walker
+        // until it calls pop() first, so none of them stops while the paths are being handled.
+        std::atomic<size_t> nextPath{0};
+        std::vector<std::thread> threads;
+        for(int i = 0; i < threadCount_; ++i) {
+            threads.emplace_back([this, &nextPath]() {
+                for(size_t index = nextPath++; index < paths_.size() && !isCancelled(); index = nextPath++) {
+                    exec(paths_[index], GFileInfoPtr{});
+                }
+                FilePath dir;
+                while(walker_->pop(dir, cancellable().get())) {
+                    // the subdirs of a native dir are pushed to the walker by listNativeDir()
+                    listDir(dir);
+                }
+            });
+        }
+        for(auto& thread: threads) {
+            thread.join();
+        }
+        walker_ = nullptr;
     }
+    reportProgress(true);
 }
 
 
@@ -5,10 +5,18 @@
 #include "fileoperationjob.h"
 #include "filepath.h"
 #include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <QElapsedTimer>
 #include "gioptrs.h"
 
 namespace Fm {
 
+class DirQueue;
+
 class LIBFM_QT_API TotalSizeJob : public Fm::FileOperationJob {
     Q_OBJECT
 public:
@@ -17,7 +25,19 @@ public:
         FOLLOW_LINKS = 1 << 0,
         SAME_FS = 1 << 1,
         PREPARE_MOVE = 1 << 2,
-        PREPARE_DELETE = 1 << 3
+        PREPARE_DELETE = 1 << 3,
+        KEEP_TREE = 1 << 4 // remember the content of the scanned dirs, see takeDirContent()
+    };
+
+    // the basic info of a file found by the scan
+    struct Entry {
+        std::string name;
+        GFileType type;
+        std::uint32_t mode;
+        std::uint64_t size;
+
+        // a GFileInfo with the name, display name, type, size, and mode of the file
+        GFileInfoPtr fileInfo() const;
     };
 
     explicit TotalSizeJob(FilePathList paths = FilePathList{}, Flags flags = DEFAULT);
@@ -34,6 +54,31 @@ public:
         return fileCount_;
     }
 
+    // Get the content of a dir found by the scan if KEEP_TREE is set, so the caller doesn't need to
+    // enumerate the dir again. Each dir can only be taken once. This can be called while the job
+    // is running, and false is returned if the dir is not fully scanned yet.
+    bool takeDirContent(const FilePath& path, std::vector<Entry>& entries);
+
+    // With PREPARE_MOVE, the files on the filesystem with this id (see G_FILE_ATTRIBUTE_ID_FILESYSTEM)
+    // are not counted recursively since they are moved by renaming. The string should be interned.
+    void setDestFilesystemId(const char* id) {
+        dest_fs_id = id;
+    }
+
+    // List the dirs with this number of threads. This helps on SSDs and network filesystems
+    // where listing one dir at a time cannot keep the device busy. The default is 1.
+    // The running totals can be polled with totalSize() and fileCount() while the job is running.
+    void setThreadCount(int count);
+
+    int threadCount() const {
+        return threadCount_;
+    }
+
+Q_SIGNALS:
+    // Emitted from the job threads at most every 200 ms with the running totals while the
+    // scan is in progress, and once more with the final totals before finished().
+    void progressChanged(quint64 totalSize, quint64 totalOnDiskSize, unsigned int fileCount);
+
 protected:
 
     void exec() override;
@@ -41,14 +86,38 @@ protected:
 private:
     void exec(FilePath path, GFileInfoPtr inf);
 
+    void listDir(const FilePath& path);
+
+    // the same as listDir() with readdir() and fstatat() for native dirs
+    void listNativeDir(const FilePath& path);
+
+    void reportProgress(bool force = false);
+
+    void keepDirContent(const FilePath& path, std::vector<Entry> entries);
+
+    // emitError() for the listing threads, which must not ask the user at the same time
+    ErrorAction emitErrorSerialized(const GErrorPtr& err, ErrorSeverity severity);
+
 private:
     FilePathList paths_;
 
     int flags_;
-    std::uint64_t totalSize_;
-    std::uint64_t totalOndiskSize_;
-    unsigned int fileCount_;
+    // can be read by other threads while the job is running
+    std::atomic<std::uint64_t> totalSize_;
+    std::atomic<std::uint64_t> totalOndiskSize_;
+    std::atomic<unsigned int> fileCount_;
     const char* dest_fs_id;
+
+    std::mutex treeMutex_; // protects tree_ and treeSize_
+    std::unordered_map<FilePath, std::vector<Entry>, FilePathHash> tree_;
+    size_t treeSize_; // number of entries in tree_
+
+    int threadCount_;
+    DirQueue* walker_; // only set while the dirs are listed by multiple threads
+    std::mutex errorMutex_;
+
+    QElapsedTimer progressTimer_;
+    std::atomic<qint64> lastProgressTime_; // elapsed time of the last progressChanged()
 };
 
 } // namespace Fm
@@ -0,0 +1,106 @@
+#include "transferscheduler.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Fm {
+
+std::mutex TransferScheduler::instanceMutex_;
+std::weak_ptr<TransferScheduler> TransferScheduler::globalInstance_;
+
+TransferScheduler::TransferScheduler(): QObject() {
+}
+
+// static
+std::shared_ptr<TransferScheduler> TransferScheduler::globalInstance() {
+    std::lock_guard<std::mutex> lock{instanceMutex_};
+    auto scheduler = globalInstance_.lock();
+    if(scheduler == nullptr) {
+        scheduler = std::make_shared<TransferScheduler>();
+        globalInstance_ = scheduler;
+    }
+    return scheduler;
+}
+
+bool TransferScheduler::canRun(const Job* job, const std::vector<std::string>& devices) const {
+    for(const auto& device: devices) {
+        if(usedDevices_.count(device)) {
+            return false;
+        }
+    }
+    // don't overtake the jobs queued earlier for the same devices
+    for(const auto& queued: queue_) {
+        if(queued.job == job) {
+            break;
+        }
+        for(const auto& device: devices) {
+            if(std::find(queued.devices.cbegin(), queued.devices.cend(), device) != queued.devices.cend()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool TransferScheduler::acquire(Job* job, const std::vector<std::string>& devices) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    bool queued = false;
+    if(!canRun(job, devices)) {
+        queue_.push_back(QueuedJob{job, devices});
+        queued = true;
+        lock.unlock();
+        Q_EMIT queueChanged();
+        lock.lock();
+        while(!job->isCancelled() && !canRun(job, devices)) {
+            // the job can be cancelled while waiting, so check it from time to time
+            devicesReleased_.wait_for(lock, std::chrono::milliseconds(200));
+        }
+        queue_.erase(std::find_if(queue_.begin(), queue_.end(), [job](const QueuedJob& item) {
+            return item.job == job;
+        }));
+        devicesReleased_.notify_all(); // the jobs behind this one might be able to run now
+    }
+    bool runnable = !job->isCancelled();
+    if(runnable) {
+        for(const auto& device: devices) {
+            usedDevices_[device] = job;
+        }
+    }
+    lock.unlock();
+    if(queued) {
+        Q_EMIT queueChanged();
+    }
+    return runnable;
+}
+
+void TransferScheduler::release(Job* job) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for(auto it = usedDevices_.begin(); it != usedDevices_.end();) {
+            if(it->second == job) {
+                it = usedDevices_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    devicesReleased_.notify_all();
+}
+
+std::vector<Job*> TransferScheduler::queuedJobs() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    std::vector<Job*> jobs;
+    for(const auto& queued: queue_) {
+        jobs.push_back(queued.job);
+    }
+    return jobs;
+}
+
+bool TransferScheduler::isQueued(const Job* job) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return std::any_of(queue_.cbegin(), queue_.cend(), [job](const QueuedJob& queued) {
+        return queued.job == job;
+    });
+}
+
+} // namespace Fm
@@ -0,0 +1,65 @@
+#ifndef FM2_TRANSFERSCHEDULER_H
+#define FM2_TRANSFERSCHEDULER_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "job.h"
+
+namespace Fm {
+
+// Runs the file transfers which use the same devices one at a time, since running them at
+// the same time makes the disk seek back and forth and every transfer gets slower.
+// Transfers on different devices still run in parallel. The devices are identified by
+// the ids of their filesystems (see G_FILE_ATTRIBUTE_ID_FILESYSTEM).
+class LIBFM_QT_API TransferScheduler: public QObject {
+    Q_OBJECT
+public:
+    explicit TransferScheduler();
+
+    static std::shared_ptr<TransferScheduler> globalInstance();
+
+    // Called from the thread of the job. Blocks until none of the devices is used by another job,
+    // and then marks them used by this job. The jobs waiting for the same device run in the order
+    // they called this. Returns false if the job is cancelled while waiting.
+    bool acquire(Job* job, const std::vector<std::string>& devices);
+
+    // let the waiting jobs use the devices of this job
+    void release(Job* job);
+
+    // the jobs waiting for other jobs to finish, in the order they will run
+    std::vector<Job*> queuedJobs() const;
+
+    bool isQueued(const Job* job) const;
+
+Q_SIGNALS:
+    // a job is added to or removed from the queue. This is emitted from the thread of the job.
+    void queueChanged();
+
+private:
+    bool canRun(const Job* job, const std::vector<std::string>& devices) const;
+
+private:
+    struct QueuedJob {
+        Job* job;
+        std::vector<std::string> devices;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable devicesReleased_;
+    std::deque<QueuedJob> queue_;
+    std::unordered_map<std::string, Job*> usedDevices_;
+
+    static std::mutex instanceMutex_;
+    static std::weak_ptr<TransferScheduler> globalInstance_;
+};
+
+} // namespace Fm
+
+#endif // FM2_TRANSFERSCHEDULER_H
@@ -1,9 +1,135 @@
 #include "trashjob.h"
 
 #include "core/legacy/fm-config.h"
+#include "cstrptr.h"
+#include <string>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 namespace Fm {
 
+namespace {
+
+// The home trash can of the freedesktop.org trash spec. Files on the same filesystem are moved
+// into it directly instead of calling g_file_trash() for each of them, which writes every
+// .trashinfo file to a temporary file and renames it. Here the info files are written in place
+// and the trash dirs are only synced once after the whole batch.
+class HomeTrash {
+public:
+    HomeTrash(): infoDirFd_{-1}, filesDirFd_{-1}, dev_{0}, dirty_{false} {
+        CStrPtr trashDir{g_build_filename(g_get_user_data_dir(), "Trash", nullptr)};
+        CStrPtr infoDir{g_build_filename(trashDir.get(), "info", nullptr)};
+        CStrPtr filesDir{g_build_filename(trashDir.get(), "files", nullptr)};
+        infoDirFd_ = open(infoDir.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        filesDirFd_ = open(filesDir.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat st;
+        if(infoDirFd_ >= 0 && filesDirFd_ >= 0 && fstat(filesDirFd_, &st) == 0) {
+            dev_ = st.st_dev;
+            trashDir_ = trashDir.get();
+        }
+        else { // the trash can is not created yet, let gio do it
+            close();
+        }
+
+        char date[32];
+        time_t now = time(nullptr);
+        struct tm tm;
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime_r(&now, &tm));
+        deletionDate_ = date;
+    }
+
+    ~HomeTrash() {
+        sync();
+        close();
+    }
+
+    // the trash dir itself or a file under it, but not a sibling such as ~/.local/share/Trash2
+    bool isInTrashDir(const char* localPath) const {
+        return g_str_has_prefix(localPath, trashDir_.c_str())
+               && (localPath[trashDir_.length()] == '\0' || localPath[trashDir_.length()] == '/');
+    }
+
+    // Returns false if the file cannot be trashed here, and g_file_trash() should be used.
+    bool trash(const FilePath& path) {
+        if(infoDirFd_ < 0 || !path.isNative()) {
+            return false;
+        }
+        auto localPath = path.localPath();
+        struct stat st;
+        if(lstat(localPath.get(), &st) != 0 || st.st_dev != dev_ || isInTrashDir(localPath.get())) { // don't trash the trash can
+            return false;
+        }
+
+        // find a name which is not used in the trash can
+        auto baseName = path.baseName();
+        std::string name = baseName.get();
+        std::string infoName;
+        int infoFd = -1;
+        for(int i = 2; i < 1000; ++i) {
+            infoName = name + ".trashinfo";
+            if(fstatat(filesDirFd_, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 && errno == ENOENT) {
+                infoFd = openat(infoDirFd_, infoName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+                if(infoFd >= 0 || errno != EEXIST) {
+                    break;
+                }
+            }
+            name = std::string{baseName.get()} + '.' + std::to_string(i);
+        }
+        if(infoFd < 0) {
+            return false;
+        }
+
+        CStrPtr escapedPath{g_uri_escape_string(localPath.get(), "/", FALSE)};
+        std::string info = "[Trash Info]\nPath=";
+        info += escapedPath.get();
+        info += "\nDeletionDate=";
+        info += deletionDate_;
+        info += '\n';
+        bool written = write(infoFd, info.c_str(), info.size()) == ssize_t(info.size());
+        ::close(infoFd);
+        if(!written || renameat(AT_FDCWD, localPath.get(), filesDirFd_, name.c_str()) != 0) {
+            unlinkat(infoDirFd_, infoName.c_str(), 0);
+            return false;
+        }
+        dirty_ = true;
+        return true;
+    }
+
+    // make the moved files and their info persistent
+    void sync() {
+        if(dirty_) {
+            fsync(infoDirFd_);
+            fsync(filesDirFd_);
+            dirty_ = false;
+        }
+    }
+
+private:
+    void close() {
+        if(infoDirFd_ >= 0) {
+            ::close(infoDirFd_);
+            infoDirFd_ = -1;
+        }
+        if(filesDirFd_ >= 0) {
+            ::close(filesDirFd_);
+            filesDirFd_ = -1;
+        }
+    }
+
+private:
+    int infoDirFd_;
+    int filesDirFd_;
+    dev_t dev_;
+    bool dirty_;
+    std::string trashDir_;
+    std::string deletionDate_;
+};
+
+} // anonymous namespace
+
 TrashJob::TrashJob(FilePathList paths): paths_{std::move(paths)} {
     // calculate progress using finished file counts rather than their sizes
     setCalcProgressUsingSize(false);
@@ -13,6 +139,8 @@ void TrashJob::exec() {
     setTotalAmount(paths_.size(), paths_.size());
     Q_EMIT preparedToRun();
 
+    HomeTrash homeTrash;
+
     /* FIXME: we shouldn't trash a file already in trash:/// */
     for(auto& path : paths_) {
         if(isCancelled()) {
@@ -40,6 +168,9 @@ void TrashJob::exec() {
             }
 
             // move the file to trash
+            if(homeTrash.trash(path)) {
+                break;
+            }
             GErrorPtr err;
             ret = g_file_trash(gf.get(), cancellable().get(), &err);
             if(ret) {  // trash operation succeeded
@@ -49,6 +180,7 @@ void TrashJob::exec() {
                 // if trashing is not supported by the file system
                 if(err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_SUPPORTED) {
                     unsupportedFiles_.push_back(path);
+                    break;
                 }
                 else {
                     ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
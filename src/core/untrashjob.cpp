@@ -1,8 +1,14 @@
 #include "untrashjob.h"
 #include "filetransferjob.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 namespace Fm {
 
+// list the dir of the trashed files instead of querying them one by one if there are this many of them
+static const size_t minEnumeratedFiles = 16;
+
 UntrashJob::UntrashJob(FilePathList srcPaths):
     srcPaths_{std::move(srcPaths)} {
 }
@@ -11,10 +17,72 @@ void UntrashJob::exec() {
     // preparing for the job
     FilePathList validSrcPaths;
     FilePathList origPaths;
-    for(auto& srcPath: srcPaths_) {
+    auto addOrigPath = [&](const FilePath& srcPath, const GFileInfoPtr& srcInfo) {
+        const char* orig_path_str = g_file_info_get_attribute_byte_string(srcInfo.get(), "trash::orig-path");
+        if(orig_path_str) {
+            validSrcPaths.emplace_back(srcPath);
+            origPaths.emplace_back(FilePath::fromPathStr(orig_path_str));
+        }
+        else {
+            GErrorPtr err;
+            g_set_error(&err, G_IO_ERROR, G_IO_ERROR_FAILED,
+                        tr("Cannot untrash file '%s': original path not known").toUtf8().constData(),
+                        g_file_info_get_display_name(srcInfo.get()));
+            // FIXME: do we need to retry here?
+            emitError(err, ErrorSeverity::MODERATE);
+        }
+    };
+
+    // The trashed files are usually in the same dir (trash:/// itself), so when many of them are
+    // restored, listing the dir once is much faster than querying the files one by one.
+    std::vector<bool> found(srcPaths_.size(), false);
+    std::unordered_map<FilePath, std::unordered_map<std::string, size_t>, FilePathHash> dirs;
+    if(srcPaths_.size() >= minEnumeratedFiles) {
+        for(size_t i = 0; i < srcPaths_.size(); ++i) {
+            auto baseName = srcPaths_[i].baseName();
+            if(baseName) {
+                dirs[srcPaths_[i].parent()].emplace(baseName.get(), i);
+            }
+        }
+    }
+    for(auto& dir: dirs) {
+        auto& children = dir.second;
+        if(isCancelled() || children.size() < minEnumeratedFiles) {
+            continue;
+        }
+        GFileEnumeratorPtr enu{
+            g_file_enumerate_children(dir.first.gfile().get(),
+                                      "standard::name,standard::display-name,trash::orig-path",
+                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                      cancellable().get(), nullptr),
+            false
+        };
+        if(!enu) {
+            continue; // the files are queried separately and the errors reported then
+        }
+        while(!isCancelled() && !children.empty()) {
+            GFileInfoPtr srcInfo{g_file_enumerator_next_file(enu.get(), cancellable().get(), nullptr), false};
+            if(!srcInfo) {
+                break;
+            }
+            auto it = children.find(g_file_info_get_name(srcInfo.get()));
+            if(it != children.end()) {
+                addOrigPath(srcPaths_[it->second], srcInfo);
+                found[it->second] = true;
+                children.erase(it);
+            }
+        }
+        g_file_enumerator_close(enu.get(), nullptr, nullptr);
+    }
+
+    for(size_t i = 0; i < srcPaths_.size(); ++i) {
         if(isCancelled()) {
             break;
         }
+        if(found[i]) { // already found while listing its dir
+            continue;
+        }
+        auto& srcPath = srcPaths_[i];
         GErrorPtr err;
         GFileInfoPtr srcInfo{
             g_file_query_info(srcPath.gfile().get(),
@@ -25,19 +93,7 @@ void UntrashJob::exec() {
             false
         };
         if(srcInfo) {
-            const char* orig_path_str = g_file_info_get_attribute_byte_string(srcInfo.get(), "trash::orig-path");
-            if(orig_path_str) {
-                validSrcPaths.emplace_back(srcPath);
-                origPaths.emplace_back(FilePath::fromPathStr(orig_path_str));
-            }
-            else {
-                ErrorAction act;
-                g_set_error(&err, G_IO_ERROR, G_IO_ERROR_FAILED,
-                            tr("Cannot untrash file '%s': original path not known").toUtf8().constData(),
-                            g_file_info_get_display_name(srcInfo.get()));
-                // FIXME: do we need to retry here?
-                emitError(err, ErrorSeverity::MODERATE);
-            }
+            addOrigPath(srcPath, srcInfo);
         }
         else {
             // FIXME: do we need to retry here?
@@ -1,39 +1,147 @@
 #include "userinfocache.h"
+#include "jobtrace_p.h"
 #include <pwd.h>
 #include <grp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <thread>
+#include <vector>
 
 namespace Fm {
 
 UserInfoCache* UserInfoCache::globalInstance_ = nullptr;
 std::mutex UserInfoCache::mutex_;
 
-UserInfoCache::UserInfoCache() : QObject() {
+// the buffer size used when the system doesn't suggest one
+static const long defaultBufferSize = 1024;
+
+UserInfoCache::UserInfoCache() : QObject(),
+    resolving_{false} {
+}
+
+// getpwuid() and getgrgid() are not thread-safe, so the reentrant versions are used
+// static
+std::shared_ptr<const UserInfo> UserInfoCache::lookupUser(uid_t uid) {
+    // it might ask a network service like LDAP
+    BlockingScope scope{"UserInfoCache::lookupUser"};
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    std::vector<char> buf(size > 0 ? size : defaultBufferSize);
+    struct passwd pwd;
+    struct passwd* pw = nullptr;
+    int err;
+    while((err = getpwuid_r(uid, &pwd, buf.data(), buf.size(), &pw)) == ERANGE) {
+        buf.resize(buf.size() * 2);
+    }
+    return (err == 0 && pw) ? std::make_shared<UserInfo>(uid, pw->pw_name, pw->pw_gecos) : nullptr;
+}
+
+// static
+std::shared_ptr<const GroupInfo> UserInfoCache::lookupGroup(gid_t gid) {
+    BlockingScope scope{"UserInfoCache::lookupGroup"};
+    long size = sysconf(_SC_GETGR_R_SIZE_MAX);
+    std::vector<char> buf(size > 0 ? size : defaultBufferSize);
+    struct group grp;
+    struct group* gr = nullptr;
+    int err;
+    while((err = getgrgid_r(gid, &grp, buf.data(), buf.size(), &gr)) == ERANGE) {
+        buf.resize(buf.size() * 2);
+    }
+    return (err == 0 && gr) ? std::make_shared<GroupInfo>(gid, gr->gr_name) : nullptr;
 }
 
 const std::shared_ptr<const UserInfo>& UserInfoCache::userFromId(uid_t uid) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = users_.find(uid);
+        if(it != users_.end())
+            return it->second;
+    }
+    // the lookup might be slow with network accounts, so the lock isn't held during it
+    auto user = lookupUser(uid);
+    std::lock_guard<std::mutex> lock{mutex_};
+    return users_.emplace(uid, std::move(user)).first->second;
+}
+
+const std::shared_ptr<const GroupInfo>& UserInfoCache::groupFromId(gid_t gid) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = groups_.find(gid);
+        if(it != groups_.end())
+            return it->second;
+    }
+    auto group = lookupGroup(gid);
+    std::lock_guard<std::mutex> lock{mutex_};
+    return groups_.emplace(gid, std::move(group)).first->second;
+}
+
+std::shared_ptr<const UserInfo> UserInfoCache::userFromIdAsync(uid_t uid, bool* pending) {
     std::lock_guard<std::mutex> lock{mutex_};
     auto it = users_.find(uid);
-    if(it != users_.end())
+    if(it != users_.end()) {
+        *pending = false;
         return it->second;
-    std::shared_ptr<const UserInfo> user;
-    auto pw = getpwuid(uid);
-    if(pw) {
-        user = std::make_shared<UserInfo>(uid, pw->pw_name, pw->pw_gecos);
     }
-    return (users_[uid] = user);
+    *pending = true;
+    pendingUsers_.insert(uid);
+    startResolving();
+    return nullptr;
 }
 
-const std::shared_ptr<const GroupInfo>& UserInfoCache::groupFromId(gid_t gid) {
+std::shared_ptr<const GroupInfo> UserInfoCache::groupFromIdAsync(gid_t gid, bool* pending) {
     std::lock_guard<std::mutex> lock{mutex_};
     auto it = groups_.find(gid);
-    if(it != groups_.end())
+    if(it != groups_.end()) {
+        *pending = false;
         return it->second;
-    std::shared_ptr<const GroupInfo> group;
-    auto gr = getgrgid(gid);
-    if(gr) {
-        group = std::make_shared<GroupInfo>(gid, gr->gr_name);
     }
-    return (groups_[gid] = group);
+    *pending = true;
+    pendingGroups_.insert(gid);
+    startResolving();
+    return nullptr;
+}
+
+// called with the mutex locked
+void UserInfoCache::startResolving() {
+    // a single worker resolves all the ids requested meanwhile
+    if(!resolving_) {
+        resolving_ = true;
+        std::thread{&UserInfoCache::resolvePending, this}.detach();
+    }
+}
+
+void UserInfoCache::resolvePending() {
+    for(;;) {
+        std::unordered_set<uid_t> uids;
+        std::unordered_set<gid_t> gids;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            uids.swap(pendingUsers_);
+            gids.swap(pendingGroups_);
+            if(uids.empty() && gids.empty()) {
+                resolving_ = false;
+                return;
+            }
+        }
+        std::vector<std::pair<uid_t, std::shared_ptr<const UserInfo>>> users;
+        for(auto uid: uids) {
+            users.emplace_back(uid, lookupUser(uid));
+        }
+        std::vector<std::pair<gid_t, std::shared_ptr<const GroupInfo>>> groups;
+        for(auto gid: gids) {
+            groups.emplace_back(gid, lookupGroup(gid));
+        }
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            for(auto& user: users) {
+                users_.emplace(user.first, std::move(user.second));
+            }
+            for(auto& group: groups) {
+                groups_.emplace(group.first, std::move(group.second));
+            }
+        }
+        // the receivers in other threads get it queued
+        Q_EMIT changed();
+    }
 }
 
 // static
@@ -5,6 +5,7 @@
 #include <QObject>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <sys/types.h>
 #include <memory>
 #include <mutex>
@@ -65,14 +66,33 @@ public:
 
     const std::shared_ptr<const GroupInfo>& groupFromId(gid_t gid);
 
+    // Like userFromId() and groupFromId(), but they don't block if the id isn't looked up yet.
+    // Then nullptr is returned and *pending is set to true. The pending ids are looked up
+    // together in a worker thread, and changed() is emitted when they're resolved.
+    std::shared_ptr<const UserInfo> userFromIdAsync(uid_t uid, bool* pending);
+
+    std::shared_ptr<const GroupInfo> groupFromIdAsync(gid_t gid, bool* pending);
+
     static UserInfoCache* globalInstance();
 
 Q_SIGNALS:
     void changed();
 
+private:
+    static std::shared_ptr<const UserInfo> lookupUser(uid_t uid);
+
+    static std::shared_ptr<const GroupInfo> lookupGroup(gid_t gid);
+
+    void startResolving();
+
+    void resolvePending();
+
 private:
     std::unordered_map<uid_t, std::shared_ptr<const UserInfo>> users_;
     std::unordered_map<gid_t, std::shared_ptr<const GroupInfo>> groups_;
+    std::unordered_set<uid_t> pendingUsers_;
+    std::unordered_set<gid_t> pendingGroups_;
+    bool resolving_; // a worker thread is resolving the pending ids
     static UserInfoCache* globalInstance_;
     static std::mutex mutex_;
 };
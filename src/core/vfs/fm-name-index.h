@@ -0,0 +1,23 @@
+/* C interface of Fm::FileNameIndex for the search:// VFS */
+
+#ifndef __FM_NAME_INDEX_H__
+#define __FM_NAME_INDEX_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef gboolean (*FmNameIndexFilter)(const char *name, gpointer user_data);
+
+/* Find the files in the local dir (and its subdirs if recursive) whose names
+ * pass the filter, using the file name index which covers the dir. The index
+ * of the dir is created if there is none. The found files are prepended to
+ * *files (GFile). Returns FALSE if the index can't be used for the dir, then
+ * the dir should be walked instead. */
+gboolean fm_name_index_query(GFile *dir, gboolean recursive, gboolean show_hidden,
+                             FmNameIndexFilter filter, gpointer user_data,
+                             GSList **files, GCancellable *cancellable);
+
+G_END_DECLS
+
+#endif /* __FM_NAME_INDEX_H__ */
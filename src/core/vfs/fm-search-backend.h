@@ -0,0 +1,57 @@
+/* Backends which find the candidates of a search:// query without walking the folders */
+
+#ifndef __FM_SEARCH_BACKEND_H__
+#define __FM_SEARCH_BACKEND_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* the parsed query of a search:// URI, owned by the search */
+typedef struct _FmSearchQuery FmSearchQuery;
+
+typedef struct _FmSearchBackend FmSearchBackend;
+
+struct _FmSearchBackend
+{
+    const char *name; /* selected with backend=<name> in the URI */
+
+    /* Prepend the files (GFile) in the folder, or in its subfolders if the
+     * query is recursive, which might match the query to *files. They don't
+     * need to match all the rules, since the search checks these files again,
+     * but all the matched files should be returned. Returns FALSE if the
+     * backend can't answer this query, then the folder is walked instead.
+     * This is called in the worker threads of the search. */
+    gboolean (*find_files)(const FmSearchQuery *query, GFile *folder, GSList **files,
+                           GCancellable *cancellable, gpointer user_data);
+    gpointer user_data;
+};
+
+/* the backends should be registered before they're used, and stay valid */
+void fm_search_register_backend(const FmSearchBackend *backend);
+
+const FmSearchBackend *fm_search_find_backend(const char *name);
+
+/* the rules of the query the backends might use */
+gboolean fm_search_query_get_recursive(const FmSearchQuery *query);
+gboolean fm_search_query_get_show_hidden(const FmSearchQuery *query);
+
+/* NULL if the names are not matched with globs */
+const char * const *fm_search_query_get_name_patterns(const FmSearchQuery *query);
+/* NULL if the names are not matched with a regex */
+GRegex *fm_search_query_get_name_regex(const FmSearchQuery *query);
+gboolean fm_search_query_get_name_ci(const FmSearchQuery *query);
+
+/* whether the query matches names at all, otherwise every file is a candidate */
+gboolean fm_search_query_has_name_rules(const FmSearchQuery *query);
+
+/* check the name of a file (not a path) with the name rules of the query */
+gboolean fm_search_query_match_name(const FmSearchQuery *query, const char *name);
+
+/* the built-in backends */
+extern const FmSearchBackend fm_search_name_index_backend; /* "index" */
+extern const FmSearchBackend fm_search_locate_backend; /* "locate" */
+
+G_END_DECLS
+
+#endif /* __FM_SEARCH_BACKEND_H__ */
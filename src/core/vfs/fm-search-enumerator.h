@@ -0,0 +1,32 @@
+/* Direct access to the results of the search:// VFS */
+
+#ifndef __FM_SEARCH_ENUMERATOR_H__
+#define __FM_SEARCH_ENUMERATOR_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* whether the enumerator lists the results of a search:// URI */
+gboolean fm_is_search_enumerator(GFileEnumerator *enumerator);
+
+/* Similar to g_file_enumerator_next_file(), but also returns the real folder
+ * of the found file in *parent (a new reference), which is a normal GFile.
+ * The container of the enumerator is not touched, so it keeps its URI.
+ * If no file is found in timeout_usec microseconds (negative to wait until
+ * the search ends), NULL is returned with *timed_out set to TRUE.
+ * It returns at once when the cancellable is cancelled. */
+GFileInfo *fm_search_enumerator_next_result(GFileEnumerator *enumerator,
+                                            GFile **parent,
+                                            gint64 timeout_usec,
+                                            gboolean *timed_out,
+                                            GCancellable *cancellable,
+                                            GError **error);
+
+/* the numbers of the files checked and found so far, can be called from any thread */
+void fm_search_enumerator_get_progress(GFileEnumerator *enumerator,
+                                       guint *n_scanned, guint *n_matched);
+
+G_END_DECLS
+
+#endif /* __FM_SEARCH_ENUMERATOR_H__ */
@@ -68,6 +68,7 @@ struct _FmXmlFile
 {
     GObject parent;
     GList *items;
+    GList *last_item; /* the last node of items */
     GString *data;
     char *comment_pre;
     FmXmlFileItem *current_item;
@@ -93,13 +94,71 @@ struct _FmXmlFileItem
     FmXmlFile *file;
     FmXmlFileItem *parent;
     GList **parent_list; /* points to file->items or to parent->children */
+    GList **parent_last; /* points to file->last_item or to parent->last_child */
+    GList *link; /* the node of this item in *parent_list */
     GList *children;
+    GList *last_child; /* the last node of children */
     gchar *comment; /* a little trick: it is equal to text if it is CDATA */
 };
 
 
 G_DEFINE_TYPE(FmXmlFile, fm_xml_file, G_TYPE_OBJECT);
 
+/* Each list of items keeps its last node and each item keeps its own node in
+   the list, so adding or removing an item doesn't walk the list. Otherwise
+   parsing an element with many children would take quadratic time. */
+static void _item_link_append(FmXmlFileItem *item, GList **list, GList **last)
+{
+    GList *link = g_list_alloc();
+
+    link->data = item;
+    link->prev = *last;
+    if (*last)
+        (*last)->next = link;
+    else
+        *list = link;
+    *last = link;
+    item->link = link;
+    item->parent_list = list;
+    item->parent_last = last;
+}
+
+static void _item_link_insert_before(FmXmlFileItem *item, FmXmlFileItem *sibling)
+{
+    GList *link = g_list_alloc();
+
+    link->data = item;
+    link->next = sibling->link;
+    link->prev = sibling->link->prev;
+    if (link->prev)
+        link->prev->next = link;
+    else
+        *sibling->parent_list = link;
+    sibling->link->prev = link;
+    item->link = link;
+    item->parent_list = sibling->parent_list;
+    item->parent_last = sibling->parent_last;
+}
+
+static void _item_unlink(FmXmlFileItem *item)
+{
+    GList *link = item->link;
+
+    g_assert(link != NULL && link->data == item);
+    if (link->prev)
+        link->prev->next = link->next;
+    else
+        *item->parent_list = link->next;
+    if (link->next)
+        link->next->prev = link->prev;
+    else
+        *item->parent_last = link->prev;
+    g_list_free_1(link);
+    item->link = NULL;
+    item->parent_list = NULL;
+    item->parent_last = NULL;
+}
+
 static void fm_xml_file_finalize(GObject *object)
 {
     FmXmlFile *self;
@@ -569,8 +628,7 @@ _restart:
             else
             {
                 item->file = file;
-                item->parent_list = &file->items;
-                file->items = g_list_append(file->items, item);
+                _item_link_append(item, &file->items, &file->last_item);
             }
             _update_file_ptr(file, 1);
             g_string_truncate(file->data, 0);
@@ -738,8 +796,7 @@ _attr_error:
             else
             {
                 item->file = file;
-                item->parent_list = &file->items;
-                file->items = g_list_append(file->items, item);
+                _item_link_append(item, &file->items, &file->last_item);
             }
             file->pos++; /* '>' or '/' */
             if (selfdo) /* simple self-closing tag */
@@ -981,13 +1038,12 @@ gboolean fm_xml_file_item_append_child(FmXmlFileItem *item, FmXmlFileItem *child
     if (child->parent_list) /* remove from old list */
     {
         /* g_debug("moving item %p(%d) from parser %p into %p as child of %p", child, (int)child->tag, child->file, item->file, item); */
-        g_assert(child->file != NULL && g_list_find(*child->parent_list, child) != NULL);
-        *child->parent_list = g_list_remove(*child->parent_list, child);
+        g_assert(child->file != NULL);
+        _item_unlink(child);
     }
     /* else
         g_debug("adding item %p(%d) into parser %p as child of %p", child, (int)child->tag, item->file, item); */
-    item->children = g_list_append(item->children, child);
-    child->parent_list = &item->children;
+    _item_link_append(child, &item->children, &item->last_child);
     child->parent = item;
     if (child->file != item->file)
         _reassign_xml_file(child, item->file);
@@ -1109,8 +1165,8 @@ gboolean fm_xml_file_item_destroy(FmXmlFileItem *item)
     if (item->parent_list)
     {
         /* g_debug("removing item %p from parser %p", item, item->file); */
-        g_assert(item->file != NULL && g_list_find(*item->parent_list, item) != NULL);
-        *item->parent_list = g_list_remove(*item->parent_list, item);
+        g_assert(item->file != NULL);
+        _item_unlink(item);
     }
     if (item->text != item->comment)
         g_free(item->comment);
@@ -1137,11 +1193,8 @@ gboolean fm_xml_file_item_destroy(FmXmlFileItem *item)
  */
 gboolean fm_xml_file_insert_before(FmXmlFileItem *item, FmXmlFileItem *new_item)
 {
-    GList *sibling;
-
     g_return_val_if_fail(item != NULL && new_item != NULL, FALSE);
-    sibling = g_list_find(*item->parent_list, item);
-    if (sibling == NULL) /* no such item found */
+    if (item->link == NULL || new_item == item) /* no such item found */
     {
         /* g_critical("item %p not found in %p", item, item->parent); */
         return FALSE;
@@ -1151,13 +1204,12 @@ gboolean fm_xml_file_insert_before(FmXmlFileItem *item, FmXmlFileItem *new_item)
     if (new_item->parent_list) /* remove from old list */
     {
         /* g_debug("moving item %p (parent=%p) from parser %p into %p", new_item, item, new_item->file, item->file); */
-        g_assert(new_item->file != NULL && g_list_find(*new_item->parent_list, new_item) != NULL);
-        *new_item->parent_list = g_list_remove(*new_item->parent_list, new_item);
+        g_assert(new_item->file != NULL);
+        _item_unlink(new_item);
     }
     /* else
         g_debug("inserting item %p (parent=%p) into parser %p", item, new_item, item->file); */
-    *item->parent_list = g_list_insert_before(*item->parent_list, sibling, new_item);
-    new_item->parent_list = item->parent_list;
+    _item_link_insert_before(new_item, item);
     new_item->parent = item->parent;
     if (new_item->file != item->file)
         _reassign_xml_file(new_item, item->file);
@@ -1184,11 +1236,13 @@ gboolean fm_xml_file_insert_first(FmXmlFile *file, FmXmlFileItem *new_item)
     if (new_item->parent_list)
     {
         /* g_debug("moving item %p from parser %p into %p", new_item, new_item->file, file); */
-        g_assert(new_item->file != NULL && g_list_find(*new_item->parent_list, new_item) != NULL);
-        *new_item->parent_list = g_list_remove(*new_item->parent_list, new_item);
+        g_assert(new_item->file != NULL);
+        _item_unlink(new_item);
     }
-    file->items = g_list_prepend(file->items, new_item);
-    new_item->parent_list = &file->items;
+    if (file->items)
+        _item_link_insert_before(new_item, file->items->data);
+    else
+        _item_link_append(new_item, &file->items, &file->last_item);
     new_item->parent = NULL;
     if (new_item->file != file)
         _reassign_xml_file(new_item, file);
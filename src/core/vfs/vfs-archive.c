@@ -0,0 +1,1198 @@
+/*
+ * vfs-archive.c
+ * VFS for "archive://" paths, which browses the contents of the archive files with libarchive
+ * without extracting them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * The URIs are "archive://<escaped URI of the archive file>/<path inside the archive>", e.g.
+ * "archive://file%3A%2F%2F%2Fhome%2Fuser%2Fsrc.tar.gz/src/main.c", so any archive readable by
+ * GIO can be browsed. The parent of the root of an archive is the folder of the archive file.
+ *
+ * When an archive is opened first, its headers are streamed to build an index of its entries,
+ * skipping their data. The seekable formats such as zip and 7z are read from their central
+ * directories, and the data of the others is skipped by seeking if the file is seekable. The
+ * index is kept in memory for the recently used archives until they're changed, so browsing
+ * their folders doesn't read them again. A member is read by streaming the archive up to it,
+ * so copying the selected files out of an archive extracts only those. The reader is kept open
+ * for a while after that, and the members after it, e.g. the next files copied out of the same
+ * folder, are read by streaming it further instead of from the start of the archive again.
+ * The archives are read-only, and they're not monitored.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fm-file.h"
+
+#include <glib/gi18n-lib.h>
+#include <archive.h>
+#include <archive_entry.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#define ARCHIVE_READ_SIZE (64 * 1024)
+#define MAX_CACHED_INDEXES 8
+#define MAX_IDLE_READERS 4
+
+/* beforehand declarations */
+GFile *_fm_vfs_archive_new_for_uri(const char *uri);
+
+
+/* ---- the index of the entries of an archive ---- */
+typedef struct _FmArchiveEntry FmArchiveEntry;
+typedef struct _FmArchiveIndex FmArchiveIndex;
+
+struct _FmArchiveEntry
+{
+    char *path; /* without leading and trailing "/" */
+    GFileType type;
+    guint64 size;
+    gint64 mtime;
+    guint32 mode;
+    char *symlink_target;
+    char *hardlink; /* the path of the entry which has the data */
+    gint64 position; /* the number of the header in the archive, -1 for the implied dirs */
+};
+
+struct _FmArchiveIndex
+{
+    gint ref_count;
+    char *archive_uri;
+    guint64 archive_mtime;
+    guint64 archive_size;
+    GHashTable *entries; /* path => FmArchiveEntry */
+    GHashTable *children; /* path of a dir => GPtrArray of its FmArchiveEntry */
+};
+
+G_LOCK_DEFINE_STATIC(archiveIndexes);
+static GQueue cached_indexes = G_QUEUE_INIT; /* FmArchiveIndex, the most recently used ones first */
+
+static void _archive_entry_free(gpointer data)
+{
+    FmArchiveEntry *entry = data;
+    g_free(entry->path);
+    g_free(entry->symlink_target);
+    g_free(entry->hardlink);
+    g_slice_free(FmArchiveEntry, entry);
+}
+
+static void _archive_index_unref(FmArchiveIndex *index)
+{
+    if(g_atomic_int_dec_and_test(&index->ref_count))
+    {
+        g_hash_table_destroy(index->children);
+        g_hash_table_destroy(index->entries);
+        g_free(index->archive_uri);
+        g_slice_free(FmArchiveIndex, index);
+    }
+}
+
+/* remove "./" and the leading and trailing "/", and resolve "." and ".." */
+static char *_archive_normalize_path(const char *path)
+{
+    char **parts = g_strsplit(path, "/", -1);
+    GPtrArray *kept = g_ptr_array_new();
+    char **part;
+    char *result;
+
+    for(part = parts; *part; ++part)
+    {
+        if(**part == '\0' || strcmp(*part, ".") == 0)
+            continue;
+        if(strcmp(*part, "..") == 0)
+        {
+            if(kept->len > 0)
+                g_ptr_array_remove_index(kept, kept->len - 1);
+            continue;
+        }
+        g_ptr_array_add(kept, *part);
+    }
+    g_ptr_array_add(kept, NULL);
+    result = g_strjoinv("/", (char**)kept->pdata);
+    g_ptr_array_free(kept, TRUE);
+    g_strfreev(parts);
+    return result;
+}
+
+static char *_archive_parent_path(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? g_strndup(path, slash - path) : g_strdup("");
+}
+
+static void _archive_index_add_child(FmArchiveIndex *index, FmArchiveEntry *entry);
+
+/* add the parent dirs which are not in the archive themselves */
+static void _archive_index_add_parents(FmArchiveIndex *index, const char *path)
+{
+    char *parent = _archive_parent_path(path);
+    if(*parent && g_hash_table_lookup(index->entries, parent) == NULL)
+    {
+        FmArchiveEntry *dir = g_slice_new0(FmArchiveEntry);
+        dir->path = parent;
+        dir->type = G_FILE_TYPE_DIRECTORY;
+        dir->mode = S_IFDIR | 0755;
+        dir->position = -1;
+        g_hash_table_insert(index->entries, dir->path, dir);
+        _archive_index_add_child(index, dir);
+        _archive_index_add_parents(index, dir->path);
+    }
+    else
+        g_free(parent);
+}
+
+static void _archive_index_add_child(FmArchiveIndex *index, FmArchiveEntry *entry)
+{
+    char *parent = _archive_parent_path(entry->path);
+    GPtrArray *children = g_hash_table_lookup(index->children, parent);
+    if(children == NULL)
+    {
+        children = g_ptr_array_new();
+        g_hash_table_insert(index->children, parent, children);
+    }
+    else
+        g_free(parent);
+    g_ptr_array_add(children, entry);
+}
+
+
+/* ---- reading the archive from a GFile ---- */
+typedef struct _FmArchiveSource FmArchiveSource;
+
+struct _FmArchiveSource
+{
+    GFileInputStream *stream;
+    GCancellable *cancellable;
+    GError *error;
+    gboolean seekable;
+    char buffer[ARCHIVE_READ_SIZE];
+};
+
+static la_ssize_t _archive_read_cb(struct archive *a, void *data, const void **buffer)
+{
+    FmArchiveSource *src = data;
+    gssize n = g_input_stream_read(G_INPUT_STREAM(src->stream), src->buffer, ARCHIVE_READ_SIZE,
+                                   src->cancellable, src->error ? NULL : &src->error);
+    *buffer = src->buffer;
+    if(n < 0)
+    {
+        archive_set_error(a, EIO, "%s", src->error ? src->error->message : "read error");
+        return -1;
+    }
+    return n;
+}
+
+static la_int64_t _archive_skip_cb(struct archive *a, void *data, la_int64_t request)
+{
+    FmArchiveSource *src = data;
+    /* libarchive reads the data to skip it if it's not seekable */
+    if(!src->seekable || !g_seekable_seek(G_SEEKABLE(src->stream), request, G_SEEK_CUR,
+                                          src->cancellable, NULL))
+        return 0;
+    return request;
+}
+
+static la_int64_t _archive_seek_cb(struct archive *a, void *data, la_int64_t offset, int whence)
+{
+    FmArchiveSource *src = data;
+    GSeekType type = whence == SEEK_SET ? G_SEEK_SET : whence == SEEK_END ? G_SEEK_END : G_SEEK_CUR;
+    if(!g_seekable_seek(G_SEEKABLE(src->stream), offset, type, src->cancellable, NULL))
+        return ARCHIVE_FATAL;
+    return g_seekable_tell(G_SEEKABLE(src->stream));
+}
+
+static void _archive_source_free(FmArchiveSource *src)
+{
+    if(src->stream)
+    {
+        g_input_stream_close(G_INPUT_STREAM(src->stream), NULL, NULL);
+        g_object_unref(src->stream);
+    }
+    if(src->cancellable)
+        g_object_unref(src->cancellable);
+    if(src->error)
+        g_error_free(src->error);
+    g_free(src);
+}
+
+static void _archive_set_error(struct archive *a, FmArchiveSource *src, GError **error)
+{
+    if(src->error)
+        g_propagate_error(error, g_error_copy(src->error));
+    else
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, _("Cannot read the archive: %s"),
+                    archive_error_string(a) ? archive_error_string(a) : _("unknown error"));
+}
+
+/* the archive ready to read its headers, which is freed with archive_read_free() and the source */
+static struct archive *_archive_open(const char *archive_uri, FmArchiveSource **psrc,
+                                     GCancellable *cancellable, GError **error)
+{
+    GFile *archive_file = g_file_new_for_uri(archive_uri);
+    FmArchiveSource *src = g_new0(FmArchiveSource, 1);
+    struct archive *a;
+
+    src->stream = g_file_read(archive_file, cancellable, error);
+    g_object_unref(archive_file);
+    if(src->stream == NULL)
+    {
+        g_free(src);
+        return NULL;
+    }
+    src->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    src->seekable = g_seekable_can_seek(G_SEEKABLE(src->stream));
+
+    a = archive_read_new();
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+    archive_read_set_callback_data(a, src);
+    archive_read_set_read_callback(a, _archive_read_cb);
+    archive_read_set_skip_callback(a, _archive_skip_cb);
+    /* the seekable readers of zip and 7z use the central directory instead of streaming */
+    if(src->seekable)
+        archive_read_set_seek_callback(a, _archive_seek_cb);
+    if(archive_read_open1(a) != ARCHIVE_OK)
+    {
+        _archive_set_error(a, src, error);
+        archive_read_free(a);
+        _archive_source_free(src);
+        return NULL;
+    }
+    *psrc = src;
+    return a;
+}
+
+static FmArchiveIndex *_archive_index_build(const char *archive_uri, guint64 mtime, guint64 size,
+                                            GCancellable *cancellable, GError **error)
+{
+    FmArchiveSource *src;
+    struct archive *a = _archive_open(archive_uri, &src, cancellable, error);
+    struct archive_entry *ae;
+    FmArchiveIndex *index;
+    gint64 position = 0;
+    int res;
+
+    if(a == NULL)
+        return NULL;
+    index = g_slice_new0(FmArchiveIndex);
+    index->ref_count = 1;
+    index->archive_uri = g_strdup(archive_uri);
+    index->archive_mtime = mtime;
+    index->archive_size = size;
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _archive_entry_free);
+    index->children = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)g_ptr_array_unref);
+
+    /* only the headers are read, and the data is skipped */
+    while((res = archive_read_next_header(a, &ae)) == ARCHIVE_OK || res == ARCHIVE_WARN)
+    {
+        const char *name = archive_entry_pathname_utf8(ae);
+        FmArchiveEntry *entry, *old;
+        char *path;
+
+        if(g_cancellable_set_error_if_cancelled(cancellable, error))
+        {
+            res = ARCHIVE_FATAL;
+            break;
+        }
+        if(name == NULL)
+            name = archive_entry_pathname(ae);
+        path = name ? _archive_normalize_path(name) : NULL;
+        if(path == NULL || *path == '\0')
+        {
+            g_free(path);
+            ++position;
+            continue;
+        }
+        entry = g_slice_new0(FmArchiveEntry);
+        entry->path = path;
+        entry->size = archive_entry_size(ae);
+        entry->mtime = archive_entry_mtime(ae);
+        entry->mode = archive_entry_mode(ae);
+        entry->position = position++;
+        switch(archive_entry_filetype(ae))
+        {
+        case AE_IFDIR:
+            entry->type = G_FILE_TYPE_DIRECTORY;
+            break;
+        case AE_IFLNK:
+            entry->type = G_FILE_TYPE_SYMBOLIC_LINK;
+            entry->symlink_target = g_strdup(archive_entry_symlink(ae));
+            break;
+        case AE_IFREG:
+            entry->type = G_FILE_TYPE_REGULAR;
+            break;
+        default:
+            entry->type = G_FILE_TYPE_SPECIAL;
+        }
+        if(archive_entry_hardlink(ae))
+        {
+            entry->type = G_FILE_TYPE_REGULAR;
+            entry->hardlink = _archive_normalize_path(archive_entry_hardlink(ae));
+        }
+
+        old = g_hash_table_lookup(index->entries, path);
+        if(old)
+        {
+            /* a later entry replaces an earlier one, as it does when it's extracted,
+               but a dir implied by its children is completed by its own entry */
+            GFileType type = entry->type;
+            g_free(old->symlink_target);
+            g_free(old->hardlink);
+            old->type = type;
+            old->size = entry->size;
+            old->mtime = entry->mtime;
+            old->mode = entry->mode;
+            old->position = entry->position;
+            old->symlink_target = entry->symlink_target;
+            old->hardlink = entry->hardlink;
+            entry->symlink_target = entry->hardlink = NULL;
+            _archive_entry_free(entry);
+            continue;
+        }
+        g_hash_table_insert(index->entries, entry->path, entry);
+        _archive_index_add_child(index, entry);
+        _archive_index_add_parents(index, entry->path);
+    }
+    if(res == ARCHIVE_FATAL || res == ARCHIVE_FAILED)
+    {
+        if(error && *error == NULL)
+            _archive_set_error(a, src, error);
+        _archive_index_unref(index);
+        index = NULL;
+    }
+    archive_read_free(a);
+    _archive_source_free(src);
+    return index;
+}
+
+/* find the index of the archive in the cache, or build it if the archive is changed */
+static FmArchiveIndex *_archive_index_get(const char *archive_uri, GCancellable *cancellable,
+                                          GError **error)
+{
+    GFile *archive_file = g_file_new_for_uri(archive_uri);
+    GFileInfo *info = g_file_query_info(archive_file,
+                                        G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                        G_FILE_QUERY_INFO_NONE, cancellable, error);
+    FmArchiveIndex *index = NULL;
+    guint64 mtime, size;
+    GList *l;
+
+    g_object_unref(archive_file);
+    if(info == NULL)
+        return NULL;
+    mtime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    size = g_file_info_get_size(info);
+    g_object_unref(info);
+
+    G_LOCK(archiveIndexes);
+    for(l = cached_indexes.head; l; l = l->next)
+    {
+        FmArchiveIndex *cached = l->data;
+        if(strcmp(cached->archive_uri, archive_uri) == 0)
+        {
+            g_queue_unlink(&cached_indexes, l);
+            if(cached->archive_mtime == mtime && cached->archive_size == size)
+            {
+                index = cached;
+                g_atomic_int_inc(&index->ref_count);
+                g_queue_push_head_link(&cached_indexes, l);
+            }
+            else
+            {
+                _archive_index_unref(cached);
+                g_list_free_1(l);
+            }
+            break;
+        }
+    }
+    G_UNLOCK(archiveIndexes);
+    if(index)
+        return index;
+
+    /* another thread might be building it too, and the result of the last one is kept */
+    index = _archive_index_build(archive_uri, mtime, size, cancellable, error);
+    if(index == NULL)
+        return NULL;
+    G_LOCK(archiveIndexes);
+    for(l = cached_indexes.head; l; l = l->next)
+    {
+        FmArchiveIndex *cached = l->data;
+        if(strcmp(cached->archive_uri, archive_uri) == 0)
+        {
+            g_queue_delete_link(&cached_indexes, l);
+            _archive_index_unref(cached);
+            break;
+        }
+    }
+    g_atomic_int_inc(&index->ref_count);
+    g_queue_push_head(&cached_indexes, index);
+    while(cached_indexes.length > MAX_CACHED_INDEXES)
+        _archive_index_unref(g_queue_pop_tail(&cached_indexes));
+    G_UNLOCK(archiveIndexes);
+    return index;
+}
+
+
+/* ---- the readers which are kept open after reading a member ---- */
+typedef struct _FmArchiveReader FmArchiveReader;
+
+struct _FmArchiveReader
+{
+    char *archive_uri;
+    guint64 archive_mtime;
+    guint64 archive_size;
+    struct archive *archive;
+    FmArchiveSource *src;
+    gint64 position; /* the number of the last header which is read */
+};
+
+G_LOCK_DEFINE_STATIC(idleReaders);
+static GQueue idle_readers = G_QUEUE_INIT; /* FmArchiveReader, the most recently used ones first */
+
+static void _archive_reader_free(FmArchiveReader *reader)
+{
+    archive_read_free(reader->archive);
+    _archive_source_free(reader->src);
+    g_free(reader->archive_uri);
+    g_slice_free(FmArchiveReader, reader);
+}
+
+/* take an idle reader of the indexed archive which is not past the member yet */
+static FmArchiveReader *_archive_reader_take(FmArchiveIndex *index, gint64 target)
+{
+    FmArchiveReader *reader = NULL;
+    GList *l;
+
+    G_LOCK(idleReaders);
+    for(l = idle_readers.head; l; l = l->next)
+    {
+        FmArchiveReader *idle = l->data;
+        if(idle->position < target && strcmp(idle->archive_uri, index->archive_uri) == 0
+           && idle->archive_mtime == index->archive_mtime && idle->archive_size == index->archive_size)
+        {
+            reader = idle;
+            g_queue_delete_link(&idle_readers, l);
+            break;
+        }
+    }
+    G_UNLOCK(idleReaders);
+    return reader;
+}
+
+/* keep the reader for the next members, and close the least recently used one if there are too many */
+static void _archive_reader_put(FmArchiveReader *reader)
+{
+    FmArchiveReader *dropped = NULL;
+
+    if(reader->src->cancellable)
+    {
+        g_object_unref(reader->src->cancellable);
+        reader->src->cancellable = NULL;
+    }
+    G_LOCK(idleReaders);
+    g_queue_push_head(&idle_readers, reader);
+    if(idle_readers.length > MAX_IDLE_READERS)
+        dropped = g_queue_pop_tail(&idle_readers);
+    G_UNLOCK(idleReaders);
+    if(dropped)
+        _archive_reader_free(dropped);
+}
+
+
+/* ---- FmArchiveVFile class ---- */
+#define FM_TYPE_ARCHIVE_VFILE           (fm_vfs_archive_file_get_type())
+#define FM_ARCHIVE_VFILE(o)             (G_TYPE_CHECK_INSTANCE_CAST((o), \
+                                         FM_TYPE_ARCHIVE_VFILE, FmArchiveVFile))
+
+typedef struct _FmArchiveVFile          FmArchiveVFile;
+typedef struct _FmArchiveVFileClass     FmArchiveVFileClass;
+
+static GType fm_vfs_archive_file_get_type (void);
+
+struct _FmArchiveVFile
+{
+    GObject parent_object;
+
+    char *archive_uri; /* the URI of the archive file */
+    char *path; /* the path inside the archive without leading and trailing "/", "" for its root */
+};
+
+struct _FmArchiveVFileClass
+{
+    GObjectClass parent_class;
+};
+
+static void fm_archive_g_file_init(GFileIface *iface);
+static void fm_archive_fm_file_init(FmFileInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(FmArchiveVFile, fm_vfs_archive_file, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_FILE, fm_archive_g_file_init)
+                        G_IMPLEMENT_INTERFACE(FM_TYPE_FILE, fm_archive_fm_file_init))
+
+static void fm_vfs_archive_file_finalize(GObject *object)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(object);
+
+    g_free(item->archive_uri);
+    g_free(item->path);
+
+    G_OBJECT_CLASS(fm_vfs_archive_file_parent_class)->finalize(object);
+}
+
+static void fm_vfs_archive_file_class_init(FmArchiveVFileClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+    gobject_class->finalize = fm_vfs_archive_file_finalize;
+}
+
+static void fm_vfs_archive_file_init(FmArchiveVFile *item)
+{
+    /* nothing */
+}
+
+/* takes the strings */
+static GFile *_fm_archive_vfile_new(char *archive_uri, char *path)
+{
+    FmArchiveVFile *item = (FmArchiveVFile*)g_object_new(FM_TYPE_ARCHIVE_VFILE, NULL);
+    item->archive_uri = archive_uri;
+    item->path = path;
+    return (GFile*)item;
+}
+
+
+/* ---- FmArchiveInputStream class ---- */
+#define FM_TYPE_ARCHIVE_INPUT_STREAM    (fm_archive_input_stream_get_type())
+#define FM_ARCHIVE_INPUT_STREAM(o)      (G_TYPE_CHECK_INSTANCE_CAST((o), \
+                                         FM_TYPE_ARCHIVE_INPUT_STREAM, FmArchiveInputStream))
+
+typedef struct _FmArchiveInputStream      FmArchiveInputStream;
+typedef struct _FmArchiveInputStreamClass FmArchiveInputStreamClass;
+
+struct _FmArchiveInputStream
+{
+    GFileInputStream parent;
+    FmArchiveReader *reader; /* positioned at the data of the member */
+    gboolean failed; /* the reader is not reused after an error */
+};
+
+struct _FmArchiveInputStreamClass
+{
+    GFileInputStreamClass parent_class;
+};
+
+static GType fm_archive_input_stream_get_type(void);
+
+G_DEFINE_TYPE(FmArchiveInputStream, fm_archive_input_stream, G_TYPE_FILE_INPUT_STREAM)
+
+static gssize _fm_archive_input_stream_read(GInputStream *stream, void *buffer, gsize count,
+                                            GCancellable *cancellable, GError **error)
+{
+    FmArchiveInputStream *ins = FM_ARCHIVE_INPUT_STREAM(stream);
+    la_ssize_t n;
+
+    if(g_cancellable_set_error_if_cancelled(cancellable, error))
+        return -1;
+    n = archive_read_data(ins->reader->archive, buffer, count);
+    if(n < 0)
+    {
+        _archive_set_error(ins->reader->archive, ins->reader->src, error);
+        ins->failed = TRUE;
+        return -1;
+    }
+    return n;
+}
+
+static gboolean _fm_archive_input_stream_close(GInputStream *stream, GCancellable *cancellable,
+                                               GError **error)
+{
+    FmArchiveInputStream *ins = FM_ARCHIVE_INPUT_STREAM(stream);
+
+    if(ins->reader)
+    {
+        if(ins->failed || ins->reader->src->error)
+            _archive_reader_free(ins->reader);
+        else
+            _archive_reader_put(ins->reader);
+        ins->reader = NULL;
+    }
+    return TRUE;
+}
+
+static void _fm_archive_input_stream_finalize(GObject *object)
+{
+    _fm_archive_input_stream_close(G_INPUT_STREAM(object), NULL, NULL);
+    G_OBJECT_CLASS(fm_archive_input_stream_parent_class)->finalize(object);
+}
+
+static void fm_archive_input_stream_class_init(FmArchiveInputStreamClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS(klass);
+
+    gobject_class->finalize = _fm_archive_input_stream_finalize;
+    stream_class->read_fn = _fm_archive_input_stream_read;
+    stream_class->close_fn = _fm_archive_input_stream_close;
+}
+
+static void fm_archive_input_stream_init(FmArchiveInputStream *stream)
+{
+    /* nothing */
+}
+
+
+/* ---- FmVfsArchiveEnumerator class ---- */
+#define FM_TYPE_VFS_ARCHIVE_ENUMERATOR  (fm_vfs_archive_enumerator_get_type())
+#define FM_VFS_ARCHIVE_ENUMERATOR(o)    (G_TYPE_CHECK_INSTANCE_CAST((o), \
+                                         FM_TYPE_VFS_ARCHIVE_ENUMERATOR, FmVfsArchiveEnumerator))
+
+typedef struct _FmVfsArchiveEnumerator      FmVfsArchiveEnumerator;
+typedef struct _FmVfsArchiveEnumeratorClass FmVfsArchiveEnumeratorClass;
+
+struct _FmVfsArchiveEnumerator
+{
+    GFileEnumerator parent;
+    GQueue infos; /* GFileInfo, which are made when the enumerator is created */
+};
+
+struct _FmVfsArchiveEnumeratorClass
+{
+    GFileEnumeratorClass parent_class;
+};
+
+static GType fm_vfs_archive_enumerator_get_type(void);
+
+G_DEFINE_TYPE(FmVfsArchiveEnumerator, fm_vfs_archive_enumerator, G_TYPE_FILE_ENUMERATOR)
+
+static GFileInfo *_fm_vfs_archive_enumerator_next_file(GFileEnumerator *enumerator,
+                                                       GCancellable *cancellable,
+                                                       GError **error)
+{
+    FmVfsArchiveEnumerator *enu = FM_VFS_ARCHIVE_ENUMERATOR(enumerator);
+
+    if(g_cancellable_set_error_if_cancelled(cancellable, error))
+        return NULL;
+    return g_queue_pop_head(&enu->infos);
+}
+
+static gboolean _fm_vfs_archive_enumerator_close(GFileEnumerator *enumerator,
+                                                 GCancellable *cancellable,
+                                                 GError **error)
+{
+    FmVfsArchiveEnumerator *enu = FM_VFS_ARCHIVE_ENUMERATOR(enumerator);
+
+    g_queue_foreach(&enu->infos, (GFunc)g_object_unref, NULL);
+    g_queue_clear(&enu->infos);
+    return TRUE;
+}
+
+static void _fm_vfs_archive_enumerator_finalize(GObject *object)
+{
+    _fm_vfs_archive_enumerator_close(G_FILE_ENUMERATOR(object), NULL, NULL);
+    G_OBJECT_CLASS(fm_vfs_archive_enumerator_parent_class)->finalize(object);
+}
+
+static void fm_vfs_archive_enumerator_class_init(FmVfsArchiveEnumeratorClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GFileEnumeratorClass *enumerator_class = G_FILE_ENUMERATOR_CLASS(klass);
+
+    gobject_class->finalize = _fm_vfs_archive_enumerator_finalize;
+    enumerator_class->next_file = _fm_vfs_archive_enumerator_next_file;
+    enumerator_class->close_fn = _fm_vfs_archive_enumerator_close;
+}
+
+static void fm_vfs_archive_enumerator_init(FmVfsArchiveEnumerator *enumerator)
+{
+    g_queue_init(&enumerator->infos);
+}
+
+
+/* ---- GFileInfo of the entries ---- */
+static void _archive_info_set_content_type(GFileInfo *info, const char *name, GFileType type)
+{
+    char *content_type;
+    GIcon *icon;
+
+    if(type == G_FILE_TYPE_DIRECTORY)
+        content_type = g_strdup("inode/directory");
+    else
+        content_type = g_content_type_guess(name, NULL, 0, NULL);
+    g_file_info_set_content_type(info, content_type);
+    g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE, content_type);
+    icon = g_content_type_get_icon(content_type);
+    g_file_info_set_icon(info, icon);
+    g_object_unref(icon);
+    g_free(content_type);
+}
+
+static void _archive_info_set_read_only(GFileInfo *info)
+{
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, TRUE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, FALSE);
+}
+
+static GFileInfo *_archive_entry_info(FmArchiveIndex *index, FmArchiveEntry *entry)
+{
+    GFileInfo *info = g_file_info_new();
+    const char *name = strrchr(entry->path, '/');
+    char *display_name;
+    FmArchiveEntry *target = entry;
+
+    name = name ? name + 1 : entry->path;
+    g_file_info_set_name(info, name);
+    display_name = g_filename_display_name(name);
+    g_file_info_set_display_name(info, display_name);
+    g_free(display_name);
+    if(name[0] == '.')
+        g_file_info_set_is_hidden(info, TRUE);
+    g_file_info_set_file_type(info, entry->type);
+    if(entry->hardlink)
+    {
+        /* the data and the size are the ones of the target */
+        FmArchiveEntry *linked = g_hash_table_lookup(index->entries, entry->hardlink);
+        if(linked)
+            target = linked;
+    }
+    g_file_info_set_size(info, target->size);
+    g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED, entry->mtime);
+    g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE, entry->mode);
+    if(entry->symlink_target)
+    {
+        g_file_info_set_symlink_target(info, entry->symlink_target);
+        g_file_info_set_is_symlink(info, TRUE);
+    }
+    _archive_info_set_content_type(info, name, entry->type);
+    _archive_info_set_read_only(info);
+    return info;
+}
+
+
+/* ---- GFile implementation ---- */
+#define ERROR_UNSUPPORTED(err) g_set_error_literal(err, G_IO_ERROR, \
+                        G_IO_ERROR_NOT_SUPPORTED, _("Operation not supported"))
+
+static GFile *_fm_vfs_archive_dup(GFile *file)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+
+    return _fm_archive_vfile_new(g_strdup(item->archive_uri), g_strdup(item->path));
+}
+
+static guint _fm_vfs_archive_hash(GFile *file)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+
+    return g_str_hash(item->archive_uri) * 31 + g_str_hash(item->path);
+}
+
+static gboolean _fm_vfs_archive_equal(GFile *file1, GFile *file2)
+{
+    FmArchiveVFile *item1 = FM_ARCHIVE_VFILE(file1);
+    FmArchiveVFile *item2 = FM_ARCHIVE_VFILE(file2);
+
+    return g_str_equal(item1->archive_uri, item2->archive_uri) && g_str_equal(item1->path, item2->path);
+}
+
+static gboolean _fm_vfs_archive_is_native(GFile *file)
+{
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_has_uri_scheme(GFile *file, const char *uri_scheme)
+{
+    return g_ascii_strcasecmp(uri_scheme, "archive") == 0;
+}
+
+static char *_fm_vfs_archive_get_uri_scheme(GFile *file)
+{
+    return g_strdup("archive");
+}
+
+static char *_fm_vfs_archive_get_basename(GFile *file)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    const char *name;
+    GFile *archive_file;
+    char *basename;
+
+    if(*item->path)
+    {
+        name = strrchr(item->path, '/');
+        return g_strdup(name ? name + 1 : item->path);
+    }
+    /* the root is named after the archive */
+    archive_file = g_file_new_for_uri(item->archive_uri);
+    basename = g_file_get_basename(archive_file);
+    g_object_unref(archive_file);
+    return basename;
+}
+
+static char *_fm_vfs_archive_get_path(GFile *file)
+{
+    return NULL;
+}
+
+static char *_fm_vfs_archive_get_uri(GFile *file)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    char *archive = g_uri_escape_string(item->archive_uri, NULL, FALSE);
+    char *path = g_uri_escape_string(item->path, "/", FALSE);
+    char *uri = g_strconcat("archive://", archive, "/", path, NULL);
+
+    g_free(archive);
+    g_free(path);
+    return uri;
+}
+
+static char *_fm_vfs_archive_get_parse_name(GFile *file)
+{
+    return _fm_vfs_archive_get_uri(file);
+}
+
+static GFile *_fm_vfs_archive_get_parent(GFile *file)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    GFile *archive_file, *parent;
+
+    if(*item->path)
+        return _fm_archive_vfile_new(g_strdup(item->archive_uri), _archive_parent_path(item->path));
+    /* leave the archive from its root */
+    archive_file = g_file_new_for_uri(item->archive_uri);
+    parent = g_file_get_parent(archive_file);
+    g_object_unref(archive_file);
+    return parent;
+}
+
+static gboolean _fm_vfs_archive_prefix_matches(GFile *prefix, GFile *file)
+{
+    FmArchiveVFile *prefix_item = FM_ARCHIVE_VFILE(prefix);
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    size_t len = strlen(prefix_item->path);
+
+    if(!g_str_equal(prefix_item->archive_uri, item->archive_uri))
+        return FALSE;
+    if(len == 0)
+        return *item->path != '\0';
+    return strncmp(prefix_item->path, item->path, len) == 0 && item->path[len] == '/';
+}
+
+static char *_fm_vfs_archive_get_relative_path(GFile *parent, GFile *descendant)
+{
+    FmArchiveVFile *parent_item = FM_ARCHIVE_VFILE(parent);
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(descendant);
+    size_t len = strlen(parent_item->path);
+
+    if(!_fm_vfs_archive_prefix_matches(parent, descendant))
+        return NULL;
+    return g_strdup(item->path + (len ? len + 1 : 0));
+}
+
+static GFile *_fm_vfs_archive_resolve_relative_path(GFile *file, const char *relative_path)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    char *joined, *path;
+
+    if(relative_path == NULL || *relative_path == '\0')
+        return g_object_ref(file);
+    if(*relative_path == '/')
+        joined = g_strdup(relative_path);
+    else
+        joined = g_strconcat(item->path, "/", relative_path, NULL);
+    path = _archive_normalize_path(joined);
+    g_free(joined);
+    return _fm_archive_vfile_new(g_strdup(item->archive_uri), path);
+}
+
+static GFile *_fm_vfs_archive_get_child_for_display_name(GFile *file,
+                                                         const char *display_name,
+                                                         GError **error)
+{
+    if(strchr(display_name, '/'))
+    {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME, _("Invalid file name"));
+        return NULL;
+    }
+    return _fm_vfs_archive_resolve_relative_path(file, display_name);
+}
+
+static FmArchiveEntry *_archive_lookup_dir(FmArchiveIndex *index, const char *path, GError **error)
+{
+    FmArchiveEntry *entry;
+
+    if(*path == '\0') /* the root */
+        return NULL;
+    entry = g_hash_table_lookup(index->entries, path);
+    if(entry == NULL)
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("No such file or directory"));
+    else if(entry->type != G_FILE_TYPE_DIRECTORY)
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY, _("The file is not a directory"));
+    return entry;
+}
+
+static GFileEnumerator *_fm_vfs_archive_enumerate_children(GFile *file,
+                                                           const char *attributes,
+                                                           GFileQueryInfoFlags flags,
+                                                           GCancellable *cancellable,
+                                                           GError **error)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    FmArchiveIndex *index = _archive_index_get(item->archive_uri, cancellable, error);
+    FmVfsArchiveEnumerator *enu;
+    GError *err = NULL;
+    GPtrArray *children;
+    guint i;
+
+    if(index == NULL)
+        return NULL;
+    _archive_lookup_dir(index, item->path, &err);
+    if(err)
+    {
+        g_propagate_error(error, err);
+        _archive_index_unref(index);
+        return NULL;
+    }
+    enu = g_object_new(FM_TYPE_VFS_ARCHIVE_ENUMERATOR, "container", file, NULL);
+    children = g_hash_table_lookup(index->children, item->path);
+    for(i = 0; children && i < children->len; ++i)
+        g_queue_push_tail(&enu->infos, _archive_entry_info(index, g_ptr_array_index(children, i)));
+    _archive_index_unref(index);
+    return G_FILE_ENUMERATOR(enu);
+}
+
+static GFileInfo *_fm_vfs_archive_query_info(GFile *file,
+                                             const char *attributes,
+                                             GFileQueryInfoFlags flags,
+                                             GCancellable *cancellable,
+                                             GError **error)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    FmArchiveIndex *index;
+    FmArchiveEntry *entry;
+    GFileInfo *info;
+
+    if(*item->path == '\0')
+    {
+        /* the root only needs the archive file, whose index is built when it's listed */
+        GFile *archive_file = g_file_new_for_uri(item->archive_uri);
+        GFileInfo *archive_info = g_file_query_info(archive_file,
+                                                    G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                                    G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
+                                                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                                    G_FILE_QUERY_INFO_NONE, cancellable, error);
+        g_object_unref(archive_file);
+        if(archive_info == NULL)
+            return NULL;
+        info = g_file_info_new();
+        g_file_info_set_name(info, g_file_info_get_name(archive_info));
+        g_file_info_set_display_name(info, g_file_info_get_display_name(archive_info));
+        g_file_info_set_file_type(info, G_FILE_TYPE_DIRECTORY);
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                         g_file_info_get_attribute_uint64(archive_info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE, S_IFDIR | 0755);
+        _archive_info_set_content_type(info, NULL, G_FILE_TYPE_DIRECTORY);
+        _archive_info_set_read_only(info);
+        g_object_unref(archive_info);
+        return info;
+    }
+
+    index = _archive_index_get(item->archive_uri, cancellable, error);
+    if(index == NULL)
+        return NULL;
+    entry = g_hash_table_lookup(index->entries, item->path);
+    if(entry)
+        info = _archive_entry_info(index, entry);
+    else
+    {
+        info = NULL;
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("No such file or directory"));
+    }
+    _archive_index_unref(index);
+    return info;
+}
+
+static GFileInfo *_fm_vfs_archive_query_filesystem_info(GFile *file,
+                                                        const char *attributes,
+                                                        GCancellable *cancellable,
+                                                        GError **error)
+{
+    GFileInfo *info = g_file_info_new();
+
+    g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE, "archive");
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY, TRUE);
+    return info;
+}
+
+static GFileInputStream *_fm_vfs_archive_read_fn(GFile *file,
+                                                 GCancellable *cancellable,
+                                                 GError **error)
+{
+    FmArchiveVFile *item = FM_ARCHIVE_VFILE(file);
+    FmArchiveIndex *index = _archive_index_get(item->archive_uri, cancellable, error);
+    FmArchiveEntry *entry;
+    FmArchiveReader *reader;
+    FmArchiveInputStream *ins;
+    struct archive_entry *ae;
+    gint64 position, target;
+    int res;
+
+    if(index == NULL)
+        return NULL;
+    entry = g_hash_table_lookup(index->entries, item->path);
+    if(entry && entry->hardlink)
+    {
+        FmArchiveEntry *linked = g_hash_table_lookup(index->entries, entry->hardlink);
+        if(linked)
+            entry = linked;
+    }
+    if(entry == NULL || entry->type == G_FILE_TYPE_DIRECTORY || entry->position < 0)
+    {
+        if(entry == NULL)
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("No such file or directory"));
+        else
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY, _("Can't open directory"));
+        _archive_index_unref(index);
+        return NULL;
+    }
+    target = entry->position;
+
+    /* continue with a reader which has read an earlier member, or open the archive again */
+    reader = _archive_reader_take(index, target);
+    if(reader)
+    {
+        reader->src->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+        position = reader->position + 1;
+    }
+    else
+    {
+        FmArchiveSource *src;
+        struct archive *a = _archive_open(item->archive_uri, &src, cancellable, error);
+        if(a == NULL)
+        {
+            _archive_index_unref(index);
+            return NULL;
+        }
+        reader = g_slice_new0(FmArchiveReader);
+        reader->archive_uri = g_strdup(index->archive_uri);
+        reader->archive_mtime = index->archive_mtime;
+        reader->archive_size = index->archive_size;
+        reader->archive = a;
+        reader->src = src;
+        position = 0;
+    }
+    _archive_index_unref(index);
+
+    /* stream the archive up to the member, skipping the data of the others */
+    for(; (res = archive_read_next_header(reader->archive, &ae)) == ARCHIVE_OK || res == ARCHIVE_WARN; ++position)
+    {
+        if(position == target)
+            break;
+        if(g_cancellable_set_error_if_cancelled(cancellable, error))
+        {
+            res = ARCHIVE_FATAL;
+            break;
+        }
+    }
+    if(position != target || (res != ARCHIVE_OK && res != ARCHIVE_WARN))
+    {
+        if(error && *error == NULL)
+        {
+            if(res == ARCHIVE_EOF)
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("No such file or directory"));
+            else
+                _archive_set_error(reader->archive, reader->src, error);
+        }
+        _archive_reader_free(reader);
+        return NULL;
+    }
+    reader->position = target;
+    ins = g_object_new(FM_TYPE_ARCHIVE_INPUT_STREAM, NULL);
+    ins->reader = reader;
+    return G_FILE_INPUT_STREAM(ins);
+}
+
+static void fm_archive_g_file_init(GFileIface *iface)
+{
+    iface->dup = _fm_vfs_archive_dup;
+    iface->hash = _fm_vfs_archive_hash;
+    iface->equal = _fm_vfs_archive_equal;
+    iface->is_native = _fm_vfs_archive_is_native;
+    iface->has_uri_scheme = _fm_vfs_archive_has_uri_scheme;
+    iface->get_uri_scheme = _fm_vfs_archive_get_uri_scheme;
+    iface->get_basename = _fm_vfs_archive_get_basename;
+    iface->get_path = _fm_vfs_archive_get_path;
+    iface->get_uri = _fm_vfs_archive_get_uri;
+    iface->get_parse_name = _fm_vfs_archive_get_parse_name;
+    iface->get_parent = _fm_vfs_archive_get_parent;
+    iface->prefix_matches = _fm_vfs_archive_prefix_matches;
+    iface->get_relative_path = _fm_vfs_archive_get_relative_path;
+    iface->resolve_relative_path = _fm_vfs_archive_resolve_relative_path;
+    iface->get_child_for_display_name = _fm_vfs_archive_get_child_for_display_name;
+    iface->enumerate_children = _fm_vfs_archive_enumerate_children;
+    iface->query_info = _fm_vfs_archive_query_info;
+    iface->query_filesystem_info = _fm_vfs_archive_query_filesystem_info;
+    iface->read_fn = _fm_vfs_archive_read_fn;
+    /* the writing operations are left unimplemented, so GIO reports them as not supported */
+    iface->supports_thread_contexts = TRUE;
+}
+
+
+/* ---- FmFile implementation ---- */
+static gboolean _fm_vfs_archive_wants_incremental(GFile* file)
+{
+    return FALSE;
+}
+
+static void fm_archive_fm_file_init(FmFileInterface *iface)
+{
+    iface->wants_incremental = _fm_vfs_archive_wants_incremental;
+}
+
+
+/* ---- interface for loading ---- */
+GFile *_fm_vfs_archive_new_for_uri(const char *uri)
+{
+    const char *archive_start, *path_start;
+    char *archive_escaped, *archive_uri, *path_escaped, *path;
+
+    g_return_val_if_fail(uri != NULL, NULL);
+    /* "archive://" or "archive:" followed by the escaped URI of the archive */
+    archive_start = uri + strlen("archive:");
+    while(*archive_start == '/')
+        ++archive_start;
+    path_start = strchr(archive_start, '/');
+    if(path_start == NULL)
+        path_start = archive_start + strlen(archive_start);
+    archive_escaped = g_strndup(archive_start, path_start - archive_start);
+    archive_uri = g_uri_unescape_string(archive_escaped, NULL);
+    g_free(archive_escaped);
+    path_escaped = g_uri_unescape_string(path_start, NULL);
+    path = _archive_normalize_path(path_escaped ? path_escaped : "");
+    g_free(path_escaped);
+    if(archive_uri == NULL)
+        archive_uri = g_strdup("");
+    return _fm_archive_vfile_new(archive_uri, path);
+}
@@ -1020,6 +1020,95 @@ static void fm_vfs_menu_enumerator_init(FmVfsMenuEnumerator *enumerator)
     /* nothing */
 }
 
+#if MENU_CACHE_CHECK_VERSION(0, 4, 0)
+/* ---- index of menu cache items ----
+ * Looking an item up by its path walks the children of each folder in the path,
+ * so all items are put into a hash table by their paths on the first lookup,
+ * and the table is built again after the menu cache is reloaded. */
+G_LOCK_DEFINE_STATIC(menuIndex); /* locks the data below */
+static GHashTable *menuIndex = NULL; /* unescaped path below root -> MenuCacheItem */
+static MenuCache *menuIndexCache = NULL; /* the cache the index is built for */
+static gpointer menuIndexNotifier = NULL;
+static gint menuIndexValid = FALSE; /* accessed atomically */
+
+static void _menu_index_reload_notify(MenuCache *cache, gpointer user_data)
+{
+    /* the menu cache may be locked now so the index is only marked here */
+    g_atomic_int_set(&menuIndexValid, FALSE);
+}
+
+static void _menu_index_add_children(GHashTable *index, MenuCacheDir *dir,
+                                     const char *dir_path)
+{
+    GSList *children, *l;
+
+    children = menu_cache_dir_list_children(dir);
+    for(l = children; l; l = l->next)
+    {
+        MenuCacheItem *item = l->data;
+        const char *id = menu_cache_item_get_id(item);
+        char *path;
+
+        if(id == NULL)
+            continue;
+        path = dir_path ? g_strconcat(dir_path, "/", id, NULL) : g_strdup(id);
+        /* menu-cache finds the first one of the same id too */
+        if(g_hash_table_contains(index, path))
+        {
+            g_free(path);
+            continue;
+        }
+        g_hash_table_insert(index, path, menu_cache_item_ref(item));
+        if(menu_cache_item_get_type(item) == MENU_CACHE_TYPE_DIR)
+            _menu_index_add_children(index, MENU_CACHE_DIR(item), path);
+    }
+    g_slist_free_full(children, (GDestroyNotify)menu_cache_item_unref);
+}
+
+/* returns referenced item or NULL if it was not found in the index */
+static MenuCacheItem *_menu_index_lookup(MenuCache *mc, const char *unescaped)
+{
+    MenuCacheItem *item;
+
+    G_LOCK(menuIndex);
+    if(mc != menuIndexCache || !g_atomic_int_get(&menuIndexValid))
+    {
+        MenuCacheDir *root;
+
+        if(menuIndex)
+            g_hash_table_destroy(menuIndex);
+        if(mc != menuIndexCache)
+        {
+            if(menuIndexCache)
+            {
+                menu_cache_remove_reload_notify(menuIndexCache, menuIndexNotifier);
+                menu_cache_unref(menuIndexCache);
+            }
+            menuIndexCache = menu_cache_ref(mc);
+            menuIndexNotifier = menu_cache_add_reload_notify(mc,
+                                        &_menu_index_reload_notify, NULL);
+        }
+        /* set before building so a reload meanwhile invalidates it again */
+        g_atomic_int_set(&menuIndexValid, TRUE);
+        menuIndex = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)menu_cache_item_unref);
+        /* if the menu is not loaded yet then the index stays empty until the
+           reload notify, and the items are looked up by walking the tree */
+        root = menu_cache_dup_root_dir(mc);
+        if(root)
+        {
+            _menu_index_add_children(menuIndex, root, NULL);
+            menu_cache_item_unref(MENU_CACHE_ITEM(root));
+        }
+    }
+    item = g_hash_table_lookup(menuIndex, unescaped);
+    if(item)
+        menu_cache_item_ref(item);
+    G_UNLOCK(menuIndex);
+    return item;
+}
+#endif
+
 static MenuCacheItem *_vfile_path_to_menu_cache_item(MenuCache* mc, const char *path)
 {
     MenuCacheItem *dir;
@@ -1027,6 +1116,13 @@ static MenuCacheItem *_vfile_path_to_menu_cache_item(MenuCache* mc, const char *
 
     unescaped = g_uri_unescape_string(path, NULL);
 #if MENU_CACHE_CHECK_VERSION(0, 4, 0)
+    dir = _menu_index_lookup(mc, unescaped);
+    if(dir)
+    {
+        g_free(unescaped);
+        return dir;
+    }
+    /* not indexed: an invalid path or the menu is being reloaded */
     dir = MENU_CACHE_ITEM(menu_cache_dup_root_dir(mc));
 #else
     dir = MENU_CACHE_ITEM(menu_cache_get_root_dir(mc));
@@ -0,0 +1,110 @@
+/* A search backend which asks the system-wide locate database (plocate,
+ * mlocate or GNU locate) for the files by name, instead of walking the folders. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fm-search-backend.h"
+
+#include <string.h>
+
+/* whether the path relative to the searched folder passes the folder rules of the query */
+static gboolean _locate_check_relative_path(const FmSearchQuery *query, const char *rel_path)
+{
+    const char *name = strrchr(rel_path, '/');
+
+    if(name && !fm_search_query_get_recursive(query))
+        return FALSE;
+    /* the files in the hidden folders are not searched */
+    if(!fm_search_query_get_show_hidden(query) &&
+       (rel_path[0] == '.' || strstr(rel_path, "/.")))
+        return FALSE;
+    return fm_search_query_match_name(query, name ? name + 1 : rel_path);
+}
+
+static gboolean _locate_find_files(const FmSearchQuery *query, GFile *folder, GSList **files,
+                                   GCancellable *cancellable, gpointer user_data)
+{
+    const char * const *patterns = fm_search_query_get_name_patterns(query);
+    GPtrArray *argv;
+    GSubprocess *proc;
+    GBytes *output = NULL;
+    GError *err = NULL;
+    char *program, *folder_path, *prefix;
+    const char *p, *end;
+    gsize prefix_len, len;
+    gboolean ret = FALSE;
+
+    /* the regex syntaxes of GLib and locate are different, so only the globs are used */
+    if(patterns == NULL || !g_file_is_native(folder))
+        return FALSE;
+    program = g_find_program_in_path("plocate");
+    if(program == NULL)
+        program = g_find_program_in_path("locate");
+    if(program == NULL)
+        return FALSE;
+
+    /* match the basenames, a pattern without wildcards matches a part of the name */
+    argv = g_ptr_array_new();
+    g_ptr_array_add(argv, program);
+    g_ptr_array_add(argv, "-0");
+    g_ptr_array_add(argv, "-b");
+    if(fm_search_query_get_name_ci(query))
+        g_ptr_array_add(argv, "-i");
+    g_ptr_array_add(argv, "--");
+    for(; *patterns; ++patterns)
+        g_ptr_array_add(argv, (gpointer)*patterns);
+    g_ptr_array_add(argv, NULL);
+    proc = g_subprocess_newv((const char * const *)argv->pdata,
+                             G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+                             &err);
+    g_ptr_array_free(argv, TRUE);
+    g_free(program);
+    if(proc == NULL)
+    {
+        g_error_free(err);
+        return FALSE;
+    }
+    if(!g_subprocess_communicate(proc, NULL, cancellable, &output, NULL, &err))
+    {
+        g_subprocess_force_exit(proc);
+        g_error_free(err);
+        g_object_unref(proc);
+        return FALSE;
+    }
+    /* locate exits with 1 if nothing is found, other errors mean there's no usable database */
+    if(!g_subprocess_get_if_exited(proc) || g_subprocess_get_exit_status(proc) > 1)
+        goto out;
+
+    folder_path = g_file_get_path(folder);
+    prefix = g_str_has_suffix(folder_path, "/") ? g_strdup(folder_path) : g_strconcat(folder_path, "/", NULL);
+    prefix_len = strlen(prefix);
+    g_free(folder_path);
+    p = g_bytes_get_data(output, &len);
+    end = p ? p + len : NULL;
+    for(; p && p < end && !g_cancellable_is_cancelled(cancellable); p += strlen(p) + 1)
+    {
+        /* the paths are separated by NUL, and the last one is terminated by NUL too */
+        if(memchr(p, '\0', end - p) == NULL)
+            break;
+        if(strncmp(p, prefix, prefix_len) == 0 && p[prefix_len] != '\0' &&
+           _locate_check_relative_path(query, p + prefix_len))
+            *files = g_slist_prepend(*files, g_file_new_for_path(p));
+    }
+    g_free(prefix);
+    ret = !g_cancellable_is_cancelled(cancellable);
+
+out:
+    if(output)
+        g_bytes_unref(output);
+    g_object_unref(proc);
+    return ret;
+}
+
+const FmSearchBackend fm_search_locate_backend =
+{
+    "locate",
+    _locate_find_files,
+    NULL
+};
@@ -27,6 +27,9 @@
 #endif
 
 #include "fm-file.h"
+#include "fm-name-index.h"
+#include "fm-search-backend.h"
+#include "fm-search-enumerator.h"
 
 #include <glib/gi18n-lib.h>
 
@@ -34,6 +37,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #define _GNU_SOURCE /* for FNM_CASEFOLD in fnmatch.h, a GNU extension */
 #include <fnmatch.h>
@@ -42,14 +50,49 @@
 #pragma GCC diagnostic ignored "-Wcomment" /* for comments below */
 #endif
 
+/* the number of threads walking the folders, and the number of threads matching the contents */
+#define MAX_SEARCH_THREADS 4
+
+/* size of the chunks native files are read in */
+#define NATIVE_READ_SIZE (256 * 1024)
+
+/* a file is binary if there's a NUL byte in its first block */
+#define BINARY_SNIFF_SIZE 4096
+
 /* ---- Classes structures ---- */
-typedef struct _FmSearchIntIter FmSearchIntIter;
+typedef struct _FmSearchResult FmSearchResult;
+typedef struct _FmSearchNameMatcher FmSearchNameMatcher;
+typedef struct _FmSearchFolderId FmSearchFolderId;
 
-struct _FmSearchIntIter
+/* identifies a folder however it's reached, through symlinks or bind mounts */
+struct _FmSearchFolderId
 {
-    FmSearchIntIter *parent; /* recursion path */
-    GFile *folder_path; /* path to folder */
-    GFileEnumerator *enu; /* children enumerator */
+    guint64 dev;
+    guint64 ino;
+};
+
+/* simple globs are matched by comparing strings, others by fnmatch() */
+typedef enum
+{
+    NAME_MATCH_LITERAL, /* "name" */
+    NAME_MATCH_PREFIX, /* "name*" */
+    NAME_MATCH_SUFFIX, /* "*name" */
+    NAME_MATCH_SUBSTRING, /* "*name*" */
+    NAME_MATCH_GLOB
+} FmSearchNameMatchType;
+
+struct _FmSearchNameMatcher
+{
+    FmSearchNameMatchType type;
+    char *text; /* the glob or its literal part, lower case if ascii_casefold */
+    gsize len;
+    gboolean ascii_casefold; /* case insensitive and the text is ASCII */
+};
+
+struct _FmSearchResult
+{
+    GFileInfo *info; /* NULL marks the end of the search */
+    GFile *parent; /* folder of the file */
 };
 
 #define FM_TYPE_VFS_SEACRH_ENUMERATOR      (fm_vfs_search_enumerator_get_type())
@@ -63,11 +106,39 @@ struct _FmVfsSearchEnumerator
 {
     GFileEnumerator parent;
 
-    FmSearchIntIter* iter;
-    char* attributes;
+    /* The search runs in the worker threads, which is started by the first
+     * call to next_file(). The folders are shared by the threads walking
+     * them, so a thread takes another folder whenever it's done with one.
+     * The files which match all the other rules are passed to the thread
+     * pool which matches their contents. The matched files are queued in
+     * the order they're found and returned by next_file().
+     * If a backend is used, the target folders are queried in the backend
+     * first and only the files found there are checked. */
+    GMutex mutex; /* protects backend_dirs, files, dirs, pending and error */
+    GCond cond; /* a folder is queued or the search is ended */
+    GQueue backend_dirs; /* GFile, target folders waiting to be queried in the backend */
+    GQueue files; /* GFile, files found by the backend waiting to be checked */
+    GQueue dirs; /* GFile, folders waiting to be walked */
+    GHashTable* visited; /* FmSearchFolderId, folders queued so far, to skip them if they're reached again */
+    guint pending; /* folders and files which are not processed yet */
+    GThread* walkers[MAX_SEARCH_THREADS];
+    guint n_walkers;
+    GThreadPool* matchers; /* NULL if contents are not matched */
+    GAsyncQueue* results; /* FmSearchResult */
+    GCancellable* cancellable; /* stops the workers */
+    GError* error; /* the first error of the workers */
+    gint n_scanned; /* atomic, files checked so far */
+    gint n_matched; /* atomic, files found so far */
+    gboolean started : 1;
+    gboolean finished : 1;
+
+    char* attributes; /* requested by the caller, queried for the matched files */
+    char* walk_attributes; /* only those needed by the rules, queried for every file */
     GFileQueryInfoFlags flags;
     GSList* target_folders; /* GFile */
     char** name_patterns;
+    FmSearchNameMatcher* name_matchers; /* compiled name_patterns */
+    guint n_name_matchers;
     GRegex* name_regex;
     char* content_pattern;
     GRegex* content_regex;
@@ -76,10 +147,14 @@ struct _FmVfsSearchEnumerator
     guint64 max_mtime;
     guint64 min_size;
     guint64 max_size;
+    guint64 content_max_size; /* larger files are not searched for the content */
+    const FmSearchBackend* backend; /* finds the candidates instead of walking, or NULL */
     gboolean name_case_insensitive : 1;
     gboolean content_case_insensitive : 1;
+    gboolean content_skip_binary : 1;
     gboolean recursive : 1;
     gboolean show_hidden : 1;
+    gboolean follow_symlinks : 1;
 };
 
 struct _FmVfsSearchEnumeratorClass
@@ -112,46 +187,526 @@ struct _FmSearchVFileClass
 
 
 /* beforehand declarations */
+static gboolean fm_search_job_match_name(FmVfsSearchEnumerator* priv,
+                                         const char* name);
 static gboolean fm_search_job_match_file(FmVfsSearchEnumerator * priv,
-                                         GFileInfo * info, GFile * parent,
-                                         GCancellable *cancellable,
-                                         GError **error);
-static void fm_search_job_match_folder(FmVfsSearchEnumerator * priv,
-                                       GFile * folder_path,
-                                       GCancellable *cancellable,
-                                       GError **error);
+                                         GFileInfo * info);
+static gboolean fm_search_job_match_content(FmVfsSearchEnumerator* priv,
+                                            GFileInfo* info, GFile* parent,
+                                            GCancellable* cancellable,
+                                            GError** error);
 static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str);
+static const char* _search_find(const char* buf, gsize len,
+                                const char* pattern, gsize pattern_len);
+static const char* _search_find_ascii_casefold(const char* buf, gsize len,
+                                               const char* pattern, gsize pattern_len);
 
 
-/* ---- Directory iterator ---- */
-/* caller should g_object_ref(folder_path) if success */
-static inline FmSearchIntIter *_search_iter_new(FmSearchIntIter *parent,
-                                                const char *attributes,
-                                                GFileQueryInfoFlags flags,
-                                                GFile *folder_path,
-                                                GCancellable *cancellable,
-                                                GError **error)
+/* ---- Search workers ---- */
+
+/* queued to wake up next_result() without a result */
+static FmSearchResult _search_wakeup;
+
+static void _search_wake_up(GCancellable *cancellable, gpointer user_data)
+{
+    FmVfsSearchEnumerator *priv = user_data;
+    g_async_queue_push(priv->results, &_search_wakeup);
+}
+
+static inline void _search_add_match(FmVfsSearchEnumerator *priv, FmSearchResult *result)
+{
+    g_atomic_int_inc(&priv->n_matched);
+    g_async_queue_push(priv->results, result);
+}
+static inline FmSearchResult *_search_result_new(GFileInfo *info, GFile *parent)
+{
+    FmSearchResult *result = g_slice_new(FmSearchResult);
+    result->info = info ? g_object_ref(info) : NULL;
+    result->parent = parent ? g_object_ref(parent) : NULL;
+    return result;
+}
+
+static void _search_result_free(FmSearchResult *result)
+{
+    if(result->info)
+        g_object_unref(result->info);
+    if(result->parent)
+        g_object_unref(result->parent);
+    g_slice_free(FmSearchResult, result);
+}
+
+/* a folder or a file is processed, the search ends when nothing is pending */
+static void _search_task_done(FmVfsSearchEnumerator *priv)
+{
+    gboolean ended;
+
+    g_mutex_lock(&priv->mutex);
+    ended = (--priv->pending == 0);
+    if(ended)
+        g_cond_broadcast(&priv->cond); /* let the walkers quit */
+    g_mutex_unlock(&priv->mutex);
+    if(ended)
+        g_async_queue_push(priv->results, _search_result_new(NULL, NULL));
+}
+
+static guint _search_folder_id_hash(gconstpointer key)
+{
+    const FmSearchFolderId *id = key;
+    return (guint)(id->ino ^ (id->ino >> 32) ^ (id->dev * 31));
+}
+
+static gboolean _search_folder_id_equal(gconstpointer a, gconstpointer b)
+{
+    const FmSearchFolderId *id1 = a, *id2 = b;
+    return id1->ino == id2->ino && id1->dev == id2->dev;
+}
+
+/* returns FALSE if the folder is visited already, the mutex should be locked */
+static gboolean _search_visit_folder(FmVfsSearchEnumerator *priv, guint64 dev, guint64 ino)
+{
+    FmSearchFolderId *id;
+
+    if(ino == 0) /* unknown, so it can't be checked */
+        return TRUE;
+    id = g_slice_new(FmSearchFolderId);
+    id->dev = dev;
+    id->ino = ino;
+    if(!g_hash_table_add(priv->visited, id))
+        return FALSE; /* the hash table keeps one of the equal keys and frees the other */
+    return TRUE;
+}
+
+static void _search_free_folder_id(gpointer id)
+{
+    g_slice_free(FmSearchFolderId, id);
+}
+
+/* ino is 0 if the id of the folder is unknown, then it's always walked */
+static void _search_add_folder(FmVfsSearchEnumerator *priv, GFile *folder_path,
+                               guint64 dev, guint64 ino)
+{
+    g_mutex_lock(&priv->mutex);
+    if(_search_visit_folder(priv, dev, ino))
+    {
+        ++priv->pending;
+        /* LIFO, so the search goes depth first and the queue stays short */
+        g_queue_push_head(&priv->dirs, g_object_ref(folder_path));
+        g_cond_signal(&priv->cond);
+    }
+    g_mutex_unlock(&priv->mutex);
+}
+
+/* takes the ownership of err */
+static void _search_set_error(FmVfsSearchEnumerator *priv, GError *err)
+{
+    if((err->domain == G_IO_ERROR && err->code == G_IO_ERROR_PERMISSION_DENIED) ||
+       g_cancellable_is_cancelled(priv->cancellable))
+    {
+        g_error_free(err); /* ignore this error */
+        return;
+    }
+    g_mutex_lock(&priv->mutex);
+    if(priv->error == NULL)
+    {
+        priv->error = err;
+        err = NULL;
+    }
+    g_mutex_unlock(&priv->mutex);
+    if(err)
+        g_error_free(err);
+    /* stop the search, next_file() returns the error after the files found so far */
+    g_cancellable_cancel(priv->cancellable);
+    g_mutex_lock(&priv->mutex);
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->mutex);
+    g_async_queue_push(priv->results, &_search_wakeup);
+}
+
+/* match the file with the rules except the content, then queue the result or match the content */
+static void _search_check_file(FmVfsSearchEnumerator *priv, GFileInfo *info, GFile *folder_path)
+{
+    if(!fm_search_job_match_file(priv, info))
+        return;
+    if(!priv->content_pattern && !priv->content_regex)
+        _search_add_match(priv, _search_result_new(info, folder_path));
+    else if(g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR &&
+            g_file_info_get_size(info) > 0)
+    {
+        /* reading the file is slow, let the thread pool do it */
+        g_mutex_lock(&priv->mutex);
+        ++priv->pending;
+        g_mutex_unlock(&priv->mutex);
+        g_thread_pool_push(priv->matchers, _search_result_new(info, folder_path), NULL);
+    }
+}
+
+/* find the candidates with the backend, or walk the folder if the backend can't answer */
+static void _search_query_backend(FmVfsSearchEnumerator *priv, GFile *folder_path)
+{
+    GSList *files = NULL, *l;
+    guint n_files;
+
+    if(!priv->backend->find_files((FmSearchQuery *)priv, folder_path, &files,
+                                  priv->cancellable, priv->backend->user_data))
+    {
+        g_slist_free_full(files, g_object_unref);
+        if(!g_cancellable_is_cancelled(priv->cancellable))
+            _search_add_folder(priv, folder_path, 0, 0); /* it's visited already */
+        return;
+    }
+    n_files = g_slist_length(files);
+    g_mutex_lock(&priv->mutex);
+    priv->pending += n_files;
+    for(l = files; l; l = l->next)
+        g_queue_push_tail(&priv->files, l->data); /* steal the ref */
+    if(n_files > 0)
+        g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->mutex);
+    g_slist_free(files);
+}
+
+/* query the full info of the file which passed the rules on its name or basic info */
+static void _search_check_candidate(FmVfsSearchEnumerator *priv, GFile *file, GFile *folder_path)
+{
+    GError *err = NULL;
+    GFileInfo *info;
+
+    info = g_file_query_info(file, priv->attributes, priv->flags, priv->cancellable, &err);
+    if(info == NULL)
+    {
+        /* the file might be deleted after it's listed */
+        if(err->domain == G_IO_ERROR && err->code == G_IO_ERROR_NOT_FOUND)
+            g_error_free(err);
+        else
+            _search_set_error(priv, err);
+        return;
+    }
+    _search_check_file(priv, info, folder_path);
+    g_object_unref(info);
+}
+
+/* the file is found by the backend, its info should be queried to check other rules */
+static void _search_check_indexed_file(FmVfsSearchEnumerator *priv, GFile *file)
+{
+    GFile *folder_path = g_file_get_parent(file);
+
+    g_atomic_int_inc(&priv->n_scanned);
+    _search_check_candidate(priv, file, folder_path);
+    g_object_unref(folder_path);
+}
+
+/* the names listed in the .hidden file of the folder, or NULL */
+static GHashTable *_search_load_hidden_names(const char *dir)
+{
+    char *hidden_file = g_build_filename(dir, ".hidden", NULL);
+    GHashTable *names = NULL;
+    char *data;
+
+    if(g_file_get_contents(hidden_file, &data, NULL, NULL))
+    {
+        char **lines = g_strsplit(data, "\n", -1), **line;
+
+        names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        for(line = lines; *line; ++line)
+        {
+            if(**line)
+                g_hash_table_add(names, *line);
+            else
+                g_free(*line);
+        }
+        g_free(lines); /* the strings are owned by the hash table */
+        g_free(data);
+    }
+    g_free(hidden_file);
+    return names;
+}
+
+/* Walk a local folder with readdir() and only stat the files if the
+ * size or time rules need it. The full info is only queried for the files
+ * which pass these rules. Returns FALSE if gio should walk it instead. */
+static gboolean _search_walk_native_folder(FmVfsSearchEnumerator *priv, GFile *folder_path)
+{
+    char *path = g_file_get_path(folder_path);
+    gboolean need_stat = (priv->min_size || priv->max_size || priv->min_mtime || priv->max_mtime);
+    GHashTable *hidden_names;
+    struct dirent *ent;
+    DIR *dir;
+
+    dir = path ? opendir(path) : NULL;
+    if(dir == NULL)
+    {
+        /* let gio report the error */
+        g_free(path);
+        return FALSE;
+    }
+    hidden_names = priv->show_hidden ? NULL : _search_load_hidden_names(path);
+    g_free(path);
+    while((ent = readdir(dir)) && !g_cancellable_is_cancelled(priv->cancellable))
+    {
+        const char *name = ent->d_name;
+        gboolean is_dir = (ent->d_type == DT_DIR);
+        gboolean is_symlink = (ent->d_type == DT_LNK);
+        gboolean matched;
+        struct stat st;
+
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        g_atomic_int_inc(&priv->n_scanned);
+        /* hidden files are neither matched nor walked into */
+        if(!priv->show_hidden &&
+           (name[0] == '.' || (hidden_names && g_hash_table_contains(hidden_names, name))))
+            continue;
+        matched = fm_search_job_match_name(priv, name);
+        if(ent->d_type == DT_UNKNOWN || (matched && need_stat && !is_symlink) ||
+           (priv->recursive && is_dir))
+        {
+            if(fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue; /* it's deleted */
+            is_dir = S_ISDIR(st.st_mode);
+            is_symlink = S_ISLNK(st.st_mode);
+            /* the rules of gio are checked later for the targets of symlinks */
+            if(matched && need_stat && !is_symlink)
+            {
+                if(priv->min_size || priv->max_size)
+                    matched = !is_dir &&
+                              (!priv->min_size || (guint64)st.st_size >= priv->min_size) &&
+                              (!priv->max_size || (guint64)st.st_size <= priv->max_size);
+                if(matched && priv->min_mtime)
+                    matched = ((guint64)st.st_mtime >= priv->min_mtime);
+                if(matched && priv->max_mtime)
+                    matched = ((guint64)st.st_mtime <= priv->max_mtime);
+            }
+        }
+        /* the folder id of the target is needed to follow a symlink */
+        if(priv->recursive && is_symlink && priv->follow_symlinks)
+            is_dir = (fstatat(dirfd(dir), name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        if(matched || (priv->recursive && is_dir))
+        {
+            GFile *file = g_file_get_child(folder_path, name);
+            if(matched)
+                _search_check_candidate(priv, file, folder_path);
+            if(priv->recursive && is_dir)
+                _search_add_folder(priv, file, st.st_dev, st.st_ino);
+            g_object_unref(file);
+        }
+    }
+    closedir(dir);
+    if(hidden_names)
+        g_hash_table_destroy(hidden_names);
+    return TRUE;
+}
+
+static void _search_walk_folder(FmVfsSearchEnumerator *priv, GFile *folder_path)
 {
     GFileEnumerator *enu;
-    FmSearchIntIter *iter;
+    GFileInfo *info;
+    GError *err = NULL;
 
-    enu = g_file_enumerate_children(folder_path, attributes, flags,
-                                    cancellable, error);
+    /* mime types are only known to gio */
+    if(priv->mime_types == NULL && g_file_is_native(folder_path) &&
+       _search_walk_native_folder(priv, folder_path))
+        return;
+    enu = g_file_enumerate_children(folder_path, priv->walk_attributes, priv->flags,
+                                    priv->cancellable, &err);
     if(enu == NULL)
-        return NULL;
-    iter = g_slice_new(FmSearchIntIter);
-    iter->parent = parent;
-    iter->folder_path = folder_path;
-    iter->enu = enu;
-    return iter;
+    {
+        _search_set_error(priv, err);
+        return;
+    }
+    while((info = g_file_enumerator_next_file(enu, priv->cancellable, &err)))
+    {
+        if(g_file_info_get_name(info) == NULL)
+        {
+            g_object_unref(info);
+            continue;
+        }
+        g_atomic_int_inc(&priv->n_scanned);
+        if(fm_search_job_match_file(priv, info))
+        {
+            GFile *file = g_file_get_child(folder_path, g_file_info_get_name(info));
+            _search_check_candidate(priv, file, folder_path);
+            g_object_unref(file);
+        }
+
+        /* recurse upon each directory */
+        if(priv->recursive &&
+           g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY &&
+           (priv->show_hidden || !g_file_info_get_is_hidden(info)))
+        {
+            guint64 ino = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_INODE);
+            guint64 dev = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+            /* SF bug #969: we get multiple instances of the same file if we follow
+               symlinks to directories, so they're only followed if the visited
+               folders can be recognized by their ids */
+            if(!g_file_info_get_is_symlink(info) || (priv->follow_symlinks && ino != 0))
+            {
+                GFile *file = g_file_get_child(folder_path, g_file_info_get_name(info));
+                _search_add_folder(priv, file, dev, ino);
+                g_object_unref(file);
+            }
+        }
+        g_object_unref(info);
+    }
+    if(err)
+        _search_set_error(priv, err);
+    g_file_enumerator_close(enu, NULL, NULL);
+    g_object_unref(enu);
 }
 
-static inline void _search_iter_free(FmSearchIntIter *iter, GCancellable *cancellable)
+static gpointer _search_walker_thread(gpointer user_data)
 {
-    g_file_enumerator_close(iter->enu, cancellable, NULL);
-    g_object_unref(iter->enu);
-    g_object_unref(iter->folder_path);
-    g_slice_free(FmSearchIntIter, iter);
+    FmVfsSearchEnumerator *priv = user_data;
+    GFile *path;
+    GQueue *queue;
+
+    for(;;)
+    {
+        g_mutex_lock(&priv->mutex);
+        while(g_queue_is_empty(&priv->backend_dirs) && g_queue_is_empty(&priv->files) &&
+              g_queue_is_empty(&priv->dirs) && priv->pending > 0 &&
+              !g_cancellable_is_cancelled(priv->cancellable))
+            g_cond_wait(&priv->cond, &priv->mutex);
+        if(g_cancellable_is_cancelled(priv->cancellable))
+            queue = NULL;
+        else if(!g_queue_is_empty(&priv->backend_dirs))
+            queue = &priv->backend_dirs;
+        else if(!g_queue_is_empty(&priv->files))
+            queue = &priv->files;
+        else
+            queue = &priv->dirs;
+        path = queue ? g_queue_pop_head(queue) : NULL;
+        g_mutex_unlock(&priv->mutex);
+        if(path == NULL) /* the search is ended or stopped */
+            break;
+        if(queue == &priv->backend_dirs)
+            _search_query_backend(priv, path);
+        else if(queue == &priv->files)
+            _search_check_indexed_file(priv, path);
+        else
+            _search_walk_folder(priv, path);
+        g_object_unref(path);
+        _search_task_done(priv);
+    }
+    return NULL;
+}
+
+static void _search_match_content_func(gpointer data, gpointer user_data)
+{
+    FmVfsSearchEnumerator *priv = user_data;
+    FmSearchResult *result = data;
+    GError *err = NULL;
+
+    if(!g_cancellable_is_cancelled(priv->cancellable) &&
+       fm_search_job_match_content(priv, result->info, result->parent,
+                                   priv->cancellable, &err))
+        _search_add_match(priv, result);
+    else
+        _search_result_free(result);
+    if(err)
+        _search_set_error(priv, err);
+    _search_task_done(priv);
+}
+
+/* the attributes needed to walk the folders and check the rules except the content */
+static char *_search_get_walk_attributes(FmVfsSearchEnumerator *priv)
+{
+    GString *attributes = g_string_new(G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                       G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                       G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+                                       G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK);
+    if(priv->recursive) /* to recognize the visited folders */
+        g_string_append(attributes, "," G_FILE_ATTRIBUTE_UNIX_DEVICE "," G_FILE_ATTRIBUTE_UNIX_INODE);
+    if(priv->min_size || priv->max_size)
+        g_string_append(attributes, "," G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    if(priv->min_mtime || priv->max_mtime)
+        g_string_append(attributes, "," G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    if(priv->mime_types)
+        g_string_append(attributes, "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+    return g_string_free(attributes, FALSE);
+}
+
+static void _search_start(FmVfsSearchEnumerator *priv)
+{
+    guint n_threads = CLAMP(g_get_num_processors(), 1, MAX_SEARCH_THREADS);
+    GSList *l;
+    guint i;
+
+    priv->started = TRUE;
+    priv->walk_attributes = _search_get_walk_attributes(priv);
+    if(priv->content_pattern || priv->content_regex)
+        priv->matchers = g_thread_pool_new(_search_match_content_func, priv,
+                                           n_threads, FALSE, NULL);
+    for(l = priv->target_folders; l; l = l->next)
+    {
+        guint64 dev = 0, ino = 0;
+
+        /* a target folder might be inside another one, or the same */
+        if(priv->recursive)
+        {
+            GFileInfo *info = g_file_query_info(l->data, G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+                                                G_FILE_ATTRIBUTE_UNIX_INODE,
+                                                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+            if(info)
+            {
+                dev = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+                ino = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_INODE);
+                g_object_unref(info);
+            }
+        }
+        if(priv->backend)
+        {
+            g_mutex_lock(&priv->mutex);
+            if(_search_visit_folder(priv, dev, ino))
+            {
+                ++priv->pending;
+                g_queue_push_tail(&priv->backend_dirs, g_object_ref(l->data));
+            }
+            g_mutex_unlock(&priv->mutex);
+        }
+        else
+            _search_add_folder(priv, l->data, dev, ino);
+    }
+    if(priv->pending == 0) /* nothing to search */
+    {
+        g_async_queue_push(priv->results, _search_result_new(NULL, NULL));
+        return;
+    }
+    /* no folder to share with other threads */
+    if(!priv->recursive && !priv->backend)
+        n_threads = MIN(n_threads, g_slist_length(priv->target_folders));
+    for(i = 0; i < n_threads; ++i)
+        priv->walkers[priv->n_walkers++] = g_thread_new("search", _search_walker_thread, priv);
+}
+
+static void _search_stop(FmVfsSearchEnumerator *priv)
+{
+    FmSearchResult *result;
+    GFile *folder_path;
+    guint i;
+
+    g_cancellable_cancel(priv->cancellable);
+    g_mutex_lock(&priv->mutex);
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->mutex);
+    for(i = 0; i < priv->n_walkers; ++i)
+        g_thread_join(priv->walkers[i]);
+    priv->n_walkers = 0;
+    /* the walkers are stopped, so no task is added. The queued ones are dropped quickly. */
+    if(priv->matchers)
+    {
+        g_thread_pool_free(priv->matchers, FALSE, TRUE);
+        priv->matchers = NULL;
+    }
+    while((folder_path = g_queue_pop_head(&priv->backend_dirs)))
+        g_object_unref(folder_path);
+    while((folder_path = g_queue_pop_head(&priv->files)))
+        g_object_unref(folder_path);
+    while((folder_path = g_queue_pop_head(&priv->dirs)))
+        g_object_unref(folder_path);
+    while((result = g_async_queue_try_pop(priv->results)))
+        if(result != &_search_wakeup)
+            _search_result_free(result);
+    priv->finished = TRUE;
 }
 
 
@@ -163,12 +718,13 @@ G_DEFINE_TYPE(FmVfsSearchEnumerator, fm_vfs_search_enumerator, G_TYPE_FILE_ENUME
 static void _fm_vfs_search_enumerator_dispose(GObject *object)
 {
     FmVfsSearchEnumerator *priv = FM_VFS_SEACRH_ENUMERATOR(object);
-    FmSearchIntIter *iter;
 
-    while((iter = priv->iter))
+    _search_stop(priv);
+
+    if(priv->error)
     {
-        priv->iter = iter->parent;
-        _search_iter_free(iter, NULL);
+        g_error_free(priv->error);
+        priv->error = NULL;
     }
 
     if(priv->attributes)
@@ -177,6 +733,12 @@ static void _fm_vfs_search_enumerator_dispose(GObject *object)
         priv->attributes = NULL;
     }
 
+    if(priv->walk_attributes)
+    {
+        g_free(priv->walk_attributes);
+        priv->walk_attributes = NULL;
+    }
+
     if(priv->target_folders)
     {
         g_slist_foreach(priv->target_folders, (GFunc)g_object_unref, NULL);
@@ -190,6 +752,16 @@ static void _fm_vfs_search_enumerator_dispose(GObject *object)
         priv->name_patterns = NULL;
     }
 
+    if(priv->name_matchers)
+    {
+        guint i;
+        for(i = 0; i < priv->n_name_matchers; ++i)
+            g_free(priv->name_matchers[i].text);
+        g_free(priv->name_matchers);
+        priv->name_matchers = NULL;
+        priv->n_name_matchers = 0;
+    }
+
     if(priv->name_regex)
     {
         g_regex_unref(priv->name_regex);
@@ -217,96 +789,105 @@ static void _fm_vfs_search_enumerator_dispose(GObject *object)
     G_OBJECT_CLASS(fm_vfs_search_enumerator_parent_class)->dispose(object);
 }
 
-static GFileInfo *_fm_vfs_search_enumerator_next_file(GFileEnumerator *enumerator,
-                                                      GCancellable *cancellable,
-                                                      GError **error)
+GFileInfo *fm_search_enumerator_next_result(GFileEnumerator *enumerator,
+                                            GFile **parent,
+                                            gint64 timeout_usec,
+                                            gboolean *timed_out,
+                                            GCancellable *cancellable,
+                                            GError **error)
 {
     FmVfsSearchEnumerator *enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
-    FmSearchIntIter *iter;
-    GFileInfo * file_info;
-    GError *err = NULL;
-    FmSearchVFile *container;
-
-    /* g_debug("_fm_vfs_search_enumerator_next_file"); */
-    while(!g_cancellable_set_error_if_cancelled(cancellable, error))
+    gint64 end_time = (timeout_usec >= 0) ? g_get_monotonic_time() + timeout_usec : -1;
+    FmSearchResult *result;
+    GFileInfo *file_info = NULL;
+    gulong handler = 0;
+
+    /* g_debug("fm_search_enumerator_next_result"); */
+    if(timed_out)
+        *timed_out = FALSE;
+    if(!enu->started)
+        _search_start(enu);
+    /* return as soon as the caller cancels it */
+    if(cancellable)
+        handler = g_cancellable_connect(cancellable, G_CALLBACK(_search_wake_up), enu, NULL);
+    while(!enu->finished && file_info == NULL && !g_cancellable_is_cancelled(cancellable))
     {
-        iter = enu->iter;
-        if(iter == NULL) /* ended with folder */
+        if(end_time < 0)
+            result = g_async_queue_pop(enu->results);
+        else
         {
-            if(enu->target_folders == NULL)
-                break;
-            iter = _search_iter_new(NULL, enu->attributes, enu->flags,
-                                    enu->target_folders->data,
-                                    cancellable, error);
-            if(iter == NULL)
+            gint64 now = g_get_monotonic_time();
+            result = (now < end_time) ? g_async_queue_timeout_pop(enu->results, end_time - now)
+                                      : g_async_queue_try_pop(enu->results);
+            if(result == NULL)
+            {
+                if(timed_out)
+                    *timed_out = TRUE;
                 break;
-            /* data is moved into iter now so free link itself */
-            enu->target_folders = g_slist_delete_link(enu->target_folders,
-                                                      enu->target_folders);
-            container = FM_SEARCH_VFILE(g_file_enumerator_get_container(enumerator));
-            if(container->current)
-                g_object_unref(container->current);
-            container->current = g_object_ref(iter->folder_path);
-            enu->iter = iter;
+            }
         }
-
-        file_info = g_file_enumerator_next_file(iter->enu, cancellable, &err);
-        if(file_info && g_file_info_get_name(file_info))
+        if(result == &_search_wakeup)
         {
-            /* check if directory itself matches criteria */
-            if(fm_search_job_match_file(enu, file_info, iter->folder_path,
-                                        cancellable, &err))
-            {
-                g_debug("found matched: %s", g_file_info_get_name(file_info));
-                return file_info;
-            }
-
-            /* recurse upon each directory */
-            if(err == NULL && enu->recursive &&
-               /* SF bug #969: very possibly we get multiple instances of the
-                  same file if we follow symlink to a directory
-                  FIXME: make it optional? */
-               !g_file_info_get_is_symlink(file_info) &&
-               g_file_info_get_file_type(file_info) == G_FILE_TYPE_DIRECTORY)
-            {
-                if(enu->show_hidden || !g_file_info_get_is_hidden(file_info))
-                {
-                    const char * name = g_file_info_get_name(file_info);
-                    GFile * file = g_file_get_child(iter->folder_path, name);
-                    /* go into directory and iterate it now */
-                    fm_search_job_match_folder(enu, file, cancellable, &err);
-                    g_object_unref(file);
-                }
-            }
-
-            g_object_unref(file_info);
-            if(err == NULL)
-                continue;
+            if(g_cancellable_is_cancelled(enu->cancellable)) /* stopped by an error */
+                enu->finished = TRUE;
+            continue;
         }
-
-        if(err != NULL) /* file_info == NULL */
+        if(result->info == NULL) /* end of the search */
+            enu->finished = TRUE;
+        else
         {
-            if(err->domain == G_IO_ERROR && err->code == G_IO_ERROR_PERMISSION_DENIED)
-            {
-                g_error_free(err); /* ignore this error */
-                err = NULL;
-                continue;
-            }
-            g_propagate_error(error, err);
-            break;
+            *parent = g_object_ref(result->parent);
+            file_info = g_object_ref(result->info);
+            g_debug("found matched: %s", g_file_info_get_name(file_info));
         }
-        /* else end of file list - go up */
-        enu->iter = iter->parent;
+        _search_result_free(result);
+    }
+    if(handler)
+        g_cancellable_disconnect(cancellable, handler);
+    if(file_info || g_cancellable_set_error_if_cancelled(cancellable, error) || !enu->finished)
+        return file_info;
+    g_mutex_lock(&enu->mutex);
+    if(enu->error)
+    {
+        g_propagate_error(error, enu->error);
+        enu->error = NULL;
+    }
+    g_mutex_unlock(&enu->mutex);
+    return NULL;
+}
+
+void fm_search_enumerator_get_progress(GFileEnumerator *enumerator,
+                                       guint *n_scanned, guint *n_matched)
+{
+    FmVfsSearchEnumerator *enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
+
+    *n_scanned = g_atomic_int_get(&enu->n_scanned);
+    *n_matched = g_atomic_int_get(&enu->n_matched);
+}
+
+gboolean fm_is_search_enumerator(GFileEnumerator *enumerator)
+{
+    return G_TYPE_CHECK_INSTANCE_TYPE(enumerator, FM_TYPE_VFS_SEACRH_ENUMERATOR);
+}
+
+static GFileInfo *_fm_vfs_search_enumerator_next_file(GFileEnumerator *enumerator,
+                                                      GCancellable *cancellable,
+                                                      GError **error)
+{
+    GFile *parent = NULL;
+    GFileInfo *file_info;
+    FmSearchVFile *container;
+
+    file_info = fm_search_enumerator_next_result(enumerator, &parent, -1, NULL, cancellable, error);
+    if(file_info)
+    {
+        /* the container tells the caller the folder of the file */
         container = FM_SEARCH_VFILE(g_file_enumerator_get_container(enumerator));
         if(container->current)
             g_object_unref(container->current);
-        if(enu->iter)
-            container->current = g_object_ref(enu->iter->folder_path);
-        else
-            container->current = NULL;
-        _search_iter_free(iter, cancellable);
+        container->current = parent;
     }
-    return NULL;
+    return file_info;
 }
 
 static gboolean _fm_vfs_search_enumerator_close(GFileEnumerator *enumerator,
@@ -314,22 +895,31 @@ static gboolean _fm_vfs_search_enumerator_close(GFileEnumerator *enumerator,
                                               GError **error)
 {
     FmVfsSearchEnumerator *enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
-    FmSearchIntIter *iter;
 
-    while((iter = enu->iter))
-    {
-        enu->iter = iter->parent;
-        _search_iter_free(iter, cancellable);
-    }
+    _search_stop(enu);
     return TRUE;
 }
 
+static void _fm_vfs_search_enumerator_finalize(GObject *object)
+{
+    FmVfsSearchEnumerator *priv = FM_VFS_SEACRH_ENUMERATOR(object);
+
+    g_object_unref(priv->cancellable);
+    g_async_queue_unref(priv->results);
+    g_hash_table_destroy(priv->visited);
+    g_mutex_clear(&priv->mutex);
+    g_cond_clear(&priv->cond);
+
+    G_OBJECT_CLASS(fm_vfs_search_enumerator_parent_class)->finalize(object);
+}
+
 static void fm_vfs_search_enumerator_class_init(FmVfsSearchEnumeratorClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
   GFileEnumeratorClass *enumerator_class = G_FILE_ENUMERATOR_CLASS(klass);
 
   gobject_class->dispose = _fm_vfs_search_enumerator_dispose;
+  gobject_class->finalize = _fm_vfs_search_enumerator_finalize;
 
   enumerator_class->next_file = _fm_vfs_search_enumerator_next_file;
   enumerator_class->close_fn = _fm_vfs_search_enumerator_close;
@@ -338,7 +928,15 @@ static void fm_vfs_search_enumerator_class_init(FmVfsSearchEnumeratorClass *klas
 
 static void fm_vfs_search_enumerator_init(FmVfsSearchEnumerator *enumerator)
 {
-    /* nothing */
+    g_mutex_init(&enumerator->mutex);
+    g_cond_init(&enumerator->cond);
+    g_queue_init(&enumerator->backend_dirs);
+    g_queue_init(&enumerator->files);
+    g_queue_init(&enumerator->dirs);
+    enumerator->visited = g_hash_table_new_full(_search_folder_id_hash, _search_folder_id_equal,
+                                                _search_free_folder_id, NULL);
+    enumerator->results = g_async_queue_new();
+    enumerator->cancellable = g_cancellable_new();
 }
 
 static GFileEnumerator *_fm_vfs_search_enumerator_new(GFile *file,
@@ -383,6 +981,108 @@ static time_t parse_date_str(const char* str)
     return 0;
 }
 
+static gboolean _search_is_ascii(const char* str)
+{
+    for(; *str; ++str)
+        if((guchar)*str >= 0x80)
+            return FALSE;
+    return TRUE;
+}
+
+/* turn the globs in name_patterns into string comparisons where possible */
+static void _search_compile_name_patterns(FmVfsSearchEnumerator* priv)
+{
+    guint i, n = g_strv_length(priv->name_patterns);
+
+    priv->name_matchers = g_new0(FmSearchNameMatcher, n);
+    priv->n_name_matchers = n;
+    for(i = 0; i < n; ++i)
+    {
+        FmSearchNameMatcher* matcher = &priv->name_matchers[i];
+        const char* pattern = priv->name_patterns[i];
+        gsize len = strlen(pattern);
+        gboolean leading_star = (len > 0 && pattern[0] == '*');
+        gboolean trailing_star = (len > 1 && pattern[len - 1] == '*');
+        const char* text = pattern + (leading_star ? 1 : 0);
+        gsize text_len = len - (leading_star ? 1 : 0) - (trailing_star ? 1 : 0);
+
+        /* the part between the stars should be literal */
+        if(strcspn(text, "*?[\\") < text_len || (len == 1 && leading_star))
+        {
+            matcher->type = (len == 1 && leading_star) ? NAME_MATCH_SUBSTRING : NAME_MATCH_GLOB;
+            if(matcher->type == NAME_MATCH_GLOB)
+            {
+                text = pattern;
+                text_len = len;
+            }
+            else
+                text_len = 0;
+        }
+        else if(leading_star)
+            matcher->type = trailing_star ? NAME_MATCH_SUBSTRING : NAME_MATCH_SUFFIX;
+        else
+            matcher->type = trailing_star ? NAME_MATCH_PREFIX : NAME_MATCH_LITERAL;
+        matcher->ascii_casefold = priv->name_case_insensitive && _search_is_ascii(pattern);
+        /* non-ASCII text can only be case folded by fnmatch() */
+        if(priv->name_case_insensitive && !matcher->ascii_casefold)
+        {
+            matcher->type = NAME_MATCH_GLOB;
+            text = pattern;
+            text_len = len;
+        }
+        if(matcher->ascii_casefold && matcher->type != NAME_MATCH_GLOB)
+            matcher->text = g_ascii_strdown(text, text_len);
+        else
+            matcher->text = g_strndup(text, text_len);
+        matcher->len = text_len;
+    }
+}
+
+static gboolean _search_match_name_pattern(FmVfsSearchEnumerator* priv,
+                                           const FmSearchNameMatcher* matcher,
+                                           const char* name)
+{
+    gsize name_len;
+
+    if(matcher->type == NAME_MATCH_GLOB)
+    {
+        /* FIXME: FNM_CASEFOLD is a GNU extension */
+        int flags = FNM_PERIOD;
+        if(priv->name_case_insensitive)
+            flags |= FNM_CASEFOLD;
+        return fnmatch(matcher->text, name, flags) == 0;
+    }
+    /* like FNM_PERIOD, a leading '*' doesn't match the dot of hidden files */
+    if(name[0] == '.' && (matcher->type == NAME_MATCH_SUFFIX || matcher->type == NAME_MATCH_SUBSTRING))
+        return FALSE;
+    name_len = strlen(name);
+    if(name_len < matcher->len)
+        return FALSE;
+    switch(matcher->type)
+    {
+    case NAME_MATCH_LITERAL:
+        if(name_len != matcher->len)
+            return FALSE;
+        /* fall through */
+    case NAME_MATCH_PREFIX:
+        if(matcher->ascii_casefold)
+            return g_ascii_strncasecmp(name, matcher->text, matcher->len) == 0;
+        return memcmp(name, matcher->text, matcher->len) == 0;
+    case NAME_MATCH_SUFFIX:
+        if(matcher->ascii_casefold)
+            return g_ascii_strncasecmp(name + name_len - matcher->len, matcher->text, matcher->len) == 0;
+        return memcmp(name + name_len - matcher->len, matcher->text, matcher->len) == 0;
+    case NAME_MATCH_SUBSTRING:
+        if(matcher->len == 0)
+            return TRUE;
+        if(matcher->ascii_casefold)
+            return _search_find_ascii_casefold(name, name_len, matcher->text, matcher->len) != NULL;
+        return _search_find(name, name_len, matcher->text, matcher->len) != NULL;
+    default:
+        return FALSE;
+    }
+}
+
 /*
  * parse_search_uri
  * @job
@@ -394,17 +1094,25 @@ static time_t parse_date_str(const char* str)
  * The optional parameter key/value pairs are:
  * show_hidden=<0 or 1>: whether to search for hidden files
  * recursive=<0 or 1>: whether to search sub folders recursively
+ * follow_symlinks=<0 or 1>: whether to search the folders symlinks point to,
+ *   a folder is searched only once however it's reached
  * name=<patterns>: patterns of filenames, separated by comma
  * name_regex=<regular expression>: regular expression
  * name_case_sensitive=<0 or 1>
  * content=<content pattern>: search for files containing the pattern
  * content_regex=<regular expression>: regular expression
  * content_case_sensitive=<0 or 1>
+ * content_skip_binary=<0 or 1>: don't search the contents of binary files
+ * content_max_size=<bytes>: don't search the contents of larger files
  * mime_types=<mime-types>: mime-types to search for, can use /* (ex: image/*), separated by ';'
  * min_size=<bytes>
  * max_size=<bytes>
  * min_mtime=YYYY-MM-DD
  * max_mtime=YYYY-MM-DD
+ * backend=<name>: find the candidates with a search backend (see
+ *   fm-search-backend.h) instead of walking the folders, like "locate"
+ * use_index=<0 or 1>: the same as backend=index, find the files by name in
+ *   the file name index of local folders
  * 
  * An example to search all *.desktop files in /usr/share and /usr/local/share
  * can be written like this:
@@ -486,6 +1194,8 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str)
                     priv->show_hidden = (value[0] == '1') ? TRUE : FALSE;
                 else if(strcmp(name, "recursive") == 0)
                     priv->recursive = (value[0] == '1') ? TRUE : FALSE;
+                else if(strcmp(name, "follow_symlinks") == 0)
+                    priv->follow_symlinks = (value && value[0] == '1') ? TRUE : FALSE;
                 else if(strcmp(name, "name") == 0)
                     priv->name_patterns = g_strsplit(value, ",", 0);
                 else if(strcmp(name, "name_regex") == 0)
@@ -510,6 +1220,20 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str)
                 }
                 else if(strcmp(name, "content_ci") == 0)
                     priv->content_case_insensitive = (value[0] == '1') ? TRUE : FALSE;
+                else if(strcmp(name, "content_skip_binary") == 0)
+                {
+                    priv->content_skip_binary = (value && value[0] == '1') ? TRUE : FALSE;
+                    /* the mime type is used to reject binaries without reading them */
+                    if(priv->content_skip_binary &&
+                       !g_strstr_len(priv->attributes, -1, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE))
+                    {
+                        gchar * attributes = g_strconcat(priv->attributes, ",", G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE, NULL);
+                        g_free(priv->attributes);
+                        priv->attributes = attributes;
+                    }
+                }
+                else if(strcmp(name, "content_max_size") == 0)
+                    priv->content_max_size = value ? atoll(value) : 0;
                 else if(strcmp(name, "mime_types") == 0)
                 {
                     priv->mime_types = g_strsplit(value, ";", -1);
@@ -551,6 +1275,13 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str)
                     priv->min_mtime = (guint64)parse_date_str(value);
                 else if(strcmp(name, "max_mtime") == 0)
                     priv->max_mtime = (guint64)parse_date_str(value);
+                else if(strcmp(name, "use_index") == 0)
+                {
+                    if(value && value[0] == '1')
+                        priv->backend = &fm_search_name_index_backend;
+                }
+                else if(strcmp(name, "backend") == 0)
+                    priv->backend = value ? fm_search_find_backend(value) : NULL;
 
                 g_free(name);
                 g_free(value);
@@ -566,13 +1297,17 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str)
             {
                 /* we set G_REGEX_RAW because GLib might cause a crash
                    if a search is done in a non-utf8 string */
-                GRegexCompileFlags flags = G_REGEX_RAW;
+                /* it's matched against every file name, so optimize it */
+                GRegexCompileFlags flags = G_REGEX_RAW | G_REGEX_OPTIMIZE;
                 if(priv->name_case_insensitive)
                     flags |= G_REGEX_CASELESS;
                 priv->name_regex = g_regex_new(name_regex, flags, 0, NULL);
                 g_free(name_regex);
             }
 
+            if(priv->name_patterns)
+                _search_compile_name_patterns(priv);
+
             if(content_regex)
             {
                 GRegexCompileFlags flags = G_REGEX_RAW; /* like above */
@@ -595,52 +1330,19 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str)
     }
 }
 
-static void fm_search_job_match_folder(FmVfsSearchEnumerator * priv,
-                                       GFile * folder_path,
-                                       GCancellable *cancellable,
-                                       GError **error)
-{
-    FmSearchIntIter *iter;
-    FmSearchVFile *container;
-
-    /* FIXME: make error if NULL */
-    iter = _search_iter_new(priv->iter, priv->attributes, priv->flags, folder_path,
-                            cancellable, error);
-    if(iter == NULL) /* error */
-        return;
-    g_object_ref(folder_path); /* it's copied into iter */
-    priv->iter = iter;
-    container = FM_SEARCH_VFILE(g_file_enumerator_get_container(G_FILE_ENUMERATOR(priv)));
-    if(container->current)
-        g_object_unref(container->current);
-    container->current = g_object_ref(folder_path);
-}
-
-static gboolean fm_search_job_match_filename(FmVfsSearchEnumerator* priv, GFileInfo* info)
+/* this is also called by the file name index, so only the name can be used */
+static gboolean fm_search_job_match_name(FmVfsSearchEnumerator* priv, const char* name)
 {
     gboolean ret;
 
-    /* g_debug("fm_search_job_match_filename: %s", g_file_info_get_name(info)); */
     if(priv->name_regex)
-    {
-        const char* name = g_file_info_get_name(info);
         ret = g_regex_match(priv->name_regex, name, 0, NULL);
-    }
-    else if(priv->name_patterns)
+    else if(priv->name_matchers)
     {
+        guint i;
         ret = FALSE;
-        const char* name = g_file_info_get_name(info);
-        char** ppattern;
-        for(ppattern = priv->name_patterns; *ppattern; ++ppattern)
-        {
-            const char* pattern = *ppattern;
-            /* FIXME: FNM_CASEFOLD is a GNU extension */
-            int flags = FNM_PERIOD;
-            if(priv->name_case_insensitive)
-                flags |= FNM_CASEFOLD;
-            if(fnmatch(pattern, name, flags) == 0)
-                ret = TRUE;
-        }
+        for(i = 0; i < priv->n_name_matchers && !ret; ++i)
+            ret = _search_match_name_pattern(priv, &priv->name_matchers[i], name);
     }
     else
         ret = TRUE;
@@ -654,6 +1356,7 @@ static gboolean fm_search_job_match_content_line_based(FmVfsSearchEnumerator* pr
                                                        GError** error)
 {
     gboolean ret = FALSE;
+    gsize sniffed = priv->content_skip_binary ? 0 : BINARY_SNIFF_SIZE;
     /* create a buffered data input stream for line-based I/O */
     GDataInputStream *input_stream = g_data_input_stream_new(stream);
     do
@@ -662,6 +1365,15 @@ static gboolean fm_search_job_match_content_line_based(FmVfsSearchEnumerator* pr
         char* line = g_data_input_stream_read_line(input_stream, &line_len, cancellable, error);
         if(line == NULL) /* error or EOF */
             break;
+        if(sniffed < BINARY_SNIFF_SIZE)
+        {
+            if(memchr(line, '\0', MIN(line_len, BINARY_SNIFF_SIZE - sniffed)))
+            {
+                g_free(line); /* binary file */
+                break;
+            }
+            sniffed += line_len + 1;
+        }
         if(priv->content_regex)
         {
             /* match using regexp */
@@ -723,6 +1435,9 @@ static gboolean fm_search_job_match_content_exact(FmVfsSearchEnumerator* priv,
             break;
         pbuf[size] = '\0'; /* make the string null terminated */
 
+        if(pbuf == buf && priv->content_skip_binary && memchr(buf, '\0', MIN(size, BINARY_SNIFF_SIZE)))
+            break; /* the first block of a binary file */
+
         found = strstr(buf, priv->content_pattern);
         if(found) /* the string is found in the buffer */
         {
@@ -745,6 +1460,142 @@ static gboolean fm_search_job_match_content_exact(FmVfsSearchEnumerator* priv,
     return ret;
 }
 
+/* reject the files which are not worth reading without opening them */
+static gboolean fm_search_job_skip_content(FmVfsSearchEnumerator* priv, GFileInfo* info)
+{
+    if(priv->content_max_size > 0 && (guint64)g_file_info_get_size(info) > priv->content_max_size)
+        return TRUE;
+    if(priv->content_skip_binary)
+    {
+        /* the types which can't be told from the name are sniffed when reading the file */
+        const char* type = g_file_info_get_content_type(info);
+        if(type && !g_content_type_is_unknown(type) &&
+           !g_content_type_is_a(type, "text/plain"))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* memchr() is vectorized by libc, so it skips to the candidates much faster
+ * than comparing the pattern at every position like strstr() does. */
+static const char* _search_find(const char* buf, gsize len,
+                                const char* pattern, gsize pattern_len)
+{
+    const char* end = buf + len;
+    const char* p = buf;
+    while(len >= pattern_len &&
+          (p = memchr(p, pattern[0], end - p - pattern_len + 1)) != NULL)
+    {
+        if(memcmp(p + 1, pattern + 1, pattern_len - 1) == 0)
+            return p;
+        ++p;
+        if(end - p < (gssize)pattern_len)
+            break;
+    }
+    return NULL;
+}
+
+/* the same as _search_find() but ignores the case of ASCII letters.
+ * pattern should be in lower case. */
+static const char* _search_find_ascii_casefold(const char* buf, gsize len,
+                                               const char* pattern, gsize pattern_len)
+{
+    char lower = pattern[0], upper = g_ascii_toupper(pattern[0]);
+    const char* last = buf + len - pattern_len; /* the last possible start */
+    const char* next_lower = buf;
+    const char* next_upper = (lower == upper) ? NULL : buf;
+    const char* p;
+
+    if(len < pattern_len)
+        return NULL;
+    for(;;)
+    {
+        /* find the next candidate of both cases, and only search again for the one which is used */
+        if(next_lower && (next_lower = memchr(next_lower, lower, last - next_lower + 1)) == NULL &&
+           next_upper == NULL)
+            break;
+        if(next_upper && (next_upper = memchr(next_upper, upper, last - next_upper + 1)) == NULL &&
+           next_lower == NULL)
+            break;
+        if(next_lower == NULL || (next_upper && next_upper < next_lower))
+            p = next_upper;
+        else
+            p = next_lower;
+        if(g_ascii_strncasecmp(p + 1, pattern + 1, pattern_len - 1) == 0)
+            return p;
+        if(p == last)
+            break;
+        if(p == next_lower)
+            ++next_lower;
+        else
+            ++next_upper;
+    }
+    return NULL;
+}
+
+/* search a native file for the plain pattern with read() in big chunks */
+static gboolean fm_search_job_match_content_native(FmVfsSearchEnumerator* priv,
+                                                   const char* path,
+                                                   gboolean ascii_casefold,
+                                                   GCancellable* cancellable,
+                                                   GError** error)
+{
+    gboolean ret = FALSE;
+    gsize pattern_len = strlen(priv->content_pattern);
+    gsize buf_size = MAX(NATIVE_READ_SIZE, pattern_len * 2);
+    gsize kept = 0; /* the bytes kept from the last chunk */
+    gboolean first_block = priv->content_skip_binary;
+    char* buf;
+    int fd, errsv = 0;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        errsv = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                    "%s", g_strerror(errsv));
+        return FALSE;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    buf = g_malloc(buf_size);
+    while(!g_cancellable_set_error_if_cancelled(cancellable, error))
+    {
+        gssize size = read(fd, buf + kept, buf_size - kept);
+        if(size < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            errsv = errno;
+            g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                        "%s", g_strerror(errsv));
+            break;
+        }
+        if(size == 0) /* EOF */
+            break;
+        if(first_block)
+        {
+            first_block = FALSE;
+            if(memchr(buf, '\0', MIN((gsize)size, BINARY_SNIFF_SIZE)))
+                break; /* binary file */
+        }
+        size += kept;
+        if(ascii_casefold ? _search_find_ascii_casefold(buf, size, priv->content_pattern, pattern_len)
+                          : _search_find(buf, size, priv->content_pattern, pattern_len))
+        {
+            ret = TRUE;
+            break;
+        }
+        /* the pattern might cross the chunks, so keep the last <pattern_len-1> bytes */
+        kept = MIN((gsize)size, pattern_len - 1);
+        memmove(buf, buf + size - kept, kept);
+    }
+    g_free(buf);
+    close(fd);
+    return ret;
+}
+
 static gboolean fm_search_job_match_content(FmVfsSearchEnumerator* priv,
                                             GFileInfo* info, GFile* parent,
                                             GCancellable* cancellable,
@@ -754,13 +1605,32 @@ static gboolean fm_search_job_match_content(FmVfsSearchEnumerator* priv,
     if(priv->content_pattern || priv->content_regex)
     {
         ret = FALSE;
-        if(g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR && g_file_info_get_size(info) > 0)
+        if(g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR && g_file_info_get_size(info) > 0 &&
+           !fm_search_job_skip_content(priv, info))
         {
             GFile* file = g_file_get_child(parent, g_file_info_get_name(info));
+            GFileInputStream * stream;
+            char* path;
+
+            /* Plain patterns in native files are searched without gio. A case
+             * insensitive pattern is only matched this way if it's ASCII,
+             * then the folding of ASCII letters gives the same result. */
+            if(priv->content_pattern && priv->content_pattern[0] &&
+               (!priv->content_case_insensitive || g_str_is_ascii(priv->content_pattern)) &&
+               (path = g_file_get_path(file)) != NULL)
+            {
+                g_object_unref(file);
+                ret = fm_search_job_match_content_native(priv, path,
+                                                         priv->content_case_insensitive,
+                                                         cancellable, error);
+                g_free(path);
+                return ret;
+            }
+
             /* NOTE: I disabled mmap-based search since this could cause
              * unexpected crashes sometimes if the mapped files are
              * removed or changed during the search. */
-            GFileInputStream * stream = g_file_read(file, cancellable, error);
+            stream = g_file_read(file, cancellable, error);
             g_object_unref(file);
 
             if(stream)
@@ -855,17 +1725,16 @@ static gboolean fm_search_job_match_mtime(FmVfsSearchEnumerator* priv, GFileInfo
     return ret;
 }
 
+/* the rules which only need the file info, the content is matched separately */
 static gboolean fm_search_job_match_file(FmVfsSearchEnumerator * priv,
-                                         GFileInfo * info, GFile * parent,
-                                         GCancellable *cancellable,
-                                         GError **error)
+                                         GFileInfo * info)
 {
     //g_print("matching file %s\n", g_file_info_get_name(info));
 
     if(!priv->show_hidden && g_file_info_get_is_hidden(info))
         return FALSE;
 
-    if(!fm_search_job_match_filename(priv, info))
+    if(!fm_search_job_match_name(priv, g_file_info_get_name(info)))
         return FALSE;
 
     if(!fm_search_job_match_file_type(priv, info))
@@ -877,15 +1746,114 @@ static gboolean fm_search_job_match_file(FmVfsSearchEnumerator * priv,
     if(!fm_search_job_match_mtime(priv, info))
         return FALSE;
 
-    if(!fm_search_job_match_content(priv, info, parent, cancellable, error))
-        return FALSE;
-
     return TRUE;
 }
 
 
 /* end of rule functions */
 
+/* ---- Search backends ---- */
+G_LOCK_DEFINE_STATIC(backends);
+static GSList *backends = NULL; /* FmSearchBackend */
+
+static void _search_init_backends(void)
+{
+    static gsize inited = 0;
+
+    if(g_once_init_enter(&inited))
+    {
+        backends = g_slist_append(backends, (gpointer)&fm_search_name_index_backend);
+        backends = g_slist_append(backends, (gpointer)&fm_search_locate_backend);
+        g_once_init_leave(&inited, 1);
+    }
+}
+
+void fm_search_register_backend(const FmSearchBackend *backend)
+{
+    _search_init_backends();
+    G_LOCK(backends);
+    backends = g_slist_append(backends, (gpointer)backend);
+    G_UNLOCK(backends);
+}
+
+const FmSearchBackend *fm_search_find_backend(const char *name)
+{
+    const FmSearchBackend *backend = NULL;
+    GSList *l;
+
+    _search_init_backends();
+    G_LOCK(backends);
+    for(l = backends; l; l = l->next)
+    {
+        if(strcmp(((const FmSearchBackend *)l->data)->name, name) == 0)
+        {
+            backend = l->data;
+            break;
+        }
+    }
+    G_UNLOCK(backends);
+    return backend;
+}
+
+gboolean fm_search_query_get_recursive(const FmSearchQuery *query)
+{
+    return ((const FmVfsSearchEnumerator *)query)->recursive;
+}
+
+gboolean fm_search_query_get_show_hidden(const FmSearchQuery *query)
+{
+    return ((const FmVfsSearchEnumerator *)query)->show_hidden;
+}
+
+const char * const *fm_search_query_get_name_patterns(const FmSearchQuery *query)
+{
+    return (const char * const *)((const FmVfsSearchEnumerator *)query)->name_patterns;
+}
+
+GRegex *fm_search_query_get_name_regex(const FmSearchQuery *query)
+{
+    return ((const FmVfsSearchEnumerator *)query)->name_regex;
+}
+
+gboolean fm_search_query_get_name_ci(const FmSearchQuery *query)
+{
+    return ((const FmVfsSearchEnumerator *)query)->name_case_insensitive;
+}
+
+gboolean fm_search_query_has_name_rules(const FmSearchQuery *query)
+{
+    const FmVfsSearchEnumerator *priv = (const FmVfsSearchEnumerator *)query;
+    return priv->name_patterns || priv->name_regex;
+}
+
+gboolean fm_search_query_match_name(const FmSearchQuery *query, const char *name)
+{
+    return fm_search_job_match_name((FmVfsSearchEnumerator *)query, name);
+}
+
+static gboolean _search_index_filter(const char *name, gpointer user_data)
+{
+    return fm_search_query_match_name(user_data, name);
+}
+
+static gboolean _search_index_find_files(const FmSearchQuery *query, GFile *folder, GSList **files,
+                                         GCancellable *cancellable, gpointer user_data)
+{
+    /* the index only helps if the names are matched */
+    if(!fm_search_query_has_name_rules(query) || !g_file_is_native(folder))
+        return FALSE;
+    return fm_name_index_query(folder, fm_search_query_get_recursive(query),
+                               fm_search_query_get_show_hidden(query),
+                               _search_index_filter, (gpointer)query, files, cancellable);
+}
+
+const FmSearchBackend fm_search_name_index_backend =
+{
+    "index",
+    _search_index_find_files,
+    NULL
+};
+
 /* ---- FmSearchVFile class ---- */
 static void fm_search_g_file_init(GFileIface *iface);
 static void fm_search_fm_file_init(FmFileInterface *iface);
@@ -1,4 +1,5 @@
 #include "volumemanager.h"
+#include "filesystemcapabilities_p.h"
 
 namespace Fm {
 
@@ -6,22 +7,12 @@ std::mutex VolumeManager::mutex_;
 std::weak_ptr<VolumeManager> VolumeManager::globalInstance_;
 
 VolumeManager::VolumeManager():
-    QObject(),
-    monitor_{g_volume_monitor_get(), false} {
-
-    // connect gobject signal handlers
-    g_signal_connect(monitor_.get(), "volume-added", G_CALLBACK(_onGVolumeAdded), this);
-    g_signal_connect(monitor_.get(), "volume-removed", G_CALLBACK(_onGVolumeRemoved), this);
-    g_signal_connect(monitor_.get(), "volume-changed", G_CALLBACK(_onGVolumeChanged), this);
-
-    g_signal_connect(monitor_.get(), "mount-added", G_CALLBACK(_onGMountAdded), this);
-    g_signal_connect(monitor_.get(), "mount-removed", G_CALLBACK(_onGMountRemoved), this);
-    g_signal_connect(monitor_.get(), "mount-changed", G_CALLBACK(_onGMountChanged), this);
-
-    // g_get_volume_monitor() is a slow blocking call, so call it in a low priority thread
+    QObject() {
+    // g_get_volume_monitor() is a slow blocking call, which starts the volume monitors
+    // talking to udisks, so it's only called in a low priority thread
     auto job = new GetGVolumeMonitorJob();
     job->setAutoDelete(true);
-    connect(job, &GetGVolumeMonitorJob::finished, this, &VolumeManager::onGetGVolumeMonitorFinished, Qt::BlockingQueuedConnection);
+    connect(job, &GetGVolumeMonitorJob::finished, this, &VolumeManager::onGetGVolumeMonitorFinished, Qt::QueuedConnection);
     job->runAsync(QThread::LowPriority);
 }
 
@@ -44,6 +35,19 @@ std::shared_ptr<VolumeManager> VolumeManager::globalInstance() {
 void VolumeManager::onGetGVolumeMonitorFinished() {
     auto job = static_cast<GetGVolumeMonitorJob*>(sender());
     monitor_ = std::move(job->monitor_);
+    if(!monitor_) {
+        return;
+    }
+
+    // connect gobject signal handlers
+    g_signal_connect(monitor_.get(), "volume-added", G_CALLBACK(_onGVolumeAdded), this);
+    g_signal_connect(monitor_.get(), "volume-removed", G_CALLBACK(_onGVolumeRemoved), this);
+    g_signal_connect(monitor_.get(), "volume-changed", G_CALLBACK(_onGVolumeChanged), this);
+
+    g_signal_connect(monitor_.get(), "mount-added", G_CALLBACK(_onGMountAdded), this);
+    g_signal_connect(monitor_.get(), "mount-removed", G_CALLBACK(_onGMountRemoved), this);
+    g_signal_connect(monitor_.get(), "mount-changed", G_CALLBACK(_onGMountChanged), this);
+
     GList* vols = g_volume_monitor_get_volumes(monitor_.get());
     for(GList* l = vols; l != nullptr; l = l->next) {
         volumes_.push_back(Volume{G_VOLUME(l->data), false});
@@ -92,6 +96,8 @@ void VolumeManager::onGMountRemoved(GMount* mnt) {
     auto it = std::find(mounts_.begin(), mounts_.end(), mnt);
     if(it == mounts_.end())
         return;
+    // the device number of the filesystem might be reused by another one
+    FileSystemCapabilities::clear();
     Q_EMIT mountRemoved(*it);
     mounts_.erase(it);
 }
@@ -100,6 +106,8 @@ void VolumeManager::onGMountChanged(GMount* mnt) {
     auto it = std::find(mounts_.begin(), mounts_.end(), mnt);
     if(it == mounts_.end())
         return;
+    // it might be remounted read-only or read-write
+    FileSystemCapabilities::clear();
     Q_EMIT mountChanged(*it);
 }
 
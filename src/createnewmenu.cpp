@@ -56,7 +56,8 @@ CreateNewMenu::CreateNewMenu(QWidget* dialogParent, Fm::FilePath dirPath, QWidge
     dialogParent_(dialogParent),
     dirPath_(std::move(dirPath)),
     templateSeparator_{nullptr},
-    templates_{Templates::globalInstance()} {
+    templates_{Templates::globalInstance()},
+    templatesAdded_{false} {
 
     QAction* action = new QAction(QIcon::fromTheme("folder-new"), tr("Folder"), this);
     connect(action, &QAction::triggered, this, &CreateNewMenu::onCreateNewFolder);
@@ -66,13 +67,8 @@ CreateNewMenu::CreateNewMenu(QWidget* dialogParent, Fm::FilePath dirPath, QWidge
     connect(action, &QAction::triggered, this, &CreateNewMenu::onCreateNewFile);
     addAction(action);
 
-    // add more items to "Create New" menu from templates
-    connect(templates_.get(), &Templates::itemAdded, this, &CreateNewMenu::addTemplateItem);
-    connect(templates_.get(), &Templates::itemChanged, this, &CreateNewMenu::updateTemplateItem);
-    connect(templates_.get(), &Templates::itemRemoved, this, &CreateNewMenu::removeTemplateItem);
-    templates_->forEachItem([this](const std::shared_ptr<const TemplateItem>& item) {
-        addTemplateItem(item);
-    });
+    // the templates are loaded and added when the menu is shown for the first time
+    connect(this, &QMenu::aboutToShow, this, &CreateNewMenu::onAboutToShow);
 }
 
 CreateNewMenu::~CreateNewMenu() {
@@ -97,6 +93,21 @@ void CreateNewMenu::onCreateNew() {
     }
 }
 
+void CreateNewMenu::onAboutToShow() {
+    if(templatesAdded_) {
+        return;
+    }
+    templatesAdded_ = true;
+    // add more items to "Create New" menu from templates
+    connect(templates_.get(), &Templates::itemAdded, this, &CreateNewMenu::addTemplateItem);
+    connect(templates_.get(), &Templates::itemChanged, this, &CreateNewMenu::updateTemplateItem);
+    connect(templates_.get(), &Templates::itemRemoved, this, &CreateNewMenu::removeTemplateItem);
+    for(auto& item : *templates_->itemsSnapshot()) {
+        addTemplateItem(item);
+    }
+    templates_->load();
+}
+
 void CreateNewMenu::addTemplateItem(const std::shared_ptr<const TemplateItem> &item) {
     if(!templateSeparator_) {
         templateSeparator_= addSeparator();
@@ -52,11 +52,14 @@ private Q_SLOTS:
 
     void removeTemplateItem(const std::shared_ptr<const TemplateItem>& item);
 
+    void onAboutToShow();
+
 private:
     QWidget* dialogParent_;
     Fm::FilePath dirPath_;
     QAction* templateSeparator_;
     std::shared_ptr<Templates> templates_;
+    bool templatesAdded_;
 };
 
 }
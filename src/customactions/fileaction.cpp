@@ -1,6 +1,14 @@
 #include "fileaction.h"
+#include "fileactiondata.h"
 #include <unordered_map>
+#include <mutex>
+#include <vector>
 #include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -9,6 +17,23 @@ namespace Fm {
 static const char* desktop_env = nullptr; // current desktop environment
 static bool actions_loaded = false; // all actions are loaded?
 static unordered_map<const char*, shared_ptr<FileActionObject>, CStrHash, CStrEqual> all_actions; // cache all loaded actions
+// the actions are loaded and matched by the menus in worker threads too, and the matching caches some data in them
+static std::mutex actions_mutex;
+
+// The parsed actions are saved in a cache file, so the desktop files are not parsed again
+// unless one of the dirs or the desktop files of the actions is changed. The version should be
+// increased when the saved data is changed.
+static const char actionsCacheMagic[] = "FMACTIONS";
+static const quint32 actionsCacheVersion = 2;
+
+// a dir or a desktop file which the actions are loaded from, to check if the cache is outdated.
+// The files are checked too, since editing a file in place doesn't change the mtime of its dir.
+struct ActionSource {
+    std::string path;
+    qint64 mtime; // -1 if the file doesn't exist
+    qint64 mtimeNsec;
+    qint64 size;
+};
 
 FileActionObject::FileActionObject() {
 }
@@ -32,6 +57,31 @@ FileActionObject::FileActionObject(GKeyFile* kf) {
     has_parent = false;
 }
 
+FileActionObject::FileActionObject(QDataStream& in) {
+    id = read_str(in);
+    name = read_str(in);
+    tooltip = read_str(in);
+    icon = read_str(in);
+    desc = read_str(in);
+    in >> enabled >> hidden;
+    suggested_shortcut = read_str(in);
+
+    condition = unique_ptr<FileActionCondition> {new FileActionCondition(in)};
+
+    has_parent = false;
+}
+
+void FileActionObject::save(QDataStream& out) const {
+    write_str(out, id.get());
+    write_str(out, name.get());
+    write_str(out, tooltip.get());
+    write_str(out, icon.get());
+    write_str(out, desc.get());
+    out << enabled << hidden;
+    write_str(out, suggested_shortcut.get());
+    condition->save(out);
+}
+
 FileActionObject::~FileActionObject() {
 }
 
@@ -302,17 +352,40 @@ FileAction::FileAction(GKeyFile* kf): FileActionObject{kf}, target{FILE_ACTION_T
     }
 }
 
-std::shared_ptr<FileActionProfile> FileAction::match(const FileInfoList& files) const {
+FileAction::FileAction(QDataStream& in): FileActionObject{in} {
+    type = FileActionType::ACTION;
+    qint32 targets;
+    quint32 n_profiles;
+    in >> targets;
+    target = targets;
+    toolbar_label = read_str(in);
+    in >> n_profiles;
+    for(quint32 i = 0; i < n_profiles && in.status() == QDataStream::Ok; ++i) {
+        profiles.push_back(make_shared<FileActionProfile>(in));
+    }
+}
+
+void FileAction::save(QDataStream& out) const {
+    FileActionObject::save(out);
+    out << qint32(target);
+    write_str(out, toolbar_label.get());
+    out << quint32(profiles.size());
+    for(const auto& profile : profiles) {
+        profile->save(out);
+    }
+}
+
+std::shared_ptr<FileActionProfile> FileAction::match(const FileActionSelection& selection) const {
     //qDebug() << "FileAction.match: " << id.get();
     if(hidden || !enabled) {
         return nullptr;
     }
 
-    if(!condition->match(files)) {
+    if(!condition->match(selection)) {
         return nullptr;
     }
     for(const auto& profile : profiles) {
-        if(profile->match(files)) {
+        if(profile->match(selection)) {
             //qDebug() << "  profile matched!\n\n";
             return profile;
         }
@@ -326,12 +399,22 @@ FileActionMenu::FileActionMenu(GKeyFile* kf): FileActionObject{kf} {
     items_list = CStrArrayPtr{g_key_file_get_string_list(kf, "Desktop Entry", "ItemsList", nullptr, nullptr)};
 }
 
-bool FileActionMenu::match(const FileInfoList& files) const {
+FileActionMenu::FileActionMenu(QDataStream& in): FileActionObject{in} {
+    type = FileActionType::MENU;
+    items_list = read_str_list(in);
+}
+
+void FileActionMenu::save(QDataStream& out) const {
+    FileActionObject::save(out);
+    write_str_list(out, items_list.get());
+}
+
+bool FileActionMenu::match(const FileActionSelection& selection) const {
     // stdout.printf("FileActionMenu.match: %s\n", id);
     if(hidden || !enabled) {
         return false;
     }
-    if(!condition->match(files)) {
+    if(!condition->match(selection)) {
         return false;
     }
     // stdout.printf("menu matched!: %s\n\n", id);
@@ -371,12 +454,12 @@ void FileActionMenu::cache_children(const FileInfoList& files, const char** item
     }
 }
 
-std::shared_ptr<FileActionItem> FileActionItem::fromActionObject(std::shared_ptr<FileActionObject> action_obj, const FileInfoList& files) {
+std::shared_ptr<FileActionItem> FileActionItem::fromActionObject(std::shared_ptr<FileActionObject> action_obj, const FileActionSelection& selection) {
     std::shared_ptr<FileActionItem> item;
     if(action_obj->type == FileActionType::MENU) {
         auto menu = static_pointer_cast<FileActionMenu>(action_obj);
-        if(menu->match(files)) {
-            item = make_shared<FileActionItem>(menu, files);
+        if(menu->match(selection)) {
+            item = make_shared<FileActionItem>(menu, selection);
             // eliminate empty menus
             if(item->children.empty()) {
                 item = nullptr;
@@ -386,9 +469,9 @@ std::shared_ptr<FileActionItem> FileActionItem::fromActionObject(std::shared_ptr
     else {
         // handle profiles here
         auto action = static_pointer_cast<FileAction>(action_obj);
-        auto profile = action->match(files);
+        auto profile = action->match(selection);
         if(profile) {
-            item = make_shared<FileActionItem>(action, profile, files);
+            item = make_shared<FileActionItem>(action, profile, selection.files());
         }
     }
     return item;
@@ -399,14 +482,14 @@ FileActionItem::FileActionItem(std::shared_ptr<FileAction> _action, std::shared_
     profile = _profile;
 }
 
-FileActionItem::FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileInfoList& files):
-    FileActionItem{static_pointer_cast<FileActionObject>(menu), files} {
+FileActionItem::FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileActionSelection& selection):
+    FileActionItem{static_pointer_cast<FileActionObject>(menu), selection.files()} {
     for(auto& action_obj : menu->cached_children) {
         if(action_obj == nullptr) { // separator
             children.push_back(nullptr);
         }
         else { // action item or menu
-            auto subitem = fromActionObject(action_obj, files);
+            auto subitem = fromActionObject(action_obj, selection);
             if(subitem != nullptr) {
                 children.push_back(subitem);
             }
@@ -431,8 +514,21 @@ bool FileActionItem::launch(GAppLaunchContext* ctx, const FileInfoList& files, C
     return false;
 }
 
-static void load_actions_from_dir(const char* dirname, const char* id_prefix) {
+static ActionSource stat_action_source(const char* path) {
+    ActionSource source{path, -1, 0, 0};
+    struct stat st;
+    if(stat(path, &st) == 0) {
+        source.mtime = st.st_mtim.tv_sec;
+        source.mtimeNsec = st.st_mtim.tv_nsec;
+        source.size = st.st_size;
+    }
+    return source;
+}
+
+static void load_actions_from_dir(const char* dirname, const char* id_prefix, std::vector<ActionSource>& sources) {
     //qDebug() << "loading from: " << dirname << endl;
+    // the dir is checked before it's read, so the changes made meanwhile invalidate the cache
+    sources.push_back(stat_action_source(dirname));
     auto dir = g_dir_open(dirname, 0, nullptr);
     if(dir != nullptr) {
         for(;;) {
@@ -451,7 +547,7 @@ static void load_actions_from_dir(const char* dirname, const char* id_prefix) {
                 if(id_prefix) {
                     new_id_prefix = CStrPtr{g_strconcat(id_prefix, "-", name, nullptr)};
                 }
-                load_actions_from_dir(full_path.get(), id_prefix ? new_id_prefix.get() : name);
+                load_actions_from_dir(full_path.get(), id_prefix ? new_id_prefix.get() : name, sources);
             }
             else if(g_str_has_suffix(name, ".desktop")) {
                 CStrPtr new_id_prefix;
@@ -461,10 +557,13 @@ static void load_actions_from_dir(const char* dirname, const char* id_prefix) {
                 const char* id = id_prefix ? new_id_prefix.get() : name;
                 // ensure that it's not already in the cache
                 if(all_actions.find(id) == all_actions.cend()) {
+                    // the file is checked before it's parsed, like the dirs
+                    sources.push_back(stat_action_source(full_path.get()));
                     auto kf = g_key_file_new();
                     if(g_key_file_load_from_file(kf, full_path.get(), G_KEY_FILE_NONE, nullptr)) {
                         auto type = CStrPtr{g_key_file_get_string(kf, "Desktop Entry", "Type", nullptr)};
                         if(!type) {
+                            g_key_file_free(kf);
                             continue;
                         }
                         std::shared_ptr<FileActionObject> action;
@@ -477,6 +576,7 @@ static void load_actions_from_dir(const char* dirname, const char* id_prefix) {
                             // stdout.printf("load menu: %s\n", id);
                         }
                         else {
+                            g_key_file_free(kf);
                             continue;
                         }
                         action->setId(id);
@@ -498,15 +598,135 @@ void file_actions_set_desktop_env(const char* env) {
     desktop_env = env;
 }
 
+static std::string actions_cache_path() {
+    CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "actions.cache", nullptr)};
+    return path.get();
+}
+
+// what the cache depends on besides the dirs, since the localized strings are saved
+static std::string actions_cache_key(const std::vector<std::string>& top_dirs) {
+    std::string key;
+    for(auto lang = g_get_language_names(); *lang; ++lang) {
+        key += *lang;
+        key += ':';
+    }
+    for(const auto& dir : top_dirs) {
+        key += '\n';
+        key += dir;
+    }
+    return key;
+}
+
+static bool load_actions_cache(const std::vector<std::string>& top_dirs) {
+    QFile file{QString::fromLocal8Bit(actions_cache_path().c_str())};
+    if(!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    auto data = file.map(0, file.size());
+    if(!data) {
+        return false;
+    }
+    QDataStream in{QByteArray::fromRawData(reinterpret_cast<const char*>(data), file.size())};
+    in.setVersion(QDataStream::Qt_5_0);
+    char magic[sizeof(actionsCacheMagic)];
+    quint32 version;
+    if(in.readRawData(magic, sizeof(magic)) != int(sizeof(magic))
+            || memcmp(magic, actionsCacheMagic, sizeof(magic)) != 0) {
+        return false;
+    }
+    in >> version;
+    auto key = read_str(in);
+    if(version != actionsCacheVersion || !key || actions_cache_key(top_dirs) != key.get()) {
+        return false;
+    }
+    // the cache is outdated if any dir or desktop file of the actions is changed
+    quint32 n_sources;
+    in >> n_sources;
+    for(quint32 i = 0; i < n_sources; ++i) {
+        auto path = read_str(in);
+        qint64 mtime, mtime_nsec, size;
+        in >> mtime >> mtime_nsec >> size;
+        if(!path || in.status() != QDataStream::Ok) {
+            return false;
+        }
+        auto source = stat_action_source(path.get());
+        if(source.mtime != mtime || (mtime >= 0 && (source.mtimeNsec != mtime_nsec || source.size != size))) {
+            return false;
+        }
+    }
+
+    quint32 n_actions;
+    in >> n_actions;
+    for(quint32 i = 0; i < n_actions && in.status() == QDataStream::Ok; ++i) {
+        quint8 type;
+        in >> type;
+        std::shared_ptr<FileActionObject> action;
+        if(type == quint8(FileActionType::ACTION)) {
+            action = static_pointer_cast<FileActionObject>(make_shared<FileAction>(in));
+        }
+        else if(type == quint8(FileActionType::MENU)) {
+            action = static_pointer_cast<FileActionObject>(make_shared<FileActionMenu>(in));
+        }
+        else {
+            break;
+        }
+        if(in.status() == QDataStream::Ok && action->id) {
+            all_actions.insert(make_pair(action->id.get(), action));
+        }
+    }
+    if(in.status() != QDataStream::Ok || !in.atEnd()) {
+        all_actions.clear();
+        return false;
+    }
+    return true;
+}
+
+static void save_actions_cache(const std::vector<std::string>& top_dirs, const std::vector<ActionSource>& sources) {
+    QString path = QString::fromLocal8Bit(actions_cache_path().c_str());
+    QDir().mkpath(QFileInfo{path}.absolutePath());
+    QSaveFile file{path};
+    if(!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out{&file};
+    out.setVersion(QDataStream::Qt_5_0);
+    out.writeRawData(actionsCacheMagic, sizeof(actionsCacheMagic));
+    out << actionsCacheVersion;
+    write_str(out, actions_cache_key(top_dirs).c_str());
+    out << quint32(sources.size());
+    for(const auto& source : sources) {
+        write_str(out, source.path.c_str());
+        out << source.mtime << source.mtimeNsec << source.size;
+    }
+    out << quint32(all_actions.size());
+    for(const auto& item : all_actions) {
+        out << quint8(item.second->type);
+        item.second->save(out);
+    }
+    if(!file.commit()) {
+        qWarning("failed to save the cache of the custom actions");
+    }
+}
+
 static void load_all_actions() {
     all_actions.clear();
+    std::vector<std::string> top_dirs;
     auto dirs = g_get_system_data_dirs();
     for(auto dir = dirs; *dir; ++dir) {
         CStrPtr dir_path{g_build_filename(*dir, "file-manager/actions", nullptr)};
-        load_actions_from_dir(dir_path.get(), nullptr);
+        top_dirs.emplace_back(dir_path.get());
     }
     CStrPtr dir_path{g_build_filename(g_get_user_data_dir(), "file-manager/actions", nullptr)};
-    load_actions_from_dir(dir_path.get(), nullptr);
+    top_dirs.emplace_back(dir_path.get());
+
+    // parse the desktop files only if the cache is outdated
+    if(!load_actions_cache(top_dirs)) {
+        std::vector<ActionSource> sources;
+        for(const auto& dir : top_dirs) {
+            load_actions_from_dir(dir.c_str(), nullptr, sources);
+        }
+        save_actions_cache(top_dirs, sources);
+    }
     actions_loaded = true;
 }
 
@@ -566,6 +786,7 @@ bool FileActionItem::compare_items(std::shared_ptr<const FileActionItem> a, std:
 }
 
 FileActionItemList FileActionItem::get_actions_for_files(const FileInfoList& files) {
+    std::lock_guard<std::mutex> lock{actions_mutex};
     if(!actions_loaded) {
         load_all_actions();
     }
@@ -586,12 +807,32 @@ FileActionItemList FileActionItem::get_actions_for_files(const FileInfoList& fil
 
     // Output the menus
     FileActionItemList items;
+    // the selection is examined once for all the actions
+    FileActionSelection selection{files};
+
+    // run the commands of all the conditions in parallel first, so a slow one doesn't delay the others
+    std::vector<std::string> checks;
+    for(auto& item : all_actions) {
+        auto& action_obj = item.second;
+        if(action_obj->hidden || !action_obj->enabled) {
+            continue;
+        }
+        action_obj->condition->collect_checks(selection, checks);
+        if(action_obj->type == FileActionType::ACTION) {
+            for(auto& profile : static_pointer_cast<FileAction>(action_obj)->profiles) {
+                profile->condition->collect_checks(selection, checks);
+            }
+        }
+    }
+    if(!checks.empty()) {
+        FileActionCondition::run_checks(checks);
+    }
 
     for(auto& item : all_actions) {
         auto& action_obj = item.second;
         // only output toplevel items here
         if(action_obj->has_parent == false) { // this is a toplevel item
-            auto item = FileActionItem::fromActionObject(action_obj, files);
+            auto item = FileActionItem::fromActionObject(action_obj, selection);
             if(item != nullptr) {
                 items.push_back(item);
             }
@@ -31,8 +31,13 @@ public:
 
     explicit FileActionObject(GKeyFile* kf);
 
+    // load the object saved in the cache of the actions by save()
+    explicit FileActionObject(QDataStream& in);
+
     virtual ~FileActionObject();
 
+    virtual void save(QDataStream& out) const;
+
     void setId(const char* _id) {
         id = CStrPtr{g_strdup(_id)};
     }
@@ -62,7 +67,11 @@ public:
 
     FileAction(GKeyFile* kf);
 
-    std::shared_ptr<FileActionProfile> match(const FileInfoList& files) const;
+    explicit FileAction(QDataStream& in);
+
+    void save(QDataStream& out) const override;
+
+    std::shared_ptr<FileActionProfile> match(const FileActionSelection& selection) const;
 
     int target; // bitwise or of FileActionTarget
     CStrPtr toolbar_label;
@@ -77,7 +86,11 @@ public:
 
     FileActionMenu(GKeyFile* kf);
 
-    bool match(const FileInfoList &files) const;
+    explicit FileActionMenu(QDataStream& in);
+
+    void save(QDataStream& out) const override;
+
+    bool match(const FileActionSelection& selection) const;
 
     // called during menu generation
     void cache_children(const FileInfoList &files, const char** items_list);
@@ -92,11 +105,11 @@ public:
 class FileActionItem {
 public:
 
-    static std::shared_ptr<FileActionItem> fromActionObject(std::shared_ptr<FileActionObject> action_obj, const FileInfoList &files);
+    static std::shared_ptr<FileActionItem> fromActionObject(std::shared_ptr<FileActionObject> action_obj, const FileActionSelection& selection);
 
     FileActionItem(std::shared_ptr<FileAction> _action, std::shared_ptr<FileActionProfile> _profile, const FileInfoList& files);
 
-    FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileInfoList& files);
+    FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileActionSelection& selection);
 
     FileActionItem(std::shared_ptr<FileActionObject> _action, const FileInfoList& files);
 
@@ -138,6 +151,7 @@ public:
     }
 
     static bool compare_items(std::shared_ptr<const FileActionItem> a, std::shared_ptr<const FileActionItem> b);
+    // It can be called in any thread. The calls are serialized, and they run the commands of the conditions.
     static std::vector<std::shared_ptr<const FileActionItem>> get_actions_for_files(const FileInfoList& files);
 
     std::string name;
@@ -1,12 +1,96 @@
 #include "fileactioncondition.h"
 #include "fileaction.h"
+#include "fileactiondata.h"
 #include <string>
+#include <algorithm>
+#include <unordered_set>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <QtGlobal>
 
 
 using namespace std;
 
 namespace Fm {
 
+// the programs of TryExec are looked up again if the result is older than this
+static const gint64 tryExecRecheckTime = 10 * G_USEC_PER_SEC;
+// the results of ShowIfTrue and ShowIfRunning are reused for a short time
+static const gint64 checkCacheTime = 5 * G_USEC_PER_SEC;
+// the commands of the checks which don't exit in time are killed
+static const gint64 checkTimeout = G_USEC_PER_SEC;
+
+std::unordered_map<std::string, FileActionCondition::TryExecResult> FileActionCondition::try_exec_results_;
+std::mutex FileActionCondition::check_mutex_;
+std::unordered_map<std::string, FileActionCondition::CheckResult> FileActionCondition::check_results_;
+
+// whether all the values match, or whether any value matches
+template <typename Value, typename Predicate>
+static bool match_values(const std::vector<Value>& values, bool all, Predicate pred) {
+    return all ? std::all_of(values.cbegin(), values.cend(), pred)
+               : std::any_of(values.cbegin(), values.cend(), pred);
+}
+
+FileActionSelection::FileActionSelection(const FileInfoList& files):
+    files_{files},
+    dirCount_{0} {
+    std::unordered_set<const MimeType*> mimeTypes;
+    std::unordered_set<std::string> schemes;
+    std::unordered_set<std::string> folders;
+    auto addFolder = [&](const FilePath& folder, const FilePath& file) {
+        auto folder_str = string(folder.toString().get()) + "/";
+        if(folders.insert(folder_str).second) {
+            folders_.emplace_back(std::move(folder_str));
+            // the files in the same folder have the same scheme
+            CStrPtr scheme{file.uriScheme()};
+            if(scheme && schemes.insert(scheme.get()).second) {
+                schemes_.emplace_back(scheme.get());
+            }
+        }
+    };
+    FilePath lastDir;
+    for(auto& fi: files) {
+        const auto& mimeType = fi->mimeType();
+        if(mimeTypes.insert(mimeType.get()).second) {
+            mimeTypes_.push_back(mimeType->name());
+        }
+        if(fi->isDir()) { // the dir itself is also matched by Folders
+            ++dirCount_;
+            addFolder(fi->path(), fi->path());
+        }
+        else if(!lastDir || lastDir != fi->dirPath()) {
+            // the files of a selection are usually in one folder
+            lastDir = fi->dirPath() ? fi->dirPath() : fi->path().parent();
+            addFolder(lastDir, fi->path());
+        }
+    }
+}
+
+const std::vector<const char*>& FileActionSelection::names() const {
+    if(names_.empty()) {
+        names_.reserve(files_.size());
+        for(auto& fi: files_) {
+            names_.push_back(fi->name().c_str());
+        }
+    }
+    return names_;
+}
+
+const std::vector<const char*>& FileActionSelection::casefoldedNames() const {
+    if(casefoldedNames_.empty()) {
+        casefoldedNameStrs_.reserve(files_.size());
+        casefoldedNames_.reserve(files_.size());
+        for(auto& fi: files_) {
+            casefoldedNameStrs_.emplace_back(g_utf8_casefold(fi->name().c_str(), -1));
+            casefoldedNames_.push_back(casefoldedNameStrs_.back().get());
+        }
+    }
+    return casefoldedNames_;
+}
+
 FileActionCondition::FileActionCondition(GKeyFile *kf, const char* group) {
     only_show_in = CStrArrayPtr{g_key_file_get_string_list(kf, group, "OnlyShowIn", nullptr, nullptr)};
     not_show_in = CStrArrayPtr{g_key_file_get_string_list(kf, group, "NotShowIn", nullptr, nullptr)};
@@ -44,23 +128,147 @@ FileActionCondition::FileActionCondition(GKeyFile *kf, const char* group) {
 
     // FIXME: implement Capabilities support
 
+    compile_all_rules();
+}
+
+FileActionCondition::FileActionCondition(QDataStream& in) {
+    only_show_in = read_str_list(in);
+    not_show_in = read_str_list(in);
+    try_exec = read_str(in);
+    show_if_registered = read_str(in);
+    show_if_true = read_str(in);
+    show_if_running = read_str(in);
+    mime_types = read_str_list(in);
+    base_names = read_str_list(in);
+    qint8 cmp;
+    qint32 count;
+    in >> match_case >> cmp >> count;
+    selection_count_cmp = cmp;
+    selection_count = count;
+    schemes = read_str_list(in);
+    folders = read_str_list(in);
+
+    compile_all_rules();
+}
+
+void FileActionCondition::save(QDataStream& out) const {
+    write_str_list(out, only_show_in.get());
+    write_str_list(out, not_show_in.get());
+    write_str(out, try_exec.get());
+    write_str(out, show_if_registered.get());
+    write_str(out, show_if_true.get());
+    write_str(out, show_if_running.get());
+    write_str_list(out, mime_types.get());
+    write_str_list(out, base_names.get());
+    out << match_case << qint8(selection_count_cmp) << qint32(selection_count);
+    write_str_list(out, schemes.get());
+    write_str_list(out, folders.get());
+}
+
+void FileActionCondition::compile_all_rules() {
+    // parse the rules once, instead of each time a menu is built
+    mime_type_rules_ = compile_rules(mime_types.get(), [](Rule& rule, const char* type) {
+        if(strcmp(type, "all/all") == 0 || strcmp(type, "*") == 0) {
+            rule.kind = Rule::ALL;
+        }
+        else if(strcmp(type, "all/allfiles") == 0) {
+            rule.kind = Rule::ALL_FILES;
+        }
+        else if(g_str_has_suffix(type, "/*")) {
+            rule.kind = Rule::PREFIX;
+            rule.value.erase(rule.value.length() - 1); // remove the last char
+        }
+    });
+    bool base_name_case = match_case;
+    base_name_rules_ = compile_rules(base_names.get(), [base_name_case](Rule& rule, const char* base_name) {
+        if(strcmp(base_name, "*") == 0) {
+            rule.kind = Rule::ALL;
+        }
+        else if(base_name_case) {
+            rule.kind = Rule::PATTERN;
+            rule.pattern.reset(g_pattern_spec_new(base_name));
+        }
+        else {
+            rule.kind = Rule::PATTERN;
+            CStrPtr case_fold{g_utf8_casefold(base_name, -1)};
+            rule.pattern.reset(g_pattern_spec_new(case_fold.get()));    // FIXME: is this correct?
+        }
+    });
+    scheme_rules_ = compile_rules(schemes.get(), [](Rule& /*rule*/, const char* /*scheme*/) {
+    });
+    folder_rules_ = compile_rules(folders.get(), [](Rule& rule, const char* folder) {
+        // trailing /* should always be implied.
+        rule.kind = Rule::PATTERN;
+        if(g_str_has_suffix(folder, "/*")) {
+            rule.pattern.reset(g_pattern_spec_new(folder));
+        }
+        else {
+            auto pat_str = g_str_has_suffix(folder, "/") ? string(folder) + "*" // be tolerant
+                                                         : string(folder) + "/*";
+            rule.pattern.reset(g_pattern_spec_new(pat_str.c_str()));
+        }
+    });
+}
+
+// static
+FileActionCondition::RuleList FileActionCondition::compile_rules(char** strs, const std::function<void (Rule& rule, const char* str)>& compile) {
+    RuleList rules;
+    if(strs != nullptr) {
+        for(auto it = strs; *it; ++it) {
+            const char* str = *it;
+            Rule rule;
+            rule.negated = (str[0] == '!');
+            if(rule.negated) {
+                ++str;
+            }
+            rule.kind = Rule::EXACT;
+            rule.value = str;
+            compile(rule, str);
+            rules.emplace_back(std::move(rule));
+        }
+    }
+    return rules;
+}
+
+// static
+template <typename Matcher>
+bool FileActionCondition::match_rules(const RuleList& rules, Matcher matches) {
+    bool allowed = false;
+    for(auto& rule: rules) {
+        if(rule.negated) { // negated rules are ANDed, so any file matching one is not allowed
+            if(matches(rule, false)) {
+                return false;
+            }
+        }
+        else if(!allowed) { // matching any one of the other rules is enough
+            allowed = matches(rule, true);
+        }
+    }
+    return allowed;
 }
 
-bool FileActionCondition::match_try_exec(const FileInfoList& files) {
+bool FileActionCondition::match_try_exec(const FileActionSelection& selection) {
     if(try_exec != nullptr) {
-        // stdout.printf("    TryExec: %s\n", try_exec);
-        CStrPtr exec_path{g_find_program_in_path(FileActionObject::expand_str(try_exec.get(), files).c_str())};
-        if(!g_file_test(exec_path.get(), G_FILE_TEST_IS_EXECUTABLE)) {
+        // many actions check the same programs, so the results are shared
+        auto exec = FileActionObject::expand_str(try_exec.get(), selection.files());
+        auto now = g_get_monotonic_time();
+        auto& result = try_exec_results_[exec];
+        if(result.time == 0 || now - result.time > tryExecRecheckTime) {
+            CStrPtr exec_path{g_find_program_in_path(exec.c_str())};
+            result.found = exec_path && g_file_test(exec_path.get(), G_FILE_TEST_IS_EXECUTABLE);
+            result.time = now;
+        }
+        if(!result.found) {
             return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_show_if_registered(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_registered(const FileActionSelection& selection) {
     if(show_if_registered != nullptr) {
         // stdout.printf("    ShowIfRegistered: %s\n", show_if_registered);
-        auto service = FileActionObject::expand_str(show_if_registered.get(), files);
+        auto service = FileActionObject::expand_str(show_if_registered.get(), selection.files());
         // References:
         // http://people.freedesktop.org/~david/eggdbus-20091014/eggdbus-interface-org.freedesktop.DBus.html#eggdbus-method-org.freedesktop.DBus.NameHasOwner
         // glib source code: gio/tests/gdbus-names.c
@@ -85,356 +293,210 @@ bool FileActionCondition::match_show_if_registered(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_show_if_true(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_true(const FileActionSelection& selection) {
     if(show_if_true != nullptr) {
-        auto cmd = FileActionObject::expand_str(show_if_true.get(), files);
-        int exit_status;
-        // FIXME: Process.spawn cannot handle shell commands. Use Posix.system() instead.
-        //if(!Process.spawn_command_line_sync(cmd, nullptr, nullptr, out exit_status)
-        //	|| exit_status != 0)
-        //	return false;
-        exit_status = system(cmd.c_str());
-        if(exit_status != 0) {
+        if(!check(show_if_true_check(selection))) {
             return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_show_if_running(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_running(const FileActionSelection& selection) {
     if(show_if_running != nullptr) {
-        auto process_name = FileActionObject::expand_str(show_if_running.get(), files);
-        CStrPtr pgrep{g_find_program_in_path("pgrep")};
-        bool running = false;
-        // pgrep is not fully portable, but we don't have better options here
-        if(pgrep != nullptr) {
-            int exit_status;
-            // cmd = "$pgrep -x '$process_name'"
-            string cmd = pgrep.get();
-            cmd += " -x \'";
-            cmd += process_name;
-            cmd += "\'";
-            if(g_spawn_command_line_sync(cmd.c_str(), nullptr, nullptr, &exit_status, nullptr)) {
-                if(exit_status == 0) {
-                    running = true;
-                }
-            }
-        }
-        if(!running) {
+        if(!check(show_if_running_check(selection))) {
             return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_mime_type(const FileInfoList& files, const char* type, bool negated) {
-    // stdout.printf("match_mime_type: %s, neg: %d\n", type, (int)negated);
+std::string FileActionCondition::show_if_true_check(const FileActionSelection& selection) const {
+    return 't' + FileActionObject::expand_str(show_if_true.get(), selection.files());
+}
 
-    if(strcmp(type, "all/all") == 0 || strcmp(type, "*") == 0) {
-        return negated ? false : true;
-    }
-    else if(strcmp(type, "all/allfiles") == 0) {
-        // see if all fileinfos are files
-        if(negated) { // all fileinfos should not be files
-            for(auto& fi: files) {
-                if(!fi->isDir()) { // at least 1 of the fileinfos is a file.
-                    return false;
-                }
-            }
-        }
-        else { // all fileinfos should be files
-            for(auto& fi: files) {
-                if(fi->isDir()) { // at least 1 of the fileinfos is a file.
-                    return false;
-                }
-            }
-        }
+std::string FileActionCondition::show_if_running_check(const FileActionSelection& selection) const {
+    return 'r' + FileActionObject::expand_str(show_if_running.get(), selection.files());
+}
+
+void FileActionCondition::collect_checks(const FileActionSelection& selection, std::vector<std::string>& checks) {
+    if((show_if_true == nullptr && show_if_running == nullptr) || !match_static(selection)) {
+        return;
     }
-    else if(g_str_has_suffix(type, "/*")) {
-        // check if all are subtypes of allowed_type
-        string prefix{type};
-        prefix.erase(prefix.length() - 1); // remove the last char
-        if(negated) { // all files should not have the prefix
-            for(auto& fi: files) {
-                if(g_str_has_prefix(fi->mimeType()->name(), prefix.c_str())) {
-                    return false;
-                }
-            }
-        }
-        else { // all files should have the prefix
-            for(auto& fi: files) {
-                if(!g_str_has_prefix(fi->mimeType()->name(), prefix.c_str())) {
-                    return false;
-                }
-            }
-        }
+    std::string keys[2];
+    if(show_if_true != nullptr) {
+        keys[0] = show_if_true_check(selection);
     }
-    else {
-        if(negated) { // all files should not be of the type
-            for(auto& fi: files) {
-                if(strcmp(fi->mimeType()->name(),type) == 0) {
-                    // if(ContentType.is_a(type, fi.get_mime_type().get_type())) {
-                    return false;
-                }
-            }
-        }
-        else { // all files should be of the type
-            for(auto& fi: files) {
-                // stdout.printf("get_type: %s, type: %s\n", fi.get_mime_type().get_type(), type);
-                if(strcmp(fi->mimeType()->name(),type) != 0) {
-                    // if(!ContentType.is_a(type, fi.get_mime_type().get_type())) {
-                    return false;
-                }
+    if(show_if_running != nullptr) {
+        keys[1] = show_if_running_check(selection);
+    }
+    auto now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> lock{check_mutex_};
+    for(auto& key: keys) {
+        if(!key.empty()) {
+            auto it = check_results_.find(key);
+            if(it == check_results_.end() || now - it->second.time > checkCacheTime) {
+                checks.emplace_back(std::move(key));
             }
         }
     }
-    return true;
 }
 
-bool FileActionCondition::match_mime_types(const FileInfoList& files) {
-    if(mime_types != nullptr) {
-        bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
-        // check if all of the mime_types are allowed
-        for(auto mime_type = mime_types.get(); *mime_type; ++mime_type) {
-            const char* allowed_type = *mime_type;
-            const char* type;
-            bool negated;
-            if(allowed_type[0] == '!') {
-                type = allowed_type + 1;
-                negated = true;
-            }
-            else {
-                type = allowed_type;
-                negated = false;
-            }
+// static
+void FileActionCondition::run_checks(const std::vector<std::string>& checks) {
+    std::unordered_set<std::string> keys{checks.cbegin(), checks.cend()};
+    if(keys.size() == 1) {
+        check(*keys.begin());
+        return;
+    }
+    // the checks mostly wait for the commands, so a thread is used for each of them
+    std::vector<std::thread> threads;
+    threads.reserve(keys.size());
+    for(auto& key: keys) {
+        threads.emplace_back([&key]() {
+            check(key);
+        });
+    }
+    for(auto& thread: threads) {
+        thread.join();
+    }
+}
 
-            if(negated) { // negated mime_type rules are ANDed
-                bool type_is_allowed = match_mime_type(files, type, negated);
-                if(!type_is_allowed) { // so any mismatch is not allowed
-                    return false;
-                }
-            }
-            else { // other mime_type rules are ORed
-                // matching any one of the mime_type is enough
-                if(!allowed) { // if no rule is matched yet
-                    allowed = match_mime_type(files, type, false);
-                }
-            }
+// static
+bool FileActionCondition::check(const std::string& key) {
+    auto now = g_get_monotonic_time();
+    {
+        std::lock_guard<std::mutex> lock{check_mutex_};
+        auto it = check_results_.find(key);
+        if(it != check_results_.end() && now - it->second.time <= checkCacheTime) {
+            return it->second.result;
         }
-        return allowed;
     }
-    return true;
+    // the lock isn't held while the command runs so other checks can run meanwhile
+    bool result = run_check(key);
+    std::lock_guard<std::mutex> lock{check_mutex_};
+    check_results_[key] = CheckResult{result, g_get_monotonic_time()};
+    return result;
 }
 
-bool FileActionCondition::match_base_name(const FileInfoList& files, const char* base_name, bool negated) {
-    // see if all files has the base_name
-    // FIXME: this is inefficient, some optimization is needed later
-    GPatternSpec* pattern;
-    if(match_case) {
-        pattern = g_pattern_spec_new(base_name);
+// static
+bool FileActionCondition::run_check(const std::string& key) {
+    std::vector<std::string> argv;
+    if(key[0] == 't') {
+        // the command of ShowIfTrue is a shell command
+        argv = {"/bin/sh", "-c", key.substr(1)};
     }
     else {
-        CStrPtr case_fold{g_utf8_casefold(base_name, -1)};
-        pattern = g_pattern_spec_new(case_fold.get());    // FIXME: is this correct?
-    }
-    for(auto& fi: files) {
-        const char* name = fi->name().c_str();
-        if(match_case) {
-            if(g_pattern_match_string(pattern, name)) {
-                // at least 1 file has the base_name
-                if(negated) {
-                    return false;
-                }
-            }
-            else {
-                // at least 1 file does not has the scheme
-                if(!negated) {
-                    return false;
-                }
-            }
-        }
-        else {
-            CStrPtr case_fold{g_utf8_casefold(name, -1)};
-            if(g_pattern_match_string(pattern, case_fold.get())) {
-                // at least 1 file has the base_name
-                if(negated) {
-                    return false;
-                }
-            }
-            else {
-                // at least 1 file does not has the scheme
-                if(!negated) {
-                    return false;
-                }
-            }
+        CStrPtr pgrep{g_find_program_in_path("pgrep")};
+        // pgrep is not fully portable, but we don't have better options here
+        if(pgrep == nullptr) {
+            return false;
         }
+        argv = {pgrep.get(), "-x", key.substr(1)};
     }
-    return true;
+    return run_command(argv);
 }
 
-bool FileActionCondition::match_base_names(const FileInfoList& files) {
-    if(base_names != nullptr) {
-        bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
-        // check if all of the base_names are allowed
-        for(auto it = base_names.get(); *it; ++it) {
-            auto allowed_name = *it;
-            const char* name;
-            bool negated;
-            if(allowed_name[0] == '!') {
-                name = allowed_name + 1;
-                negated = true;
-            }
-            else {
-                name = allowed_name;
-                negated = false;
-            }
-
-            if(negated) { // negated base_name rules are ANDed
-                bool name_is_allowed = match_base_name(files, name, negated);
-                if(!name_is_allowed) { // so any mismatch is not allowed
-                    return false;
-                }
-            }
-            else { // other base_name rules are ORed
-                // matching any one of the base_name is enough
-                if(!allowed) { // if no rule is matched yet
-                    allowed = match_base_name(files, name, false);
-                }
-            }
-        }
-        return allowed;
-    }
-    return true;
+static void setup_checked_process(gpointer /*user_data*/) {
+    // put the command and its children in a new process group, so they can be killed together
+    setpgid(0, 0);
 }
 
-bool FileActionCondition::match_scheme(const FileInfoList& files, const char* scheme, bool negated) {
-    // FIXME: this is inefficient, some optimization is needed later
-    // see if all files has the scheme
-    for(auto& fi: files) {
-        if(fi->path().hasUriScheme(scheme)) {
-            // at least 1 file has the scheme
-            if(negated) {
-                return false;
-            }
-        }
-        else {
-            // at least 1 file does not has the scheme
-            if(!negated) {
-                return false;
-            }
+// static
+bool FileActionCondition::run_command(const std::vector<std::string>& argv) {
+    std::vector<char*> args;
+    for(auto& arg: argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    GPid pid;
+    if(!g_spawn_async(nullptr, args.data(), nullptr,
+                      GSpawnFlags(G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL),
+                      setup_checked_process, nullptr, &pid, nullptr)) {
+        return false;
+    }
+    // wait for the command, but don't let a slow one block the menu
+    auto deadline = g_get_monotonic_time() + checkTimeout;
+    gulong interval = 1000; // in microseconds
+    int status;
+    pid_t ret;
+    while((ret = waitpid(pid, &status, WNOHANG)) == 0 || (ret < 0 && errno == EINTR)) {
+        if(g_get_monotonic_time() >= deadline) {
+            kill(-pid, SIGKILL);
+            kill(pid, SIGKILL); // in case its process group isn't created
+            waitpid(pid, &status, 0);
+            qWarning("the check of the custom action timed out: %s", argv.back().c_str());
+            return false;
         }
+        g_usleep(interval);
+        interval = std::min(interval * 2, gulong(20000));
     }
-    return true;
+    return ret == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
-bool FileActionCondition::match_schemes(const FileInfoList& files) {
-    if(schemes != nullptr) {
-        bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
-        // check if all of the schemes are allowed
-        for(auto it = schemes.get(); *it; ++it) {
-            auto allowed_scheme = *it;
-            const char* scheme;
-            bool negated;
-            if(allowed_scheme[0] == '!') {
-                scheme = allowed_scheme + 1;
-                negated = true;
-            }
-            else {
-                scheme = allowed_scheme;
-                negated = false;
-            }
-
-            if(negated) { // negated scheme rules are ANDed
-                bool scheme_is_allowed = match_scheme(files, scheme, negated);
-                if(!scheme_is_allowed) { // so any mismatch is not allowed
-                    return false;
-                }
-            }
-            else { // other scheme rules are ORed
-                // matching any one of the scheme is enough
-                if(!allowed) { // if no rule is matched yet
-                    allowed = match_scheme(files, scheme, false);
-                }
-            }
+bool FileActionCondition::match_mime_types(const FileActionSelection& selection) const {
+    if(mime_types == nullptr) {
+        return true;
+    }
+    return match_rules(mime_type_rules_, [&selection](const Rule& rule, bool all) {
+        switch(rule.kind) {
+        case Rule::ALL:
+            return true;
+        case Rule::ALL_FILES: // see if all (or any) of the fileinfos are files
+            return all ? selection.dirCount() == 0 : selection.dirCount() < selection.count();
+        case Rule::PREFIX: // check if the types are subtypes of the allowed type
+            return match_values(selection.mimeTypes(), all, [&rule](const char* type) {
+                return g_str_has_prefix(type, rule.value.c_str());
+            });
+        default:
+            return match_values(selection.mimeTypes(), all, [&rule](const char* type) {
+                return rule.value == type;
+            });
         }
-        return allowed;
-    }
-    return true;
+    });
 }
 
-bool FileActionCondition::match_folder(const FileInfoList& files, const char* folder, bool negated) {
-    // trailing /* should always be implied.
-    // FIXME: this is inefficient, some optimization is needed later
-    GPatternSpec* pattern;
-    if(g_str_has_suffix(folder, "/*")) {
-        pattern = g_pattern_spec_new(folder);
-    }
-    else {
-        auto pat_str = g_str_has_suffix(folder, "/") ? string(folder) + "*" // be tolerant
-                                                     : string(folder) + "/*";
-        pattern = g_pattern_spec_new(pat_str.c_str());
+bool FileActionCondition::match_base_names(const FileActionSelection& selection) const {
+    if(base_names == nullptr) {
+        return true;
     }
-    for(auto& fi: files) {
-        auto dirname = fi->isDir() ? fi->path().toString() // also match "folder" itself
-                                   : fi->dirPath().toString();
-        // Since the pattern ends with "/*", if the directory path is equal to "folder",
-        // it should end with "/" to be found as a match. Adding "/" is always harmless.
-        auto path_str = string(dirname.get()) + "/";
-        if(g_pattern_match_string(pattern, path_str.c_str())) { // at least 1 file is in the folder
-            if(negated) {
-                return false;
-            }
-        }
-        else {
-            if(!negated) {
-                return false;
-            }
+    return match_rules(base_name_rules_, [this, &selection](const Rule& rule, bool all) {
+        if(rule.kind == Rule::ALL) {
+            return true;
         }
-    }
-    return true;
+        return match_values(match_case ? selection.names() : selection.casefoldedNames(), all, [&rule](const char* name) {
+            return g_pattern_match_string(rule.pattern.get(), name) != FALSE;
+        });
+    });
 }
 
-bool FileActionCondition::match_folders(const FileInfoList& files) {
-    if(folders != nullptr) {
-        bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
-        // check if all of the schemes are allowed
-        for(auto it = folders.get(); *it; ++it) {
-            auto allowed_folder = *it;
-            const char* folder;
-            bool negated;
-            if(allowed_folder[0] == '!') {
-                folder = allowed_folder + 1;
-                negated = true;
-            }
-            else {
-                folder = allowed_folder;
-                negated = false;
-            }
+bool FileActionCondition::match_schemes(const FileActionSelection& selection) const {
+    if(schemes == nullptr) {
+        return true;
+    }
+    return match_rules(scheme_rules_, [&selection](const Rule& rule, bool all) {
+        // the schemes are case-insensitive
+        return match_values(selection.schemes(), all, [&rule](const std::string& scheme) {
+            return g_ascii_strcasecmp(scheme.c_str(), rule.value.c_str()) == 0;
+        });
+    });
+}
 
-            if(negated) { // negated folder rules are ANDed
-                bool folder_is_allowed = match_folder(files, folder, negated);
-                if(!folder_is_allowed) { // so any mismatch is not allowed
-                    return false;
-                }
-            }
-            else { // other folder rules are ORed
-                // matching any one of the folder is enough
-                if(!allowed) { // if no rule is matched yet
-                    allowed = match_folder(files, folder, false);
-                }
-            }
-        }
-        return allowed;
+bool FileActionCondition::match_folders(const FileActionSelection& selection) const {
+    if(folders == nullptr) {
+        return true;
     }
-    return true;
+    return match_rules(folder_rules_, [&selection](const Rule& rule, bool all) {
+        // Since the pattern ends with "/*", if the directory path is equal to "folder",
+        // it should end with "/" to be found as a match. Adding "/" is always harmless.
+        return match_values(selection.folders(), all, [&rule](const std::string& folder) {
+            return g_pattern_match_string(rule.pattern.get(), folder.c_str()) != FALSE;
+        });
+    });
 }
 
-bool FileActionCondition::match_selection_count(const FileInfoList& files) {
-    const int n_files = files.size();
+bool FileActionCondition::match_selection_count(const FileActionSelection& selection) const {
+    const int n_files = selection.count();
     switch(selection_count_cmp) {
     case '<':
         if(n_files >= selection_count) {
@@ -455,49 +517,56 @@ bool FileActionCondition::match_selection_count(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_capabilities(const FileInfoList& /*files*/) {
+bool FileActionCondition::match_capabilities(const FileActionSelection& /*selection*/) {
     // TODO
     return true;
 }
 
-bool FileActionCondition::match(const FileInfoList& files) {
+bool FileActionCondition::match_static(const FileActionSelection& selection) {
     // all of the condition are combined with AND
     // So, if any one of the conditions is not matched, we quit.
+    // The cheapest conditions are checked first.
 
     // TODO: OnlyShowIn, NotShowIn
-    if(!match_try_exec(files)) {
-        return false;
-    }
-
-    if(!match_mime_types(files)) {
+    if(!match_selection_count(selection)) {
         return false;
     }
-    if(!match_base_names(files)) {
+    if(!match_schemes(selection)) {
         return false;
     }
-    if(!match_selection_count(files)) {
+    if(!match_mime_types(selection)) {
         return false;
     }
-    if(!match_schemes(files)) {
+    if(!match_folders(selection)) {
         return false;
     }
-    if(!match_folders(files)) {
+    if(!match_base_names(selection)) {
         return false;
     }
     // TODO: Capabilities
     // currently, due to limitations of Fm.FileInfo, this cannot
     // be implemanted correctly.
-    if(!match_capabilities(files)) {
+    if(!match_capabilities(selection)) {
         return false;
     }
 
-    if(!match_show_if_registered(files)) {
+    if(!match_try_exec(selection)) {
+        return false;
+    }
+    return true;
+}
+
+bool FileActionCondition::match(const FileActionSelection& selection) {
+    if(!match_static(selection)) {
+        return false;
+    }
+    if(!match_show_if_registered(selection)) {
         return false;
     }
-    if(!match_show_if_true(files)) {
+    if(!match_show_if_true(selection)) {
         return false;
     }
-    if(!match_show_if_running(files)) {
+    if(!match_show_if_running(selection)) {
         return false;
     }
 
@@ -4,6 +4,14 @@
 #include <glib.h>
 #include "../core/gioptrs.h"
 #include "../core/fileinfo.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+
+class QDataStream;
 
 namespace Fm {
 
@@ -20,10 +28,64 @@ enum class FileActionCapability {
 };
 
 
+// The information of a selection used by the conditions, which is collected once and
+// shared by all the actions when a menu is built. Most selections have only a few
+// distinct mime types, schemes and folders, so the rules only check these.
+class FileActionSelection {
+public:
+    explicit FileActionSelection(const FileInfoList& files);
+
+    const FileInfoList& files() const {
+        return files_;
+    }
+
+    int count() const {
+        return files_.size();
+    }
+
+    int dirCount() const {
+        return dirCount_;
+    }
+
+    const std::vector<const char*>& mimeTypes() const {
+        return mimeTypes_;
+    }
+
+    const std::vector<std::string>& schemes() const {
+        return schemes_;
+    }
+
+    // the dirs of the files, or the dirs themselves, ending with "/"
+    const std::vector<std::string>& folders() const {
+        return folders_;
+    }
+
+    const std::vector<const char*>& names() const;
+
+    // casefolded names, which are created when they're first used
+    const std::vector<const char*>& casefoldedNames() const;
+
+private:
+    const FileInfoList& files_;
+    int dirCount_;
+    std::vector<const char*> mimeTypes_;
+    std::vector<std::string> schemes_;
+    std::vector<std::string> folders_;
+    mutable std::vector<const char*> names_;
+    mutable std::vector<CStrPtr> casefoldedNameStrs_;
+    mutable std::vector<const char*> casefoldedNames_;
+};
+
+
 class FileActionCondition {
 public:
     explicit FileActionCondition(GKeyFile* kf, const char* group);
 
+    // load the condition saved in the cache of the actions by save()
+    explicit FileActionCondition(QDataStream& in);
+
+    void save(QDataStream& out) const;
+
 #if 0
     bool match_base_name_(const FileInfoList& files, const char* allowed_base_name) {
         // all files should match the base_name pattern.
@@ -72,35 +134,38 @@ public:
     }
 #endif
 
-    bool match_try_exec(const FileInfoList& files);
-
-    bool match_show_if_registered(const FileInfoList& files);
+    bool match_try_exec(const FileActionSelection& selection);
 
-    bool match_show_if_true(const FileInfoList& files);
+    bool match_show_if_registered(const FileActionSelection& selection);
 
-    bool match_show_if_running(const FileInfoList& files);
+    bool match_show_if_true(const FileActionSelection& selection);
 
-    bool match_mime_type(const FileInfoList& files, const char* type, bool negated);
+    bool match_show_if_running(const FileActionSelection& selection);
 
-    bool match_mime_types(const FileInfoList& files);
+    bool match_mime_types(const FileActionSelection& selection) const;
 
-    bool match_base_name(const FileInfoList& files, const char* base_name, bool negated);
+    bool match_base_names(const FileActionSelection& selection) const;
 
-    bool match_base_names(const FileInfoList& files);
+    bool match_schemes(const FileActionSelection& selection) const;
 
-    static bool match_scheme(const FileInfoList& files, const char* scheme, bool negated);
+    bool match_folders(const FileActionSelection& selection) const;
 
-    bool match_schemes(const FileInfoList& files);
+    bool match_selection_count(const FileActionSelection& selection) const;
 
-    static bool match_folder(const FileInfoList& files, const char* folder, bool negated);
+    bool match_capabilities(const FileActionSelection& selection);
 
-    bool match_folders(const FileInfoList& files);
+    bool match(const FileActionSelection& selection);
 
-    bool match_selection_count(const FileInfoList &files);
+    bool match(const FileInfoList& files) {
+        return match(FileActionSelection{files});
+    }
 
-    bool match_capabilities(const FileInfoList& files);
+    // Add the checks of ShowIfTrue and ShowIfRunning which would be run by match() and are not
+    // cached yet, so they can be run together by run_checks() before the menu is built.
+    void collect_checks(const FileActionSelection& selection, std::vector<std::string>& checks);
 
-    bool match(const FileInfoList& files);
+    // run the checks in parallel and cache the results, which takes at most the check timeout
+    static void run_checks(const std::vector<std::string>& checks);
 
     CStrArrayPtr only_show_in;
     CStrArrayPtr not_show_in;
@@ -116,6 +181,76 @@ public:
     CStrArrayPtr schemes;
     CStrArrayPtr folders;
     FileActionCapability capabilities;
+
+private:
+    struct PatternSpecDeleter {
+        void operator()(GPatternSpec* pattern) const {
+            g_pattern_spec_free(pattern);
+        }
+    };
+
+    // a rule of MimeTypes, Basenames, Schemes or Folders, which is parsed when the action is loaded
+    struct Rule {
+        enum Kind {
+            ALL,        // "*" or "all/all", which matches any file
+            ALL_FILES,  // "all/allfiles", which matches the files which are not dirs
+            PREFIX,     // "type/*"
+            EXACT,
+            PATTERN
+        };
+        Kind kind;
+        bool negated;
+        std::string value;
+        std::unique_ptr<GPatternSpec, PatternSpecDeleter> pattern;
+    };
+
+    typedef std::vector<Rule> RuleList;
+
+    // parse the rules, which is done once after the condition is loaded
+    void compile_all_rules();
+
+    // the conditions which don't run any commands
+    bool match_static(const FileActionSelection& selection);
+
+    // the keys of the checks, which are the expanded commands or process names
+    std::string show_if_true_check(const FileActionSelection& selection) const;
+
+    std::string show_if_running_check(const FileActionSelection& selection) const;
+
+    // the cached result of the check, which is run if it's not cached
+    static bool check(const std::string& key);
+
+    static bool run_check(const std::string& key);
+
+    // whether the command exits with 0 before the check timeout
+    static bool run_command(const std::vector<std::string>& argv);
+
+    static RuleList compile_rules(char** strs, const std::function<void (Rule& rule, const char* str)>& compile);
+
+    // The negated rules are ANDed and the other rules are ORed. A rule is matched if all the
+    // files match it, and a negated rule if none of them do.
+    // matches(rule, all) checks if all the files match the rule, or if any file does.
+    template <typename Matcher>
+    static bool match_rules(const RuleList& rules, Matcher matches);
+
+    RuleList mime_type_rules_;
+    RuleList base_name_rules_;
+    RuleList scheme_rules_;
+    RuleList folder_rules_;
+
+    // whether the programs of TryExec are found, which are checked again after a while
+    struct TryExecResult {
+        bool found;
+        gint64 time;
+    };
+    static std::unordered_map<std::string, TryExecResult> try_exec_results_;
+
+    struct CheckResult {
+        bool result;
+        gint64 time;
+    };
+    static std::mutex check_mutex_;
+    static std::unordered_map<std::string, CheckResult> check_results_;
 };
 
 }
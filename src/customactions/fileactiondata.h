@@ -0,0 +1,69 @@
+#ifndef FILEACTIONDATA_H
+#define FILEACTIONDATA_H
+
+#include <QDataStream>
+#include <glib.h>
+#include "../core/gioptrs.h"
+
+namespace Fm {
+
+// helpers to save the parsed actions in the cache, where nullptr and empty strings are different
+
+inline void write_str(QDataStream& out, const char* str) {
+    if(str) {
+        quint32 len = strlen(str);
+        out << len;
+        out.writeRawData(str, len);
+    }
+    else {
+        out << quint32(0xffffffff);
+    }
+}
+
+inline CStrPtr read_str(QDataStream& in) {
+    quint32 len;
+    in >> len;
+    if(len == 0xffffffff || in.status() != QDataStream::Ok || len > (1 << 20)) {
+        return CStrPtr{};
+    }
+    CStrPtr str{static_cast<char*>(g_malloc(len + 1))};
+    if(in.readRawData(str.get(), len) != int(len)) {
+        in.setStatus(QDataStream::ReadPastEnd);
+        return CStrPtr{};
+    }
+    str[len] = '\0';
+    return str;
+}
+
+inline void write_str_list(QDataStream& out, char** strs) {
+    if(strs) {
+        out << quint32(g_strv_length(strs));
+        for(auto str = strs; *str; ++str) {
+            write_str(out, *str);
+        }
+    }
+    else {
+        out << quint32(0xffffffff);
+    }
+}
+
+inline CStrArrayPtr read_str_list(QDataStream& in) {
+    quint32 n;
+    in >> n;
+    if(n == 0xffffffff || in.status() != QDataStream::Ok || n > (1 << 16)) {
+        return CStrArrayPtr{};
+    }
+    CStrArrayPtr strs{g_new0(char*, n + 1)};
+    for(quint32 i = 0; i < n; ++i) {
+        strs[i] = read_str(in).release();
+        if(!strs[i]) { // the strings can't be nullptr
+            in.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+    }
+    return strs;
+}
+
+} // namespace Fm
+
+#endif // FILEACTIONDATA_H
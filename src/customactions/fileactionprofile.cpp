@@ -1,5 +1,6 @@
 #include "fileactionprofile.h"
 #include "fileaction.h"
+#include "fileactiondata.h"
 #include <QDebug>
 
 using namespace std;
@@ -43,6 +44,32 @@ FileActionProfile::FileActionProfile(GKeyFile *kf, const char* profile_name) {
     condition = make_shared<FileActionCondition>(kf, group_name.c_str());
 }
 
+FileActionProfile::FileActionProfile(QDataStream& in) {
+    auto id_str = read_str(in);
+    id = id_str ? id_str.get() : "";
+    name = read_str(in);
+    exec = read_str(in);
+    path = read_str(in);
+    qint8 mode;
+    in >> mode >> startup_notify;
+    exec_mode = mode <= qint8(FileActionExecMode::DISPLAY_OUTPUT) ? FileActionExecMode(mode) : FileActionExecMode::NORMAL;
+    startup_wm_class = read_str(in);
+    exec_as = read_str(in);
+
+    condition = make_shared<FileActionCondition>(in);
+}
+
+void FileActionProfile::save(QDataStream& out) const {
+    write_str(out, id.c_str());
+    write_str(out, name.get());
+    write_str(out, exec.get());
+    write_str(out, path.get());
+    out << qint8(exec_mode) << startup_notify;
+    write_str(out, startup_wm_class.get());
+    write_str(out, exec_as.get());
+    condition->save(out);
+}
+
 
 bool FileActionProfile::launch_once(GAppLaunchContext* /*ctx*/, std::shared_ptr<const FileInfo> first_file, const FileInfoList& files, CStrPtr& output) {
     if(exec == nullptr) {
@@ -116,9 +143,9 @@ bool FileActionProfile::launch(GAppLaunchContext* ctx, const FileInfoList& files
     return ret;
 }
 
-bool FileActionProfile::match(FileInfoList files) {
+bool FileActionProfile::match(const FileActionSelection& selection) {
     // stdout.printf("  match profile: %s\n", id);
-    return condition->match(files);
+    return condition->match(selection);
 }
 
 }
@@ -22,11 +22,16 @@ class FileActionProfile {
 public:
     explicit FileActionProfile(GKeyFile* kf, const char* profile_name);
 
+    // load the profile saved in the cache of the actions by save()
+    explicit FileActionProfile(QDataStream& in);
+
+    void save(QDataStream& out) const;
+
     bool launch_once(GAppLaunchContext* ctx, std::shared_ptr<const FileInfo> first_file, const FileInfoList& files, CStrPtr& output);
 
     bool launch(GAppLaunchContext* ctx, const FileInfoList& files, CStrPtr& output);
 
-    bool match(FileInfoList files);
+    bool match(const FileActionSelection& selection);
 
     std::string id;
     CStrPtr name;
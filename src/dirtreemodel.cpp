@@ -21,21 +21,38 @@
 #include "dirtreemodelitem.h"
 #include <QDebug>
 #include "core/fileinfojob.h"
+#include "core/subdirprobejob.h"
+#include <QTimer>
+#include <algorithm>
 
 namespace Fm {
 
+static const int defaultUnloadDelay = 60000; // msecs
+static const int defaultMaxLoadedFolders = 256;
+
 DirTreeModel::DirTreeModel(QObject* parent):
     QAbstractItemModel(parent),
-    showHidden_(false) {
+    showHidden_(false),
+    probeJob_(nullptr),
+    unloadTimer_(new QTimer(this)),
+    unloadDelay_(defaultUnloadDelay),
+    maxLoadedFolders_(defaultMaxLoadedFolders),
+    loadedFolders_(0) {
+    clock_.start();
+    unloadTimer_->setSingleShot(true);
+    connect(unloadTimer_, &QTimer::timeout, this, &DirTreeModel::unloadCollapsedItems);
 }
 
 DirTreeModel::~DirTreeModel() {
+    if(probeJob_) {
+        probeJob_->cancel();
+    }
 }
 
 void DirTreeModel::addRoots(Fm::FilePathList rootPaths) {
     auto job = new Fm::FileInfoJob{std::move(rootPaths)};
     job->setAutoDelete(true);
-    connect(job, &Fm::FileInfoJob::finished, this, &DirTreeModel::onFileInfoJobFinished, Qt::BlockingQueuedConnection);
+    connect(job, &Fm::FileInfoJob::finished, this, &DirTreeModel::onFileInfoJobFinished, Qt::QueuedConnection);
     job->runAsync();
 }
 
@@ -69,6 +86,10 @@ QVariant DirTreeModel::data(const QModelIndex& index, int role) const {
         case Qt::DisplayRole:
             return QVariant(item->displayName_);
         case Qt::DecorationRole:
+            // the item is being shown, so load its details, like its custom icon, if they're deferred
+            if(Q_UNLIKELY(info && info->isPartial()) && item->parent_ && item->parent_->folder_) {
+                item->parent_->folder_->loadDetails(info);
+            }
             return QVariant(item->icon_);
         case FileInfoRole: {
             QVariant v;
@@ -100,12 +121,7 @@ QModelIndex DirTreeModel::parent(const QModelIndex& child) const {
     if(item && item->parent_) {
         item = item->parent_; // go to parent item
         if(item) {
-            const auto& items = item->parent_ ? item->parent_->children_ : rootItems_;
-            auto it = std::find(items.cbegin(), items.cend(), item);
-            if(it != items.cend()) {
-                int row = it - items.cbegin();
-                return createIndex(row, 0, (void*)item);
-            }
+            return indexFromItem(item);
         }
     }
     return QModelIndex();
@@ -132,15 +148,78 @@ QModelIndex DirTreeModel::index(int row, int column, const QModelIndex& parent)
 
 bool DirTreeModel::hasChildren(const QModelIndex& parent) const {
     DirTreeModelItem* item = itemFromIndex(parent);
-    return item ? !item->isPlaceHolder() : true;
+    if(!item) {
+        return true;
+    }
+    if(item->isPlaceHolder()) {
+        return false;
+    }
+    // this is called for the visible rows, so only they are probed for sub dirs
+    if(!item->subDirsProbed_ && !item->expanded_) {
+        const_cast<DirTreeModel*>(this)->probeSubDirs(item);
+    }
+    return !item->children_.empty();
+}
+
+void DirTreeModel::probeSubDirs(DirTreeModelItem* item) {
+    item->subDirsProbed_ = true;
+    probeQueue_.push_back(item);
+    // probe all the rows shown at once by a single job
+    if(probeQueue_.size() == 1 && !probeJob_) {
+        QTimer::singleShot(0, this, &DirTreeModel::startSubDirProbes);
+    }
+}
+
+void DirTreeModel::startSubDirProbes() {
+    Fm::FilePathList dirs;
+    probingItems_.clear();
+    for(auto item: probeQueue_) {
+        if(item) {
+            dirs.push_back(item->fileInfo_->path());
+            probingItems_.push_back(item);
+        }
+    }
+    probeQueue_.clear();
+    if(dirs.empty()) {
+        return;
+    }
+    probeJob_ = new Fm::SubDirProbeJob{std::move(dirs), showHidden_};
+    probeJob_->setAutoDelete(true);
+    connect(probeJob_, &Fm::SubDirProbeJob::finished, this, &DirTreeModel::onSubDirProbeJobFinished, Qt::QueuedConnection);
+    probeJob_->runAsync(QThread::LowPriority);
+}
+
+void DirTreeModel::cancelSubDirProbe(DirTreeModelItem* item) {
+    std::replace(probeQueue_.begin(), probeQueue_.end(), item, static_cast<DirTreeModelItem*>(nullptr));
+    std::replace(probingItems_.begin(), probingItems_.end(), item, static_cast<DirTreeModelItem*>(nullptr));
+}
+
+void DirTreeModel::onSubDirProbeJobFinished() {
+    auto job = static_cast<Fm::SubDirProbeJob*>(sender());
+    probeJob_ = nullptr;
+    const auto& results = job->results();
+    for(size_t i = 0; i < results.size() && i < probingItems_.size(); ++i) {
+        DirTreeModelItem* item = probingItems_[i];
+        // the probed results are not used if the item is expanded meanwhile
+        if(item && !results[i] && !item->expanded_ && !item->isDetached()) {
+            item->removeExpander();
+        }
+    }
+    probingItems_.clear();
+    if(!probeQueue_.empty()) {
+        QTimer::singleShot(0, this, &DirTreeModel::startSubDirProbes);
+    }
 }
 
 QModelIndex DirTreeModel::indexFromItem(DirTreeModelItem* item) const {
     Q_ASSERT(item);
-    const auto& items = item->parent_ ? item->parent_->children_ : rootItems_;
-    auto it = std::find(items.cbegin(), items.cend(), item);
-    if(it != items.cend()) {
-        int row = it - items.cbegin();
+    if(item->parent_) {
+        int row = item->parent_->childPosition(item);
+        return row >= 0 ? createIndex(row, 0, (void*)item) : QModelIndex();
+    }
+    auto it = std::find(rootItems_.cbegin(), rootItems_.cend(), item);
+    if(it != rootItems_.cend()) {
+        int row = it - rootItems_.cbegin();
         return createIndex(row, 0, (void*)item);
     }
     return QModelIndex();
@@ -186,13 +265,72 @@ void DirTreeModel::loadRow(const QModelIndex& index) {
     DirTreeModelItem* item = itemFromIndex(index);
     Q_ASSERT(item);
     if(item && !item->isPlaceHolder()) {
+        // a collapsed row which is not unloaded yet is reused
+        removeCollapsedItem(item);
         item->loadFolder();
+        unloadCollapsedItems();
+    }
+}
+
+void DirTreeModel::collapseRow(const QModelIndex& index) {
+    DirTreeModelItem* item = itemFromIndex(index);
+    if(!item || item->isPlaceHolder() || !item->expanded_) {
+        return;
+    }
+    if(unloadDelay_ <= 0) {
+        item->unloadFolder();
+        return;
+    }
+    removeCollapsedItem(item);
+    collapsedItems_.emplace_back(item, clock_.elapsed());
+    unloadCollapsedItems();
+}
+
+void DirTreeModel::setUnloadDelay(int msecs) {
+    unloadDelay_ = msecs;
+    unloadCollapsedItems();
+}
+
+void DirTreeModel::setMaxLoadedFolders(int max) {
+    maxLoadedFolders_ = max;
+    unloadCollapsedItems();
+}
+
+void DirTreeModel::removeCollapsedItem(DirTreeModelItem* item) {
+    auto it = std::find_if(collapsedItems_.cbegin(), collapsedItems_.cend(), [item](const std::pair<DirTreeModelItem*, qint64>& collapsed) {
+        return collapsed.first == item;
+    });
+    if(it != collapsedItems_.cend()) {
+        collapsedItems_.erase(it);
+    }
+}
+
+void DirTreeModel::unloadCollapsedItems() {
+    qint64 now = clock_.elapsed();
+    while(!collapsedItems_.empty()) {
+        auto oldest = collapsedItems_.front();
+        if(now - oldest.second < unloadDelay_
+                && (maxLoadedFolders_ <= 0 || loadedFolders_ <= maxLoadedFolders_)) {
+            break;
+        }
+        // the collapsed items in its branch are removed from the list when they're deleted
+        collapsedItems_.erase(collapsedItems_.cbegin());
+        if(!oldest.first->isDetached()) {
+            oldest.first->unloadFolder();
+        }
+    }
+    if(collapsedItems_.empty()) {
+        unloadTimer_->stop();
+    }
+    else {
+        unloadTimer_->start(std::max(qint64{0}, collapsedItems_.front().second + unloadDelay_ - now));
     }
 }
 
 void DirTreeModel::unloadRow(const QModelIndex& index) {
     DirTreeModelItem* item = itemFromIndex(index);
     if(item && !item->isPlaceHolder()) {
+        removeCollapsedItem(item);
         item->unloadFolder();
     }
 }
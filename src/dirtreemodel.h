@@ -26,15 +26,20 @@
 #include <QIcon>
 #include <QList>
 #include <QSharedPointer>
+#include <QCollator>
+#include <QElapsedTimer>
 #include <vector>
 
 #include "core/fileinfo.h"
 #include "core/filepath.h"
 
+class QTimer;
+
 namespace Fm {
 
 class DirTreeModelItem;
 class DirTreeView;
+class SubDirProbeJob;
 
 class LIBFM_QT_API DirTreeModel : public QAbstractItemModel {
     Q_OBJECT
@@ -55,6 +60,24 @@ public:
     void loadRow(const QModelIndex& index);
     void unloadRow(const QModelIndex& index);
 
+    // The row is collapsed, so it's unloaded later. Its branch is kept until it's collapsed for
+    // unloadDelay() msecs, or until more than maxLoadedFolders() folders are loaded, and is reused
+    // if the row is expanded again before that.
+    void collapseRow(const QModelIndex& index);
+
+    // 0 means the collapsed rows are unloaded immediately
+    void setUnloadDelay(int msecs);
+    int unloadDelay() const {
+        return unloadDelay_;
+    }
+
+    // the number of loaded folders, each of which is monitored, before the collapsed rows are
+    // unloaded earlier; 0 means no limit
+    void setMaxLoadedFolders(int max);
+    int maxLoadedFolders() const {
+        return maxLoadedFolders_;
+    }
+
     bool isLoaded(const QModelIndex& index);
     QIcon icon(const QModelIndex& index);
     std::shared_ptr<const Fm::FileInfo> fileInfo(const QModelIndex& index);
@@ -81,6 +104,8 @@ Q_SIGNALS:
 
 private Q_SLOTS:
     void onFileInfoJobFinished();
+    void onSubDirProbeJobFinished();
+    void unloadCollapsedItems();
 
 private:
     QModelIndex addRoot(std::shared_ptr<const Fm::FileInfo> root);
@@ -89,9 +114,29 @@ private:
     DirTreeModelItem* itemFromIndex(const QModelIndex& index) const;
     QModelIndex indexFromItem(DirTreeModelItem* item) const;
 
+    // check if the dir of a collapsed item has sub dirs in the background, and
+    // remove its placeholder child, and so its expander, if it doesn't have any
+    void probeSubDirs(DirTreeModelItem* item);
+    void startSubDirProbes();
+    void cancelSubDirProbe(DirTreeModelItem* item);
+
+    void removeCollapsedItem(DirTreeModelItem* item);
+
 private:
     bool showHidden_;
+    QCollator collator_; // for sorting the items by name
     std::vector<DirTreeModelItem*> rootItems_;
+    // the items waiting for a sub dir probe, and the ones being probed (nullptr if deleted)
+    std::vector<DirTreeModelItem*> probeQueue_;
+    std::vector<DirTreeModelItem*> probingItems_;
+    SubDirProbeJob* probeJob_;
+    // the collapsed items which are not unloaded yet, the oldest first
+    std::vector<std::pair<DirTreeModelItem*, qint64>> collapsedItems_;
+    QElapsedTimer clock_;
+    QTimer* unloadTimer_;
+    int unloadDelay_;
+    int maxLoadedFolders_;
+    int loadedFolders_;
 };
 
 }
@@ -20,6 +20,8 @@
 #include "dirtreemodelitem.h"
 #include "dirtreemodel.h"
 #include <QDebug>
+#include <algorithm>
+#include <cstring>
 
 namespace Fm {
 
@@ -31,7 +33,8 @@ DirTreeModelItem::DirTreeModelItem():
     parent_(nullptr),
     placeHolderChild_(nullptr),
     model_(nullptr),
-    queuedForDeletion_(false) {
+    queuedForDeletion_(false),
+    subDirsProbed_(false) {
 }
 
 DirTreeModelItem::DirTreeModelItem(std::shared_ptr<const Fm::FileInfo> info, DirTreeModel* model, DirTreeModelItem* parent):
@@ -41,7 +44,8 @@ DirTreeModelItem::DirTreeModelItem(std::shared_ptr<const Fm::FileInfo> info, Dir
     parent_(parent),
     placeHolderChild_(nullptr),
     model_(model),
-    queuedForDeletion_(false) {
+    queuedForDeletion_(false),
+    subDirsProbed_(false) {
 
     if(fileInfo_) {
         displayName_ = fileInfo_->displayName();
@@ -52,6 +56,12 @@ DirTreeModelItem::DirTreeModelItem(std::shared_ptr<const Fm::FileInfo> info, Dir
 
 DirTreeModelItem::~DirTreeModelItem() {
     freeFolder();
+    if(subDirsProbed_) {
+        model_->cancelSubDirProbe(this);
+    }
+    if(model_ && fileInfo_) {
+        model_->removeCollapsedItem(this);
+    }
     // delete child items if needed
     if(!children_.empty()) {
         for(DirTreeModelItem* const item : qAsConst(children_)) {
@@ -74,6 +84,7 @@ void DirTreeModelItem::freeFolder() {
         QObject::disconnect(onFolderFilesRemovedConn_);
         QObject::disconnect(onFolderFilesChangedConn_);
         folder_.reset();
+        --model_->loadedFolders_;
     }
 }
 
@@ -88,17 +99,19 @@ void DirTreeModelItem::addPlaceHolderChild() {
 void DirTreeModelItem::loadFolder() {
     if(!expanded_) {
         /* dynamically load content of the folder. */
-        folder_ =  Fm::Folder::fromPath(fileInfo_->path());
+        // only the sub dirs are shown in the tree
+        folder_ = Fm::Folder::dirsFromPath(fileInfo_->path());
+        ++model_->loadedFolders_;
         /* g_debug("fm_dir_tree_model_load_row()"); */
         /* associate the data with loaded handler */
 
         onFolderFinishLoadingConn_ = QObject::connect(folder_.get(), &Fm::Folder::finishLoading, model_, [=]() {
             onFolderFinishLoading();
         });
-        onFolderFilesAddedConn_ = QObject::connect(folder_.get(), &Fm::Folder::filesAdded, model_, [=](Fm::FileInfoList files) {
+        onFolderFilesAddedConn_ = QObject::connect(folder_.get(), &Fm::Folder::filesAdded, model_, [=](Fm::FileInfoList& files) {
             onFolderFilesAdded(files);
         });
-        onFolderFilesRemovedConn_ = QObject::connect(folder_.get(), &Fm::Folder::filesRemoved, model_, [=](Fm::FileInfoList files) {
+        onFolderFilesRemovedConn_ = QObject::connect(folder_.get(), &Fm::Folder::filesRemoved, model_, [=](Fm::FileInfoList& files) {
             onFolderFilesRemoved(files);
         });
         onFolderFilesChangedConn_ = QObject::connect(folder_.get(), &Fm::Folder::filesChanged, model_, [=](std::vector<Fm::FileInfoPair>& changes) {
@@ -112,6 +125,9 @@ void DirTreeModelItem::loadFolder() {
             insertFiles(folder_->files());
             onFolderFinishLoading();
         }
+        else if(folder_->isIncremental() && !folder_->isEmpty()) { // partially loaded
+            insertFiles(folder_->files());
+        }
     }
 }
 
@@ -121,14 +137,15 @@ void DirTreeModelItem::unloadFolder() {
           * item to keep expander in the tree view around. */
 
         // delete all visible child items
-        model_->beginRemoveRows(index(), 0, children_.size() - 1);
         if(!children_.empty()) {
+            model_->beginRemoveRows(index(), 0, children_.size() - 1);
             for(DirTreeModelItem* const item : qAsConst(children_)) {
                 delete item;
             }
             children_.clear();
+            childNames_.clear();
+            model_->endRemoveRows();
         }
-        model_->endRemoveRows();
 
         // remove hidden children
         if(!hiddenChildren_.empty()) {
@@ -140,7 +157,9 @@ void DirTreeModelItem::unloadFolder() {
 
         /* now, we have no child since all child items are removed.
          * So we add a place holder child item to keep the expander around. */
+        model_->beginInsertRows(index(), 0, 0);
         addPlaceHolderChild();
+        model_->endInsertRows();
         /* deactivate folder since it will be reactivated on expand */
         freeFolder();
         expanded_ = false;
@@ -148,100 +167,152 @@ void DirTreeModelItem::unloadFolder() {
     }
 }
 
+bool DirTreeModelItem::isDetached() const {
+    for(auto item = this; item; item = item->parent_) {
+        if(item->queuedForDeletion_) {
+            return true;
+        }
+    }
+    return false;
+}
+
 QModelIndex DirTreeModelItem::index() {
     Q_ASSERT(model_);
     return model_->indexFromItem(this);
 }
 
-/* Add file info to parent node to proper position. */
-DirTreeModelItem* DirTreeModelItem::insertFile(std::shared_ptr<const Fm::FileInfo> fi) {
-    // qDebug() << "insertFileInfo: " << fm_file_info_get_disp_name(fi);
-    DirTreeModelItem* item = new DirTreeModelItem(std::move(fi), model_);
-    insertItem(item);
-    return item;
+// static
+bool DirTreeModelItem::lessThan(const DirTreeModelItem* a, const DirTreeModelItem* b) {
+    if(Q_UNLIKELY(!a->fileInfo_)) {
+        return b->fileInfo_ != nullptr;  // the placeholder item is always the first one
+    }
+    if(Q_UNLIKELY(!b->fileInfo_)) {
+        return false;
+    }
+    return a->sortKey().compare(b->sortKey()) < 0;
 }
 
-/* Add file info to parent node to proper position. */
-void DirTreeModelItem::insertFiles(Fm::FileInfoList files) {
-    if(children_.size() == 1 && placeHolderChild_) {
-        // the list is empty, add them all at once and do sort
-        if(!model_->showHidden()) { // need to separate visible and hidden items
-            // insert hidden files into the "hiddenChildren_" list and remove them from "files" list
-            // WARNING: "std::remove_if" shouldn't be used to work on the "removed" items because, as
-            // docs say, the elements between the returned and the end iterators are in an unspecified
-            // state and, as far as I (@tsujan) have tested, some of them announce themselves as null.
-            for(auto it = files.begin(); it != files.end();) {
-                auto file = *it;
-                if(file->isHidden()) {
-                    hiddenChildren_.push_back(new DirTreeModelItem{std::move(file), model_});
-                    it = files.erase(it);
-                }
-                else {
-                    ++it;
-                }
-            }
+const QCollatorSortKey& DirTreeModelItem::sortKey() const {
+    // the display name of an item doesn't change, so its key is computed only once
+    if(!sortKey_) {
+        sortKey_.reset(new QCollatorSortKey{model_->collator_.sortKey(displayName_)});
+    }
+    return *sortKey_;
+}
 
+void DirTreeModelItem::removePlaceHolderChild() {
+    if(placeHolderChild_ && children_.size() > 1) {
+        auto it = std::find(children_.cbegin(), children_.cend(), placeHolderChild_);
+        if(it != children_.cend()) {
+            auto pos = it - children_.cbegin();
+            model_->beginRemoveRows(index(), pos, pos);
+            children_.erase(it);
+            delete placeHolderChild_;
+            model_->endRemoveRows();
+            placeHolderChild_ = nullptr;
         }
-        // sort the remaining visible files by name
-        std::sort(files.begin(), files.end(), [](const std::shared_ptr<const Fm::FileInfo>& a, const std::shared_ptr<const Fm::FileInfo>& b) {
-            return QString::localeAwareCompare(a->displayName(), b->displayName()) < 0;
-        });
-        // insert the files into the visible children list at once
-        model_->beginInsertRows(index(), 1, files.size() + 1); // the first item is the placeholder item, so we start from row 1
-        for(auto& file: files) {
-            if(file->isDir()) {
-                DirTreeModelItem* newItem = new DirTreeModelItem(std::move(file), model_);
-                newItem->parent_ = this;
-                children_.push_back(newItem);
-            }
-        }
+    }
+}
+
+void DirTreeModelItem::removeExpander() {
+    if(placeHolderChild_ && children_.size() == 1) {
+        model_->beginRemoveRows(index(), 0, 0);
+        children_.clear();
+        delete placeHolderChild_;
+        placeHolderChild_ = nullptr;
+        model_->endRemoveRows();
+    }
+}
+
+void DirTreeModelItem::resetSubDirProbe() {
+    if(subDirsProbed_) {
+        model_->cancelSubDirProbe(this);
+        subDirsProbed_ = false;
+    }
+    if(children_.empty()) { // the expander was removed
+        model_->beginInsertRows(index(), 0, 0);
+        addPlaceHolderChild();
         model_->endInsertRows();
+    }
+}
 
-        // remove the place holder if a folder is added
-        if(children_.size() > 1) {
-            auto it = std::find(children_.cbegin(), children_.cend(), placeHolderChild_);
-            if(it != children_.cend()) {
-                auto pos = it - children_.cbegin();
-                model_->beginRemoveRows(index(), pos, pos);
-                children_.erase(it);
-                delete placeHolderChild_;
-                model_->endRemoveRows();
-                placeHolderChild_ = nullptr;
-            }
+/* Add file infos to parent node to proper positions. */
+void DirTreeModelItem::insertFiles(Fm::FileInfoList files) {
+    std::vector<DirTreeModelItem*> items;
+    items.reserve(files.size());
+    for(auto& file: files) {
+        if(file->isDir()) {
+            items.push_back(new DirTreeModelItem(std::move(file), model_));
         }
     }
-    else {
-        // the list already contain some items, insert new items one by one so they can be sorted.
-        for(auto& file: files) {
-            if(file->isDir()) {
-                insertFile(std::move(file));
+    insertItems(std::move(items));
+    // remove the place holder if a folder is added
+    removePlaceHolderChild();
+}
+
+// Sort the new items once and merge them into the sorted children, so that each run of
+// new items between two existing children is inserted as one range of rows.
+void DirTreeModelItem::insertItems(std::vector<DirTreeModelItem*> items) {
+    if(!model_->showHidden()) {
+        // keep the hidden folders aside
+        // WARNING: "std::remove_if" shouldn't be used to work on the "removed" items because, as
+        // docs say, the elements between the returned and the end iterators are in an unspecified
+        // state and, as far as I (@tsujan) have tested, some of them announce themselves as null.
+        for(auto it = items.begin(); it != items.end();) {
+            if((*it)->fileInfo_->isHidden()) {
+                hiddenChildren_.push_back(*it);
+                it = items.erase(it);
+            }
+            else {
+                ++it;
             }
         }
     }
+    if(items.empty()) {
+        return;
+    }
+    std::sort(items.begin(), items.end(), lessThan);
+
+    QModelIndex parentIndex = index();
+    size_t pos = 0;
+    for(auto first = items.begin(); first != items.end();) {
+        // the new items go after the existing items with equal names
+        pos = std::upper_bound(children_.cbegin() + pos, children_.cend(), *first, lessThan) - children_.cbegin();
+        // all the new items sorted before the next existing child are inserted at once
+        auto last = items.end();
+        if(pos < children_.size()) {
+            const DirTreeModelItem* next = children_[pos];
+            last = std::partition_point(first, items.end(), [next](const DirTreeModelItem* item) {
+                return lessThan(item, next);
+            });
+        }
+        auto count = last - first;
+        model_->beginInsertRows(parentIndex, pos, pos + count - 1);
+        for(auto it = first; it != last; ++it) {
+            (*it)->parent_ = this;
+            childNames_.emplace((*it)->fileInfo_->name(), *it);
+        }
+        children_.insert(children_.cbegin() + pos, first, last);
+        model_->endInsertRows();
+        pos += count;
+        first = last;
+    }
 }
 
 // find a good position to insert the new item
-// FIXME: insert one item at a time is slow. Insert multiple items at once and then sort is faster.
 int DirTreeModelItem::insertItem(DirTreeModelItem* newItem) {
     if(!newItem->fileInfo_ || !newItem->fileInfo_->isDir()) {
         // don't insert placeholders or non-directory files 
         return -1;
     }
     if(model_->showHidden() || !newItem->fileInfo_ || !newItem->fileInfo_->isHidden()) {
-        auto it = std::lower_bound(children_.cbegin(), children_.cend(), newItem, [=](const DirTreeModelItem* a, const DirTreeModelItem* b) {
-            if(Q_UNLIKELY(!a->fileInfo_)) {
-                return true;  // this is a placeholder item which will be removed so the order doesn't matter.
-            }
-            if(Q_UNLIKELY(!b->fileInfo_)) {
-                return false;
-            }
-            return QString::localeAwareCompare(a->fileInfo_->displayName(), b->fileInfo_->displayName()) < 0;
-        });
+        auto it = std::upper_bound(children_.cbegin(), children_.cend(), newItem, lessThan);
         // inform the world that we're about to insert the item
-        auto position = it - children_.begin();
+        auto position = it - children_.cbegin();
         model_->beginInsertRows(index(), position, position);
         newItem->parent_ = this;
         children_.insert(it, newItem);
+        childNames_.emplace(newItem->fileInfo_->name(), newItem);
         model_->endInsertRows();
         return position;
     }
@@ -299,10 +370,14 @@ void DirTreeModelItem::onFolderFilesRemoved(Fm::FileInfoList& files) {
             // The item shouldn't be deleted now but after its row is removed from QTreeView;
             // otherwise a freeze will happen when it has a child item (its row is expanded).
             child->queuedForDeletion_ = true;
+            if(child->subDirsProbed_) {
+                model->cancelSubDirProbe(child);
+                child->subDirsProbed_ = false;
+            }
             model->beginRemoveRows(index(), pos, pos);
             children_.erase(children_.cbegin() + pos);
+            childNames_.erase(child->fileInfo_->name());
             model->endRemoveRows();
-            
         }
     }
 
@@ -319,64 +394,81 @@ void DirTreeModelItem::onFolderFilesChanged(std::vector<Fm::FileInfoPair> &chang
         auto& changedFile = changePair.first;
         DirTreeModelItem* child = childFromName(changedFile->name().c_str(), &pos);
         if(child) {
+            // the new info might have the details which were deferred, like the custom icon
+            auto& newFile = changePair.second;
+            child->fileInfo_ = newFile;
+            if(newFile->icon()) {
+                child->icon_ = newFile->icon()->qicon();
+            }
             QModelIndex childIndex = child->index();
             Q_EMIT model->dataChanged(childIndex, childIndex);
         }
     }
 }
 
+DirTreeModelItem* DirTreeModelItem::findChild(const char* utf8_name) const {
+    auto it = childNames_.find(utf8_name);
+    return it != childNames_.cend() ? it->second : nullptr;
+}
+
+int DirTreeModelItem::childPosition(const DirTreeModelItem* child) const {
+    // the children are sorted, so the row is found by a binary search
+    auto it = std::lower_bound(children_.cbegin(), children_.cend(), child, lessThan);
+    while(it != children_.cend() && *it != child && !lessThan(child, *it)) {
+        ++it;
+    }
+    if(it == children_.cend() || *it != child) {
+        it = std::find(children_.cbegin(), children_.cend(), child);
+    }
+    return it != children_.cend() ? it - children_.cbegin() : -1;
+}
+
 DirTreeModelItem* DirTreeModelItem::childFromName(const char* utf8_name, int* pos) {
-    int i = 0;
-    for(const auto item : children_) {
-        if(item->fileInfo_ && item->fileInfo_->name() == utf8_name) {
-            if(pos) {
-                *pos = i;
-            }
-            return item;
-        }
-        ++i;
+    DirTreeModelItem* item = findChild(utf8_name);
+    if(item && pos) {
+        *pos = childPosition(item);
     }
-    return nullptr;
+    return item;
 }
 
 DirTreeModelItem* DirTreeModelItem::childFromPath(Fm::FilePath path, bool recursive) const {
     Q_ASSERT(path != nullptr);
-
-    for(DirTreeModelItem* const item : qAsConst(children_)) {
-        // if(item->fileInfo_)
-        //  qDebug() << "child: " << QString::fromUtf8(fm_file_info_get_disp_name(item->fileInfo_));
-        if(item->fileInfo_ && item->fileInfo_->path() == path) {
-            return item;
-        }
-        else if(recursive) {
-            DirTreeModelItem* child = item->childFromPath(std::move(path), true);
-            if(child) {
-                return child;
-            }
+    if(!fileInfo_) {
+        return nullptr;
+    }
+    Fm::FilePath dirPath = fileInfo_->path();
+    if(!recursive) {
+        return dirPath.isParentOf(path) ? findChild(path.baseName().get()) : nullptr;
+    }
+    // look up the names in the relative path one level at a time
+    auto relPath = dirPath.relativePathStr(path);
+    if(!relPath) {
+        return nullptr;
+    }
+    const DirTreeModelItem* item = this;
+    for(char* name = relPath.get(); item && name && *name;) {
+        char* sep = strchr(name, '/');
+        if(sep) {
+            *sep = '\0';
         }
+        item = item->findChild(name);
+        name = sep ? sep + 1 : nullptr;
     }
-    return nullptr;
+    return item != this ? const_cast<DirTreeModelItem*>(item) : nullptr;
 }
 
 void DirTreeModelItem::setShowHidden(bool show) {
+    if(fileInfo_ && !expanded_) {
+        // the result of the sub dir probe depends on whether the hidden dirs are shown
+        resetSubDirProbe();
+    }
     if(show) {
         // move all hidden children to visible list
-        for(auto item: hiddenChildren_) {
-            insertItem(item);
-        }
-        hiddenChildren_.clear();
+        std::vector<DirTreeModelItem*> items;
+        items.swap(hiddenChildren_);
+        insertItems(std::move(items));
         // remove the placeholder if needed
-        if(children_.size() > 1) {
-            auto it = std::find(children_.cbegin(), children_.cend(), placeHolderChild_);
-            if(it != children_.cend()) {
-                auto pos = it - children_.cbegin();
-                model_->beginRemoveRows(index(), pos, pos);
-                children_.erase(it);
-                delete placeHolderChild_;
-                model_->endRemoveRows();
-                placeHolderChild_ = nullptr;
-            }
-        }
+        removePlaceHolderChild();
         // recursively show children of children, etc.
         for(auto item: children_) {
             item->setShowHidden(true);
@@ -385,24 +477,23 @@ void DirTreeModelItem::setShowHidden(bool show) {
     else { // hide hidden folders
         QModelIndex _index = index();
         int pos = 0;
-        for(auto it = children_.begin(); it != children_.end(); ++pos) {
+        for(auto it = children_.begin(); it != children_.end();) {
             DirTreeModelItem* item = *it;
             if(item->fileInfo_) {
                 if(item->fileInfo_->isHidden()) { // hidden folder
                     // remove from the model and add to the hiddenChildren_ list
                     model_->beginRemoveRows(_index, pos, pos);
                     it = children_.erase(it);
+                    childNames_.erase(item->fileInfo_->name());
                     hiddenChildren_.push_back(item);
                     model_->endRemoveRows();
+                    continue;
                 }
-                else { // visible folder, recursively filter its children
-                    item->setShowHidden(show);
-                    ++it;
-                }
-            }
-            else {
-                ++it;
+                // visible folder, recursively filter its children
+                item->setShowHidden(show);
             }
+            ++it;
+            ++pos;
         }
         if(children_.empty()) { // no visible children, add a placeholder item to keep the row expanded
             addPlaceHolderChild();
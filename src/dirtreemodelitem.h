@@ -22,8 +22,12 @@
 
 #include "libfmqtglobals.h"
 #include <vector>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <QIcon>
 #include <QModelIndex>
+#include <QCollator>
 
 #include "core/fileinfo.h"
 #include "core/folder.h"
@@ -54,16 +58,32 @@ public:
     bool isQueuedForDeletion() {
         return queuedForDeletion_;
     }
+
+    // whether the item or one of its parents is removed from the model
+    bool isDetached() const;
     
 
 private:
     void freeFolder();
     void addPlaceHolderChild();
+    // the children are looked up by their names, which are indexed
+    DirTreeModelItem* findChild(const char* utf8_name) const;
+    int childPosition(const DirTreeModelItem* child) const;
     DirTreeModelItem* childFromName(const char* utf8_name, int* pos);
     DirTreeModelItem* childFromPath(Fm::FilePath path, bool recursive) const;
 
-    DirTreeModelItem* insertFile(std::shared_ptr<const Fm::FileInfo> fi);
+    void removePlaceHolderChild();
+    // remove the placeholder child of a collapsed item whose dir has no sub dirs
+    void removeExpander();
+    // forget the result of the sub dir probe, which is done again when the item is shown
+    void resetSubDirProbe();
+
+    // the order of the children, by the collation keys of their names
+    static bool lessThan(const DirTreeModelItem* a, const DirTreeModelItem* b);
+    const QCollatorSortKey& sortKey() const;
+
     void insertFiles(Fm::FileInfoList files);
+    void insertItems(std::vector<DirTreeModelItem*> items);
     int insertItem(Fm::DirTreeModelItem* newItem);
     QModelIndex index();
 
@@ -82,9 +102,12 @@ private:
     DirTreeModelItem* parent_;
     DirTreeModelItem* placeHolderChild_;
     std::vector<DirTreeModelItem*> children_;
+    std::unordered_map<std::string, DirTreeModelItem*> childNames_; // the visible children by name
     std::vector<DirTreeModelItem*> hiddenChildren_;
     DirTreeModel* model_;
     bool queuedForDeletion_;
+    bool subDirsProbed_; // the dir is probed for sub dirs, or waiting for it
+    mutable std::unique_ptr<const QCollatorSortKey> sortKey_;
     // signal connections
     QMetaObject::Connection onFolderFinishLoadingConn_;
     QMetaObject::Connection onFolderFilesAddedConn_;
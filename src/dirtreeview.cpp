@@ -27,12 +27,14 @@
 #include "dirtreemodel.h"
 #include "dirtreemodelitem.h"
 #include "filemenu.h"
+#include "folderprefetcher_p.h"
 
 namespace Fm {
 
 DirTreeView::DirTreeView(QWidget* parent):
     QTreeView(parent),
-    currentExpandingItem_(nullptr) {
+    currentExpandingItem_(nullptr),
+    prefetcher_(nullptr) {
 
     setSelectionMode(QAbstractItemView::SingleSelection);
     setHeaderHidden(true);
@@ -50,6 +52,19 @@ DirTreeView::DirTreeView(QWidget* parent):
 DirTreeView::~DirTreeView() {
 }
 
+void DirTreeView::setPrefetchOnHover(bool prefetch) {
+    if(prefetch && !prefetcher_) {
+        prefetcher_ = new FolderPrefetcher(this, [this](const QModelIndex& index) {
+            DirTreeModel* _model = static_cast<DirTreeModel*>(model());
+            return _model ? _model->filePath(index) : Fm::FilePath();
+        });
+    }
+    else if(!prefetch && prefetcher_) {
+        delete prefetcher_;
+        prefetcher_ = nullptr;
+    }
+}
+
 void DirTreeView::cancelPendingChdir() {
     if(!pathsToExpand_.empty()) {
         pathsToExpand_.clear();
@@ -265,7 +280,7 @@ void DirTreeView::onNewFolder() {
 void DirTreeView::onCollapsed(const QModelIndex& index) {
     DirTreeModel* treeModel = static_cast<DirTreeModel*>(model());
     if(treeModel) {
-        treeModel->unloadRow(index);
+        treeModel->collapseRow(index);
     }
 }
 
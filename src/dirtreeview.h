@@ -31,6 +31,7 @@ namespace Fm {
 
 class FileMenu;
 class DirTreeModelItem;
+class FolderPrefetcher;
 
 class LIBFM_QT_API DirTreeView : public QTreeView {
     Q_OBJECT
@@ -51,6 +52,14 @@ public:
 
     virtual void setModel(QAbstractItemModel* model);
 
+    // List the folder under the pointer, or the current one chosen with the keyboard, in the
+    // background after a short delay, so it's loaded already when it's opened. Off by default.
+    void setPrefetchOnHover(bool prefetch);
+
+    bool prefetchOnHover() const {
+        return prefetcher_ != nullptr;
+    }
+
 protected:
     virtual void mousePressEvent(QMouseEvent* event);
     virtual void rowsAboutToBeRemoved(const QModelIndex& parent, int start, int end);
@@ -86,6 +95,7 @@ private:
     Fm::FilePathList pathsToExpand_;
     DirTreeModelItem* currentExpandingItem_;
     std::vector<DirTreeModelItem*> queuedForDeletion_;
+    FolderPrefetcher* prefetcher_;
 };
 
 }
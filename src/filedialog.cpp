@@ -14,6 +14,8 @@
 #include <QCompleter>
 #include <QShortcut>
 #include <QTimer>
+#include <QScrollBar>
+#include <QRegExp>
 #include <QDebug>
 
 namespace Fm {
@@ -22,7 +24,6 @@ namespace Fm {
 FileDialog::FileDialog(QWidget* parent, FilePath path) :
     QDialog(parent),
     ui{new Ui::FileDialog()},
-    folderModel_{nullptr},
     proxyModel_{nullptr},
     folder_{nullptr},
     options_{0},
@@ -30,7 +31,8 @@ FileDialog::FileDialog(QWidget* parent, FilePath path) :
     fileMode_{QFileDialog::AnyFile},
     acceptMode_{QFileDialog::AcceptOpen},
     confirmOverwrite_{true},
-    modelFilter_{this} {
+    modelFilter_{this},
+    deferredPartsInitialized_{false} {
 
     ui->setupUi(this);
 
@@ -39,8 +41,7 @@ FileDialog::FileDialog(QWidget* parent, FilePath path) :
         setDirectoryPath(path);
     });
 
-    // side pane
-    ui->sidePane->setMode(Fm::SidePane::ModePlaces);
+    // side pane, its places are added by initDeferredParts()
     connect(ui->sidePane, &SidePane::chdirRequested, [this](int /*type*/, const FilePath &path) {
         setDirectoryPath(path);
     });
@@ -49,7 +50,6 @@ FileDialog::FileDialog(QWidget* parent, FilePath path) :
     proxyModel_ = new ProxyFolderModel(this);
     proxyModel_->sort(FolderModel::ColumnFileName, Qt::AscendingOrder);
     proxyModel_->setThumbnailSize(64);
-    proxyModel_->setShowThumbnails(true);
 
     proxyModel_->addFilter(&modelFilter_);
 
@@ -98,6 +98,7 @@ FileDialog::FileDialog(QWidget* parent, FilePath path) :
     backAction_ = toolbar->addAction(QIcon::fromTheme("go-previous"), tr("Go Back"));
     backAction_->setShortcut(QKeySequence(tr("Alt+Left", "Go Back")));
     connect(backAction_, &QAction::triggered, [this]() {
+        retainViewState();
         history_.backward();
         setDirectoryPath(history_.currentPath(), FilePath(), false);
     });
@@ -105,6 +106,7 @@ FileDialog::FileDialog(QWidget* parent, FilePath path) :
     forwardAction_ = toolbar->addAction(QIcon::fromTheme("go-next"), tr("Go Forward"));
     forwardAction_->setShortcut(QKeySequence(tr("Alt+Right", "Go Forward")));
     connect(forwardAction_, &QAction::triggered, [this]() {
+        retainViewState();
         history_.forward();
         setDirectoryPath(history_.currentPath(), FilePath(), false);
     });
@@ -172,6 +174,25 @@ FileDialog::~FileDialog() {
     freeFolder();
 }
 
+void FileDialog::showEvent(QShowEvent* event) {
+    QDialog::showEvent(event);
+    if(!deferredPartsInitialized_) {
+        // let the dialog and the files be painted first
+        QTimer::singleShot(0, this, &FileDialog::initDeferredParts);
+    }
+}
+
+// The places view (with the volume manager and the bookmarks) and the thumbnail loading
+// take a while to set up, and they're not needed to paint the files for the first time.
+void FileDialog::initDeferredParts() {
+    if(deferredPartsInitialized_) {
+        return;
+    }
+    deferredPartsInitialized_ = true;
+    ui->sidePane->setMode(Fm::SidePane::ModePlaces);
+    proxyModel_->setShowThumbnails(true);
+}
+
 int FileDialog::splitterPos() const {
     return ui->splitter->sizes().at(0);
 }
@@ -352,10 +373,12 @@ void FileDialog::setDirectoryPath(FilePath directory, FilePath selectedPath, boo
     }
 
    if(directoryPath_ != directory) {
+       if(addHistory) {
+           retainViewState();
+       }
        if(folder_) {
             if(folderModel_) {
                 proxyModel_->setSourceModel(nullptr);
-                folderModel_->unref(); // unref the cached model
                 folderModel_ = nullptr;
             }
             freeFolder();
@@ -372,8 +395,13 @@ void FileDialog::setDirectoryPath(FilePath directory, FilePath selectedPath, boo
         forwardAction_->setEnabled(history_.canForward());
     
         folder_ = Fm::Folder::fromPath(directoryPath_);
-        folderModel_ = CachedFolderModel::modelFromFolder(folder_);
-        proxyModel_->setSourceModel(folderModel_);
+        folderModel_ = CachedFolderModel::sharedModelFromFolder(folder_);
+        proxyModel_->setSourceModel(folderModel_.get());
+        // the model retained by the history still has its items, so the old view is shown at once
+        if(!addHistory && history_.size() > 0 && history_.currentItem().model() == folderModel_.get()
+                && folder_->isLoaded() && !selectedPath.isValid()) {
+            restoreViewState(history_.currentItem());
+        }
     
         // no lambda in these connections for easy disconnection
         connect(folder_.get(), &Fm::Folder::removed, this, &FileDialog::goHome);
@@ -401,6 +429,34 @@ void FileDialog::setDirectoryPath(FilePath directory, FilePath selectedPath, boo
 
 }
 
+// keep the model and the view state of the current folder in the history before leaving it
+void FileDialog::retainViewState() {
+    if(!folderModel_ || history_.size() == 0 || history_.currentPath() != directoryPath_) {
+        return;
+    }
+    int scrollPos = ui->folderView->childView()->verticalScrollBar()->value();
+    history_.retainModel(folderModel_, ui->folderView->selectedFilePaths(), scrollPos);
+}
+
+void FileDialog::restoreViewState(const BrowseHistoryItem& item) {
+    QItemSelectionModel::SelectionFlags flags = QItemSelectionModel::Select;
+    if(viewMode_ == FolderView::DetailedListMode) {
+        flags |= QItemSelectionModel::Rows;
+    }
+    QItemSelectionModel* selModel = ui->folderView->selectionModel();
+    for(const auto& path: item.selectedFiles()) {
+        auto idx = proxyModel_->indexFromPath(path);
+        if(idx.isValid()) {
+            selModel->select(idx, flags);
+        }
+    }
+    // the view is laid out after the model is set
+    int scrollPos = item.scrollPos();
+    QTimer::singleShot(0, this, [this, scrollPos]() {
+        ui->folderView->childView()->verticalScrollBar()->setValue(scrollPos);
+    });
+}
+
 void FileDialog::selectFilePath(const FilePath &path) {
     auto idx = proxyModel_->indexFromPath(path);
     if(!idx.isValid()) {
@@ -930,20 +986,57 @@ bool FileDialog::FileDialogFilter::filterAcceptsRow(const ProxyFolderModel* /*mo
         }
     }
 
-    bool nameMatched = false;
+    if(matchesAll_) {
+        return true;
+    }
     auto& name = info->displayName();
-    for(const auto& pattern: patterns_) {
-        if(pattern.exactMatch(name)) {
-            nameMatched = true;
-            break;
+    if(!suffixes_.isEmpty()) {
+        // try each suffix starting with a dot, like ".gz" and ".tar.gz"
+        for(int dot = name.indexOf('.'); dot != -1; dot = name.indexOf('.', dot + 1)) {
+            if(suffixes_.contains(name.mid(dot).toLower())) {
+                return true;
+            }
         }
     }
-    return nameMatched;
+    return !otherGlobs_.pattern().isEmpty() && otherGlobs_.match(name).hasMatch();
+}
+
+// convert a glob to a regular expression with the same rules as QRegExp::Wildcard
+static QString globToRegularExpression(const QString& glob) {
+    QString regex;
+    for(int i = 0; i < glob.length(); ++i) {
+        QChar c = glob[i];
+        if(c == '*') {
+            regex += QLatin1String(".*");
+        }
+        else if(c == '?') {
+            regex += QLatin1Char('.');
+        }
+        else if(c == '[') {
+            int end = glob.indexOf(']', i + 2); // "[]...]" contains ']'
+            if(end == -1) {
+                regex += QLatin1String("\\[");
+                continue;
+            }
+            QString set = glob.mid(i + 1, end - i - 1);
+            if(set.startsWith('!')) {
+                set[0] = '^';
+            }
+            regex += QLatin1Char('[') + set.replace(QLatin1Char('\\'), QLatin1String("\\\\")) + QLatin1Char(']');
+            i = end;
+        }
+        else {
+            regex += QRegularExpression::escape(c);
+        }
+    }
+    return regex;
 }
 
 void FileDialog::FileDialogFilter::update() {
     // update filename patterns
-    patterns_.clear();
+    matchesAll_ = false;
+    suffixes_.clear();
+    otherGlobs_ = QRegularExpression();
     QString nameFilter = dlg_->currentNameFilter_;
     // if the filter contains (...), only get the part between the parenthesis.
     auto left = nameFilter.indexOf('(');
@@ -955,10 +1048,24 @@ void FileDialog::FileDialogFilter::update() {
         }
         nameFilter = nameFilter.mid(left, right - left);
     }
-    // parse the "*.ext1 *.ext2 *.ext3 ..." list into QRegExp objects
-    auto globs = nameFilter.simplified().split(' ');
+    // parse the "*.ext1 *.ext2 *.ext3 ..." list
+    QStringList others;
+    const auto globs = nameFilter.simplified().split(' ', QString::SkipEmptyParts);
     for(const auto& glob: globs) {
-        patterns_.emplace_back(QRegExp(glob, Qt::CaseInsensitive, QRegExp::Wildcard));
+        if(glob == QLatin1String("*")) {
+            matchesAll_ = true;
+        }
+        else if(glob.startsWith(QLatin1String("*.")) && glob.indexOf(QRegularExpression(QStringLiteral("[*?\\[]")), 1) == -1) {
+            suffixes_.insert(glob.mid(1).toLower());
+        }
+        else {
+            others.append(globToRegularExpression(glob));
+        }
+    }
+    if(!others.isEmpty()) {
+        otherGlobs_ = QRegularExpression(QStringLiteral("\\A(?:") + others.join('|') + QStringLiteral(")\\z"),
+                                         QRegularExpression::CaseInsensitiveOption);
+        otherGlobs_.optimize();
     }
 }
 
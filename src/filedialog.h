@@ -5,7 +5,8 @@
 #include "core/filepath.h"
 
 #include <QFileDialog>
-#include <QRegExp>
+#include <QRegularExpression>
+#include <QSet>
 #include <vector>
 #include <memory>
 #include "folderview.h"
@@ -122,6 +123,9 @@ public:
     int splitterPos() const;
     void setSplitterPos(int pos);
 
+protected:
+    void showEvent(QShowEvent* event) override;
+
 private Q_SLOTS:
     void onCurrentRowChanged(const QModelIndex &current, const QModelIndex& /*previous*/);
     void onSelectionChanged(const QItemSelection& /*selected*/, const QItemSelection& /*deselected*/);
@@ -145,12 +149,15 @@ private:
 
     class FileDialogFilter: public ProxyFolderModelFilter {
     public:
-        FileDialogFilter(FileDialog* dlg): dlg_{dlg} {}
+        FileDialogFilter(FileDialog* dlg): dlg_{dlg}, matchesAll_{false} {}
         virtual bool filterAcceptsRow(const ProxyFolderModel* /*model*/, const std::shared_ptr<const Fm::FileInfo>& info) const override;
         void update();
 
         FileDialog* dlg_;
-        std::vector<QRegExp> patterns_;
+        // The globs of the name filter are compiled once, so a name is not matched with each of them.
+        bool matchesAll_; // there's a "*" glob
+        QSet<QString> suffixes_; // the "*.ext" globs without wildcards in "ext", lower case and with the dot
+        QRegularExpression otherGlobs_; // the other globs in one alternation, invalid if there's none
     };
 
     bool isLabelExplicitlySet(QFileDialog::DialogLabel label) const {
@@ -172,11 +179,14 @@ private:
     void doAccept();
     void onFileInfoJobFinished();
     void freeFolder();
+    void retainViewState();
+    void restoreViewState(const BrowseHistoryItem& item);
     QStringList parseNames() const;
+    void initDeferredParts();
 
 private:
     std::unique_ptr<Ui::FileDialog> ui;
-    CachedFolderModel* folderModel_;
+    std::shared_ptr<CachedFolderModel> folderModel_;
     ProxyFolderModel* proxyModel_;
     FilePath directoryPath_;
     std::shared_ptr<Fm::Folder> folder_;
@@ -206,6 +216,8 @@ private:
     QString explicitLabels_[5];
     // needed for disconnecting Fm::Folder signal from lambda:
     QMetaObject::Connection lambdaConnection_;
+    // the places, volumes and thumbnails are set up after the dialog is shown
+    bool deferredPartsInitialized_;
 };
 
 
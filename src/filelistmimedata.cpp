@@ -0,0 +1,80 @@
+#include "filelistmimedata_p.h"
+#include "utilities.h"
+#include <QCoreApplication>
+
+namespace Fm {
+
+static const QString uriListFormat = QStringLiteral("text/uri-list");
+// Gnome, LXDE, and XFCE
+static const QString gnomeFormat = QStringLiteral("x-special/gnome-copied-files");
+// KDE, which uses text/uri-list for the files
+static const QString kdeCutFormat = QStringLiteral("application/x-kde-cutselection");
+
+FileListMimeData::FileListMimeData(FilePathList paths):
+    paths_{std::move(paths)},
+    clipboardFormats_{false},
+    isCut_{false} {
+}
+
+FileListMimeData::~FileListMimeData() {
+}
+
+void FileListMimeData::setClipboardFormats(bool isCut) {
+    clipboardFormats_ = true;
+    isCut_ = isCut;
+    // used to trace cut/copy operations to the current app
+    QByteArray pid;
+    setData(QStringLiteral("text/x-libfmqt-pid"), pid.setNum(QCoreApplication::applicationPid()));
+}
+
+QStringList FileListMimeData::lazyFormats() const {
+    QStringList result{uriListFormat};
+    if(clipboardFormats_) {
+        result << gnomeFormat;
+        if(isCut_) {
+            result << kdeCutFormat;
+        }
+    }
+    return result;
+}
+
+QStringList FileListMimeData::formats() const {
+    QStringList result = QMimeData::formats();
+    for(const auto& format: lazyFormats()) {
+        if(!result.contains(format)) {
+            result << format;
+        }
+    }
+    return result;
+}
+
+bool FileListMimeData::hasFormat(const QString& mimeType) const {
+    return lazyFormats().contains(mimeType) || QMimeData::hasFormat(mimeType);
+}
+
+const QByteArray& FileListMimeData::uriList() const {
+    if(uriList_.isEmpty() && !paths_.empty()) {
+        uriList_ = pathListToUriList(paths_);
+    }
+    return uriList_;
+}
+
+QVariant FileListMimeData::retrieveData(const QString& mimeType, QVariant::Type type) const {
+    if(mimeType == uriListFormat) {
+        // QMimeData converts it to a list of urls if needed
+        return uriList();
+    }
+    if(clipboardFormats_) {
+        if(mimeType == gnomeFormat) {
+            // the standard text/uri-list format uses CRLF for line breaks, but gnome format uses LF only
+            QByteArray uris = uriList();
+            return QByteArray(isCut_ ? "cut\n" : "copy\n") + uris.replace("\r\n", "\n");
+        }
+        if(isCut_ && mimeType == kdeCutFormat) {
+            return QByteArrayLiteral("1");
+        }
+    }
+    return QMimeData::retrieveData(mimeType, type);
+}
+
+} // namespace Fm
@@ -0,0 +1,54 @@
+#ifndef FM_FILELISTMIMEDATA_P_H
+#define FM_FILELISTMIMEDATA_P_H
+
+#include <QMimeData>
+#include <QStringList>
+#include "core/filepath.h"
+
+namespace Fm {
+
+// The mime data of a list of files, which only builds the text/uri-list data and the other
+// formats of the files when another program or a widget asks for them. A large selection can be
+// dragged or copied at once this way, and the drops and pastes inside the same program take the
+// paths directly with paths().
+// It has no Q_OBJECT since it's only cast with dynamic_cast.
+class FileListMimeData: public QMimeData {
+public:
+    explicit FileListMimeData(FilePathList paths);
+
+    ~FileListMimeData();
+
+    const FilePathList& paths() const {
+        return paths_;
+    }
+
+    // Add the formats used by the file managers for copying or cutting files with the clipboard,
+    // and the pid of this program (see isCurrentPidClipboardData()).
+    void setClipboardFormats(bool isCut);
+
+    // the files are cut to the clipboard
+    bool isCut() const {
+        return clipboardFormats_ && isCut_;
+    }
+
+    QStringList formats() const override;
+
+    bool hasFormat(const QString& mimeType) const override;
+
+protected:
+    QVariant retrieveData(const QString& mimeType, QVariant::Type type) const override;
+
+private:
+    const QByteArray& uriList() const;
+
+    QStringList lazyFormats() const;
+
+    FilePathList paths_;
+    bool clipboardFormats_;
+    bool isCut_;
+    mutable QByteArray uriList_; // built on the first request
+};
+
+} // namespace Fm
+
+#endif // FM_FILELISTMIMEDATA_P_H
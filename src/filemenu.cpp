@@ -31,23 +31,129 @@
 
 #include <QMessageBox>
 #include <QAbstractItemView>
+#include <QElapsedTimer>
 #include <QDebug>
+#include <list>
+#include <mutex>
+#include <string>
 #include "filemenu_p.h"
 
 #include "core/archiver.h"
+#include "core/appinfocache.h"
+#include "core/job.h"
+#include "core/jobtrace_p.h"
+#include "core/filesystemcapabilities_p.h"
+#include "core/resultqueue_p.h"
 
 #include "core/legacy/fm-app-info.h"
 
 
 namespace Fm {
 
+namespace {
+
+// The custom actions matched for the recent selections, so right clicking the same files again
+// shows them at once. The conditions might depend on other things, which are not checked again
+// until the entry expires after maxAge.
+class CustomActionsCache {
+public:
+    static std::string key(const FileInfoList& files) {
+        std::string key;
+        for(auto& file: files) {
+            auto uri = file->path().uri();
+            key += uri.get();
+            key += '\n';
+            key += std::to_string(file->mtime());
+            key += '\n';
+        }
+        return key;
+    }
+
+    bool lookup(const std::string& key, FileActionItemList& items) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for(auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if(it->key == key) {
+                if(it->time.elapsed() > maxAge) {
+                    entries_.erase(it);
+                    return false;
+                }
+                items = it->items;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(std::string key, FileActionItemList items) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for(auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if(it->key == key) {
+                entries_.erase(it);
+                break;
+            }
+        }
+        entries_.push_front(Entry{std::move(key), std::move(items), QElapsedTimer{}});
+        entries_.front().time.start();
+        if(entries_.size() > maxEntries) {
+            entries_.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        FileActionItemList items;
+        QElapsedTimer time;
+    };
+
+    static const size_t maxEntries = 8;
+    static const qint64 maxAge = 30000;
+
+    std::mutex mutex_;
+    std::list<Entry> entries_; // the most recent ones first
+};
+
+CustomActionsCache& customActionsCache() {
+    static CustomActionsCache cache;
+    return cache;
+}
+
+// matches the custom actions in the shared job executor and caches them
+class CustomActionsJob: public Job {
+public:
+    explicit CustomActionsJob(FileInfoList files, std::string cacheKey,
+                              std::shared_ptr<ResultQueue<FileActionItemList>> results):
+        files_{std::move(files)},
+        cacheKey_{std::move(cacheKey)},
+        results_{std::move(results)} {
+    }
+
+protected:
+    void exec() override {
+        TraceSpan span{"FileActionItem::get_actions_for_files"};
+        auto items = FileActionItem::get_actions_for_files(files_);
+        customActionsCache().insert(std::move(cacheKey_), items);
+        results_->push(std::move(items));
+    }
+
+private:
+    FileInfoList files_;
+    std::string cacheKey_;
+    std::shared_ptr<ResultQueue<FileActionItemList>> results_;
+};
+
+} // namespace
+
+// The core actions are added at once, and the expensive parts are filled in later: the apps of the
+// "Open With..." menu when it's shown, and the custom actions when they're matched in a worker thread.
 FileMenu::FileMenu(Fm::FileInfoList files, std::shared_ptr<const Fm::FileInfo> info, Fm::FilePath cwd, bool isWritableDir, const QString& title, QWidget* parent):
     QMenu(title, parent),
     files_{std::move(files)},
     info_{std::move(info)},
     cwd_{std::move(cwd)},
     unTrashAction_(nullptr),
-    fileLauncher_(nullptr) {
+    fileLauncher_(nullptr),
+    customActionsAnchor_(nullptr) {
 
     useTrash_ = true;
     confirmDelete_ = true;
@@ -81,6 +187,10 @@ FileMenu::FileMenu(Fm::FileInfoList files, std::shared_ptr<const Fm::FileInfo> i
     // check if the files are all in the trash can
     allTrash_ =  sameFilesystem_ && path.hasUriScheme("trash");
 
+    // The capabilities are already cached when the files are listed, and the menu does not query
+    // the filesystem. The trash is assumed to work if they're not known.
+    canTrash_ = !sameFilesystem_ || FileSystemCapabilities::cached(info_->filesystemId()).canTrash;
+
     openAction_ = new QAction(QIcon::fromTheme("document-open"), tr("Open"), this);
     connect(openAction_, &QAction::triggered, this, &FileMenu::onOpenTriggered);
     addAction(openAction_);
@@ -91,31 +201,20 @@ FileMenu::FileMenu(Fm::FileInfoList files, std::shared_ptr<const Fm::FileInfo> i
     QMenu* menu = new QMenu(this);
     openWithMenuAction_->setMenu(menu);
 
+    QAction* appsSeparator = menu->addSeparator();
+    openWithAction_ = new QAction(tr("Other Applications"), this);
+    connect(openWithAction_, &QAction::triggered, this, &FileMenu::onOpenWithTriggered);
+    menu->addAction(openWithAction_);
     if(sameType_) { /* add specific menu items for this mime type */
         if(mime_type && !allVirtual_) { /* the file has a valid mime-type and its not virtual */
-            GList* apps = g_app_info_get_all_for_type(mime_type->name());
-            GList* l;
-            for(l = apps; l; l = l->next) {
-                Fm::GAppInfoPtr app{G_APP_INFO(l->data), false};
-                // check if the command really exists
-                gchar* program_path = g_find_program_in_path(g_app_info_get_executable(app.get()));
-                if(!program_path) {
-                    continue;
-                }
-                g_free(program_path);
-
-                // create a QAction for the application.
-                AppInfoAction* action = new AppInfoAction(std::move(app), menu);
-                connect(action, &QAction::triggered, this, &FileMenu::onApplicationTriggered);
-                menu->addAction(action);
-            }
-            g_list_free(apps);
+            // the apps are looked up once when the menu is shown first
+            auto connection = std::make_shared<QMetaObject::Connection>();
+            *connection = connect(menu, &QMenu::aboutToShow, this, [this, menu, appsSeparator, connection]() {
+                disconnect(*connection);
+                addOpenWithApps(menu, appsSeparator);
+            });
         }
     }
-    menu->addSeparator();
-    openWithAction_ = new QAction(tr("Other Applications"), this);
-    connect(openWithAction_, &QAction::triggered, this, &FileMenu::onOpenWithTriggered);
-    menu->addAction(openWithAction_);
 
     separator1_ = addSeparator();
 
@@ -156,7 +255,12 @@ FileMenu::FileMenu(Fm::FileInfoList files, std::shared_ptr<const Fm::FileInfo> i
         connect(pasteAction_, &QAction::triggered, this, &FileMenu::onPasteTriggered);
         addAction(pasteAction_);
 
-        deleteAction_ = new QAction(QIcon::fromTheme("user-trash"), tr("&Move to Trash"), this);
+        if(useTrash_ && canTrash_) {
+            deleteAction_ = new QAction(QIcon::fromTheme("user-trash"), tr("&Move to Trash"), this);
+        }
+        else {
+            deleteAction_ = new QAction(QIcon::fromTheme("edit-delete"), tr("&Delete"), this);
+        }
         connect(deleteAction_, &QAction::triggered, this, &FileMenu::onDeleteTriggered);
         addAction(deleteAction_);
 
@@ -187,22 +291,32 @@ FileMenu::FileMenu(Fm::FileInfoList files, std::shared_ptr<const Fm::FileInfo> i
         deleteAction_->setEnabled(hasDeletable);
         renameAction_->setEnabled(hasRenamable);
         if(!(sameType_ && info_->isDir()
-             && (files_.size() > 1 ? isWritableDir : info_->isWritable()))) {
+             && (files_.size() > 1 ? isWritableDir : info_->isWritable() && info_->isWritableDirectory()))) {
             pasteAction_->setEnabled(false);
         }
     }
 
     // DES-EMA custom actions integration
     // FIXME: port these parts to Fm API
-    auto custom_actions = FileActionItem::get_actions_for_files(files_);
-    for(auto& item: custom_actions) {
-        if(item && !(item->get_target() & FILE_ACTION_TARGET_CONTEXT)) {
-            continue;  // this item is not for context menu
-        }
-        if(item == custom_actions.front() && !item->is_action()) {
-            addSeparator(); // before all custom actions
-        }
-        addCustomActionItem(this, item);
+    // The conditions of the actions might run commands and query the files, so they're matched in
+    // a worker thread unless the same files are matched recently, and the actions are added later.
+    customActionsAnchor_ = addSeparator();
+    customActionsAnchor_->setVisible(false);
+    std::string cacheKey = CustomActionsCache::key(files_);
+    FileActionItemList custom_actions;
+    if(customActionsCache().lookup(cacheKey, custom_actions)) {
+        addCustomActions(custom_actions);
+    }
+    else {
+        auto results = ResultQueue<FileActionItemList>::create(this, [this](std::vector<FileActionItemList>& results) {
+            for(auto& items: results) {
+                addCustomActions(items);
+            }
+        });
+        auto job = new CustomActionsJob{files_, std::move(cacheKey), std::move(results)};
+        job->setAutoDelete(true);
+        job->setPriority(Job::Priority::INTERACTIVE);
+        job->runAsync();
     }
 
     // archiver integration
@@ -249,9 +363,38 @@ FileMenu::~FileMenu() {
 }
 
 
-void FileMenu::addCustomActionItem(QMenu* menu, std::shared_ptr<const FileActionItem> item) {
+void FileMenu::addOpenWithApps(QMenu* menu, QAction* before) {
+    TraceSpan span{"FileMenu::addOpenWithApps"};
+    for(auto& app: Fm::AppInfoCache::appsForType(info_->mimeType()->name())) {
+        // check if the command really exists
+        gchar* program_path = g_find_program_in_path(g_app_info_get_executable(app.get()));
+        if(!program_path) {
+            continue;
+        }
+        g_free(program_path);
+
+        // create a QAction for the application.
+        AppInfoAction* action = new AppInfoAction(std::move(app), menu);
+        connect(action, &QAction::triggered, this, &FileMenu::onApplicationTriggered);
+        menu->insertAction(before, action);
+    }
+}
+
+void FileMenu::addCustomActions(const FileActionItemList& items) {
+    for(auto& item: items) {
+        if(item && !(item->get_target() & FILE_ACTION_TARGET_CONTEXT)) {
+            continue;  // this item is not for context menu
+        }
+        if(item == items.front() && !item->is_action()) {
+            insertSeparator(customActionsAnchor_); // before all custom actions
+        }
+        addCustomActionItem(this, item, customActionsAnchor_);
+    }
+}
+
+void FileMenu::addCustomActionItem(QMenu* menu, std::shared_ptr<const FileActionItem> item, QAction* before) {
     if(!item) { // separator
-        addSeparator();
+        menu->insertSeparator(before);
         return;
     }
 
@@ -261,7 +404,7 @@ void FileMenu::addCustomActionItem(QMenu* menu, std::shared_ptr<const FileAction
     }
 
     CustomAction* action = new CustomAction(item, menu);
-    menu->addAction(action);
+    menu->insertAction(before, action);
     if(item->is_menu()) {
         auto& subitems = item->get_sub_items();
         if(!subitems.empty()) {
@@ -346,7 +489,7 @@ void FileMenu::onCutTriggered() {
 
 void FileMenu::onDeleteTriggered() {
     auto paths = files_.paths();
-    if(useTrash_) {
+    if(useTrash_ && canTrash_) {
         FileOperation::trashFiles(paths, confirmTrash_);
     }
     else {
@@ -387,8 +530,9 @@ void FileMenu::setUseTrash(bool trash) {
     if(useTrash_ != trash) {
         useTrash_ = trash;
         if(deleteAction_) {
-            deleteAction_->setText(useTrash_ ? tr("&Move to Trash") : tr("&Delete"));
-            deleteAction_->setIcon(useTrash_ ? QIcon::fromTheme("user-trash") : QIcon::fromTheme("edit-delete"));
+            bool trash = useTrash_ && canTrash_;
+            deleteAction_->setText(trash ? tr("&Move to Trash") : tr("&Delete"));
+            deleteAction_->setIcon(trash ? QIcon::fromTheme("user-trash") : QIcon::fromTheme("edit-delete"));
         }
     }
 }
@@ -24,6 +24,8 @@
 #include "libfmqtglobals.h"
 #include <QMenu>
 #include <qabstractitemmodel.h>
+#include <vector>
+#include <memory>
 #include "core/fileinfo.h"
 
 class QAction;
@@ -155,7 +157,8 @@ public:
     }
 
 protected:
-    void addCustomActionItem(QMenu* menu, std::shared_ptr<const FileActionItem> item);
+    // the item is inserted before the action, or appended if it's nullptr
+    void addCustomActionItem(QMenu* menu, std::shared_ptr<const FileActionItem> item, QAction* before = nullptr);
     void openFilesWithApp(GAppInfo* app);
 
 protected Q_SLOTS:
@@ -180,6 +183,7 @@ private:
     std::shared_ptr<const Fm::FileInfo> info_;
     Fm::FilePath cwd_;
     bool useTrash_;
+    bool canTrash_; // the filesystem of the files supports the trash
     bool confirmDelete_;
     bool confirmTrash_; // Confirm before moving files into "trash can"
 
@@ -204,6 +208,12 @@ private:
     QAction* propertiesAction_;
 
     FileLauncher* fileLauncher_;
+
+private:
+    void addOpenWithApps(QMenu* menu, QAction* before);
+    void addCustomActions(const std::vector<std::shared_ptr<const FileActionItem>>& items);
+
+    QAction* customActionsAnchor_; // the custom actions are inserted before it when they're matched
 };
 
 }
@@ -24,18 +24,26 @@
 #include <QElapsedTimer>
 #include <QMessageBox>
 #include <QDebug>
+#include <QThread>
+#include <QCryptographicHash>
+#include <algorithm>
 
 #include "core/deletejob.h"
 #include "core/trashjob.h"
 #include "core/untrashjob.h"
 #include "core/filetransferjob.h"
 #include "core/filechangeattrjob.h"
+#include "core/transferscheduler.h"
+#include "core/folder.h"
 #include "utilities.h"
 
 namespace Fm {
 
 #define SHOW_DLG_DELAY  1000
 
+// the operations on more files than this make the affected folders wait for them to finish instead of updating per file
+static const size_t bulkOperationThreshold = 32;
+
 FileOperation::FileOperation(Type type, Fm::FilePathList srcPaths, QObject* parent):
     QObject(parent),
     type_{type},
@@ -49,12 +57,22 @@ FileOperation::FileOperation(Type type, Fm::FilePathList srcPaths, QObject* pare
     autoDestroy_(true) {
 
     switch(type_) {
-    case Copy:
-        job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::COPY);
+    case Copy: {
+        auto job = new FileTransferJob(srcPaths_, FileTransferJob::Mode::COPY);
+        // don't wait for the size of the whole tree before copying the first file
+        job->setOverlapSizeScan(true);
+        // let concurrent operations on the same devices run one after another instead of thrashing them
+        job->setScheduled(true);
+        job_ = job;
         break;
-    case Move:
-        job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::MOVE);
+    }
+    case Move: {
+        auto job = new FileTransferJob(srcPaths_, FileTransferJob::Mode::MOVE);
+        job->setOverlapSizeScan(true);
+        job->setScheduled(true);
+        job_ = job;
         break;
+    }
     case Link:
         job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::LINK);
         break;
@@ -100,6 +118,7 @@ void FileOperation::disconnectJob() {
 }
 
 FileOperation::~FileOperation() {
+    endBulkUpdates();
     if(uiTimer_) {
         uiTimer_->stop();
         delete uiTimer_;
@@ -131,6 +150,12 @@ void FileOperation::setDestFiles(FilePathList destFiles) {
     case Copy:
     case Move:
     case Link:
+        for(const auto& destFile: destFiles) {
+            auto dirPath = destFile.parent();
+            if(std::find(destDirPaths_.cbegin(), destDirPaths_.cend(), dirPath) == destDirPaths_.cend()) {
+                destDirPaths_.push_back(std::move(dirPath));
+            }
+        }
         if(job_) {
             static_cast<FileTransferJob*>(job_)->setDestPaths(std::move(destFiles));
         }
@@ -166,6 +191,10 @@ void FileOperation::setRecursiveChattr(bool recursive) {
     if(job_) {
         auto job = static_cast<FileChangeAttrJob*>(job_);
         job->setRecursive(recursive);
+        if(recursive) {
+            // walking big trees is faster with a few threads, especially on SSDs
+            job->setThreadCount(std::min(QThread::idealThreadCount(), 4));
+        }
     }
 }
 
@@ -177,22 +206,79 @@ bool FileOperation::run() {
     connect(uiTimer_, &QTimer::timeout, this, &FileOperation::onUiTimeout);
 
     if(job_) {
+        beginBulkUpdates();
         job_->runAsync();
         return true;
     }
     return false;
 }
 
+void FileOperation::beginBulkUpdates() {
+    if(srcPaths_.size() < bulkOperationThreshold) {
+        return;
+    }
+    // only the folders which are already loaded are affected
+    auto addFolder = [this](const FilePath& dirPath) {
+        auto folder = dirPath ? Folder::findByPath(dirPath) : nullptr;
+        if(folder && std::find(bulkFolders_.cbegin(), bulkFolders_.cend(), folder) == bulkFolders_.cend()) {
+            folder->beginBulkUpdate();
+            bulkFolders_.push_back(std::move(folder));
+        }
+    };
+    switch(type_) {
+    case Move:
+    case Delete:
+    case Trash:
+        // the files are removed from their folders
+        for(const auto& path: srcPaths_) {
+            addFolder(path.parent());
+        }
+        break;
+    default:
+        break;
+    }
+    addFolder(destPath_);
+    for(const auto& dirPath: destDirPaths_) {
+        addFolder(dirPath);
+    }
+}
+
+void FileOperation::endBulkUpdates() {
+    for(auto& folder: bulkFolders_) {
+        folder->endBulkUpdate();
+    }
+    bulkFolders_.clear();
+}
+
 void FileOperation::cancel() {
     if(job_) {
         job_->cancel();
     }
 }
 
+void FileOperation::pause() {
+    if(job_ && !job_->isPaused() && job_->pause()) {
+        // the paused time is not counted in the estimate of the remaining time
+        pauseElapsedTimer();
+    }
+}
+
+void FileOperation::resume() {
+    if(job_ && job_->isPaused()) {
+        job_->resume();
+        resumeElapsedTimer();
+    }
+}
+
 void FileOperation::onUiTimeout() {
     if(dlg_) {
         // estimate remaining time based on past history
-        if(job_) {
+        if(job_ && Fm::TransferScheduler::globalInstance()->isQueued(job_)) {
+            if(curFile.isEmpty()) {
+                dlg_->setCurFile(tr("Waiting for other operations on the same device..."));
+            }
+        }
+        else if(job_) {
             Fm::FilePath curFilePath = job_->currentFile();
             // update progress bar
             double finishedRatio = job_->progress();
@@ -206,16 +292,25 @@ void FileOperation::onUiTimeout() {
                 // only show data transferred if the job progress can be calculated by file size.
                 // for jobs not related to data transfer (for example: change attr, delete,...), hide the UI
                 if(job_->calcProgressUsingSize()) {
-                    dlg_->setDataTransferred(finishedSize, totalSize);
+                    double bytesPerSec, filesPerSec;
+                    if(!job_->throughput(bytesPerSec, filesPerSec)) {
+                        bytesPerSec = 0;
+                    }
+                    dlg_->setDataTransferred(finishedSize, totalSize, bytesPerSec);
                 }
                 else {
                     dlg_->setFilesProcessed(finishedCount, totalCount);
                 }
 
-                double remainRatio = 1.0 - finishedRatio;
-                gint64 remaining = elapsedTime() * (remainRatio / finishedRatio) / 1000;
-                // qDebug("etime: %llu, finished: %lf, remain:%lf, remaining secs: %llu",
-                //        elapsedTime(), finishedRatio, remainRatio, remaining);
+                // the estimate of the job is based on the recent rates, which is more reliable
+                // than extrapolating the elapsed time when the sizes of the files vary a lot
+                gint64 remaining = job_->remainingTime();
+                if(remaining < 0) {
+                    double remainRatio = 1.0 - finishedRatio;
+                    remaining = elapsedTime() * (remainRatio / finishedRatio) / 1000;
+                }
+                // qDebug("etime: %llu, finished: %lf, remaining secs: %llu",
+                //        elapsedTime(), finishedRatio, remaining);
                 dlg_->setRemainingTime(remaining);
             }
             // update currently processed file
@@ -258,6 +353,11 @@ void FileOperation::onJobFileExists(const FileInfo& src, const FileInfo& dest, F
     pauseElapsedTimer();
     showDialog();
     response = dlg_->askRename(src, dest, newDest);
+    FileOperationJob::FileExistsAction action;
+    if(job_ && dlg_->defaultFileExistsAction(action)) {
+        // the job resolves the rest of the conflicts itself
+        job_->setFileExistsAction(action);
+    }
     resumeElapsedTimer();
 }
 
@@ -284,6 +384,7 @@ void FileOperation::onJobPrepared() {
 
 void FileOperation::onJobFinish() {
     disconnectJob();
+    endBulkUpdates();
 
     if(uiTimer_) {
         uiTimer_->stop();
@@ -320,10 +421,35 @@ void FileOperation::onJobFinish() {
     }
 }
 
+// The journal of a copy is named after its sources and destinations, so copying the same files again
+// after the operation is cancelled or the program crashes skips the files which are already copied.
+static QString copyJournalPath(const FilePathList& srcFiles, const FilePathList& destFiles) {
+    QCryptographicHash hash{QCryptographicHash::Sha1};
+    for(const auto* paths: {&srcFiles, &destFiles}) {
+        for(const auto& path: *paths) {
+            hash.addData(path.uri().get());
+            hash.addData("\n", 1);
+        }
+        hash.addData("\t", 1);
+    }
+    CStrPtr dir{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "transfers", nullptr)};
+    if(g_mkdir_with_parents(dir.get(), 0700) != 0) {
+        return QString{};
+    }
+    return QString::fromLocal8Bit(dir.get()) + QLatin1Char('/') + QLatin1String(hash.result().toHex()) + QStringLiteral(".journal");
+}
+
+void FileOperation::setCopyJournal(const FilePathList& destFiles) {
+    if(job_) {
+        static_cast<FileTransferJob*>(job_)->setJournalPath(copyJournalPath(srcPaths_, destFiles));
+    }
+}
+
 // static
 FileOperation* FileOperation::copyFiles(Fm::FilePathList srcFiles, Fm::FilePath dest, QWidget* parent) {
     FileOperation* op = new FileOperation(FileOperation::Copy, std::move(srcFiles), parent);
     op->setDestination(dest);
+    op->setCopyJournal(FilePathList{dest});
     op->run();
     return op;
 }
@@ -332,6 +458,7 @@ FileOperation* FileOperation::copyFiles(Fm::FilePathList srcFiles, Fm::FilePath
 FileOperation *FileOperation::copyFiles(FilePathList srcFiles, FilePathList destFiles, QWidget *parent) {
     qDebug("copy: %s -> %s", srcFiles[0].toString().get(), destFiles[0].toString().get());
     FileOperation* op = new FileOperation(FileOperation::Copy, std::move(srcFiles), parent);
+    op->setCopyJournal(destFiles);
     op->setDestFiles(std::move(destFiles));
     op->run();
     return op;
@@ -26,12 +26,15 @@
 #include <QElapsedTimer>
 #include "core/filepath.h"
 #include "core/fileoperationjob.h"
+#include <memory>
+#include <vector>
 
 class QTimer;
 
 namespace Fm {
 
 class FileOperationDialog;
+class Folder;
 
 class LIBFM_QT_API FileOperation : public QObject {
     Q_OBJECT
@@ -66,6 +69,43 @@ public:
 
     void cancel();
 
+    // Run the operation in the background with a low I/O and CPU priority, and optionally a limited
+    // bandwidth in bytes per second. They can be changed while the operation is running.
+    // Only copying, moving and deleting files support them.
+    void setBackground(bool background) {
+        if(job_) {
+            job_->setBackground(background);
+        }
+    }
+
+    bool isBackground() const {
+        return job_ && job_->isBackground();
+    }
+
+    void setBandwidthLimit(std::uint64_t bytesPerSec) {
+        if(job_) {
+            job_->setBandwidthLimit(bytesPerSec);
+        }
+    }
+
+    // Resolve all the conflicts with the existing destination files in advance (OVERWRITE or SKIP),
+    // instead of asking the user for each of them.
+    void setFileExistsAction(FileOperationJob::FileExistsAction action) {
+        if(job_) {
+            job_->setFileExistsAction(action);
+        }
+    }
+
+    // Pause the operation between files or chunks of data, and resume it later.
+    // Only copying, moving and deleting files check if they're paused.
+    void pause();
+
+    void resume();
+
+    bool isPaused() const {
+        return job_ && job_->isPaused();
+    }
+
     bool isRunning() const {
         return job_ && !isCancelled();
     }
@@ -140,22 +180,30 @@ private:
     void disconnectJob();
     void showDialog();
 
+    // suppress the per-file updates of the loaded folders affected by the operation
+    void beginBulkUpdates();
+    void endBulkUpdates();
+
+    // let a copy resume from where a cancelled or crashed run of the same operation stopped
+    void setCopyJournal(const FilePathList& destFiles);
+
     void pauseElapsedTimer() {
-        if(Q_LIKELY(elapsedTimer_ != nullptr)) {
+        // the timer might be paused already while the job is paused
+        if(Q_LIKELY(elapsedTimer_ != nullptr) && elapsedTimer_->isValid()) {
             lastElapsed_ += elapsedTimer_->elapsed();
             elapsedTimer_->invalidate();
         }
     }
 
     void resumeElapsedTimer() {
-        if(Q_LIKELY(elapsedTimer_ != nullptr)) {
+        if(Q_LIKELY(elapsedTimer_ != nullptr) && !isPaused()) {
             elapsedTimer_->start();
         }
     }
 
     qint64 elapsedTime() {
         if(Q_LIKELY(elapsedTimer_ != nullptr)) {
-            return lastElapsed_ + elapsedTimer_->elapsed();
+            return lastElapsed_ + (elapsedTimer_->isValid() ? elapsedTimer_->elapsed() : 0);
         }
         return 0;
     }
@@ -168,6 +216,7 @@ private:
     FileOperationJob* job_;
     FileOperationDialog* dlg_;
     FilePath destPath_;
+    FilePathList destDirPaths_; // parent dirs of the files set by setDestFiles()
     FilePath curFilePath_;
     FilePathList srcPaths_;
     QTimer* uiTimer_;
@@ -176,6 +225,7 @@ private:
     bool updateRemainingTime_;
     QString curFile;
     bool autoDestroy_;
+    std::vector<std::shared_ptr<Folder>> bulkFolders_;
 };
 
 }
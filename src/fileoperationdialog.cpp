@@ -23,6 +23,7 @@
 #include "renamedialog.h"
 #include <QLabel>
 #include <QMessageBox>
+#include <QPushButton>
 #include "utilities.h"
 #include "ui_file-operation-dialog.h"
 
@@ -79,6 +80,34 @@ FileOperationDialog::FileOperationDialog(FileOperation* _operation):
     }
     ui->message->setText(message);
     setWindowTitle(title);
+
+    switch(_operation->type()) {
+    case FileOperation::Copy:
+    case FileOperation::Move:
+    case FileOperation::Delete:
+        ui->background->setChecked(_operation->isBackground());
+        connect(ui->background, &QCheckBox::toggled, this, [this](bool checked) {
+            operation->setBackground(checked);
+        });
+        {
+            // the job stops at the next file or chunk of data, without cancelling it
+            QPushButton* pauseButton = ui->buttonBox->addButton(tr("&Pause"), QDialogButtonBox::ActionRole);
+            connect(pauseButton, &QPushButton::clicked, this, [this, pauseButton]() {
+                if(operation->isPaused()) {
+                    operation->resume();
+                    pauseButton->setText(tr("&Pause"));
+                }
+                else {
+                    operation->pause();
+                    pauseButton->setText(tr("&Resume"));
+                }
+            });
+        }
+        break;
+    default:
+        ui->background->hide();
+        break;
+    }
 }
 
 
@@ -162,10 +191,14 @@ void FileOperationDialog::setCurFile(QString cur_file) {
     ui->curFile->setText(cur_file);
 }
 
-void FileOperationDialog::setDataTransferred(uint64_t finishedSize, std::uint64_t totalSize) {
-    ui->filesProcessed->setText(QString("%1 / %2")
-                                 .arg(formatFileSize(finishedSize, fm_config->si_unit))
-                                 .arg(formatFileSize(totalSize, fm_config->si_unit)));
+void FileOperationDialog::setDataTransferred(uint64_t finishedSize, std::uint64_t totalSize, double bytesPerSec) {
+    QString text = QString("%1 / %2")
+                   .arg(formatFileSize(finishedSize, fm_config->si_unit))
+                   .arg(formatFileSize(totalSize, fm_config->si_unit));
+    if(bytesPerSec > 0) {
+        text += tr(" (%1/s)").arg(formatFileSize(uint64_t(bytesPerSec), fm_config->si_unit));
+    }
+    ui->filesProcessed->setText(text);
 }
 
 void FileOperationDialog::setFilesProcessed(uint64_t finishedCount, uint64_t totalCount) {
@@ -49,11 +49,21 @@ public:
 
     FileOperationJob::FileExistsAction askRename(const FileInfo& src, const FileInfo& dest, FilePath& newDest);
 
+    // the action the user chose for all the existing files, or returns false if it's not chosen
+    bool defaultFileExistsAction(FileOperationJob::FileExistsAction& action) const {
+        if(defaultOption == -1) {
+            return false;
+        }
+        action = FileOperationJob::FileExistsAction(defaultOption);
+        return true;
+    }
+
     Job::ErrorAction error(GError* err, Job::ErrorSeverity severity);
     void setPrepared();
     void setCurFile(QString cur_file);
     void setPercent(unsigned int percent);
-    void setDataTransferred(std::uint64_t finishedSize, std::uint64_t totalSize);
+    // the rate is only shown if it's known
+    void setDataTransferred(std::uint64_t finishedSize, std::uint64_t totalSize, double bytesPerSec = 0);
     void setFilesProcessed(std::uint64_t finishedCount, std::uint64_t totalCount);
     void setRemainingTime(unsigned int sec);
 
@@ -28,10 +28,13 @@
 #include <QDateTime>
 #include <QStandardPaths>
 #include <QFileDialog>
+#include <QThread>
+#include <algorithm>
 #include <sys/types.h>
 #include <time.h>
 #include "core/totalsizejob.h"
 #include "core/folder.h"
+#include "core/appinfocache.h"
 
 #include "core/legacy/fm-config.h"
 
@@ -65,19 +68,13 @@ FilePropsDialog::FilePropsDialog(Fm::FileInfoList files, QWidget* parent, Qt::Wi
     }
 
     totalSizeJob = new Fm::TotalSizeJob(fileInfos_.paths(), Fm::TotalSizeJob::DEFAULT);
+    totalSizeJob->setThreadCount(std::min(QThread::idealThreadCount(), 4));
 
     initGeneralPage();
     initPermissionsPage();
 }
 
 FilePropsDialog::~FilePropsDialog() {
-    // Stop the timer if it's still running
-    if(fileSizeTimer) {
-        fileSizeTimer->stop();
-        delete fileSizeTimer;
-        fileSizeTimer = nullptr;
-    }
-
     // Cancel the indexing job if it hasn't finished
     if(totalSizeJob) {
         totalSizeJob->cancel();
@@ -308,43 +305,33 @@ void FilePropsDialog::initGeneralPage() {
 
     initApplications(); // init applications combo box
 
-    // calculate total file sizes
-    fileSizeTimer = new QTimer(this);
-    connect(fileSizeTimer, &QTimer::timeout, this, &FilePropsDialog::onFileSizeTimerTimeout);
-    fileSizeTimer->start(600);
-
-    connect(totalSizeJob, &Fm::TotalSizeJob::finished, this, &FilePropsDialog::onDeepCountJobFinished, Qt::BlockingQueuedConnection);
+    // calculate total file sizes and show the running totals while counting
+    connect(totalSizeJob, &Fm::TotalSizeJob::progressChanged, this, &FilePropsDialog::onTotalSizeProgress, Qt::QueuedConnection);
+    connect(totalSizeJob, &Fm::TotalSizeJob::finished, this, &FilePropsDialog::onDeepCountJobFinished, Qt::QueuedConnection);
     totalSizeJob->setAutoDelete(true);
     totalSizeJob->runAsync();
 }
 
 void FilePropsDialog::onDeepCountJobFinished() {
-    onFileSizeTimerTimeout(); // update file size display
-
+    // the final totals are sent by progressChanged() before the job finishes
     totalSizeJob = nullptr;
-
-    // stop the timer
-    if(fileSizeTimer) {
-        fileSizeTimer->stop();
-        delete fileSizeTimer;
-        fileSizeTimer = nullptr;
-    }
 }
 
-void FilePropsDialog::onFileSizeTimerTimeout() {
+void FilePropsDialog::onTotalSizeProgress(quint64 totalSize, quint64 totalOnDiskSize, unsigned int /*fileCount*/) {
+    // the queued snapshots may arrive after the dialog cancels the job
     if(totalSizeJob && !totalSizeJob->isCancelled()) {
         // FIXME:
         // OMG! It's really unbelievable that Qt developers only implement
         // QObject::tr(... int n). GNU gettext developers are smarter and
         // they use unsigned long instead of int.
         // We cannot use Qt here to handle plural forms. So sad. :-(
-        QString str = Fm::formatFileSize(totalSizeJob->totalSize(), fm_config->si_unit) %
-                      QString(" (%1 B)").arg(totalSizeJob->totalSize());
+        QString str = Fm::formatFileSize(totalSize, fm_config->si_unit) %
+                      QString(" (%1 B)").arg(totalSize);
         // tr(" (%n) byte(s)", "", deepCountJob->total_size);
         ui->fileSize->setText(str);
 
-        str = Fm::formatFileSize(totalSizeJob->totalOnDiskSize(), fm_config->si_unit) %
-              QString(" (%1 B)").arg(totalSizeJob->totalOnDiskSize());
+        str = Fm::formatFileSize(totalOnDiskSize, fm_config->si_unit) %
+              QString(" (%1 B)").arg(totalOnDiskSize);
         // tr(" (%n) byte(s)", "", deepCountJob->total_ondisk_size);
         ui->onDiskSize->setText(str);
     }
@@ -401,6 +388,7 @@ void FilePropsDialog::accept() {
     if(mimeType && ui->openWith->isChanged()) {
         auto currentApp = ui->openWith->selectedApp();
         g_app_info_set_as_default_for_type(currentApp.get(), mimeType->name(), nullptr);
+        AppInfoCache::invalidate();
     }
 
     // check if chown or chmod is needed
@@ -64,7 +64,7 @@ private:
 
 private Q_SLOTS:
     void onDeepCountJobFinished();
-    void onFileSizeTimerTimeout();
+    void onTotalSizeProgress(quint64 totalSize, quint64 totalOnDiskSize, unsigned int fileCount);
     void onIconButtonclicked();
 
 private:
@@ -91,7 +91,6 @@ private:
     Qt::CheckState execCheckState;
 
     Fm::TotalSizeJob* totalSizeJob; // job used to count total size
-    QTimer* fileSizeTimer;
 };
 
 }
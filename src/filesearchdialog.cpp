@@ -65,10 +65,15 @@ void FileSearchDialog::accept() {
         fm_search_set_name_patterns(search, ui->namePatterns->text().toUtf8().constData());
         fm_search_set_name_ci(search, ui->nameCaseInsensitive->isChecked());
         fm_search_set_name_regex(search, ui->nameRegExp->isChecked());
+        fm_search_set_use_index(search, ui->useIndex->isChecked());
 
         fm_search_set_content_pattern(search, ui->contentPattern->text().toUtf8().constData());
         fm_search_set_content_ci(search, ui->contentCaseInsensitive->isChecked());
         fm_search_set_content_regex(search, ui->contentRegExp->isChecked());
+        fm_search_set_content_skip_binary(search, ui->skipBinaryFiles->isChecked());
+        if(ui->limitContentSize->isChecked()) {
+            fm_search_set_content_max_size(search, guint64(ui->contentMaxSize->value()) * 1024 * 1024);
+        }
 
         // search for the files of specific mime-types
         if(ui->searchTextFiles->isChecked()) {
@@ -174,6 +179,14 @@ void FileSearchDialog::setSearchhHidden(bool hidden) {
     ui->searchHidden->setChecked(hidden);
 }
 
+void FileSearchDialog::setSkipBinaryFiles(bool skip) {
+    ui->skipBinaryFiles->setChecked(skip);
+}
+
+void FileSearchDialog::setUseIndex(bool use) {
+    ui->useIndex->setChecked(use);
+}
+
 bool FileSearchDialog::nameCaseInsensitive() const {
     return ui->nameCaseInsensitive->isChecked();
 }
@@ -198,4 +211,12 @@ bool FileSearchDialog::searchhHidden() const {
     return ui->searchHidden->isChecked();
 }
 
+bool FileSearchDialog::skipBinaryFiles() const {
+    return ui->skipBinaryFiles->isChecked();
+}
+
+bool FileSearchDialog::useIndex() const {
+    return ui->useIndex->isChecked();
+}
+
 }
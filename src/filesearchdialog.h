@@ -59,6 +59,14 @@ public:
     bool searchhHidden() const;
     void setSearchhHidden(bool hidden);
 
+    // don't search the contents of binary files
+    bool skipBinaryFiles() const;
+    void setSkipBinaryFiles(bool skip);
+
+    // search the names in the file name index of local folders
+    bool useIndex() const;
+    void setUseIndex(bool use);
+
 private Q_SLOTS:
     void onAddPath();
     void onRemovePath();
@@ -26,6 +26,7 @@
 struct _FmSearch
 {
     gboolean recursive;
+    gboolean follow_symlinks;
     gboolean show_hidden;
     char* name_patterns;
     gboolean name_ci;
@@ -33,6 +34,10 @@ struct _FmSearch
     char* content_pattern;
     gboolean content_ci;
     gboolean content_regex;
+    gboolean content_skip_binary;
+    guint64 content_max_size;
+    gboolean use_index;
+    char* backend;
     GList* mime_types;
     GList* search_path_list;
     guint64 max_size;
@@ -55,6 +60,7 @@ void fm_search_free(FmSearch* search)
     g_free(search->content_pattern);
     g_free(search->max_mtime);
     g_free(search->min_mtime);
+    g_free(search->backend);
     g_slice_free(FmSearch, search);
 }
 
@@ -68,6 +74,16 @@ void fm_search_set_recursive(FmSearch* search, gboolean recursive)
     search->recursive = recursive;
 }
 
+gboolean fm_search_get_follow_symlinks(FmSearch* search)
+{
+    return search->follow_symlinks;
+}
+
+void fm_search_set_follow_symlinks(FmSearch* search, gboolean follow_symlinks)
+{
+    search->follow_symlinks = follow_symlinks;
+}
+
 gboolean fm_search_get_show_hidden(FmSearch* search)
 {
     return search->show_hidden;
@@ -184,6 +200,47 @@ GList* fm_search_get_mime_types(FmSearch* search)
     return search->mime_types;
 }
 
+gboolean fm_search_get_content_skip_binary(FmSearch* search)
+{
+    return search->content_skip_binary;
+}
+
+void fm_search_set_content_skip_binary(FmSearch* search, gboolean skip_binary)
+{
+    search->content_skip_binary = skip_binary;
+}
+
+guint64 fm_search_get_content_max_size(FmSearch* search)
+{
+    return search->content_max_size;
+}
+
+void fm_search_set_content_max_size(FmSearch* search, guint64 size)
+{
+    search->content_max_size = size;
+}
+
+gboolean fm_search_get_use_index(FmSearch* search)
+{
+    return search->use_index;
+}
+
+void fm_search_set_use_index(FmSearch* search, gboolean use_index)
+{
+    search->use_index = use_index;
+}
+
+const char* fm_search_get_backend(FmSearch* search)
+{
+    return search->backend;
+}
+
+void fm_search_set_backend(FmSearch* search, const char* backend)
+{
+    g_free(search->backend);
+    search->backend = g_strdup(backend);
+}
+
 guint64 fm_search_get_max_size(FmSearch* search)
 {
     return search->max_size;
@@ -257,6 +314,8 @@ GFile* fm_search_to_gfile(FmSearch* search)
 
         g_string_append_c(search_str, '?');
         g_string_append_printf(search_str, "recursive=%c", search->recursive ? '1' : '0');
+        if(search->follow_symlinks)
+            g_string_append(search_str, "&follow_symlinks=1");
         g_string_append_printf(search_str, "&show_hidden=%c", search->show_hidden ? '1' : '0');
         if(search->name_patterns && *search->name_patterns)
         {
@@ -282,6 +341,10 @@ GFile* fm_search_to_gfile(FmSearch* search)
             g_free(escaped);
             if(search->content_ci)
                 g_string_append_printf(search_str, "&content_ci=%c", search->content_ci ? '1' : '0');
+            if(search->content_skip_binary)
+                g_string_append(search_str, "&content_skip_binary=1");
+            if(search->content_max_size)
+                g_string_append_printf(search_str, "&content_max_size=%llu", (unsigned long long)search->content_max_size);
         }
 
         /* search for the files of specific mime-types */
@@ -310,6 +373,16 @@ GFile* fm_search_to_gfile(FmSearch* search)
         if(search->max_mtime)
             g_string_append_printf(search_str, "&max_mtime=%s", search->max_mtime);
 
+        if(search->use_index)
+            g_string_append(search_str, "&use_index=1");
+
+        if(search->backend && *search->backend)
+        {
+            escaped = g_uri_escape_string(search->backend, NULL, TRUE);
+            g_string_append_printf(search_str, "&backend=%s", escaped);
+            g_free(escaped);
+        }
+
         search_path = g_file_new_for_uri(search_str->str);
         g_string_free(search_str, TRUE);
     }
@@ -41,6 +41,10 @@ GFile* fm_search_to_gfile(FmSearch* search);
 gboolean fm_search_get_recursive(FmSearch* search);
 void fm_search_set_recursive(FmSearch* search, gboolean recursive);
 
+/* search the folders symlinks point to as well, each folder is searched once */
+gboolean fm_search_get_follow_symlinks(FmSearch* search);
+void fm_search_set_follow_symlinks(FmSearch* search, gboolean follow_symlinks);
+
 gboolean fm_search_get_show_hidden(FmSearch* search);
 void fm_search_set_show_hidden(FmSearch* search, gboolean show_hidden);
 
@@ -62,6 +66,22 @@ void fm_search_set_content_ci(FmSearch* search, gboolean content_ci);
 gboolean fm_search_get_content_regex(FmSearch* search);
 void fm_search_set_content_regex(FmSearch* search, gboolean content_regex);
 
+/* don't search the contents of files which look binary */
+gboolean fm_search_get_content_skip_binary(FmSearch* search);
+void fm_search_set_content_skip_binary(FmSearch* search, gboolean skip_binary);
+
+/* don't search the contents of files larger than this (0 means no limit) */
+guint64 fm_search_get_content_max_size(FmSearch* search);
+void fm_search_set_content_max_size(FmSearch* search, guint64 size);
+
+/* find the files by name in the file name index of local folders */
+gboolean fm_search_get_use_index(FmSearch* search);
+void fm_search_set_use_index(FmSearch* search, gboolean use_index);
+
+/* find the files with the named search backend, like "locate", instead of walking the folders */
+const char* fm_search_get_backend(FmSearch* search);
+void fm_search_set_backend(FmSearch* search, const char* backend);
+
 void fm_search_add_dir(FmSearch* search, const char* dir);
 void fm_search_remove_dir(FmSearch* search, const char* dir);
 GList* fm_search_get_dirs(FmSearch* search);
@@ -20,6 +20,7 @@
 
 #include "folderitemdelegate.h"
 #include "foldermodel.h"
+#include "core/iconinfo.h"
 #include <QPainter>
 #include <QModelIndex>
 #include <QAbstractItemView>
@@ -32,18 +33,29 @@
 #include <QLineEdit>
 #include <QTextEdit>
 #include <QTimer>
+#include <QPixmapCache>
 #include <QDebug>
 
 namespace Fm {
 
+// enough for the items shown by a few views on a large screen
+static const int maxCachedTextLayouts = 4096;
+
 FolderItemDelegate::FolderItemDelegate(QAbstractItemView* view, QObject* parent):
     QStyledItemDelegate(parent ? parent : view),
     symlinkIcon_(QIcon::fromTheme("emblem-symbolic-link")),
     fileInfoRole_(Fm::FolderModel::FileInfoRole),
     iconInfoRole_(-1),
     margins_(QSize(3, 3)),
-    hasEditor_(false) {
+    hasEditor_(false),
+    textLayouts_(maxCachedTextLayouts) {
     connect(this,  &QAbstractItemDelegate::closeEditor, [=]{hasEditor_ = false;});
+    // the icons are rendered after they're painted for the first time
+    if(view) {
+        connect(IconPixmapLoader::instance(), &IconPixmapLoader::pixmapsReady, view->viewport(), [view] {
+            view->viewport()->update();
+        });
+    }
 }
 
 FolderItemDelegate::~FolderItemDelegate() {
@@ -88,6 +100,23 @@ QSize FolderItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QMo
     return style->sizeFromContents(QStyle::CT_ItemViewItem, &opt, QSize(), widget);
 }
 
+// static
+QPixmap FolderItemDelegate::cachedPixmap(const QIcon& icon, const QSize& size, QIcon::Mode mode) {
+    // the serial of the icon theme is a part of the key, so the pixmaps of the old theme aren't used
+    QString key = QStringLiteral("fm-icon-%1-%2x%3-%4-%5-%6")
+                  .arg(icon.cacheKey()).arg(size.width()).arg(size.height())
+                  .arg(int(mode)).arg(qApp->devicePixelRatio()).arg(IconInfo::themeSerial());
+    QPixmap pixmap;
+    if(!QPixmapCache::find(key, &pixmap)) {
+        pixmap = icon.pixmap(size, mode);
+        // a deferred icon is not rendered yet
+        if(!pixmap.isNull()) {
+            QPixmapCache::insert(key, pixmap);
+        }
+    }
+    return pixmap;
+}
+
 QIcon::Mode FolderItemDelegate::iconModeFromState(const QStyle::State state) {
 
     if(state & QStyle::State_Enabled) {
@@ -101,6 +130,9 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
     if(!index.isValid())
         return;
 
+    // don't block the painting while the icons are rendered
+    IconInfo::DeferredRendering deferredRendering;
+
     // get emblems for this icon
     std::forward_list<std::shared_ptr<const Fm::IconInfo>> icon_emblems;
     auto fmicon = index.data(iconInfoRole_).value<std::shared_ptr<const Fm::IconInfo>>();
@@ -134,9 +166,18 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
         // draw the icon
         QIcon::Mode iconMode = iconModeFromState(opt.state);
         QPoint iconPos(opt.rect.x() + (opt.rect.width() - option.decorationSize.width()) / 2, opt.rect.y() + margins_.height());
-        QPixmap pixmap = opt.icon.pixmap(option.decorationSize, iconMode);
+        QPixmap pixmap;
+        QVariant decoration = index.data(Qt::DecorationRole);
+        if(iconMode == QIcon::Normal && decoration.type() == QVariant::Pixmap) {
+            // a thumbnail, which the model has already scaled for the screen
+            pixmap = decoration.value<QPixmap>();
+        }
+        else {
+            pixmap = cachedPixmap(opt.icon, option.decorationSize, iconMode);
+        }
         // in case the pixmap is smaller than the requested size
-        QSize margin = ((option.decorationSize - pixmap.size()) / 2).expandedTo(QSize(0, 0));
+        QSize pixmapSize = pixmap.size() / pixmap.devicePixelRatio();
+        QSize margin = ((option.decorationSize - pixmapSize) / 2).expandedTo(QSize(0, 0));
         bool isCut = index.data(FolderModel::FileIsCutRole).toBool();
         if(isCut) {
             painter->save();
@@ -150,7 +191,7 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
         // draw some emblems for the item if needed
         if(isSymlink) {
             // draw the emblem for symlinks
-            painter->drawPixmap(iconPos, symlinkIcon_.pixmap(option.decorationSize / 2, iconMode));
+            painter->drawPixmap(iconPos, cachedPixmap(symlinkIcon_, option.decorationSize / 2, iconMode));
         }
 
         // draw other emblems if there's any
@@ -158,7 +199,7 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
             // FIXME: we only support one emblem now
             QPoint emblemPos(opt.rect.x() + opt.rect.width() / 2, opt.rect.y() + option.decorationSize.height() / 2);
             QIcon emblem = emblems.front()->qicon();
-            painter->drawPixmap(emblemPos, emblem.pixmap(option.decorationSize / 2, iconMode));
+            painter->drawPixmap(emblemPos, cachedPixmap(emblem, option.decorationSize / 2, iconMode));
         }
 
         // draw the text
@@ -184,21 +225,29 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
             // draw some emblems for the item if needed
             if(isSymlink) {
                 QPoint iconPos(opt.rect.x(), opt.rect.y() + (opt.rect.height() - option.decorationSize.height()) / 2);
-                painter->drawPixmap(iconPos, symlinkIcon_.pixmap(option.decorationSize / 2, iconMode));
+                painter->drawPixmap(iconPos, cachedPixmap(symlinkIcon_, option.decorationSize / 2, iconMode));
             }
             else {
                 // FIXME: we only support one emblem now
                 QPoint iconPos(opt.rect.x() + option.decorationSize.width() / 2, opt.rect.y() + opt.rect.height() / 2);
                 QIcon emblem = emblems.front()->qicon();
-                painter->drawPixmap(iconPos, emblem.pixmap(option.decorationSize / 2, iconMode));
+                painter->drawPixmap(iconPos, cachedPixmap(emblem, option.decorationSize / 2, iconMode));
             }
         }
     }
 }
 
-// if painter is nullptr, the method calculate the bounding rectangle of the text and save it to textRect
-void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const {
-    QTextLayout layout(opt.text, opt.font);
+const FolderItemDelegate::TextLayout* FolderItemDelegate::textLayout(const QStyleOptionViewItem& opt, const QRectF& textRect) const {
+    // NOTE: the font metrics of the option are not a part of the key since they're made from the font
+    TextLayoutKey key{opt.text, opt.font, textRect.size(), int(opt.displayAlignment), int(opt.textElideMode)};
+    if(auto cached = textLayouts_.object(key)) {
+        return cached;
+    }
+
+    auto data = new TextLayout;
+    QTextLayout& layout = data->layout;
+    layout.setText(opt.text);
+    layout.setFont(opt.font);
     QTextOption textOption;
     textOption.setAlignment(opt.displayAlignment);
     textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
@@ -215,22 +264,22 @@ void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt,
     int visibleLines = 0;
     layout.beginLayout();
     QString elidedText;
-    textRect.adjust(2, 2, -2, -2); // a 2-px margin is considered at FolderView::updateGridSize()
+    QRectF rect = textRect.adjusted(2, 2, -2, -2); // a 2-px margin is considered at FolderView::updateGridSize()
     for(;;) {
         QTextLine line = layout.createLine();
         if(!line.isValid()) {
             break;
         }
-        line.setLineWidth(textRect.width());
+        line.setLineWidth(rect.width());
         height += opt.fontMetrics.leading();
         line.setPosition(QPointF(0, height));
-        if((height + line.height() + textRect.y()) > textRect.bottom()) {
+        if(height + line.height() > rect.height()) {
             // if part of this line falls outside the textRect, ignore it and quit.
             QTextLine lastLine = layout.lineAt(visibleLines - 1);
             elidedText = opt.text.mid(lastLine.textStart());
-            elidedText = opt.fontMetrics.elidedText(elidedText, opt.textElideMode, textRect.width());
+            elidedText = opt.fontMetrics.elidedText(elidedText, opt.textElideMode, rect.width());
             if(visibleLines == 1) { // this is the only visible line
-                width = textRect.width();
+                width = rect.width();
             }
             break;
         }
@@ -239,14 +288,25 @@ void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt,
         ++ visibleLines;
     }
     layout.endLayout();
-    width = qMax(width, (qreal)opt.fontMetrics.width(elidedText));
+    data->visibleLines = visibleLines;
+    data->elidedText = elidedText;
+    data->width = qMax(width, (qreal)opt.fontMetrics.width(elidedText));
+    data->height = height;
+    textLayouts_.insert(key, data);
+    return data;
+}
+
+// if painter is nullptr, the method calculate the bounding rectangle of the text and save it to textRect
+void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const {
+    const TextLayout* data = textLayout(opt, textRect);
+    const QTextLayout& layout = data->layout;
+    const int visibleLines = data->visibleLines;
+    const QString& elidedText = data->elidedText;
+    const qreal width = data->width;
+    textRect.adjust(2, 2, -2, -2); // a 2-px margin is considered at FolderView::updateGridSize()
 
     // draw background for selected item
-    QRectF boundRect = layout.boundingRect();
-    //qDebug() << "bound rect: " << boundRect << "width: " << width;
-    boundRect.setWidth(width);
-    boundRect.setHeight(height);
-    boundRect.moveTo(textRect.x() + (textRect.width() - width) / 2, textRect.y());
+    QRectF boundRect(textRect.x() + (textRect.width() - width) / 2, textRect.y(), width, data->height);
 
     QRectF selRect = boundRect.adjusted(-2, -2, 2, 2);
 
@@ -23,6 +23,9 @@
 
 #include "libfmqtglobals.h"
 #include <QStyledItemDelegate>
+#include <QTextLayout>
+#include <QCache>
+#include <QFont>
 class QAbstractItemView;
 
 namespace Fm {
@@ -104,10 +107,45 @@ public:
     QSize iconViewTextSize(const QModelIndex& index) const;
 
 private:
+    // the wrapped and elided text of an item in the vertical layout, relative to its text rect
+    struct TextLayout {
+        QTextLayout layout;
+        int visibleLines;
+        QString elidedText; // the text of the last visible line if it's elided
+        qreal width;
+        qreal height;
+    };
+
+    // everything the text layout depends on, so a changed text or font gets a new layout
+    struct TextLayoutKey {
+        QString text;
+        QFont font;
+        QSizeF size;
+        int alignment;
+        int elideMode;
+
+        bool operator==(const TextLayoutKey& other) const {
+            return text == other.text && font == other.font && size == other.size
+                   && alignment == other.alignment && elideMode == other.elideMode;
+        }
+
+        friend uint qHash(const TextLayoutKey& key, uint seed = 0) {
+            return qHash(key.text, seed) ^ qHash(key.font, seed) ^ qHash(int(key.size.width()) << 16 | int(key.size.height()), seed)
+                   ^ qHash(key.alignment << 8 | key.elideMode, seed);
+        }
+    };
+
+    // get the cached layout of the text, or lay it out in the rect which has a 2-px margin
+    const TextLayout* textLayout(const QStyleOptionViewItem& opt, const QRectF& textRect) const;
+
     void drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const;
 
     static QIcon::Mode iconModeFromState(QStyle::State state);
 
+    // The pixmaps of the icons are shared by all the views in QPixmapCache, so that they're not
+    // looked up and scaled again whenever the items are painted.
+    static QPixmap cachedPixmap(const QIcon& icon, const QSize& size, QIcon::Mode mode);
+
 private:
     QIcon symlinkIcon_;
     QSize iconSize_;
@@ -117,6 +155,8 @@ private:
     QColor shadowColor_;
     QSize margins_;
     mutable bool hasEditor_;
+    // sizeHint() and paint() lay out the same texts again and again while scrolling and resizing
+    mutable QCache<TextLayoutKey, TextLayout> textLayouts_;
 };
 
 }
@@ -21,6 +21,9 @@
 #include "foldermodel.h"
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <climits>
+#include <unordered_set>
 #include <QtAlgorithms>
 #include <QVector>
 #include <qmimedata.h>
@@ -28,15 +31,56 @@
 #include <QByteArray>
 #include <QPixmap>
 #include <QPainter>
+#include <QGuiApplication>
 #include <QTimer>
 #include "utilities.h"
 #include "fileoperation.h"
+#include "core/userinfocache.h"
+#include "core/dirsizecache.h"
+#include "core/resultqueue_p.h"
+#include "core/stats.h"
+#include "filelistmimedata_p.h"
 
 namespace Fm {
 
+// the view states kept by default, which are many more than the items shown by a view at once
+static const int defaultViewStateLimit = 10000;
+
+// the approximate bytes of an item without its view state: the item allocated by QList with the
+// pointer to it, and the nodes of the two hash tables indexing it
+static const size_t itemMemoryUsage = sizeof(FolderModelItem) + 3 * sizeof(void*) + 2 * 4 * sizeof(void*);
+
+// The pixmap of a thumbnail at the icon size on the screen, so the views draw it without scaling.
+static QPixmap thumbnailPixmap(const QImage& image, int size) {
+    qreal dpr = qApp->devicePixelRatio();
+    int deviceSize = qRound(size * dpr);
+    QPixmap pixmap;
+    if(image.width() > deviceSize || image.height() > deviceSize) {
+        pixmap = QPixmap::fromImage(image.scaled(deviceSize, deviceSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+    else {
+        pixmap = QPixmap::fromImage(image);
+    }
+    pixmap.setDevicePixelRatio(dpr);
+    return pixmap;
+}
+
 FolderModel::FolderModel():
+    rowsDirty_{false},
     hasPendingThumbnailHandler_{false},
+    hasVisibleIndexes_{false},
+    viewStateLimit_{defaultViewStateLimit},
+    lastShownSerial_{0},
+    memoryUsage_{0},
     showFullNames_{false} {
+    // the owners and groups are looked up in a worker thread
+    connect(Fm::UserInfoCache::globalInstance(), &Fm::UserInfoCache::changed, this, &FolderModel::onUserInfoChanged);
+    // the thumbnail jobs queue their results instead of waiting for the model to handle each of them
+    loadedThumbnails_ = Fm::ResultQueue<LoadedThumbnail>::create(this, [this](std::vector<LoadedThumbnail>& thumbnails) {
+        onThumbnailsLoaded(thumbnails);
+    });
+    memoryPressure_ = Fm::MemoryPressure::globalInstance();
+    connect(memoryPressure_.get(), &Fm::MemoryPressure::trimRequested, this, &FolderModel::onMemoryPressure);
 }
 
 FolderModel::~FolderModel() {
@@ -44,11 +88,14 @@ FolderModel::~FolderModel() {
     for(auto job: pendingThumbnailJobs_) {
         job->cancel();
     }
+    Stats::add(Stats::FOLDER_MODEL_MEMORY_BYTES, -std::int64_t(memoryUsage_));
 }
 
 void FolderModel::setFolder(const std::shared_ptr<Fm::Folder>& new_folder) {
+    bool wasLarge = isLargeFolder();
     if(folder_) {
         removeAll();        // remove old items
+        disconnect(folder_.get(), &Fm::Folder::largeChanged, this, &FolderModel::onFolderLargeChanged);
     }
     if(new_folder) {
         folder_ = new_folder;
@@ -57,11 +104,19 @@ void FolderModel::setFolder(const std::shared_ptr<Fm::Folder>& new_folder) {
         connect(folder_.get(), &Fm::Folder::filesAdded, this, &FolderModel::onFilesAdded);
         connect(folder_.get(), &Fm::Folder::filesChanged, this, &FolderModel::onFilesChanged);
         connect(folder_.get(), &Fm::Folder::filesRemoved, this, &FolderModel::onFilesRemoved);
-        // handle the case if the folder is already loaded
-        if(folder_->isLoaded()) {
-            insertFiles(0, folder_->files());
+        connect(folder_.get(), &Fm::Folder::largeChanged, this, &FolderModel::onFolderLargeChanged);
+        // handle the case if the folder is already (partially) loaded
+        if(folder_->isLoaded() || folder_->isIncremental()) {
+            insertFiles(0, *folder_->filesSnapshot());
         }
     }
+    if(isLargeFolder() != wasLarge) {
+        Q_EMIT largeFolderChanged(!wasLarge);
+    }
+}
+
+void FolderModel::onFolderLargeChanged(bool large) {
+    Q_EMIT largeFolderChanged(large);
 }
 
 void FolderModel::onStartLoading() {
@@ -76,14 +131,13 @@ void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
     int n_files = files.size();
     beginInsertRows(QModelIndex(), items.count(), items.count() + n_files - 1);
     for(auto& info : files) {
-        FolderModelItem item(info);
         /*
             if(fm_file_info_is_hidden(info)) {
               model->hiddenItems.append(item);
               continue;
             }
         */
-        items.append(item);
+        appendItem(info);
     }
     endInsertRows();
     Q_EMIT filesAdded(files);
@@ -98,8 +152,13 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
         if(it != items.end()) {
             FolderModelItem& item = *it;
             // try to update the item
+            unindexItem(&item);
             item.info = newInfo;
-            item.thumbnails.clear();
+            indexItem(&item);
+            item.invalidateSortKey();
+            item.invalidateDisplayStrings();
+            item.removeThumbnails();
+            countViewState(&item);
             QModelIndex index = createIndex(row, 0, &item);
             Q_EMIT dataChanged(index, index);
             if(oldInfo->size() != newInfo->size()) {
@@ -110,31 +169,125 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
 }
 
 void FolderModel::onFilesRemoved(const Fm::FileInfoList& files) {
+    // find all rows first while the rows stored in the items are still valid
+    std::vector<int> rows;
+    rows.reserve(files.size());
     for(auto& info : files) {
         int row;
-        QList<FolderModelItem>::iterator it = findItemByName(info->name().c_str(), &row);
-        if(it != items.end()) {
-            beginRemoveRows(QModelIndex(), row, row);
-            items.erase(it);
-            endRemoveRows();
+        if(findItemByName(info->name().c_str(), &row) != items.end()) {
+            rows.push_back(row);
         }
     }
+    // remove the rows from the bottom, so the rows found above stay valid.
+    // Adjacent rows are removed together to reduce the remapping done by the proxy models and views.
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    for(size_t i = 0; i < rows.size();) {
+        int last = rows[i];
+        int first = last;
+        for(++i; i < rows.size() && (rows[i] == first - 1 || rows[i] == first); ++i) {
+            first = rows[i];
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        for(int row = first; row <= last; ++row) {
+            unindexItem(&items[row]);
+            addMemoryUsage(-std::int64_t(itemMemoryUsage + items[row].countedMemory_));
+        }
+        forgetShownItems(items.begin() + first, items.begin() + last + 1);
+        items.erase(items.begin() + first, items.begin() + last + 1);
+        rowsDirty_ = true;
+        endRemoveRows();
+    }
 }
 
 void FolderModel::loadPendingThumbnails() {
     hasPendingThumbnailHandler_ = false;
+    // The requests are split into small jobs, so the requests of the items which become visible
+    // later can still be moved before the ones which are scrolled away.
+    const size_t jobSize = 16;
+    const size_t maxJobs = std::max(1, Fm::ThumbnailJob::maxThreadCount());
+    bool visibleOnly = hasVisibleIndexes_ && isLargeFolder();
     for(auto& item: thumbnailData_) {
-        if(!item.pendingThumbnails_.empty()) {
-            auto job = new Fm::ThumbnailJob(std::move(item.pendingThumbnails_), item.size_);
+        if(hasVisibleIndexes_) {
+            prioritizePendingThumbnails(item.pendingThumbnails_);
+        }
+        if(visibleOnly) {
+            dropHiddenThumbnails(item);
+        }
+        while(!item.pendingThumbnails_.empty() && pendingThumbnailJobs_.size() < maxJobs) {
+            auto& pending = item.pendingThumbnails_;
+            auto end = pending.begin() + std::min(jobSize, pending.size());
+            Fm::FileInfoList files;
+            files.insert(files.end(), pending.begin(), end);
+            pending.erase(pending.begin(), end);
+            // the thumbnails are loaded at the size in device pixels, so they're sharp on HiDPI screens
+            int size = item.size_;
+            auto job = new Fm::ThumbnailJob(std::move(files), qRound(size * qApp->devicePixelRatio()));
+            // the previews are replaced by the real thumbnails through onThumbnailsLoaded()
+            job->setProgressive(true);
             pendingThumbnailJobs_.push_back(job);
-            job->setAutoDelete(true);
-            connect(job, &Fm::ThumbnailJob::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded, Qt::BlockingQueuedConnection);
-            connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished, Qt::BlockingQueuedConnection);
+            // the job is deleted after its finished() is handled, instead of by the thread pool,
+            // so the pointers in pendingThumbnailJobs_ stay valid until they're removed
+            job->setAutoDelete(false);
+            auto results = loadedThumbnails_;
+            connect(job, &Fm::ThumbnailJob::thumbnailLoaded, [results, size](const std::shared_ptr<const Fm::FileInfo>& file, int /*deviceSize*/, QImage image) {
+                results->push(LoadedThumbnail{file, size, std::move(image)});
+            });
+            connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished, Qt::QueuedConnection);
+            connect(job, &Fm::ThumbnailJob::finished, job, &Fm::ThumbnailJob::deleteLater, Qt::QueuedConnection);
             Fm::ThumbnailJob::threadPool()->start(job);
         }
     }
 }
 
+// move the requests of the visible items to the front, in the order of their priorities.
+// NOTE: the requests of the other items are kept, since they might be shown by other views of this model.
+void FolderModel::prioritizePendingThumbnails(Fm::FileInfoList& pending) {
+    std::vector<std::pair<int, std::shared_ptr<const Fm::FileInfo>>> ranked;
+    ranked.reserve(pending.size());
+    for(auto& file: pending) {
+        auto rankIt = visibleRanks_.find(file.get());
+        ranked.emplace_back(rankIt != visibleRanks_.end() ? rankIt->second : INT_MAX, std::move(file));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, std::shared_ptr<const Fm::FileInfo>>& a,
+                                                      const std::pair<int, std::shared_ptr<const Fm::FileInfo>>& b) {
+        return a.first < b.first;
+    });
+    pending.clear();
+    for(auto& rankedFile: ranked) {
+        pending.push_back(std::move(rankedFile.second));
+    }
+}
+
+// In a large folder, the items scrolled past quickly would keep the thumbnail threads busy long after
+// they're not shown. Their requests are dropped, and they're requested again when they're shown.
+void FolderModel::dropHiddenThumbnails(ThumbnailData& data) {
+    auto& pending = data.pendingThumbnails_;
+    // the visible ones are moved to the front by prioritizePendingThumbnails()
+    auto firstHidden = std::find_if(pending.begin(), pending.end(), [this](const std::shared_ptr<const Fm::FileInfo>& file) {
+        return visibleRanks_.find(file.get()) == visibleRanks_.end();
+    });
+    for(auto it = firstHidden; it != pending.end(); ++it) {
+        auto itemIt = itemsByInfo_.find(it->get());
+        if(itemIt != itemsByInfo_.end()) {
+            // the status is "not checked" again
+            itemIt->second->removeThumbnail(data.size_);
+            countViewState(itemIt->second);
+        }
+    }
+    pending.erase(firstHidden, pending.end());
+}
+
+void FolderModel::setVisibleIndexes(const QModelIndexList& indexes) {
+    visibleRanks_.clear();
+    int rank = 0;
+    for(const auto& index: indexes) {
+        if(FolderModelItem* item = itemFromIndex(index)) {
+            visibleRanks_.emplace(item->info.get(), rank++);
+        }
+    }
+    hasVisibleIndexes_ = true;
+}
+
 void FolderModel::queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size) {
     auto it = std::find_if(thumbnailData_.begin(), thumbnailData_.end(), [size](ThumbnailData& item){return item.size_ == size;});
     if(it != thumbnailData_.end()) {
@@ -148,24 +301,125 @@ void FolderModel::queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>&
 
 void FolderModel::insertFiles(int row, const Fm::FileInfoList& files) {
     int n_files = files.size();
+    if(n_files == 0) {
+        return;
+    }
     beginInsertRows(QModelIndex(), row, row + n_files - 1);
     for(auto& info : files) {
-        FolderModelItem item(info);
-        items.append(item);
+        appendItem(info);
     }
     endInsertRows();
 }
 
+void FolderModel::appendItem(const std::shared_ptr<const Fm::FileInfo>& info) {
+    items.append(FolderModelItem{info});
+    FolderModelItem& item = items.last();
+    item.row_ = items.size() - 1;
+    indexItem(&item);
+    addMemoryUsage(itemMemoryUsage);
+}
+
+void FolderModel::indexItem(FolderModelItem* item) {
+    itemsByName_[item->info->name().c_str()] = item;
+    itemsByInfo_[item->info.get()] = item;
+}
+
+void FolderModel::unindexItem(FolderModelItem* item) {
+    auto nameIt = itemsByName_.find(item->info->name().c_str());
+    if(nameIt != itemsByName_.end() && nameIt->second == item) {
+        itemsByName_.erase(nameIt);
+    }
+    itemsByInfo_.erase(item->info.get());
+}
+
+QList<FolderModelItem>::iterator FolderModel::iteratorOfItem(FolderModelItem* item, int* row) {
+    if(rowsDirty_) {
+        // renumber all items once instead of shifting the rows on every removal
+        int i = 0;
+        for(auto& it : items) {
+            it.row_ = i++;
+        }
+        rowsDirty_ = false;
+    }
+    *row = item->row_;
+    return items.begin() + item->row_;
+}
+
+void FolderModel::setViewStateLimit(int limit) {
+    viewStateLimit_ = limit;
+    if(limit > 0 && shownItems_.size() > size_t(limit)) {
+        releaseOldViewStates();
+    }
+}
+
+void FolderModel::touchItem(FolderModelItem* item) const {
+    if(viewStateLimit_ <= 0) {
+        return;
+    }
+    if(item->lastShown_ == 0) {
+        if(shownItems_.size() >= size_t(viewStateLimit_)) {
+            releaseOldViewStates();
+        }
+        shownItems_.push_back(item);
+    }
+    item->lastShown_ = ++lastShownSerial_;
+}
+
+void FolderModel::releaseOldViewStates() const {
+    // free half of the states at once, so the items are not sorted for each new one
+    size_t kept = std::max(viewStateLimit_, 2) / 2;
+    if(shownItems_.size() <= kept) {
+        return;
+    }
+    std::nth_element(shownItems_.begin(), shownItems_.begin() + kept, shownItems_.end(),
+                     [](const FolderModelItem* a, const FolderModelItem* b) {
+        return a->lastShown_ > b->lastShown_;
+    });
+    for(auto it = shownItems_.begin() + kept; it != shownItems_.end(); ++it) {
+        (*it)->releaseViewState();
+        (*it)->lastShown_ = 0;
+        countViewState(*it);
+    }
+    shownItems_.resize(kept);
+}
+
+void FolderModel::forgetShownItems(QList<FolderModelItem>::iterator first, QList<FolderModelItem>::iterator last) {
+    std::unordered_set<const FolderModelItem*> removed;
+    for(auto it = first; it != last; ++it) {
+        if(it->lastShown_ != 0) {
+            removed.insert(&*it);
+        }
+    }
+    if(!removed.empty()) {
+        shownItems_.erase(std::remove_if(shownItems_.begin(), shownItems_.end(), [&removed](const FolderModelItem* item) {
+            return removed.count(item) != 0;
+        }), shownItems_.end());
+    }
+}
+
+void FolderModel::countViewState(const FolderModelItem* item) const {
+    size_t bytes = item->viewStateMemoryUsage();
+    if(bytes != item->countedMemory_) {
+        addMemoryUsage(std::int64_t(bytes) - std::int64_t(item->countedMemory_));
+        item->countedMemory_ = bytes;
+    }
+}
+
+void FolderModel::addMemoryUsage(std::int64_t delta) const {
+    memoryUsage_ += size_t(delta);
+    Stats::add(Stats::FOLDER_MODEL_MEMORY_BYTES, delta);
+}
+
 void FolderModel::setCutFiles(const QItemSelection& selection) {
     if(folder_) {
         if(!selection.isEmpty()) {
-            auto cutFilesHashSet = std::make_shared<HashSet>();
+            auto cutFilesHashSet = std::make_shared<CutFileSet>();
             folder_->setCutFiles(cutFilesHashSet);
             const auto indexes = selection.indexes();
             for(const auto& index : indexes) {
                 auto item = itemFromIndex(index);
                 item->bindCutFiles(cutFilesHashSet);
-                cutFilesHashSet->insert(item->info->path().hash());
+                cutFilesHashSet->insert(item->info->dirPath(), item->info->name());
             }
         }
         Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, 0));
@@ -178,6 +432,12 @@ void FolderModel::removeAll() {
     }
     beginRemoveRows(QModelIndex(), 0, items.size() - 1);
     items.clear();
+    addMemoryUsage(-std::int64_t(memoryUsage_));
+    itemsByName_.clear();
+    itemsByInfo_.clear();
+    visibleRanks_.clear();
+    shownItems_.clear();
+    rowsDirty_ = false;
     endRemoveRows();
 }
 
@@ -210,6 +470,9 @@ QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRol
     }
     FolderModelItem* item = itemFromIndex(index);
     auto info = item->info;
+    if(role == Qt::DisplayRole) {
+        touchItem(item);
+    }
 
     bool isCut = false;
     if(folder_ && Q_UNLIKELY(folder_->hasCutFiles())) {
@@ -220,25 +483,50 @@ QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRol
     case Qt::ToolTipRole:
         return QVariant(item->displayName());
     case Qt::DisplayRole:  {
+        // the display strings are created on demand, so they're counted once they're returned
+        QVariant result;
         switch(index.column()) {
         case ColumnFileName:
-            return (showFullNames_ && !item->name().empty() ? QString::fromStdString(item->name())
-                                                            : item->displayName());
+            result = (showFullNames_ && !item->name().empty() ? item->displayFullName()
+                                                              : item->displayName());
+            break;
         case ColumnFileType:
-            return QString(info->mimeType()->desc());
+            result = item->displayType();
+            break;
         case ColumnFileMTime:
-            return item->displayMtime();
+            result = item->displayMtime();
+            break;
         case ColumnFileSize:
-            return item->displaySize();
+            if(dirSizeCache_ && info->isDir() && !info->isSymlink()) {
+                // not kept in the view state since it's changed by the cache
+                std::uint64_t size;
+                auto path = info->path();
+                if(dirSizeCache_->size(path, info->mtime(), &size)) {
+                    result = Fm::formatFileSize(size, false);
+                }
+                else {
+                    dirSizeCache_->requestSize(path, info->mtime());
+                }
+                break;
+            }
+            result = item->displaySize();
+            break;
         case ColumnFileOwner:
-            return item->ownerName();
+            result = item->ownerName();
+            break;
         case ColumnFileGroup:
-            return item->ownerGroup();
+            result = item->ownerGroup();
+            break;
         }
-        break;
+        countViewState(item);
+        return result;
     }
     case Qt::DecorationRole: {
         if(index.column() == 0) {
+            // the item is being shown, so load its details if they're deferred
+            if(Q_UNLIKELY(info->isPartial()) && folder_) {
+                folder_->loadDetails(info);
+            }
             return QVariant(item->icon(isCut));
         }
         break;
@@ -335,36 +623,20 @@ QList<FolderModelItem>::iterator FolderModel::findItemByPath(const Fm::FilePath&
     return items.end();
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
 QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info->name() == name) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+    auto it = itemsByName_.find(name);
+    if(it == itemsByName_.end()) {
+        return items.end();
     }
-    return items.end();
+    return iteratorOfItem(it->second, row);
 }
 
 QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info.get() == info) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+    auto it = itemsByInfo_.find(info);
+    if(it == itemsByInfo_.end()) {
+        return items.end();
     }
-    return items.end();
+    return iteratorOfItem(it->second, row);
 }
 
 QStringList FolderModel::mimeTypes() const {
@@ -382,25 +654,31 @@ QStringList FolderModel::mimeTypes() const {
 }
 
 QMimeData* FolderModel::mimeData(const QModelIndexList& indexes) const {
-    QMimeData* data = QAbstractItemModel::mimeData(indexes);
     //qDebug("FolderModel::mimeData");
-    // build a uri list
-    QByteArray urilist;
-    urilist.reserve(4096);
-
+    if(indexes.isEmpty()) {
+        return nullptr;
+    }
+    // The uri list is only built when it's requested, which might never happen if the files
+    // are dropped in the same program.
+    Fm::FilePathList paths;
+    paths.reserve(indexes.size());
     for(const auto& index : indexes) {
+        // the other columns of a row have the same file
+        if(index.column() != ColumnFileName) {
+            continue;
+        }
         FolderModelItem* item = itemFromIndex(index);
         if(item && item->info) {
             auto path = item->info->path();
             if(path.isValid()) {
-                auto uri = path.uri();
-                urilist.append(uri.get());
-                urilist.append('\n');
+                paths.push_back(std::move(path));
             }
         }
     }
-    data->setData("text/uri-list", urilist);
-
+    QMimeData* data = new FileListMimeData{std::move(paths)};
+    // Only dropMimeData() checks this format, so the data of the items are not encoded
+    // into it like QAbstractItemModel::mimeData() does, which is slow for many files.
+    data->setData("application/x-qabstractitemmodeldatalist", QByteArray());
     return data;
 }
 
@@ -438,7 +716,7 @@ bool FolderModel::dropMimeData(const QMimeData* data, Qt::DropAction action, int
     // FIXME: should we put this in dropEvent handler of FolderView instead?
     if(data->hasUrls()) {
         //qDebug("drop action: %d", action);
-        auto srcPaths = pathListFromQUrls(data->urls());
+        auto srcPaths = pathListFromMimeData(*data);
         switch(action) {
         case Qt::CopyAction:
             FileOperation::copyFiles(srcPaths, destPath);
@@ -491,6 +769,7 @@ void FolderModel::releaseThumbnails(int size) {
             for(itemIt = items.begin(); itemIt != items.end(); ++itemIt) {
                 FolderModelItem& item = *itemIt;
                 item.removeThumbnail(size);
+                countViewState(&item);
             }
             break;
         }
@@ -504,31 +783,123 @@ void FolderModel::onThumbnailJobFinished() {
     if(it != pendingThumbnailJobs_.end()) {
         pendingThumbnailJobs_.erase(it);
     }
+    // start the next job if there are pending requests
+    if(!hasPendingThumbnailHandler_
+            && std::any_of(thumbnailData_.cbegin(), thumbnailData_.cend(), [](const ThumbnailData& data) {
+                return !data.pendingThumbnails_.empty();
+            })) {
+        QTimer::singleShot(0, this, &FolderModel::loadPendingThumbnails);
+        hasPendingThumbnailHandler_ = true;
+    }
+}
+
+void FolderModel::onUserInfoChanged() {
+    // update the rows showing the numeric ids of the owners or groups which were looked up
+    int first = -1, last = -1;
+    for(int row = 0; row < items.size(); ++row) {
+        if(items[row].isOwnerPending()) {
+            if(first < 0) {
+                first = row;
+            }
+            last = row;
+        }
+    }
+    if(first >= 0) {
+        Q_EMIT dataChanged(index(first, ColumnFileOwner), index(last, ColumnFileGroup));
+    }
+}
+
+void FolderModel::setShowDirSizes(bool show) {
+    if(show == showDirSizes()) {
+        return;
+    }
+    if(show) {
+        dirSizeCache_ = Fm::DirSizeCache::globalInstance();
+        connect(dirSizeCache_.get(), &Fm::DirSizeCache::sizeChanged, this, &FolderModel::onDirSizeChanged);
+        connect(dirSizeCache_.get(), &Fm::DirSizeCache::invalidated, this, &FolderModel::onDirSizeChanged);
+    }
+    else {
+        disconnect(dirSizeCache_.get(), nullptr, this, nullptr);
+        dirSizeCache_.reset();
+    }
+    if(!items.isEmpty()) {
+        Q_EMIT dataChanged(index(0, ColumnFileSize), index(items.size() - 1, ColumnFileSize));
+    }
+}
+
+std::uint64_t FolderModel::fileSize(const FolderModelItem* item) const {
+    const auto& info = item->info;
+    std::uint64_t size;
+    if(dirSizeCache_ && info->isDir() && !info->isSymlink()
+            && dirSizeCache_->size(info->path(), info->mtime(), &size)) {
+        return size;
+    }
+    return info->size();
 }
 
-void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image) {
-    // find the model item this thumbnail belongs to
+void FolderModel::onDirSizeChanged(const Fm::FilePath& dir) {
+    // the size of a dir in this folder is got or forgotten
+    FilePath dirPath = dir;
+    if(!folder_ || !dirPath.hasParent() || dirPath.parent() != folder_->path()) {
+        return;
+    }
     int row;
-    QList<FolderModelItem>::iterator it = findItemByFileInfo(file.get(), &row);
+    auto it = findItemByName(dirPath.baseName().get(), &row);
     if(it != items.end()) {
+        QModelIndex sizeIndex = index(row, ColumnFileSize);
+        Q_EMIT dataChanged(sizeIndex, sizeIndex);
+    }
+}
+
+void FolderModel::onMemoryPressure(Fm::MemoryPressure::Level level) {
+    if(level == Fm::MemoryPressure::Critical) {
+        // the views create the states of the items they show again
+        for(auto& item : items) {
+            if(item.hasViewState()) {
+                item.releaseViewState();
+                item.lastShown_ = 0;
+                countViewState(&item);
+            }
+        }
+        shownItems_.clear();
+    }
+    else {
+        releaseOldViewStates();
+    }
+}
+
+void FolderModel::onThumbnailsLoaded(std::vector<LoadedThumbnail>& thumbnails) {
+    for(auto& loaded: thumbnails) {
+        const auto& image = loaded.image;
+        int size = loaded.size;
+        // find the model item this thumbnail belongs to
+        int row;
+        QList<FolderModelItem>::iterator it = findItemByFileInfo(loaded.file.get(), &row);
+        if(it == items.end()) {
+            continue;
+        }
         // the file is found in our model
         FolderModelItem& item = *it;
         QModelIndex index = createIndex(row, 0, (void*)&item);
         // store the image in the folder model item.
+        touchItem(&item);
         FolderModelItem::Thumbnail* thumbnail = item.findThumbnail(size, false);
         thumbnail->image = image;
         thumbnail->transparent = false;
         // qDebug("thumbnail loaded for: %s, size: %d", item.displayName.toUtf8().constData(), size);
         if(image.isNull()) {
             thumbnail->status = FolderModelItem::ThumbnailFailed;
+            thumbnail->pixmap = QPixmap();
         }
         else {
             thumbnail->status = FolderModelItem::ThumbnailLoaded;
-            thumbnail->image = image;
+            // converted here once, so painting it is only a blit
+            thumbnail->pixmap = thumbnailPixmap(image, size);
 
             // tell the world that we have the thumbnail loaded
             Q_EMIT thumbnailLoaded(index, size);
         }
+        countViewState(&item);
     }
 }
 
@@ -537,8 +908,12 @@ void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& f
 QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
     FolderModelItem* item = itemFromIndex(index);
     if(item) {
+        touchItem(item);
         FolderModelItem::Thumbnail* thumbnail = item->findThumbnail(size, item->isCut());
+        // a transparent copy of the thumbnail might be added
+        countViewState(item);
         // qDebug("FolderModel::thumbnailFromIndex: %d, %s", thumbnail->status, item->displayName.toUtf8().data());
+        Stats::add(Stats::THUMBNAIL_REQUESTS);
         switch(thumbnail->status) {
         case FolderModelItem::ThumbnailNotChecked: {
             // load the thumbnail
@@ -547,6 +922,7 @@ QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
             break;
         }
         case FolderModelItem::ThumbnailLoaded:
+            Stats::add(Stats::THUMBNAIL_MODEL_HITS);
             return thumbnail->image;
         default:
             ;
@@ -555,5 +931,34 @@ QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
     return QImage();
 }
 
+QPixmap FolderModel::thumbnailPixmapFromIndex(const QModelIndex& index, int size) {
+    FolderModelItem* item = itemFromIndex(index);
+    if(item) {
+        touchItem(item);
+        FolderModelItem::Thumbnail* thumbnail = item->findThumbnail(size, item->isCut());
+        // a transparent copy of the thumbnail might be added
+        countViewState(item);
+        Stats::add(Stats::THUMBNAIL_REQUESTS);
+        switch(thumbnail->status) {
+        case FolderModelItem::ThumbnailNotChecked: {
+            // load the thumbnail
+            queueLoadThumbnail(item->info, size);
+            thumbnail->status = FolderModelItem::ThumbnailLoading;
+            break;
+        }
+        case FolderModelItem::ThumbnailLoaded:
+            Stats::add(Stats::THUMBNAIL_MODEL_HITS);
+            // the transparent thumbnails of the cut files are made later, and the screen might be changed
+            if(thumbnail->pixmap.isNull() || thumbnail->pixmap.devicePixelRatio() != qApp->devicePixelRatio()) {
+                thumbnail->pixmap = thumbnailPixmap(thumbnail->image, size);
+            }
+            return thumbnail->pixmap;
+        default:
+            ;
+        }
+    }
+    return QPixmap();
+}
+
 
 } // namespace Fm
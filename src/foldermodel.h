@@ -28,15 +28,22 @@
 #include <QImage>
 #include <QList>
 #include <vector>
+#include <cstdint>
 #include <utility>
 #include <forward_list>
+#include <unordered_map>
 #include "foldermodelitem.h"
 
 #include "core/folder.h"
 #include "core/thumbnailjob.h"
+#include "core/memorypressure.h"
+#include "core/cstrptr.h"
 
 namespace Fm {
 
+template <typename T> class ResultQueue;
+class DirSizeCache;
+
 class LIBFM_QT_API FolderModel : public QAbstractListModel {
     Q_OBJECT
 public:
@@ -88,21 +95,70 @@ public:
 
     std::shared_ptr<const Fm::FileInfo> fileInfoFromIndex(const QModelIndex& index) const;
     FolderModelItem* itemFromIndex(const QModelIndex& index) const;
+    // The size is in device independent pixels, and the image is loaded at the size in device pixels.
     QImage thumbnailFromIndex(const QModelIndex& index, int size);
+    // Same as thumbnailFromIndex(), but the image is converted to a pixmap with the device pixel ratio
+    // of the screen once it's loaded, so the views only need to blit it on each repaint.
+    QPixmap thumbnailPixmapFromIndex(const QModelIndex& index, int size);
 
     void cacheThumbnails(int size);
     void releaseThumbnails(int size);
 
     void setCutFiles(const QItemSelection& selection);
 
+    // The items currently shown by a view, in the order of priority.
+    // The pending thumbnails of these items are loaded before the others.
+    void setVisibleIndexes(const QModelIndexList& indexes);
+
     void setShowFullName(bool fullName) {
         showFullNames_ = fullName;
     }
 
+    bool showFullName() const {
+        return showFullNames_;
+    }
+
+    // Show the total sizes of the native dirs including their content in the size column. They're got
+    // by DirSizeCache in the background when the dirs are shown, and the rows are updated then.
+    void setShowDirSizes(bool show);
+
+    bool showDirSizes() const {
+        return dirSizeCache_ != nullptr;
+    }
+
+    // the size of the file, or the total size of the dir if it's shown and known, which is sorted by
+    std::uint64_t fileSize(const FolderModelItem* item) const;
+
+    // True while the folder is large, see Folder::setLargeThreshold(). Only the thumbnails of the
+    // items shown by the views are loaded then, and the proxy models and views use cheaper strategies.
+    bool isLargeFolder() const {
+        return folder_ && folder_->isLarge();
+    }
+
+    // The most items which keep their display strings and thumbnails. When more items are shown,
+    // the state of the ones not shown for the longest time is freed, and it's created again if
+    // they're shown later. So the memory used by a large folder doesn't grow while it's scrolled.
+    // 0 means no limit.
+    void setViewStateLimit(int limit);
+
+    int viewStateLimit() const {
+        return viewStateLimit_;
+    }
+
+    // The approximate number of bytes used by the items, their display strings and thumbnails,
+    // which is updated as they change. The FileInfo objects are counted by Folder::memoryUsage().
+    // The total of all models is Stats::FOLDER_MODEL_MEMORY_BYTES.
+    size_t memoryUsage() const {
+        return memoryUsage_;
+    }
+
 Q_SIGNALS:
     void thumbnailLoaded(const QModelIndex& index, int size);
     void fileSizeChanged(const QModelIndex& index);
-    void filesAdded(FileInfoList infoList);
+    // the list is shared by the receivers, which should not keep a reference to it
+    void filesAdded(const FileInfoList& infoList);
+    // the folder becomes large or small, or another folder is set
+    void largeFolderChanged(bool large);
 
 protected Q_SLOTS:
 
@@ -112,19 +168,42 @@ protected Q_SLOTS:
     void onFilesChanged(std::vector<Fm::FileInfoPair>& files);
     void onFilesRemoved(const Fm::FileInfoList& files);
 
-    void onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image);
     void onThumbnailJobFinished();
+    void onUserInfoChanged();
+    void onDirSizeChanged(const Fm::FilePath& dir);
+    void onFolderLargeChanged(bool large);
+    // free the view states, see MemoryPressure
+    void onMemoryPressure(Fm::MemoryPressure::Level level);
     void loadPendingThumbnails();
 
 protected:
+    struct LoadedThumbnail {
+        std::shared_ptr<const Fm::FileInfo> file;
+        int size;
+        QImage image;
+    };
+
+    void onThumbnailsLoaded(std::vector<LoadedThumbnail>& thumbnails);
     void queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size);
     void insertFiles(int row, const Fm::FileInfoList& files);
+    void prioritizePendingThumbnails(Fm::FileInfoList& pending);
     void removeAll();
     QList<FolderModelItem>::iterator findItemByPath(const Fm::FilePath& path, int* row);
     QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
     QList<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
 
 private:
+    void appendItem(const std::shared_ptr<const Fm::FileInfo>& info);
+    void indexItem(FolderModelItem* item);
+    void unindexItem(FolderModelItem* item);
+    QList<FolderModelItem>::iterator iteratorOfItem(FolderModelItem* item, int* row);
+    // called before the view state of the item is used
+    void touchItem(FolderModelItem* item) const;
+    void releaseOldViewStates() const;
+    void forgetShownItems(QList<FolderModelItem>::iterator first, QList<FolderModelItem>::iterator last);
+    // update the counted memory of the view state of the item after it's changed
+    void countViewState(const FolderModelItem* item) const;
+    void addMemoryUsage(std::int64_t delta) const;
 
     struct ThumbnailData {
         ThumbnailData(int size):
@@ -137,14 +216,30 @@ private:
         Fm::FileInfoList pendingThumbnails_;
     };
 
+    // drop the pending thumbnails of the items not shown by the views, see isLargeFolder()
+    void dropHiddenThumbnails(ThumbnailData& data);
+
     std::shared_ptr<Fm::Folder> folder_;
     QList<FolderModelItem> items;
+    // NOTE: QList allocates large items separately, so their addresses don't change when other items are added or removed.
+    std::unordered_map<const char*, FolderModelItem*, CStrHash, CStrEqual> itemsByName_; // keys are owned by the FileInfo of the items
+    std::unordered_map<const Fm::FileInfo*, FolderModelItem*> itemsByInfo_;
+    bool rowsDirty_; // the rows stored in the items are outdated
 
     bool hasPendingThumbnailHandler_;
     std::vector<Fm::ThumbnailJob*> pendingThumbnailJobs_;
+    std::shared_ptr<Fm::ResultQueue<LoadedThumbnail>> loadedThumbnails_; // filled by the thumbnail jobs
     std::forward_list<ThumbnailData> thumbnailData_;
+    std::unordered_map<const Fm::FileInfo*, int> visibleRanks_; // priorities of the files shown by the view
+    bool hasVisibleIndexes_;
+    int viewStateLimit_;
+    mutable quint64 lastShownSerial_;
+    mutable std::vector<FolderModelItem*> shownItems_; // the items having the view state which can be freed
+    mutable size_t memoryUsage_;
 
     bool showFullNames_;
+    std::shared_ptr<Fm::DirSizeCache> dirSizeCache_; // only set if the sizes of the dirs are shown
+    std::shared_ptr<Fm::MemoryPressure> memoryPressure_;
 };
 
 }
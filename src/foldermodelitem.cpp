@@ -27,60 +27,127 @@
 namespace Fm {
 
 FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info):
-    info{_info} {
-    thumbnails.reserve(2);
+    info{_info},
+    sortKeySerial_{0},
+    row_{-1},
+    lastShown_{0},
+    countedMemory_{0} {
 }
 
 FolderModelItem::FolderModelItem(const FolderModelItem& other):
     info{other.info},
-    thumbnails{other.thumbnails} {
+    sortKey_{other.sortKey_},
+    sortKeySerial_{other.sortKeySerial_},
+    row_{other.row_},
+    lastShown_{0},
+    countedMemory_{0} {
+    // the copy is not tracked by FolderModel, so only the thumbnails are copied
+    if(other.viewState_ && !other.viewState_->thumbnails.isEmpty()) {
+        viewState().thumbnails = other.viewState_->thumbnails;
+    }
 }
 
 FolderModelItem::~FolderModelItem() {
 }
 
-QString FolderModelItem::ownerName() const {
-    QString name;
-    auto user = Fm::UserInfoCache::globalInstance()->userFromId(info->uid());
-    if(user) {
-        name = user->name();
+FolderModelItem::ViewState& FolderModelItem::viewState() const {
+    if(!viewState_) {
+        viewState_.reset(new ViewState());
     }
-    return name;
+    return *viewState_;
 }
 
-QString FolderModelItem::ownerGroup() const {
-    auto group = Fm::UserInfoCache::globalInstance()->groupFromId(info->gid());
-    return group ? group->name() : QString();
+const QString& FolderModelItem::ownerName() const {
+    ViewState& state = viewState();
+    if(state.dispOwner.isNull() || state.ownerPending) {
+        // this is called while painting, so the numeric id is shown until the user is looked up
+        auto user = Fm::UserInfoCache::globalInstance()->userFromIdAsync(info->uid(), &state.ownerPending);
+        state.dispOwner = user ? user->name() : state.ownerPending ? QString::number(info->uid()) : QString();
+        if(state.dispOwner.isNull()) { // remember that the owner is unknown
+            state.dispOwner = QLatin1String("");
+        }
+    }
+    return state.dispOwner;
+}
+
+const QString& FolderModelItem::ownerGroup() const {
+    ViewState& state = viewState();
+    if(state.dispGroup.isNull() || state.groupPending) {
+        auto group = Fm::UserInfoCache::globalInstance()->groupFromIdAsync(info->gid(), &state.groupPending);
+        state.dispGroup = group ? group->name() : state.groupPending ? QString::number(info->gid()) : QString();
+        if(state.dispGroup.isNull()) {
+            state.dispGroup = QLatin1String("");
+        }
+    }
+    return state.dispGroup;
 }
 
 const QString &FolderModelItem::displayMtime() const {
-    if(dispMtime_.isEmpty()) {
+    ViewState& state = viewState();
+    if(state.dispMtime.isEmpty()) {
         auto mtime = QDateTime::fromMSecsSinceEpoch(info->mtime() * 1000);
-        dispMtime_ = mtime.toString(Qt::SystemLocaleShortDate);
+        state.dispMtime = mtime.toString(Qt::SystemLocaleShortDate);
     }
-    return dispMtime_;
+    return state.dispMtime;
 }
 
 const QString& FolderModelItem::displaySize() const {
-    if(!info->isDir()) {
+    ViewState& state = viewState();
+    if(state.dispSize.isEmpty() && !info->isDir()) {
         // FIXME: choose IEC or SI units
-        dispSize_ = Fm::formatFileSize(info->size(), false);
+        state.dispSize = Fm::formatFileSize(info->size(), false);
+    }
+    return state.dispSize;
+}
+
+const QString& FolderModelItem::displayType() const {
+    ViewState& state = viewState();
+    if(state.dispType.isNull()) {
+        state.dispType = info->description();
+        if(state.dispType.isNull()) {
+            state.dispType = QLatin1String("");
+        }
+    }
+    return state.dispType;
+}
+
+const QString& FolderModelItem::displayFullName() const {
+    ViewState& state = viewState();
+    if(state.dispFullName.isNull()) {
+        state.dispFullName = QString::fromStdString(info->name());
+    }
+    return state.dispFullName;
+}
+
+void FolderModelItem::invalidateDisplayStrings() {
+    if(viewState_) {
+        auto thumbnails = std::move(viewState_->thumbnails);
+        *viewState_ = ViewState();
+        viewState_->thumbnails = std::move(thumbnails);
     }
-    return dispSize_;
 }
 
 bool FolderModelItem::isCut() const {
     return !cutFilesHashSet_.expired() || info->isCut();
 }
 
-void FolderModelItem::bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet) {
+void FolderModelItem::bindCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet) {
     cutFilesHashSet_ = cutFilesHashSet;
 }
 
+const QCollatorSortKey& FolderModelItem::displayNameSortKey(const QCollator& collator, unsigned int collatorSerial) const {
+    if(!sortKey_ || sortKeySerial_ != collatorSerial) {
+        sortKey_ = std::make_shared<const QCollatorSortKey>(collator.sortKey(info->displayName()));
+        sortKeySerial_ = collatorSerial;
+    }
+    return *sortKey_;
+}
+
 // find thumbnail of the specified size
 // The returned thumbnail item is temporary and short-lived
 // If you need to use the struct later, copy it to your own struct to keep it.
 FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size, bool transparent) {
+    QVector<Thumbnail>& thumbnails = viewState().thumbnails;
     QVector<Thumbnail>::iterator it;
     Thumbnail* transThumb = nullptr;
     for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
@@ -131,8 +198,35 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size, bool transp
     return &thumbnails.back();
 }
 
+static size_t stringMemoryUsage(const QString& str) {
+    return str.isNull() ? 0 : sizeof(QArrayData) + (str.capacity() + 1) * sizeof(QChar);
+}
+
+size_t FolderModelItem::viewStateMemoryUsage() const {
+    if(!viewState_) {
+        return 0;
+    }
+    const ViewState& state = *viewState_;
+    size_t bytes = sizeof(ViewState) + stringMemoryUsage(state.dispMtime) + stringMemoryUsage(state.dispSize)
+                   + stringMemoryUsage(state.dispOwner) + stringMemoryUsage(state.dispGroup)
+                   + stringMemoryUsage(state.dispType) + stringMemoryUsage(state.dispFullName)
+                   + state.thumbnails.capacity() * sizeof(Thumbnail);
+    for(const auto& thumbnail: state.thumbnails) {
+        // the images might be shared with the memory cache of ThumbnailJob
+        bytes += thumbnail.image.byteCount();
+        if(!thumbnail.pixmap.isNull()) {
+            bytes += size_t(thumbnail.pixmap.width()) * thumbnail.pixmap.height() * thumbnail.pixmap.depth() / 8;
+        }
+    }
+    return bytes;
+}
+
 // remove cached thumbnail of the specified size
 void FolderModelItem::removeThumbnail(int size) {
+    if(!viewState_) {
+        return;
+    }
+    QVector<Thumbnail>& thumbnails = viewState_->thumbnails;
     QVector<Thumbnail>::iterator it;
     for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
         if(it->size == size) { // an image of the same size is found
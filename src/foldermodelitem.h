@@ -23,9 +23,12 @@
 
 #include "libfmqtglobals.h"
 #include <QImage>
+#include <QPixmap>
 #include <QString>
 #include <QIcon>
 #include <QVector>
+#include <QCollator>
+#include <memory>
 
 #include "core/folder.h"
 
@@ -46,6 +49,27 @@ public:
         bool transparent;
         ThumbnailStatus status;
         QImage image;
+        QPixmap pixmap; // the image scaled to the size in device pixels, ready to be painted
+    };
+
+    // The state which is only needed while the item is shown. It's created on demand, and
+    // FolderModel frees it for the items which are not shown recently, so that it's not kept
+    // for all the items of a large folder.
+    struct ViewState {
+        ViewState():
+            ownerPending{false},
+            groupPending{false} {
+        }
+
+        QString dispMtime;
+        QString dispSize;
+        QString dispOwner;
+        QString dispGroup;
+        QString dispType;
+        QString dispFullName;
+        bool ownerPending; // the owner is being looked up
+        bool groupPending;
+        QVector<Thumbnail> thumbnails;
     };
 
 public:
@@ -66,27 +90,73 @@ public:
         return i ? i->qicon(transparent) : QIcon{};
     }
 
-    QString ownerName() const;
+    // NOTE: the display strings are created on demand and cached until invalidateDisplayStrings() is called.
+    const QString& ownerName() const;
 
-    QString ownerGroup() const;
+    const QString& ownerGroup() const;
 
     const QString& displayMtime() const;
 
     const QString &displaySize() const;
 
+    const QString& displayType() const;
+
+    const QString& displayFullName() const;
+
+    // should be called when info is replaced
+    void invalidateDisplayStrings();
+
     bool isCut() const;
 
-    void bindCutFiles(const std::shared_ptr<const HashSet>& cutFilesHashSet);
+    // whether the owner or the group is still looked up, and the numeric id is shown instead
+    bool isOwnerPending() const {
+        return viewState_ && (viewState_->ownerPending || viewState_->groupPending);
+    }
+
+    // The collation key of the display name, which is computed once and cached for sorting.
+    // The cached key is recomputed if the given serial differs from the one it was created with.
+    const QCollatorSortKey& displayNameSortKey(const QCollator& collator, unsigned int collatorSerial) const;
+
+    // should be called when info is replaced
+    void invalidateSortKey() {
+        sortKey_.reset();
+    }
+
+    void bindCutFiles(const std::shared_ptr<const CutFileSet>& cutFilesHashSet);
 
     Thumbnail* findThumbnail(int size, bool transparent);
 
     void removeThumbnail(int size);
 
+    void removeThumbnails() {
+        if(viewState_) {
+            viewState_->thumbnails.clear();
+        }
+    }
+
+    bool hasViewState() const {
+        return viewState_ != nullptr;
+    }
+
+    // free the display strings and the thumbnails, which are created again when they're needed
+    void releaseViewState() {
+        viewState_.reset();
+    }
+
+    // the approximate bytes of the display strings and the thumbnails
+    size_t viewStateMemoryUsage() const;
+
     std::shared_ptr<const Fm::FileInfo> info;
-    mutable QString dispMtime_;
-    mutable QString dispSize_;
-    std::weak_ptr<const HashSet> cutFilesHashSet_;
-    QVector<Thumbnail> thumbnails;
+    mutable std::unique_ptr<ViewState> viewState_;
+    mutable std::shared_ptr<const QCollatorSortKey> sortKey_;
+    mutable unsigned int sortKeySerial_;
+    int row_; // position in FolderModel, which is updated lazily after rows are removed
+    quint64 lastShown_; // when FolderModel needed the view state last time, 0 if it's not tracked
+    mutable size_t countedMemory_; // the part of FolderModel::memoryUsage() added for the view state
+    std::weak_ptr<const CutFileSet> cutFilesHashSet_;
+
+private:
+    ViewState& viewState() const;
 };
 
 }
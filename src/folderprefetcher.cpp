@@ -0,0 +1,82 @@
+#include "folderprefetcher_p.h"
+#include "core/folder.h"
+#include <QAbstractItemView>
+#include <QTimer>
+#include <QEvent>
+
+namespace Fm {
+
+// how long the pointer should stay on an item before its folder is listed (in ms)
+static const int prefetchDelay = 300;
+
+FolderPrefetcher::FolderPrefetcher(QAbstractItemView* view, PathOfIndex pathOfIndex):
+    QObject(view),
+    view_{view},
+    pathOfIndex_{std::move(pathOfIndex)},
+    timer_{new QTimer(this)} {
+    timer_->setSingleShot(true);
+    timer_->setInterval(prefetchDelay);
+    connect(timer_, &QTimer::timeout, this, [this]() {
+        start();
+    });
+    // QAbstractItemView::entered() is only emitted with the mouse tracking
+    view_->setMouseTracking(true);
+    connect(view_, &QAbstractItemView::entered, this, [this](const QModelIndex& index) {
+        hover(index);
+    });
+    connect(view_, &QAbstractItemView::viewportEntered, this, [this]() {
+        cancel();
+    });
+    view_->viewport()->installEventFilter(this);
+    view_->installEventFilter(this);
+}
+
+FolderPrefetcher::~FolderPrefetcher() {
+}
+
+bool FolderPrefetcher::eventFilter(QObject* watched, QEvent* event) {
+    if(watched == view_->viewport() && event->type() == QEvent::Leave) {
+        cancel();
+    }
+    else if(watched == view_ && event->type() == QEvent::KeyRelease) {
+        // the current item might be changed with the keyboard
+        hover(view_->currentIndex());
+    }
+    return false;
+}
+
+void FolderPrefetcher::hover(const QModelIndex& index) {
+    if(index.isValid() && index == pendingIndex_) {
+        return;
+    }
+    cancel();
+    if(index.isValid()) {
+        pendingIndex_ = index;
+        timer_->start();
+    }
+}
+
+void FolderPrefetcher::cancel() {
+    timer_->stop();
+    pendingIndex_ = QPersistentModelIndex();
+    if(current_) {
+        // an unfinished listing is cancelled when the folder is released
+        if(current_->isLoaded()) {
+            lastLoaded_ = std::move(current_);
+        }
+        current_.reset();
+    }
+}
+
+void FolderPrefetcher::start() {
+    if(!pendingIndex_.isValid()) {
+        return;
+    }
+    auto path = pathOfIndex_(pendingIndex_);
+    // the remote folders are not listed, since the listing might ask for a password or mount them
+    if(path.isValid() && path.isNative()) {
+        current_ = Folder::prefetch(path);
+    }
+}
+
+} // namespace Fm
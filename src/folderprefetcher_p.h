@@ -0,0 +1,50 @@
+#ifndef FM_FOLDERPREFETCHER_P_H
+#define FM_FOLDERPREFETCHER_P_H
+
+#include <QObject>
+#include <QModelIndex>
+#include <QPersistentModelIndex>
+#include <functional>
+#include <memory>
+#include "core/filepath.h"
+
+class QAbstractItemView;
+class QTimer;
+
+namespace Fm {
+
+class Folder;
+
+// Lists the folder of the item hovered by the pointer, or made current with the keyboard, in the
+// background after a short delay, so it's already loaded when the user opens it. The listing is
+// cancelled when another item is hovered or the pointer leaves the view before it's finished.
+// The last folder loaded this way is kept until another one is loaded.
+// It has no Q_OBJECT since it only needs an event filter, and it's deleted with the view.
+class FolderPrefetcher: public QObject {
+public:
+    // the path of the folder shown by the item, or an invalid path if the item is not a folder
+    using PathOfIndex = std::function<FilePath (const QModelIndex& index)>;
+
+    FolderPrefetcher(QAbstractItemView* view, PathOfIndex pathOfIndex);
+
+    ~FolderPrefetcher();
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+    void hover(const QModelIndex& index);
+    void cancel();
+    void start();
+
+    QAbstractItemView* view_;
+    PathOfIndex pathOfIndex_;
+    QTimer* timer_;
+    QPersistentModelIndex pendingIndex_;
+    std::shared_ptr<Folder> current_; // the folder of the hovered item
+    std::shared_ptr<Folder> lastLoaded_;
+};
+
+} // namespace Fm
+
+#endif // FM_FOLDERPREFETCHER_P_H
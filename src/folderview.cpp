@@ -46,15 +46,66 @@
 #include <xcb/xcb.h> // for XDS support
 #include "xdndworkaround.h" // for XDS support
 #include "folderview_p.h"
+#include "folderprefetcher_p.h"
 #include "utilities.h"
+#include <algorithm>
+#include <unordered_set>
 
 #define SCROLL_FRAMES_PER_SEC 50
 #define SCROLL_DURATION 300 // in ms
 
 static const int scrollAnimFrames = SCROLL_FRAMES_PER_SEC * SCROLL_DURATION / 1000;
 
+// the rows measured to estimate the column widths of the detailed list, like the default
+// QHeaderView::resizeContentsPrecision(), and the rows measured in each inserted batch
+static const int maxSampledRows = 1000;
+static const int maxSampledInsertedRows = 200;
+// fewer rows are measured while the folder is large, see Folder::setLargeThreshold()
+static const int maxSampledLargeRows = 200;
+static const int maxSampledLargeInsertedRows = 16;
+
 using namespace Fm;
 
+bool FolderViewTypeAhead::search(QAbstractItemView* view, const QString& text) {
+    auto model = qobject_cast<ProxyFolderModel*>(view->model());
+    if(!model) {
+        return false;
+    }
+    int count = model->rowCount();
+    if(count == 0) {
+        return true;
+    }
+    QModelIndex current = view->currentIndex();
+    int start = current.isValid() ? current.row() : 0;
+    // the keys typed within the interval are added to the search
+    bool skipRow = false;
+    bool timeWasValid = inputTime_.isValid();
+    qint64 elapsed = timeWasValid ? inputTime_.restart() : 0;
+    if(!timeWasValid) {
+        inputTime_.start();
+    }
+    if(text.isEmpty() || !timeWasValid || elapsed > QApplication::keyboardInputInterval()) {
+        input_ = text;
+        skipRow = current.isValid();
+    }
+    else {
+        input_ += text;
+    }
+    // typing the same key again goes to the next item starting with it
+    bool sameKey = input_.length() > 1 && input_.count(input_.at(input_.length() - 1)) == input_.length();
+    if(sameKey) {
+        skipRow = true;
+    }
+    if(skipRow) {
+        start = (start + 1) % count;
+    }
+    int row = model->findRowByPrefix(sameKey ? QString{input_.at(0)} : input_, start);
+    if(row >= 0) {
+        view->setCurrentIndex(model->index(row, current.isValid() ? current.column() : 0));
+    }
+    return true;
+}
+
 FolderViewListView::FolderViewListView(QWidget* parent):
     QListView(parent),
     activationAllowed_(true) {
@@ -66,6 +117,12 @@ FolderViewListView::FolderViewListView(QWidget* parent):
 FolderViewListView::~FolderViewListView() {
 }
 
+void FolderViewListView::keyboardSearch(const QString& search) {
+    if(!typeAhead_.search(this, search)) {
+        QListView::keyboardSearch(search);
+    }
+}
+
 void FolderViewListView::startDrag(Qt::DropActions supportedActions) {
     if(movement() != Static) {
         QListView::startDrag(supportedActions);
@@ -236,7 +293,8 @@ FolderViewTreeView::FolderViewTreeView(QWidget* parent):
     QTreeView(parent),
     doingLayout_(false),
     layoutTimer_(nullptr),
-    activationAllowed_(true) {
+    activationAllowed_(true),
+    columnWidthsValid_(false) {
 
     header()->setStretchLastSection(true);
     setIndentation(0);
@@ -256,8 +314,15 @@ FolderViewTreeView::~FolderViewTreeView() {
     }
 }
 
+void FolderViewTreeView::keyboardSearch(const QString& search) {
+    if(!typeAhead_.search(this, search)) {
+        QTreeView::keyboardSearch(search);
+    }
+}
+
 void FolderViewTreeView::setModel(QAbstractItemModel* model) {
     QTreeView::setModel(model);
+    invalidateColumnWidths();
     layoutColumns();
     if(ProxyFolderModel* proxyModel = qobject_cast<ProxyFolderModel*>(model)) {
         connect(proxyModel, &ProxyFolderModel::sortFilterChanged, this, &FolderViewTreeView::onSortFilterChanged,
@@ -323,6 +388,18 @@ void FolderViewTreeView::layoutColumns() {
             opt.sortIndicator = QStyleOptionHeader::SortDown;
         }
         QAbstractItemModel* model_ = model();
+        if(!columnWidthsValid_) {
+            // the shown rows, and a sample of all the rows
+            columnWidths_.assign(model_->columnCount(rootIndex()), 0);
+            int rowCount = model_->rowCount(rootIndex());
+            QModelIndex firstShown = indexAt(QPoint(0, 0));
+            if(firstShown.isValid()) {
+                QModelIndex lastShown = indexAt(QPoint(0, viewport()->height() - 1));
+                measureRows(firstShown.row(), lastShown.isValid() ? lastShown.row() : rowCount - 1, maxSampledRows);
+            }
+            measureRows(0, rowCount - 1, isLargeFolder() ? maxSampledLargeRows : maxSampledRows);
+            columnWidthsValid_ = true;
+        }
         int column;
         for(column = 0; column < numCols; ++column) {
             int columnId = headerView->logicalIndex(column);
@@ -334,7 +411,8 @@ void FolderViewTreeView::layoutColumns() {
                 }
             }
             opt.section = columnId;
-            widths[column] = qMax(sizeHintForColumn(columnId),
+            int contentWidth = size_t(columnId) < columnWidths_.size() ? columnWidths_[columnId] : 0;
+            widths[column] = qMax(contentWidth,
                                   style()->sizeFromContents(QStyle::CT_HeaderSection, &opt, QSize(), headerView).width());
             // compute the total width needed
             desiredWidth += widths[column];
@@ -347,7 +425,7 @@ void FolderViewTreeView::layoutColumns() {
             int filenameAvailWidth = availWidth - desiredWidth + widths[filenameColumn];
 
             // Compute the minimum acceptable width for the filename column
-            int filenameMinWidth = qMin(200, sizeHintForColumn(filenameColumn));
+            int filenameMinWidth = qMin(200, widths[filenameColumn]);
 
             if(filenameAvailWidth > filenameMinWidth) {
                 // Shrink the filename column to the available width
@@ -390,8 +468,53 @@ void FolderViewTreeView::resizeEvent(QResizeEvent* event) {
     }
 }
 
+void FolderViewTreeView::changeEvent(QEvent* event) {
+    QTreeView::changeEvent(event);
+    if(event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange) {
+        invalidateColumnWidths();
+        queueLayoutColumns();
+    }
+}
+
+bool FolderViewTreeView::measureRows(int first, int last, int maxRows) {
+    QAbstractItemModel* model_ = model();
+    if(!model_ || first > last) {
+        return false;
+    }
+    bool widened = false;
+    QStyleOptionViewItem opt = viewOptions();
+    // the step between the measured rows, rounded up
+    int step = qMax(1, (last - first + maxRows) / maxRows);
+    for(int row = first; row <= last; row += step) {
+        // the hidden columns are measured too, since nothing measures them again when they're shown
+        for(size_t column = 0; column < columnWidths_.size(); ++column) {
+            QModelIndex index = model_->index(row, column, rootIndex());
+            int width = itemDelegate(index)->sizeHint(opt, index).width();
+            if(width > columnWidths_[column]) {
+                columnWidths_[column] = width;
+                widened = true;
+            }
+        }
+    }
+    return widened;
+}
+
+bool FolderViewTreeView::isLargeFolder() const {
+    auto proxyModel = qobject_cast<ProxyFolderModel*>(model());
+    auto folderModel = proxyModel ? qobject_cast<FolderModel*>(proxyModel->sourceModel()) : nullptr;
+    return folderModel && folderModel->isLargeFolder();
+}
+
+void FolderViewTreeView::invalidateColumnWidths() {
+    columnWidthsValid_ = false;
+}
+
 void FolderViewTreeView::rowsInserted(const QModelIndex& parent, int start, int end) {
     QTreeView::rowsInserted(parent, start, end);
+    // only the new rows are measured, and the widths never shrink until they're estimated again
+    if(columnWidthsValid_ && parent == rootIndex()) {
+        measureRows(start, end, isLargeFolder() ? maxSampledLargeInsertedRows : maxSampledInsertedRows);
+    }
     queueLayoutColumns();
 }
 
@@ -402,8 +525,13 @@ void FolderViewTreeView::rowsAboutToBeRemoved(const QModelIndex& parent, int sta
 
 void FolderViewTreeView::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles /*= QVector<int>{}*/) {
     QTreeView::dataChanged(topLeft, bottomRight, roles);
-    // FIXME: this will be very inefficient
-    // queueLayoutColumns();
+    // the changed files might need wider columns, but the loaded thumbnails don't change the icon size
+    bool onlyDecoration = roles.size() == 1 && roles.at(0) == Qt::DecorationRole;
+    if(columnWidthsValid_ && !onlyDecoration && topLeft.parent() == rootIndex()
+            && measureRows(topLeft.row(), bottomRight.row(),
+                           isLargeFolder() ? maxSampledLargeInsertedRows : maxSampledInsertedRows)) {
+        queueLayoutColumns();
+    }
 }
 
 void FolderViewTreeView::reset() {
@@ -414,6 +542,7 @@ void FolderViewTreeView::reset() {
     // This fixes bug #190
     // https://github.com/lxqt/pcmanfm-qt/issues/190
     QTreeView::reset();
+    invalidateColumnWidths();
     queueLayoutColumns();
 }
 
@@ -480,7 +609,10 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
     selChangedTimer_(nullptr),
     itemDelegateMargins_(QSize(3, 3)),
     smoothScrollTimer_(nullptr),
-    wheelEvent_(nullptr) {
+    wheelEvent_(nullptr),
+    visibleRangeUpdatePending_(false),
+    prefetchOnHover_(false),
+    selectedFilesValid_(false) {
 
     iconSize_[IconMode - FirstViewMode] = QSize(48, 48);
     iconSize_[CompactMode - FirstViewMode] = QSize(24, 24);
@@ -526,6 +658,7 @@ void FolderView::onSelChangedTimeout() {
 }
 
 void FolderView::onSelectionChanged(const QItemSelection& /*selected*/, const QItemSelection& /*deselected*/) {
+    invalidateSelectedFiles();
     // It's possible that the selected items change too often and this slot gets called for thousands of times.
     // For example, when you select thousands of files and delete them, we will get one selectionChanged() event
     // for every deleted file. So, we use a timer to delay the handling to avoid too frequent updates of the UI.
@@ -671,6 +804,7 @@ void FolderView::setViewMode(ViewMode _mode) {
 
         view->setSelectionMode(QAbstractItemView::ExtendedSelection);
         layout()->addWidget(view);
+        updatePrefetcher();
 
         // enable dnd (the drop indicator is set at "FolderView::childDragMoveEvent()")
         view->setDragEnabled(true);
@@ -684,6 +818,7 @@ void FolderView::setViewMode(ViewMode _mode) {
 
         if(model_) {
             // FIXME: preserve selections
+            invalidateSelectedFiles();
             model_->setThumbnailSize(iconSize.width());
             view->setModel(model_);
             if(recreateView) {
@@ -724,12 +859,17 @@ void FolderView::updateGridSize() {
         grid += 2*itemDelegateMargins_;
         // let horizontal and vertical spacings be set only by itemDelegateMargins_
         listView->setSpacing(0);
+        // All items have the size of the grid, so the view can ask the delegate for the size of one
+        // item only, instead of going through the whole model whenever the items are laid out.
+        listView->setUniformItemSizes(true);
 
         break;
     }
     default:
         // FIXME: set proper item size
         listView->setSpacing(2);
+        // the widths of the items depend on their texts
+        listView->setUniformItemSizes(false);
         ; // do not use grid size
     }
 
@@ -767,6 +907,23 @@ FolderView::ViewMode FolderView::viewMode() const {
     return mode;
 }
 
+void FolderView::setPrefetchOnHover(bool prefetch) {
+    prefetchOnHover_ = prefetch;
+    updatePrefetcher();
+}
+
+void FolderView::updatePrefetcher() {
+    if(prefetchOnHover_ && view && !prefetcher_) {
+        prefetcher_ = new FolderPrefetcher(view, [](const QModelIndex& index) {
+            auto info = index.data(FolderModel::FileInfoRole).value<std::shared_ptr<const Fm::FileInfo>>();
+            return info && info->isDir() ? info->path() : Fm::FilePath();
+        });
+    }
+    else if(!prefetchOnHover_ && prefetcher_) {
+        delete prefetcher_;
+    }
+}
+
 void FolderView::setAutoSelectionDelay(int delay) {
     autoSelectionDelay_ = delay;
 }
@@ -780,6 +937,14 @@ ProxyFolderModel* FolderView::model() const {
 }
 
 void FolderView::setModel(ProxyFolderModel* model) {
+    invalidateSelectedFiles();
+    if(model) {
+        // the selected rows might be removed, or show other files, without a selection change
+        connect(model, &QAbstractItemModel::rowsRemoved, this, &FolderView::invalidateSelectedFiles);
+        connect(model, &QAbstractItemModel::modelReset, this, &FolderView::invalidateSelectedFiles);
+        connect(model, &QAbstractItemModel::layoutChanged, this, &FolderView::invalidateSelectedFiles);
+        connect(model, &QAbstractItemModel::dataChanged, this, &FolderView::invalidateSelectedFiles);
+    }
     if(view) {
         view->setModel(model);
         QSize iconSize = iconSize_[mode - FirstViewMode];
@@ -794,6 +959,49 @@ void FolderView::setModel(ProxyFolderModel* model) {
     model_ = model;
 }
 
+// Find the rows shown in the viewport and tell the model about them, so that the
+// thumbnails of the visible items are loaded before the others.
+void FolderView::updateVisibleRange() {
+    visibleRangeUpdatePending_ = false;
+    if(!view || !model_) {
+        return;
+    }
+    int count = model_->rowCount();
+    if(count == 0) {
+        return;
+    }
+    // the items are laid out in the order of their rows along the scrolling direction
+    const QRect viewportRect = view->viewport()->rect();
+    const bool horizontal = (mode == CompactMode);
+    auto isBeforeViewport = [&](int row) {
+        QRect rect = view->visualRect(model_->index(row, 0));
+        return horizontal ? rect.right() < viewportRect.left() : rect.bottom() < viewportRect.top();
+    };
+    auto isAfterViewport = [&](int row) {
+        QRect rect = view->visualRect(model_->index(row, 0));
+        return horizontal ? rect.left() > viewportRect.right() : rect.top() > viewportRect.bottom();
+    };
+    // binary search for the first visible row
+    int first = 0;
+    int end = count;
+    while(first < end) {
+        int mid = (first + end) / 2;
+        if(isBeforeViewport(mid)) {
+            first = mid + 1;
+        }
+        else {
+            end = mid;
+        }
+    }
+    int last = first;
+    while(last + 1 < count && !isAfterViewport(last + 1)) {
+        ++last;
+    }
+    if(first < count) {
+        model_->setVisibleRange(first, last);
+    }
+}
+
 bool FolderView::event(QEvent* event) {
     switch(event->type()) {
     case QEvent::StyleChange:
@@ -870,19 +1078,11 @@ QItemSelectionModel* FolderView::selectionModel() const {
 }
 
 Fm::FilePathList FolderView::selectedFilePaths() const {
-    if(model_) {
-        QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
-        if(!selIndexes.isEmpty()) {
-            Fm::FilePathList paths;
-            QModelIndexList::const_iterator it;
-            for(it = selIndexes.constBegin(); it != selIndexes.constEnd(); ++it) {
-                auto file = model_->fileInfoFromIndex(*it);
-                paths.push_back(file->path());
-            }
-            return paths;
-        }
+    Fm::FilePathList paths;
+    for(const auto& file: selectedFiles()) {
+        paths.push_back(file->path());
     }
-    return Fm::FilePathList();
+    return paths;
 }
 
 bool FolderView::hasSelection() const {
@@ -913,28 +1113,36 @@ void FolderView::selectFiles(const Fm::FileInfoList& files, bool add) {
   if(!add) {
       selectionModel()->clear();
   }
-  QModelIndex index, firstIndex;
+  // find the rows of the files with one pass over the model
+  std::unordered_set<const Fm::FileInfo*> wanted;
+  for(const auto& file: files) {
+      wanted.insert(file.get());
+  }
+  std::vector<int> rows;
   int count = model_->rowCount();
-  Fm::FileInfoList list = files;
-  bool singleFile(files.size() == 1);
-  for(int row = 0; row < count; ++row) {
-      if (list.empty()) {
-          break;
+  for(int row = 0; row < count && rows.size() < wanted.size(); ++row) {
+      auto info = model_->fileInfoFromIndex(model_->index(row, 0));
+      if(info && wanted.count(info.get()) != 0) {
+          rows.push_back(row);
       }
-      index = model_->index(row, 0);
-      auto info = model_->fileInfoFromIndex(index);
-      for(auto it = list.cbegin(); it != list.cend(); ++it) {
-          auto& item = *it;
-          if(item == info) {
-              selectionModel()->select(index, QItemSelectionModel::Select);
-              if (!firstIndex.isValid()) {
-                  firstIndex = index;
-              }
-              list.erase(it);
-              break;
-          }
+  }
+  if(rows.empty()) {
+      return;
+  }
+  // the adjacent rows are selected as one range, and the selection model is changed only once
+  int lastColumn = mode == DetailedListMode ? model_->columnCount() - 1 : 0;
+  QItemSelection selection;
+  for(size_t i = 0; i < rows.size();) {
+      int first = rows[i];
+      int last = first;
+      for(++i; i < rows.size() && rows[i] == last + 1; ++i) {
+          last = rows[i];
       }
+      selection.append(QItemSelectionRange(model_->index(first, 0), model_->index(last, lastColumn)));
   }
+  selectionModel()->select(selection, QItemSelectionModel::Select);
+  QModelIndex firstIndex = model_->index(rows.front(), 0);
+  bool singleFile(files.size() == 1);
   if (firstIndex.isValid()) {
       view->scrollTo(firstIndex, QAbstractItemView::EnsureVisible);
       if (singleFile) { // give focus to the single file
@@ -944,19 +1152,38 @@ void FolderView::selectFiles(const Fm::FileInfoList& files, bool add) {
 }
 
 Fm::FileInfoList FolderView::selectedFiles() const {
-    if(model_) {
-        QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
-        if(!selIndexes.isEmpty()) {
-            Fm::FileInfoList files;
-            QModelIndexList::const_iterator it;
-            for(it = selIndexes.constBegin(); it != selIndexes.constEnd(); ++it) {
-                auto file = model_->fileInfoFromIndex(*it);
-                files.push_back(file);
+    if(selectedFilesValid_) {
+        return selectedFiles_;
+    }
+    selectedFiles_.clear();
+    QItemSelectionModel* selModel = selectionModel();
+    if(model_ && selModel) {
+        // the rows are read from the selected ranges instead of listing every selected cell.
+        // A row is selected if its first column is, and the ranges might overlap.
+        std::vector<std::pair<int, int>> ranges;
+        for(const auto& range: selModel->selection()) {
+            if(range.left() == 0 && range.parent() == view->rootIndex()) {
+                ranges.emplace_back(range.top(), range.bottom());
             }
-            return files;
+        }
+        std::sort(ranges.begin(), ranges.end());
+        int nextRow = 0;
+        for(const auto& range: ranges) {
+            for(int row = std::max(range.first, nextRow); row <= range.second; ++row) {
+                if(auto file = model_->fileInfoFromIndex(model_->index(row, 0))) {
+                    selectedFiles_.push_back(std::move(file));
+                }
+            }
+            nextRow = std::max(nextRow, range.second + 1);
         }
     }
-    return Fm::FileInfoList();
+    selectedFilesValid_ = true;
+    return selectedFiles_;
+}
+
+void FolderView::invalidateSelectedFiles() {
+    selectedFilesValid_ = false;
+    selectedFiles_.clear();
 }
 
 void FolderView::selectAll() {
@@ -985,9 +1212,10 @@ void FolderView::invertSelection() {
         if(mode == DetailedListMode) {
             flags |= QItemSelectionModel::Rows;
         }
-        for(int row = 0; row < rows; ++row) {
-            QModelIndex index = model_->index(row, 0);
-            selModel->select(index, flags);
+        // toggle all the rows at once instead of changing the selection for every row
+        if(rows > 0) {
+            const QItemSelection sel{model_->index(0, 0), model_->index(rows - 1, 0)};
+            selModel->select(sel, flags);
         }
     }
 }
@@ -1092,6 +1320,13 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
     // That's why we override respective virtual methods for different events.
     if(view && watched == view->viewport()) {
         switch(event->type()) {
+        case QEvent::Paint:
+            // the shown items might be changed by scrolling, resizing or changes of the model
+            if(!visibleRangeUpdatePending_) {
+                visibleRangeUpdatePending_ = true;
+                QTimer::singleShot(0, this, &FolderView::updateVisibleRange);
+            }
+            break;
         case QEvent::HoverMove:
             // activate items on single click
             if(style()->styleHint(QStyle::SH_ItemView_ActivateItemOnSingleClick)) {
@@ -1342,14 +1577,16 @@ void FolderView::onClipboardDataChange() {
         const QClipboard* clipboard = QApplication::clipboard();
         const QMimeData* data = clipboard->mimeData();
         Fm::FilePathList paths;
-        bool isCutSelection;
-        std::tie(paths, isCutSelection) = Fm::parseClipboardData(*data);
-        if(!folder()->path().hasUriScheme("search") // skip for search results
-           && isCutSelection
-           && Fm::isCurrentPidClipboardData(*data)) { // set cut files only with this app
+        bool isCutSelection = false;
+        // set cut files only with this app, so the data of the other apps are not parsed
+        // (the paths are taken directly from the data made by this app)
+        if(data && Fm::isCurrentPidClipboardData(*data)) {
+            std::tie(paths, isCutSelection) = Fm::parseClipboardData(*data);
+        }
+        if(isCutSelection) {
             auto cutDirPath = paths.size() > 0 ? paths[0].parent() : FilePath();
-            // set the cut file(s) only if the cutting is done here
-            if(folder()->path() == cutDirPath
+            // set the cut file(s) only if the cutting is done here, and the files of a search folder are in other folders
+            if((folder()->path() == cutDirPath || folder()->path().hasUriScheme("search"))
                && selectedFilePaths() == paths) {
                 model_->setCutFiles(selectionModel()->selection());
             }
@@ -1359,7 +1596,7 @@ void FolderView::onClipboardDataChange() {
             return;
         }
 
-        folder()->setCutFiles(std::make_shared<HashSet>()); // clean Folder::cutFilesHashSet_
+        folder()->setCutFiles(std::make_shared<CutFileSet>()); // clean Folder::cutFilesHashSet_
         if(folder()->hadCutFilesUnset()) {
             model_->setCutFiles(QItemSelection()); // update indexes if there were cut files here
         }
@@ -26,6 +26,7 @@
 #include <QListView>
 #include <QTreeView>
 #include <QMouseEvent>
+#include <QPointer>
 #include "foldermodel.h"
 #include "proxyfoldermodel.h"
 
@@ -39,6 +40,7 @@ class FileMenu;
 class FolderMenu;
 class FileLauncher;
 class FolderViewStyle;
+class FolderPrefetcher;
 
 class LIBFM_QT_API FolderView : public QWidget {
     Q_OBJECT
@@ -120,6 +122,14 @@ public:
 
     void setAutoSelectionDelay(int delay);
 
+    // List the folder under the pointer, or the current one chosen with the keyboard, in the
+    // background after a short delay, so it's loaded already when it's opened. Off by default.
+    void setPrefetchOnHover(bool prefetch);
+
+    bool prefetchOnHover() const {
+        return prefetchOnHover_;
+    }
+
 protected:
     virtual bool event(QEvent* event);
     virtual void contextMenuEvent(QContextMenuEvent* event);
@@ -158,8 +168,11 @@ public Q_SLOTS:
 private Q_SLOTS:
     void onAutoSelectionTimeout();
     void onSelChangedTimeout();
+    void invalidateSelectedFiles();
+    void updatePrefetcher();
     void onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint);
     void scrollSmoothly();
+    void updateVisibleRange();
 
 Q_SIGNALS:
     void clicked(int type, const std::shared_ptr<const Fm::FileInfo>& file);
@@ -189,6 +202,12 @@ private:
     QTimer *smoothScrollTimer_;
     QWheelEvent *wheelEvent_;
     QList<scollData> queuedScrollSteps_;
+    bool visibleRangeUpdatePending_;
+    bool prefetchOnHover_;
+    QPointer<FolderPrefetcher> prefetcher_; // a child of the view, which might be recreated
+    // the files of the selected rows, which are found again after the selection or the model is changed
+    mutable Fm::FileInfoList selectedFiles_;
+    mutable bool selectedFilesValid_;
 };
 
 }
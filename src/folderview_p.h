@@ -24,12 +24,26 @@
 #include <QListView>
 #include <QTreeView>
 #include <QMouseEvent>
+#include <QElapsedTimer>
+#include <vector>
 #include "folderview.h"
 
 class QTimer;
 
 namespace Fm {
 
+// The keyboard type-ahead of the views of FolderView, which behaves like QAbstractItemView::keyboardSearch(),
+// but finds the typed prefix with ProxyFolderModel::findRowByPrefix() instead of calling match() for every key.
+class FolderViewTypeAhead {
+public:
+  // returns false if the model isn't a ProxyFolderModel, and the default search should be used
+  bool search(QAbstractItemView* view, const QString& text);
+
+private:
+  QString input_;
+  QElapsedTimer inputTime_;
+};
+
 // override these classes for implementing FolderView
 class FolderViewListView : public QListView {
   Q_OBJECT
@@ -49,6 +63,8 @@ public:
 
   virtual QModelIndex indexAt(const QPoint & point) const;
 
+  virtual void keyboardSearch(const QString& search);
+
   inline void setPositionForIndex(const QPoint & position, const QModelIndex & index) {
     QListView::setPositionForIndex(position, index);
   }
@@ -72,6 +88,7 @@ private Q_SLOTS:
 
 private:
   bool activationAllowed_;
+  FolderViewTypeAhead typeAhead_;
 };
 
 class FolderViewTreeView : public QTreeView {
@@ -95,7 +112,10 @@ public:
   virtual void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles = QVector<int>{});
   virtual void reset();
 
+  virtual void keyboardSearch(const QString& search);
+
   virtual void resizeEvent(QResizeEvent* event);
+  virtual void changeEvent(QEvent* event);
   void queueLayoutColumns();
 
 Q_SIGNALS:
@@ -107,9 +127,24 @@ private Q_SLOTS:
   void onSortFilterChanged();
 
 private:
+  // Widen the estimated column widths to fit the rows in [first, last]. At most maxRows of them
+  // are measured, which are spread evenly. Returns true if any column becomes wider.
+  bool measureRows(int first, int last, int maxRows);
+
+  // measure the shown rows and a sample of the others again, such as after the model is reset
+  void invalidateColumnWidths();
+
+  // fewer rows are sampled in a large folder, see FolderModel::isLargeFolder()
+  bool isLargeFolder() const;
+
   bool doingLayout_;
   QTimer* layoutTimer_;
   bool activationAllowed_;
+  // The widths the columns need, estimated with the rows measured so far. Measuring every row with
+  // sizeHintForColumn() takes too long in large folders, and the rows are added in many batches.
+  std::vector<int> columnWidths_;
+  bool columnWidthsValid_;
+  FolderViewTypeAhead typeAhead_;
 };
 
 
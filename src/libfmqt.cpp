@@ -20,8 +20,8 @@
 #include "libfmqt.h"
 #include <QLocale>
 #include <QPixmapCache>
-#include "core/thumbnailer.h"
 #include "xdndworkaround.h"
+#include "core/jobtrace_p.h"
 #include "core/vfs/fm-file.h"
 #include "core/legacy/fm-config.h"
 
@@ -32,6 +32,7 @@ struct LibFmQtData {
     ~LibFmQtData();
 
     QTranslator translator;
+    bool translatorLoaded;
     XdndWorkaround workaround;
     int refCount;
     Q_DISABLE_COPY(LibFmQtData)
@@ -43,6 +44,9 @@ extern "C" {
 
 GFile *_fm_vfs_search_new_for_uri(const char *uri);  // defined in vfs-search.c
 GFile *_fm_vfs_menu_new_for_uri(const char *uri);  // defined in vfs-menu.c
+#ifdef HAVE_LIBARCHIVE
+GFile *_fm_vfs_archive_new_for_uri(const char *uri);  // defined in vfs-archive.c
+#endif
 
 }
 
@@ -54,30 +58,49 @@ static GFile* lookupMenuUri(GVfs * /*vfs*/, const char *identifier, gpointer /*u
     return _fm_vfs_menu_new_for_uri(identifier);
 }
 
-LibFmQtData::LibFmQtData(): refCount(1) {
+#ifdef HAVE_LIBARCHIVE
+static GFile* lookupArchiveUri(GVfs * /*vfs*/, const char *identifier, gpointer /*user_data*/) {
+    return _fm_vfs_archive_new_for_uri(identifier);
+}
+#endif
+
+// Only what can't wait is done here. The translations are loaded when translator() is called first,
+// and the thumbnailers when the first thumbnail is requested (see Thumbnailer::ensureLoaded()).
+LibFmQtData::LibFmQtData(): translatorLoaded(false), refCount(1) {
+    StartupSpan span{"LibFmQt"};
 #if !GLIB_CHECK_VERSION(2, 36, 0)
     g_type_init();
 #endif
     // turn on glib debug message
     // g_setenv("G_MESSAGES_DEBUG", "all", true);
-    Fm::Thumbnailer::loadAll();
-    translator.load("libfm-qt_" + QLocale::system().name(), LIBFM_QT_DATA_DIR "/translations");
 
     // FIXME: we keep the FmConfig data structure here to keep compatibility with legacy libfm API.
     fm_config_init();
 
     // register some URI schemes implemented by libfm
+    // They can't be registered lazily since any path might be created with them.
+    StartupSpan vfsSpan{"LibFmQt::registerUriSchemes"};
     GVfs* vfs = g_vfs_get_default();
     g_vfs_register_uri_scheme(vfs, "menu", lookupMenuUri, nullptr, nullptr, lookupMenuUri, nullptr, nullptr);
     g_vfs_register_uri_scheme(vfs, "search", lookupSearchUri, nullptr, nullptr, lookupSearchUri, nullptr, nullptr);
+#ifdef HAVE_LIBARCHIVE
+    g_vfs_register_uri_scheme(vfs, "archive", lookupArchiveUri, nullptr, nullptr, lookupArchiveUri, nullptr, nullptr);
+#endif
+
+    // only started if LIBFM_QT_STALL_WATCHDOG is set
+    StallWatchdog::start();
 }
 
 LibFmQtData::~LibFmQtData() {
     // _fm_file_finalize();
+    StallWatchdog::stop();
 
     GVfs* vfs = g_vfs_get_default();
     g_vfs_unregister_uri_scheme(vfs, "menu");
     g_vfs_unregister_uri_scheme(vfs, "search");
+#ifdef HAVE_LIBARCHIVE
+    g_vfs_unregister_uri_scheme(vfs, "archive");
+#endif
 }
 
 LibFmQt::LibFmQt() {
@@ -98,6 +121,11 @@ LibFmQt::~LibFmQt() {
 }
 
 QTranslator* LibFmQt::translator() {
+    if(!d->translatorLoaded) {
+        d->translatorLoaded = true;
+        StartupSpan span{"LibFmQt::loadTranslations"};
+        d->translator.load("libfm-qt_" + QLocale::system().name(), LIBFM_QT_DATA_DIR "/translations");
+    }
     return &d->translator;
 }
 
@@ -19,63 +19,25 @@
 
 
 #include "pathedit.h"
-#include "pathedit_p.h"
 #include <QCompleter>
 #include <QStringListModel>
 #include <QStringBuilder>
-#include <QThread>
 #include <QDebug>
 #include <QKeyEvent>
 #include <QDir>
+#include <algorithm>
 
 namespace Fm {
 
-void PathEditJob::runJob() {
-    GError* err = nullptr;
-    GFileEnumerator* enu = g_file_enumerate_children(dirName,
-                           // G_FILE_ATTRIBUTE_STANDARD_NAME","
-                           G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
-                           G_FILE_ATTRIBUTE_STANDARD_TYPE,
-                           G_FILE_QUERY_INFO_NONE, cancellable,
-                           &err);
-    if(enu) {
-        while(!g_cancellable_is_cancelled(cancellable)) {
-            GFileInfo* inf = g_file_enumerator_next_file(enu, cancellable, &err);
-            if(inf) {
-                GFileType type = g_file_info_get_file_type(inf);
-                if(type == G_FILE_TYPE_DIRECTORY) {
-                    const char* name = g_file_info_get_display_name(inf);
-                    // FIXME: encoding conversion here?
-                    subDirs.append(QString::fromUtf8(name));
-                }
-                g_object_unref(inf);
-            }
-            else {
-                if(err) {
-                    g_error_free(err);
-                    err = nullptr;
-                }
-                else { /* EOF */
-                    break;
-                }
-            }
-        }
-        g_file_enumerator_close(enu, cancellable, nullptr);
-        g_object_unref(enu);
-    }
-    // finished! let's update the UI in the main thread
-    Q_EMIT finished();
-    QThread::currentThread()->quit();
-}
-
-
 PathEdit::PathEdit(QWidget* parent):
     QLineEdit(parent),
     completer_(new QCompleter()),
     model_(new QStringListModel()),
-    cancellable_(nullptr) {
+    completeWhenLoaded_(false) {
     setCompleter(completer_);
     completer_->setModel(model_);
+    // the list is kept sorted so the completer finds the matches by binary search while typing
+    completer_->setModelSorting(QCompleter::CaseSensitivelySortedModel);
     connect(this, &PathEdit::textChanged, this, &PathEdit::onTextChanged);
     connect(this, &PathEdit::textEdited, this, &PathEdit::onTextEdited);
 }
@@ -85,9 +47,8 @@ PathEdit::~PathEdit() {
     if(model_) {
         delete model_;
     }
-    if(cancellable_) {
-        g_cancellable_cancel(cancellable_);
-        g_object_unref(cancellable_);
+    if(folder_) {
+        folder_->disconnect(this);
     }
 }
 
@@ -178,67 +139,71 @@ void PathEdit::autoComplete() {
 
 void PathEdit::reloadCompleter(bool triggeredByFocusInEvent) {
     // parent dir has been changed, reload dir list
-    // if(currentPrefix_[0] == "~") { // special case for home dir
-    // cancel running dir-listing jobs, if there's any
-    if(cancellable_) {
-        g_cancellable_cancel(cancellable_);
-        g_object_unref(cancellable_);
-    }
-
-    // create a new job to do dir listing
-    PathEditJob* job = new PathEditJob();
-    job->edit = this;
-    job->triggeredByFocusInEvent = triggeredByFocusInEvent;
-    // need to use fm_file_new_for_commandline_arg() rather than g_file_new_for_commandline_arg().
-    // otherwise, our own vfs, such as menu://, won't be loaded.
-    job->dirName = g_file_new_for_commandline_arg(currentPrefix_.toLocal8Bit().constData());
-    // qDebug("load: %s", g_file_get_uri(data->dirName));
-    cancellable_ = g_cancellable_new();
-    job->cancellable = (GCancellable*)g_object_ref(cancellable_);
-
-    // launch a new worker thread to handle the job
-    QThread* thread = new QThread();
-    job->moveToThread(thread);
-    connect(job, &PathEditJob::finished, this, &PathEdit::onJobFinished, Qt::BlockingQueuedConnection);
-    // connect(job, &PathEditJob::finished, thread, &QThread::quit);
-    connect(thread, &QThread::started, job, &PathEditJob::runJob);
-    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
-    connect(thread, &QThread::finished, job, &QObject::deleteLater);
-    thread->start(QThread::LowPriority);
+    freeCompleter();
+    auto path = FilePath::fromPathStr(currentPrefix_.toLocal8Bit().constData());
+    if(!path.isValid()) {
+        return;
+    }
+    // A shared folder which only lists the sub dirs is used. It's loaded by the job pool, and if it's
+    // already loaded or cached, e.g. by the dir tree, it's not listed again.
+    folder_ = Folder::dirsFromPath(path);
+    completeWhenLoaded_ = !triggeredByFocusInEvent;
+    connect(folder_.get(), &Folder::filesAdded, this, &PathEdit::onFilesAdded);
+    connect(folder_.get(), &Folder::filesRemoved, this, &PathEdit::onFilesRemoved);
+    connect(folder_.get(), &Folder::finishLoading, this, &PathEdit::onFolderFinishLoading);
+    if(folder_->isLoaded()) {
+        onFilesAdded(folder_->files());
+        onFolderFinishLoading();
+    }
+    else if(folder_->isIncremental() && !folder_->isEmpty()) { // partially loaded
+        onFilesAdded(folder_->files());
+    }
 }
 
 void PathEdit::freeCompleter() {
-    if(cancellable_) {
-        g_cancellable_cancel(cancellable_);
-        g_object_unref(cancellable_);
-        cancellable_ = nullptr;
+    if(folder_) {
+        folder_->disconnect(this);
+        folder_.reset();
     }
     model_->setStringList(QStringList());
 }
 
-// This slot is called from main thread so it's safe to access the GUI
-void PathEdit::onJobFinished() {
-    PathEditJob* data = static_cast<PathEditJob*>(sender());
-    if(!g_cancellable_is_cancelled(data->cancellable)) {
-        // update the completer only if the job is not cancelled
-        QStringList::iterator it;
-        for(it = data->subDirs.begin(); it != data->subDirs.end(); ++it) {
-            // qDebug("%s", it->toUtf8().constData());
-            *it = (currentPrefix_ % *it);
-        }
-        model_->setStringList(data->subDirs);
-        // trigger completion manually
-        if(hasFocus() && !data->triggeredByFocusInEvent) {
-            completer_->complete();
+void PathEdit::onFilesAdded(const FileInfoList& files) {
+    // insert the new dirs into the sorted list
+    QStringList list = model_->stringList();
+    bool added = false;
+    for(auto& file : files) {
+        // the folder might be a full folder loaded by a view
+        if(!file->isDir()) {
+            continue;
         }
+        QString item = currentPrefix_ % file->displayName();
+        list.insert(std::lower_bound(list.begin(), list.end(), item), item);
+        added = true;
     }
-    else {
-        model_->setStringList(QStringList());
+    if(added) {
+        model_->setStringList(list);
+    }
+}
+
+void PathEdit::onFilesRemoved(const FileInfoList& files) {
+    QStringList list = model_->stringList();
+    for(auto& file : files) {
+        QString item = currentPrefix_ % file->displayName();
+        auto it = std::lower_bound(list.begin(), list.end(), item);
+        if(it != list.end() && *it == item) {
+            list.erase(it);
+        }
     }
-    if(cancellable_) {
-        g_object_unref(cancellable_);
-        cancellable_ = nullptr;
+    model_->setStringList(list);
+}
+
+void PathEdit::onFolderFinishLoading() {
+    // trigger completion manually
+    if(completeWhenLoaded_ && hasFocus()) {
+        completer_->complete();
     }
+    completeWhenLoaded_ = false;
 }
 
 } // namespace Fm
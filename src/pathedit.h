@@ -23,15 +23,14 @@
 
 #include "libfmqtglobals.h"
 #include <QLineEdit>
-#include <gio/gio.h>
+#include <memory>
+#include "core/folder.h"
 
 class QCompleter;
 class QStringListModel;
 
 namespace Fm {
 
-class PathEditJob;
-
 class LIBFM_QT_API PathEdit : public QLineEdit {
     Q_OBJECT
 public:
@@ -51,13 +50,16 @@ private:
     void autoComplete();
     void reloadCompleter(bool triggeredByFocusInEvent = false);
     void freeCompleter();
-    void onJobFinished();
+    void onFilesAdded(const FileInfoList& files);
+    void onFilesRemoved(const FileInfoList& files);
+    void onFolderFinishLoading();
 
 private:
     QCompleter* completer_;
     QStringListModel* model_;
     QString currentPrefix_;
-    GCancellable* cancellable_;
+    std::shared_ptr<Folder> folder_; // the sub dirs of currentPrefix_ are completed
+    bool completeWhenLoaded_;
 };
 
 }
@@ -23,23 +23,42 @@
 #include <QDebug>
 #include <QMimeData>
 #include <QTimer>
-#include <QPointer>
 #include <QStandardPaths>
 #include "utilities.h"
 #include "placesmodelitem.h"
+#include "core/gioasync.h"
 
 namespace Fm {
 
+// the minimal interval between the queries of the trash item count, in ms
+static const int trashUpdateInterval = 500;
+
 std::weak_ptr<PlacesModel> PlacesModel::globalInstance_;
 
 PlacesModel::PlacesModel(QObject* parent):
     QStandardItemModel(parent),
     showApplications_(true),
     showDesktop_(true),
+    showTrash_(true),
+    trashItem_(nullptr),
+    trashMonitor_(nullptr),
+    trashUpdateTimer_(new QTimer(this)),
+    trashQueryRunning_(false),
+    trashUpdatePending_(false),
+    trashItemCount_(-1),
+    trashProbeRunning_(false),
     // FIXME: this seems to be broken when porting to new API.
     ejectIcon_(QIcon::fromTheme("media-eject")) {
     setColumnCount(2);
 
+    // a bulk trash operation emits many change events, which are handled together
+    trashUpdateTimer_->setSingleShot(true);
+    trashUpdateTimer_->setInterval(trashUpdateInterval);
+    connect(trashUpdateTimer_, &QTimer::timeout, this, &PlacesModel::updateTrash);
+
+    connect(this, &QStandardItemModel::rowsInserted, this, &PlacesModel::onRowsInserted);
+    connect(this, &QStandardItemModel::rowsAboutToBeRemoved, this, &PlacesModel::onRowsAboutToBeRemoved);
+
     placesRoot = new QStandardItem(tr("Places"));
     placesRoot->setSelectable(false);
     placesRoot->setColumnCount(2);
@@ -80,82 +99,66 @@ PlacesModel::PlacesModel(QObject* parent):
     devicesRoot->setColumnCount(2);
     appendRow(devicesRoot);
 
-    // volumes
-    volumeMonitor = g_volume_monitor_get();
-    if(volumeMonitor) {
-        g_signal_connect(volumeMonitor, "volume-added", G_CALLBACK(onVolumeAdded), this);
-        g_signal_connect(volumeMonitor, "volume-removed", G_CALLBACK(onVolumeRemoved), this);
-        g_signal_connect(volumeMonitor, "volume-changed", G_CALLBACK(onVolumeChanged), this);
-        g_signal_connect(volumeMonitor, "mount-added", G_CALLBACK(onMountAdded), this);
-        g_signal_connect(volumeMonitor, "mount-changed", G_CALLBACK(onMountChanged), this);
-        g_signal_connect(volumeMonitor, "mount-removed", G_CALLBACK(onMountRemoved), this);
-
-        // add volumes to side-pane
-        GList* vols = g_volume_monitor_get_volumes(volumeMonitor);
-        GList* l;
-        for(l = vols; l; l = l->next) {
-            GVolume* volume = G_VOLUME(l->data);
-            onVolumeAdded(volumeMonitor, volume, this);
-            g_object_unref(volume);
-        }
-        g_list_free(vols);
-
-        /* add mounts to side-pane */
-        vols = g_volume_monitor_get_mounts(volumeMonitor);
-        for(l = vols; l; l = l->next) {
-            GMount* mount = G_MOUNT(l->data);
-            GVolume* volume = g_mount_get_volume(mount);
-            if(volume) {
-                g_object_unref(volume);
-            }
-            else { /* network mounts or others */
-                gboolean shadowed = FALSE;
-#if GLIB_CHECK_VERSION(2, 20, 0)
-                shadowed = g_mount_is_shadowed(mount);
-#endif
-                // according to gio API doc, a shadowed mount should not be visible to the user
-                if(shadowed) {
-                    shadowedMounts_.push_back(mount);
-                    continue;
-                }
-                else {
-                    PlacesModelItem* item = new PlacesModelMountItem(mount);
-                    devicesRoot->appendRow(item);
-                }
-            }
-            g_object_unref(mount);
-        }
-        g_list_free(vols);
-    }
-
-    // bookmarks
     bookmarksRoot = new QStandardItem(tr("Bookmarks"));
     bookmarksRoot->setSelectable(false);
     bookmarksRoot->setColumnCount(2);
     appendRow(bookmarksRoot);
 
-    bookmarks = Fm::Bookmarks::globalInstance();
-    loadBookmarks();
-    connect(bookmarks.get(), &Fm::Bookmarks::changed, this, &PlacesModel::onBookmarksChanged);
+    // only the fixed places are added before the first paint
+    QTimer::singleShot(0, this, [this]() {
+        loadBookmarks();
+    });
+    loadVolumes();
 }
 
 void PlacesModel::loadBookmarks() {
+    if(bookmarks) {
+        return;
+    }
+    bookmarks = Fm::Bookmarks::globalInstance();
+    // the rows are inserted at once, so the views update their filters only once
+    QList<QStandardItem*> items;
     for(auto& bm_item: bookmarks->items()) {
-        PlacesModelBookmarkItem* item = new PlacesModelBookmarkItem(bm_item);
-        bookmarksRoot->appendRow(item);
+        items << new PlacesModelBookmarkItem(bm_item);
     }
+    if(!items.isEmpty()) {
+        bookmarksRoot->appendRows(items);
+    }
+    connect(bookmarks.get(), &Fm::Bookmarks::changed, this, &PlacesModel::onBookmarksChanged);
 }
 
-PlacesModel::~PlacesModel() {
-    if(volumeMonitor) {
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onVolumeAdded), this);
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onVolumeRemoved), this);
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onVolumeChanged), this);
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onMountAdded), this);
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onMountChanged), this);
-        g_signal_handlers_disconnect_by_func(volumeMonitor, (gpointer)G_CALLBACK(onMountRemoved), this);
-        g_object_unref(volumeMonitor);
+void PlacesModel::loadVolumes() {
+    // VolumeManager gets the volume monitor in a thread, and reports the volumes and
+    // the mounts when it's ready, so they're added like the ones added later.
+    volumeManager_ = Fm::VolumeManager::globalInstance();
+    connect(volumeManager_.get(), &Fm::VolumeManager::volumeAdded, this, [this](const Fm::Volume& vol) {
+        queueVolumeEvent(VolumeAdded, vol.get());
+    });
+    connect(volumeManager_.get(), &Fm::VolumeManager::volumeRemoved, this, [this](const Fm::Volume& vol) {
+        queueVolumeEvent(VolumeRemoved, vol.get());
+    });
+    connect(volumeManager_.get(), &Fm::VolumeManager::volumeChanged, this, [this](const Fm::Volume& vol) {
+        queueVolumeEvent(VolumeChanged, vol.get());
+    });
+    connect(volumeManager_.get(), &Fm::VolumeManager::mountAdded, this, [this](const Fm::Mount& mnt) {
+        queueVolumeEvent(MountAdded, mnt.get());
+    });
+    connect(volumeManager_.get(), &Fm::VolumeManager::mountRemoved, this, [this](const Fm::Mount& mnt) {
+        queueVolumeEvent(MountRemoved, mnt.get());
+    });
+    connect(volumeManager_.get(), &Fm::VolumeManager::mountChanged, this, [this](const Fm::Mount& mnt) {
+        queueVolumeEvent(MountChanged, mnt.get());
+    });
+    // the shared instance might be ready already
+    for(const auto& vol: volumeManager_->volumes()) {
+        queueVolumeEvent(VolumeAdded, vol.get());
+    }
+    for(const auto& mnt: volumeManager_->mounts()) {
+        queueVolumeEvent(MountAdded, mnt.get());
     }
+}
+
+PlacesModel::~PlacesModel() {
     if(trashMonitor_) {
         g_signal_handlers_disconnect_by_func(trashMonitor_, (gpointer)G_CALLBACK(onTrashChanged), this);
         g_object_unref(trashMonitor_);
@@ -168,66 +171,76 @@ PlacesModel::~PlacesModel() {
 
 // static
 void PlacesModel::onTrashChanged(GFileMonitor* /*monitor*/, GFile* /*gf*/, GFile* /*other*/, GFileMonitorEvent /*evt*/, PlacesModel* pThis) {
-    QTimer::singleShot(0, pThis, SLOT(updateTrash()));
+    pThis->queueTrashUpdate();
 }
 
-void PlacesModel::updateTrash() {
-
-    struct UpdateTrashData {
-        QPointer<PlacesModel> model;
-        GFile* gf;
-        UpdateTrashData(PlacesModel* _model) : model(_model) {
-            gf = g_file_new_for_uri("trash:///");
-        }
-        ~UpdateTrashData() {
-            g_object_unref(gf);
-        }
-    };
+void PlacesModel::queueTrashUpdate() {
+    // the timer is not restarted, so the updates still happen during a long operation
+    if(!trashUpdateTimer_->isActive()) {
+        trashUpdateTimer_->start();
+    }
+}
 
+void PlacesModel::updateTrash() {
+    if(trashQueryRunning_) {
+        // query again when the running query is finished
+        trashUpdatePending_ = true;
+        return;
+    }
     if(trashItem_) {
-        UpdateTrashData* data = new UpdateTrashData(this);
-        g_file_query_info_async(data->gf, G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT, G_FILE_QUERY_INFO_NONE, G_PRIORITY_LOW, nullptr,
-        [](GObject * /*source_object*/, GAsyncResult * res, gpointer user_data) {
-            // the callback lambda function is called when the asyn query operation is finished
-            UpdateTrashData* data = reinterpret_cast<UpdateTrashData*>(user_data);
-            PlacesModel* _this = data->model.data();
-            if(_this != nullptr) { // ensure that our model object is not deleted yet
-                Fm::GFileInfoPtr inf{g_file_query_info_finish(data->gf, res, nullptr), false};
-                if(inf) {
-                    if(_this->trashItem_ != nullptr) { // it's possible that when we finish, the trash item is removed
-                        guint32 n = g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT);
+        trashQueryRunning_ = true;
+        // the callback is not called if the model is deleted meanwhile
+        Fm::GioAsync::queryInfo(Fm::FilePath::fromUri("trash:///"), G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT,
+                                G_FILE_QUERY_INFO_NONE, Fm::GCancellablePtr{}, this,
+                                [this](Fm::GFileInfoPtr& inf, Fm::GErrorPtr& /*err*/) {
+            trashQueryRunning_ = false;
+            if(inf) {
+                if(trashItem_ != nullptr) { // it's possible that when we finish, the trash item is removed
+                    int n = g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT);
+                    // only change the icon when the trash becomes empty or not
+                    if(trashItemCount_ < 0 || (n > 0) != (trashItemCount_ > 0)) {
                         const char* icon_name = n > 0 ? "user-trash-full" : "user-trash";
                         auto icon = Fm::IconInfo::fromName(icon_name);
-                        _this->trashItem_->setIcon(std::move(icon));
+                        trashItem_->setIcon(std::move(icon));
                     }
+                    trashItemCount_ = n;
                 }
             }
-            delete data; // free the data used for this async operation.
-        }, data);
+            if(trashUpdatePending_) {
+                trashUpdatePending_ = false;
+                queueTrashUpdate();
+            }
+        }, G_PRIORITY_LOW);
     }
 }
 
 void PlacesModel::createTrashItem() {
-    GFile* gf;
-    gf = g_file_new_for_uri("trash:///");
-    // check if trash is supported by the current vfs
-    // if gvfs is not installed, this can be unavailable.
-    if(!g_file_query_exists(gf, nullptr)) {
-        g_object_unref(gf);
-        trashItem_ = nullptr;
-        trashMonitor_ = nullptr;
+    if(trashItem_ || trashProbeRunning_) {
         return;
     }
-    trashItem_ = new PlacesModelItem("user-trash", tr("Trash"), Fm::FilePath::fromUri("trash:///"));
-
-    trashMonitor_ = g_file_monitor_directory(gf, G_FILE_MONITOR_NONE, nullptr, nullptr);
-    if(trashMonitor_) {
-        g_signal_connect(trashMonitor_, "changed", G_CALLBACK(onTrashChanged), this);
-    }
-    g_object_unref(gf);
+    // check if trash is supported by the current vfs
+    // if gvfs is not installed, this can be unavailable.
+    // The query talks to gvfs, so the item is added when it's finished, with the icon for its count.
+    trashProbeRunning_ = true;
+    Fm::GioAsync::queryInfo(Fm::FilePath::fromUri("trash:///"), G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT,
+                            G_FILE_QUERY_INFO_NONE, Fm::GCancellablePtr{}, this,
+                            [this](Fm::GFileInfoPtr& inf, Fm::GErrorPtr& /*err*/) {
+        trashProbeRunning_ = false;
+        if(!inf || !showTrash_ || trashItem_) {
+            return;
+        }
+        int n = g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_TRASH_ITEM_COUNT);
+        trashItem_ = new PlacesModelItem(n > 0 ? "user-trash-full" : "user-trash", tr("Trash"), Fm::FilePath::fromUri("trash:///"));
+        trashItemCount_ = n;
+
+        Fm::GFilePtr gf{g_file_new_for_uri("trash:///"), false};
+        trashMonitor_ = g_file_monitor_directory(gf.get(), G_FILE_MONITOR_NONE, nullptr, nullptr);
+        if(trashMonitor_) {
+            g_signal_connect(trashMonitor_, "changed", G_CALLBACK(onTrashChanged), this);
+        }
 
-    placesRoot->insertRow(desktopItem->row() + 1, trashItem_);
-    QTimer::singleShot(0, this, SLOT(updateTrash()));
+        placesRoot->insertRow(desktopItem->row() + 1, trashItem_);
+    }, G_PRIORITY_LOW);
 }
 
 void PlacesModel::setShowApplications(bool show) {
@@ -243,6 +256,7 @@ void PlacesModel::setShowDesktop(bool show) {
 }
 
 void PlacesModel::setShowTrash(bool show) {
+    showTrash_ = show;
     if(show) {
         if(!trashItem_) {
             createTrashItem();
@@ -257,6 +271,7 @@ void PlacesModel::setShowTrash(bool show) {
             }
             placesRoot->removeRow(trashItem_->row()); // delete trashItem_;
             trashItem_ = nullptr;
+            trashItemCount_ = -1;
         }
     }
 }
@@ -273,6 +288,10 @@ PlacesModelItem* PlacesModel::itemFromPath(const Fm::FilePath &path) {
 }
 
 PlacesModelItem* PlacesModel::itemFromPath(QStandardItem* rootItem, const Fm::FilePath &path) {
+    if(rootItem == bookmarksRoot) {
+        auto it = bookmarkPaths_.find(path);
+        return it != bookmarkPaths_.end() ? it->second : nullptr;
+    }
     int rowCount = rootItem->rowCount();
     for(int i = 0; i < rowCount; ++i) {
         PlacesModelItem* item = static_cast<PlacesModelItem*>(rootItem->child(i, 0));
@@ -284,42 +303,144 @@ PlacesModelItem* PlacesModel::itemFromPath(QStandardItem* rootItem, const Fm::Fi
 }
 
 PlacesModelVolumeItem* PlacesModel::itemFromVolume(GVolume* volume) {
-    int rowCount = devicesRoot->rowCount();
-    for(int i = 0; i < rowCount; ++i) {
-        PlacesModelItem* item = static_cast<PlacesModelItem*>(devicesRoot->child(i, 0));
-        if(item->type() == PlacesModelItem::Volume) {
-            PlacesModelVolumeItem* volumeItem = static_cast<PlacesModelVolumeItem*>(item);
-            if(volumeItem->volume() == volume) {
-                return volumeItem;
-            }
+    auto it = volumeItems_.find(volume);
+    return it != volumeItems_.end() ? it->second : nullptr;
+}
+
+PlacesModelMountItem* PlacesModel::itemFromMount(GMount* mount) {
+    auto it = mountItems_.find(mount);
+    return it != mountItems_.end() ? it->second : nullptr;
+}
+
+PlacesModelBookmarkItem* PlacesModel::itemFromBookmark(std::shared_ptr<const Fm::BookmarkItem> bkitem) {
+    auto it = bookmarkItems_.find(bkitem.get());
+    return it != bookmarkItems_.end() ? it->second : nullptr;
+}
+
+void PlacesModel::onRowsInserted(const QModelIndex& parent, int first, int last) {
+    QStandardItem* parentItem = itemFromIndex(parent);
+    if(!parentItem) { // the sections
+        return;
+    }
+    for(int row = first; row <= last; ++row) {
+        auto item = static_cast<PlacesModelItem*>(parentItem->child(row, 0));
+        if(!item) {
+            continue;
+        }
+        switch(item->type()) {
+        case PlacesModelItem::Volume: {
+            auto volumeItem = static_cast<PlacesModelVolumeItem*>(item);
+            volumeItems_[volumeItem->volume()] = volumeItem;
+            break;
+        }
+        case PlacesModelItem::Mount: {
+            auto mountItem = static_cast<PlacesModelMountItem*>(item);
+            mountItems_[mountItem->mount()] = mountItem;
+            break;
+        }
+        case PlacesModelItem::Bookmark: {
+            auto bookmarkItem = static_cast<PlacesModelBookmarkItem*>(item);
+            bookmarkItems_[bookmarkItem->bookmark().get()] = bookmarkItem;
+            bookmarkPaths_.emplace(bookmarkItem->path(), bookmarkItem);
+            break;
+        }
         }
     }
-    return nullptr;
 }
 
-PlacesModelMountItem* PlacesModel::itemFromMount(GMount* mount) {
-    int rowCount = devicesRoot->rowCount();
-    for(int i = 0; i < rowCount; ++i) {
-        PlacesModelItem* item = static_cast<PlacesModelItem*>(devicesRoot->child(i, 0));
-        if(item->type() == PlacesModelItem::Mount) {
-            PlacesModelMountItem* mountItem = static_cast<PlacesModelMountItem*>(item);
-            if(mountItem->mount() == mount) {
-                return mountItem;
+void PlacesModel::onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last) {
+    QStandardItem* parentItem = itemFromIndex(parent);
+    if(!parentItem) {
+        return;
+    }
+    for(int row = first; row <= last; ++row) {
+        auto item = static_cast<PlacesModelItem*>(parentItem->child(row, 0));
+        if(!item) {
+            continue;
+        }
+        switch(item->type()) {
+        case PlacesModelItem::Volume: {
+            auto it = volumeItems_.find(static_cast<PlacesModelVolumeItem*>(item)->volume());
+            if(it != volumeItems_.end() && it->second == item) {
+                volumeItems_.erase(it);
+            }
+            break;
+        }
+        case PlacesModelItem::Mount: {
+            auto it = mountItems_.find(static_cast<PlacesModelMountItem*>(item)->mount());
+            if(it != mountItems_.end() && it->second == item) {
+                mountItems_.erase(it);
             }
+            break;
+        }
+        case PlacesModelItem::Bookmark: {
+            auto bookmarkItem = static_cast<PlacesModelBookmarkItem*>(item);
+            auto it = bookmarkItems_.find(bookmarkItem->bookmark().get());
+            if(it != bookmarkItems_.end() && it->second == item) {
+                bookmarkItems_.erase(it);
+            }
+            auto range = bookmarkPaths_.equal_range(bookmarkItem->path());
+            for(auto pathIt = range.first; pathIt != range.second; ++pathIt) {
+                if(pathIt->second == item) {
+                    bookmarkPaths_.erase(pathIt);
+                    break;
+                }
+            }
+            break;
+        }
         }
     }
-    return nullptr;
 }
 
-PlacesModelBookmarkItem* PlacesModel::itemFromBookmark(std::shared_ptr<const Fm::BookmarkItem> bkitem) {
-    int rowCount = bookmarksRoot->rowCount();
-    for(int i = 0; i < rowCount; ++i) {
-        PlacesModelBookmarkItem* item = static_cast<PlacesModelBookmarkItem*>(bookmarksRoot->child(i, 0));
-        if(item->bookmark() == bkitem) {
-            return item;
+void PlacesModel::queueVolumeEvent(VolumeEventType type, gpointer object) {
+    if(volumeEvents_.empty()) {
+        QTimer::singleShot(0, this, &PlacesModel::processVolumeEvents);
+    }
+    volumeEvents_.push_back(VolumeEvent{type, GObjectPtr<GObject>{G_OBJECT(object)}});
+}
+
+void PlacesModel::processVolumeEvents() {
+    auto events = std::move(volumeEvents_);
+    volumeEvents_.clear();
+    // a "changed" event is skipped if the next event of the same object is the same,
+    // so the items are updated and their icons are created only once for each batch.
+    std::vector<bool> skipped(events.size(), false);
+    std::unordered_map<GObject*, VolumeEventType> nextEvents;
+    for(size_t i = events.size(); i-- > 0;) {
+        auto& event = events[i];
+        auto it = nextEvents.find(event.object.get());
+        if((event.type == VolumeChanged || event.type == MountChanged)
+                && it != nextEvents.end() && it->second == event.type) {
+            skipped[i] = true;
+        }
+        nextEvents[event.object.get()] = event.type;
+    }
+    for(size_t i = 0; i < events.size(); ++i) {
+        if(skipped[i]) {
+            continue;
+        }
+        auto object = events[i].object.get();
+        switch(events[i].type) {
+        case VolumeAdded:
+            onVolumeAdded(nullptr, G_VOLUME(object), this);
+            break;
+        case VolumeRemoved:
+            onVolumeRemoved(nullptr, G_VOLUME(object), this);
+            break;
+        case VolumeChanged:
+            onVolumeChanged(nullptr, G_VOLUME(object), this);
+            break;
+        case MountAdded:
+            onMountAdded(nullptr, G_MOUNT(object), this);
+            break;
+        case MountRemoved:
+            onMountRemoved(nullptr, G_MOUNT(object), this);
+            break;
+        case MountChanged:
+            onMountChanged(nullptr, G_MOUNT(object), this);
+            break;
         }
     }
-    return nullptr;
 }
 
 void PlacesModel::onMountAdded(GVolumeMonitor* /*monitor*/, GMount* mount, PlacesModel* pThis) {
@@ -465,9 +586,37 @@ void PlacesModel::onVolumeRemoved(GVolumeMonitor* /*monitor*/, GVolume* volume,
 }
 
 void PlacesModel::onBookmarksChanged() {
-    // remove all items
-    bookmarksRoot->removeRows(0, bookmarksRoot->rowCount());
-    loadBookmarks();
+    // The bookmark items are kept when they're moved or renamed, so only the changed rows are updated.
+    auto& items = bookmarks->items();
+    std::unordered_map<const Fm::BookmarkItem*, int> newBookmarks;
+    for(size_t i = 0; i < items.size(); ++i) {
+        newBookmarks.emplace(items[i].get(), int(i));
+    }
+    for(int row = bookmarksRoot->rowCount() - 1; row >= 0; --row) {
+        auto item = static_cast<PlacesModelBookmarkItem*>(bookmarksRoot->child(row, 0));
+        if(newBookmarks.find(item->bookmark().get()) == newBookmarks.end()) {
+            bookmarksRoot->removeRow(row);
+        }
+    }
+    for(int row = 0; row < int(items.size()); ++row) {
+        auto& bookmark = items[row];
+        auto item = row < bookmarksRoot->rowCount() ? static_cast<PlacesModelBookmarkItem*>(bookmarksRoot->child(row, 0)) : nullptr;
+        if(!item || item->bookmark() != bookmark) {
+            auto existing = itemFromBookmark(bookmark);
+            if(existing) { // moved
+                bookmarksRoot->insertRow(row, bookmarksRoot->takeRow(existing->row()));
+                item = existing;
+            }
+            else {
+                item = new PlacesModelBookmarkItem(bookmark);
+                bookmarksRoot->insertRow(row, item);
+                continue;
+            }
+        }
+        if(item->text() != bookmark->name()) { // renamed
+            item->setText(bookmark->name());
+        }
+    }
 }
 
 Qt::ItemFlags PlacesModel::flags(const QModelIndex& index) const {
@@ -512,6 +661,8 @@ std::shared_ptr<PlacesModel> PlacesModel::globalInstance() {
 
 
 bool PlacesModel::dropMimeData(const QMimeData* data, Qt::DropAction /*action*/, int row, int column, const QModelIndex& parent) {
+    // the bookmarks might not be loaded yet
+    loadBookmarks();
     QStandardItem* item = itemFromIndex(parent);
     if(data->hasFormat("application/x-bookmark-row")) { // the data being dopped is a bookmark row
         // decode it and do bookmark reordering
@@ -562,7 +713,7 @@ bool PlacesModel::dropMimeData(const QMimeData* data, Qt::DropAction /*action*/,
         }
         else { // drop uris on a position between items
             if(item == bookmarksRoot) { // we only allow dropping on blank row of bookmarks section
-                auto paths = pathListFromQUrls(data->urls());
+                auto paths = pathListFromMimeData(*data);
                 for(auto& path: paths) {
                     // FIXME: this is a blocking call
                     if(g_file_query_file_type(path.gfile().get(), G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
@@ -28,9 +28,15 @@
 #include <QAction>
 
 #include <memory>
+#include <vector>
+#include <unordered_map>
 
 #include "core/filepath.h"
 #include "core/bookmarks.h"
+#include "core/volumemanager.h"
+#include "core/gobjectptr.h"
+
+class QTimer;
 
 namespace Fm {
 
@@ -73,6 +79,11 @@ public:
     }
     void setShowTrash(bool show);
 
+    // the cached number of items in the trash, or -1 if it's not known yet
+    int trashItemCount() const {
+        return trashItemCount_;
+    }
+
     bool showApplications() {
         return showApplications_;
     }
@@ -108,8 +119,35 @@ protected:
     void createTrashItem();
 
 private:
+    // The items are added in steps, so the fixed places are shown first: the bookmarks are loaded
+    // in the next event loop iteration, the devices as VolumeManager reports them, and the trash
+    // after gvfs tells that it exists.
     void loadBookmarks();
 
+    void loadVolumes();
+
+    // keep the indices of the items up to date
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+
+    // the volume monitor events are queued and handled together in the next event loop iteration
+    enum VolumeEventType {
+        VolumeAdded,
+        VolumeRemoved,
+        VolumeChanged,
+        MountAdded,
+        MountRemoved,
+        MountChanged
+    };
+
+    struct VolumeEvent {
+        VolumeEventType type;
+        GObjectPtr<GObject> object;
+    };
+
+    void queueVolumeEvent(VolumeEventType type, gpointer object);
+    void processVolumeEvents();
+
     static void onVolumeAdded(GVolumeMonitor* monitor, GVolume* volume, PlacesModel* pThis);
     static void onVolumeRemoved(GVolumeMonitor* monitor, GVolume* volume, PlacesModel* pThis);
     static void onVolumeChanged(GVolumeMonitor* monitor, GVolume* volume, PlacesModel* pThis);
@@ -119,16 +157,25 @@ private:
 
     static void onTrashChanged(GFileMonitor* monitor, GFile* gf, GFile* other, GFileMonitorEvent evt, PlacesModel* pThis);
 
+    // schedule updateTrash() unless it's scheduled already
+    void queueTrashUpdate();
+
 private:
     std::shared_ptr<Fm::Bookmarks> bookmarks;
-    GVolumeMonitor* volumeMonitor;
+    std::shared_ptr<Fm::VolumeManager> volumeManager_;
     bool showApplications_;
     bool showDesktop_;
+    bool showTrash_;
     QStandardItem* placesRoot;
     QStandardItem* devicesRoot;
     QStandardItem* bookmarksRoot;
     PlacesModelItem* trashItem_;
     GFileMonitor* trashMonitor_;
+    QTimer* trashUpdateTimer_; // limits the rate of trash updates
+    bool trashQueryRunning_;
+    bool trashUpdatePending_; // the trash is changed while the query is running
+    int trashItemCount_;
+    bool trashProbeRunning_; // checking whether the trash exists
     PlacesModelItem* desktopItem;
     PlacesModelItem* homeItem;
     PlacesModelItem* computerItem;
@@ -137,6 +184,13 @@ private:
     QIcon ejectIcon_;
     QList<GMount*> shadowedMounts_;
 
+    // indices of the items in the devices and bookmarks sections
+    std::unordered_map<GVolume*, PlacesModelVolumeItem*> volumeItems_;
+    std::unordered_map<GMount*, PlacesModelMountItem*> mountItems_;
+    std::unordered_map<const Fm::BookmarkItem*, PlacesModelBookmarkItem*> bookmarkItems_;
+    std::unordered_multimap<Fm::FilePath, PlacesModelBookmarkItem*, Fm::FilePathHash> bookmarkPaths_;
+    std::vector<VolumeEvent> volumeEvents_;
+
     static std::weak_ptr<PlacesModel> globalInstance_;
 };
 
@@ -29,6 +29,7 @@
 #include <QDebug>
 #include <QGuiApplication>
 #include "folderitemdelegate.h"
+#include "folderprefetcher_p.h"
 
 namespace Fm {
 
@@ -126,7 +127,8 @@ bool PlacesProxyModel::filterAcceptsRow(int source_row, const QModelIndex& sourc
 }
 
 PlacesView::PlacesView(QWidget* parent):
-    QTreeView(parent) {
+    QTreeView(parent),
+    prefetcher_(nullptr) {
     setRootIsDecorated(false);
     setHeaderHidden(true);
     setIndentation(12);
@@ -165,7 +167,10 @@ PlacesView::PlacesView(QWidget* parent):
         setFirstColumnSpanned(0, QModelIndex(), true);
         setFirstColumnSpanned(1, QModelIndex(), true);
         setFirstColumnSpanned(2, QModelIndex(), true);
-
+        // the item of the current path might be added after the view is created
+        if(currentPath_ && !selectionModel()->hasSelection()) {
+            setCurrentPath(currentPath_);
+        }
     });
     connect(model_.get(), &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex&, int, int) {
         proxyModel_->setHidden(QString());
@@ -200,6 +205,23 @@ PlacesView::~PlacesView() {
     // qDebug("delete PlacesView");
 }
 
+void PlacesView::setPrefetchOnHover(bool prefetch) {
+    if(prefetch && !prefetcher_) {
+        prefetcher_ = new FolderPrefetcher(this, [this](const QModelIndex& index) {
+            if(!index.parent().isValid()) { // the root items are only headings
+                return Fm::FilePath();
+            }
+            auto item = static_cast<PlacesModelItem*>(model_->itemFromIndex(proxyModel_->mapToSource(index)));
+            // the unmounted volumes have no path
+            return item ? item->path() : Fm::FilePath();
+        });
+    }
+    else if(!prefetch && prefetcher_) {
+        delete prefetcher_;
+        prefetcher_ = nullptr;
+    }
+}
+
 void PlacesView::activateRow(int type, const QModelIndex& index) {
     if(!index.parent().isValid()) { // ignore root items
         return;
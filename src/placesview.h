@@ -33,6 +33,7 @@ namespace Fm {
 class PlacesModel;
 class PlacesModelItem;
 class PlacesView;
+class FolderPrefetcher;
 
 class LIBFM_QT_API PlacesProxyModel : public QSortFilterProxyModel {
     Q_OBJECT
@@ -95,6 +96,14 @@ public:
 
     void restoreHiddenItems(const QSet<QString>& items);
 
+    // List the folder under the pointer, or the current one chosen with the keyboard, in the
+    // background after a short delay, so it's loaded already when it's opened. Off by default.
+    void setPrefetchOnHover(bool prefetch);
+
+    bool prefetchOnHover() const {
+        return prefetcher_ != nullptr;
+    }
+
 Q_SIGNALS:
     void chdirRequested(int type, const Fm::FilePath& path);
     void hiddenItemSet(const QString& str, bool hide);
@@ -139,6 +148,7 @@ private:
 private:
     std::shared_ptr<PlacesModel> model_;
     Fm::FilePath currentPath_;
+    FolderPrefetcher* prefetcher_;
 
     static std::shared_ptr<PlacesProxyModel> proxyModel_; // used to hide items in all views
 };
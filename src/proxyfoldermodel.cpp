@@ -20,22 +20,191 @@
 
 #include "proxyfoldermodel.h"
 #include "foldermodel.h"
+#include "foldermodelitem.h"
+#include "asciicollator_p.h"
 #include <QCollator>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
 
 namespace Fm {
 
+// the loaded thumbnails are shown in batches, about once a frame (in ms)
+static const int thumbnailUpdateInterval = 16;
+// the added and changed rows of a large folder are sorted at most once in this time (in ms)
+static const int deferredSortInterval = 1000;
+
+namespace {
+
+// the properties of a source row which are needed to sort it by a text column without accessing the model
+struct SortEntry {
+    int row;
+    bool isDir;
+    QString text; // text of the sort column if it's not the display name
+    QString displayName;
+    std::shared_ptr<const QCollatorSortKey> textKey;
+    std::shared_ptr<const QCollatorSortKey> nameKey;
+};
+
+// the key of a source row which is sorted by the size or the mtime, packed into 16 bytes
+struct NumericSortEntry {
+    std::uint64_t key;
+    int row;
+    bool isDir;
+};
+
+// the same order as ProxyFolderModel::lessThan() for the text columns, with the source row as the last tie-break
+struct SortEntryLess {
+    bool folderFirst;
+    bool ascending;
+    const AsciiCollator* ascii; // if all the names are ASCII, they're compared by it without the name keys
+
+    int compareNames(const SortEntry& a, const SortEntry& b) const {
+        return ascii ? ascii->compare(a.displayName, b.displayName) : a.nameKey->compare(*b.nameKey);
+    }
+
+    bool operator()(const SortEntry& a, const SortEntry& b) const {
+        if(folderFirst && a.isDir != b.isDir) {
+            return ascending ? a.isDir : b.isDir;
+        }
+        int comp = a.textKey ? a.textKey->compare(*b.textKey) : compareNames(a, b);
+        if(comp == 0 && a.textKey) {
+            comp = compareNames(a, b);
+        }
+        return comp != 0 ? comp < 0 : a.row < b.row;
+    }
+};
+
+// The order of the numeric columns without the tie-break by the names, which is only needed for
+// the runs of equal keys. It's specialized for each setting so each comparison is only a few instructions.
+template <bool folderFirst, bool ascending>
+struct NumericSortEntryLess {
+    bool operator()(const NumericSortEntry& a, const NumericSortEntry& b) const {
+        if(folderFirst && a.isDir != b.isDir) {
+            return ascending ? a.isDir : b.isDir;
+        }
+        return a.key < b.key;
+    }
+};
+
+// call func(begin, end) for nThreads consecutive ranges of [0, count) in parallel
+template <typename Func>
+void parallelForRanges(int count, int nThreads, Func func) {
+    std::vector<std::thread> threads;
+    int chunk = (count + nThreads - 1) / nThreads;
+    for(int begin = chunk; begin < count; begin += chunk) {
+        threads.emplace_back(func, begin, std::min(begin + chunk, count));
+    }
+    func(0, std::min(chunk, count)); // the calling thread handles the first range
+    for(auto& thread: threads) {
+        thread.join();
+    }
+}
+
+// Compute the collation keys of the display names of the items which don't have a valid one.
+// The ASCII names compared by ascii don't need them.
+void cacheSortKeys(const std::vector<FolderModelItem*>& items, const QCollator& collator, unsigned int serial,
+                   const AsciiCollator* ascii) {
+    int count = items.size();
+    int nThreads = std::max(1, std::min(QThread::idealThreadCount(), count / 1024));
+    parallelForRanges(count, nThreads, [&](int begin, int end) {
+        QCollator threadCollator{collator}; // QCollator is reentrant, but not thread-safe
+        for(int i = begin; i < end; ++i) {
+            if(!ascii->isValid() || !AsciiCollator::isAscii(items[i]->displayName())) {
+                items[i]->displayNameSortKey(threadCollator, serial);
+            }
+        }
+    });
+}
+
+// Sort the entries with a parallel merge sort. prepare(begin, end) is called in the thread which
+// sorts the range before it's sorted.
+template <typename Entry, typename Less, typename Prepare>
+void parallelMergeSort(std::vector<Entry>& entries, const Less& less, Prepare prepare) {
+    int count = entries.size();
+    int nThreads = std::max(1, std::min(QThread::idealThreadCount(), count / 1024));
+    int chunk = (count + nThreads - 1) / nThreads;
+    parallelForRanges(count, nThreads, [&](int begin, int end) {
+        prepare(begin, end);
+        std::sort(entries.begin() + begin, entries.begin() + end, less);
+    });
+    // merge the sorted ranges pairwise
+    for(int width = chunk; width < count; width *= 2) {
+        std::vector<std::thread> threads;
+        for(int begin = 0; begin + width < count; begin += 2 * width) {
+            auto first = entries.begin() + begin;
+            auto middle = first + width;
+            auto last = entries.begin() + std::min(begin + 2 * width, count);
+            threads.emplace_back([first, middle, last, &less]() {
+                std::inplace_merge(first, middle, last, less);
+            });
+        }
+        for(auto& thread: threads) {
+            thread.join();
+        }
+    }
+}
+
+// compute the missing collation keys and sort the entries of a text column
+void parallelSort(std::vector<SortEntry>& entries, const QCollator& collator, const SortEntryLess& less) {
+    parallelMergeSort(entries, less, [&](int begin, int end) {
+        QCollator threadCollator{collator}; // QCollator is reentrant, but not thread-safe
+        for(int i = begin; i < end; ++i) {
+            auto& entry = entries[i];
+            if(!entry.nameKey && !less.ascii) {
+                entry.nameKey = std::make_shared<const QCollatorSortKey>(threadCollator.sortKey(entry.displayName));
+            }
+            if(!entry.text.isNull()) {
+                entry.textKey = std::make_shared<const QCollatorSortKey>(threadCollator.sortKey(entry.text));
+            }
+        }
+    });
+}
+
+template <bool folderFirst, bool ascending>
+void parallelSort(std::vector<NumericSortEntry>& entries) {
+    parallelMergeSort(entries, NumericSortEntryLess<folderFirst, ascending>{}, [](int, int) {});
+}
+
+} // namespace
+
+// static
+unsigned int ProxyFolderModel::lastCollatorSerial_ = 0;
+
 ProxyFolderModel::ProxyFolderModel(QObject* parent):
     QSortFilterProxyModel(parent),
+    collatorSerial_(0),
+    asciiCollator_{new AsciiCollator{}},
     showHidden_(false),
     backupAsHidden_(true),
     folderFirst_(true),
     showThumbnails_(false),
-    thumbnailSize_(0) {
+    thumbnailSize_(0),
+    parallelSortThreshold_(10000),
+    recordRejected_(false),
+    skipRejected_(false),
+    reuseFilterResults_(false),
+    thumbnailTimer_(nullptr),
+    deferredSortTimer_(nullptr),
+    prefixIndexValid_(false) {
 
     setDynamicSortFilter(true);
-    setSortCaseSensitivity(Qt::CaseInsensitive);
-
     collator_.setNumericMode(true);
+    // the rows or their texts are changed
+    connect(this, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::invalidatePrefixIndex);
+    connect(this, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::invalidatePrefixIndex);
+    connect(this, &QAbstractItemModel::rowsMoved, this, &ProxyFolderModel::invalidatePrefixIndex);
+    connect(this, &QAbstractItemModel::layoutChanged, this, &ProxyFolderModel::invalidatePrefixIndex);
+    connect(this, &QAbstractItemModel::modelReset, this, &ProxyFolderModel::invalidatePrefixIndex);
+    connect(this, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex& /*topLeft*/, const QModelIndex& /*bottomRight*/, const QVector<int>& roles) {
+        if(roles.isEmpty() || roles.contains(Qt::DisplayRole)) {
+            invalidatePrefixIndex();
+        }
+    });
+    setSortCaseSensitivity(Qt::CaseInsensitive);
 }
 
 ProxyFolderModel::~ProxyFolderModel() {
@@ -75,22 +244,232 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
             }
         }
     }
+    if(oldSrcModel) {
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsInserted);
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::clearFilterCache);
+        disconnect(oldSrcModel, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::clearFilterCache);
+        disconnect(oldSrcModel, &QAbstractItemModel::modelReset, this, &ProxyFolderModel::clearFilterCache);
+        disconnect(oldSrcModel, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
+        disconnect(oldSrcModel, &FolderModel::largeFolderChanged, this, &ProxyFolderModel::setDeferredSorting);
+    }
+    clearFilterCache();
+    if(model) {
+        // NOTE: this is connected before QSortFilterProxyModel connects its own handler,
+        // so the new rows already have their sort keys when they're merged into the sorted rows.
+        connect(model, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsInserted);
+        // the FileInfo objects of the removed or changed files might be freed
+        connect(model, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::clearFilterCache);
+        connect(model, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::clearFilterCache);
+        connect(model, &QAbstractItemModel::modelReset, this, &ProxyFolderModel::clearFilterCache);
+        connect(model, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
+        connect(static_cast<FolderModel*>(model), &FolderModel::largeFolderChanged, this, &ProxyFolderModel::setDeferredSorting);
+    }
     QSortFilterProxyModel::setSourceModel(model);
+    setDeferredSorting(model && static_cast<FolderModel*>(model)->isLargeFolder());
+}
+
+// QSortFilterProxyModel sorts the inserted rows and finds their places with binary searches,
+// which compares each new row with O(log n) existing ones. The names of the new rows are
+// collated here at once, so those comparisons only need to compare the cached keys.
+void ProxyFolderModel::onSourceRowsInserted(const QModelIndex& parent, int first, int last) {
+    queueDeferredSort();
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || parent.isValid() || sortColumn() < 0 || !dynamicSortFilter()) {
+        return;
+    }
+    std::vector<FolderModelItem*> items;
+    items.reserve(last - first + 1);
+    for(int row = first; row <= last; ++row) {
+        items.push_back(srcModel->itemFromIndex(srcModel->index(row, 0)));
+    }
+    cacheSortKeys(items, collator_, collatorSerial_, asciiCollator_.get());
+}
+
+void ProxyFolderModel::onSourceDataChanged(const QModelIndex& /*topLeft*/, const QModelIndex& /*bottomRight*/, const QVector<int>& roles) {
+    // the loaded thumbnails don't change the order
+    if(roles.size() != 1 || roles.at(0) != Qt::DecorationRole) {
+        queueDeferredSort();
+    }
+}
+
+// A large folder might have thousands of changes in a second, and QSortFilterProxyModel would find
+// the place of each added or changed row by itself.
+void ProxyFolderModel::setDeferredSorting(bool deferred) {
+    if(deferred == deferredSorting()) {
+        return;
+    }
+    if(deferred) {
+        deferredSortTimer_ = new QTimer(this);
+        deferredSortTimer_->setSingleShot(true);
+        deferredSortTimer_->setInterval(deferredSortInterval);
+        connect(deferredSortTimer_, &QTimer::timeout, this, &ProxyFolderModel::resortInParallel);
+        setDynamicSortFilter(false);
+    }
+    else {
+        delete deferredSortTimer_;
+        deferredSortTimer_ = nullptr;
+        // QSortFilterProxyModel sorts the rows again
+        setDynamicSortFilter(true);
+    }
+}
+
+void ProxyFolderModel::queueDeferredSort() {
+    // the timer is not restarted by the following changes, so the rows are sorted in each interval
+    if(deferredSortTimer_ && !deferredSortTimer_->isActive()) {
+        deferredSortTimer_->start();
+    }
 }
 
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
     int oldColumn = sortColumn();
     Qt::SortOrder oldOrder = sortOrder();
+    if(column != oldColumn || order != oldOrder) {
+        // QSortFilterProxyModel compares the precomputed ranks, which is cheap
+        prepareParallelSort(column, order);
+    }
     QSortFilterProxyModel::sort(column, order);
+    sortRanks_.clear();
     if(column != oldColumn || order != oldOrder) {
         Q_EMIT sortFilterChanged();
     }
 }
 
+// Sort all source rows with worker threads and remember the position of each row,
+// so lessThan() only needs to compare the positions afterwards.
+bool ProxyFolderModel::prepareParallelSort(int column, Qt::SortOrder order) {
+    sortRanks_.clear();
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || column < 0 || parallelSortThreshold_ <= 0 || srcModel->rowCount() < parallelSortThreshold_) {
+        return false;
+    }
+
+    // the model is only accessed in the main thread
+    int count = srcModel->rowCount();
+    if(column == FolderModel::ColumnFileMTime || column == FolderModel::ColumnFileSize) {
+        prepareNumericSort(column, order == Qt::AscendingOrder);
+        return true;
+    }
+    bool useNameKeys = (column == FolderModel::ColumnFileName && !srcModel->showFullName());
+    bool allAscii = asciiCollator_->isValid();
+    std::vector<SortEntry> entries(count);
+    for(int row = 0; row < count; ++row) {
+        auto index = srcModel->index(row, column);
+        FolderModelItem* item = srcModel->itemFromIndex(index);
+        auto& entry = entries[row];
+        entry.row = row;
+        entry.isDir = item->info->isDir();
+        entry.displayName = item->displayName();
+        if(allAscii && !AsciiCollator::isAscii(entry.displayName)) {
+            allAscii = false;
+        }
+        if(item->sortKey_ && item->sortKeySerial_ == collatorSerial_) {
+            entry.nameKey = item->sortKey_;
+        }
+        if(!useNameKeys) {
+            entry.text = index.data(Qt::DisplayRole).toString();
+            if(entry.text.isNull()) {
+                entry.text = QLatin1String("");
+            }
+        }
+    }
+
+    // the collation keys of the names are only needed if some of them are not ASCII
+    parallelSort(entries, collator_, SortEntryLess{folderFirst_, order == Qt::AscendingOrder,
+                                                   allAscii ? asciiCollator_.get() : nullptr});
+
+    sortRanks_.resize(count);
+    for(int i = 0; i < count; ++i) {
+        auto& entry = entries[i];
+        sortRanks_[entry.row] = i;
+        // keep the collation keys of the names for later sorts
+        if(entry.nameKey) {
+            FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(entry.row, 0));
+            item->sortKey_ = entry.nameKey;
+            item->sortKeySerial_ = collatorSerial_;
+        }
+    }
+    return true;
+}
+
+// The size or the mtime of each row is packed with its row and folder flag, and sorted without
+// the names. Only the rows with equal keys need their names collated, which is rare for mtimes.
+void ProxyFolderModel::prepareNumericSort(int column, bool ascending) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    int count = srcModel->rowCount();
+    bool isSize = (column == FolderModel::ColumnFileSize);
+    std::vector<FolderModelItem*> items(count);
+    std::vector<NumericSortEntry> entries(count);
+    for(int row = 0; row < count; ++row) {
+        FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(row, 0));
+        items[row] = item;
+        auto& entry = entries[row];
+        entry.key = isSize ? srcModel->fileSize(item) : item->info->mtime();
+        entry.row = row;
+        entry.isDir = item->info->isDir();
+    }
+
+    if(folderFirst_) {
+        if(ascending) {
+            parallelSort<true, true>(entries);
+        }
+        else {
+            parallelSort<true, false>(entries);
+        }
+    }
+    else {
+        parallelSort<false, true>(entries);
+    }
+
+    // find the runs of equal keys, and collate the names of their rows at once
+    auto sameKey = [this](const NumericSortEntry& a, const NumericSortEntry& b) {
+        return a.key == b.key && (!folderFirst_ || a.isDir == b.isDir);
+    };
+    std::vector<std::pair<int, int>> runs;
+    std::vector<FolderModelItem*> tiedItems;
+    for(int begin = 0; begin < count;) {
+        int end = begin + 1;
+        while(end < count && sameKey(entries[begin], entries[end])) {
+            ++end;
+        }
+        if(end - begin > 1) {
+            runs.emplace_back(begin, end);
+            for(int i = begin; i < end; ++i) {
+                tiedItems.push_back(items[entries[i].row]);
+            }
+        }
+        begin = end;
+    }
+    if(!tiedItems.empty()) {
+        cacheSortKeys(tiedItems, collator_, collatorSerial_, asciiCollator_.get());
+        auto byName = [&](const NumericSortEntry& a, const NumericSortEntry& b) {
+            int comp = compareNames(items[a.row], items[b.row]);
+            return comp != 0 ? comp < 0 : a.row < b.row;
+        };
+        for(const auto& run: runs) {
+            std::sort(entries.begin() + run.first, entries.begin() + run.second, byName);
+        }
+    }
+
+    sortRanks_.resize(count);
+    for(int i = 0; i < count; ++i) {
+        sortRanks_[entries[i].row] = i;
+    }
+}
+
+// invalidate the sorting and sort the rows again, using worker threads for large folders
+void ProxyFolderModel::resortInParallel() {
+    prepareParallelSort(sortColumn(), sortOrder());
+    invalidate();
+    if(!sortRanks_.empty()) {
+        rowCount(); // create the mapping and sort it now while the ranks are valid
+        sortRanks_.clear();
+    }
+}
+
 void ProxyFolderModel::setShowHidden(bool show) {
     if(show != showHidden_) {
         showHidden_ = show;
-        invalidateFilter();
+        updateHiddenRows(show);
         Q_EMIT sortFilterChanged();
     }
 }
@@ -98,44 +477,80 @@ void ProxyFolderModel::setShowHidden(bool show) {
 void ProxyFolderModel::setBackupAsHidden(bool backupAsHidden) {
     if(backupAsHidden != backupAsHidden_) {
         backupAsHidden_ = backupAsHidden;
-        invalidateFilter();
+        if(!showHidden_) {
+            updateHiddenRows(!backupAsHidden);
+        }
         Q_EMIT sortFilterChanged();
     }
 }
 
+// Only the hidden files are added or removed when they're shown or hidden. The filters are not
+// evaluated again for the files whose results are known from the last time, and the added rows
+// are put at their places by comparing the ranks precomputed for all rows.
+void ProxyFolderModel::updateHiddenRows(bool added) {
+    if(added) {
+        prepareParallelSort(sortColumn(), sortOrder());
+    }
+    reuseFilterResults_ = true;
+    invalidateFilter();
+    reuseFilterResults_ = false;
+    sortRanks_.clear();
+}
+
 // need to call invalidateFilter() manually.
 void ProxyFolderModel::setFolderFirst(bool folderFirst) {
     if(folderFirst != folderFirst_) {
         folderFirst_ = folderFirst;
-        invalidate();
+        resortInParallel();
         Q_EMIT sortFilterChanged();
     }
 }
 
 void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
     collator_.setCaseSensitivity(cs);
+    // the cached sort keys of the items are created with the old settings
+    collatorSerial_ = ++lastCollatorSerial_;
+    asciiCollator_->setCollator(collator_);
     QSortFilterProxyModel::setSortCaseSensitivity(cs);
-    invalidate();
+    resortInParallel();
     Q_EMIT sortFilterChanged();
 }
 
 bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel) {
+        return true;
+    }
+    auto info = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
     if(!showHidden_) {
-        if(FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())) {
-            auto info = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if(info && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
-                return false;
-            }
+        if(info && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
+            return false;
         }
     }
     // apply additional filters if there're any
-    for(ProxyFolderModelFilter* const filter : qAsConst(filters_)) {
-        if(FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())){
-            auto fileInfo = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if(!filter->filterAcceptsRow(this, fileInfo)) {
+    if(!filters_.isEmpty()) {
+        if(reuseFilterResults_) {
+            if(acceptedByFilters_.count(info.get()) > 0) {
+                return true;
+            }
+            if(rejectedByFilters_.count(info.get()) > 0) {
                 return false;
             }
         }
+        else if(skipRejected_ && rejectedByFilters_.count(info.get()) > 0) {
+            return false;
+        }
+        for(ProxyFolderModelFilter* const filter : qAsConst(filters_)) {
+            if(!filter->filterAcceptsRow(this, info)) {
+                if(recordRejected_ || reuseFilterResults_) {
+                    rejectedByFilters_.insert(info.get());
+                }
+                return false;
+            }
+        }
+        if(reuseFilterResults_) {
+            acceptedByFilters_.insert(info.get());
+        }
     }
     return true;
 }
@@ -143,6 +558,10 @@ bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& sourc
 bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
     FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // left and right are indexes of source model, not the proxy model.
+    if(!sortRanks_.empty() && left.row() < int(sortRanks_.size()) && right.row() < int(sortRanks_.size())) {
+        // already sorted by prepareParallelSort()
+        return sortRanks_[left.row()] < sortRanks_[right.row()];
+    }
     if(srcModel) {
         auto leftInfo = srcModel->fileInfoFromIndex(left);
         auto rightInfo = srcModel->fileInfoFromIndex(right);
@@ -155,14 +574,29 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
             }
         }
 
+        FolderModelItem* leftItem = srcModel->itemFromIndex(left);
+        FolderModelItem* rightItem = srcModel->itemFromIndex(right);
+
         int comp;
         switch(sortColumn()) {
         case FolderModel::ColumnFileMTime:
-            comp = leftInfo->mtime() - rightInfo->mtime();
+            // NOTE: subtracting the unsigned 64-bit values might overflow an int
+            comp = leftInfo->mtime() < rightInfo->mtime() ? -1 : (leftInfo->mtime() > rightInfo->mtime() ? 1 : 0);
             break;
-        case FolderModel::ColumnFileSize:
-            comp = leftInfo->size() - rightInfo->size();
+        case FolderModel::ColumnFileSize: {
+            // the total sizes of the dirs are sorted if they're shown
+            std::uint64_t leftSize = srcModel->fileSize(leftItem);
+            std::uint64_t rightSize = srcModel->fileSize(rightItem);
+            comp = leftSize < rightSize ? -1 : (leftSize > rightSize ? 1 : 0);
             break;
+        }
+        case FolderModel::ColumnFileName:
+            // the cached sort keys are compared instead of collating the names each time
+            if(!srcModel->showFullName()) {
+                comp = compareNames(leftItem, rightItem);
+                break;
+            }
+        /* Falls through. */
         default: {
             QString leftText = left.data(Qt::DisplayRole).toString();
             QString rightText = right.data(Qt::DisplayRole).toString();
@@ -172,13 +606,23 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
         }
         // always sort files by their display names when they have the same property
         if(comp == 0) {
-            return collator_.compare(leftInfo->displayName(), rightInfo->displayName()) < 0;
+            return compareNames(leftItem, rightItem) < 0;
         }
         return comp < 0;
     }
     return QSortFilterProxyModel::lessThan(left, right);
 }
 
+int ProxyFolderModel::compareNames(const FolderModelItem* left, const FolderModelItem* right) const {
+    // the names which aren't ASCII are known without checking their chars
+    if(asciiCollator_->isValid() && left->info->isNameAscii() && right->info->isNameAscii()
+            && AsciiCollator::isAscii(left->displayName()) && AsciiCollator::isAscii(right->displayName())) {
+        return asciiCollator_->compare(left->displayName(), right->displayName());
+    }
+    return left->displayNameSortKey(collator_, collatorSerial_).compare(
+                right->displayNameSortKey(collator_, collatorSerial_));
+}
+
 std::shared_ptr<const Fm::FileInfo> ProxyFolderModel::fileInfoFromIndex(const QModelIndex& index) const {
     if(index.isValid()) {
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
@@ -265,9 +709,10 @@ QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
             // we need to show thumbnails instead of icons
             FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
             QModelIndex srcIndex = mapToSource(index);
-            QImage image = srcModel->thumbnailFromIndex(srcIndex, thumbnailSize_);
-            if(!image.isNull()) { // if we got a thumbnail of the desired size, use it
-                return QVariant(image);
+            // a cached pixmap is returned, so that the delegate doesn't convert the image on each paint
+            QPixmap pixmap = srcModel->thumbnailPixmapFromIndex(srcIndex, thumbnailSize_);
+            if(!pixmap.isNull()) { // if we got a thumbnail of the desired size, use it
+                return QVariant(pixmap);
             }
         }
     }
@@ -282,28 +727,138 @@ void ProxyFolderModel::onThumbnailLoaded(const QModelIndex& srcIndex, int size)
 
     if(size == thumbnailSize_ // if a thumbnail of the size we want is loaded
        && srcIndex.model() == sourceModel()) { // check if the sourse model contains the index item
-        QModelIndex index = mapFromSource(srcIndex);
-        Q_EMIT dataChanged(index, index);
+        // the views are updated once a frame, since many thumbnails are often loaded at once
+        loadedThumbnails_.emplace_back(srcIndex);
+        if(!thumbnailTimer_) {
+            thumbnailTimer_ = new QTimer(this);
+            thumbnailTimer_->setSingleShot(true);
+            thumbnailTimer_->setInterval(thumbnailUpdateInterval);
+            connect(thumbnailTimer_, &QTimer::timeout, this, &ProxyFolderModel::emitLoadedThumbnails);
+        }
+        if(!thumbnailTimer_->isActive()) {
+            thumbnailTimer_->start();
+        }
     }
 }
 
+void ProxyFolderModel::emitLoadedThumbnails() {
+    std::vector<int> rows;
+    rows.reserve(loadedThumbnails_.size());
+    for(const auto& srcIndex: loadedThumbnails_) {
+        // the file might be removed or filtered out since its thumbnail was loaded
+        if(srcIndex.isValid() && srcIndex.model() == sourceModel()) {
+            QModelIndex index = mapFromSource(srcIndex);
+            if(index.isValid()) {
+                rows.push_back(index.row());
+            }
+        }
+    }
+    loadedThumbnails_.clear();
+    std::sort(rows.begin(), rows.end());
+    const QVector<int> roles{Qt::DecorationRole};
+    for(auto it = rows.cbegin(); it != rows.cend();) {
+        int first = *it;
+        int last = first;
+        for(++it; it != rows.cend() && *it <= last + 1; ++it) {
+            last = *it;
+        }
+        Q_EMIT dataChanged(index(first, 0), index(last, 0), roles);
+    }
+}
+
+void ProxyFolderModel::setVisibleRange(int first, int last) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || !showThumbnails_ || thumbnailSize_ == 0) {
+        return;
+    }
+    QModelIndexList srcIndexes;
+    int count = rowCount();
+    if(first >= 0 && first <= last) {
+        // the visible rows first, then the next page and the previous one
+        int page = last - first + 1;
+        int end = std::min(last + page, count - 1);
+        for(int row = first; row <= end; ++row) {
+            srcIndexes.append(mapToSource(index(row, 0)));
+        }
+        for(int row = first - 1; row >= std::max(0, first - page); --row) {
+            srcIndexes.append(mapToSource(index(row, 0)));
+        }
+    }
+    srcModel->setVisibleIndexes(srcIndexes);
+}
+
 void ProxyFolderModel::addFilter(ProxyFolderModelFilter* filter) {
     filters_.append(filter);
+    clearFilterCache();
     invalidateFilter();
     Q_EMIT sortFilterChanged();
 }
 
 void ProxyFolderModel::removeFilter(ProxyFolderModelFilter* filter) {
     filters_.removeOne(filter);
+    clearFilterCache();
     invalidateFilter();
     Q_EMIT sortFilterChanged();
 }
 
-void ProxyFolderModel::updateFilters() {
-    invalidate();
+void ProxyFolderModel::updateFilters(bool narrowed) {
+    // NOTE: the rows are evaluated synchronously here, so only the results of the current filters are recorded.
+    recordRejected_ = true;
+    // the accepted files might be rejected by the changed filters
+    acceptedByFilters_.clear();
+    if(narrowed) {
+        // the accepted rows are checked again and no row can be added, so the order is kept
+        skipRejected_ = true;
+        invalidateFilter();
+        skipRejected_ = false;
+    }
+    else {
+        rejectedByFilters_.clear();
+        invalidate();
+        rowCount(); // create the mapping now while the results are recorded
+    }
+    recordRejected_ = false;
     Q_EMIT sortFilterChanged();
 }
 
+int ProxyFolderModel::findRowByPrefix(const QString& prefix, int startRow) const {
+    int count = rowCount();
+    if(count == 0) {
+        return -1;
+    }
+    if(!prefixIndexValid_) {
+        prefixIndex_.clear();
+        prefixIndex_.reserve(count);
+        for(int row = 0; row < count; ++row) {
+            prefixIndex_.emplace_back(index(row, 0).data(Qt::DisplayRole).toString().toCaseFolded(), row);
+        }
+        std::sort(prefixIndex_.begin(), prefixIndex_.end());
+        prefixIndexValid_ = true;
+    }
+    // the texts starting with the prefix are adjacent in the sorted index
+    QString folded = prefix.toCaseFolded();
+    auto first = std::lower_bound(prefixIndex_.cbegin(), prefixIndex_.cend(), std::make_pair(folded, -1));
+    auto last = std::partition_point(first, prefixIndex_.cend(), [&folded](const std::pair<QString, int>& entry) {
+        return entry.first.startsWith(folded);
+    });
+    // the matching row which comes first from startRow in the current order
+    int found = -1;
+    int foundDistance = count;
+    for(auto it = first; it != last; ++it) {
+        int distance = (it->second - startRow + count) % count;
+        if(distance < foundDistance) {
+            found = it->second;
+            foundDistance = distance;
+        }
+    }
+    return found;
+}
+
+void ProxyFolderModel::clearFilterCache() {
+    rejectedByFilters_.clear();
+    acceptedByFilters_.clear();
+}
+
 #if 0
 void ProxyFolderModel::reloadAllThumbnails() {
     // reload all thumbnails and update UI
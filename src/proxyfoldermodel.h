@@ -25,15 +25,22 @@
 #include <QSortFilterProxyModel>
 #include <QList>
 #include <QCollator>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <QPersistentModelIndex>
 
 #include "core/fileinfo.h"
 
+class QTimer;
+
 namespace Fm {
 
 // a proxy model used to sort and filter FolderModel
 
 class FolderModelItem;
 class ProxyFolderModel;
+class AsciiCollator;
 
 class LIBFM_QT_API ProxyFolderModelFilter {
 public:
@@ -87,17 +94,56 @@ public:
     QModelIndex indexFromPath(const FilePath& path) const;
 
     virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+    // Folders with at least this number of files are sorted by worker threads
+    // before QSortFilterProxyModel applies the result (0 disables it).
+    void setParallelSortThreshold(int rows) {
+        parallelSortThreshold_ = rows;
+    }
+
+    int parallelSortThreshold() const {
+        return parallelSortThreshold_;
+    }
+
+    // While the folder of the source model is large, the added and changed rows are not put at their
+    // places one by one. They're appended, and all the rows are sorted again by the worker threads once
+    // in a while. It's turned on and off by FolderModel::largeFolderChanged().
+    void setDeferredSorting(bool deferred);
+
+    bool deferredSorting() const {
+        return deferredSortTimer_ != nullptr;
+    }
+
     virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
 
+    // Tell the source model which rows of this model are shown by the view, so their thumbnails
+    // are loaded first. A page of the following rows is prefetched as well.
+    void setVisibleRange(int first, int last);
+
     void addFilter(ProxyFolderModelFilter* filter);
     void removeFilter(ProxyFolderModelFilter* filter);
-    void updateFilters();
+    // Evaluate the filters again after they are changed.
+    // If narrowed is true, the filters only reject more files than at the last call of this
+    // function, so the files which were rejected by them then are not checked again.
+    void updateFilters(bool narrowed = false);
+
+    // The first row from startRow on, wrapping around, whose display text starts with the prefix
+    // case-insensitively, or -1. It's the row found by match() with Qt::MatchStartsWith | Qt::MatchWrap,
+    // but the sorted names are looked up with binary searches. They're indexed on the first call
+    // after the rows are changed.
+    int findRowByPrefix(const QString& prefix, int startRow) const;
 
 Q_SIGNALS:
     void sortFilterChanged();
 
 protected Q_SLOTS:
     void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
+    void emitLoadedThumbnails();
+
+    void onSourceRowsInserted(const QModelIndex& parent, int first, int last);
+    void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+
+    void clearFilterCache();
 
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
@@ -105,13 +151,47 @@ protected:
     // void reloadAllThumbnails();
 
 private:
+    bool prepareParallelSort(int column, Qt::SortOrder order);
+    void prepareNumericSort(int column, bool ascending);
+    // the order of the display names, which are compared without the sort keys if they're ASCII
+    int compareNames(const FolderModelItem* left, const FolderModelItem* right) const;
+    void resortInParallel();
+    void queueDeferredSort();
+    void updateHiddenRows(bool added);
+    void invalidatePrefixIndex() {
+        prefixIndex_.clear();
+        prefixIndexValid_ = false;
+    }
+
     QCollator collator_;
+    unsigned int collatorSerial_; // changed whenever the settings of collator_ change
+    std::unique_ptr<AsciiCollator> asciiCollator_; // compares the ASCII names in the order of collator_
+    static unsigned int lastCollatorSerial_;
     bool showHidden_;
     bool backupAsHidden_;
     bool folderFirst_;
     bool showThumbnails_;
     int thumbnailSize_;
     QList<ProxyFolderModelFilter*> filters_;
+    int parallelSortThreshold_;
+    std::vector<int> sortRanks_; // positions of the source rows precomputed by prepareParallelSort()
+    // files rejected by the filters, which stay rejected as long as the filters are only narrowed.
+    // NOTE: it's cleared whenever files of the source model are removed or changed, so the pointers are never dangling.
+    mutable std::unordered_set<const Fm::FileInfo*> rejectedByFilters_;
+    bool recordRejected_; // add the files rejected by the filters to rejectedByFilters_
+    bool skipRejected_; // don't check the files in rejectedByFilters_ again
+    // The files accepted by the filters, which are recorded with the rejected ones while the hidden files
+    // are shown or hidden, and reused the next time. It's cleared with rejectedByFilters_.
+    mutable std::unordered_set<const Fm::FileInfo*> acceptedByFilters_;
+    bool reuseFilterResults_; // use and record the results in acceptedByFilters_ and rejectedByFilters_
+    // The source indexes of the thumbnails loaded in the current frame. Their rows are updated
+    // with one dataChanged() for each run of adjacent rows, instead of one for each thumbnail.
+    std::vector<QPersistentModelIndex> loadedThumbnails_;
+    QTimer* thumbnailTimer_;
+    QTimer* deferredSortTimer_; // only created while the sorting is deferred
+    // the case-folded display texts of the rows and the rows, sorted by the texts, for findRowByPrefix()
+    mutable std::vector<std::pair<QString, int>> prefixIndex_;
+    mutable bool prefixIndexValid_;
 };
 
 }
@@ -0,0 +1,144 @@
+#ifndef FM2_BENCHMARK_P_H
+#define FM2_BENCHMARK_P_H
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// The parts shared by the benchmarks: the output of the results as JSON objects, one per line,
+// the memory and the CPU time used by the process, and the counting of the C++ allocations.
+// It's included by the file of main() of each benchmark only. If BENCHMARK_COUNT_ALLOCATIONS is
+// defined before it, the global operator new is replaced to count the allocations. Otherwise they're
+// not counted, since the shared counters would slow down the benchmarks of many threads.
+// The allocations of GLib are never counted, since it doesn't allow hooking g_malloc().
+
+struct AllocationCounts {
+    std::uint64_t count;
+    std::uint64_t bytes;
+
+    AllocationCounts operator-(const AllocationCounts& other) const {
+        return AllocationCounts{count - other.count, bytes - other.bytes};
+    }
+};
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+
+static std::atomic<std::uint64_t> allocationCount{0};
+static std::atomic<std::uint64_t> allocatedBytes{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept {
+    free(p);
+}
+
+static inline AllocationCounts allocationCounts() {
+    return AllocationCounts{allocationCount.load(), allocatedBytes.load()};
+}
+
+#endif // BENCHMARK_COUNT_ALLOCATIONS
+
+// Writes the results to stdout, or to the file of the --output option.
+class BenchmarkOutput {
+public:
+    BenchmarkOutput():
+        option_{"output", "Write the results to <file> instead of stdout.", "file"},
+        file_{stdout} {
+    }
+
+    ~BenchmarkOutput() {
+        if(file_ != stdout) {
+            fclose(file_);
+        }
+    }
+
+    // the option should be added to the parser before it's processed
+    const QCommandLineOption& option() const {
+        return option_;
+    }
+
+    // returns false if the file of the option can't be opened
+    bool open(const QCommandLineParser& parser) {
+        if(parser.isSet(option_)) {
+            file_ = fopen(parser.value(option_).toLocal8Bit().constData(), "w");
+            if(!file_) {
+                qWarning() << "failed to open" << parser.value(option_);
+                file_ = stdout;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // writes a line, which is flushed at once so the results are kept if the benchmark is killed
+    __attribute__((format(printf, 2, 3))) void writeLine(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(file_, format, args);
+        va_end(args);
+        fputc('\n', file_);
+        fflush(file_);
+    }
+
+    static long currentRssKb() {
+        long pages = 0;
+        if(FILE* statm = fopen("/proc/self/statm", "r")) {
+            if(fscanf(statm, "%*s %ld", &pages) != 1) {
+                pages = 0;
+            }
+            fclose(statm);
+        }
+        return pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    // the peak of the whole process since it's started
+    static long peakRssKb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    // the user and system CPU time of all the threads
+    static double cpuSecs() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+               + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+    }
+
+    static double ms(qint64 ns) {
+        return ns / 1000000.0;
+    }
+
+    // the times should be sorted
+    static double percentileMs(const std::vector<qint64>& sorted, int percent) {
+        return ms(sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)]);
+    }
+
+private:
+    QCommandLineOption option_;
+    FILE* file_;
+};
+
+#endif // FM2_BENCHMARK_P_H
@@ -0,0 +1,88 @@
+#include <QCoreApplication>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+#include <random>
+#include "../asciicollator_p.h"
+
+// usage: test-asciicollator [number of names]
+// Compares random ASCII names with Fm::AsciiCollator and with a numeric-mode QCollator of the
+// current locale, reports the pairs whose orders differ, and compares the speed of sorting them.
+
+static QStringList generateNames(int count) {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -_.~()[]+,";
+    std::mt19937 random{1234};
+    QStringList names;
+    for(int i = 0; i < count; ++i) {
+        QString name;
+        switch(i % 3) {
+        case 0: // render outputs and logs
+            name = QStringLiteral("frame_%1.png").arg(random() % 100000, 6, 10, QLatin1Char('0'));
+            break;
+        case 1:
+            name = QStringLiteral("Log-%1.%2").arg(random() % 1000).arg(random() % 20);
+            break;
+        default: {
+            int len = 1 + random() % 12;
+            for(int j = 0; j < len; ++j) {
+                name += QLatin1Char(chars[random() % (sizeof(chars) - 1)]);
+            }
+            break;
+        }
+        }
+        names << name;
+    }
+    return names;
+}
+
+static int sign(int value) {
+    return value < 0 ? -1 : (value > 0 ? 1 : 0);
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    QStringList names = generateNames(count);
+
+    int failed = 0;
+    for(auto cs: {Qt::CaseInsensitive, Qt::CaseSensitive}) {
+        QCollator collator;
+        collator.setNumericMode(true);
+        collator.setCaseSensitivity(cs);
+        Fm::AsciiCollator ascii;
+        ascii.setCollator(collator);
+        qDebug() << "locale" << collator.locale().name() << "case sensitive" << (cs == Qt::CaseSensitive)
+                 << "valid" << ascii.isValid();
+        if(!ascii.isValid()) {
+            continue;
+        }
+
+        for(int i = 1; i < names.size(); ++i) {
+            const QString& a = names[i - 1];
+            const QString& b = names[i];
+            if(sign(ascii.compare(a, b)) != sign(collator.compare(a, b))) {
+                if(++failed <= 20) {
+                    qDebug() << "different order:" << a << b;
+                }
+            }
+        }
+
+        QElapsedTimer timer;
+        QStringList sorted = names;
+        timer.start();
+        std::sort(sorted.begin(), sorted.end(), [&collator](const QString& a, const QString& b) {
+            return collator.compare(a, b) < 0;
+        });
+        qDebug() << "QCollator:" << timer.elapsed() << "ms";
+        sorted = names;
+        timer.start();
+        std::sort(sorted.begin(), sorted.end(), [&ascii](const QString& a, const QString& b) {
+            return ascii.compare(a, b) < 0;
+        });
+        qDebug() << "AsciiCollator:" << timer.elapsed() << "ms";
+    }
+    qDebug() << failed << "pairs in different orders";
+    return failed == 0 ? 0 : 1;
+}
@@ -2,6 +2,8 @@
 #include <QMainWindow>
 #include <QToolBar>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
 #include "../core/folder.h"
 #include "../foldermodel.h"
 #include "../folderview.h"
@@ -11,12 +13,48 @@
 #include "../filedialog.h"
 #include "libfmqt.h"
 
+// Measure the time from creating a dialog to its first paint with "test-filedialog --benchmark".
+class FirstPaintWatcher: public QObject {
+public:
+    explicit FirstPaintWatcher(const QElapsedTimer& timer): timer_{timer} {
+    }
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override {
+        if(event->type() == QEvent::Paint) {
+            watched->removeEventFilter(this);
+            qDebug() << "first paint after" << timer_.elapsed() << "ms";
+            QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+        }
+        return false;
+    }
+
+private:
+    const QElapsedTimer& timer_;
+};
+
+static int benchmarkStartup() {
+    QElapsedTimer timer;
+    timer.start();
+    Fm::FileDialog dlg;
+    qDebug() << "constructed in" << timer.elapsed() << "ms";
+    FirstPaintWatcher watcher{timer};
+    dlg.installEventFilter(&watcher);
+    dlg.show();
+    qApp->exec();
+    return 0;
+}
+
 
 int main(int argc, char** argv) {
     QApplication app(argc, argv);
 
     Fm::LibFmQt contex;
 
+    if(app.arguments().contains(QStringLiteral("--benchmark"))) {
+        return benchmarkStartup();
+    }
+
     /*
     QFileDialog dlg0;
     dlg0.setFileMode(QFileDialog::ExistingFiles);
@@ -0,0 +1,222 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../core/filetransferjob.h"
+#include "../core/deletejob.h"
+#include "../core/trashjob.h"
+#include "../core/totalsizejob.h"
+#include "benchmark_p.h"
+
+// usage: test-filetransfer-benchmark [--dir PATH] [--cross-dir PATH] [--small N] [--huge N]
+//                                    [--huge-size MiB] [--depth N] [--trash] [--output FILE]
+// Generates trees of many small files, a few huge files, sparse files and deeply nested dirs in PATH
+// (the temp dir by default), and measures scanning their size, copying, moving them within the
+// filesystem and to the one of --cross-dir (/dev/shm by default if it's on another filesystem),
+// and deleting them. With --trash, they're also moved to the trash of the user.
+// A JSON object with the files/s, MB/s and the CPU time of all the threads is written per job.
+
+namespace {
+
+struct Tree {
+    QString name;
+    Fm::FilePath path;
+    std::uint64_t size;
+    std::uint64_t files;
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(BenchmarkOutput& output): output_(output) {
+    }
+
+    void measure(const Tree& tree, const char* operation, const std::function<void ()>& run) {
+        double startCpuSecs = BenchmarkOutput::cpuSecs();
+        QElapsedTimer timer;
+        timer.start();
+        run();
+        double secs = timer.nsecsElapsed() / 1000000000.0;
+        double cpuSecs = BenchmarkOutput::cpuSecs() - startCpuSecs;
+        output_.writeLine("{\"tree\":\"%s\",\"operation\":\"%s\",\"files\":%llu,\"bytes\":%llu,\"wallMs\":%.3f,"
+                          "\"cpuMs\":%.3f,\"filesPerSec\":%.1f,\"mbPerSec\":%.2f}",
+                          tree.name.toUtf8().constData(), operation, static_cast<unsigned long long>(tree.files),
+                          static_cast<unsigned long long>(tree.size), secs * 1000, cpuSecs * 1000,
+                          secs > 0 ? tree.files / secs : 0, secs > 0 ? tree.size / secs / 1000000 : 0);
+    }
+
+private:
+    BenchmarkOutput& output_;
+};
+
+} // namespace
+
+static bool writeFile(const QString& path, off_t size, bool sparse) {
+    int fd = open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return false;
+    }
+    // not all zeros, so the filesystems which compress the data don't make it look faster
+    std::vector<char> block(1024 * 1024);
+    for(size_t i = 0; i < block.size(); ++i) {
+        block[i] = char(i * 7 + i / 4096);
+    }
+    bool ok = true;
+    if(sparse) {
+        // a block of data at every 64 MiB, and holes between them
+        ok = ftruncate(fd, size) == 0;
+        for(off_t offset = 0; ok && offset < size; offset += 64 * 1024 * 1024) {
+            ok = pwrite(fd, block.data(), std::min<off_t>(block.size(), size - offset), offset) >= 0;
+        }
+    }
+    else {
+        for(off_t written = 0; ok && written < size; written += block.size()) {
+            ok = write(fd, block.data(), std::min<off_t>(block.size(), size - written)) >= 0;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+static void makeSmallFiles(const QString& dirPath, int count) {
+    for(int i = 0; i < count; ++i) {
+        // 100 files per dir, like a source tree
+        QString subdir = dirPath + QStringLiteral("/dir-%1").arg(i / 100);
+        if(i % 100 == 0) {
+            QDir().mkpath(subdir);
+        }
+        writeFile(subdir + QStringLiteral("/file-%1.c").arg(i), 512 + (i % 16) * 512, false);
+    }
+}
+
+static void makeDeepTree(const QString& dirPath, int depth) {
+    QString path = dirPath;
+    for(int i = 0; i < depth; ++i) {
+        path += QStringLiteral("/level-%1").arg(i);
+        QDir().mkpath(path);
+        for(int j = 0; j < 10; ++j) {
+            writeFile(path + QStringLiteral("/file-%1").arg(j), 4096, false);
+        }
+    }
+}
+
+static dev_t deviceOf(const QString& path) {
+    struct stat st;
+    return stat(path.toLocal8Bit().constData(), &st) == 0 ? st.st_dev : 0;
+}
+
+static Fm::FilePath localPath(const QString& path) {
+    return Fm::FilePath::fromLocalPath(path.toLocal8Bit().constData());
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption dirOption{"dir", "Create the trees in <path>.", "path", QDir::tempPath()};
+    QCommandLineOption crossDirOption{"cross-dir", "Move the trees to <path> on another filesystem.", "path", "/dev/shm"};
+    QCommandLineOption smallOption{"small", "Number of small files.", "count", "10000"};
+    QCommandLineOption hugeOption{"huge", "Number of huge files.", "count", "2"};
+    QCommandLineOption hugeSizeOption{"huge-size", "Size of each huge or sparse file in MiB.", "size", "256"};
+    QCommandLineOption depthOption{"depth", "Depth of the nested dirs.", "depth", "100"};
+    QCommandLineOption trashOption{"trash", "Also move the trees to the trash of the user."};
+    BenchmarkOutput output;
+    parser.addOptions({dirOption, crossDirOption, smallOption, hugeOption, hugeSizeOption, depthOption, trashOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir baseDir{parser.value(dirOption) + "/libfm-qt-benchmark-XXXXXX"};
+    if(!baseDir.isValid()) {
+        qWarning() << "failed to create a folder in" << parser.value(dirOption);
+        return 1;
+    }
+    std::unique_ptr<QTemporaryDir> crossDir;
+    if(deviceOf(parser.value(crossDirOption)) != deviceOf(baseDir.path())) {
+        crossDir.reset(new QTemporaryDir{parser.value(crossDirOption) + "/libfm-qt-benchmark-XXXXXX"});
+    }
+    if(!crossDir || !crossDir->isValid()) {
+        qWarning() << parser.value(crossDirOption) << "is not on another filesystem, the cross-filesystem moves are skipped";
+        crossDir.reset();
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+
+    QDir base{baseDir.path()};
+    off_t hugeSize = off_t(parser.value(hugeSizeOption).toLongLong()) * 1024 * 1024;
+    std::vector<Tree> trees;
+    for(const char* name: {"small", "huge", "sparse", "deep"}) {
+        base.mkpath(QStringLiteral("src/") + QLatin1String(name));
+        trees.push_back(Tree{QLatin1String(name), localPath(base.filePath(QStringLiteral("src/") + QLatin1String(name))), 0, 0});
+    }
+    qDebug() << "generating the trees in" << baseDir.path();
+    makeSmallFiles(base.filePath("src/small"), parser.value(smallOption).toInt());
+    for(int i = 0; i < parser.value(hugeOption).toInt(); ++i) {
+        writeFile(base.filePath(QStringLiteral("src/huge/file-%1.iso").arg(i)), hugeSize, false);
+        writeFile(base.filePath(QStringLiteral("src/sparse/file-%1.img").arg(i)), hugeSize, true);
+    }
+    makeDeepTree(base.filePath("src/deep"), parser.value(depthOption).toInt());
+    sync();
+
+    Benchmark benchmark{output};
+    for(auto& tree: trees) {
+        benchmark.measure(tree, "size", [&]() {
+            Fm::TotalSizeJob job{Fm::FilePathList{tree.path}};
+            job.run();
+            tree.size = job.totalSize();
+            tree.files = job.fileCount();
+        });
+
+        auto copyDir = localPath(base.filePath("copy"));
+        g_file_make_directory(copyDir.gfile().get(), nullptr, nullptr);
+        benchmark.measure(tree, "copy", [&]() {
+            Fm::FileTransferJob job{Fm::FilePathList{tree.path}, copyDir, Fm::FileTransferJob::Mode::COPY};
+            job.run();
+        });
+        auto copyPath = copyDir.child(tree.path.baseName().get());
+
+        auto moveDir = localPath(base.filePath("move"));
+        g_file_make_directory(moveDir.gfile().get(), nullptr, nullptr);
+        benchmark.measure(tree, "move", [&]() {
+            Fm::FileTransferJob job{Fm::FilePathList{copyPath}, moveDir, Fm::FileTransferJob::Mode::MOVE};
+            job.run();
+        });
+        copyPath = moveDir.child(tree.path.baseName().get());
+
+        if(crossDir) {
+            auto crossPath = localPath(crossDir->path());
+            benchmark.measure(tree, "moveCrossFs", [&]() {
+                Fm::FileTransferJob job{Fm::FilePathList{copyPath}, crossPath, Fm::FileTransferJob::Mode::MOVE};
+                job.run();
+            });
+            // moved back, so it's deleted from the same filesystem as the other trees
+            benchmark.measure(tree, "moveCrossFsBack", [&]() {
+                Fm::FileTransferJob job{Fm::FilePathList{crossPath.child(tree.path.baseName().get())}, moveDir, Fm::FileTransferJob::Mode::MOVE};
+                job.run();
+            });
+        }
+
+        if(parser.isSet(trashOption)) {
+            benchmark.measure(tree, "trash", [&]() {
+                Fm::TrashJob job{Fm::FilePathList{copyPath}};
+                job.run();
+            });
+        }
+        else {
+            benchmark.measure(tree, "delete", [&]() {
+                Fm::DeleteJob job{Fm::FilePathList{copyPath}};
+                job.run();
+            });
+        }
+    }
+
+    return 0;
+}
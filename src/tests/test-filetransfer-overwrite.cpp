@@ -0,0 +1,87 @@
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <chrono>
+#include <thread>
+#include "../core/filetransferjob.h"
+
+// usage: test-filetransfer-overwrite
+// Overwrites an existing file with a copy which is cancelled while it's written, with the streaming
+// copy and the verified streaming copy, and checks that the existing file is kept unchanged and no
+// partial copy is left. The exit code is 1 if any of them fails.
+
+static const int sourceSize = 8 * 1024 * 1024;
+
+static Fm::FilePath localPath(const QString& path) {
+    return Fm::FilePath::fromLocalPath(path.toLocal8Bit().constData());
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QTemporaryDir baseDir{QDir::tempPath() + "/libfm-qt-test-XXXXXX"};
+    if(!baseDir.isValid()) {
+        qWarning("failed to create the test folder");
+        return 1;
+    }
+    QDir base{baseDir.path()};
+    base.mkdir("src");
+    base.mkdir("dest");
+    QFile src{base.filePath("src/file")};
+    src.open(QIODevice::WriteOnly);
+    QByteArray data(sourceSize, 0);
+    for(int i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 7 + i / 4096);
+    }
+    src.write(data);
+    src.close();
+    const QByteArray original{"the existing file which should be kept\n"};
+
+    struct {
+        const char* name;
+        size_t streamBufferSize;
+        bool verify;
+    } methods[] = {
+        {"stream", 64 * 1024, false},
+        {"verify", 64 * 1024, true}
+    };
+    bool ok = true;
+    for(auto& method: methods) {
+        QString destPath = base.filePath("dest/file");
+        QFile dest{destPath};
+        dest.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        dest.write(original);
+        dest.close();
+
+        Fm::FileTransferJob job{Fm::FilePathList{localPath(src.fileName())}, localPath(base.filePath("dest"))};
+        job.setStreamBufferSize(method.streamBufferSize);
+        job.setVerifyCopies(method.verify);
+        job.setFileExistsAction(Fm::FileOperationJob::OVERWRITE);
+        // the copy takes 8 seconds at this rate, so it's cancelled while the file is written
+        job.setBandwidthLimit(1024 * 1024);
+        std::thread canceller{[&job]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            job.cancel();
+        }};
+        job.run();
+        canceller.join();
+
+        dest.open(QIODevice::ReadOnly);
+        QByteArray content = dest.readAll();
+        dest.close();
+        auto leftovers = QDir{base.filePath("dest")}.entryList(QStringList{".file.*"}, QDir::Files | QDir::Hidden);
+        if(content != original) {
+            qWarning() << method.name << "copy: the existing file is" << (dest.exists() ? "changed" : "deleted");
+            ok = false;
+        }
+        else if(!leftovers.isEmpty()) {
+            qWarning() << method.name << "copy: the partial copy is left in" << leftovers;
+            ok = false;
+        }
+        else {
+            qDebug() << method.name << "copy: the existing file is kept";
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include "../core/filetransferjob.h"
+
+// usage: test-filetransfer <source> <dest dir> [buffer size in KiB]
+// The source is copied to <dest dir>/default with the default method, to <dest dir>/stream with
+// the streaming copy, and to <dest dir>/verify with the verified streaming copy, so their speeds
+// can be compared.
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    if(argc < 3) {
+        qDebug("usage: test-filetransfer <source> <dest dir> [buffer size in KiB]");
+        return 1;
+    }
+    auto srcPath = Fm::FilePath::fromPathStr(argv[1]);
+    auto destDirPath = Fm::FilePath::fromPathStr(argv[2]);
+    size_t bufferSize = (argc > 3 ? atoi(argv[3]) : 4096) * 1024;
+
+    struct {
+        const char* name;
+        size_t streamBufferSize;
+        bool verify;
+    } methods[] = {
+        {"default", 0, false},
+        {"stream", bufferSize, false},
+        {"verify", bufferSize, true}
+    };
+    for(auto& method: methods) {
+        auto subdir = destDirPath.child(method.name);
+        g_file_make_directory(subdir.gfile().get(), nullptr, nullptr);
+
+        Fm::FileTransferJob job{Fm::FilePathList{srcPath}, subdir};
+        job.setStreamBufferSize(method.streamBufferSize);
+        job.setVerifyCopies(method.verify);
+        QElapsedTimer timer;
+        timer.start();
+        job.run();
+        double bytesPerSec = 0, filesPerSec = 0;
+        job.averageThroughput(bytesPerSec, filesPerSec);
+        qDebug() << method.name << "copy:" << timer.elapsed() << "ms,"
+                 << bytesPerSec / (1024 * 1024) << "MiB/s," << filesPerSec << "files/s";
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../core/folder.h"
+#include "../core/dirlistjob.h"
+#define BENCHMARK_COUNT_ALLOCATIONS
+#include "benchmark_p.h"
+
+// usage: test-folder-benchmark [--dir PATH] [--sizes 1000,100000,1000000] [--depth N] [--runs N] [--output FILE]
+// Generates folders with the given numbers of mixed entries (files of several types, folders and
+// symlinks) and a deep tree, under PATH (/dev/shm by default, so it's on tmpfs), lists them with
+// Folder::fromPath() and DirListJob, and writes a JSON object per run, one per line, for tracking
+// the regressions. The kernel caches are warm, since the files are just created.
+// The allocations only count the C++ ones (see benchmark_p.h). The peak RSS is the one of the
+// whole process, so run a size at a time to get the peak of each of them.
+
+namespace {
+
+struct Result {
+    const char* api;
+    qint64 firstBatchNs;
+    qint64 finishNs;
+    std::uint64_t files;
+    AllocationCounts allocations;
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(BenchmarkOutput& output): output_(output) {
+    }
+
+    void run(const QString& name, const QStringList& dirs, int runs) {
+        for(int i = 1; i <= runs; ++i) {
+            report(name, i, listFolders(dirs));
+            report(name, i, listJobs(dirs));
+        }
+    }
+
+private:
+    // the dirs are opened one by one, like the user going down a deep tree
+    Result listFolders(const QStringList& dirs) {
+        Result result{"Folder", -1, 0, 0, {0, 0}};
+        auto allocations = allocationCounts();
+        QElapsedTimer timer;
+        timer.start();
+        for(const auto& dir: dirs) {
+            QEventLoop loop;
+            auto folder = Fm::Folder::fromPath(Fm::FilePath::fromLocalPath(dir.toLocal8Bit().constData()));
+            QObject::connect(folder.get(), &Fm::Folder::filesAdded, &loop, [&](Fm::FileInfoList& files) {
+                if(result.firstBatchNs < 0) {
+                    result.firstBatchNs = timer.nsecsElapsed();
+                }
+                result.files += files.size();
+            });
+            QObject::connect(folder.get(), &Fm::Folder::finishLoading, &loop, &QEventLoop::quit);
+            if(!folder->isLoaded()) {
+                loop.exec();
+            }
+            // the next run should list the folder again
+            folder.reset();
+            Fm::Folder::clearCache();
+        }
+        result.finishNs = timer.nsecsElapsed();
+        result.allocations = allocationCounts() - allocations;
+        return result;
+    }
+
+    Result listJobs(const QStringList& dirs) {
+        Result result{"DirListJob", -1, 0, 0, {0, 0}};
+        auto allocations = allocationCounts();
+        QElapsedTimer timer;
+        timer.start();
+        std::atomic<qint64> firstBatchNs{-1};
+        std::atomic<std::uint64_t> files{0};
+        for(const auto& dir: dirs) {
+            QEventLoop loop;
+            auto job = new Fm::DirListJob(Fm::FilePath::fromLocalPath(dir.toLocal8Bit().constData()), Fm::DirListJob::FAST);
+            job->setIncremental(true);
+            QObject::connect(job, &Fm::DirListJob::filesFound, job, [&](Fm::FileInfoList& found) {
+                qint64 unset = -1;
+                firstBatchNs.compare_exchange_strong(unset, timer.nsecsElapsed());
+                files += found.size();
+            }, Qt::DirectConnection);
+            QObject::connect(job, &Fm::Job::finished, &loop, [&loop, job, &files]() {
+                // the files which are not emitted in batches yet
+                files += job->files().size();
+                loop.quit();
+            });
+            job->runAsync();
+            loop.exec();
+        }
+        result.finishNs = timer.nsecsElapsed();
+        result.firstBatchNs = firstBatchNs.load();
+        result.files = files.load();
+        result.allocations = allocationCounts() - allocations;
+        return result;
+    }
+
+    void report(const QString& name, int run, const Result& result) {
+        output_.writeLine("{\"case\":\"%s\",\"api\":\"%s\",\"run\":%d,\"files\":%llu,\"firstBatchMs\":%.3f,"
+                          "\"finishMs\":%.3f,\"allocations\":%llu,\"allocatedBytes\":%llu,\"rssKb\":%ld,\"peakRssKb\":%ld}",
+                          name.toUtf8().constData(), result.api, run, static_cast<unsigned long long>(result.files),
+                          BenchmarkOutput::ms(result.firstBatchNs), BenchmarkOutput::ms(result.finishNs),
+                          static_cast<unsigned long long>(result.allocations.count),
+                          static_cast<unsigned long long>(result.allocations.bytes),
+                          BenchmarkOutput::currentRssKb(), BenchmarkOutput::peakRssKb());
+    }
+
+    BenchmarkOutput& output_;
+};
+
+} // namespace
+
+static void createFile(const QByteArray& path, const char* content) {
+    int fd = open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0) {
+        if(content && write(fd, content, strlen(content)) < 0) {
+            qWarning("failed to write %s", path.constData());
+        }
+        close(fd);
+    }
+}
+
+// the types are mixed so the mime types are guessed in different ways
+static void generateEntries(const QString& dirPath, int count) {
+    static const char* const extensions[] = {".txt", ".png", ".c", ".html", ".tar.gz", ".mp3", "", ".odt"};
+    QDir().mkpath(dirPath);
+    QByteArray dir = dirPath.toLocal8Bit() + '/';
+    for(int i = 0; i < count; ++i) {
+        QByteArray name = dir + "entry-" + QByteArray::number(i);
+        switch(i % 10) {
+        case 0:
+            mkdir(name.constData(), 0755);
+            break;
+        case 1:
+            if(symlink("entry-2.c", (name + ".lnk").constData()) < 0) {
+                qWarning("failed to create the symlink %s", name.constData());
+            }
+            break;
+        default: {
+            auto extension = extensions[i % 8];
+            // the files without an extension are recognized by their content
+            createFile(name + extension, *extension ? nullptr : "#!/bin/sh\necho hello\n");
+            break;
+        }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption dirOption{"dir", "Create the test folders in <path>.", "path",
+                                 QFile::exists("/dev/shm") ? "/dev/shm" : QDir::tempPath()};
+    QCommandLineOption sizesOption{"sizes", "Comma separated numbers of entries of the flat folders.", "sizes", "1000,100000"};
+    QCommandLineOption depthOption{"depth", "Depth of the tree, which has 100 entries per folder.", "depth", "50"};
+    QCommandLineOption runsOption{"runs", "Number of runs of each case.", "runs", "3"};
+    BenchmarkOutput output;
+    parser.addOptions({dirOption, sizesOption, depthOption, runsOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir baseDir{parser.value(dirOption) + "/libfm-qt-benchmark-XXXXXX"};
+    if(!baseDir.isValid()) {
+        qWarning() << "failed to create a folder in" << parser.value(dirOption);
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+    int runs = parser.value(runsOption).toInt();
+    Benchmark benchmark{output};
+
+    for(const auto& size: parser.value(sizesOption).split(',', QString::SkipEmptyParts)) {
+        QString dirPath = baseDir.path() + "/flat-" + size;
+        qDebug() << "generating" << dirPath;
+        generateEntries(dirPath, size.toInt());
+        benchmark.run("flat-" + size, {dirPath}, runs);
+    }
+
+    int depth = parser.value(depthOption).toInt();
+    if(depth > 0) {
+        QStringList dirs;
+        QString dirPath = baseDir.path() + "/deep-" + QString::number(depth);
+        for(int i = 0; i < depth; ++i) {
+            dirPath += "/level-" + QString::number(i);
+            dirs << dirPath;
+            generateEntries(dirPath, 100);
+        }
+        qDebug() << "generated a tree of" << depth << "levels";
+        benchmark.run("deep-" + QString::number(depth), dirs, runs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QAbstractItemView>
+#include <QScrollBar>
+#include <QStyleOptionViewItem>
+#include <QTreeView>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <vector>
+#include "../core/folder.h"
+#include "../folderview.h"
+#include "../cachedfoldermodel.h"
+#include "../proxyfoldermodel.h"
+#include "libfmqt.h"
+#include "benchmark_p.h"
+
+// usage: test-folderview-benchmark [--files N] [--frames N] [--output FILE]
+// Shows a FolderView of a generated folder with the offscreen platform unless another one is chosen,
+// scrolls it, resizes it and switches its view modes, and writes the percentiles of the time taken
+// by each kind of work as a JSON object per line.
+
+namespace {
+
+// updateGridSize() is protected
+class BenchmarkFolderView: public Fm::FolderView {
+public:
+    void measureGridSize() {
+        updateGridSize();
+    }
+};
+
+class Samples {
+public:
+    template <typename Func>
+    void measure(Func func) {
+        QElapsedTimer timer;
+        timer.start();
+        func();
+        times_.push_back(timer.nsecsElapsed());
+    }
+
+    void report(BenchmarkOutput& output, const char* mode, const char* metric) {
+        if(times_.empty()) {
+            return;
+        }
+        std::sort(times_.begin(), times_.end());
+        output.writeLine("{\"mode\":\"%s\",\"metric\":\"%s\",\"samples\":%zu,\"p50Ms\":%.3f,\"p90Ms\":%.3f,\"p99Ms\":%.3f,\"maxMs\":%.3f}",
+                         mode, metric, times_.size(), BenchmarkOutput::percentileMs(times_, 50),
+                         BenchmarkOutput::percentileMs(times_, 90), BenchmarkOutput::percentileMs(times_, 99),
+                         BenchmarkOutput::ms(times_.back()));
+        times_.clear();
+    }
+
+private:
+    std::vector<qint64> times_;
+};
+
+} // namespace
+
+static void generateFolder(const QString& dirPath, int count) {
+    static const char* const extensions[] = {".txt", ".png", ".c", ".html", ".tar.gz", ".mp3", ".odt"};
+    QDir dir{dirPath};
+    for(int i = 0; i < count; ++i) {
+        QString name = QStringLiteral("entry with a long name %1").arg(i);
+        if(i % 10 == 0) {
+            dir.mkdir(name);
+        }
+        else {
+            QFile file{dir.filePath(name + QLatin1String(extensions[i % 7]))};
+            file.open(QIODevice::WriteOnly);
+        }
+    }
+}
+
+static void waitForFolder(const Fm::FilePath& path) {
+    auto folder = Fm::Folder::fromPath(path);
+    if(!folder->isLoaded()) {
+        QEventLoop loop;
+        QObject::connect(folder.get(), &Fm::Folder::finishLoading, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+}
+
+int main(int argc, char** argv) {
+    // it should run without a display
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    Fm::LibFmQt contex;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption filesOption{"files", "Number of files in the generated folder.", "count", "10000"};
+    QCommandLineOption framesOption{"frames", "Number of the measured frames of each kind of work.", "count", "200"};
+    BenchmarkOutput output;
+    parser.addOptions({filesOption, framesOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir dir{QDir::tempPath() + "/libfm-qt-benchmark-XXXXXX"};
+    if(!dir.isValid()) {
+        qWarning("failed to create the test folder");
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+    int frames = std::max(1, parser.value(framesOption).toInt());
+    generateFolder(dir.path(), parser.value(filesOption).toInt());
+
+    auto path = Fm::FilePath::fromLocalPath(dir.path().toLocal8Bit().constData());
+    waitForFolder(path);
+    auto model = Fm::CachedFolderModel::sharedModelFromPath(path);
+    auto proxyModel = new Fm::ProxyFolderModel();
+    proxyModel->sort(Fm::FolderModel::ColumnFileName, Qt::AscendingOrder);
+    proxyModel->setSourceModel(model.get());
+
+    BenchmarkFolderView view;
+    view.setModel(proxyModel);
+    view.resize(1024, 768);
+    view.show();
+    app.processEvents();
+
+    const struct {
+        Fm::FolderView::ViewMode mode;
+        const char* name;
+    } modes[] = {
+        {Fm::FolderView::IconMode, "icon"},
+        {Fm::FolderView::CompactMode, "compact"},
+        {Fm::FolderView::DetailedListMode, "detailed"},
+        {Fm::FolderView::ThumbnailMode, "thumbnail"}
+    };
+    Samples samples;
+    for(const auto& mode: modes) {
+        samples.measure([&]() {
+            view.setViewMode(mode.mode);
+            app.processEvents();
+        });
+        samples.report(output, mode.name, "setViewMode");
+
+        for(int i = 0; i < frames; ++i) {
+            samples.measure([&]() {
+                view.measureGridSize();
+            });
+        }
+        samples.report(output, mode.name, "updateGridSize");
+
+        auto childView = view.childView();
+        auto delegate = childView->itemDelegate();
+        QStyleOptionViewItem option;
+        option.initFrom(childView);
+        option.decorationSize = view.iconSize(mode.mode);
+        int rows = proxyModel->rowCount();
+        for(int i = 0; i < frames && rows > 0; ++i) {
+            auto index = proxyModel->index(i * rows / frames, Fm::FolderModel::ColumnFileName);
+            samples.measure([&]() {
+                delegate->sizeHint(option, index);
+            });
+        }
+        samples.report(output, mode.name, "sizeHint");
+
+        // a page is scrolled and painted per frame, and it goes back to the top at the end
+        // the items flow from top to bottom in the compact mode
+        auto scrollBar = mode.mode == Fm::FolderView::CompactMode ? childView->horizontalScrollBar() : childView->verticalScrollBar();
+        for(int i = 0; i < frames; ++i) {
+            int value = scrollBar->value() + scrollBar->pageStep();
+            scrollBar->setValue(value > scrollBar->maximum() ? 0 : value);
+            samples.measure([&]() {
+                childView->viewport()->repaint();
+            });
+        }
+        samples.report(output, mode.name, "paint");
+
+        for(int i = 0; i < frames; ++i) {
+            samples.measure([&]() {
+                view.resize(800 + (i % 8) * 50, 768);
+                app.processEvents();
+            });
+        }
+        samples.report(output, mode.name, "resize");
+
+        if(auto treeView = qobject_cast<QTreeView*>(childView)) {
+            for(int i = 0; i < frames; ++i) {
+                samples.measure([&]() {
+                    // it's a private slot
+                    QMetaObject::invokeMethod(treeView, "layoutColumns", Qt::DirectConnection);
+                });
+            }
+            samples.report(output, mode.name, "layoutColumns");
+        }
+        view.resize(1024, 768);
+        app.processEvents();
+    }
+
+    return 0;
+}
@@ -20,10 +20,10 @@ int main(int argc, char** argv) {
     win.setCentralWidget(&folder_view);
 
     auto home = Fm::FilePath::homeDir();
-    Fm::CachedFolderModel* model = Fm::CachedFolderModel::modelFromPath(home);
+    auto model = Fm::CachedFolderModel::sharedModelFromPath(home);
     auto proxy_model = new Fm::ProxyFolderModel();
     proxy_model->sort(Fm::FolderModel::ColumnFileName, Qt::AscendingOrder);
-    proxy_model->setSourceModel(model);
+    proxy_model->setSourceModel(model.get());
 
     proxy_model->setThumbnailSize(64);
     proxy_model->setShowThumbnails(true);
@@ -39,8 +39,9 @@ int main(int argc, char** argv) {
     toolbar.addAction(action);
     QObject::connect(action, &QAction::triggered, [&]() {
         auto path = Fm::FilePath::fromPathStr(edit.text().toLocal8Bit().constData());
-        auto new_model = Fm::CachedFolderModel::modelFromPath(path);
-        proxy_model->setSourceModel(new_model);
+        // the old model is kept by the cache of the idle models
+        model = Fm::CachedFolderModel::sharedModelFromPath(path);
+        proxy_model->setSourceModel(model.get());
     });
 
     win.show();
@@ -0,0 +1,266 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QPainter>
+#include <QImage>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <atomic>
+#include <functional>
+#include "../core/folder.h"
+#include "../core/dirlistjob.h"
+#include "../core/fileinfojob.h"
+#include "../core/thumbnailjob.h"
+#include "libfmqt.h"
+#include "vfs-latency.h"
+#include "benchmark_p.h"
+
+// usage: test-remote-benchmark [--files N] [--images N] [--latencies 0,1,10,50] [--throughput N]
+//                              [--batch N] [--failure-rate R] [--runs N] [--output FILE]
+// Lists a generated folder, queries the infos of its files and loads the thumbnails of images
+// through the latency:// VFS of vfs-latency.c, which adds the round trip of a remote filesystem
+// to every call, so the batching, the async enumeration and the caching of DirListJob, Folder,
+// FileInfoJob and ThumbnailJob can be measured reproducibly without a server.
+// A JSON object per latency, API and run has the time to the first results, the total time and
+// the round trips done. The thumbnails and the folder snapshots are saved in a temporary XDG_CACHE_HOME.
+
+namespace {
+
+struct Result {
+    const char* api;
+    std::uint64_t items;
+    qint64 firstNs;
+    qint64 totalNs;
+};
+
+class Benchmark {
+public:
+    Benchmark(BenchmarkOutput& output, const Fm::FilePath& dir, const Fm::FilePathList& files, int thumbnailSize):
+        output_(output),
+        dir_{dir},
+        files_{files},
+        thumbnailSize_{thumbnailSize} {
+    }
+
+    void run(int run) {
+        measure(run, [this]() {
+            return listJob();
+        });
+        measure(run, [this]() {
+            return listFolder();
+        });
+        // the folder is shown from the listing saved by the first load, while it's listed again
+        Fm::Folder::setSnapshotsEnabled(true);
+        listFolder();
+        measure(run, [this]() {
+            Result result = listFolder();
+            result.api = "Folder+snapshot";
+            return result;
+        });
+        Fm::Folder::setSnapshotsEnabled(false);
+        measure(run, [this]() {
+            return queryInfos();
+        });
+        measure(run, [this]() {
+            return loadThumbnails();
+        });
+    }
+
+private:
+    void measure(int run, const std::function<Result ()>& func) {
+        guint64 calls, failures, lastCalls, lastFailures;
+        fm_latency_vfs_get_counts(&lastCalls, &lastFailures);
+        Result result = func();
+        fm_latency_vfs_get_counts(&calls, &failures);
+        FmLatencyVfsConfig config;
+        fm_latency_vfs_get_config(&config);
+        output_.writeLine("{\"api\":\"%s\",\"run\":%d,\"latencyMs\":%.3f,\"entriesPerSec\":%u,\"failureRate\":%.3f,"
+                          "\"items\":%llu,\"firstMs\":%.3f,\"totalMs\":%.3f,\"roundTrips\":%llu,\"failures\":%llu}",
+                          result.api, run, config.call_latency_us / 1000.0, config.entries_per_sec, config.failure_rate,
+                          static_cast<unsigned long long>(result.items), BenchmarkOutput::ms(result.firstNs),
+                          BenchmarkOutput::ms(result.totalNs), static_cast<unsigned long long>(calls - lastCalls),
+                          static_cast<unsigned long long>(failures - lastFailures));
+    }
+
+    Result listJob() {
+        Result result{"DirListJob", 0, -1, 0};
+        QEventLoop loop;
+        QElapsedTimer timer;
+        std::atomic<qint64> firstNs{-1};
+        std::atomic<std::uint64_t> files{0};
+        auto job = new Fm::DirListJob(dir_, Fm::DirListJob::FAST);
+        job->setIncremental(true);
+        QObject::connect(job, &Fm::DirListJob::filesFound, job, [&](Fm::FileInfoList& found) {
+            qint64 unset = -1;
+            firstNs.compare_exchange_strong(unset, timer.nsecsElapsed());
+            files += found.size();
+        }, Qt::DirectConnection);
+        QObject::connect(job, &Fm::Job::finished, &loop, [&loop, job, &files]() {
+            files += job->files().size();
+            loop.quit();
+        });
+        timer.start();
+        job->runAsync();
+        loop.exec();
+        result.totalNs = timer.nsecsElapsed();
+        result.firstNs = firstNs.load();
+        result.items = files.load();
+        return result;
+    }
+
+    Result listFolder() {
+        Result result{"Folder", 0, -1, 0};
+        QEventLoop loop;
+        QElapsedTimer timer;
+        timer.start();
+        auto folder = Fm::Folder::fromPath(dir_);
+        QObject::connect(folder.get(), &Fm::Folder::filesAdded, &loop, [&](Fm::FileInfoList& files) {
+            if(result.firstNs < 0) {
+                result.firstNs = timer.nsecsElapsed();
+            }
+            result.items += files.size();
+        });
+        QObject::connect(folder.get(), &Fm::Folder::finishLoading, &loop, &QEventLoop::quit);
+        if(!folder->isLoaded()) {
+            loop.exec();
+        }
+        result.totalNs = timer.nsecsElapsed();
+        // the next run should list the folder again
+        folder.reset();
+        Fm::Folder::clearCache();
+        return result;
+    }
+
+    Result queryInfos() {
+        Result result{"FileInfoJob", 0, -1, 0};
+        QElapsedTimer timer;
+        Fm::FileInfoJob job{files_};
+        QObject::connect(&job, &Fm::FileInfoJob::gotInfo, &job, [&](const Fm::FilePath&, std::shared_ptr<const Fm::FileInfo>&) {
+            if(result.firstNs < 0) {
+                result.firstNs = timer.nsecsElapsed();
+            }
+        }, Qt::DirectConnection);
+        timer.start();
+        job.run();
+        result.totalNs = timer.nsecsElapsed();
+        result.items = job.files().size();
+        infos_ = job.files();
+        return result;
+    }
+
+    Result loadThumbnails() {
+        Result result{"ThumbnailJob", 0, -1, 0};
+        Fm::FileInfoList images;
+        for(const auto& info: infos_) {
+            if(info->isImage()) {
+                images.push_back(info);
+            }
+        }
+        // loaded from the files every time, not from the caches
+        QDir{QString::fromLocal8Bit(qgetenv("XDG_CACHE_HOME")) + "/thumbnails"}.removeRecursively();
+        Fm::ThumbnailJob::clearMemoryCache();
+        QElapsedTimer timer;
+        Fm::ThumbnailJob job{images, thumbnailSize_};
+        QObject::connect(&job, &Fm::ThumbnailJob::thumbnailLoaded, &job, [&](const std::shared_ptr<const Fm::FileInfo>&, int, QImage image) {
+            if(result.firstNs < 0) {
+                result.firstNs = timer.nsecsElapsed();
+            }
+            if(!image.isNull()) {
+                ++result.items;
+            }
+        }, Qt::DirectConnection);
+        timer.start();
+        job.run();
+        result.totalNs = timer.nsecsElapsed();
+        return result;
+    }
+
+    BenchmarkOutput& output_;
+    Fm::FilePath dir_;
+    Fm::FilePathList files_;
+    Fm::FileInfoList infos_;
+    int thumbnailSize_;
+};
+
+} // namespace
+
+static void generateFiles(const QString& dirPath, int count, int images) {
+    QDir dir{dirPath};
+    for(int i = 0; i < count; ++i) {
+        QFile file{dir.filePath(QStringLiteral("file-%1.txt").arg(i))};
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray::number(i) + '\n');
+    }
+    for(int i = 0; i < images; ++i) {
+        QImage image{QSize{800, 600}, QImage::Format_RGB32};
+        image.fill(QColor::fromHsv(i * 37 % 360, 200, 255));
+        QPainter painter{&image};
+        painter.drawText(image.rect(), Qt::AlignCenter, QString::number(i));
+        painter.end();
+        image.save(dir.filePath(QStringLiteral("image-%1.jpg").arg(i)), "JPEG", 85);
+    }
+}
+
+int main(int argc, char** argv) {
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QTemporaryDir cacheDir{QDir::tempPath() + "/libfm-qt-benchmark-cache-XXXXXX"};
+    // it should be set before GLib reads it
+    qputenv("XDG_CACHE_HOME", cacheDir.path().toLocal8Bit());
+
+    QGuiApplication app(argc, argv);
+    Fm::LibFmQt contex;
+    fm_latency_vfs_register();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption filesOption{"files", "Number of the generated text files.", "count", "2000"};
+    QCommandLineOption imagesOption{"images", "Number of the generated images.", "count", "20"};
+    QCommandLineOption latenciesOption{"latencies", "Comma separated latencies of a round trip in milliseconds.", "msecs", "0,1,10,50"};
+    QCommandLineOption throughputOption{"throughput", "The most entries listed per second (0 means no limit).", "count", "0"};
+    QCommandLineOption batchOption{"batch", "Number of the entries listed per round trip.", "count", "64"};
+    QCommandLineOption failureRateOption{"failure-rate", "The rate of the round trips which fail.", "rate", "0"};
+    QCommandLineOption runsOption{"runs", "Number of runs with each latency.", "runs", "3"};
+    BenchmarkOutput output;
+    parser.addOptions({filesOption, imagesOption, latenciesOption, throughputOption, batchOption,
+                       failureRateOption, runsOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir baseDir{QDir::tempPath() + "/libfm-qt-benchmark-XXXXXX"};
+    if(!cacheDir.isValid() || !baseDir.isValid()) {
+        qWarning("failed to create the test folders");
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+    qDebug() << "generating the files in" << baseDir.path();
+    generateFiles(baseDir.path(), parser.value(filesOption).toInt(), parser.value(imagesOption).toInt());
+
+    auto dir = Fm::FilePath::fromUri(("latency://" + baseDir.path()).toLocal8Bit().constData());
+    Fm::FilePathList files;
+    for(const auto& name: QDir{baseDir.path()}.entryList(QDir::Files)) {
+        files.push_back(dir.child(name.toLocal8Bit().constData()));
+    }
+
+    Benchmark benchmark{output, dir, files, 128};
+    int runs = parser.value(runsOption).toInt();
+    for(const auto& latency: parser.value(latenciesOption).split(',', QString::SkipEmptyParts)) {
+        FmLatencyVfsConfig config;
+        config.call_latency_us = guint(latency.toDouble() * 1000);
+        config.entries_per_sec = parser.value(throughputOption).toUInt();
+        config.batch_size = parser.value(batchOption).toUInt();
+        config.failure_rate = parser.value(failureRateOption).toDouble();
+        fm_latency_vfs_set_config(&config);
+        for(int run = 1; run <= runs; ++run) {
+            benchmark.run(run);
+        }
+    }
+
+    fm_latency_vfs_unregister();
+    return 0;
+}
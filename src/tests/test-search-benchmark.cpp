@@ -0,0 +1,189 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <atomic>
+#include <functional>
+#include "../core/dirlistjob.h"
+#include "../fm-search.h"
+#include "libfmqt.h"
+#include "benchmark_p.h"
+
+// usage: test-search-benchmark [--dir PATH] [--files N] [--runs N] [--output FILE]
+// Generates a tree of text files, binary files and hidden files in PATH (the temp dir by default),
+// and lists search:// URIs of it with DirListJob, matching the names literally, with globs and
+// with regular expressions, and the content literally and with regular expressions, recursively
+// or not, and with the hidden files or not. A JSON object per run has the entries scanned per
+// second, the bytes of the searched files per second, which is an upper bound since the content
+// of a file isn't read after the first match, and the time to the first batch of hits, which
+// includes the time the job holds the found files (DirListJob::batchInterval()).
+
+namespace {
+
+struct Corpus {
+    std::uint64_t entries;
+    std::uint64_t topLevelEntries;
+    std::uint64_t bytes;
+};
+
+struct SearchCase {
+    const char* name;
+    std::function<void (FmSearch* search)> setup;
+    bool recursive;
+    bool showHidden;
+    bool content;
+};
+
+} // namespace
+
+static Corpus generateCorpus(const QString& dirPath, int count) {
+    static const char* const words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel"};
+    Corpus corpus{0, 0, 0};
+    QDir dir{dirPath};
+    for(int i = 0; i < count; ++i) {
+        // 20 dirs of 10 subdirs each, and some hidden ones
+        QString subdir = QStringLiteral("%1dir-%2/sub-%3").arg(i % 97 == 0 ? QStringLiteral(".") : QString()).arg(i % 20).arg(i % 10);
+        if(!dir.exists(subdir)) {
+            corpus.entries += dir.exists(subdir.section('/', 0, 0)) ? 1 : 2;
+            dir.mkpath(subdir);
+        }
+        QString name = (i % 50 == 0 ? QStringLiteral(".hidden-%1.txt") : i % 7 == 0 ? QStringLiteral("file-%1.bin") : QStringLiteral("file-%1.txt")).arg(i);
+        QFile file{dir.filePath(subdir + '/' + name)};
+        file.open(QIODevice::WriteOnly);
+        QByteArray data;
+        if(name.endsWith(QLatin1String(".bin"))) {
+            data.resize(8192);
+            for(int j = 0; j < data.size(); ++j) {
+                data[j] = char((i + j * 13) & 0xff);
+            }
+        }
+        else {
+            for(int line = 0; line < 64; ++line) {
+                data += QByteArray{words[(i + line) % 8]} + ' ' + words[(i * line) % 8] + ' ' + QByteArray::number(i * line) + '\n';
+            }
+            // a few files have the needle at their end, so the whole file is read
+            if(i % 100 == 42) {
+                data += "needle-" + QByteArray::number(i) + '\n';
+            }
+        }
+        file.write(data);
+        corpus.bytes += data.size();
+        ++corpus.entries;
+    }
+    corpus.topLevelEntries = dir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden).size();
+    return corpus;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    Fm::LibFmQt contex;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption dirOption{"dir", "Create the files in <path>.", "path", QDir::tempPath()};
+    QCommandLineOption filesOption{"files", "Number of the generated files.", "count", "20000"};
+    QCommandLineOption runsOption{"runs", "Number of runs of each search.", "runs", "3"};
+    BenchmarkOutput output;
+    parser.addOptions({dirOption, filesOption, runsOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir baseDir{parser.value(dirOption) + "/libfm-qt-benchmark-XXXXXX"};
+    if(!baseDir.isValid()) {
+        qWarning() << "failed to create a folder in" << parser.value(dirOption);
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+    qDebug() << "generating the files in" << baseDir.path();
+    Corpus corpus = generateCorpus(baseDir.path(), parser.value(filesOption).toInt());
+
+    const SearchCase cases[] = {
+        {"name", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "file-1234.txt");
+        }, true, false, false},
+        {"glob", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "*7.txt");
+        }, true, false, false},
+        {"globCaseInsensitive", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "FILE-1*");
+            fm_search_set_name_ci(search, true);
+        }, true, false, false},
+        {"regex", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "^file-[0-9]*[05]\\.bin$");
+            fm_search_set_name_regex(search, true);
+        }, true, false, false},
+        {"content", [](FmSearch* search) {
+            fm_search_set_content_pattern(search, "needle-");
+        }, true, false, true},
+        {"contentCaseInsensitive", [](FmSearch* search) {
+            fm_search_set_content_pattern(search, "NEEDLE-");
+            fm_search_set_content_ci(search, true);
+        }, true, false, true},
+        {"contentRegex", [](FmSearch* search) {
+            fm_search_set_content_pattern(search, "need[a-z]+-[0-9]+2$");
+            fm_search_set_content_regex(search, true);
+        }, true, false, true},
+        {"contentSkipBinary", [](FmSearch* search) {
+            fm_search_set_content_pattern(search, "needle-");
+            fm_search_set_content_skip_binary(search, true);
+        }, true, false, true},
+        {"notRecursive", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "*");
+        }, false, false, false},
+        {"hidden", [](FmSearch* search) {
+            fm_search_set_name_patterns(search, "*.txt");
+        }, true, true, false}
+    };
+
+    int runs = parser.value(runsOption).toInt();
+    for(const auto& searchCase: cases) {
+        FmSearch* search = fm_search_new();
+        fm_search_add_dir(search, baseDir.path().toLocal8Bit().constData());
+        fm_search_set_recursive(search, searchCase.recursive);
+        fm_search_set_show_hidden(search, searchCase.showHidden);
+        searchCase.setup(search);
+        Fm::FilePath uri{fm_search_to_gfile(search), false};
+        fm_search_free(search);
+
+        for(int run = 1; run <= runs; ++run) {
+            QEventLoop loop;
+            QElapsedTimer timer;
+            std::atomic<qint64> firstHitNs{-1};
+            std::atomic<std::uint64_t> hits{0};
+            std::atomic<unsigned int> scanned{0};
+            auto job = new Fm::DirListJob(uri, Fm::DirListJob::FAST);
+            job->setIncremental(true);
+            QObject::connect(job, &Fm::DirListJob::filesFound, job, [&](Fm::FileInfoList& found) {
+                qint64 unset = -1;
+                firstHitNs.compare_exchange_strong(unset, timer.nsecsElapsed());
+                hits += found.size();
+            }, Qt::DirectConnection);
+            QObject::connect(job, &Fm::DirListJob::searchProgress, job, [&](unsigned int scannedFiles, unsigned int /*matchedFiles*/) {
+                scanned = scannedFiles;
+            }, Qt::DirectConnection);
+            QObject::connect(job, &Fm::Job::finished, &loop, [&loop, job, &hits]() {
+                hits += job->files().size();
+                loop.quit();
+            });
+            timer.start();
+            job->runAsync();
+            loop.exec();
+            double secs = timer.nsecsElapsed() / 1000000000.0;
+
+            // the last progress might not be reported before the job finishes, so the generated entries are counted
+            std::uint64_t entries = searchCase.recursive ? corpus.entries : corpus.topLevelEntries;
+            output.writeLine("{\"case\":\"%s\",\"run\":%d,\"hits\":%llu,\"entries\":%llu,\"lastProgress\":%u,\"totalMs\":%.3f,"
+                             "\"firstHitMs\":%.3f,\"entriesPerSec\":%.1f,\"contentMbPerSec\":%.2f}",
+                             searchCase.name, run, static_cast<unsigned long long>(hits.load()), static_cast<unsigned long long>(entries), scanned.load(),
+                             secs * 1000, BenchmarkOutput::ms(firstHitNs.load()), secs > 0 ? entries / secs : 0,
+                             searchCase.content && secs > 0 ? corpus.bytes / secs / 1000000 : 0);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QTemporaryDir>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QImage>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <vector>
+#include "../core/folder.h"
+#include "../core/thumbnailjob.h"
+#include "../foldermodel.h"
+#include "libfmqt.h"
+#include "benchmark_p.h"
+
+// usage: test-thumbnail-benchmark [--images N] [--size N] [--pools 1,2,4,0] [--output FILE]
+// Generates JPEG, PNG and large photo-like images, and loads their thumbnails with ThumbnailJob
+// and FolderModel in three states: with an empty disk cache, with the thumbnails cached on the disk
+// only, and with them cached in the memory too. The thumbnails are saved in a temporary
+// XDG_CACHE_HOME so the cache of the user is not touched. The latency of each image and the
+// throughput with each size of the thread pool are written as JSON objects, one per line.
+
+namespace {
+
+class Benchmark {
+public:
+    explicit Benchmark(BenchmarkOutput& output): output_(output) {
+    }
+
+    void report(const char* api, const char* cache, int threads, std::vector<qint64>& latencies, qint64 totalNs) {
+        if(latencies.empty()) {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        output_.writeLine("{\"api\":\"%s\",\"cache\":\"%s\",\"threads\":%d,\"images\":%zu,\"p50Ms\":%.3f,\"p90Ms\":%.3f,"
+                          "\"maxMs\":%.3f,\"totalMs\":%.3f,\"imagesPerSec\":%.1f,\"peakRssKb\":%ld}",
+                          api, cache, threads, latencies.size(), BenchmarkOutput::percentileMs(latencies, 50),
+                          BenchmarkOutput::percentileMs(latencies, 90), BenchmarkOutput::ms(latencies.back()),
+                          BenchmarkOutput::ms(totalNs), totalNs > 0 ? latencies.size() * 1000000000.0 / totalNs : 0,
+                          BenchmarkOutput::peakRssKb());
+    }
+
+private:
+    BenchmarkOutput& output_;
+};
+
+} // namespace
+
+static void generateImages(const QString& dirPath, int count) {
+    for(int i = 0; i < count; ++i) {
+        // every tenth image is as large as the photos of a camera
+        bool photo = i % 10 == 0;
+        QImage image{photo ? QSize{4000, 3000} : QSize{1024, 768}, QImage::Format_RGB32};
+        QPainter painter{&image};
+        QLinearGradient gradient{0, 0, qreal(image.width()), qreal(image.height())};
+        gradient.setColorAt(0, QColor::fromHsv(i * 37 % 360, 200, 255));
+        gradient.setColorAt(1, QColor::fromHsv(i * 91 % 360, 255, 80));
+        painter.fillRect(image.rect(), gradient);
+        painter.drawText(image.rect(), Qt::AlignCenter, QString::number(i));
+        painter.end();
+        if(photo) {
+            image.save(dirPath + QStringLiteral("/photo-%1.jpg").arg(i), "JPEG", 90);
+        }
+        else if(i % 2) {
+            image.save(dirPath + QStringLiteral("/image-%1.png").arg(i), "PNG");
+        }
+        else {
+            image.save(dirPath + QStringLiteral("/image-%1.jpg").arg(i), "JPEG", 85);
+        }
+    }
+}
+
+static std::shared_ptr<Fm::Folder> loadFolder(const QString& dirPath) {
+    auto folder = Fm::Folder::fromPath(Fm::FilePath::fromLocalPath(dirPath.toLocal8Bit().constData()));
+    if(!folder->isLoaded()) {
+        QEventLoop loop;
+        QObject::connect(folder.get(), &Fm::Folder::finishLoading, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    return folder;
+}
+
+// the latency is the time since the previous thumbnail, since the job loads them one by one
+static qint64 runJob(const Fm::FileInfoList& files, int size, std::vector<qint64>& latencies) {
+    Fm::ThumbnailJob job{files, size};
+    QElapsedTimer timer;
+    qint64 last = 0;
+    QObject::connect(&job, &Fm::ThumbnailJob::thumbnailLoaded, &job, [&](const std::shared_ptr<const Fm::FileInfo>&, int, QImage) {
+        qint64 now = timer.nsecsElapsed();
+        latencies.push_back(now - last);
+        last = now;
+    }, Qt::DirectConnection);
+    timer.start();
+    job.run();
+    return timer.nsecsElapsed();
+}
+
+// the latency is the time since the thumbnail is requested until the model has it
+static qint64 runModel(const std::shared_ptr<Fm::Folder>& folder, int size, std::vector<qint64>& latencies) {
+    Fm::FolderModel model;
+    model.setFolder(folder);
+    int rows = model.rowCount();
+    int loaded = 0;
+    QEventLoop loop;
+    QElapsedTimer timer;
+    // the model doesn't tell when a thumbnail fails, so it stops waiting when nothing is loaded for long
+    QTimer idleTimer;
+    idleTimer.setSingleShot(true);
+    idleTimer.setInterval(10000);
+    QObject::connect(&idleTimer, &QTimer::timeout, &loop, [&]() {
+        qWarning("%d thumbnails are not loaded", rows - loaded);
+        loop.quit();
+    });
+    QObject::connect(&model, &Fm::FolderModel::thumbnailLoaded, &loop, [&](const QModelIndex&, int) {
+        latencies.push_back(timer.nsecsElapsed());
+        idleTimer.start();
+        if(++loaded == rows) {
+            loop.quit();
+        }
+    });
+    timer.start();
+    for(int row = 0; row < rows; ++row) {
+        if(!model.thumbnailFromIndex(model.index(row, 0), size).isNull()) {
+            latencies.push_back(timer.nsecsElapsed());
+            ++loaded;
+        }
+    }
+    if(loaded < rows) {
+        idleTimer.start();
+        loop.exec();
+    }
+    return timer.nsecsElapsed();
+}
+
+int main(int argc, char** argv) {
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QTemporaryDir cacheDir{QDir::tempPath() + "/libfm-qt-benchmark-cache-XXXXXX"};
+    // it should be set before GLib reads it
+    qputenv("XDG_CACHE_HOME", cacheDir.path().toLocal8Bit());
+
+    QGuiApplication app(argc, argv);
+    Fm::LibFmQt contex;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption imagesOption{"images", "Number of the generated images.", "count", "200"};
+    QCommandLineOption sizeOption{"size", "Size of the thumbnails.", "size", "128"};
+    QCommandLineOption poolsOption{"pools", "Comma separated numbers of threads of the pool (0 means one per core).", "counts", "1,2,4,0"};
+    BenchmarkOutput output;
+    parser.addOptions({imagesOption, sizeOption, poolsOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir imageDir{QDir::tempPath() + "/libfm-qt-benchmark-XXXXXX"};
+    if(!cacheDir.isValid() || !imageDir.isValid()) {
+        qWarning("failed to create the test folders");
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+    int size = parser.value(sizeOption).toInt();
+    qDebug() << "generating the images in" << imageDir.path();
+    generateImages(imageDir.path(), parser.value(imagesOption).toInt());
+    auto folder = loadFolder(imageDir.path());
+    Benchmark benchmark{output};
+
+    auto clearDiskCache = [&]() {
+        QDir{cacheDir.path() + "/thumbnails"}.removeRecursively();
+    };
+
+    std::vector<qint64> latencies;
+    clearDiskCache();
+    Fm::ThumbnailJob::clearMemoryCache();
+    qint64 totalNs = runJob(folder->files(), size, latencies);
+    benchmark.report("ThumbnailJob", "cold", 1, latencies, totalNs);
+    latencies.clear();
+    Fm::ThumbnailJob::clearMemoryCache();
+    totalNs = runJob(folder->files(), size, latencies);
+    benchmark.report("ThumbnailJob", "disk", 1, latencies, totalNs);
+    latencies.clear();
+    totalNs = runJob(folder->files(), size, latencies);
+    benchmark.report("ThumbnailJob", "memory", 1, latencies, totalNs);
+    latencies.clear();
+
+    for(const auto& pool: parser.value(poolsOption).split(',', QString::SkipEmptyParts)) {
+        int threads = pool.toInt();
+        Fm::ThumbnailJob::setMaxThreadCount(threads);
+        threads = Fm::ThumbnailJob::maxThreadCount();
+
+        clearDiskCache();
+        Fm::ThumbnailJob::clearMemoryCache();
+        totalNs = runModel(folder, size, latencies);
+        benchmark.report("FolderModel", "cold", threads, latencies, totalNs);
+        latencies.clear();
+        Fm::ThumbnailJob::clearMemoryCache();
+        totalNs = runModel(folder, size, latencies);
+        benchmark.report("FolderModel", "disk", threads, latencies, totalNs);
+        latencies.clear();
+        totalNs = runModel(folder, size, latencies);
+        benchmark.report("FolderModel", "memory", threads, latencies, totalNs);
+        latencies.clear();
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "../core/filepath.h"
+#include "../core/fileinfo.h"
+#include "../core/iconinfo.h"
+#include "libfmqt.h"
+#define BENCHMARK_COUNT_ALLOCATIONS
+#include "benchmark_p.h"
+
+// usage: test-valuetypes-benchmark [--iterations N] [--runs N] [--check] [--output FILE]
+// Micro-benchmarks of the value types used on every hot path: copying and moving FilePath,
+// creating FileInfo from GFileInfo, FileInfoList::paths() and IconInfo::fromGIcon().
+// A JSON object per case and run has the time, the C++ allocations and the allocated bytes per
+// operation. The allocations of GLib are not counted (see benchmark_p.h).
+// With --check, the exit code is 1 if a case allocates more than its budget, so the changes which
+// add allocations to these types are caught.
+
+namespace {
+
+struct BenchmarkCase {
+    const char* name;
+    double maxAllocationsPerOp; // the budget checked by --check, negative if there's none
+    // runs the operation the given times, and returns the number of operations done
+    std::function<std::uint64_t (int iterations)> run;
+};
+
+// keeps the compiler from optimizing the measured operations away
+std::atomic<std::uintptr_t> sink{0};
+
+template <typename T>
+void consume(const T& value) {
+    sink.fetch_add(reinterpret_cast<std::uintptr_t>(&value) & 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    Fm::LibFmQt contex;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption{"iterations", "Number of operations in each run.", "count", "100000"};
+    QCommandLineOption runsOption{"runs", "Number of runs of each case.", "runs", "5"};
+    QCommandLineOption checkOption{"check", "Fail if a case allocates more than its budget."};
+    BenchmarkOutput output;
+    parser.addOptions({iterationsOption, runsOption, checkOption, output.option()});
+    parser.process(app);
+
+    QTemporaryDir dir{QDir::tempPath() + "/libfm-qt-benchmark-XXXXXX"};
+    if(!dir.isValid()) {
+        qWarning("failed to create the test folder");
+        return 1;
+    }
+    if(!output.open(parser)) {
+        return 1;
+    }
+
+    // a real file, so the GFileInfo has all the attributes a folder listing gets
+    QString filePath = dir.filePath(QStringLiteral("a-file-with-a-long-name-that-is-not-inlined.txt"));
+    QFile file{filePath};
+    file.open(QIODevice::WriteOnly);
+    file.write("text\n");
+    file.close();
+    auto dirPath = Fm::FilePath::fromLocalPath(dir.path().toLocal8Bit().constData());
+    auto path = Fm::FilePath::fromLocalPath(filePath.toLocal8Bit().constData());
+    Fm::GFileInfoPtr gfileInfo{g_file_query_info(path.gfile().get(), "standard::*,unix::*,access::*,time::*,thumbnail::*",
+                                                 G_FILE_QUERY_INFO_NONE, nullptr, nullptr), false};
+    if(!gfileInfo) {
+        qWarning() << "failed to query" << filePath;
+        return 1;
+    }
+    Fm::FileInfoList infos;
+    for(int i = 0; i < 1000; ++i) {
+        infos.push_back(std::make_shared<const Fm::FileInfo>(gfileInfo, dirPath));
+    }
+    Fm::GIconPtr gicon{g_themed_icon_new("text-plain"), false};
+
+    const BenchmarkCase cases[] = {
+        {"FilePath::copy", 0, [&](int iterations) {
+            for(int i = 0; i < iterations; ++i) {
+                Fm::FilePath copy{path};
+                consume(copy);
+            }
+            return std::uint64_t(iterations);
+        }},
+        {"FilePath::move", 0, [&](int iterations) {
+            Fm::FilePath moved{path};
+            for(int i = 0; i < iterations; ++i) {
+                Fm::FilePath other{std::move(moved)};
+                moved = std::move(other);
+                consume(moved);
+            }
+            // each iteration moves twice
+            return std::uint64_t(iterations) * 2;
+        }},
+        {"FilePathList::growth", 0.1, [&](int iterations) {
+            // the reallocations of the vector move the paths
+            Fm::FilePathList paths;
+            for(int i = 0; i < iterations; ++i) {
+                paths.push_back(path);
+            }
+            consume(paths);
+            return std::uint64_t(iterations);
+        }},
+        // the mime type and the icon are looked up in caches, which might allocate, so there's no budget
+        {"FileInfo::fromGFileInfo", -1, [&](int iterations) {
+            for(int i = 0; i < iterations; ++i) {
+                auto info = std::make_shared<const Fm::FileInfo>(gfileInfo, dirPath);
+                consume(*info);
+            }
+            return std::uint64_t(iterations);
+        }},
+        {"FileInfoList::paths", 0.02, [&](int iterations) {
+            // an operation is a path of the list
+            int lists = std::max(1, iterations / int(infos.size()));
+            for(int i = 0; i < lists; ++i) {
+                auto paths = infos.paths();
+                consume(paths);
+            }
+            return std::uint64_t(lists) * infos.size();
+        }},
+        {"IconInfo::fromGIcon", 0, [&](int iterations) {
+            // the icon is found in the cache after the first call
+            for(int i = 0; i < iterations; ++i) {
+                auto icon = Fm::IconInfo::fromGIcon(gicon);
+                consume(icon);
+            }
+            return std::uint64_t(iterations);
+        }},
+        {"IconInfo::fromGIconNew", -1, [&](int iterations) {
+            // a new GIcon which is equal to a cached one, like in a folder listing
+            for(int i = 0; i < iterations; ++i) {
+                auto icon = Fm::IconInfo::fromGIcon(Fm::GIconPtr{g_themed_icon_new("text-plain"), false});
+                consume(icon);
+            }
+            return std::uint64_t(iterations);
+        }}
+    };
+
+    int iterations = parser.value(iterationsOption).toInt();
+    int runs = parser.value(runsOption).toInt();
+    bool withinBudget = true;
+    for(const auto& benchmarkCase: cases) {
+        for(int run = 1; run <= runs; ++run) {
+            auto start = allocationCounts();
+            QElapsedTimer timer;
+            timer.start();
+            std::uint64_t ops = benchmarkCase.run(iterations);
+            qint64 ns = timer.nsecsElapsed();
+            auto allocations = allocationCounts() - start;
+            double allocationsPerOp = double(allocations.count) / ops;
+            output.writeLine("{\"case\":\"%s\",\"run\":%d,\"ops\":%llu,\"nsPerOp\":%.2f,\"allocsPerOp\":%.3f,\"bytesPerOp\":%.1f}",
+                             benchmarkCase.name, run, static_cast<unsigned long long>(ops), double(ns) / ops,
+                             allocationsPerOp, double(allocations.bytes) / ops);
+            if(benchmarkCase.maxAllocationsPerOp >= 0 && allocationsPerOp > benchmarkCase.maxAllocationsPerOp) {
+                qWarning("%s allocates %.3f times per operation, more than %.3f",
+                         benchmarkCase.name, allocationsPerOp, benchmarkCase.maxAllocationsPerOp);
+                withinBudget = false;
+            }
+        }
+    }
+
+    return parser.isSet(checkOption) && !withinBudget ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QFile>
+#include <QDebug>
+#include "../core/vfs/fm-xml-file.h"
+
+// usage: test-xmlfile [number of entries | menu file]
+// Parses a menu with the given number of <Include> entries, or the given file, with FmXmlFile,
+// and with GMarkupParser which doesn't build a tree, to compare their speed.
+
+static gboolean passHandler(FmXmlFileItem* /*item*/, GList* /*children*/,
+                            char* const* /*attribute_names*/, char* const* /*attribute_values*/,
+                            guint /*n_attributes*/, gint /*line*/, gint /*pos*/,
+                            GError** /*error*/, gpointer /*user_data*/) {
+    return TRUE;
+}
+
+static QByteArray generateMenu(int entries) {
+    QByteArray data{"<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+                    " \"http://www.freedesktop.org/standards/menu-spec/menu-1.0.dtd\">\n"
+                    "<Menu>\n  <Name>Applications</Name>\n  <MergeFile type=\"parent\">/etc/xdg/menus/applications.menu</MergeFile>\n"};
+    for(int i = 0; i < entries; ++i) {
+        if(i % 100 == 0) {
+            data += "  <Menu>\n    <Name>Folder " + QByteArray::number(i / 100) + "</Name>\n";
+        }
+        data += "    <Include>\n      <Filename>application-" + QByteArray::number(i) + ".desktop</Filename>\n    </Include>\n";
+        if(i % 100 == 99 || i == entries - 1) {
+            data += "  </Menu>\n";
+        }
+    }
+    data += "</Menu>\n";
+    return data;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QByteArray data;
+    if(argc > 1 && QFile::exists(QString::fromLocal8Bit(argv[1]))) {
+        QFile file{QString::fromLocal8Bit(argv[1])};
+        file.open(QIODevice::ReadOnly);
+        data = file.readAll();
+    }
+    else {
+        data = generateMenu(argc > 1 ? atoi(argv[1]) : 10000);
+    }
+    qDebug() << "parsing" << data.size() << "bytes";
+
+    QElapsedTimer timer;
+    timer.start();
+    FmXmlFile* xml = fm_xml_file_new(nullptr);
+    const char* tags[] = {"Menu", "Name", "Include", "Exclude", "Filename", "Category", "MergeFile", "Directory"};
+    for(auto tag: tags) {
+        fm_xml_file_set_handler(xml, tag, &passHandler, FALSE, nullptr);
+    }
+    GError* error = nullptr;
+    if(!fm_xml_file_parse_data(xml, data.constData(), data.size(), &error, nullptr)) {
+        qDebug() << "FmXmlFile failed:" << error->message;
+        g_error_free(error);
+        return 1;
+    }
+    GList* items = fm_xml_file_finish_parse(xml, nullptr);
+    g_list_free(items);
+    qDebug() << "FmXmlFile:" << timer.elapsed() << "ms";
+    timer.restart();
+    g_object_unref(xml);
+    qDebug() << "FmXmlFile freed:" << timer.elapsed() << "ms";
+
+    timer.restart();
+    GMarkupParser parser{};
+    GMarkupParseContext* context = g_markup_parse_context_new(&parser, G_MARKUP_TREAT_CDATA_AS_TEXT, nullptr, nullptr);
+    bool parsed = g_markup_parse_context_parse(context, data.constData(), data.size(), nullptr)
+                  && g_markup_parse_context_end_parse(context, nullptr);
+    g_markup_parse_context_free(context);
+    qDebug() << "GMarkupParser:" << timer.elapsed() << "ms" << (parsed ? "" : "(failed)");
+    return 0;
+}
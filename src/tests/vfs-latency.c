@@ -0,0 +1,433 @@
+/*
+ * vfs-latency.c
+ *
+ * A GFile implementation for the tests, which forwards the calls to the local files
+ * after waiting as long as a remote filesystem would. See vfs-latency.h for details.
+ */
+
+#include "vfs-latency.h"
+
+#include <string.h>
+
+#define LATENCY_SCHEME "latency"
+
+/* the calls sleep in slices this long, so they notice when they're cancelled */
+#define LATENCY_SLICE_US 10000
+
+static FmLatencyVfsConfig latency_config = { 0, 0, 64, 0.0 };
+static guint64 latency_calls = 0;
+static guint64 latency_failures = 0;
+G_LOCK_DEFINE_STATIC(latency);
+
+void fm_latency_vfs_set_config(const FmLatencyVfsConfig *config)
+{
+    G_LOCK(latency);
+    latency_config = *config;
+    if(latency_config.batch_size == 0)
+        latency_config.batch_size = 1;
+    G_UNLOCK(latency);
+}
+
+void fm_latency_vfs_get_config(FmLatencyVfsConfig *config)
+{
+    G_LOCK(latency);
+    *config = latency_config;
+    G_UNLOCK(latency);
+}
+
+void fm_latency_vfs_get_counts(guint64 *calls, guint64 *failures)
+{
+    G_LOCK(latency);
+    *calls = latency_calls;
+    *failures = latency_failures;
+    G_UNLOCK(latency);
+}
+
+static gboolean _latency_sleep(guint64 usecs, GCancellable *cancellable, GError **error)
+{
+    while(usecs > 0)
+    {
+        guint64 slice = MIN(usecs, LATENCY_SLICE_US);
+        if(g_cancellable_set_error_if_cancelled(cancellable, error))
+            return FALSE;
+        g_usleep(slice);
+        usecs -= slice;
+    }
+    return !g_cancellable_set_error_if_cancelled(cancellable, error);
+}
+
+/* a round trip to the "server", which fails at the configured rate */
+static gboolean _latency_round_trip(GCancellable *cancellable, GError **error)
+{
+    FmLatencyVfsConfig config;
+    gboolean fail;
+
+    G_LOCK(latency);
+    config = latency_config;
+    ++latency_calls;
+    fail = config.failure_rate > 0 && g_random_double() < config.failure_rate;
+    if(fail)
+        ++latency_failures;
+    G_UNLOCK(latency);
+
+    if(!_latency_sleep(config.call_latency_us, cancellable, error))
+        return FALSE;
+    if(fail)
+    {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "Injected failure");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* ---- Classes structures ---- */
+typedef struct _FmLatencyVFile          FmLatencyVFile;
+typedef struct _FmLatencyVFileClass     FmLatencyVFileClass;
+
+#define FM_TYPE_LATENCY_VFILE           (fm_latency_vfile_get_type())
+#define FM_LATENCY_VFILE(o)             (G_TYPE_CHECK_INSTANCE_CAST((o), \
+                                         FM_TYPE_LATENCY_VFILE, FmLatencyVFile))
+
+struct _FmLatencyVFile
+{
+    GObject parent_object;
+
+    GFile *real; /* the local file */
+};
+
+struct _FmLatencyVFileClass
+{
+    GObjectClass parent_class;
+};
+
+typedef struct _FmLatencyEnumerator         FmLatencyEnumerator;
+typedef struct _FmLatencyEnumeratorClass    FmLatencyEnumeratorClass;
+
+#define FM_TYPE_LATENCY_ENUMERATOR      (fm_latency_enumerator_get_type())
+#define FM_LATENCY_ENUMERATOR(o)        (G_TYPE_CHECK_INSTANCE_CAST((o), \
+                                         FM_TYPE_LATENCY_ENUMERATOR, FmLatencyEnumerator))
+
+struct _FmLatencyEnumerator
+{
+    GFileEnumerator parent;
+
+    GFileEnumerator *real;
+    guint listed; /* the entries listed so far */
+};
+
+struct _FmLatencyEnumeratorClass
+{
+    GFileEnumeratorClass parent_class;
+};
+
+static GType fm_latency_vfile_get_type(void);
+static GType fm_latency_enumerator_get_type(void);
+
+/* takes the reference of real */
+static GFile *_fm_latency_vfile_new(GFile *real)
+{
+    FmLatencyVFile *item;
+
+    if(real == NULL)
+        return NULL;
+    item = (FmLatencyVFile*)g_object_new(FM_TYPE_LATENCY_VFILE, NULL);
+    item->real = real;
+    return (GFile*)item;
+}
+
+/* ---- FmLatencyEnumerator class ---- */
+G_DEFINE_TYPE(FmLatencyEnumerator, fm_latency_enumerator, G_TYPE_FILE_ENUMERATOR)
+
+static GFileInfo *_fm_latency_enumerator_next_file(GFileEnumerator *enumerator,
+                                                   GCancellable *cancellable,
+                                                   GError **error)
+{
+    FmLatencyEnumerator *priv = FM_LATENCY_ENUMERATOR(enumerator);
+    FmLatencyVfsConfig config;
+
+    fm_latency_vfs_get_config(&config);
+    /* a round trip for each batch of entries */
+    if(priv->listed % config.batch_size == 0 && !_latency_round_trip(cancellable, error))
+        return NULL;
+    if(config.entries_per_sec > 0
+       && !_latency_sleep(G_USEC_PER_SEC / config.entries_per_sec, cancellable, error))
+        return NULL;
+    ++priv->listed;
+    return g_file_enumerator_next_file(priv->real, cancellable, error);
+}
+
+static gboolean _fm_latency_enumerator_close(GFileEnumerator *enumerator,
+                                             GCancellable *cancellable,
+                                             GError **error)
+{
+    return g_file_enumerator_close(FM_LATENCY_ENUMERATOR(enumerator)->real, cancellable, error);
+}
+
+static void _fm_latency_enumerator_finalize(GObject *object)
+{
+    FmLatencyEnumerator *priv = FM_LATENCY_ENUMERATOR(object);
+
+    g_object_unref(priv->real);
+
+    G_OBJECT_CLASS(fm_latency_enumerator_parent_class)->finalize(object);
+}
+
+static void fm_latency_enumerator_class_init(FmLatencyEnumeratorClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GFileEnumeratorClass *enumerator_class = G_FILE_ENUMERATOR_CLASS(klass);
+
+    gobject_class->finalize = _fm_latency_enumerator_finalize;
+    enumerator_class->next_file = _fm_latency_enumerator_next_file;
+    enumerator_class->close_fn = _fm_latency_enumerator_close;
+}
+
+static void fm_latency_enumerator_init(FmLatencyEnumerator *enumerator)
+{
+    /* nothing */
+}
+
+/* ---- FmLatencyVFile class ---- */
+static void fm_latency_g_file_init(GFileIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(FmLatencyVFile, fm_latency_vfile, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_FILE, fm_latency_g_file_init))
+
+static void fm_latency_vfile_finalize(GObject *object)
+{
+    FmLatencyVFile *item = FM_LATENCY_VFILE(object);
+
+    if(item->real)
+        g_object_unref(item->real);
+
+    G_OBJECT_CLASS(fm_latency_vfile_parent_class)->finalize(object);
+}
+
+static void fm_latency_vfile_class_init(FmLatencyVFileClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->finalize = fm_latency_vfile_finalize;
+}
+
+static void fm_latency_vfile_init(FmLatencyVFile *item)
+{
+    /* nothing */
+}
+
+/* ---- GFile implementation ---- */
+#define REAL(file) (FM_LATENCY_VFILE(file)->real)
+
+static GFile *_fm_latency_dup(GFile *file)
+{
+    return _fm_latency_vfile_new(g_file_dup(REAL(file)));
+}
+
+static guint _fm_latency_hash(GFile *file)
+{
+    return g_file_hash(REAL(file));
+}
+
+static gboolean _fm_latency_equal(GFile *file1, GFile *file2)
+{
+    return g_file_equal(REAL(file1), REAL(file2));
+}
+
+static gboolean _fm_latency_is_native(GFile *file)
+{
+    return FALSE;
+}
+
+static gboolean _fm_latency_has_uri_scheme(GFile *file, const char *uri_scheme)
+{
+    return g_ascii_strcasecmp(uri_scheme, LATENCY_SCHEME) == 0;
+}
+
+static char *_fm_latency_get_uri_scheme(GFile *file)
+{
+    return g_strdup(LATENCY_SCHEME);
+}
+
+static char *_fm_latency_get_basename(GFile *file)
+{
+    return g_file_get_basename(REAL(file));
+}
+
+static char *_fm_latency_get_path(GFile *file)
+{
+    /* like a remote file without a FUSE mount */
+    return NULL;
+}
+
+static char *_fm_latency_get_uri(GFile *file)
+{
+    char *real_uri = g_file_get_uri(REAL(file));
+    /* "file:///path" -> "latency:///path" */
+    char *uri = g_strconcat(LATENCY_SCHEME, real_uri + strlen("file"), NULL);
+    g_free(real_uri);
+    return uri;
+}
+
+static char *_fm_latency_get_parse_name(GFile *file)
+{
+    return _fm_latency_get_uri(file);
+}
+
+static GFile *_fm_latency_get_parent(GFile *file)
+{
+    return _fm_latency_vfile_new(g_file_get_parent(REAL(file)));
+}
+
+static gboolean _fm_latency_prefix_matches(GFile *prefix, GFile *file)
+{
+    return g_file_has_prefix(REAL(file), REAL(prefix));
+}
+
+static char *_fm_latency_get_relative_path(GFile *parent, GFile *descendant)
+{
+    return g_file_get_relative_path(REAL(parent), REAL(descendant));
+}
+
+static GFile *_fm_latency_resolve_relative_path(GFile *file, const char *relative_path)
+{
+    return _fm_latency_vfile_new(g_file_resolve_relative_path(REAL(file), relative_path));
+}
+
+static GFile *_fm_latency_get_child_for_display_name(GFile *file,
+                                                     const char *display_name,
+                                                     GError **error)
+{
+    return _fm_latency_vfile_new(g_file_get_child_for_display_name(REAL(file), display_name, error));
+}
+
+static GFileEnumerator *_fm_latency_enumerate_children(GFile *file,
+                                                       const char *attributes,
+                                                       GFileQueryInfoFlags flags,
+                                                       GCancellable *cancellable,
+                                                       GError **error)
+{
+    GFileEnumerator *real;
+    FmLatencyEnumerator *enumerator;
+
+    if(!_latency_round_trip(cancellable, error))
+        return NULL;
+    real = g_file_enumerate_children(REAL(file), attributes, flags, cancellable, error);
+    if(real == NULL)
+        return NULL;
+    enumerator = (FmLatencyEnumerator*)g_object_new(FM_TYPE_LATENCY_ENUMERATOR,
+                                                    "container", file, NULL);
+    enumerator->real = real;
+    return (GFileEnumerator*)enumerator;
+}
+
+static GFileInfo *_fm_latency_query_info(GFile *file,
+                                         const char *attributes,
+                                         GFileQueryInfoFlags flags,
+                                         GCancellable *cancellable,
+                                         GError **error)
+{
+    if(!_latency_round_trip(cancellable, error))
+        return NULL;
+    return g_file_query_info(REAL(file), attributes, flags, cancellable, error);
+}
+
+static GFileInfo *_fm_latency_query_filesystem_info(GFile *file,
+                                                    const char *attributes,
+                                                    GCancellable *cancellable,
+                                                    GError **error)
+{
+    GFileInfo *info;
+
+    if(!_latency_round_trip(cancellable, error))
+        return NULL;
+    info = g_file_query_filesystem_info(REAL(file), attributes, cancellable, error);
+    if(info)
+        g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE, TRUE);
+    return info;
+}
+
+static GMount *_fm_latency_find_enclosing_mount(GFile *file,
+                                                GCancellable *cancellable,
+                                                GError **error)
+{
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No mount");
+    return NULL;
+}
+
+static GFileInputStream *_fm_latency_read_fn(GFile *file,
+                                             GCancellable *cancellable,
+                                             GError **error)
+{
+    if(!_latency_round_trip(cancellable, error))
+        return NULL;
+    return g_file_read(REAL(file), cancellable, error);
+}
+
+static GFileMonitor *_fm_latency_monitor_dir(GFile *file,
+                                             GFileMonitorFlags flags,
+                                             GCancellable *cancellable,
+                                             GError **error)
+{
+    /* most remote filesystems can't be monitored */
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Operation not supported");
+    return NULL;
+}
+
+/* the other calls are not implemented, so GIO reports them as not supported */
+static void fm_latency_g_file_init(GFileIface *iface)
+{
+    iface->dup = _fm_latency_dup;
+    iface->hash = _fm_latency_hash;
+    iface->equal = _fm_latency_equal;
+    iface->is_native = _fm_latency_is_native;
+    iface->has_uri_scheme = _fm_latency_has_uri_scheme;
+    iface->get_uri_scheme = _fm_latency_get_uri_scheme;
+    iface->get_basename = _fm_latency_get_basename;
+    iface->get_path = _fm_latency_get_path;
+    iface->get_uri = _fm_latency_get_uri;
+    iface->get_parse_name = _fm_latency_get_parse_name;
+    iface->get_parent = _fm_latency_get_parent;
+    iface->prefix_matches = _fm_latency_prefix_matches;
+    iface->get_relative_path = _fm_latency_get_relative_path;
+    iface->resolve_relative_path = _fm_latency_resolve_relative_path;
+    iface->get_child_for_display_name = _fm_latency_get_child_for_display_name;
+    iface->enumerate_children = _fm_latency_enumerate_children;
+    iface->query_info = _fm_latency_query_info;
+    iface->query_filesystem_info = _fm_latency_query_filesystem_info;
+    iface->find_enclosing_mount = _fm_latency_find_enclosing_mount;
+    iface->read_fn = _fm_latency_read_fn;
+    iface->monitor_dir = _fm_latency_monitor_dir;
+    iface->supports_thread_contexts = TRUE;
+}
+
+
+/* ---- interface for loading ---- */
+static GFile *_fm_latency_new_for_uri(const char *uri)
+{
+    char *real_uri;
+    GFile *real;
+
+    if(g_ascii_strncasecmp(uri, LATENCY_SCHEME ":", strlen(LATENCY_SCHEME ":")) != 0)
+        return NULL;
+    real_uri = g_strconcat("file", uri + strlen(LATENCY_SCHEME), NULL);
+    real = g_file_new_for_uri(real_uri);
+    g_free(real_uri);
+    return _fm_latency_vfile_new(real);
+}
+
+static GFile *_fm_latency_lookup(GVfs *vfs, const char *identifier, gpointer user_data)
+{
+    return _fm_latency_new_for_uri(identifier);
+}
+
+void fm_latency_vfs_register(void)
+{
+    g_vfs_register_uri_scheme(g_vfs_get_default(), LATENCY_SCHEME,
+                              _fm_latency_lookup, NULL, NULL,
+                              _fm_latency_lookup, NULL, NULL);
+}
+
+void fm_latency_vfs_unregister(void)
+{
+    g_vfs_unregister_uri_scheme(g_vfs_get_default(), LATENCY_SCHEME);
+}
@@ -0,0 +1,37 @@
+/* A test-only VFS which adds the latency of a remote filesystem to local files */
+
+#ifndef __VFS_LATENCY_H__
+#define __VFS_LATENCY_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* "latency:///some/path" is the local "/some/path", and every call which would be a round trip
+ * to a remote server waits call_latency_us. The folders are listed at most entries_per_sec
+ * (0 means no limit), with a round trip per batch_size entries like the READDIR of sftp and smb.
+ * Each round trip fails with G_IO_ERROR_TIMED_OUT at failure_rate (0 to 1).
+ * The files are not native, so they're read through GIO, and they have no file monitor. */
+typedef struct _FmLatencyVfsConfig
+{
+    guint call_latency_us;
+    guint entries_per_sec;
+    guint batch_size;
+    double failure_rate;
+} FmLatencyVfsConfig;
+
+void fm_latency_vfs_set_config(const FmLatencyVfsConfig *config);
+
+void fm_latency_vfs_get_config(FmLatencyVfsConfig *config);
+
+/* the numbers of the round trips and the injected failures so far */
+void fm_latency_vfs_get_counts(guint64 *calls, guint64 *failures);
+
+/* registers the "latency" URI scheme to the default GVfs, like LibFmQt does for "search" */
+void fm_latency_vfs_register(void);
+
+void fm_latency_vfs_unregister(void);
+
+G_END_DECLS
+
+#endif /* __VFS_LATENCY_H__ */
@@ -19,6 +19,8 @@
 
 #include "utilities.h"
 #include "utilities_p.h"
+#include "filelistmimedata_p.h"
+#include "core/jobtrace_p.h"
 #include <QApplication>
 #include <QClipboard>
 #include <QMimeData>
@@ -66,7 +68,19 @@ Fm::FilePathList pathListFromQUrls(QList<QUrl> urls) {
     return pathList;
 }
 
+Fm::FilePathList pathListFromMimeData(const QMimeData& data) {
+    if(auto fileList = dynamic_cast<const FileListMimeData*>(&data)) {
+        return fileList->paths();
+    }
+    return pathListFromQUrls(data.urls());
+}
+
 std::pair<Fm::FilePathList, bool> parseClipboardData(const QMimeData& data) {
+    // the files are copied or cut in this program
+    if(auto fileList = dynamic_cast<const FileListMimeData*>(&data)) {
+        return std::make_pair(fileList->paths(), fileList->isCut());
+    }
+
     bool isCut = false;
     Fm::FilePathList paths;
 
@@ -116,35 +130,16 @@ void pasteFilesFromClipboard(const Fm::FilePath& destPath, QWidget* parent) {
 
 void copyFilesToClipboard(const Fm::FilePathList& files) {
     QClipboard* clipboard = QApplication::clipboard();
-    QMimeData* data = new QMimeData();
-    QByteArray ba;
-    auto urilist = pathListToUriList(files);
-
-    // Add current pid to trace cut/copy operations to current app
-    data->setData(QStringLiteral("text/x-libfmqt-pid"), ba.setNum(QCoreApplication::applicationPid()));
-    // Gnome, LXDE, and XFCE
-    // Note: the standard text/urilist format uses CRLF for line breaks, but gnome format uses LF only
-    data->setData("x-special/gnome-copied-files", QByteArray("copy\n") + urilist.replace("\r\n", "\n"));
-    // The KDE way
-    data->setData("text/uri-list", urilist);
-    // data->setData(QStringLiteral("application/x-kde-cutselection"), QByteArrayLiteral("0"));
+    // the uri lists are only built if another program pastes the files
+    auto data = new FileListMimeData{files};
+    data->setClipboardFormats(false);
     clipboard->setMimeData(data);
 }
 
 void cutFilesToClipboard(const Fm::FilePathList& files) {
     QClipboard* clipboard = QApplication::clipboard();
-    QMimeData* data = new QMimeData();
-    QByteArray ba;
-    auto urilist = pathListToUriList(files);
-
-    // Add current pid to trace cut/copy operations to current app
-    data->setData(QStringLiteral("text/x-libfmqt-pid"), ba.setNum(QCoreApplication::applicationPid()));
-    // Gnome, LXDE, and XFCE
-    // Note: the standard text/urilist format uses CRLF for line breaks, but gnome format uses LF only
-    data->setData("x-special/gnome-copied-files", QByteArray("cut\n") + urilist.replace("\r\n", "\n"));
-    // The KDE way
-    data->setData("text/uri-list", urilist);
-    data->setData(QStringLiteral("application/x-kde-cutselection"), QByteArrayLiteral("1"));
+    auto data = new FileListMimeData{files};
+    data->setClipboardFormats(true);
     clipboard->setMimeData(data);
 }
 
@@ -159,12 +154,17 @@ bool isCurrentPidClipboardData(const QMimeData& data) {
 bool changeFileName(const Fm::FilePath& filePath, const QString& newName, QWidget* parent, bool showMessage) {
     auto dest = filePath.parent().child(newName.toLocal8Bit().constData());
     Fm::GErrorPtr err;
-    if(!g_file_move(filePath.gfile().get(), dest.gfile().get(),
-                    GFileCopyFlags(G_FILE_COPY_ALL_METADATA |
-                                   G_FILE_COPY_NO_FALLBACK_FOR_MOVE |
-                                   G_FILE_COPY_NOFOLLOW_SYMLINKS),
-                    nullptr, /* make this cancellable later. */
-                    nullptr, nullptr, &err)) {
+    bool moved;
+    {
+        BlockingScope scope{"changeFileName"};
+        moved = g_file_move(filePath.gfile().get(), dest.gfile().get(),
+                            GFileCopyFlags(G_FILE_COPY_ALL_METADATA |
+                                           G_FILE_COPY_NO_FALLBACK_FOR_MOVE |
+                                           G_FILE_COPY_NOFOLLOW_SYMLINKS),
+                            nullptr, /* make this cancellable later. */
+                            nullptr, nullptr, &err);
+    }
+    if(!moved) {
         if (showMessage){
             QMessageBox::critical(parent, QObject::tr("Error"), err.message());
         }
@@ -240,15 +240,18 @@ _retry:
     Fm::GErrorPtr err;
     switch(type) {
     case CreateNewTextFile: {
+        BlockingScope scope{"createFileOrFolder"};
         Fm::GFileOutputStreamPtr f{g_file_create(dest.gfile().get(), G_FILE_CREATE_NONE, nullptr, &err), false};
         if(f) {
             g_output_stream_close(G_OUTPUT_STREAM(f.get()), nullptr, nullptr);
         }
         break;
     }
-    case CreateNewFolder:
+    case CreateNewFolder: {
+        BlockingScope scope{"createFileOrFolder"};
         g_file_make_directory(dest.gfile().get(), nullptr, &err);
         break;
+    }
     case CreateWithTemplate:
         // copy the template file to its destination
         FileOperation::copyFile(templ->filePath(), dest, parent);
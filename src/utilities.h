@@ -43,6 +43,10 @@ LIBFM_QT_API QByteArray pathListToUriList(const Fm::FilePathList& paths);
 
 LIBFM_QT_API Fm::FilePathList pathListFromQUrls(QList<QUrl> urls);
 
+// The paths of the files in the mime data of a drag or the clipboard. The paths are taken
+// directly from the data made by libfm-qt in the same program, instead of parsing its urls.
+LIBFM_QT_API Fm::FilePathList pathListFromMimeData(const QMimeData& data);
+
 LIBFM_QT_API std::pair<Fm::FilePathList, bool> parseClipboardData(const QMimeData& data);
 
 LIBFM_QT_API void pasteFilesFromClipboard(const Fm::FilePath& destPath, QWidget* parent = 0);